@@ -43,14 +43,52 @@ using namespace Windows::Storage::Streams;
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
+// the event thread never waits for the UWP peer. while a message is in flight
+// everything written in the meantime is collected into the next message. the
+// order of concurrently sent messages is not guaranteed, therefore only one
+// message is in flight at a time
+static void app_service_send_pending(AppService_ *app_service) {
+	ValueSet ^value_set;
+
+	if (app_service->send_task != nullptr || app_service->pending_length == 0) {
+		return;
+	}
+
+	if (app_service->connection == nullptr) { // got closed, drop pending data
+		app_service->pending_length = 0;
+
+		return;
+	}
+
+	value_set = ref new ValueSet();
+
+	value_set->Insert("data", ref new Array<uint8_t>(app_service->pending, app_service->pending_length));
+
+	app_service->pending_length = 0;
+	app_service->send_task = new task<void>(create_task(app_service->connection->SendMessageAsync(value_set))
+	.then([app_service](task<AppServiceResponse ^> previous) {
+		int status;
+
+		try {
+			status = (int)previous.get()->Status;
+		} catch (...) {
+			status = -1;
+		}
+
+		if (pipe_write(&app_service->sent_pipe, &status, sizeof(status)) < 0) {
+			log_error("Could not write to AppService (caller: %s) sent pipe: %s (%d)",
+			          app_service->caller, get_errno_name(errno), errno);
+		}
+	}));
+}
+
 static void app_service_forward_write(void *opaque) {
 	AppService_ *app_service = (AppService_ *)opaque;
-	uint8_t buffer[1024];
 	int length;
-	ValueSet ^value_set;
-	Array<uint8_t> ^data;
 
-	length = pipe_read(&app_service->write_pipe, buffer, sizeof(buffer));
+	length = pipe_read(&app_service->write_pipe,
+	                   app_service->pending + app_service->pending_length,
+	                   sizeof(app_service->pending) - app_service->pending_length);
 
 	if (length < 0) {
 		log_error("Could not read from AppService (caller: %s) write pipe: %s (%d)",
@@ -59,13 +97,60 @@ static void app_service_forward_write(void *opaque) {
 		return;
 	}
 
-	value_set = ref new ValueSet();
-	data = ref new Array<uint8_t>(length); // FIXME: how to handle length == 0?
+	app_service->pending_length += length;
+
+	app_service_send_pending(app_service);
+
+	if (app_service->pending_length < (int)sizeof(app_service->pending)) {
+		return;
+	}
 
-	memcpy(data->Data, buffer, length);
-	value_set->Insert("data", data);
+	// stop reading the write pipe until the message in flight was sent
+	if (event_modify_source(app_service->write_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                        EVENT_READ, 0, NULL, NULL) < 0) {
+		log_error("Could not pause AppService (caller: %s) write pipe",
+		          app_service->caller);
 
-	create_task(app_service->connection->SendMessageAsync(value_set)).wait(); // FIXME: look at response status?
+		return;
+	}
+
+	app_service->write_pipe_paused = true;
+}
+
+static void app_service_handle_sent(void *opaque) {
+	AppService_ *app_service = (AppService_ *)opaque;
+	int status;
+
+	if (pipe_read(&app_service->sent_pipe, &status, sizeof(status)) < 0) {
+		log_error("Could not read from AppService (caller: %s) sent pipe: %s (%d)",
+		          app_service->caller, get_errno_name(errno), errno);
+
+		return;
+	}
+
+	delete app_service->send_task;
+	app_service->send_task = nullptr;
+
+	if (status != (int)AppServiceResponseStatus::Success) {
+		log_warn("Could not send message to AppService (caller: %s) (status: %d)",
+		         app_service->caller, status);
+	}
+
+	app_service_send_pending(app_service);
+
+	if (!app_service->write_pipe_paused) {
+		return;
+	}
+
+	if (event_modify_source(app_service->write_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                        0, EVENT_READ, app_service_forward_write, app_service) < 0) {
+		log_error("Could not resume AppService (caller: %s) write pipe",
+		          app_service->caller);
+
+		return;
+	}
+
+	app_service->write_pipe_paused = false;
 }
 
 static void app_service_handle_close(void *opaque) {
@@ -162,12 +247,28 @@ extern "C" int app_service_create(AppService_ *app_service, const char *caller,
 
 	phase = 5;
 
+	if (pipe_create(&app_service->sent_pipe, 0) < 0) {
+		goto error;
+	}
+
+	phase = 6;
+
+	if (event_add_source(app_service->sent_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, app_service_handle_sent, app_service) < 0) {
+		goto error;
+	}
+
+	phase = 7;
+
 	app_service->base.read_handle = app_service->read_pipe.base.read_handle;
 	app_service->base.write_handle = app_service->write_pipe.base.write_handle;
 
 	string_copy(app_service->caller, sizeof(app_service->caller), caller, -1);
 	app_service->deferral = deferral;
 	app_service->connection = connection;
+	app_service->send_task = nullptr;
+	app_service->write_pipe_paused = false;
+	app_service->pending_length = 0;
 
 	connection->RequestReceived += ref new TypedEventHandler<AppServiceConnection ^, AppServiceRequestReceivedEventArgs ^>(
 	[app_service](AppServiceConnection ^sender, AppServiceRequestReceivedEventArgs ^args) {
@@ -199,6 +300,14 @@ error:
 	saved_errno = errno;
 
 	switch (phase) { // no breaks, all cases fall through intentionally
+	case 7:
+		event_remove_source(app_service->sent_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+		// fall through
+
+	case 6:
+		pipe_destroy(&app_service->sent_pipe);
+		// fall through
+
 	case 5:
 		event_remove_source(app_service->close_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
 		// fall through
@@ -229,6 +338,19 @@ error:
 }
 
 extern "C" void app_service_destroy(AppService_ *app_service) {
+	// the message in flight signals the sent pipe on completion
+	if (app_service->send_task != nullptr) {
+		try {
+			app_service->send_task->wait();
+		} catch (...) {
+		}
+
+		delete app_service->send_task;
+	}
+
+	event_remove_source(app_service->sent_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&app_service->sent_pipe);
+
 	event_remove_source(app_service->close_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
 	pipe_destroy(&app_service->close_pipe);
 
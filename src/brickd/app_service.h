@@ -23,8 +23,10 @@
 #define BRICKD_APP_SERVICE_H
 
 #include <agile.h>
+#include <ppltasks.h>
 
 #define APP_SERVICE_MAX_CALLER_LENGTH 128
+#define APP_SERVICE_MAX_MESSAGE_LENGTH 65536
 
 typedef Platform::Agile<Windows::ApplicationModel::AppService::AppServiceConnection ^> AgileAppServiceConnection;
 typedef Platform::Agile<Windows::ApplicationModel::Background::BackgroundTaskDeferral ^> AgileBackgroundTaskDeferral;
@@ -43,8 +45,13 @@ typedef struct {
 	Pipe read_pipe;
 	Pipe write_pipe;
 	Pipe close_pipe;
+	Pipe sent_pipe; // signals the event thread that a message was sent
 	AgileBackgroundTaskDeferral deferral;
 	AgileAppServiceConnection connection;
+	concurrency::task<void> *send_task; // nullptr if no message is in flight
+	bool write_pipe_paused; // while the pending buffer is full
+	int pending_length;
+	uint8_t pending[APP_SERVICE_MAX_MESSAGE_LENGTH]; // data for the next message
 } AppService_;
 
 int app_service_create(AppService_ *app_service, const char *caller,
@@ -28,16 +28,30 @@
 #include <daemonlib/config.h>
 #include <daemonlib/event.h>
 #include <daemonlib/log.h>
+#include <daemonlib/timer.h>
 #include <daemonlib/utils.h>
 
 #include "client.h"
 
+#include "enumerate_cache.h"
+#include "event_profile.h"
 #include "hardware.h"
 #include "hmac.h"
+#ifdef BRICKD_WITH_IO_THREADS
+	#include "io_worker.h"
+#endif
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_debug.h"
+#include "packet_log.h"
+#include "response_cache.h"
+#include "response_latency.h"
 #ifdef BRICKD_WITH_RED_BRICK
+	#include "redapid.h"
+	#include "red_stack.h"
 	#include "red_usb_gadget.h"
 #endif
+#include "usb.h"
 #include "zombie.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
@@ -46,6 +60,227 @@ extern uint8_t _redapid_version[3];
 
 #define UID_BRICK_DAEMON 1
 
+#define FUNCTION_ADD_CALLBACK_FILTER 3
+#define FUNCTION_CLEAR_CALLBACK_FILTERS 4
+#define FUNCTION_GET_QUEUE_STATISTICS 5
+#define FUNCTION_GET_USB_STACK_STATISTICS 6
+#define FUNCTION_GET_USB_STACK_LATENCY_HISTOGRAM 7
+#define FUNCTION_GET_SPI_STACK_STATISTICS 8
+#define FUNCTION_GET_SPI_STACK_LATENCY_HISTOGRAM 9
+#define FUNCTION_GET_REDAPID_LINK_STATISTICS 10
+#define FUNCTION_GET_STACK_LATENCY_HISTOGRAM 11
+#define FUNCTION_GET_FUNCTION_LATENCY_HISTOGRAM 12
+#define FUNCTION_DUMP_PACKET_LOG 13
+#define FUNCTION_SET_CALLBACK_RATE_LIMIT 14
+#define FUNCTION_GET_SESSION_TOKEN 15
+#define FUNCTION_RESUME_SESSION 16
+
+#define STACK_LATENCY_HISTOGRAM_NAME_LENGTH 15
+
+#include <daemonlib/packed_begin.h>
+
+typedef struct {
+	PacketHeader header;
+	uint32_t uid;
+	uint8_t function_id;
+} ATTRIBUTE_PACKED AddCallbackFilterRequest;
+
+typedef struct {
+	PacketHeader header;
+} ATTRIBUTE_PACKED ClearCallbackFiltersRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint32_t uid;
+	uint8_t function_id;
+	uint32_t period; // milliseconds, 0 removes the rate limit
+} ATTRIBUTE_PACKED SetCallbackRateLimitRequest;
+
+typedef struct {
+	PacketHeader header;
+} ATTRIBUTE_PACKED GetSessionTokenRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t session_token[CLIENT_SESSION_TOKEN_LENGTH];
+} ATTRIBUTE_PACKED GetSessionTokenResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t session_token[CLIENT_SESSION_TOKEN_LENGTH];
+} ATTRIBUTE_PACKED ResumeSessionRequest;
+
+typedef struct {
+	PacketHeader header;
+} ATTRIBUTE_PACKED GetQueueStatisticsRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint32_t queued_responses;
+	uint32_t queued_bytes;
+	uint32_t peak_queued_responses;
+	uint32_t dropped_callbacks;
+} ATTRIBUTE_PACKED GetQueueStatisticsResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t index;
+} ATTRIBUTE_PACKED GetUSBStackStatisticsRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t stack_count;
+	uint8_t bus_number;
+	uint8_t device_address;
+	uint32_t packets_in;
+	uint32_t packets_out;
+	uint32_t bytes_in;
+	uint32_t bytes_out;
+	uint32_t peak_queued_writes;
+	uint32_t dropped_requests;
+	uint32_t submit_failures;
+	uint32_t stall_recoveries;
+} ATTRIBUTE_PACKED GetUSBStackStatisticsResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t index;
+} ATTRIBUTE_PACKED GetUSBStackLatencyHistogramRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t stack_count;
+	uint8_t bus_number;
+	uint8_t device_address;
+	uint32_t latency_histogram[USB_STACK_LATENCY_BUCKETS];
+} ATTRIBUTE_PACKED GetUSBStackLatencyHistogramResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t index;
+} ATTRIBUTE_PACKED GetStackLatencyHistogramRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t stack_count;
+	char name[STACK_LATENCY_HISTOGRAM_NAME_LENGTH]; // truncated, not NUL-terminated if full
+	uint32_t latency_histogram[RESPONSE_LATENCY_BUCKETS];
+} ATTRIBUTE_PACKED GetStackLatencyHistogramResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint16_t index;
+} ATTRIBUTE_PACKED GetFunctionLatencyHistogramRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint16_t function_count;
+	uint16_t device_identifier;
+	uint8_t function_id;
+	uint32_t latency_histogram[RESPONSE_LATENCY_BUCKETS];
+} ATTRIBUTE_PACKED GetFunctionLatencyHistogramResponse;
+
+typedef struct {
+	PacketHeader header;
+} ATTRIBUTE_PACKED DumpPacketLogRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint32_t record_count;
+} ATTRIBUTE_PACKED DumpPacketLogResponse;
+
+#ifdef BRICKD_WITH_RED_BRICK
+
+typedef struct {
+	PacketHeader header;
+	uint8_t index;
+} ATTRIBUTE_PACKED GetSPIStackStatisticsRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t slave_count;
+	uint8_t stack_address;
+	uint32_t transfers;
+	uint32_t packets_in;
+	uint32_t packets_out;
+	uint32_t retransmits;
+	uint32_t sequence_mismatches;
+	uint32_t checksum_errors;
+	uint32_t length_errors;
+	uint32_t preamble_errors;
+	uint32_t transfer_errors;
+	uint32_t queued_requests;
+	uint32_t peak_queued_requests;
+	uint32_t transceive_time; // milliseconds
+	uint32_t sleep_time; // milliseconds
+} ATTRIBUTE_PACKED GetSPIStackStatisticsResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t index;
+} ATTRIBUTE_PACKED GetSPIStackLatencyHistogramRequest;
+
+typedef struct {
+	PacketHeader header;
+	uint8_t slave_count;
+	uint8_t stack_address;
+	uint32_t latency_histogram[RED_STACK_LATENCY_BUCKETS];
+} ATTRIBUTE_PACKED GetSPIStackLatencyHistogramResponse;
+
+typedef struct {
+	PacketHeader header;
+} ATTRIBUTE_PACKED GetREDAPIDLinkStatisticsRequest;
+
+typedef struct {
+	PacketHeader header;
+	bool connected;
+	uint32_t connects;
+	uint32_t packets_in;
+	uint32_t packets_out;
+	uint32_t bytes_in; // wraps around
+	uint32_t bytes_out; // wraps around
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t dropped_requests;
+	uint32_t peak_buffered_bytes;
+} ATTRIBUTE_PACKED GetREDAPIDLinkStatisticsResponse;
+
+#endif
+
+#include <daemonlib/packed_end.h>
+
+// pending requests are allocated from a fixed-size pool first and only fall
+// back to the heap if the pool is exhausted. slots that were never used are
+// handed out in order, returned slots are kept in a free list that is linked
+// through their global_node
+static PendingRequest _pending_request_pool[PENDING_REQUEST_POOL_SIZE];
+static int _pending_request_pool_used = 0;
+static Node _pending_request_pool_free_sentinel = {
+	&_pending_request_pool_free_sentinel, &_pending_request_pool_free_sentinel
+};
+static uint32_t _pending_request_pool_hits = 0;
+static uint32_t _pending_request_pool_misses = 0;
+
+static void client_send_empty_response(Client *client, Packet *request,
+                                       PacketE error_code) {
+	union {
+		EmptyResponse response;
+		Packet packet;
+	} u;
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+
+	packet_header_set_error_code(&u.response.header, error_code);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
 static void client_handle_get_authentication_nonce_request(Client *client,
                                                            GetAuthenticationNonceRequest *request) {
 	union {
@@ -57,7 +292,7 @@ static void client_handle_get_authentication_nonce_request(Client *client,
 		log_error("Client ("CLIENT_SIGNATURE_FORMAT") tries to authenticate, but authentication is disabled, disconnecting client",
 		          client_expand_signature(client));
 
-		client->disconnected = true;
+		client_mark_as_disconnected(client);
 
 		return;
 	}
@@ -75,7 +310,7 @@ static void client_handle_get_authentication_nonce_request(Client *client,
 		          client_get_authentication_state_name(client->authentication_state),
 		          client_get_authentication_state_name(CLIENT_AUTHENTICATION_STATE_NONCE_SEND));
 
-		client->disconnected = true;
+		client_mark_as_disconnected(client);
 
 		return;
 	}
@@ -100,7 +335,7 @@ static void client_handle_authenticate_request(Client *client,
                                                AuthenticateRequest *request) {
 	uint32_t nonces[2];
 	uint8_t digest[SHA1_DIGEST_LENGTH];
-	const char *secret;
+	HMACSHA1Key *authentication_key;
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 	union {
 		AuthenticateResponse response;
@@ -111,7 +346,7 @@ static void client_handle_authenticate_request(Client *client,
 		log_error("Client ("CLIENT_SIGNATURE_FORMAT") tries to authenticate, but authentication is disabled, disconnecting client",
 		          client_expand_signature(client));
 
-		client->disconnected = true;
+		client_mark_as_disconnected(client);
 
 		return;
 	}
@@ -122,7 +357,7 @@ static void client_handle_authenticate_request(Client *client,
 		          client_get_authentication_state_name(client->authentication_state),
 		          client_get_authentication_state_name(CLIENT_AUTHENTICATION_STATE_DONE));
 
-		client->disconnected = true;
+		client_mark_as_disconnected(client);
 
 		return;
 	}
@@ -130,17 +365,18 @@ static void client_handle_authenticate_request(Client *client,
 	memcpy(&nonces[0], &client->authentication_nonce, sizeof(client->authentication_nonce));
 	memcpy(&nonces[1], request->client_nonce, sizeof(request->client_nonce));
 
-	secret = config_get_option_value("authentication.secret")->string;
+	// authentication cannot be disabled at runtime, so the key exists if
+	// the client is in the nonce-send state
+	authentication_key = network_get_authentication_key();
 
-	hmac_sha1((uint8_t *)secret, strlen(secret),
-	          (uint8_t *)nonces, sizeof(nonces), digest);
+	hmac_sha1_with_key(authentication_key, (uint8_t *)nonces, sizeof(nonces), digest);
 
 	if (memcmp(request->digest, digest, SHA1_DIGEST_LENGTH) != 0) {
 		log_error("Authenticate request (%s) from client ("CLIENT_SIGNATURE_FORMAT") did not contain the expected data, disconnecting client",
 		          packet_get_request_signature(packet_signature, (Packet *)request),
 		          client_expand_signature(client));
 
-		client->disconnected = true;
+		client_mark_as_disconnected(client);
 
 		return;
 	}
@@ -165,321 +401,1709 @@ static void client_handle_authenticate_request(Client *client,
 	}
 }
 
-static void client_handle_request(Client *client, Packet *request) {
-	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+// the token is issued once per session and stays the same across
+// resumptions. it identifies the session instead of the authentication
+// handshake, so it has to be unguessable
+static void client_handle_get_session_token_request(Client *client,
+                                                    GetSessionTokenRequest *request) {
 	union {
-		EmptyResponse response;
+		GetSessionTokenResponse response;
 		Packet packet;
 	} u;
+	uint32_t random;
+	int i;
 
-	packet_add_trace(request);
+	if (!config_get_option_value("listen.session_resumption")->boolean) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_FUNCTION_NOT_SUPPORTED);
 
-	// handle requests meant for brickd
-	if (uint32_from_le(request->header.uid) == UID_BRICK_DAEMON) {
-		// add as pending request if response is expected
-		if (packet_header_get_response_expected(&request->header)) {
-			network_client_expects_response(client, request);
+		return;
+	}
+
+	if (!client->session_resumable) {
+		for (i = 0; i < CLIENT_SESSION_TOKEN_LENGTH; i += (int)sizeof(random)) {
+			random = get_random_uint32();
+
+			memcpy(&client->session_token[i], &random, sizeof(random));
 		}
 
-		if (request->header.function_id == FUNCTION_GET_AUTHENTICATION_NONCE) {
-			if (request->header.length != sizeof(GetAuthenticationNonceRequest)) {
-				log_error("Received authentication-nonce request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
-				          packet_get_request_signature(packet_signature, request),
-				          client_expand_signature(client));
+		client->session_resumable = true;
 
-				client->disconnected = true;
+		log_debug("Issued session token to client ("CLIENT_SIGNATURE_FORMAT")",
+		          client_expand_signature(client));
+	}
 
-				return;
-			}
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
 
-			client_handle_get_authentication_nonce_request(client, (GetAuthenticationNonceRequest *)request);
-		} else if (request->header.function_id == FUNCTION_AUTHENTICATE) {
-			if (request->header.length != sizeof(AuthenticateRequest)) {
-				log_error("Received authenticate request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
-				          packet_get_request_signature(packet_signature, request),
-				          client_expand_signature(client));
+	memcpy(u.response.session_token, client->session_token, sizeof(u.response.session_token));
 
-				client->disconnected = true;
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
 
-				return;
-			}
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
 
-			client_handle_authenticate_request(client, (AuthenticateRequest *)request);
-		} else if (packet_header_get_response_expected(&request->header)) {
-			u.response.header = request->header;
-			u.response.header.length = sizeof(u.response);
+// allowed before authentication, because the session token stands in for it.
+// a session that timed out is reported as invalid parameter, the client has
+// to start over with a new session then
+static void client_handle_resume_session_request(Client *client,
+                                                 ResumeSessionRequest *request) {
+	Zombie *zombie = NULL;
+	union {
+		EmptyResponse response;
+		Packet packet;
+	} u;
+
+	if (config_get_option_value("listen.session_resumption")->boolean) {
+		zombie = network_find_resumable_zombie(request->session_token);
+	}
+
+	if (zombie == NULL) {
+		log_debug("Client ("CLIENT_SIGNATURE_FORMAT") tries to resume an unknown or timed out session",
+		          client_expand_signature(client));
+	} else {
+		zombie_resume(zombie, client);
+	}
 
-			packet_header_set_error_code(&u.response.header,
-			                             PACKET_E_FUNCTION_NOT_SUPPORTED);
+	if (packet_header_get_response_expected(&request->header)) {
+		u.response.header = request->header;
+		u.response.header.length = sizeof(u.response);
+
+		packet_header_set_error_code(&u.response.header,
+		                             zombie != NULL ? PACKET_E_SUCCESS : PACKET_E_INVALID_PARAMETER);
 
 #ifdef DAEMONLIB_WITH_PACKET_TRACE
-			u.packet.trace_id = packet_get_next_response_trace_id();
+		u.packet.trace_id = packet_get_next_response_trace_id();
 #endif
 
-			packet_add_trace(&u.packet);
-			client_dispatch_response(client, NULL, &u.packet, false, false);
-		}
-	} else if (client->authentication_state == CLIENT_AUTHENTICATION_STATE_DISABLED ||
-	           client->authentication_state == CLIENT_AUTHENTICATION_STATE_DONE) {
-		// add as pending request if response is expected...
-		if (packet_header_get_response_expected(&request->header)) {
-			network_client_expects_response(client, request);
-		}
-
-		// ...then dispatch it to the hardware
-		packet_add_trace(request);
-		hardware_dispatch_request(request);
-	} else {
-		log_packet_debug("Client ("CLIENT_SIGNATURE_FORMAT") is not authenticated, dropping request (%s)",
-		                 client_expand_signature(client),
-		                 packet_get_request_signature(packet_signature, request));
+		packet_add_trace(&u.packet);
+		client_dispatch_response(client, NULL, &u.packet, false, true);
 	}
 }
 
-static void client_handle_read(void *opaque) {
-	Client *client = opaque;
-	int length;
-	const char *message = NULL;
-	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
-	Packet request;
+static void client_handle_add_callback_filter_request(Client *client,
+                                                     AddCallbackFilterRequest *request) {
+	int i;
+	ClientCallbackFilter *filter;
+	PacketE error_code = PACKET_E_SUCCESS;
+	char base58[BASE58_MAX_LENGTH];
 
-	length = io_read(client->io, client->buffer + client->buffer_used,
-	                 sizeof(client->buffer) - client->buffer_used);
+	for (i = 0; i < client->callback_filters.count; ++i) {
+		filter = array_get(&client->callback_filters, i);
 
-	if (length == 0) {
-		log_info("Client ("CLIENT_SIGNATURE_FORMAT") disconnected by peer",
-		         client_expand_signature(client));
+		if (filter->uid == request->uid && filter->function_id == request->function_id) {
+			goto done; // already added
+		}
+	}
 
-		client->disconnected = true;
+	if (client->callback_filters.count >= CLIENT_MAX_CALLBACK_FILTERS) {
+		log_warn("Client ("CLIENT_SIGNATURE_FORMAT") tries to add more than %d callback filters",
+		         client_expand_signature(client), CLIENT_MAX_CALLBACK_FILTERS);
 
-		return;
+		error_code = PACKET_E_INVALID_PARAMETER;
+
+		goto done;
 	}
 
-	if (length < 0) {
-		if (length == IO_CONTINUE) {
-			// no actual data received
-		} else if (errno_interrupted()) {
-			log_debug("Receiving from client ("CLIENT_SIGNATURE_FORMAT") was interrupted, retrying",
-			          client_expand_signature(client));
-		} else if (errno_would_block()) {
-			log_debug("Receiving from client ("CLIENT_SIGNATURE_FORMAT") would block, retrying",
-			          client_expand_signature(client));
-		} else {
-			log_error("Could not receive from client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
-			          client_expand_signature(client), get_errno_name(errno), errno);
+	filter = array_append(&client->callback_filters);
 
-			client->disconnected = true;
-		}
+	if (filter == NULL) {
+		log_error("Could not append to callback filter array of client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+		          client_expand_signature(client), get_errno_name(errno), errno);
 
-		return;
+		error_code = PACKET_E_UNKNOWN_ERROR;
+
+		goto done;
 	}
 
-	client->buffer_used += length;
+	filter->uid = request->uid;
+	filter->function_id = request->function_id;
 
-	while (!client->disconnected && client->buffer_used > 0) {
-		if (client->buffer_used < (int)sizeof(PacketHeader)) {
-			// wait for complete header
-			break;
-		}
+	log_debug("Added callback filter (uid: %s, function-id: %u) for client ("CLIENT_SIGNATURE_FORMAT")",
+	          base58_encode(base58, uint32_from_le(filter->uid)), filter->function_id,
+	          client_expand_signature(client));
 
-		if (!client->header_checked) {
-			if (!packet_header_is_valid_request(&client->request.header, &message)) {
-				// FIXME: include packet_get_content_dump output in the error message
-				log_error("Received invalid request (%s) from client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s",
-				          packet_get_request_signature(packet_signature, &client->request),
-				          client_expand_signature(client), message);
+done:
+	if (packet_header_get_response_expected(&request->header)) {
+		client_send_empty_response(client, (Packet *)request, error_code);
+	}
+}
 
-				client->disconnected = true;
+static void client_handle_clear_callback_filters_request(Client *client,
+                                                         ClearCallbackFiltersRequest *request) {
+	log_debug("Clearing %d callback filter(s) for client ("CLIENT_SIGNATURE_FORMAT")",
+	          client->callback_filters.count, client_expand_signature(client));
 
-				return;
-			}
+	array_resize(&client->callback_filters, 0, NULL);
 
-			client->header_checked = true;
-		}
+	if (packet_header_get_response_expected(&request->header)) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_SUCCESS);
+	}
+}
+
+static void client_handle_set_callback_rate_limit_request(Client *client,
+                                                          SetCallbackRateLimitRequest *request) {
+	int i;
+	ClientCallbackRateLimit *rate_limit;
+	Packet latest;
+	bool deliver_latest = false;
+	PacketE error_code = PACKET_E_SUCCESS;
+	char base58[BASE58_MAX_LENGTH];
+	uint32_t period = uint32_from_le(request->period);
+
+	// decimation keeps one callback per rate limit, this doesn't work for
+	// wildcards that match callbacks of different devices or functions
+	if (request->uid == 0 || request->function_id == 0) {
+		log_warn("Client ("CLIENT_SIGNATURE_FORMAT") tries to set callback rate limit without UID or function ID",
+		         client_expand_signature(client));
 
-		length = client->request.header.length;
+		error_code = PACKET_E_INVALID_PARAMETER;
 
-		if (client->buffer_used < length) {
-			// wait for complete packet
+		goto done;
+	}
+
+	for (i = 0; i < client->callback_rate_limits.count; ++i) {
+		rate_limit = array_get(&client->callback_rate_limits, i);
+
+		if (rate_limit->uid == request->uid && rate_limit->function_id == request->function_id) {
 			break;
 		}
+	}
 
-		if (client->request.header.function_id == FUNCTION_DISCONNECT_PROBE) {
-			log_packet_debug("Received disconnect probe from client ("CLIENT_SIGNATURE_FORMAT"), dropping request",
-			                 client_expand_signature(client));
+	if (i < client->callback_rate_limits.count) {
+		if (period > 0) {
+			rate_limit->period = (uint64_t)period * 1000;
 		} else {
-			memcpy(&request, client->buffer, length);
+			// don't lose the latest value, send it right after removal
+			if (rate_limit->held) {
+				memcpy(&latest, &rate_limit->latest, rate_limit->latest.header.length);
 
-#ifdef DAEMONLIB_WITH_PACKET_TRACE
-			request.trace_id = packet_get_next_request_trace_id();
-#endif
+				deliver_latest = true;
+			}
 
-			log_packet_debug("Received request (%s) from client ("CLIENT_SIGNATURE_FORMAT")",
-			                 packet_get_request_signature(packet_signature, &request),
-			                 client_expand_signature(client));
+			array_remove(&client->callback_rate_limits, i, NULL);
+		}
+	} else if (period > 0) {
+		if (client->callback_rate_limits.count >= CLIENT_MAX_CALLBACK_RATE_LIMITS) {
+			log_warn("Client ("CLIENT_SIGNATURE_FORMAT") tries to set more than %d callback rate limits",
+			         client_expand_signature(client), CLIENT_MAX_CALLBACK_RATE_LIMITS);
+
+			error_code = PACKET_E_INVALID_PARAMETER;
 
-			client_handle_request(client, &request);
+			goto done;
 		}
 
-		memmove(client->buffer, &client->buffer[length],
-		        client->buffer_used - length);
+		rate_limit = array_append(&client->callback_rate_limits);
 
-		client->buffer_used -= length;
-		client->header_checked = false;
-	}
-}
+		if (rate_limit == NULL) {
+			log_error("Could not append to callback rate limit array of client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+			          client_expand_signature(client), get_errno_name(errno), errno);
 
-void pending_request_remove_and_free(PendingRequest *pending_request) {
-	node_remove(&pending_request->global_node);
-	node_remove(&pending_request->client_node);
+			error_code = PACKET_E_UNKNOWN_ERROR;
 
-	if (pending_request->client != NULL) {
-		--pending_request->client->pending_request_count;
-	}
+			goto done;
+		}
 
-	if (pending_request->zombie != NULL) {
-		--pending_request->zombie->pending_request_count;
+		rate_limit->uid = request->uid;
+		rate_limit->function_id = request->function_id;
+		rate_limit->period = (uint64_t)period * 1000;
+		rate_limit->last_delivery = 0;
+		rate_limit->held = false;
 	}
 
-	free(pending_request);
-}
+	log_debug("Set callback rate limit (uid: %s, function-id: %u, period: %u msec) for client ("CLIENT_SIGNATURE_FORMAT")",
+	          base58_encode(base58, uint32_from_le(request->uid)), request->function_id,
+	          period, client_expand_signature(client));
 
-const char *client_get_authentication_state_name(ClientAuthenticationState state) {
-	switch (state) {
-	case CLIENT_AUTHENTICATION_STATE_DISABLED:   return "disabled";
-	case CLIENT_AUTHENTICATION_STATE_ENABLED:    return "enabled";
-	case CLIENT_AUTHENTICATION_STATE_NONCE_SEND: return "nonce-send";
-	case CLIENT_AUTHENTICATION_STATE_DONE:       return "done";
+done:
+	if (packet_header_get_response_expected(&request->header)) {
+		client_send_empty_response(client, (Packet *)request, error_code);
+	}
 
-	default:                                     return "<unknown>";
+	if (deliver_latest) {
+		client_broadcast_response(client, &latest);
 	}
 }
 
-static char *client_get_recipient_signature(char *signature, bool upper, void *opaque) {
-	Client *client = opaque;
+static void client_handle_get_queue_statistics_request(Client *client,
+                                                       GetQueueStatisticsRequest *request) {
+	union {
+		GetQueueStatisticsResponse response;
+		Packet packet;
+	} u;
 
-	snprintf(signature, WRITER_MAX_RECIPIENT_SIGNATURE_LENGTH,
-	         "%client ("CLIENT_SIGNATURE_FORMAT")",
-	         upper ? 'C' : 'c', client_expand_signature(client));
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.queued_responses = uint32_to_le(client->queued_responses);
+	u.response.queued_bytes = uint32_to_le(client->queued_bytes);
+	u.response.peak_queued_responses = uint32_to_le(client->peak_queued_responses);
+	u.response.dropped_callbacks = uint32_to_le(client->dropped_callbacks);
 
-	return signature;
-}
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
 
-static void client_recipient_disconnect(void *opaque) {
-	Client *client = opaque;
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
 
-	client->disconnected = true;
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
 }
 
-int client_create(Client *client, const char *name, IO *io,
-                  uint32_t authentication_nonce,
-                  ClientDestroyDoneFunction destroy_done) {
-	log_debug("Creating client from %s (handle: %d/%d)",
-	          io->type, io->read_handle, io->write_handle);
-
-	string_copy(client->name, sizeof(client->name), name, -1);
+// USB stacks are addressed by their index, the response contains the number of
+// USB stacks, so a monitoring tool can iterate them starting at index 0
+static void client_handle_get_usb_stack_statistics_request(Client *client,
+                                                           GetUSBStackStatisticsRequest *request) {
+	USBStack *usb_stack = usb_get_stack(request->index);
+	union {
+		GetUSBStackStatisticsResponse response;
+		Packet packet;
+	} u;
 
-	client->io = io;
-	client->disconnected = false;
-	client->buffer_used = 0;
-	client->header_checked = false;
-	client->pending_request_count = 0;
-	client->authentication_state = CLIENT_AUTHENTICATION_STATE_DISABLED;
-	client->authentication_nonce = authentication_nonce;
-	client->destroy_done = destroy_done;
+	if (usb_stack == NULL) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
 
-	if (config_get_option_value("authentication.secret")->string != NULL) {
-		client->authentication_state = CLIENT_AUTHENTICATION_STATE_ENABLED;
+		return;
 	}
 
-	node_reset(&client->pending_request_sentinel);
-
-	// create response writer
-	if (writer_create(&client->response_writer, client->io,
-	                  "response", packet_get_response_signature,
-	                  "client", client_get_recipient_signature,
-	                  client_recipient_disconnect, client) < 0) {
-		log_error("Could not create response writer: %s (%d)",
-		          get_errno_name(errno), errno);
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.stack_count = (uint8_t)MIN(usb_get_stack_count(), 255);
+	u.response.bus_number = usb_stack->bus_number;
+	u.response.device_address = usb_stack->device_address;
+	u.response.packets_in = uint32_to_le(usb_stack->statistics.packets_in);
+	u.response.packets_out = uint32_to_le(usb_stack->statistics.packets_out);
+	u.response.bytes_in = uint32_to_le(usb_stack->statistics.bytes_in);
+	u.response.bytes_out = uint32_to_le(usb_stack->statistics.bytes_out);
+	u.response.peak_queued_writes = uint32_to_le(usb_stack->statistics.peak_queued_writes);
+	u.response.dropped_requests = uint32_to_le(usb_stack->statistics.dropped_requests);
+	u.response.submit_failures = uint32_to_le(usb_stack->statistics.submit_failures);
+	u.response.stall_recoveries = uint32_to_le(usb_stack->statistics.stall_recoveries);
+
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
 
-		return -1;
-	}
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
 
-	// add I/O object as event source
-	return event_add_source(client->io->read_handle, EVENT_SOURCE_TYPE_GENERIC,
-	                        EVENT_READ, client_handle_read, client);
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
 }
 
-void client_destroy(Client *client) {
-	bool destroy_pending_requests = false;
-	PendingRequest *pending_request;
-
-	if (client->pending_request_count > 0) {
-		log_warn("Destroying client ("CLIENT_SIGNATURE_FORMAT") while %d request(s) are still pending",
-		         client_expand_signature(client), client->pending_request_count);
+static void client_handle_get_usb_stack_latency_histogram_request(Client *client,
+                                                                  GetUSBStackLatencyHistogramRequest *request) {
+	USBStack *usb_stack = usb_get_stack(request->index);
+	int i;
+	union {
+		GetUSBStackLatencyHistogramResponse response;
+		Packet packet;
+	} u;
 
-		if (network_create_zombie(client) < 0) {
-			log_error("Could not create zombie for %d pending request(s) of ("CLIENT_SIGNATURE_FORMAT")",
-			          client->pending_request_count, client_expand_signature(client));
+	if (usb_stack == NULL) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
 
-			destroy_pending_requests = true;
-		}
+		return;
 	}
 
-	writer_destroy(&client->response_writer);
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.stack_count = (uint8_t)MIN(usb_get_stack_count(), 255);
+	u.response.bus_number = usb_stack->bus_number;
+	u.response.device_address = usb_stack->device_address;
 
-	event_remove_source(client->io->read_handle, EVENT_SOURCE_TYPE_GENERIC);
-	io_destroy(client->io);
-	free(client->io);
+	for (i = 0; i < USB_STACK_LATENCY_BUCKETS; ++i) {
+		u.response.latency_histogram[i] = uint32_to_le(usb_stack->statistics.latency_histogram[i]);
+	}
 
-	if (destroy_pending_requests) {
-		while (client->pending_request_sentinel.next != &client->pending_request_sentinel) {
-			pending_request = containerof(client->pending_request_sentinel.next, PendingRequest, client_node);
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
 
-			pending_request_remove_and_free(pending_request);
-		}
-	}
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
 
-	if (client->destroy_done != NULL) {
-		client->destroy_done();
-	}
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
 }
 
-void client_dispatch_response(Client *client, PendingRequest *pending_request,
-                              Packet *response, bool force, bool ignore_authentication) {
-	Node *pending_request_client_node = NULL;
-	int enqueued = 0;
+static void client_handle_get_stack_latency_histogram_request(Client *client,
+                                                             GetStackLatencyHistogramRequest *request) {
+	Stack *stack = hardware_get_stack(request->index);
+	int i;
+	union {
+		GetStackLatencyHistogramResponse response;
+		Packet packet;
+	} u;
 
-	packet_add_trace(response);
+	if (stack == NULL) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
 
-	if (!ignore_authentication &&
-	    client->authentication_state != CLIENT_AUTHENTICATION_STATE_DISABLED &&
-	    client->authentication_state != CLIENT_AUTHENTICATION_STATE_DONE) {
-		log_packet_debug("Ignoring non-authenticated client ("CLIENT_SIGNATURE_FORMAT")",
-		                 client_expand_signature(client));
+		return;
+	}
 
-		goto cleanup;
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.stack_count = (uint8_t)MIN(hardware_get_stack_count(), 255);
+
+	memset(u.response.name, 0, sizeof(u.response.name));
+	memcpy(u.response.name, stack->name, MIN(strlen(stack->name), sizeof(u.response.name)));
+
+	for (i = 0; i < RESPONSE_LATENCY_BUCKETS; ++i) {
+		u.response.latency_histogram[i] = uint32_to_le(stack->latency_histogram[i]);
 	}
 
-	// find matching pending request if not forced and no pending request is
-	// already given. do this before the disconnect check to ensure that even
-	// for a disconnected client the pending request list is updated correctly
-	if (!force && pending_request == NULL) {
-		pending_request_client_node = client->pending_request_sentinel.next;
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+static void client_handle_get_function_latency_histogram_request(Client *client,
+                                                                GetFunctionLatencyHistogramRequest *request) {
+	ResponseLatencyFunction *function = response_latency_get_function(uint16_from_le(request->index));
+	int i;
+	union {
+		GetFunctionLatencyHistogramResponse response;
+		Packet packet;
+	} u;
+
+	if (function == NULL) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
+
+		return;
+	}
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.function_count = uint16_to_le((uint16_t)response_latency_get_function_count());
+	u.response.device_identifier = uint16_to_le(function->device_identifier);
+	u.response.function_id = function->function_id;
+
+	for (i = 0; i < RESPONSE_LATENCY_BUCKETS; ++i) {
+		u.response.latency_histogram[i] = uint32_to_le(function->histogram[i]);
+	}
+
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+static void client_handle_dump_packet_log_request(Client *client,
+                                                  DumpPacketLogRequest *request) {
+	uint32_t record_count;
+	union {
+		DumpPacketLogResponse response;
+		Packet packet;
+	} u;
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+
+	if (packet_log_dump(&record_count) < 0) {
+		packet_header_set_error_code(&u.response.header, PACKET_E_UNKNOWN_ERROR);
+	} else {
+		packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+	}
+
+	u.response.record_count = uint32_to_le(record_count);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+#ifdef BRICKD_WITH_RED_BRICK
+
+static void client_handle_get_spi_stack_statistics_request(Client *client,
+                                                           GetSPIStackStatisticsRequest *request) {
+	REDStackStatistics statistics;
+	union {
+		GetSPIStackStatisticsResponse response;
+		Packet packet;
+	} u;
+
+	if (red_stack_get_slave_statistics(request->index, &statistics) < 0) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
+
+		return;
+	}
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.slave_count = (uint8_t)red_stack_get_slave_count();
+	u.response.stack_address = request->index;
+	u.response.transfers = uint32_to_le(statistics.link.transfers);
+	u.response.packets_in = uint32_to_le(statistics.link.packets_in);
+	u.response.packets_out = uint32_to_le(statistics.link.packets_out);
+	u.response.retransmits = uint32_to_le(statistics.link.retransmits);
+	u.response.sequence_mismatches = uint32_to_le(statistics.link.sequence_mismatches);
+	u.response.checksum_errors = uint32_to_le(statistics.link.checksum_errors);
+	u.response.length_errors = uint32_to_le(statistics.link.length_errors);
+	u.response.preamble_errors = uint32_to_le(statistics.link.preamble_errors);
+	u.response.transfer_errors = uint32_to_le(statistics.link.transfer_errors);
+	u.response.queued_requests = uint32_to_le(statistics.queued_requests);
+	u.response.peak_queued_requests = uint32_to_le(statistics.peak_queued_requests);
+	u.response.transceive_time = uint32_to_le((uint32_t)(statistics.transceive_time / 1000));
+	u.response.sleep_time = uint32_to_le((uint32_t)(statistics.sleep_time / 1000));
+
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+static void client_handle_get_spi_stack_latency_histogram_request(Client *client,
+                                                                  GetSPIStackLatencyHistogramRequest *request) {
+	REDStackStatistics statistics;
+	int i;
+	union {
+		GetSPIStackLatencyHistogramResponse response;
+		Packet packet;
+	} u;
+
+	if (red_stack_get_slave_statistics(request->index, &statistics) < 0) {
+		client_send_empty_response(client, (Packet *)request, PACKET_E_INVALID_PARAMETER);
+
+		return;
+	}
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.slave_count = (uint8_t)red_stack_get_slave_count();
+	u.response.stack_address = request->index;
+
+	for (i = 0; i < RED_STACK_LATENCY_BUCKETS; ++i) {
+		u.response.latency_histogram[i] = uint32_to_le(statistics.link.latency_histogram[i]);
+	}
+
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+static void client_handle_get_redapid_link_statistics_request(Client *client,
+                                                              GetREDAPIDLinkStatisticsRequest *request) {
+	REDBrickAPIDaemonStatistics statistics;
+	union {
+		GetREDAPIDLinkStatisticsResponse response;
+		Packet packet;
+	} u;
+
+	redapid_get_statistics(&statistics);
+
+	u.response.header = request->header;
+	u.response.header.length = sizeof(u.response);
+	u.response.connected = redapid_is_connected();
+	u.response.connects = uint32_to_le(statistics.connects);
+	u.response.packets_in = uint32_to_le(statistics.packets_in);
+	u.response.packets_out = uint32_to_le(statistics.packets_out);
+	u.response.bytes_in = uint32_to_le((uint32_t)statistics.bytes_in);
+	u.response.bytes_out = uint32_to_le((uint32_t)statistics.bytes_out);
+	u.response.reads = uint32_to_le(statistics.reads);
+	u.response.writes = uint32_to_le(statistics.writes);
+	u.response.dropped_requests = uint32_to_le(statistics.dropped_requests);
+	u.response.peak_buffered_bytes = uint32_to_le(statistics.peak_buffered_bytes);
+
+	packet_header_set_error_code(&u.response.header, PACKET_E_SUCCESS);
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	u.packet.trace_id = packet_get_next_response_trace_id();
+#endif
+
+	packet_add_trace(&u.packet);
+	client_dispatch_response(client, NULL, &u.packet, false, false);
+}
+
+#endif
+
+static bool client_is_interested_in_callback(Client *client, Packet *callback) {
+	int i;
+	ClientCallbackFilter *filter;
+
+	// clients that never registered a filter get all callbacks. enumerate
+	// callbacks are always sent to keep enumeration working
+	if (client->callback_filters.count == 0 ||
+	    callback->header.function_id == CALLBACK_ENUMERATE) {
+		return true;
+	}
+
+	for (i = 0; i < client->callback_filters.count; ++i) {
+		filter = array_get(&client->callback_filters, i);
+
+		if ((filter->uid == 0 || filter->uid == callback->header.uid) &&
+		    (filter->function_id == 0 || filter->function_id == callback->header.function_id)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void client_handle_request(Client *client, Packet *request) {
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+	PendingRequest *pending_request;
+	Packet cached_response;
+
+	packet_add_trace(request);
+	packet_log_add(request, PACKET_LOG_DIRECTION_REQUEST, NULL);
+	packet_capture_add(request, PACKET_LOG_DIRECTION_REQUEST, NULL);
+
+	// handle requests meant for brickd
+	if (uint32_from_le(request->header.uid) == UID_BRICK_DAEMON) {
+		// add as pending request if response is expected
+		if (packet_header_get_response_expected(&request->header)) {
+			network_client_expects_response(client, request);
+		}
+
+		if (request->header.function_id == FUNCTION_GET_AUTHENTICATION_NONCE) {
+			if (request->header.length != sizeof(GetAuthenticationNonceRequest)) {
+				log_error("Received authentication-nonce request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_get_authentication_nonce_request(client, (GetAuthenticationNonceRequest *)request);
+		} else if (request->header.function_id == FUNCTION_AUTHENTICATE) {
+			if (request->header.length != sizeof(AuthenticateRequest)) {
+				log_error("Received authenticate request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_authenticate_request(client, (AuthenticateRequest *)request);
+		} else if (request->header.function_id == FUNCTION_RESUME_SESSION) {
+			if (request->header.length != sizeof(ResumeSessionRequest)) {
+				log_error("Received resume-session request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_resume_session_request(client, (ResumeSessionRequest *)request);
+		} else if (client->authentication_state != CLIENT_AUTHENTICATION_STATE_DISABLED &&
+		           client->authentication_state != CLIENT_AUTHENTICATION_STATE_DONE) {
+			log_packet_debug_checked("Client ("CLIENT_SIGNATURE_FORMAT") is not authenticated, dropping request (%s)",
+			                         client_expand_signature(client),
+			                         packet_get_request_signature(packet_signature, request));
+
+			if (packet_header_get_response_expected(&request->header)) {
+				// the response is not sent to a non-authenticated client,
+				// but this removes the pending request again
+				client_send_empty_response(client, request, PACKET_E_UNKNOWN_ERROR);
+			}
+		} else if (request->header.function_id == FUNCTION_ADD_CALLBACK_FILTER) {
+			if (request->header.length != sizeof(AddCallbackFilterRequest)) {
+				log_error("Received add-callback-filter request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_add_callback_filter_request(client, (AddCallbackFilterRequest *)request);
+		} else if (request->header.function_id == FUNCTION_CLEAR_CALLBACK_FILTERS) {
+			if (request->header.length != sizeof(ClearCallbackFiltersRequest)) {
+				log_error("Received clear-callback-filters request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_clear_callback_filters_request(client, (ClearCallbackFiltersRequest *)request);
+		} else if (request->header.function_id == FUNCTION_SET_CALLBACK_RATE_LIMIT) {
+			if (request->header.length != sizeof(SetCallbackRateLimitRequest)) {
+				log_error("Received set-callback-rate-limit request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_set_callback_rate_limit_request(client, (SetCallbackRateLimitRequest *)request);
+		} else if (request->header.function_id == FUNCTION_GET_SESSION_TOKEN) {
+			if (request->header.length != sizeof(GetSessionTokenRequest)) {
+				log_error("Received get-session-token request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client_handle_get_session_token_request(client, (GetSessionTokenRequest *)request);
+		} else if (request->header.function_id == FUNCTION_GET_QUEUE_STATISTICS) {
+			if (request->header.length != sizeof(GetQueueStatisticsRequest)) {
+				log_error("Received get-queue-statistics request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_queue_statistics_request(client, (GetQueueStatisticsRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_USB_STACK_STATISTICS) {
+			if (request->header.length != sizeof(GetUSBStackStatisticsRequest)) {
+				log_error("Received get-usb-stack-statistics request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_usb_stack_statistics_request(client, (GetUSBStackStatisticsRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_USB_STACK_LATENCY_HISTOGRAM) {
+			if (request->header.length != sizeof(GetUSBStackLatencyHistogramRequest)) {
+				log_error("Received get-usb-stack-latency-histogram request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_usb_stack_latency_histogram_request(client, (GetUSBStackLatencyHistogramRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_STACK_LATENCY_HISTOGRAM) {
+			if (request->header.length != sizeof(GetStackLatencyHistogramRequest)) {
+				log_error("Received get-stack-latency-histogram request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_stack_latency_histogram_request(client, (GetStackLatencyHistogramRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_FUNCTION_LATENCY_HISTOGRAM) {
+			if (request->header.length != sizeof(GetFunctionLatencyHistogramRequest)) {
+				log_error("Received get-function-latency-histogram request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_function_latency_histogram_request(client, (GetFunctionLatencyHistogramRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_DUMP_PACKET_LOG) {
+			if (request->header.length != sizeof(DumpPacketLogRequest)) {
+				log_error("Received dump-packet-log request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_dump_packet_log_request(client, (DumpPacketLogRequest *)request);
+			}
+#ifdef BRICKD_WITH_RED_BRICK
+		} else if (request->header.function_id == FUNCTION_GET_SPI_STACK_STATISTICS) {
+			if (request->header.length != sizeof(GetSPIStackStatisticsRequest)) {
+				log_error("Received get-spi-stack-statistics request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_spi_stack_statistics_request(client, (GetSPIStackStatisticsRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_SPI_STACK_LATENCY_HISTOGRAM) {
+			if (request->header.length != sizeof(GetSPIStackLatencyHistogramRequest)) {
+				log_error("Received get-spi-stack-latency-histogram request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_spi_stack_latency_histogram_request(client, (GetSPIStackLatencyHistogramRequest *)request);
+			}
+		} else if (request->header.function_id == FUNCTION_GET_REDAPID_LINK_STATISTICS) {
+			if (request->header.length != sizeof(GetREDAPIDLinkStatisticsRequest)) {
+				log_error("Received get-redapid-link-statistics request (%s) from client ("CLIENT_SIGNATURE_FORMAT") with wrong length, disconnecting client",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client));
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			if (packet_header_get_response_expected(&request->header)) {
+				client_handle_get_redapid_link_statistics_request(client, (GetREDAPIDLinkStatisticsRequest *)request);
+			}
+#endif
+		} else if (packet_header_get_response_expected(&request->header)) {
+			client_send_empty_response(client, request, PACKET_E_FUNCTION_NOT_SUPPORTED);
+		}
+	} else if (client->authentication_state == CLIENT_AUTHENTICATION_STATE_DISABLED ||
+	           client->authentication_state == CLIENT_AUTHENTICATION_STATE_DONE) {
+		// answer from the response cache if possible...
+		if (packet_header_get_response_expected(&request->header) &&
+		    response_cache_get(request, &cached_response)) {
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+			cached_response.trace_id = packet_get_next_response_trace_id();
+#endif
+
+			packet_add_trace(&cached_response);
+			client_dispatch_response(client, NULL, &cached_response, true, false);
+
+			return;
+		}
+
+		pending_request = NULL;
+
+		// ...otherwise add as pending request if response is expected...
+		if (packet_header_get_response_expected(&request->header)) {
+			pending_request = network_client_expects_response(client, request);
+		}
+
+		response_cache_handle_request(request, pending_request);
+
+		// ...and answer it by the response to an identical request that is
+		// already pending at the device, if any...
+		if (pending_request != NULL && network_coalesce_request(pending_request, request)) {
+			return;
+		}
+
+		// ...or answer enumerates from the enumerate cache...
+		if (request->header.uid == 0 && request->header.function_id == FUNCTION_ENUMERATE &&
+		    enumerate_cache_handle_request(client, request)) {
+			return;
+		}
+
+		// ...otherwise dispatch it to the hardware
+		packet_add_trace(request);
+		hardware_dispatch_request(request, client);
+	} else {
+		log_packet_debug_checked("Client ("CLIENT_SIGNATURE_FORMAT") is not authenticated, dropping request (%s)",
+		                         client_expand_signature(client),
+		                         packet_get_request_signature(packet_signature, request));
+	}
+}
+
+static void client_handle_buffer(Client *client) {
+	int length;
+	const char *message = NULL;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+	int buffer_start = 0;
+	Packet *request;
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	Packet traced_request;
+#endif
+
+	// complete requests are dispatched directly from the receive buffer. the
+	// remaining incomplete request, if any, is moved to the front of the
+	// buffer only once after all complete requests have been dispatched
+	while (!client->disconnected && client->buffer_used - buffer_start > 0) {
+		if (client->buffer_used - buffer_start < (int)sizeof(PacketHeader)) {
+			// wait for complete header
+			break;
+		}
+
+		request = (Packet *)&client->buffer[buffer_start];
+
+		if (!client->header_checked) {
+			if (!packet_header_is_valid_request(&request->header, &message)) {
+				// FIXME: include packet_get_content_dump output in the error message
+				log_error("Received invalid request (%s) from client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s",
+				          packet_get_request_signature(packet_signature, request),
+				          client_expand_signature(client), message);
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			client->header_checked = true;
+		}
+
+		length = request->header.length;
+
+		if (client->buffer_used - buffer_start < length) {
+			// wait for complete packet
+			break;
+		}
+
+		if (request->header.function_id == FUNCTION_DISCONNECT_PROBE) {
+			log_packet_debug("Received disconnect probe from client ("CLIENT_SIGNATURE_FORMAT"), dropping request",
+			                 client_expand_signature(client));
+		} else {
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+			// the trace ID is stored behind the packet data, so the request
+			// has to be copied to avoid overwriting the following request
+			memcpy(&traced_request, request, length);
+
+			request = &traced_request;
+			request->trace_id = packet_get_next_request_trace_id();
+#endif
+
+			log_packet_debug_checked("Received request (%s) from client ("CLIENT_SIGNATURE_FORMAT")",
+			                         packet_get_request_signature(packet_signature, request),
+			                         client_expand_signature(client));
+
+			client_handle_request(client, request);
+		}
+
+		buffer_start += length;
+		client->header_checked = false;
+	}
+
+	if (buffer_start > 0) {
+		memmove(client->buffer, &client->buffer[buffer_start],
+		        client->buffer_used - buffer_start);
+
+		client->buffer_used -= buffer_start;
+	}
+}
+
+static void client_handle_read(void *opaque) {
+	Client *client = opaque;
+	int length;
+	int available;
+	int reads = 0;
+
+	// keep reading as long as the previous read filled all available buffer
+	// space, because then more data is likely to be ready already. a shorter
+	// read means that the socket is drained. this saves event loop wakeups for
+	// clients that send requests in bulk, but is bounded to not starve other
+	// event sources
+	do {
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+		if (client->buffer == NULL) {
+			client->buffer = malloc(client->buffer_size);
+
+			if (client->buffer == NULL) {
+				log_error("Could not allocate receive buffer of %d byte(s) for client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+				          client->buffer_size, client_expand_signature(client),
+				          get_errno_name(ENOMEM), ENOMEM);
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+		}
+#endif
+
+		available = client->buffer_size - client->buffer_used;
+
+		length = io_read(client->io, client->buffer + client->buffer_used,
+		                 available);
+
+		if (length == 0) {
+			log_info("Client ("CLIENT_SIGNATURE_FORMAT") disconnected by peer",
+			         client_expand_signature(client));
+
+			client_mark_as_disconnected(client);
+
+			return;
+		}
+
+		if (length < 0) {
+			if (length == IO_CONTINUE) {
+				// no actual data received
+			} else if (errno_interrupted()) {
+				log_debug("Receiving from client ("CLIENT_SIGNATURE_FORMAT") was interrupted, retrying",
+				          client_expand_signature(client));
+			} else if (errno_would_block()) {
+				log_debug("Receiving from client ("CLIENT_SIGNATURE_FORMAT") would block, retrying",
+				          client_expand_signature(client));
+			} else {
+				log_error("Could not receive from client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+				          client_expand_signature(client), get_errno_name(errno), errno);
+
+				client_mark_as_disconnected(client);
+			}
+
+			break;
+		}
+
+		client->buffer_used += length;
+
+		client_handle_buffer(client);
+	} while (!client->disconnected && length == available &&
+	         ++reads < CLIENT_MAX_READS_PER_EVENT);
+
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	// most clients are idle most of the time, only keep the receive buffer
+	// while it holds the start of an incomplete request
+	if (!client->disconnected && client->buffer_used == 0) {
+		free(client->buffer);
+
+		client->buffer = NULL;
+	}
+#endif
+}
+
+EVENT_PROFILE_HANDLER(client_handle_read, "client-read")
+
+// sets errno on error
+PendingRequest *pending_request_allocate(void) {
+	Node *pending_request_free_node = _pending_request_pool_free_sentinel.next;
+	PendingRequest *pending_request;
+
+	if (pending_request_free_node != &_pending_request_pool_free_sentinel) {
+		node_remove(pending_request_free_node);
+
+		pending_request = containerof(pending_request_free_node,
+		                              PendingRequest, global_node);
+
+		++_pending_request_pool_hits;
+	} else if (_pending_request_pool_used < PENDING_REQUEST_POOL_SIZE) {
+		pending_request = &_pending_request_pool[_pending_request_pool_used++];
+
+		++_pending_request_pool_hits;
+	} else {
+		pending_request = malloc(sizeof(PendingRequest));
+
+		if (pending_request == NULL) {
+			errno = ENOMEM;
+
+			return NULL;
+		}
+
+		++_pending_request_pool_misses;
+	}
+
+	memset(pending_request, 0, sizeof(PendingRequest));
+
+	return pending_request;
+}
+
+void pending_request_remove_and_free(PendingRequest *pending_request) {
+	if (pending_request->coalesced_request != NULL) {
+		network_release_coalesced_request(pending_request);
+	}
+
+	if (pending_request->response_cache_entry != NULL) {
+		response_cache_release(pending_request);
+	}
+
+	node_remove(&pending_request->global_node);
+	node_remove(&pending_request->client_node);
+	node_remove(&pending_request->index_node);
+
+	if (pending_request->client != NULL) {
+		--pending_request->client->pending_request_count;
+	}
+
+	if (pending_request->zombie != NULL) {
+		--pending_request->zombie->pending_request_count;
+	}
+
+	if (pending_request >= &_pending_request_pool[0] &&
+	    pending_request < &_pending_request_pool[PENDING_REQUEST_POOL_SIZE]) {
+		// reuse the most recently returned slot first, it is most likely
+		// still in the cache
+		node_insert_after(&_pending_request_pool_free_sentinel,
+		                  &pending_request->global_node);
+	} else {
+		free(pending_request);
+	}
+}
+
+void pending_request_get_pool_counters(uint32_t *hits, uint32_t *misses) {
+	*hits = _pending_request_pool_hits;
+	*misses = _pending_request_pool_misses;
+}
+
+const char *client_get_authentication_state_name(ClientAuthenticationState state) {
+	switch (state) {
+	case CLIENT_AUTHENTICATION_STATE_DISABLED:   return "disabled";
+	case CLIENT_AUTHENTICATION_STATE_ENABLED:    return "enabled";
+	case CLIENT_AUTHENTICATION_STATE_NONCE_SEND: return "nonce-send";
+	case CLIENT_AUTHENTICATION_STATE_DONE:       return "done";
+
+	default:                                     return "<unknown>";
+	}
+}
+
+static void client_handle_write(void *opaque) {
+	client_flush_responses(opaque);
+}
+
+EVENT_PROFILE_HANDLER(client_handle_write, "client-write")
+
+static void client_set_write_pending(Client *client, bool write_pending) {
+	if (client->write_pending == write_pending) {
+		return;
+	}
+
+#ifdef BRICKD_WITH_IO_THREADS
+	// the I/O worker calls client_handle_write by itself once it has room
+	if (io_worker_is_wrapped(client->io)) {
+		client->write_pending = write_pending;
+
+		return;
+	}
+#endif
+
+	if (write_pending) {
+		if (event_modify_source(client->io->write_handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        0, EVENT_WRITE, EVENT_PROFILED(client_handle_write), client) < 0) {
+			log_error("Could not wait for client ("CLIENT_SIGNATURE_FORMAT") to become writable, disconnecting client",
+			          client_expand_signature(client));
+
+			client_mark_as_disconnected(client);
+
+			return;
+		}
+	} else {
+		if (event_modify_source(client->io->write_handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        EVENT_WRITE, 0, NULL, NULL) < 0) {
+			log_error("Could not stop waiting for client ("CLIENT_SIGNATURE_FORMAT") to become writable, disconnecting client",
+			          client_expand_signature(client));
+
+			client_mark_as_disconnected(client);
+
+			return;
+		}
+	}
+
+	client->write_pending = write_pending;
+}
+
+static void client_release_shared_response(ClientSharedResponse *shared) {
+	if (--shared->ref_count == 0) {
+		free(shared);
+	}
+}
+
+static void client_free_queued_response(Client *client,
+                                        ClientQueuedResponse *queued_response) {
+	node_remove(&queued_response->queue_node);
+	node_remove(&queued_response->callback_node); // no-op if not linked
+
+	--client->queued_responses;
+	client->queued_bytes -= queued_response->length;
+
+	if (queued_response->shared != NULL) {
+		client_release_shared_response(queued_response->shared);
+	}
+
+	free(queued_response);
+}
+
+// drops the oldest queued callback that was not partially written yet.
+// returns false if there is no such callback
+static bool client_drop_oldest_queued_callback(Client *client) {
+	Node *callback_node = client->queued_callback_sentinel.next;
+	ClientQueuedResponse *queued_response;
+
+	while (callback_node != &client->queued_callback_sentinel) {
+		queued_response = containerof(callback_node, ClientQueuedResponse, callback_node);
+
+		if (&queued_response->queue_node != client->queue_sentinel.next ||
+		    client->queue_offset == 0) {
+			if (&queued_response->queue_node == client->queue_sentinel.next) {
+				client->queue_offset = 0;
+			}
+
+			client_free_queued_response(client, queued_response);
+
+			++client->dropped_callbacks;
+
+			return true;
+		}
+
+		callback_node = callback_node->next;
+	}
+
+	return false;
+}
+
+// returns -1 if the response was dropped and 1 if the response was enqueued.
+// if a shared response is given then the queued response references it
+// instead of holding a copy of the response
+static int client_queue_shared_response(Client *client, Packet *response,
+                                        ClientSharedResponse *shared,
+                                        bool prepared_frame) {
+	int length = shared != NULL ? shared->length : response->header.length;
+	bool is_callback = packet_header_get_sequence_number(&response->header) == 0;
+	uint32_t dropped_callbacks = client->dropped_callbacks;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+	ClientQueuedResponse *queued_response;
+
+	while ((int)client->queued_responses + 1 > client->queue_max_responses ||
+	       (int)client->queued_bytes + length > client->queue_max_bytes) {
+		if (client->queue_overflow_policy == CLIENT_QUEUE_OVERFLOW_POLICY_DISCONNECT) {
+			log_error("Response queue of client ("CLIENT_SIGNATURE_FORMAT") is full (%u response(s), %u byte(s)), disconnecting client",
+			          client_expand_signature(client), client->queued_responses,
+			          client->queued_bytes);
+
+			client_mark_as_disconnected(client);
+
+			return -1;
+		}
+
+		// make room by dropping the oldest callbacks, but keep the responses
+		// to requests, because the client is waiting for them
+		if (client_drop_oldest_queued_callback(client)) {
+			continue;
+		}
+
+		if (is_callback) {
+			++client->dropped_callbacks;
+
+			log_debug("Response queue of client ("CLIENT_SIGNATURE_FORMAT") is full, dropping callback (%s), %u dropped in total",
+			          client_expand_signature(client),
+			          packet_get_response_signature(packet_signature, response),
+			          client->dropped_callbacks);
+
+			return -1;
+		}
+
+		log_error("Response queue of client ("CLIENT_SIGNATURE_FORMAT") is full of %u response(s) to requests, disconnecting client",
+		          client_expand_signature(client), client->queued_responses);
+
+		client_mark_as_disconnected(client);
+
+		return -1;
+	}
+
+	if (client->dropped_callbacks != dropped_callbacks) {
+		log_debug("Response queue of client ("CLIENT_SIGNATURE_FORMAT") is full, dropped %u queued callback(s), %u dropped in total",
+		          client_expand_signature(client),
+		          client->dropped_callbacks - dropped_callbacks,
+		          client->dropped_callbacks);
+	}
+
+	queued_response = malloc(CLIENT_QUEUED_RESPONSE_OVERHEAD + (shared != NULL ? 0 : length));
+
+	if (queued_response == NULL) {
+		log_error("Could not allocate queued response for client ("CLIENT_SIGNATURE_FORMAT"), dropping response: %s (%d)",
+		          client_expand_signature(client), get_errno_name(ENOMEM), ENOMEM);
+
+		return -1;
+	}
+
+	queued_response->shared = shared;
+	queued_response->prepared_frame = prepared_frame;
+	queued_response->length = length;
+
+	if (shared != NULL) {
+		++shared->ref_count;
+
+		queued_response->data = shared->data;
+	} else {
+		memcpy(&queued_response->response, response, length);
+
+		queued_response->data = (uint8_t *)&queued_response->response;
+	}
+
+	node_insert_before(&client->queue_sentinel, &queued_response->queue_node);
+
+	if (is_callback) {
+		node_insert_before(&client->queued_callback_sentinel, &queued_response->callback_node);
+	} else {
+		node_reset(&queued_response->callback_node);
+	}
+
+	++client->queued_responses;
+	client->queued_bytes += length;
+
+	if (client->queued_responses > client->peak_queued_responses) {
+		client->peak_queued_responses = client->queued_responses;
+	}
+
+	client_set_write_pending(client, true);
+
+	return 1;
+}
+
+// returns -1 if the response was dropped and 1 if the response was enqueued
+static int client_queue_response(Client *client, Packet *response) {
+	return client_queue_shared_response(client, response, NULL, false);
+}
+
+// writes queued responses until the client would block
+static void client_write_queued_responses(Client *client) {
+	ClientQueuedResponse *queued_response;
+	int length;
+
+	while (client->queue_sentinel.next != &client->queue_sentinel) {
+		queued_response = containerof(client->queue_sentinel.next, ClientQueuedResponse, queue_node);
+
+		// the rest of a partially written prepared frame is continued by
+		// the WebSocket like one of its own frames
+		if (queued_response->prepared_frame && client->queue_offset == 0) {
+			length = websocket_send_prepared_frame(client->websocket, queued_response->data,
+			                                       queued_response->length);
+		} else {
+			length = io_write(client->io, queued_response->data + client->queue_offset,
+			                  queued_response->length - client->queue_offset);
+		}
+
+		if (length < 0) {
+			if (errno_interrupted() || errno_would_block()) {
+				return;
+			}
+
+			log_error("Could not send queued response to client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+			          client_expand_signature(client), get_errno_name(errno), errno);
+
+			client_mark_as_disconnected(client);
+
+			return;
+		}
+
+		client->queue_offset += length;
+
+		if (client->queue_offset < queued_response->length) {
+			return;
+		}
+
+		client->queue_offset = 0;
+
+		client_free_queued_response(client, queued_response);
+	}
+}
+
+// returns -1 on error, 0 if the response was written and 1 if the response
+// was enqueued
+static int client_write_response(Client *client, Packet *response) {
+	int length = response->header.length;
+	int written;
+
+	// keep the order of the responses, if something is already waiting for
+	// the client to become writable then queue behind it
+	if (client->write_pending) {
+		return client_queue_response(client, response);
+	}
+
+	if (client->coalescing_buffer == NULL) {
+		written = io_write(client->io, response, length);
+
+		if (written < 0) {
+			if (!errno_interrupted() && !errno_would_block()) {
+				log_error("Could not send response to client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+				          client_expand_signature(client), get_errno_name(errno), errno);
+
+				client_mark_as_disconnected(client);
+
+				return -1;
+			}
+
+			written = 0;
+		}
+
+		if (written == length) {
+			return 0;
+		}
+
+		if (client_queue_response(client, response) < 0) {
+			if (written > 0) {
+				// the client already got a part of the response
+				client_mark_as_disconnected(client);
+			}
+
+			return -1;
+		}
+
+		client->queue_offset = written;
+
+		return 1;
+	}
+
+	if (client->coalescing_used + length > client->coalescing_size) {
+		client_flush_responses(client);
+
+		if (client->disconnected) {
+			return -1;
+		}
+
+		if (client->write_pending) {
+			return client_queue_response(client, response);
+		}
+	}
+
+	if (client->coalescing_used == 0) {
+		client->coalescing_start = microseconds();
+
+		if (!client->flush_scheduled) {
+			network_schedule_client_flush(client);
+		}
+	}
+
+	memcpy(client->coalescing_buffer + client->coalescing_used, response, length);
+
+	client->coalescing_used += length;
+
+	// all coalesced responses are flushed at the end of the current event
+	// loop iteration. flush them earlier if the oldest response is already
+	// waiting longer than the configured delay
+	if (microseconds() - client->coalescing_start >= client->coalescing_delay) {
+		client_flush_responses(client);
+
+		if (client->disconnected) {
+			return -1;
+		}
+	}
+
+	return client->coalescing_used > 0 || client->write_pending ? 1 : 0;
+}
+
+int client_create(Client *client, const char *name, IO *io,
+                  uint32_t authentication_nonce,
+                  ClientDestroyDoneFunction destroy_done) {
+	log_debug("Creating client from %s (handle: %d/%d)",
+	          io->type, io->read_handle, io->write_handle);
+
+	string_copy(client->name, sizeof(client->name), name, -1);
+
+	client->address_known = false;
+	client->io = io;
+	client->disconnected = false;
+	client->buffer_size = config_get_option_value("listen.receive_buffer_size")->integer;
+	client->buffer_used = 0;
+	client->header_checked = false;
+	client->queue_offset = 0;
+	client->queue_max_responses = config_get_option_value("listen.max_queued_responses")->integer;
+	client->queue_max_bytes = config_get_option_value("listen.max_queued_bytes")->integer;
+	client->queue_overflow_policy = config_get_option_value("listen.queue_overflow_policy")->symbol;
+	client->queued_responses = 0;
+	client->queued_bytes = 0;
+	client->peak_queued_responses = 0;
+	client->dropped_callbacks = 0;
+	client->callback_rate_limit_timer_created = false;
+	client->callback_rate_limit_timer_due = 0;
+	client->decimated_callbacks = 0;
+	client->write_pending = false;
+	client->coalescing_delay = 0;
+	client->coalescing_buffer = NULL;
+	client->byte_stream = false;
+	client->websocket = NULL;
+	client->coalescing_size = 0;
+	client->coalescing_used = 0;
+	client->coalescing_start = 0;
+	client->pending_request_count = 0;
+	client->authentication_state = CLIENT_AUTHENTICATION_STATE_DISABLED;
+	client->authentication_nonce = authentication_nonce;
+	client->session_resumable = false;
+	client->destroy_done = destroy_done;
+
+	if (network_get_authentication_key() != NULL) {
+		client->authentication_state = CLIENT_AUTHENTICATION_STATE_ENABLED;
+	}
+
+	node_reset(&client->pending_request_sentinel);
+	node_reset(&client->queue_sentinel);
+	node_reset(&client->queued_callback_sentinel);
+
+	// create callback filter array
+	if (array_create(&client->callback_filters, 4, sizeof(ClientCallbackFilter), true) < 0) {
+		log_error("Could not create callback filter array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	// create callback rate limit array
+	if (array_create(&client->callback_rate_limits, 4, sizeof(ClientCallbackRateLimit), true) < 0) {
+		log_error("Could not create callback rate limit array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		array_destroy(&client->callback_filters, NULL);
+
+		return -1;
+	}
+
+	// create receive buffer. in compact mode it is allocated by the first read
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	client->buffer = NULL;
+#else
+	client->buffer = malloc(client->buffer_size);
+
+	if (client->buffer == NULL) {
+		log_error("Could not allocate receive buffer of %d byte(s): %s (%d)",
+		          client->buffer_size, get_errno_name(ENOMEM), ENOMEM);
+
+		array_destroy(&client->callback_rate_limits, NULL);
+		array_destroy(&client->callback_filters, NULL);
+
+		return -1;
+	}
+#endif
+
+#ifdef BRICKD_WITH_IO_THREADS
+	if (io_worker_is_wrapped(client->io)) {
+		io_worker_set_functions(client->io, client_handle_read, client_handle_write, client);
+
+		return 0;
+	}
+#endif
+
+	// add I/O object as event source
+	return event_add_source(client->io->read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                        EVENT_READ, EVENT_PROFILED(client_handle_read), client);
+}
+
+// the client is removed at the end of the current event loop iteration
+void client_mark_as_disconnected(Client *client) {
+	if (client->disconnected) {
+		return;
+	}
+
+	client->disconnected = true;
+
+	network_schedule_client_removal(client);
+}
+
+// called by the stacks for every queued request of this client they drop
+// during hardware_cancel_requests. the response will never arrive
+void client_cancel_pending_request(Client *client, Packet *request) {
+	PendingRequest *pending_request;
+
+	if (!packet_header_get_response_expected(&request->header)) {
+		return;
+	}
+
+	pending_request = network_find_pending_request(request, client);
+
+	if (pending_request != NULL) {
+		pending_request_remove_and_free(pending_request);
+	}
+}
+
+void client_destroy(Client *client) {
+	bool destroy_pending_requests = false;
+	PendingRequest *pending_request;
+	int pending_request_count = client->pending_request_count;
+
+	// requests that were not sent yet don't need a zombie to swallow their
+	// responses, they can be dropped instead. unless the session can be
+	// resumed, then the client still expects their responses
+	if (client->pending_request_count > 0 && !client->session_resumable &&
+	    config_get_option_value("listen.cancel_queued_requests")->boolean) {
+		hardware_cancel_requests(client);
+
+		if (client->pending_request_count < pending_request_count) {
+			log_debug("Canceled %d queued request(s) of client ("CLIENT_SIGNATURE_FORMAT")",
+			          pending_request_count - client->pending_request_count,
+			          client_expand_signature(client));
+		}
+	}
+
+	// a resumable session needs a zombie even without pending requests, it
+	// keeps the session state until the client reconnects or it times out
+	if (client->pending_request_count > 0 || client->session_resumable) {
+		if (client->pending_request_count > 0) {
+			log_warn("Destroying client ("CLIENT_SIGNATURE_FORMAT") while %d request(s) are still pending",
+			         client_expand_signature(client), client->pending_request_count);
+		}
+
+		if (network_create_zombie(client) < 0) {
+			log_error("Could not create zombie for %d pending request(s) of ("CLIENT_SIGNATURE_FORMAT")",
+			          client->pending_request_count, client_expand_signature(client));
+
+			destroy_pending_requests = true;
+		}
+	}
 
-		while (pending_request_client_node != &client->pending_request_sentinel) {
-			pending_request = containerof(pending_request_client_node, PendingRequest, client_node);
+	if (!client->disconnected) {
+		client_flush_responses(client);
+	}
 
-			if (packet_is_matching_response(response, &pending_request->header)) {
-				break;
+	if (client->coalescing_used > 0 || client->queued_responses > 0) {
+		log_warn("Destroying client ("CLIENT_SIGNATURE_FORMAT") while %d byte(s) of coalesced and %u queued response(s) are still unsent",
+		         client_expand_signature(client), client->coalescing_used,
+		         client->queued_responses);
+	}
+
+	while (client->queue_sentinel.next != &client->queue_sentinel) {
+		client_free_queued_response(client, containerof(client->queue_sentinel.next,
+		                                                ClientQueuedResponse, queue_node));
+	}
+
+	free(client->coalescing_buffer);
+
+#ifdef BRICKD_WITH_IO_THREADS
+	if (!io_worker_is_wrapped(client->io)) {
+		event_remove_source(client->io->read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	}
+#else
+	event_remove_source(client->io->read_handle, EVENT_SOURCE_TYPE_GENERIC);
+#endif
+
+	io_destroy(client->io);
+	free(client->io);
+
+	free(client->buffer);
+	array_destroy(&client->callback_filters, NULL);
+	array_destroy(&client->callback_rate_limits, NULL);
+
+	if (client->callback_rate_limit_timer_created) {
+		timer_destroy(&client->callback_rate_limit_timer);
+	}
+
+	if (destroy_pending_requests) {
+		while (client->pending_request_sentinel.next != &client->pending_request_sentinel) {
+			pending_request = containerof(client->pending_request_sentinel.next, PendingRequest, client_node);
+
+			pending_request_remove_and_free(pending_request);
+		}
+	}
+
+	if (client->destroy_done != NULL) {
+		client->destroy_done();
+	}
+}
+
+// responses to this client are collected and written in one go at the end of
+// the event loop iteration, or earlier if the oldest collected response is
+// waiting for longer than the given delay in microseconds
+int client_enable_response_coalescing(Client *client, uint64_t delay) {
+	client->coalescing_buffer = malloc(CLIENT_COALESCING_BUFFER_SIZE);
+
+	if (client->coalescing_buffer == NULL) {
+		log_error("Could not allocate coalescing buffer for client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+		          client_expand_signature(client), get_errno_name(ENOMEM), ENOMEM);
+
+		return -1;
+	}
+
+	client->coalescing_delay = delay;
+	client->coalescing_size = CLIENT_COALESCING_BUFFER_SIZE;
+
+	return 0;
+}
+
+// writes coalesced responses first, then queued responses. whatever the
+// client does not accept without blocking is written as soon as it is
+// writable again
+void client_flush_responses(Client *client) {
+	int length;
+
+	if (client->disconnected) {
+		return;
+	}
+
+	if (client->coalescing_used > 0) {
+		length = io_write(client->io, client->coalescing_buffer, client->coalescing_used);
+
+		if (length < 0) {
+			if (!errno_interrupted() && !errno_would_block()) {
+				log_error("Could not send coalesced responses to client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+				          client_expand_signature(client), get_errno_name(errno), errno);
+
+				client_mark_as_disconnected(client);
+
+				return;
 			}
 
-			pending_request_client_node = pending_request_client_node->next;
+			length = 0;
+		}
+
+		if (length < client->coalescing_used) {
+			// keep the unsent rest and retry as soon as the client is writable
+			memmove(client->coalescing_buffer, client->coalescing_buffer + length,
+			        client->coalescing_used - length);
+
+			client->coalescing_used -= length;
+
+			client_set_write_pending(client, true);
+
+			return;
 		}
 
-		if (pending_request_client_node == &client->pending_request_sentinel) {
-			pending_request = NULL;
+		client->coalescing_used = 0;
+	}
+
+	client_write_queued_responses(client);
+
+	if (!client->disconnected) {
+		client_set_write_pending(client, client->queue_sentinel.next != &client->queue_sentinel);
+	}
+}
+
+void client_dispatch_response(Client *client, PendingRequest *pending_request,
+                              Packet *response, bool force, bool ignore_authentication) {
+	int enqueued = 0;
+
+	packet_add_trace(response);
+
+	if (!ignore_authentication &&
+	    client->authentication_state != CLIENT_AUTHENTICATION_STATE_DISABLED &&
+	    client->authentication_state != CLIENT_AUTHENTICATION_STATE_DONE) {
+		log_packet_debug("Ignoring non-authenticated client ("CLIENT_SIGNATURE_FORMAT")",
+		                 client_expand_signature(client));
+
+		goto cleanup;
+	}
+
+	// find matching pending request if not forced and no pending request is
+	// already given. do this before the disconnect check to ensure that even
+	// for a disconnected client the pending request list is updated correctly
+	if (!force && pending_request == NULL) {
+		pending_request = network_find_pending_request(response, client);
 
+		if (pending_request == NULL) {
 			goto cleanup;
 		}
 	}
@@ -492,7 +2116,7 @@ void client_dispatch_response(Client *client, PendingRequest *pending_request,
 	}
 
 	if (force || pending_request != NULL) {
-		enqueued = writer_write(&client->response_writer, response);
+		enqueued = client_write_response(client, response);
 
 		if (enqueued < 0) {
 			goto cleanup;
@@ -514,6 +2138,385 @@ cleanup:
 	}
 }
 
+// delivers the held back callbacks whose period ended and rearms the timer
+// for the next one
+static void client_handle_callback_rate_limit_timer(void *opaque) {
+	Client *client = opaque;
+	uint64_t now = microseconds();
+	uint64_t next_due = 0;
+	uint64_t due;
+	ClientCallbackRateLimit *rate_limit;
+	int i;
+
+	client->callback_rate_limit_timer_due = 0;
+
+	for (i = 0; i < client->callback_rate_limits.count && !client->disconnected; ++i) {
+		rate_limit = array_get(&client->callback_rate_limits, i);
+
+		if (!rate_limit->held) {
+			continue;
+		}
+
+		due = rate_limit->last_delivery + rate_limit->period;
+
+		if (due <= now) {
+			rate_limit->held = false;
+			rate_limit->last_delivery = now;
+
+			client_write_response(client, &rate_limit->latest);
+		} else if (next_due == 0 || due < next_due) {
+			next_due = due;
+		}
+	}
+
+	if (next_due > 0 && !client->disconnected) {
+		if (timer_configure(&client->callback_rate_limit_timer, next_due - now, 0) < 0) {
+			log_error("Could not restart callback rate limit timer of client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+			          client_expand_signature(client), get_errno_name(errno), errno);
+
+			return;
+		}
+
+		client->callback_rate_limit_timer_due = next_due;
+	}
+}
+
+// returns true if the callback is held back, to be delivered when the period
+// of its rate limit ends, unless a newer callback replaces it until then
+static bool client_decimate_callback(Client *client, Packet *callback) {
+	int i;
+	ClientCallbackRateLimit *rate_limit;
+	uint64_t now;
+	uint64_t due;
+
+	for (i = 0; i < client->callback_rate_limits.count; ++i) {
+		rate_limit = array_get(&client->callback_rate_limits, i);
+
+		if (rate_limit->uid == callback->header.uid &&
+		    rate_limit->function_id == callback->header.function_id) {
+			break;
+		}
+	}
+
+	if (i >= client->callback_rate_limits.count) {
+		return false;
+	}
+
+	now = microseconds();
+
+	if (!rate_limit->held && now - rate_limit->last_delivery >= rate_limit->period) {
+		rate_limit->last_delivery = now;
+
+		return false;
+	}
+
+	if (rate_limit->held) {
+		++client->decimated_callbacks; // the older held back callback is lost
+	}
+
+	memcpy(&rate_limit->latest, callback, callback->header.length);
+
+	rate_limit->held = true;
+	due = rate_limit->last_delivery + rate_limit->period;
+
+	if (client->callback_rate_limit_timer_due > 0 &&
+	    client->callback_rate_limit_timer_due <= due) {
+		return true; // timer fires in time
+	}
+
+	if (!client->callback_rate_limit_timer_created) {
+		if (timer_create_(&client->callback_rate_limit_timer,
+		                  client_handle_callback_rate_limit_timer, client) < 0) {
+			log_error("Could not create callback rate limit timer for client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+			          client_expand_signature(client), get_errno_name(errno), errno);
+
+			rate_limit->held = false;
+
+			return false;
+		}
+
+		client->callback_rate_limit_timer_created = true;
+	}
+
+	if (timer_configure(&client->callback_rate_limit_timer, due > now ? due - now : 1, 0) < 0) {
+		log_error("Could not start callback rate limit timer of client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+		          client_expand_signature(client), get_errno_name(errno), errno);
+
+		rate_limit->held = false;
+
+		return false;
+	}
+
+	client->callback_rate_limit_timer_due = due;
+
+	return true;
+}
+
+// broadcasts are forced and have no pending request, skip the matching and
+// the per-client logging done by client_dispatch_response. the caller logs
+// and traces the broadcast once for all clients
+static bool client_is_receiving_broadcasts(Client *client) {
+	return !client->disconnected &&
+	       (client->authentication_state == CLIENT_AUTHENTICATION_STATE_DISABLED ||
+	        client->authentication_state == CLIENT_AUTHENTICATION_STATE_DONE);
+}
+
+static bool client_accepts_broadcast(Client *client, Packet *response) {
+	return packet_header_get_sequence_number(&response->header) != 0 ||
+	       (client_is_interested_in_callback(client, response) &&
+	        (client->callback_rate_limits.count == 0 || !client_decimate_callback(client, response)));
+}
+
+void client_broadcast_response(Client *client, Packet *response) {
+	if (!client_is_receiving_broadcasts(client) ||
+	    !client_accepts_broadcast(client, response)) {
+		return;
+	}
+
+	client_write_response(client, response);
+}
+
+void client_broadcast_init(ClientBroadcast *broadcast, Packet *response) {
+	broadcast->response = response;
+	broadcast->plain = NULL;
+	broadcast->frame = NULL;
+}
+
+// drops the references of the broadcast, the clients keep theirs until the
+// queued responses are written
+void client_broadcast_release(ClientBroadcast *broadcast) {
+	if (broadcast->plain != NULL) {
+		client_release_shared_response(broadcast->plain);
+	}
+
+	if (broadcast->frame != NULL) {
+		client_release_shared_response(broadcast->frame);
+	}
+}
+
+// returns NULL if the shared response could not be allocated
+static ClientSharedResponse *client_broadcast_get_shared_response(ClientBroadcast *broadcast,
+                                                                  bool prepared_frame) {
+	ClientSharedResponse **shared = prepared_frame ? &broadcast->frame : &broadcast->plain;
+	Packet *response = broadcast->response;
+	int length = response->header.length;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+
+	if (*shared != NULL) {
+		return *shared;
+	}
+
+	if (prepared_frame) {
+		length += WEBSOCKET_MAX_SERVER_HEADER_LENGTH;
+	}
+
+	*shared = malloc(CLIENT_SHARED_RESPONSE_OVERHEAD + length);
+
+	if (*shared == NULL) {
+		log_error("Could not allocate shared response (%s): %s (%d)",
+		          packet_get_response_signature(packet_signature, response),
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		return NULL;
+	}
+
+	(*shared)->ref_count = 1; // the reference of the broadcast
+
+	if (prepared_frame) {
+		(*shared)->length = websocket_prepare_frame((*shared)->data, response,
+		                                            response->header.length);
+	} else {
+		memcpy((*shared)->data, response, length);
+
+		(*shared)->length = length;
+	}
+
+	return *shared;
+}
+
+// like client_write_response, but a response that has to be queued references
+// the shared response of the broadcast, and WebSocket clients get the frame
+// that was prepared once for all of them
+static void client_write_broadcast(Client *client, ClientBroadcast *broadcast) {
+	Packet *response = broadcast->response;
+	bool prepared_frame;
+	ClientSharedResponse *shared = NULL;
+	int written = 0;
+
+	// coalesced responses are copied into the coalescing buffer anyway
+	if (client->coalescing_buffer != NULL) {
+		client_write_response(client, response);
+
+		return;
+	}
+
+	prepared_frame = client->websocket != NULL &&
+	                 websocket_can_send_prepared_frame(client->websocket);
+
+	if (prepared_frame) {
+		shared = client_broadcast_get_shared_response(broadcast, true);
+
+		if (shared == NULL) {
+			client_write_response(client, response);
+
+			return;
+		}
+	}
+
+	// keep the order of the responses, if something is already waiting for
+	// the client to become writable then queue behind it
+	if (!client->write_pending) {
+		if (prepared_frame) {
+			written = websocket_send_prepared_frame(client->websocket, shared->data, shared->length);
+		} else {
+			written = io_write(client->io, response, response->header.length);
+		}
+
+		if (written < 0) {
+			if (!errno_interrupted() && !errno_would_block()) {
+				log_error("Could not send response to client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+				          client_expand_signature(client), get_errno_name(errno), errno);
+
+				client_mark_as_disconnected(client);
+
+				return;
+			}
+
+			written = 0;
+		}
+
+		if (written == (prepared_frame ? shared->length : response->header.length)) {
+			return;
+		}
+	}
+
+	if (!prepared_frame) {
+		shared = client_broadcast_get_shared_response(broadcast, false); // NULL queues a copy
+	}
+
+	if (client_queue_shared_response(client, response, shared, prepared_frame) < 0) {
+		if (written > 0) {
+			// the client already got a part of the response
+			client_mark_as_disconnected(client);
+		}
+
+		return;
+	}
+
+	if (written > 0) {
+		client->queue_offset = written;
+	}
+}
+
+void client_broadcast_shared_response(Client *client, ClientBroadcast *broadcast) {
+	if (!client_is_receiving_broadcasts(client) ||
+	    !client_accepts_broadcast(client, broadcast->response)) {
+		return;
+	}
+
+	client_write_broadcast(client, broadcast);
+}
+
+// broadcasts a burst of responses, such as the enumerate-disconnected
+// callbacks for all devices of a stack. with response coalescing they end up
+// in the coalescing buffer anyway. without it, the accepted responses are
+// collected and written in one go instead of one write per response, but only
+// for byte stream clients. WebSocket and seqpacket clients expect one packet
+// per frame or message
+void client_broadcast_responses(Client *client, Packet *responses, int count) {
+	uint8_t *buffer;
+	int used = 0;
+	int offset;
+	int length;
+	int written;
+	int i;
+	Packet *response;
+
+	if (!client_is_receiving_broadcasts(client)) {
+		return;
+	}
+
+	if (client->coalescing_buffer != NULL || client->write_pending ||
+	    !client->byte_stream || count < 2) {
+		for (i = 0; i < count && !client->disconnected; ++i) {
+			if (client_accepts_broadcast(client, &responses[i])) {
+				client_write_response(client, &responses[i]);
+			}
+		}
+
+		return;
+	}
+
+	buffer = malloc(count * sizeof(Packet));
+
+	if (buffer == NULL) {
+		log_error("Could not allocate broadcast buffer for client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+		          client_expand_signature(client), get_errno_name(ENOMEM), ENOMEM);
+
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (client_accepts_broadcast(client, &responses[i])) {
+			memcpy(buffer + used, &responses[i], responses[i].header.length);
+
+			used += responses[i].header.length;
+		}
+	}
+
+	if (used == 0) {
+		free(buffer);
+
+		return;
+	}
+
+	written = io_write(client->io, buffer, used);
+
+	if (written < 0) {
+		if (!errno_interrupted() && !errno_would_block()) {
+			log_error("Could not send responses to client ("CLIENT_SIGNATURE_FORMAT"), disconnecting client: %s (%d)",
+			          client_expand_signature(client), get_errno_name(errno), errno);
+
+			client_mark_as_disconnected(client);
+			free(buffer);
+
+			return;
+		}
+
+		written = 0;
+	}
+
+	// queue whatever the client did not accept, the first queued response
+	// might already be partially written
+	for (offset = 0; offset < used; offset += length) {
+		response = (Packet *)(buffer + offset);
+		length = response->header.length;
+
+		if (offset + length <= written) {
+			continue;
+		}
+
+		if (client_queue_response(client, response) < 0) {
+			if (offset < written) {
+				// the client already got a part of the response
+				client_mark_as_disconnected(client);
+			}
+
+			if (client->disconnected) {
+				break;
+			}
+
+			continue;
+		}
+
+		if (offset < written) {
+			client->queue_offset = written - offset;
+		}
+	}
+
+	free(buffer);
+}
+
 #ifdef BRICKD_WITH_RED_BRICK
 
 void client_send_red_brick_enumerate(Client *client, EnumerationType type) {
@@ -524,6 +2527,12 @@ void client_send_red_brick_enumerate(Client *client, EnumerationType type) {
 
 	uint32_t uid = red_usb_gadget_get_uid(); // always little endian
 
+	// the RED Brick announces itself once its USB gadget is initialized,
+	// which happens after the listeners are already open
+	if (uid == 0) {
+		return;
+	}
+
 	memset(&u.packet, 0, sizeof(u.packet));
 
 	u.response.header.uid = uid;
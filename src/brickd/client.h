@@ -24,6 +24,7 @@
 #define BRICKD_CLIENT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #ifdef _WIN32
 	#include <ws2tcpip.h>
 #else
@@ -34,12 +35,31 @@
 #include <daemonlib/io.h>
 #include <daemonlib/node.h>
 #include <daemonlib/packet.h>
-#include <daemonlib/writer.h>
-
-#define CLIENT_MAX_NAME_LENGTH 128
-#define CLIENT_MAX_PENDING_REQUESTS 32768
+#include <daemonlib/timer.h>
+
+#include "stack.h"
+#include "websocket.h"
+
+// the compact memory profile trades throughput headroom for a smaller worst
+// case memory footprint, for the RED Brick and other small gateways
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	#define CLIENT_MAX_NAME_LENGTH 64
+	#define CLIENT_MAX_PENDING_REQUESTS 1024
+	#define CLIENT_MAX_CALLBACK_FILTERS 64
+	#define CLIENT_MAX_CALLBACK_RATE_LIMITS 64
+	#define CLIENT_COALESCING_BUFFER_SIZE 1024
+	#define PENDING_REQUEST_POOL_SIZE 128
+#else
+	#define CLIENT_MAX_NAME_LENGTH 128
+	#define CLIENT_MAX_PENDING_REQUESTS 32768
+	#define CLIENT_MAX_CALLBACK_FILTERS 256
+	#define CLIENT_MAX_CALLBACK_RATE_LIMITS 256
+	#define CLIENT_COALESCING_BUFFER_SIZE 4096
+	#define PENDING_REQUEST_POOL_SIZE 1024
+#endif
+#define CLIENT_MAX_READS_PER_EVENT 16
+#define CLIENT_SESSION_TOKEN_LENGTH 16
 
-typedef struct _Client Client;
 typedef struct _Zombie Zombie;
 
 typedef enum {
@@ -49,33 +69,121 @@ typedef enum {
 	CLIENT_AUTHENTICATION_STATE_DONE
 } ClientAuthenticationState;
 
+typedef enum {
+	CLIENT_QUEUE_OVERFLOW_POLICY_DROP_CALLBACKS = 0,
+	CLIENT_QUEUE_OVERFLOW_POLICY_DISCONNECT
+} ClientQueueOverflowPolicy;
+
 typedef void (*ClientDestroyDoneFunction)(void);
 
+typedef struct {
+	uint32_t uid; // always little endian, 0 matches all UIDs
+	uint8_t function_id; // 0 matches all callbacks
+} ClientCallbackFilter;
+
+typedef struct {
+	uint32_t uid; // always little endian
+	uint8_t function_id;
+	uint64_t period; // microseconds, callbacks are delivered at most this often
+	uint64_t last_delivery; // microseconds
+	bool held; // latest waits for the end of the period
+	Packet latest; // held back callback, newer ones overwrite it
+} ClientCallbackRateLimit;
+
+// a response that is queued by several clients, allocated with the actual
+// length of the data. the data is either the response or a prepared WebSocket
+// frame of it
+typedef struct {
+	int ref_count;
+	int length;
+	uint8_t data[WEBSOCKET_MAX_SERVER_HEADER_LENGTH + sizeof(Packet)];
+} ClientSharedResponse;
+
+#define CLIENT_SHARED_RESPONSE_OVERHEAD offsetof(ClientSharedResponse, data)
+
+// allocated with the actual length of the response, not sizeof(Packet). a
+// queued broadcast references the shared response of the broadcast instead of
+// holding a copy of the response itself
+typedef struct {
+	Node queue_node;
+	Node callback_node; // only linked if the response is a callback
+	ClientSharedResponse *shared; // NULL if the response is held by value
+	bool prepared_frame; // the data is a prepared WebSocket frame
+	const uint8_t *data; // the response or the data of the shared response
+	int length;
+	Packet response; // not allocated if the response is shared
+} ClientQueuedResponse;
+
+#define CLIENT_QUEUED_RESPONSE_OVERHEAD offsetof(ClientQueuedResponse, response)
+
+// a response sent to all clients. its shared responses are created on first
+// use, so it is copied and framed at most once, not once per client
+typedef struct {
+	Packet *response;
+	ClientSharedResponse *plain;
+	ClientSharedResponse *frame;
+} ClientBroadcast;
+
 typedef struct _PendingRequest PendingRequest;
+typedef struct _CoalescedRequest CoalescedRequest;
+typedef struct _ResponseCacheEntry ResponseCacheEntry;
 
 struct _PendingRequest {
 	Node global_node;
 	Node client_node; // also used as zombie_node
+	Node index_node; // bucket list of the pending request index in network.c
 	Client *client;
 	Zombie *zombie;
 	PacketHeader header;
+	uint64_t arrival_time; // microseconds, for the response latency histograms
+	CoalescedRequest *coalesced_request; // led or waited for, NULL if not coalesced
+	ResponseCacheEntry *response_cache_entry; // filled by the response, if any
 };
 
 struct _Client {
+	Node network_node; // in the client list of network.c
+	Node removal_node; // in the removal list of network.c, if disconnected
+	Node flush_node; // in the flush list of network.c, if flush_scheduled
+	bool flush_scheduled;
 	char name[CLIENT_MAX_NAME_LENGTH]; // for display purpose
+	bool address_known;
+	uint8_t address[16]; // IPv6 or IPv4-mapped peer address, if known
 	IO *io;
 	bool disconnected;
-	union {
-		uint8_t buffer[512];
-		Packet request;
-	};
+	uint8_t *buffer; // requests are dispatched from here without copying, NULL while idle in compact mode
+	int buffer_size;
 	int buffer_used;
 	bool header_checked;
 	Node pending_request_sentinel;
 	int pending_request_count;
-	Writer response_writer;
+	Array callback_filters; // empty means that all callbacks are sent
+	Array callback_rate_limits; // empty means that callbacks are not decimated
+	bool callback_rate_limit_timer_created;
+	Timer callback_rate_limit_timer; // delivers held back callbacks
+	uint64_t callback_rate_limit_timer_due; // microseconds, 0 if not armed
+	uint32_t decimated_callbacks;
+	Node queue_sentinel; // responses waiting for the client to become writable
+	Node queued_callback_sentinel; // the queued callbacks, oldest first
+	int queue_offset; // bytes of the first queued response already written
+	int queue_max_responses;
+	int queue_max_bytes;
+	ClientQueueOverflowPolicy queue_overflow_policy;
+	uint32_t queued_responses;
+	uint32_t queued_bytes;
+	uint32_t peak_queued_responses;
+	uint32_t dropped_callbacks;
+	bool write_pending;
+	uint64_t coalescing_delay; // microseconds, 0 if disabled
+	uint8_t *coalescing_buffer;
+	int coalescing_size;
+	int coalescing_used;
+	uint64_t coalescing_start; // microseconds
+	bool byte_stream; // TCP or UNIX domain stream, several packets per write are fine
+	Websocket *websocket; // set if prepared frames can be written to the I/O object
 	ClientAuthenticationState authentication_state;
 	uint32_t authentication_nonce; // server
+	bool session_resumable; // a session token was issued
+	uint8_t session_token[CLIENT_SESSION_TOKEN_LENGTH];
 	ClientDestroyDoneFunction destroy_done;
 };
 
@@ -84,7 +192,9 @@ struct _Client {
 	(int)(client)->io->read_handle, (int)(client)->io->write_handle, \
 	client_get_authentication_state_name((client)->authentication_state)
 
+PendingRequest *pending_request_allocate(void);
 void pending_request_remove_and_free(PendingRequest *pending_request);
+void pending_request_get_pool_counters(uint32_t *hits, uint32_t *misses);
 
 const char *client_get_authentication_state_name(ClientAuthenticationState state);
 
@@ -93,8 +203,19 @@ int client_create(Client *client, const char *name, IO *io,
                   ClientDestroyDoneFunction destroy_done);
 void client_destroy(Client *client);
 
+void client_mark_as_disconnected(Client *client);
+void client_cancel_pending_request(Client *client, Packet *request);
+
+int client_enable_response_coalescing(Client *client, uint64_t delay);
+void client_flush_responses(Client *client);
+
 void client_dispatch_response(Client *client, PendingRequest *pending_request,
                               Packet *response, bool force, bool ignore_authentication);
+void client_broadcast_response(Client *client, Packet *response);
+void client_broadcast_init(ClientBroadcast *broadcast, Packet *response);
+void client_broadcast_release(ClientBroadcast *broadcast);
+void client_broadcast_shared_response(Client *client, ClientBroadcast *broadcast);
+void client_broadcast_responses(Client *client, Packet *responses, int count);
 
 #ifdef BRICKD_WITH_RED_BRICK
 
@@ -68,6 +68,7 @@
  base64.c^
  client.c^
  config_options.c^
+ fair_queue.c^
  event_winapi.c^
  fixes_msvc.c^
  hardware.c^
@@ -75,10 +76,20 @@
  log_winapi.c^
  mesh.c^
  mesh_stack.c^
+ metrics.c^
+ multicast.c^
  main_winapi.c^
+ name_resolver.c^
  network.c^
+ packet_ring.c^
+ packet_log.c^
+ packet_capture.c^
+ response_latency.c^
+ response_cache.c^
+ enumerate_cache.c^
  service.c^
  sha1.c^
+ spsc_ring.c^
  stack.c^
  usb.c^
  usb_stack.c^
@@ -86,6 +97,7 @@
  usb_winapi.c^
  usb_windows.c^
  websocket.c^
+ websocket_mask.c^
  zombie.c
 
 %RC% /folog_messages.res log_messages.rc
@@ -19,12 +19,63 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <daemonlib/config.h>
 #include <daemonlib/enum.h>
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
 #ifdef BRICKD_WITH_RED_BRICK
 	#include <daemonlib/red_led.h>
 #endif
 
+#include "config_options.h"
+
+#include "client.h"
+#include "network.h"
+#ifdef BRICKD_WITH_RED_BRICK
+	#include "red_rs485_extension.h"
+	#include "red_stack.h"
+#endif
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	#define DEFAULT_RECEIVE_BUFFER_SIZE 512
+	#define DEFAULT_MAX_QUEUED_RESPONSES 1024
+	#define DEFAULT_MAX_QUEUED_BYTES 65536
+	#define DEFAULT_USB_TRANSFERS 4
+#else
+	#define DEFAULT_RECEIVE_BUFFER_SIZE 4096
+	#define DEFAULT_MAX_QUEUED_RESPONSES 32768
+	#define DEFAULT_MAX_QUEUED_BYTES 1048576
+	#define DEFAULT_USB_TRANSFERS 10
+#endif
+
+typedef struct {
+	const char *name;
+	ConfigOptionType type;
+	ConfigOption *option; // NULL for options owned by daemonlib
+	ConfigOptionValue value;
+} ConfigOptionSnapshot;
+
+static EnumValueName _queue_overflow_policy_enum_value_names[] = {
+	{ CLIENT_QUEUE_OVERFLOW_POLICY_DROP_CALLBACKS, "drop-callbacks" },
+	{ CLIENT_QUEUE_OVERFLOW_POLICY_DISCONNECT,     "disconnect" },
+	{ -1,                                          NULL }
+};
+
+static int config_parse_queue_overflow_policy(const char *string, int *value) {
+	return enum_get_value(_queue_overflow_policy_enum_value_names, string, value, true);
+}
+
+static const char *config_format_queue_overflow_policy(int value) {
+	return enum_get_name(_queue_overflow_policy_enum_value_names, value, "<unknown>");
+}
+
 #ifdef BRICKD_WITH_RED_BRICK
 
 static EnumValueName _red_led_trigger_enum_value_names[] = {
@@ -51,16 +102,328 @@ ConfigOption config_options[] = {
 	CONFIG_OPTION_STRING_INITIALIZER("listen.address", 1, -1, "0.0.0.0"),
 	CONFIG_OPTION_INTEGER_INITIALIZER("listen.plain_port", 1, UINT16_MAX, 4223),
 	CONFIG_OPTION_INTEGER_INITIALIZER("listen.websocket_port", 0, UINT16_MAX, 0), // default to enable: 4280
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.metrics_port", 0, UINT16_MAX, 0), // 0 disables the metrics endpoint
 	CONFIG_OPTION_INTEGER_INITIALIZER("listen.mesh_gateway_port", 1, UINT16_MAX, 4240),
 	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.dual_stack", false),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.receive_buffer_size", 80, 1048576, DEFAULT_RECEIVE_BUFFER_SIZE), // bytes
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.response_coalescing_delay", 0, 1000000, 0), // microseconds, 0 to disable
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.websocket_deflate", false),
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.websocket_deflate_context_takeover", true),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.websocket_deflate_memory_limit", 32768, 1048576, 65536), // bytes
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.max_queued_responses", 1, 1048576, DEFAULT_MAX_QUEUED_RESPONSES),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.max_queued_bytes", 80, INT32_MAX, DEFAULT_MAX_QUEUED_BYTES),
+	CONFIG_OPTION_SYMBOL_INITIALIZER("listen.queue_overflow_policy", config_parse_queue_overflow_policy, config_format_queue_overflow_policy, CLIENT_QUEUE_OVERFLOW_POLICY_DROP_CALLBACKS),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.zombie_timeout", 10, 60000, 1000), // milliseconds
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.session_resumption", false),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.session_timeout", 100, 600000, 10000), // milliseconds
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.cancel_queued_requests", false),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.max_clients", 0, 65535, 0), // 0 for unlimited
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.max_clients_per_address", 0, 65535, 0), // 0 for unlimited
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.accept_rate", 0, 10000, 0), // connections per second, 0 for unlimited
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.accept_burst", 1, 10000, 20), // connections
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.resolve_client_names", false),
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.request_coalescing", false),
+	CONFIG_OPTION_STRING_INITIALIZER("listen.multicast_address", 0, -1, NULL), // empty disables callback multicast
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.multicast_port", 1, UINT16_MAX, 4223),
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.multicast_ttl", 1, 255, 1),
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("listen.multicast_without_authentication", false),
+	CONFIG_OPTION_STRING_INITIALIZER("response_cache.functions", 0, -1, NULL),
+	CONFIG_OPTION_INTEGER_INITIALIZER("enumerate_cache.refresh_interval", 0, 3600000, 0), // milliseconds, 0 to disable
 	CONFIG_OPTION_STRING_INITIALIZER("authentication.secret", 0, 64, NULL),
+	CONFIG_OPTION_INTEGER_INITIALIZER("usb.read_transfers", 1, 256, DEFAULT_USB_TRANSFERS),
+	CONFIG_OPTION_INTEGER_INITIALIZER("usb.write_transfers", 1, 256, DEFAULT_USB_TRANSFERS),
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("usb.adaptive_read_transfers", false),
+	CONFIG_OPTION_INTEGER_INITIALIZER("usb.responses_per_iteration", 1, 65536, 64),
+	CONFIG_OPTION_INTEGER_INITIALIZER("mesh.heartbeat_interval", 1000, 600000, 8000), // milliseconds
+	CONFIG_OPTION_INTEGER_INITIALIZER("mesh.heartbeat_jitter", 0, 50, 10), // percent of the interval
+	CONFIG_OPTION_INTEGER_INITIALIZER("packet_log.records", 0, 1048576, 16384), // 0 to disable
+	CONFIG_OPTION_STRING_INITIALIZER("packet_log.dump_file", 0, -1, NULL),
+	CONFIG_OPTION_STRING_INITIALIZER("packet_capture.file", 0, -1, NULL),
 	CONFIG_OPTION_SYMBOL_INITIALIZER("log.level", config_parse_log_level, config_format_log_level, LOG_LEVEL_INFO),
 	CONFIG_OPTION_STRING_INITIALIZER("log.debug_filter", 0, -1, NULL),
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	CONFIG_OPTION_INTEGER_INITIALIZER("loopback_stack.devices", 0, 4096, 8), // 0 to disable
+	CONFIG_OPTION_INTEGER_INITIALIZER("loopback_stack.response_delay", 0, 1000000, 0), // microseconds
+	CONFIG_OPTION_INTEGER_INITIALIZER("loopback_stack.callback_period", 0, 3600000, 0), // milliseconds, 0 to disable
+	CONFIG_OPTION_STRING_INITIALIZER("loopback_stack.replay_file", 0, -1, NULL),
+	CONFIG_OPTION_INTEGER_INITIALIZER("loopback_stack.replay_speed", 1, 100000, 100), // percent of the original rate
+#endif
+#ifndef _WIN32
+	CONFIG_OPTION_STRING_INITIALIZER("listen.unix_socket", 0, -1, NULL), // empty disables the UNIX domain stream listener
+	CONFIG_OPTION_STRING_INITIALIZER("listen.unix_seqpacket_socket", 0, -1, NULL), // empty disables the UNIX domain seqpacket listener
+#endif
+#ifdef BRICKD_WITH_IO_THREADS
+	CONFIG_OPTION_INTEGER_INITIALIZER("listen.io_threads", 0, 64, 0), // 0 to handle client I/O in the event thread
+#endif
+#ifdef BRICKD_WITH_USB_THREAD
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("usb.dedicated_thread", false),
+#endif
+#ifdef BRICKD_WITH_USBFS
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("usb.usbfs", false),
+#endif
+#ifdef BRICKD_WITH_EVENT_PROFILING
+	CONFIG_OPTION_INTEGER_INITIALIZER("event.stall_threshold", 0, 60000, 100), // milliseconds, 0 to disable
+#endif
 #ifdef BRICKD_WITH_RED_BRICK
 	CONFIG_OPTION_SYMBOL_INITIALIZER("led_trigger.green", config_parse_red_led_trigger, config_format_red_led_trigger, RED_LED_TRIGGER_HEARTBEAT),
 	CONFIG_OPTION_SYMBOL_INITIALIZER("led_trigger.red", config_parse_red_led_trigger, config_format_red_led_trigger, RED_LED_TRIGGER_OFF),
 	CONFIG_OPTION_INTEGER_INITIALIZER("poll_delay.spi", 50, INT32_MAX, 50), // microseconds
+	CONFIG_OPTION_INTEGER_INITIALIZER("poll_delay.spi_max", 50, INT32_MAX, 1000), // microseconds
 	CONFIG_OPTION_INTEGER_INITIALIZER("poll_delay.rs485", 50, INT32_MAX, 4000), // microseconds
+	CONFIG_OPTION_INTEGER_INITIALIZER("poll_backoff.rs485", 0, 64, 8), // poll turns
+	CONFIG_OPTION_INTEGER_INITIALIZER("spi.responses_per_iteration", 1, 256, 64),
+	CONFIG_OPTION_INTEGER_INITIALIZER("rs485.frames_per_turn", 1, 64, 1),
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("rs485.adaptive_timeout", true),
+	CONFIG_OPTION_INTEGER_INITIALIZER("rs485.timeout_min", 50, INT32_MAX, 2000), // microseconds
+	CONFIG_OPTION_INTEGER_INITIALIZER("rs485.timeout_max", 0, INT32_MAX, 0), // microseconds, 0 for the baudrate derived timeout
+	CONFIG_OPTION_INTEGER_INITIALIZER("spi.realtime_priority", 0, 99, 0), // 0 for normal scheduling
+	CONFIG_OPTION_INTEGER_INITIALIZER("spi.cpu_affinity", -1, 1023, -1), // -1 for any CPU, 1023 is CPU_SETSIZE - 1
+	CONFIG_OPTION_BOOLEAN_INITIALIZER("realtime.lock_memory", false),
 #endif
 	CONFIG_OPTION_NULL_INITIALIZER // end of list
 };
+
+// options owned by daemonlib instead of config_options[]
+static const ConfigOptionSnapshot _daemonlib_options[] = {
+	{ "log.level",        CONFIG_OPTION_TYPE_SYMBOL, NULL, { NULL } },
+	{ "log.debug_filter", CONFIG_OPTION_TYPE_STRING, NULL, { NULL } }
+};
+
+// options whose consumers either look them up on every use or provide a
+// reload function. all other options are only read once while subsystems are
+// initialized, changing them has to wait for the next restart
+static const char *_reloadable_option_names[] = {
+	"log.level",
+	"log.debug_filter",
+	"authentication.secret",
+	"listen.max_clients",
+	"listen.max_clients_per_address",
+	"listen.accept_rate",
+	"listen.accept_burst",
+	"listen.resolve_client_names",
+	"listen.receive_buffer_size", // for new clients
+	"listen.max_queued_responses", // for new clients
+	"listen.max_queued_bytes", // for new clients
+	"listen.queue_overflow_policy", // for new clients
+	"listen.response_coalescing_delay",
+	"listen.cancel_queued_requests",
+	"listen.zombie_timeout",
+	"listen.session_resumption",
+	"listen.session_timeout",
+#ifdef BRICKD_WITH_RED_BRICK
+	"poll_delay.spi",
+	"poll_delay.spi_max",
+	"poll_delay.rs485",
+	"poll_backoff.rs485",
+	"rs485.frames_per_turn",
+	"rs485.adaptive_timeout",
+	"rs485.timeout_min",
+	"rs485.timeout_max",
+#endif
+	NULL
+};
+
+static bool config_is_reloadable(const char *name, const ConfigOptionValue *previous,
+                                 const ConfigOptionValue *current) {
+	int i;
+
+	// clients keep their authentication state for their whole lifetime, only
+	// the secret of an enabled authentication can be changed in place
+	if (strcmp(name, "authentication.secret") == 0 &&
+	    (previous->string == NULL) != (current->string == NULL)) {
+		return false;
+	}
+
+	for (i = 0; _reloadable_option_names[i] != NULL; ++i) {
+		if (strcmp(_reloadable_option_names[i], name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool config_is_equal(ConfigOptionType type, const ConfigOptionValue *a,
+                            const ConfigOptionValue *b) {
+	switch (type) {
+	case CONFIG_OPTION_TYPE_STRING:
+		if (a->string == NULL || b->string == NULL) {
+			return a->string == b->string;
+		}
+
+		return strcmp(a->string, b->string) == 0;
+
+	case CONFIG_OPTION_TYPE_INTEGER:
+		return a->integer == b->integer;
+
+	case CONFIG_OPTION_TYPE_BOOLEAN:
+		return a->boolean == b->boolean;
+
+	case CONFIG_OPTION_TYPE_SYMBOL:
+		return a->symbol == b->symbol;
+
+	default:
+		return true;
+	}
+}
+
+static void config_free_snapshots(ConfigOptionSnapshot *snapshots, int count) {
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		if (snapshots[i].type == CONFIG_OPTION_TYPE_STRING) {
+			free(snapshots[i].value.string);
+		}
+	}
+
+	free(snapshots);
+}
+
+// gives the value of the snapshot back to the option. config_exit frees string
+// values that differ from the default, so the copy in the snapshot is handed
+// over to the config. options owned by daemonlib are only restored right after
+// config_exit, their current value is the default then and not owned
+static void config_restore_snapshot(ConfigOptionSnapshot *snapshot) {
+	ConfigOptionValue *value;
+
+	if (snapshot->option != NULL) {
+		value = &snapshot->option->value;
+	} else {
+		value = (ConfigOptionValue *)config_get_option_value(snapshot->name);
+	}
+
+	if (snapshot->type == CONFIG_OPTION_TYPE_STRING) {
+		if (snapshot->option != NULL &&
+		    value->string != snapshot->option->default_value.string) {
+			free(value->string);
+		}
+
+		value->string = snapshot->value.string;
+		snapshot->value.string = NULL;
+	} else {
+		*value = snapshot->value;
+	}
+}
+
+// rereads the config file and applies the changed values of reloadable options
+// in place, without reinitializing any subsystem. changes to other options are
+// reverted with a warning, so every subsystem keeps seeing the values it was
+// initialized with. if the file contains errors the previous values are kept.
+// changes to the log options are reported by log_changed, the log has to be
+// reinitialized by the caller as only it knows the log output to keep
+int config_options_reload(const char *filename, bool *log_changed) {
+	int option_count = 0;
+	int count;
+	ConfigOptionSnapshot *snapshots;
+	ConfigOptionSnapshot *snapshot;
+	const ConfigOptionValue *current;
+	bool changed = false;
+	int i;
+
+	*log_changed = false;
+
+	while (config_options[option_count].name != NULL) {
+		++option_count;
+	}
+
+	count = option_count + sizeof(_daemonlib_options) / sizeof(_daemonlib_options[0]);
+
+	snapshots = calloc(count, sizeof(ConfigOptionSnapshot));
+
+	if (snapshots == NULL) {
+		log_error("Could not allocate config option snapshot: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		snapshot = &snapshots[i];
+
+		if (i < option_count) {
+			snapshot->name = config_options[i].name;
+			snapshot->type = config_options[i].type;
+			snapshot->option = &config_options[i];
+		} else {
+			*snapshot = _daemonlib_options[i - option_count];
+		}
+
+		snapshot->value = *config_get_option_value(snapshot->name);
+
+		if (snapshot->type == CONFIG_OPTION_TYPE_STRING && snapshot->value.string != NULL) {
+			snapshot->value.string = strdup(snapshot->value.string);
+
+			if (snapshot->value.string == NULL) {
+				log_error("Could not copy value of config option %s: %s (%d)",
+				          snapshot->name, get_errno_name(ENOMEM), ENOMEM);
+
+				snapshot->type = CONFIG_OPTION_TYPE_INTEGER; // nothing to free
+				config_free_snapshots(snapshots, i + 1);
+
+				return -1;
+			}
+		}
+	}
+
+	log_info("Reloading config file '%s'", filename);
+
+	config_exit();
+	config_init(filename);
+
+	if (config_has_error()) {
+		log_error("Error(s) in config file '%s', keeping previous config", filename);
+
+		config_exit();
+
+		for (i = 0; i < count; ++i) {
+			config_restore_snapshot(&snapshots[i]);
+		}
+
+		config_free_snapshots(snapshots, count);
+
+		return -1;
+	}
+
+	if (config_has_warning()) {
+		log_warn("Warning(s) in config file '%s'", filename);
+	}
+
+	for (i = 0; i < count; ++i) {
+		snapshot = &snapshots[i];
+		current = config_get_option_value(snapshot->name);
+
+		if (config_is_equal(snapshot->type, &snapshot->value, current)) {
+			continue;
+		}
+
+		if (!config_is_reloadable(snapshot->name, &snapshot->value, current)) {
+			log_warn("Change of config option %s requires a restart, keeping previous value",
+			         snapshot->name);
+
+			config_restore_snapshot(snapshot);
+
+			continue;
+		}
+
+		log_info("Applying changed config option %s", snapshot->name);
+
+		if (strncmp(snapshot->name, "log.", 4) == 0) {
+			*log_changed = true;
+		}
+
+		changed = true;
+	}
+
+	config_free_snapshots(snapshots, count);
+
+	if (changed) {
+		network_reload_config();
+
+#ifdef BRICKD_WITH_RED_BRICK
+		red_stack_reload_config();
+		red_rs485_extension_reload_config();
+#endif
+	}
+
+	return 0;
+}
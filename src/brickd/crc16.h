@@ -0,0 +1,34 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * crc16.h: Modbus CRC-16 used by the RS485 extension
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_CRC16_H
+#define BRICKD_CRC16_H
+
+#include <stdint.h>
+
+#define CRC16_INITIAL_VALUE 0xFFFF
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, int length);
+uint16_t crc16_finalize(uint16_t crc);
+
+uint16_t crc16(const uint8_t *data, int length);
+
+#endif // BRICKD_CRC16_H
@@ -0,0 +1,175 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * enumerate_cache.c: Answers enumerate requests from the last seen callbacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * if enumerate_cache.refresh_interval is set then the last enumerate callback
+ * of every device is kept, as seen by network_dispatch_response. this includes
+ * the enumerate-disconnected callbacks sent by stack_announce_disconnect,
+ * which remove the device again. the first enumerate request is dispatched to
+ * the stacks as usual to fill the cache. later enumerate requests are answered
+ * from the cache to the requesting client only. if the last enumerate that
+ * was dispatched to the stacks is older than the refresh interval then the
+ * request is dispatched as well, so the cache catches up with devices that
+ * vanished without a disconnect. this way a reconnect storm of clients causes
+ * at most one enumerate per refresh interval on slow links such as RS485,
+ * mesh and SPI
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <daemonlib/array.h>
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "enumerate_cache.h"
+
+#include "hardware.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+static uint64_t _refresh_interval = 0; // microseconds, 0 if disabled
+static Array _callbacks; // EnumerateCallback, at most one per UID
+static bool _filled = false; // an enumerate was dispatched to the stacks
+static uint64_t _refreshed_at = 0; // microseconds
+static uint32_t _answered = 0;
+
+// the enumerate cache is optional. if it cannot be created then brickd runs
+// without it
+void enumerate_cache_init(void) {
+	_refresh_interval = (uint64_t)config_get_option_value("enumerate_cache.refresh_interval")->integer * 1000;
+
+	if (_refresh_interval == 0) {
+		log_debug("Enumerate cache is disabled");
+
+		return;
+	}
+
+	if (array_create(&_callbacks, 32, sizeof(EnumerateCallback), true) < 0) {
+		log_error("Could not create enumerate cache array, disabling enumerate cache: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		_refresh_interval = 0;
+
+		return;
+	}
+
+	_filled = false;
+	_answered = 0;
+
+	log_info("Enumerate cache is enabled (refresh-interval: %u msec)",
+	         (uint32_t)(_refresh_interval / 1000));
+}
+
+// safe to call if the enumerate cache is disabled
+void enumerate_cache_exit(void) {
+	if (_refresh_interval == 0) {
+		return;
+	}
+
+	log_debug("Enumerate cache answered %u enumerate request(s)", _answered);
+
+	array_destroy(&_callbacks, NULL);
+}
+
+void enumerate_cache_update(EnumerateCallback *enumerate_callback) {
+	EnumerateCallback *cached;
+	int i;
+
+	if (_refresh_interval == 0) {
+		return;
+	}
+
+	for (i = 0; i < _callbacks.count; ++i) {
+		cached = array_get(&_callbacks, i);
+
+		if (cached->header.uid == enumerate_callback->header.uid) {
+			break;
+		}
+	}
+
+	if (enumerate_callback->enumeration_type == ENUMERATION_TYPE_DISCONNECTED) {
+		if (i < _callbacks.count) {
+			array_remove(&_callbacks, i, NULL);
+		}
+
+		return;
+	}
+
+	if (i == _callbacks.count) {
+		cached = array_append(&_callbacks);
+
+		if (cached == NULL) {
+			log_error("Could not append to enumerate cache array: %s (%d)",
+			          get_errno_name(errno), errno);
+
+			return;
+		}
+	} else {
+		cached = array_get(&_callbacks, i);
+	}
+
+	memcpy(cached, enumerate_callback, sizeof(*cached));
+
+	cached->enumeration_type = ENUMERATION_TYPE_AVAILABLE;
+}
+
+// returns true if the enumerate request was answered from the cache and does
+// not have to be dispatched to the stacks
+bool enumerate_cache_handle_request(Client *client, Packet *request) {
+	uint64_t now;
+	int i;
+
+	if (_refresh_interval == 0) {
+		return false;
+	}
+
+	now = microseconds();
+
+	if (!_filled) {
+		_filled = true;
+		_refreshed_at = now;
+
+		return false;
+	}
+
+	log_debug("Answering enumerate request of client ("CLIENT_SIGNATURE_FORMAT") with %d cached enumerate callback(s)",
+	          client_expand_signature(client), _callbacks.count);
+
+	for (i = 0; i < _callbacks.count; ++i) {
+		client_broadcast_response(client, array_get(&_callbacks, i));
+	}
+
+	++_answered;
+
+	if (now - _refreshed_at >= _refresh_interval) {
+		_refreshed_at = now;
+
+		log_debug("Refreshing enumerate cache");
+
+		packet_add_trace(request);
+		hardware_dispatch_request(request, client);
+	}
+
+	return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * enumerate_cache.h: Answers enumerate requests from the last seen callbacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_ENUMERATE_CACHE_H
+#define BRICKD_ENUMERATE_CACHE_H
+
+#include <stdbool.h>
+
+#include <daemonlib/packet.h>
+
+#include "client.h"
+
+void enumerate_cache_init(void);
+void enumerate_cache_exit(void);
+
+void enumerate_cache_update(EnumerateCallback *enumerate_callback);
+bool enumerate_cache_handle_request(Client *client, Packet *request);
+
+#endif // BRICKD_ENUMERATE_CACHE_H
@@ -0,0 +1,664 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * event_io_uring.c: io_uring based event loop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * replacement for the epoll based event loop of daemonlib on Linux. every
+ * event source is watched by a one-shot IORING_OP_POLL_ADD request. all
+ * requests queued by adding, modifying or removing event sources and by
+ * re-arming the sources that were just handled are submitted together with
+ * the wait for the next completion in a single io_uring_enter call, instead
+ * of one epoll_ctl call per change plus epoll_wait. the timerfds of the
+ * daemonlib timers are normal event sources and go through the ring as well.
+ *
+ * multishot poll requests are not used on purpose. they only complete again
+ * if the file is woken up by new activity, but the event handlers rely on
+ * level-triggered semantics: for example, a client that was not drained
+ * because it hit CLIENT_MAX_READS_PER_EVENT has to be reported again. a
+ * one-shot request checks the current readiness when it is submitted.
+ *
+ * the request user data combines the file descriptor with a per descriptor
+ * generation. removing or modifying an event source bumps the generation, so
+ * completions of outdated requests are recognized and ignored even if the
+ * file descriptor got reused in the meantime.
+ *
+ * needs Linux 5.5 or newer, the ring is set up with raw system calls so there
+ * is no dependency on liburing.
+ */
+
+#include <errno.h>
+#include <endian.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <daemonlib/array.h>
+#include <daemonlib/event.h>
+#include <daemonlib/log.h>
+#include <daemonlib/pipe.h>
+#include <daemonlib/utils.h>
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define EVENT_IO_URING_SQ_ENTRIES 256
+#define EVENT_IO_URING_CQ_ENTRIES 4096
+#define EVENT_IO_URING_IGNORED UINT64_MAX // user data of poll removals
+
+typedef struct {
+	uint32_t generation;
+	bool armed; // a poll request with the current generation is in flight
+	int index; // position in the event source array, rechecked on every use
+} EventIOUringSlot;
+
+typedef struct {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size; // 0 if the CQ ring shares the SQ ring mapping
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_local_tail;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+} EventIOUring;
+
+static EventIOUring _ring;
+static Array _slots; // indexed by file descriptor
+static Pipe _stop_pipe;
+
+static int event_io_uring_enter(unsigned to_submit, unsigned min_complete) {
+	return (int)syscall(__NR_io_uring_enter, _ring.fd, to_submit, min_complete,
+	                    min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// submits all queued requests and waits for at least min_complete
+// completions. an interrupted wait or a full CQ ring is not an error, the
+// caller reaps the completions and the remaining requests are submitted by
+// the next call
+static int event_io_uring_submit(unsigned min_complete) {
+	unsigned to_submit;
+	int rc;
+
+	for (;;) {
+		to_submit = _ring.sq_local_tail - __atomic_load_n(_ring.sq_head, __ATOMIC_ACQUIRE);
+		rc = event_io_uring_enter(to_submit, min_complete);
+
+		if (rc >= 0) {
+			return 0;
+		}
+
+		if (errno == EINTR) {
+			if (min_complete > 0) {
+				return 0;
+			}
+
+			continue;
+		}
+
+		if (errno == EBUSY || errno == EAGAIN) {
+			return 0;
+		}
+
+		return -1;
+	}
+}
+
+// sets errno on error
+static struct io_uring_sqe *event_io_uring_get_sqe(void) {
+	unsigned index;
+	struct io_uring_sqe *sqe;
+
+	if (_ring.sq_local_tail - __atomic_load_n(_ring.sq_head, __ATOMIC_ACQUIRE) >= _ring.sq_entries) {
+		if (event_io_uring_submit(0) < 0) {
+			return NULL;
+		}
+
+		if (_ring.sq_local_tail - __atomic_load_n(_ring.sq_head, __ATOMIC_ACQUIRE) >= _ring.sq_entries) {
+			errno = EBUSY;
+
+			return NULL;
+		}
+	}
+
+	index = _ring.sq_local_tail & _ring.sq_mask;
+	sqe = &_ring.sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+
+	_ring.sq_array[index] = index;
+
+	return sqe;
+}
+
+static void event_io_uring_commit_sqe(void) {
+	++_ring.sq_local_tail;
+
+	__atomic_store_n(_ring.sq_tail, _ring.sq_local_tail, __ATOMIC_RELEASE);
+}
+
+static uint64_t event_get_user_data(int fd, EventIOUringSlot *slot) {
+	return ((uint64_t)slot->generation << 32) | (uint32_t)fd;
+}
+
+static EventIOUringSlot *event_get_slot(int fd, bool create) {
+	int count = _slots.count;
+	EventIOUringSlot *slot;
+	int i;
+
+	if (fd < 0) {
+		errno = EINVAL;
+
+		return NULL;
+	}
+
+	if (fd >= count) {
+		if (!create) {
+			return NULL;
+		}
+
+		if (array_resize(&_slots, fd + 1, NULL) < 0) {
+			return NULL;
+		}
+
+		for (i = count; i <= fd; ++i) {
+			slot = array_get(&_slots, i);
+
+			slot->generation = 0;
+			slot->armed = false;
+			slot->index = -1;
+		}
+	}
+
+	return array_get(&_slots, fd);
+}
+
+static int event_arm_slot(EventSource *event_source, EventIOUringSlot *slot) {
+	uint32_t poll_mask = 0;
+	struct io_uring_sqe *sqe;
+
+	if ((event_source->events & EVENT_READ) != 0) {
+		poll_mask |= POLLIN;
+	}
+
+	if ((event_source->events & EVENT_WRITE) != 0) {
+		poll_mask |= POLLOUT;
+	}
+
+	if ((event_source->events & EVENT_PRIO) != 0) {
+		poll_mask |= POLLPRI;
+	}
+
+	if ((event_source->events & EVENT_ERROR) != 0) {
+		poll_mask |= POLLERR;
+	}
+
+	if (poll_mask == 0) {
+		return 0;
+	}
+
+	sqe = event_io_uring_get_sqe();
+
+	if (sqe == NULL) {
+		log_error("Could not queue poll request for %s event source (handle: %d): %s (%d)",
+		          event_get_source_type_name(event_source->type, false),
+		          event_source->handle, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	poll_mask = (poll_mask << 16) | (poll_mask >> 16);
+#endif
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = event_source->handle;
+	sqe->poll32_events = poll_mask;
+	sqe->user_data = event_get_user_data(event_source->handle, slot);
+
+	event_io_uring_commit_sqe();
+
+	slot->armed = true;
+
+	return 0;
+}
+
+// outdated completions are ignored by their generation, even if the removal
+// request itself cannot be queued
+static void event_disarm_slot(int fd, EventIOUringSlot *slot) {
+	struct io_uring_sqe *sqe;
+
+	if (slot->armed) {
+		sqe = event_io_uring_get_sqe();
+
+		if (sqe == NULL) {
+			log_error("Could not queue poll removal for event source (handle: %d): %s (%d)",
+			          fd, get_errno_name(errno), errno);
+		} else {
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = event_get_user_data(fd, slot);
+			sqe->user_data = EVENT_IO_URING_IGNORED;
+
+			event_io_uring_commit_sqe();
+		}
+
+		slot->armed = false;
+	}
+
+	++slot->generation;
+}
+
+static EventSource *event_find_source(Array *event_sources, int fd, EventIOUringSlot *slot) {
+	EventSource *event_source;
+	int i;
+
+	if (slot->index >= 0 && slot->index < event_sources->count) {
+		event_source = array_get(event_sources, slot->index);
+
+		if (event_source->handle == fd && event_source->state != EVENT_SOURCE_STATE_REMOVED) {
+			return event_source;
+		}
+	}
+
+	// event_cleanup_sources moved the event source or it was never looked up
+	for (i = 0; i < event_sources->count; ++i) {
+		event_source = array_get(event_sources, i);
+
+		if (event_source->handle == fd && event_source->state != EVENT_SOURCE_STATE_REMOVED) {
+			slot->index = i;
+
+			return event_source;
+		}
+	}
+
+	slot->index = -1;
+
+	return NULL;
+}
+
+static uint32_t event_get_received_events(int poll_mask) {
+	uint32_t received_events = 0;
+
+	if ((poll_mask & POLLIN) != 0) {
+		received_events |= EVENT_READ;
+	}
+
+	if ((poll_mask & POLLOUT) != 0) {
+		received_events |= EVENT_WRITE;
+	}
+
+	if ((poll_mask & POLLPRI) != 0) {
+		received_events |= EVENT_PRIO;
+	}
+
+	if ((poll_mask & POLLERR) != 0) {
+		received_events |= EVENT_ERROR;
+	}
+
+	return received_events;
+}
+
+static void event_unmap_ring(void) {
+	if (_ring.sqes != NULL) {
+		munmap(_ring.sqes, _ring.sqes_size);
+	}
+
+	if (_ring.cq_ring_size > 0) {
+		munmap(_ring.cq_ring, _ring.cq_ring_size);
+	}
+
+	if (_ring.sq_ring != NULL) {
+		munmap(_ring.sq_ring, _ring.sq_ring_size);
+	}
+}
+
+static int event_setup_ring(void) {
+	struct io_uring_params params;
+	uint8_t *sq_ring;
+	uint8_t *cq_ring;
+
+	memset(&_ring, 0, sizeof(_ring));
+	memset(&params, 0, sizeof(params));
+
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = EVENT_IO_URING_CQ_ENTRIES;
+
+	_ring.fd = (int)syscall(__NR_io_uring_setup, EVENT_IO_URING_SQ_ENTRIES, &params);
+
+	if (_ring.fd < 0) {
+		log_error("Could not create io_uring: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	// without this feature completions could be lost if the CQ ring overflows
+	if ((params.features & IORING_FEAT_NODROP) == 0) {
+		log_error("Could not create io_uring, Linux 5.5 or newer is required");
+
+		close(_ring.fd);
+
+		return -1;
+	}
+
+	_ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	_ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		_ring.sq_ring_size = MAX(_ring.sq_ring_size, _ring.cq_ring_size);
+		_ring.cq_ring_size = 0;
+	}
+
+	_ring.sq_ring = mmap(NULL, _ring.sq_ring_size, PROT_READ | PROT_WRITE,
+	                     MAP_SHARED | MAP_POPULATE, _ring.fd, IORING_OFF_SQ_RING);
+
+	if (_ring.sq_ring == MAP_FAILED) {
+		_ring.sq_ring = NULL;
+
+		goto error;
+	}
+
+	if (_ring.cq_ring_size > 0) {
+		_ring.cq_ring = mmap(NULL, _ring.cq_ring_size, PROT_READ | PROT_WRITE,
+		                     MAP_SHARED | MAP_POPULATE, _ring.fd, IORING_OFF_CQ_RING);
+
+		if (_ring.cq_ring == MAP_FAILED) {
+			_ring.cq_ring_size = 0;
+
+			goto error;
+		}
+	} else {
+		_ring.cq_ring = _ring.sq_ring;
+	}
+
+	_ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	_ring.sqes = mmap(NULL, _ring.sqes_size, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, _ring.fd, IORING_OFF_SQES);
+
+	if (_ring.sqes == MAP_FAILED) {
+		_ring.sqes = NULL;
+
+		goto error;
+	}
+
+	sq_ring = _ring.sq_ring;
+	cq_ring = _ring.cq_ring;
+
+	_ring.sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+	_ring.sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+	_ring.sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+	_ring.sq_mask = *(unsigned *)(sq_ring + params.sq_off.ring_mask);
+	_ring.sq_entries = params.sq_entries;
+	_ring.sq_local_tail = *_ring.sq_tail;
+	_ring.cq_head = (unsigned *)(cq_ring + params.cq_off.head);
+	_ring.cq_tail = (unsigned *)(cq_ring + params.cq_off.tail);
+	_ring.cq_mask = *(unsigned *)(cq_ring + params.cq_off.ring_mask);
+	_ring.cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+	log_debug("Created io_uring with %u submission and %u completion entries",
+	          params.sq_entries, params.cq_entries);
+
+	return 0;
+
+error:
+	log_error("Could not map io_uring: %s (%d)", get_errno_name(errno), errno);
+
+	event_unmap_ring();
+	close(_ring.fd);
+
+	return -1;
+}
+
+int event_init_platform(void) {
+	int phase = 0;
+
+	if (event_setup_ring() < 0) {
+		goto cleanup;
+	}
+
+	phase = 1;
+
+	if (array_create(&_slots, 64, sizeof(EventIOUringSlot), true) < 0) {
+		log_error("Could not create io_uring slot array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 2;
+
+	// create stop pipe
+	if (pipe_create(&_stop_pipe, 0) < 0) {
+		log_error("Could not create stop pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 3;
+
+	if (event_add_source(_stop_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, NULL, NULL) < 0) {
+		goto cleanup;
+	}
+
+	phase = 4;
+
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 3:
+		pipe_destroy(&_stop_pipe);
+		// fall through
+
+	case 2:
+		array_destroy(&_slots, NULL);
+		// fall through
+
+	case 1:
+		event_unmap_ring();
+		close(_ring.fd);
+		// fall through
+
+	default:
+		break;
+	}
+
+	return phase == 4 ? 0 : -1;
+}
+
+void event_exit_platform(void) {
+	event_remove_source(_stop_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&_stop_pipe);
+
+	array_destroy(&_slots, NULL);
+
+	// closing the ring cancels all requests still in flight
+	event_unmap_ring();
+	close(_ring.fd);
+}
+
+// USB event sources are libusb file descriptors on Linux and are polled the
+// same way as generic event sources
+int event_source_added_platform(EventSource *event_source) {
+	EventIOUringSlot *slot = event_get_slot(event_source->handle, true);
+
+	if (slot == NULL) {
+		log_error("Could not add %s event source (handle: %d) to io_uring: %s (%d)",
+		          event_get_source_type_name(event_source->type, false),
+		          event_source->handle, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	// a removed event source that is added again may still have its poll
+	// request in flight
+	event_disarm_slot(event_source->handle, slot);
+
+	slot->index = -1;
+
+	return event_arm_slot(event_source, slot);
+}
+
+int event_source_modified_platform(EventSource *event_source) {
+	EventIOUringSlot *slot = event_get_slot(event_source->handle, false);
+
+	if (slot == NULL) {
+		return event_source_added_platform(event_source);
+	}
+
+	event_disarm_slot(event_source->handle, slot);
+
+	return event_arm_slot(event_source, slot);
+}
+
+void event_source_removed_platform(EventSource *event_source) {
+	EventIOUringSlot *slot = event_get_slot(event_source->handle, false);
+
+	if (slot != NULL) {
+		event_disarm_slot(event_source->handle, slot);
+	}
+}
+
+int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction cleanup) {
+	unsigned head;
+	unsigned tail;
+	struct io_uring_cqe *cqe;
+	uint64_t user_data;
+	int32_t result;
+	int fd;
+	uint32_t generation;
+	EventIOUringSlot *slot;
+	EventSource *event_source;
+	int handled;
+
+	*running = true;
+
+	cleanup();
+	event_cleanup_sources();
+
+	while (*running) {
+		log_event_debug("Starting to wait for io_uring completions");
+
+		if (event_io_uring_submit(1) < 0) {
+			log_error("Could not wait for io_uring completions: %s (%d)",
+			          get_errno_name(errno), errno);
+
+			*running = false;
+
+			return -1;
+		}
+
+		head = *_ring.cq_head;
+		tail = __atomic_load_n(_ring.cq_tail, __ATOMIC_ACQUIRE);
+		handled = 0;
+
+		while (*running && head != tail) {
+			cqe = &_ring.cqes[head & _ring.cq_mask];
+			user_data = cqe->user_data;
+			result = cqe->res;
+
+			// release the CQ entry before the event handler runs, it might
+			// queue new requests whose completions need room
+			__atomic_store_n(_ring.cq_head, ++head, __ATOMIC_RELEASE);
+
+			if (user_data == EVENT_IO_URING_IGNORED) {
+				continue;
+			}
+
+			fd = (int)(uint32_t)user_data;
+			generation = (uint32_t)(user_data >> 32);
+			slot = event_get_slot(fd, false);
+
+			if (slot == NULL || !slot->armed || slot->generation != generation) {
+				continue; // outdated
+			}
+
+			slot->armed = false;
+			event_source = event_find_source(event_sources, fd, slot);
+
+			if (event_source == NULL) {
+				continue;
+			}
+
+			if (result < 0) {
+				log_error("Could not poll %s event source (handle: %d): %s (%d)",
+				          event_get_source_type_name(event_source->type, false),
+				          fd, get_errno_name(-result), -result);
+
+				continue;
+			}
+
+			event_handle_source(event_source, event_get_received_events(result));
+
+			++handled;
+
+			// the event source has to be looked up again, the event handler
+			// might have added event sources and moved the arrays. it is not
+			// re-armed if the event handler modified or removed it
+			slot = event_get_slot(fd, false);
+
+			if (slot == NULL || slot->armed || slot->generation != generation) {
+				continue;
+			}
+
+			event_source = event_find_source(event_sources, fd, slot);
+
+			if (event_source != NULL) {
+				event_arm_slot(event_source, slot);
+			}
+		}
+
+		log_event_debug("Handled %d ready event source(s)", handled);
+
+		// now cleanup event sources that got marked as disconnected/removed
+		// during the event handling
+		cleanup();
+		event_cleanup_sources();
+	}
+
+	return 0;
+}
+
+int event_stop_platform(void) {
+	uint8_t byte = 0;
+
+	if (pipe_write(&_stop_pipe, &byte, sizeof(byte)) < 0) {
+		log_error("Could not write to stop pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * event_profile.c: Per-handler event loop profiling and stall detection
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * profiled handlers are wrapped with EVENT_PROFILE_HANDLER. the wrapper
+ * measures each call and adds it to the profile of the handler. an iteration
+ * is measured from the start of its first profiled call to the end-of-iteration
+ * cleanup in network.c. time spent in handlers that are not profiled before
+ * the first profiled call of an iteration is not seen
+ */
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "event_profile.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+static EventProfile *_first_profile = NULL;
+static uint64_t _stall_threshold = 0; // microseconds, 0 if disabled
+static uint64_t _iteration_start = 0; // microseconds, 0 outside an iteration
+static EventProfile *_iteration_longest_profile = NULL;
+static uint64_t _iteration_longest_time = 0; // microseconds
+static uint32_t _stalls = 0;
+
+void event_profile_init(void) {
+	_stall_threshold = (uint64_t)config_get_option_value("event.stall_threshold")->integer * 1000;
+
+	log_info("Event loop profiling is enabled (stall-threshold: %u msec)",
+	         (uint32_t)(_stall_threshold / 1000));
+}
+
+void event_profile_exit(void) {
+	EventProfile *profile;
+
+	log_info("Event loop profile (stalls: %u):", _stalls);
+
+	for (profile = _first_profile; profile != NULL; profile = profile->next) {
+		log_info("  %s: %u call(s), %llu usec total, %llu usec average, %llu usec max",
+		         profile->name, profile->calls,
+		         (unsigned long long)profile->total_time,
+		         (unsigned long long)(profile->total_time / profile->calls),
+		         (unsigned long long)profile->max_time);
+	}
+}
+
+void event_profile_call(EventProfile *profile, EventFunction function, void *opaque) {
+	uint64_t start = microseconds();
+	uint64_t duration;
+
+	if (_iteration_start == 0) {
+		_iteration_start = start;
+	}
+
+	function(opaque);
+
+	duration = microseconds() - start;
+
+	if (profile->calls == 0) {
+		profile->next = _first_profile;
+		_first_profile = profile;
+	}
+
+	++profile->calls;
+	profile->total_time += duration;
+
+	if (duration > profile->max_time) {
+		profile->max_time = duration;
+	}
+
+	if (duration > _iteration_longest_time) {
+		_iteration_longest_profile = profile;
+		_iteration_longest_time = duration;
+	}
+}
+
+void event_profile_end_iteration(void) {
+	uint64_t duration;
+
+	if (_iteration_start == 0) {
+		return;
+	}
+
+	duration = microseconds() - _iteration_start;
+
+	if (_stall_threshold > 0 && duration > _stall_threshold) {
+		++_stalls;
+
+		log_warn("Event loop iteration took %llu usec, longest handler was %s with %llu usec",
+		         (unsigned long long)duration, _iteration_longest_profile->name,
+		         (unsigned long long)_iteration_longest_time);
+	}
+
+	_iteration_start = 0;
+	_iteration_longest_profile = NULL;
+	_iteration_longest_time = 0;
+}
+
+EventProfile *event_profile_get_first(void) {
+	return _first_profile;
+}
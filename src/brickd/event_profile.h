@@ -0,0 +1,70 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * event_profile.h: Per-handler event loop profiling and stall detection
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_EVENT_PROFILE_H
+#define BRICKD_EVENT_PROFILE_H
+
+#include <stdint.h>
+
+#include <daemonlib/event.h>
+
+#ifdef BRICKD_WITH_EVENT_PROFILING
+
+typedef struct _EventProfile EventProfile;
+
+struct _EventProfile {
+	const char *name;
+	EventProfile *next; // in the list of profiles that were called at least once
+	uint32_t calls;
+	uint64_t total_time; // microseconds
+	uint64_t max_time; // microseconds
+};
+
+#define EVENT_PROFILE_INITIALIZER(name) { name, NULL, 0, 0, 0 }
+
+// defines function_profiled, that calls the event handler function and
+// accounts its duration to a profile with the given name
+#define EVENT_PROFILE_HANDLER(function, name) \
+	static EventProfile function##_profile = EVENT_PROFILE_INITIALIZER(name); \
+	static void function##_profiled(void *opaque) { \
+		event_profile_call(&function##_profile, function, opaque); \
+	}
+
+// the handler to pass to event_add_source and event_modify_source
+#define EVENT_PROFILED(function) function##_profiled
+
+void event_profile_init(void);
+void event_profile_exit(void);
+
+void event_profile_call(EventProfile *profile, EventFunction function, void *opaque);
+void event_profile_end_iteration(void);
+
+EventProfile *event_profile_get_first(void);
+
+#else
+
+#define EVENT_PROFILE_HANDLER(function, name)
+#define EVENT_PROFILED(function) function
+
+#endif
+
+#endif // BRICKD_EVENT_PROFILE_H
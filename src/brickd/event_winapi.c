@@ -71,6 +71,8 @@ static SocketSet *_socket_error_set = NULL;
 static Pipe _stop_pipe;
 static bool _usb_poll_running;
 static bool _usb_poll_stuck;
+static bool _usb_poll_suspended; // only accessed by the event thread
+static bool _usb_poll_reported; // set by the USB poll thread before suspending
 static int _usb_poll_suspend_pipe[2]; // libusb pipe
 static Pipe _usb_poll_ready_pipe;
 static Semaphore _usb_poll_resume;
@@ -110,16 +112,17 @@ static fd_set *event_get_socket_set_as_fd_set(SocketSet *socket_set) {
 	return (fd_set *)((uint8_t *)socket_set + offsetof(SocketSet, count));
 }
 
+// the USB poll thread polls the pollfd array prepared by the event thread.
+// it only reports back if a USB event source became ready, or if it was asked
+// to suspend. the event thread only suspends the USB poll thread if the set of
+// USB event sources changed. socket events don't interrupt the USB poll thread
 static void event_poll_usb_events(void *opaque) {
-	Array *event_sources = opaque;
-	int count;
 	struct usbi_pollfd *pollfd;
-	EventSource *event_source;
-	int i;
-	int k;
 	int ready;
 	uint8_t byte = 0;
 
+	(void)opaque;
+
 	log_debug("Started USB poll thread");
 
 	for (;;) {
@@ -133,52 +136,6 @@ static void event_poll_usb_events(void *opaque) {
 
 		_usb_poll_pollfds_ready = 0;
 
-		// update pollfd array
-		count = 0;
-
-		for (i = 0; i < event_sources->count; ++i) {
-			event_source = array_get(event_sources, i);
-
-			if (event_source->type == EVENT_SOURCE_TYPE_USB) {
-				++count;
-			}
-		}
-
-		if (count == 0) {
-			goto suspend;
-		}
-
-		++count; // add the suspend pipe
-
-		if (array_resize(&_usb_poll_pollfds, count, NULL) < 0) {
-			log_error("Could not resize USB pollfd array: %s (%d)",
-			          get_errno_name(errno), errno);
-
-			goto cleanup;
-		}
-
-		pollfd = array_get(&_usb_poll_pollfds, 0);
-
-		pollfd->fd = _usb_poll_suspend_pipe[0];
-		pollfd->events = USBI_POLLIN;
-		pollfd->revents = 0;
-
-		for (i = 0, k = 1; i < event_sources->count; ++i) {
-			event_source = array_get(event_sources, i);
-
-			if (event_source->type != EVENT_SOURCE_TYPE_USB) {
-				continue;
-			}
-
-			pollfd = array_get(&_usb_poll_pollfds, k);
-
-			pollfd->fd = event_source->handle;
-			pollfd->events = (short)event_source->events;
-			pollfd->revents = 0;
-
-			++k;
-		}
-
 		// start to poll
 		log_event_debug("Starting to poll on %d %s event source(s)",
 		                _usb_poll_pollfds.count - 1,
@@ -199,11 +156,15 @@ static void event_poll_usb_events(void *opaque) {
 			          event_get_source_type_name(EVENT_SOURCE_TYPE_USB, false),
 			          get_errno_name(errno), errno);
 
-			goto suspend;
+			// report back with no ready event sources, so the event thread
+			// resumes this thread again in its next iteration
+			ready = 0;
+
+			goto report;
 		}
 
 		if (ready == 0) {
-			goto suspend;
+			goto retry;
 		}
 
 		// handle poll result
@@ -213,16 +174,18 @@ static void event_poll_usb_events(void *opaque) {
 			log_event_debug("Received suspend signal");
 
 			--ready; // remove the suspend pipe
-		}
 
-		if (ready == 0) {
-			goto suspend;
+			if (ready == 0) {
+				goto suspend;
+			}
 		}
 
 		log_event_debug("Poll returned %d %s event source(s) as ready", ready,
 		                event_get_source_type_name(EVENT_SOURCE_TYPE_USB, false));
 
+	report:
 		_usb_poll_pollfds_ready = ready;
+		_usb_poll_reported = true;
 
 		if (pipe_write(&_usb_poll_ready_pipe, &byte, sizeof(byte)) < 0) {
 			log_error("Could not write to USB ready pipe: %s (%d)",
@@ -245,6 +208,122 @@ cleanup:
 	_usb_poll_running = false;
 }
 
+// must only be called while the USB poll thread is suspended. returns the
+// number of USB event sources, or -1 on error
+static int event_update_usb_pollfds(Array *event_sources) {
+	int count = 0;
+	struct usbi_pollfd *pollfd;
+	EventSource *event_source;
+	int i;
+	int k;
+
+	for (i = 0; i < event_sources->count; ++i) {
+		event_source = array_get(event_sources, i);
+
+		if (event_source->type == EVENT_SOURCE_TYPE_USB) {
+			++count;
+		}
+	}
+
+	if (array_resize(&_usb_poll_pollfds, count + 1, NULL) < 0) { // + 1 for the suspend pipe
+		log_error("Could not resize USB pollfd array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	pollfd = array_get(&_usb_poll_pollfds, 0);
+
+	pollfd->fd = _usb_poll_suspend_pipe[0];
+	pollfd->events = USBI_POLLIN;
+	pollfd->revents = 0;
+
+	for (i = 0, k = 1; i < event_sources->count; ++i) {
+		event_source = array_get(event_sources, i);
+
+		if (event_source->type != EVENT_SOURCE_TYPE_USB) {
+			continue;
+		}
+
+		pollfd = array_get(&_usb_poll_pollfds, k);
+
+		pollfd->fd = event_source->handle;
+		pollfd->events = (short)event_source->events;
+		pollfd->revents = 0;
+
+		++k;
+	}
+
+	return count;
+}
+
+// resumes the USB poll thread, if it's suspended and there is something to
+// poll. returns -1 on error
+static int event_resume_usb_poll(Array *event_sources) {
+	int count;
+
+	if (!_usb_poll_running || !_usb_poll_suspended) {
+		return 0;
+	}
+
+	// the USB poll thread might have reported ready event sources right
+	// before it got suspended. its poll result has to be forwarded before the
+	// pollfd array can be updated. the USB ready pipe is readable in this case
+	if (_usb_poll_reported) {
+		return 0;
+	}
+
+	count = event_update_usb_pollfds(event_sources);
+
+	if (count < 0) {
+		return -1;
+	}
+
+	if (count == 0) {
+		return 0; // stay suspended until a USB event source gets added
+	}
+
+	_usb_poll_suspended = false;
+
+	semaphore_release(&_usb_poll_resume);
+
+	return 0;
+}
+
+// interrupts the USB poll thread and waits for it to suspend. returns -1 on
+// error, then the USB poll thread is stuck
+static int event_suspend_usb_poll(void) {
+	uint8_t byte = 0;
+
+	if (!_usb_poll_running || _usb_poll_suspended || _usb_poll_stuck) {
+		return 0;
+	}
+
+	log_event_debug("Sending suspend signal to USB poll thread");
+
+	if (usbi_write(_usb_poll_suspend_pipe[1], &byte, 1) < 0) {
+		log_error("Could not write to USB suspend pipe");
+
+		_usb_poll_stuck = true;
+
+		return -1;
+	}
+
+	semaphore_acquire(&_usb_poll_suspend);
+
+	if (usbi_read(_usb_poll_suspend_pipe[0], &byte, 1) < 0) {
+		log_error("Could not read from USB suspend pipe");
+
+		_usb_poll_stuck = true;
+
+		return -1;
+	}
+
+	_usb_poll_suspended = true;
+
+	return 0;
+}
+
 static void event_forward_usb_events(void *opaque) {
 	Array *event_sources = opaque;
 	uint8_t byte;
@@ -254,6 +333,12 @@ static void event_forward_usb_events(void *opaque) {
 	int k;
 	EventSource *event_source;
 	struct usbi_pollfd *pollfd;
+	struct {
+		EventFunction function;
+		void *opaque;
+	} handled_reads[4];
+	int handled_read_count = 0;
+	int m;
 
 	(void)opaque;
 
@@ -264,6 +349,17 @@ static void event_forward_usb_events(void *opaque) {
 		return;
 	}
 
+	// the USB poll thread suspends itself after reporting ready event sources.
+	// if the set of USB event sources changed in the meantime then the event
+	// thread already waited for this while suspending the USB poll thread
+	if (!_usb_poll_suspended) {
+		semaphore_acquire(&_usb_poll_suspend);
+
+		_usb_poll_suspended = true;
+	}
+
+	_usb_poll_reported = false;
+
 	if (_usb_poll_pollfds.count == 0 || _usb_poll_pollfds_ready == 0) {
 		return;
 	}
@@ -298,9 +394,35 @@ static void event_forward_usb_events(void *opaque) {
 			continue;
 		}
 
-		event_handle_source(event_source, pollfd->revents);
-
 		++handled;
+
+		// the libusb fork emulates one pollfd per submitted transfer and a
+		// single libusb_handle_events call completes all transfers of its
+		// context that are done. therefore, the read function of a context
+		// only needs to be called once per poll result, instead of once per
+		// ready transfer. with several read transfers per device this saves
+		// most of the calls during callback bursts
+		if (pollfd->revents == USBI_POLLIN && event_source->state == EVENT_SOURCE_STATE_NORMAL) {
+			for (m = 0; m < handled_read_count; ++m) {
+				if (handled_reads[m].function == event_source->read &&
+				    handled_reads[m].opaque == event_source->read_opaque) {
+					break;
+				}
+			}
+
+			if (m < handled_read_count) {
+				continue;
+			}
+
+			if (handled_read_count < (int)(sizeof(handled_reads) / sizeof(handled_reads[0]))) {
+				handled_reads[handled_read_count].function = event_source->read;
+				handled_reads[handled_read_count].opaque = event_source->read_opaque;
+
+				++handled_read_count;
+			}
+		}
+
+		event_handle_source(event_source, pollfd->revents);
 	}
 
 	if (_usb_poll_pollfds_ready == handled) {
@@ -366,6 +488,8 @@ int event_init_platform(void) {
 	// create USB poll thread
 	_usb_poll_running = false;
 	_usb_poll_stuck = false;
+	_usb_poll_suspended = true;
+	_usb_poll_reported = false;
 
 	if (usbi_pipe(_usb_poll_suspend_pipe) < 0) {
 		log_error("Could not create USB suspend pipe");
@@ -476,20 +600,28 @@ void event_exit_platform(void) {
 	free(_socket_read_set);
 }
 
+// the USB poll thread has to stop polling before a USB event source changes,
+// the next event loop iteration resumes it with the updated pollfd array
 int event_source_added_platform(EventSource *event_source) {
-	(void)event_source;
+	if (event_source->type == EVENT_SOURCE_TYPE_USB) {
+		return event_suspend_usb_poll();
+	}
 
 	return 0;
 }
 
 int event_source_modified_platform(EventSource *event_source) {
-	(void)event_source;
+	if (event_source->type == EVENT_SOURCE_TYPE_USB) {
+		return event_suspend_usb_poll();
+	}
 
 	return 0;
 }
 
 void event_source_removed_platform(EventSource *event_source) {
-	(void)event_source;
+	if (event_source->type == EVENT_SOURCE_TYPE_USB) {
+		event_suspend_usb_poll();
+	}
 }
 
 int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction cleanup) {
@@ -501,7 +633,6 @@ int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction
 	fd_set *fd_error_set;
 	int ready;
 	int handled;
-	uint8_t byte = 1;
 	int rc;
 	int event_source_count;
 	uint32_t received_events;
@@ -514,6 +645,7 @@ int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction
 
 	*running = true;
 	_usb_poll_running = true;
+	_usb_poll_suspended = true;
 
 	thread_create(&_usb_poll_thread, event_poll_usb_events, event_sources);
 
@@ -521,6 +653,14 @@ int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction
 	event_cleanup_sources();
 
 	while (*running) {
+		if (_usb_poll_stuck) {
+			goto cleanup;
+		}
+
+		if (event_resume_usb_poll(event_sources) < 0) {
+			goto cleanup;
+		}
+
 		// update SocketSet arrays
 		if (event_reserve_socket_set(&_socket_read_set, // FIXME: this over-allocates
 		                             event_sources->count) < 0) {
@@ -579,36 +719,12 @@ int event_run_platform(Array *event_sources, bool *running, EventCleanupFunction
 		                _socket_read_set->count, _socket_write_set->count, _socket_error_set->count,
 		                event_get_source_type_name(EVENT_SOURCE_TYPE_GENERIC, false));
 
-		semaphore_release(&_usb_poll_resume);
-
 		fd_read_set = event_get_socket_set_as_fd_set(_socket_read_set);
 		fd_write_set = event_get_socket_set_as_fd_set(_socket_write_set);
 		fd_error_set = event_get_socket_set_as_fd_set(_socket_error_set);
 
 		ready = select(0, fd_read_set, fd_write_set, fd_error_set, NULL);
 
-		if (_usb_poll_running) {
-			log_event_debug("Sending suspend signal to USB poll thread");
-
-			if (usbi_write(_usb_poll_suspend_pipe[1], &byte, 1) < 0) {
-				log_error("Could not write to USB suspend pipe");
-
-				_usb_poll_stuck = true;
-
-				goto cleanup;
-			}
-
-			semaphore_acquire(&_usb_poll_suspend);
-
-			if (usbi_read(_usb_poll_suspend_pipe[0], &byte, 1) < 0) {
-				log_error("Could not read from USB suspend pipe");
-
-				_usb_poll_stuck = true;
-
-				goto cleanup;
-			}
-		}
-
 		if (ready == SOCKET_ERROR) {
 			rc = ERRNO_WINAPI_OFFSET + WSAGetLastError();
 
@@ -689,13 +805,11 @@ cleanup:
 	*running = false;
 
 	if (_usb_poll_running && !_usb_poll_stuck) {
-		_usb_poll_running = false;
-
 		log_debug("Stopping USB poll thread");
 
-		if (usbi_write(_usb_poll_suspend_pipe[1], &byte, 1) < 0) {
-			log_error("Could not write to USB suspend pipe");
-		} else {
+		if (event_suspend_usb_poll() >= 0) {
+			_usb_poll_running = false;
+
 			semaphore_release(&_usb_poll_resume);
 			thread_join(&_usb_poll_thread);
 		}
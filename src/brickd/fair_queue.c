@@ -0,0 +1,335 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * fair_queue.c: Deficit round-robin queue across request owners
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * a fair queue is a FIFO queue per owner (typically a client) with deficit
+ * round-robin scheduling between the owners. the owner at the front of the
+ * round-robin order gets FAIR_QUEUE_QUANTUM bytes of credit per turn and keeps
+ * its turn as long as the packet in its next item is covered by its credit.
+ * this way every owner gets the same share of bytes, regardless of how many
+ * items it queued or how large they are.
+ *
+ * the item returned by fair_queue_peek stays the same until it is popped,
+ * even if items are pushed in the meantime, so it can be modified in place.
+ * fair_queue_cancel_owner keeps that item, but might move it in memory.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/log.h>
+#include <daemonlib/packet.h>
+#include <daemonlib/utils.h>
+
+#include "fair_queue.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define FAIR_QUEUE_QUANTUM ((int)sizeof(Packet)) // bytes, fits the largest packet
+
+static FairQueueFlow *fair_queue_get_front(FairQueue *queue) {
+	return containerof(queue->flow_sentinel.next, FairQueueFlow, flow_node);
+}
+
+static int fair_queue_get_cost(FairQueue *queue, void *item) {
+	Packet *packet = (Packet *)((uint8_t *)item + queue->packet_offset);
+
+	return packet->header.length;
+}
+
+static FairQueueFlow *fair_queue_find_flow(FairQueue *queue, void *owner) {
+	Node *flow_node;
+	FairQueueFlow *flow;
+
+	for (flow_node = queue->flow_sentinel.next; flow_node != &queue->flow_sentinel;
+	     flow_node = flow_node->next) {
+		flow = containerof(flow_node, FairQueueFlow, flow_node);
+
+		if (flow->owner == owner) {
+			return flow;
+		}
+	}
+
+	return NULL;
+}
+
+// the flow at the front has the turn and gets its credit for it
+static void fair_queue_start_turn(FairQueue *queue) {
+	if (queue->flow_count > 0) {
+		fair_queue_get_front(queue)->deficit += FAIR_QUEUE_QUANTUM;
+	}
+}
+
+static void fair_queue_remove_flow(FairQueue *queue, FairQueueFlow *flow,
+                                   ItemDestroyFunction destroy) {
+	bool front = flow == fair_queue_get_front(queue);
+
+	node_remove(&flow->flow_node);
+	queue_destroy(&flow->items, destroy);
+	free(flow);
+
+	--queue->flow_count;
+
+	if (front) {
+		fair_queue_start_turn(queue);
+	}
+}
+
+static void fair_queue_pop_flow(FairQueue *queue, FairQueueFlow *flow,
+                                ItemDestroyFunction destroy) {
+	if (flow == queue->current) {
+		queue->current = NULL;
+	}
+
+	queue_pop(&flow->items, destroy);
+
+	--queue->count;
+
+	// an empty flow loses its remaining credit
+	if (flow->items.count == 0) {
+		fair_queue_remove_flow(queue, flow, NULL);
+	}
+}
+
+int fair_queue_create(FairQueue *queue, int item_size, int packet_offset) {
+	queue->item_size = item_size;
+	queue->packet_offset = packet_offset;
+	queue->current = NULL;
+	queue->current_cost = 0;
+	queue->flow_count = 0;
+	queue->count = 0;
+
+	node_reset(&queue->flow_sentinel);
+
+	return 0;
+}
+
+void fair_queue_destroy(FairQueue *queue, ItemDestroyFunction destroy) {
+	while (queue->flow_count > 0) {
+		fair_queue_remove_flow(queue, fair_queue_get_front(queue), destroy);
+	}
+
+	queue->current = NULL;
+	queue->count = 0;
+}
+
+// sets errno on error
+void *fair_queue_push(FairQueue *queue, void *owner) {
+	FairQueueFlow *flow = fair_queue_find_flow(queue, owner);
+	void *item;
+
+	if (flow == NULL) {
+		flow = calloc(1, sizeof(FairQueueFlow));
+
+		if (flow == NULL) {
+			errno = ENOMEM;
+
+			return NULL;
+		}
+
+		if (queue_create(&flow->items, queue->item_size) < 0) {
+			free(flow);
+
+			return NULL;
+		}
+
+		flow->owner = owner;
+
+		node_insert_before(&queue->flow_sentinel, &flow->flow_node);
+
+		if (++queue->flow_count == 1) {
+			fair_queue_start_turn(queue);
+		}
+
+		log_debug("Added flow %p for owner %p to fair queue %p (flows: %d)",
+		          flow, owner, queue, queue->flow_count);
+	}
+
+	item = queue_push(&flow->items);
+
+	if (item == NULL) {
+		if (flow->items.count == 0) {
+			fair_queue_remove_flow(queue, flow, NULL);
+		}
+
+		return NULL;
+	}
+
+	++queue->count;
+
+	return item;
+}
+
+void *fair_queue_peek(FairQueue *queue) {
+	FairQueueFlow *flow;
+	int cost;
+
+	if (queue->current != NULL) {
+		return queue_peek(&queue->current->items);
+	}
+
+	if (queue->count == 0) {
+		return NULL;
+	}
+
+	flow = fair_queue_get_front(queue);
+	cost = fair_queue_get_cost(queue, queue_peek(&flow->items));
+
+	// if the credit of the front flow is used up then its turn is over and the
+	// next flow gets its turn
+	while (cost > flow->deficit) {
+		node_remove(&flow->flow_node);
+		node_insert_before(&queue->flow_sentinel, &flow->flow_node);
+
+		fair_queue_start_turn(queue);
+
+		flow = fair_queue_get_front(queue);
+		cost = fair_queue_get_cost(queue, queue_peek(&flow->items));
+	}
+
+	queue->current = flow;
+	queue->current_cost = cost;
+
+	return queue_peek(&flow->items);
+}
+
+void fair_queue_pop(FairQueue *queue, ItemDestroyFunction destroy) {
+	FairQueueFlow *flow;
+
+	if (fair_queue_peek(queue) == NULL) {
+		return;
+	}
+
+	flow = queue->current;
+	flow->deficit -= queue->current_cost;
+
+	fair_queue_pop_flow(queue, flow, destroy);
+}
+
+// the flow with the most queued items is the one to drop from if the queue
+// is full, so a single owner cannot push out the items of all others
+static FairQueueFlow *fair_queue_get_longest_flow(FairQueue *queue) {
+	Node *flow_node;
+	FairQueueFlow *flow;
+	FairQueueFlow *longest = NULL;
+
+	for (flow_node = queue->flow_sentinel.next; flow_node != &queue->flow_sentinel;
+	     flow_node = flow_node->next) {
+		flow = containerof(flow_node, FairQueueFlow, flow_node);
+
+		if (longest == NULL || flow->items.count > longest->items.count) {
+			longest = flow;
+		}
+	}
+
+	return longest;
+}
+
+void *fair_queue_peek_longest(FairQueue *queue) {
+	FairQueueFlow *flow = fair_queue_get_longest_flow(queue);
+
+	return flow != NULL ? queue_peek(&flow->items) : NULL;
+}
+
+// pops the oldest item of the longest flow without charging its credit. this
+// invalidates the item returned by fair_queue_peek if it is the popped one
+void fair_queue_pop_longest(FairQueue *queue, ItemDestroyFunction destroy) {
+	FairQueueFlow *flow = fair_queue_get_longest_flow(queue);
+
+	if (flow != NULL) {
+		fair_queue_pop_flow(queue, flow, destroy);
+	}
+}
+
+// removes all items of the owner, except for the item returned by the last
+// fair_queue_peek, because the caller might be sending it right now. the cancel
+// function is called for each removed item. returns the number of removed
+// items. sets errno on error
+int fair_queue_cancel_owner(FairQueue *queue, void *owner,
+                            FairQueueCancelFunction cancel, void *opaque) {
+	FairQueueFlow *flow = fair_queue_find_flow(queue, owner);
+	void *current_item = NULL;
+	void *item;
+	int count = 0;
+
+	if (flow == NULL) {
+		return 0;
+	}
+
+	if (flow == queue->current) {
+		if (flow->items.count == 1) {
+			return 0;
+		}
+
+		// Queue can only pop from the front, take the current item out and
+		// push it back after the rest of the flow is gone
+		current_item = malloc(queue->item_size);
+
+		if (current_item == NULL) {
+			errno = ENOMEM;
+
+			return -1;
+		}
+
+		memcpy(current_item, queue_peek(&flow->items), queue->item_size);
+		queue_pop(&flow->items, NULL);
+		--queue->count;
+	}
+
+	while (flow->items.count > 0) {
+		item = queue_peek(&flow->items);
+
+		if (cancel != NULL) {
+			cancel(item, opaque);
+		}
+
+		queue_pop(&flow->items, NULL);
+		--queue->count;
+		++count;
+	}
+
+	if (current_item != NULL) {
+		item = queue_push(&flow->items);
+
+		if (item == NULL) {
+			log_error("Could not restore current item of flow %p in fair queue %p, dropping it: %s (%d)",
+			          flow, queue, get_errno_name(errno), errno);
+
+			free(current_item);
+			fair_queue_remove_flow(queue, flow, NULL);
+
+			queue->current = NULL;
+
+			return -1;
+		}
+
+		memcpy(item, current_item, queue->item_size);
+		++queue->count;
+
+		free(current_item);
+	} else {
+		fair_queue_remove_flow(queue, flow, NULL);
+	}
+
+	return count;
+}
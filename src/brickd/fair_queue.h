@@ -0,0 +1,63 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * fair_queue.h: Deficit round-robin queue across request owners
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_FAIR_QUEUE_H
+#define BRICKD_FAIR_QUEUE_H
+
+#include <daemonlib/node.h>
+#include <daemonlib/queue.h>
+
+// one FIFO queue per owner. the owner is only used as a key and is never
+// dereferenced. a NULL owner is valid and groups everything without an owner
+typedef struct {
+	Node flow_node;
+	void *owner;
+	Queue items;
+	int deficit; // bytes
+} FairQueueFlow;
+
+typedef struct {
+	int item_size;
+	int packet_offset; // offset of the Packet inside the item
+	Node flow_sentinel; // flows with queued items in round-robin order
+	FairQueueFlow *current; // flow of the item returned by fair_queue_peek
+	int current_cost; // bytes
+	int flow_count;
+	int count; // items
+} FairQueue;
+
+// called for each item removed by fair_queue_cancel_owner
+typedef void (*FairQueueCancelFunction)(void *item, void *opaque);
+
+int fair_queue_create(FairQueue *queue, int item_size, int packet_offset);
+void fair_queue_destroy(FairQueue *queue, ItemDestroyFunction destroy);
+
+void *fair_queue_push(FairQueue *queue, void *owner);
+void *fair_queue_peek(FairQueue *queue);
+void fair_queue_pop(FairQueue *queue, ItemDestroyFunction destroy);
+
+void *fair_queue_peek_longest(FairQueue *queue);
+void fair_queue_pop_longest(FairQueue *queue, ItemDestroyFunction destroy);
+
+int fair_queue_cancel_owner(FairQueue *queue, void *owner,
+                            FairQueueCancelFunction cancel, void *opaque);
+
+#endif // BRICKD_FAIR_QUEUE_H
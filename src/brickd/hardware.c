@@ -21,20 +21,264 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include <daemonlib/array.h>
+#include <daemonlib/base58.h>
 #include <daemonlib/log.h>
 #include <daemonlib/packet.h>
 #include <daemonlib/utils.h>
 
 #include "hardware.h"
 
+#include "packet_debug.h"
 #include "stack.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
 static Array _stacks;
 
+// the routing table maps each known UID to exactly one stack. it is an open
+// addressing hash table with linear probing. a UID of 0 marks an empty slot,
+// because 0 is the broadcast UID and never routed.
+//
+// UIDs that no stack knows are kept in the table as well, without a stack. if
+// requests for such a UID got broadcast HARDWARE_MAX_UNANSWERED_BROADCASTS
+// times within HARDWARE_UNKNOWN_UID_TIMEOUT without any response for it, then
+// further requests are dropped until the timeout is over, a response for the
+// UID arrives or a client enumerates
+#define HARDWARE_MAX_UNANSWERED_BROADCASTS 3
+#define HARDWARE_UNKNOWN_UID_TIMEOUT 10000000 // microseconds
+#define HARDWARE_MAX_UNKNOWN_UIDS 1024
+
+typedef struct {
+	uint32_t uid; // always little endian
+	Stack *stack; // NULL if the UID is unknown
+	int unanswered_broadcasts; // only used for unknown UIDs
+	uint64_t first_broadcast; // microseconds, only used for unknown UIDs
+	uint16_t device_identifier; // 0 until seen in an enumerate callback or get-identity response
+} HardwareRoute;
+
+static HardwareRoute *_routes = NULL;
+static int _route_bits = 0; // capacity is 2^_route_bits
+static int _route_count = 0; // including unknown UIDs
+static int _unknown_uid_count = 0;
+
+static HardwareRoute *hardware_get_route_slot(HardwareRoute *routes, int bits,
+                                              uint32_t uid) {
+	uint32_t mask = ((uint32_t)1 << bits) - 1;
+	uint32_t i = (uint32_t)(uid * 2654435761u) >> (32 - bits);
+
+	while (routes[i].uid != 0 && routes[i].uid != uid) {
+		i = (i + 1) & mask;
+	}
+
+	return &routes[i];
+}
+
+// rebuilds the table with the given capacity and without the routes to the
+// excluded stack. sets errno on error
+static int hardware_rebuild_routes(int bits, Stack *excluded_stack, bool keep_unknown_uids) {
+	HardwareRoute *routes = calloc((size_t)1 << bits, sizeof(HardwareRoute));
+	HardwareRoute *route;
+	int count = 0;
+	int unknown_uid_count = 0;
+	int i;
+
+	if (routes == NULL) {
+		errno = ENOMEM;
+
+		return -1;
+	}
+
+	for (i = 0; _routes != NULL && i < 1 << _route_bits; ++i) {
+		if (_routes[i].uid == 0 ||
+		    (_routes[i].stack != NULL && _routes[i].stack == excluded_stack) ||
+		    (_routes[i].stack == NULL && !keep_unknown_uids)) {
+			continue;
+		}
+
+		route = hardware_get_route_slot(routes, bits, _routes[i].uid);
+
+		*route = _routes[i];
+		++count;
+
+		if (route->stack == NULL) {
+			++unknown_uid_count;
+		}
+	}
+
+	free(_routes);
+
+	_routes = routes;
+	_route_bits = bits;
+	_route_count = count;
+	_unknown_uid_count = unknown_uid_count;
+
+	return 0;
+}
+
+static HardwareRoute *hardware_find_route(uint32_t uid) {
+	HardwareRoute *route;
+
+	if (_routes == NULL) {
+		return NULL;
+	}
+
+	route = hardware_get_route_slot(_routes, _route_bits, uid);
+
+	return route->uid != 0 ? route : NULL;
+}
+
+static Stack *hardware_get_route(uint32_t uid) {
+	HardwareRoute *route = hardware_find_route(uid);
+
+	return route != NULL ? route->stack : NULL;
+}
+
+// returns the existing or a new entry for the UID, or NULL on error. sets
+// errno on error
+static HardwareRoute *hardware_add_route(uint32_t uid) {
+	HardwareRoute *route;
+
+	// keep the load factor at 50% or below
+	if ((_route_count + 1) * 2 > (_routes != NULL ? 1 << _route_bits : 0) &&
+	    hardware_rebuild_routes(_route_bits > 0 ? _route_bits + 1 : 5, NULL, true) < 0) {
+		return NULL;
+	}
+
+	route = hardware_get_route_slot(_routes, _route_bits, uid);
+
+	if (route->uid == 0) {
+		route->uid = uid;
+		route->stack = NULL;
+		route->unanswered_broadcasts = 0;
+		route->first_broadcast = 0;
+		route->device_identifier = 0;
+
+		++_route_count;
+		++_unknown_uid_count;
+	}
+
+	return route;
+}
+
+// returns the stack the UID was previously routed to, or NULL
+static Stack *hardware_set_route(uint32_t uid, Stack *stack) {
+	HardwareRoute *route = hardware_add_route(uid);
+	Stack *previous_stack;
+	char base58[BASE58_MAX_LENGTH];
+
+	if (route == NULL) {
+		log_error("Could not grow routing table to add %s: %s (%d)",
+		          base58_encode(base58, uint32_from_le(uid)),
+		          get_errno_name(errno), errno);
+
+		return NULL;
+	}
+
+	previous_stack = route->stack;
+
+	if (previous_stack == NULL) {
+		--_unknown_uid_count;
+	}
+
+	route->stack = stack;
+
+	return previous_stack;
+}
+
+// returns true if the request for the unknown UID should be broadcast
+static bool hardware_check_unknown_uid(uint32_t uid) {
+	HardwareRoute *route = hardware_find_route(uid);
+	uint64_t now = microseconds();
+	char base58[BASE58_MAX_LENGTH];
+
+	if (route == NULL) {
+		if (_unknown_uid_count >= HARDWARE_MAX_UNKNOWN_UIDS) {
+			return true; // too many unknown UIDs to keep track of
+		}
+
+		route = hardware_add_route(uid);
+
+		if (route == NULL) {
+			return true;
+		}
+	}
+
+	if (route->unanswered_broadcasts == 0 ||
+	    now - route->first_broadcast >= HARDWARE_UNKNOWN_UID_TIMEOUT) {
+		route->unanswered_broadcasts = 0;
+		route->first_broadcast = now;
+	}
+
+	if (route->unanswered_broadcasts >= HARDWARE_MAX_UNANSWERED_BROADCASTS) {
+		return false;
+	}
+
+	if (++route->unanswered_broadcasts == HARDWARE_MAX_UNANSWERED_BROADCASTS) {
+		log_debug("No response for UID %s after %d broadcasts, dropping further requests for it for up to %d second(s)",
+		          base58_encode(base58, uint32_from_le(uid)),
+		          HARDWARE_MAX_UNANSWERED_BROADCASTS,
+		          HARDWARE_UNKNOWN_UID_TIMEOUT / 1000000);
+	}
+
+	return true;
+}
+
+static void hardware_remove_route(uint32_t uid) {
+	uint32_t mask;
+	HardwareRoute *route;
+	uint32_t i;
+	uint32_t k;
+	uint32_t home;
+
+	if (_routes == NULL) {
+		return;
+	}
+
+	route = hardware_get_route_slot(_routes, _route_bits, uid);
+
+	if (route->uid == 0) {
+		return;
+	}
+
+	if (route->stack == NULL) {
+		--_unknown_uid_count;
+	}
+
+	mask = ((uint32_t)1 << _route_bits) - 1;
+	i = (uint32_t)(route - _routes);
+	k = i;
+
+	// shift following entries of the same probe sequence back to keep the
+	// table free of holes, instead of leaving tombstones behind
+	for (;;) {
+		_routes[i].uid = 0;
+
+		for (;;) {
+			k = (k + 1) & mask;
+
+			if (_routes[k].uid == 0) {
+				--_route_count;
+
+				return;
+			}
+
+			home = (uint32_t)(_routes[k].uid * 2654435761u) >> (32 - _route_bits);
+
+			// move the entry at k to the hole at i, if its home slot is not
+			// cyclically between i (exclusive) and k (inclusive)
+			if ((i <= k) ? (i >= home || home > k) : (i >= home && home > k)) {
+				break;
+			}
+		}
+
+		_routes[i] = _routes[k];
+		i = k;
+	}
+}
+
 int hardware_init(void) {
 	log_debug("Initializing hardware subsystem");
 
@@ -57,6 +301,13 @@ void hardware_exit(void) {
 	}
 
 	array_destroy(&_stacks, NULL);
+
+	free(_routes);
+
+	_routes = NULL;
+	_route_bits = 0;
+	_route_count = 0;
+	_unknown_uid_count = 0;
 }
 
 int hardware_add_stack(Stack *stack) {
@@ -84,6 +335,21 @@ int hardware_remove_stack(Stack *stack) {
 		if (candidate == stack) {
 			array_remove(&_stacks, i, NULL);
 
+			// drop all routes to the removed stack. rebuilding the table in
+			// place can only fail if memory is exhausted, in which case the
+			// whole table is dropped
+			if (_routes != NULL && hardware_rebuild_routes(_route_bits, stack, true) < 0) {
+				log_error("Could not rebuild routing table, clearing it: %s (%d)",
+				          get_errno_name(errno), errno);
+
+				free(_routes);
+
+				_routes = NULL;
+				_route_bits = 0;
+				_route_count = 0;
+				_unknown_uid_count = 0;
+			}
+
 			return 0;
 		}
 	}
@@ -93,61 +359,105 @@ int hardware_remove_stack(Stack *stack) {
 	return -1;
 }
 
-void hardware_dispatch_request(Packet *request) {
+// cancels the requests of a disconnected client that are still queued, so
+// they do not use device bandwidth
+void hardware_cancel_requests(Client *client) {
+	int i;
+	Stack *stack;
+
+	for (i = 0; i < _stacks.count; ++i) {
+		stack = *(Stack **)array_get(&_stacks, i);
+
+		if (stack->cancel_requests != NULL) {
+			stack->cancel_requests(stack, client);
+		}
+	}
+}
+
+void hardware_dispatch_request(Packet *request, Client *client) {
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 	int i;
 	Stack *stack;
 	int rc;
-	bool dispatched = false;
 
 	packet_add_trace(request);
 
 	if (_stacks.count == 0) {
-		log_packet_debug("No stacks connected, dropping request (%s)",
-		                 packet_get_request_signature(packet_signature, request));
+		log_packet_debug_checked("No stacks connected, dropping request (%s)",
+		                         packet_get_request_signature(packet_signature, request));
 
 		return;
 	}
 
 	if (request->header.uid == 0) {
-		log_packet_debug("Broadcasting request (%s) to %d stack(s)",
-		                 packet_get_request_signature(packet_signature, request),
-		                 _stacks.count);
+		log_packet_debug_checked("Broadcasting request (%s) to %d stack(s)",
+		                         packet_get_request_signature(packet_signature, request),
+		                         _stacks.count);
 
 		packet_add_trace(request);
 
+		// give UIDs that did not respond recently another chance, because
+		// enumerating might show them again
+		if (request->header.function_id == FUNCTION_ENUMERATE &&
+		    _unknown_uid_count > 0 &&
+		    hardware_rebuild_routes(_route_bits, NULL, false) < 0) {
+			log_error("Could not rebuild routing table: %s (%d)",
+			          get_errno_name(errno), errno);
+		}
+
 		// broadcast to all stacks
 		for (i = 0; i < _stacks.count; ++i) {
 			stack = *(Stack **)array_get(&_stacks, i);
 
-			stack_dispatch_request(stack, request, true);
+			stack_dispatch_request(stack, request, client, true);
 		}
 	} else {
-		log_packet_debug("Dispatching request (%s) to %d stack(s)",
-		                 packet_get_request_signature(packet_signature, request),
-		                 _stacks.count);
+		stack = hardware_get_route(request->header.uid);
 
-		packet_add_trace(request);
+		if (stack != NULL) {
+			log_packet_debug_checked("Dispatching request (%s) to %s",
+			                         packet_get_request_signature(packet_signature, request),
+			                         stack->name);
 
-		// dispatch to all stacks, not only the first one that might claim to
-		// know the UID
+			packet_add_trace(request);
 
-		// FIXME: instead of sending to all stacks, dynamically update the routing
-		//        table and remove UIDs from a stack if the show up on another
-		//        stack. this ensures that the UID is only mapped to one stack
+			rc = stack_dispatch_request(stack, request, client, false);
+
+			if (rc != 0) {
+				return;
+			}
+
+			// the stack does not know the UID anymore
+			hardware_remove_route(request->header.uid);
+		}
+
+		log_packet_debug_checked("Dispatching request (%s) to %d stack(s)",
+		                         packet_get_request_signature(packet_signature, request),
+		                         _stacks.count);
+
+		packet_add_trace(request);
+
+		// the UID is not routed yet, but a stack might already know it. this
+		// happens if stack recipients are restored without a response, for
+		// example after reopening a USB device
 		for (i = 0; i < _stacks.count; ++i) {
 			stack = *(Stack **)array_get(&_stacks, i);
 
-			rc = stack_dispatch_request(stack, request, false);
+			rc = stack_dispatch_request(stack, request, client, false);
 
 			if (rc < 0) {
 				continue;
 			} else if (rc > 0) {
-				dispatched = true;
+				hardware_set_route(request->header.uid, stack);
+
+				return;
 			}
 		}
 
-		if (dispatched) {
+		if (!hardware_check_unknown_uid(request->header.uid)) {
+			log_packet_debug_checked("Dropping request (%s), because UID did not respond to recent broadcasts",
+			                         packet_get_request_signature(packet_signature, request));
+
 			return;
 		}
 
@@ -159,11 +469,70 @@ void hardware_dispatch_request(Packet *request) {
 		for (i = 0; i < _stacks.count; ++i) {
 			stack = *(Stack **)array_get(&_stacks, i);
 
-			stack_dispatch_request(stack, request, true);
+			stack_dispatch_request(stack, request, client, true);
 		}
 	}
 }
 
+// called for each response. the UID is routed to the stack that sent the
+// latest response for it. if the UID moves to another stack then the previous
+// stack forgets about it
+void hardware_update_route(Stack *stack, uint32_t uid /* always little endian */) {
+	Stack *previous_stack;
+	char base58[BASE58_MAX_LENGTH];
+
+	if (uid == 0 || hardware_get_route(uid) == stack) {
+		return;
+	}
+
+	previous_stack = hardware_set_route(uid, stack);
+
+	if (previous_stack != NULL && previous_stack != stack) {
+		log_debug("UID %s moved from %s to %s",
+		          base58_encode(base58, uint32_from_le(uid)),
+		          previous_stack->name, stack->name);
+
+		stack_remove_recipient(previous_stack, uid);
+	}
+}
+
+// returns the stack the UID is routed to, or NULL. the device identifier is 0
+// if not known yet
+Stack *hardware_find_stack(uint32_t uid /* always little endian */, uint16_t *device_identifier) {
+	HardwareRoute *route = hardware_find_route(uid);
+
+	if (route == NULL) {
+		*device_identifier = 0;
+
+		return NULL;
+	}
+
+	*device_identifier = route->device_identifier;
+
+	return route->stack;
+}
+
+// only updates known routes, UIDs without a route are not added
+void hardware_set_device_identifier(uint32_t uid /* always little endian */, uint16_t device_identifier) {
+	HardwareRoute *route = hardware_find_route(uid);
+
+	if (route != NULL) {
+		route->device_identifier = device_identifier;
+	}
+}
+
+int hardware_get_stack_count(void) {
+	return _stacks.count;
+}
+
+Stack *hardware_get_stack(int index) {
+	if (index < 0 || index >= _stacks.count) {
+		return NULL;
+	}
+
+	return *(Stack **)array_get(&_stacks, index);
+}
+
 void hardware_announce_disconnect(void) {
 	int i;
 	Stack *stack;
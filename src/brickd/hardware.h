@@ -32,7 +32,15 @@ void hardware_exit(void);
 int hardware_add_stack(Stack *stack);
 int hardware_remove_stack(Stack *stack);
 
-void hardware_dispatch_request(Packet *request);
+void hardware_dispatch_request(Packet *request, Client *client);
+void hardware_update_route(Stack *stack, uint32_t uid /* always little endian */);
+void hardware_cancel_requests(Client *client);
+
+Stack *hardware_find_stack(uint32_t uid /* always little endian */, uint16_t *device_identifier);
+void hardware_set_device_identifier(uint32_t uid /* always little endian */, uint16_t device_identifier);
+
+int hardware_get_stack_count(void);
+Stack *hardware_get_stack(int index);
 
 void hardware_announce_disconnect(void);
 
@@ -113,12 +113,11 @@ fallback:
 	return (seconds << 26 | seconds >> 6) + microseconds + getpid(); // overflow is intended
 }
 
-void hmac_sha1(uint8_t *secret, int secret_length,
-               uint8_t *data, int data_length,
-               uint8_t digest[SHA1_DIGEST_LENGTH]) {
+// absorbs the ipad and opad blocks once, so that each following HMAC
+// computation with the same secret only has to hash the actual data
+void hmac_sha1_prepare_key(HMACSHA1Key *key, uint8_t *secret, int secret_length) {
 	SHA1 sha1;
 	uint8_t secret_digest[SHA1_DIGEST_LENGTH];
-	uint8_t inner_digest[SHA1_DIGEST_LENGTH];
 	uint8_t ipad[SHA1_BLOCK_LENGTH];
 	uint8_t opad[SHA1_BLOCK_LENGTH];
 	int i;
@@ -132,7 +131,7 @@ void hmac_sha1(uint8_t *secret, int secret_length,
 		secret_length = SHA1_DIGEST_LENGTH;
 	}
 
-	// inner digest
+	// inner state
 	for (i = 0; i < secret_length; ++i) {
 		ipad[i] = secret[i] ^ 0x36;
 	}
@@ -141,12 +140,10 @@ void hmac_sha1(uint8_t *secret, int secret_length,
 		ipad[i] = 0x36;
 	}
 
-	sha1_init(&sha1);
-	sha1_update(&sha1, ipad, SHA1_BLOCK_LENGTH);
-	sha1_update(&sha1, data, data_length);
-	sha1_final(&sha1, inner_digest);
+	sha1_init(&key->inner);
+	sha1_update(&key->inner, ipad, SHA1_BLOCK_LENGTH);
 
-	// outer digest
+	// outer state
 	for (i = 0; i < secret_length; ++i) {
 		opad[i] = secret[i] ^ 0x5C;
 	}
@@ -155,8 +152,33 @@ void hmac_sha1(uint8_t *secret, int secret_length,
 		opad[i] = 0x5C;
 	}
 
-	sha1_init(&sha1);
-	sha1_update(&sha1, opad, SHA1_BLOCK_LENGTH);
+	sha1_init(&key->outer);
+	sha1_update(&key->outer, opad, SHA1_BLOCK_LENGTH);
+}
+
+void hmac_sha1_with_key(HMACSHA1Key *key, uint8_t *data, int data_length,
+                        uint8_t digest[SHA1_DIGEST_LENGTH]) {
+	SHA1 sha1;
+	uint8_t inner_digest[SHA1_DIGEST_LENGTH];
+
+	// inner digest
+	sha1 = key->inner;
+
+	sha1_update(&sha1, data, data_length);
+	sha1_final(&sha1, inner_digest);
+
+	// outer digest
+	sha1 = key->outer;
+
 	sha1_update(&sha1, inner_digest, SHA1_DIGEST_LENGTH);
 	sha1_final(&sha1, digest);
 }
+
+void hmac_sha1(uint8_t *secret, int secret_length,
+               uint8_t *data, int data_length,
+               uint8_t digest[SHA1_DIGEST_LENGTH]) {
+	HMACSHA1Key key;
+
+	hmac_sha1_prepare_key(&key, secret, secret_length);
+	hmac_sha1_with_key(&key, data, data_length, digest);
+}
@@ -27,8 +27,17 @@
 
 #include "sha1.h"
 
+typedef struct {
+	SHA1 inner; // state after absorbing the ipad block
+	SHA1 outer; // state after absorbing the opad block
+} HMACSHA1Key;
+
 uint32_t get_random_uint32(void);
 
+void hmac_sha1_prepare_key(HMACSHA1Key *key, uint8_t *secret, int secret_length);
+void hmac_sha1_with_key(HMACSHA1Key *key, uint8_t *data, int data_length,
+                        uint8_t digest[SHA1_DIGEST_LENGTH]);
+
 void hmac_sha1(uint8_t *secret, int secret_length,
                uint8_t *data, int data_length,
                uint8_t digest[SHA1_DIGEST_LENGTH]);
@@ -0,0 +1,1115 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * io_worker.c: Client socket I/O on worker threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * every worker thread owns the sockets of a share of the clients. it reads
+ * from them, which includes the WebSocket framing and handshake, and writes
+ * the responses to them. routing, authentication and all the client logic in
+ * client.c and network.c stay in the event thread.
+ *
+ * the event thread sees a wrapped client socket as an IO object without a
+ * handle. its write function hands the data to the worker and its read
+ * function returns what the worker received. the data is exchanged through
+ * two SPSC rings per worker, one in each direction, and a pipe per direction
+ * wakes up the other side. a wakeup is only sent if the other side is not
+ * already about to look at the ring.
+ *
+ * a connection is freed by the event thread after the worker released it. the
+ * release is the last item the worker sends for a connection, so no item in
+ * the ring can refer to a freed connection.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/node.h>
+#include <daemonlib/pipe.h>
+#include <daemonlib/threads.h>
+#include <daemonlib/utils.h>
+
+#include "io_worker.h"
+
+#include "event_profile.h"
+#include "spsc_ring.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define IO_WORKER_CHUNK_SIZE 512
+#define IO_WORKER_RING_CAPACITY 1024 // items, per direction and worker
+#define IO_WORKER_MAX_QUEUED_BYTES 65536 // per connection, not yet written by the worker
+#define IO_WORKER_MAX_READS_PER_EVENT 16
+#define IO_WORKER_MAX_ITEMS_PER_EVENT 256
+
+typedef enum {
+	IO_WORKER_ITEM_ADD = 0, // to the worker
+	IO_WORKER_ITEM_DATA, // to the worker and to the event thread
+	IO_WORKER_ITEM_CLOSED, // to the event thread, end of stream or error
+	IO_WORKER_ITEM_WRITABLE, // to the event thread
+	IO_WORKER_ITEM_BATCHING, // to the event thread
+	IO_WORKER_ITEM_RELEASED // to the event thread
+} IOWorkerItemType;
+
+typedef struct _IOWorker IOWorker;
+typedef struct _IOWorkerConnection IOWorkerConnection;
+
+typedef struct {
+	IOWorkerConnection *connection;
+	IOWorkerItemType type;
+	int length; // of the data, or the errno value of a closed item
+	uint8_t data[IO_WORKER_CHUNK_SIZE];
+} IOWorkerItem;
+
+struct _IOWorkerConnection {
+	IO *io; // the wrapped socket, owned by the worker once started
+	IOWorker *worker;
+	bool started;
+
+	// event thread only
+	IO *worker_io; // NULL after the client destroyed its I/O object
+	EventFunction read;
+	EventFunction write;
+	void *opaque;
+	WebsocketBatchingFunction batching;
+	void *batching_opaque;
+	IOWorkerItem *current; // the data or closed item that is being read
+	int current_offset;
+
+	// accessed atomically by both threads
+	uint32_t queued_bytes; // handed to the worker, but not written yet
+	uint32_t writable_wanted;
+	uint32_t detached;
+
+	// worker thread only
+	Node worker_node;
+	bool detaching;
+	bool closed; // nothing is read or written anymore
+	int closed_error;
+	bool closed_pending;
+	bool writable_pending;
+	bool batching_pending;
+	uint8_t *output;
+	int output_size;
+	int output_used;
+	int pollfd_index; // -1 if not polled
+};
+
+typedef struct {
+	IO base;
+	IOWorkerConnection *connection;
+} IOWorkerIO;
+
+struct _IOWorker {
+	int index;
+	Thread thread;
+	uint32_t stopping;
+	SPSCRing to_worker;
+	SPSCRing from_worker;
+	Pipe wakeup; // for the worker
+	uint32_t wakeup_pending;
+	Pipe notification; // for the event thread
+	uint32_t notification_pending;
+	uint32_t room_wanted; // the worker waits for room in the ring to the event thread
+	int connection_count; // event thread only, to assign new connections
+
+	// worker thread only
+	Node connection_sentinel;
+	bool notify;
+	struct pollfd *pollfds;
+	int pollfds_size;
+	uint8_t buffer[IO_WORKER_CHUNK_SIZE];
+};
+
+static IOWorker *_workers = NULL;
+static int _worker_count = 0;
+
+static uint32_t io_worker_load(uint32_t *value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static void io_worker_store(uint32_t *value, uint32_t new_value) {
+	__atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+static uint32_t io_worker_exchange(uint32_t *value, uint32_t new_value) {
+	return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+// the pending flag is set until the other side drained the pipe, so there is
+// at most one byte in the pipe and a burst of items causes only one wakeup
+static void io_worker_signal(Pipe *pipe, uint32_t *pending) {
+	uint8_t byte = 0;
+
+	if (io_worker_exchange(pending, 1) != 0) {
+		return;
+	}
+
+	if (pipe_write(pipe, &byte, sizeof(byte)) < 0) {
+		log_error("Could not write to I/O worker pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+	}
+}
+
+// has to be called before looking at the ring, so that items added afterwards
+// cause a new wakeup
+static void io_worker_drain(Pipe *pipe, uint32_t *pending) {
+	uint8_t bytes[16];
+
+	while (pipe_read(pipe, bytes, sizeof(bytes)) > 0) {
+	}
+
+	io_worker_store(pending, 0);
+}
+
+static bool io_worker_push(IOWorker *worker, IOWorkerConnection *connection,
+                           IOWorkerItemType type, const void *data, int length) {
+	IOWorkerItem *item = spsc_ring_reserve(&worker->from_worker);
+
+	if (item == NULL) {
+		return false;
+	}
+
+	item->connection = connection;
+	item->type = type;
+	item->length = length;
+
+	if (data != NULL) {
+		memcpy(item->data, data, length);
+	}
+
+	spsc_ring_commit(&worker->from_worker);
+
+	worker->notify = true;
+
+	return true;
+}
+
+static bool io_worker_is_write_blocked(IOWorkerConnection *connection) {
+	return io_worker_load(&connection->queued_bytes) >= IO_WORKER_MAX_QUEUED_BYTES ||
+	       spsc_ring_count(&connection->worker->to_worker) >= IO_WORKER_RING_CAPACITY;
+}
+
+// a read might also enable batching, so reading requires room for two items
+static bool io_worker_has_room(IOWorker *worker) {
+	return spsc_ring_count(&worker->from_worker) + 2 <= IO_WORKER_RING_CAPACITY;
+}
+
+/*
+ * event thread
+ */
+
+static void io_worker_deliver(IOWorkerConnection *connection, IOWorkerItem *item) {
+	int offset;
+
+	connection->current = item;
+	connection->current_offset = 0;
+
+	// the read function might read less than the whole item if its receive
+	// buffer runs full. call it until the item is consumed, but give up if it
+	// stops making progress
+	while (connection->worker_io != NULL && connection->current != NULL) {
+		offset = connection->current_offset;
+
+		connection->read(connection->opaque);
+
+		if (connection->current == item && connection->current_offset == offset) {
+			break;
+		}
+	}
+
+	connection->current = NULL;
+}
+
+static void io_worker_handle_events(void *opaque) {
+	IOWorker *worker = opaque;
+	IOWorkerItem *item;
+	IOWorkerConnection *connection;
+	int count = 0;
+
+	io_worker_drain(&worker->notification, &worker->notification_pending);
+
+	while (count < IO_WORKER_MAX_ITEMS_PER_EVENT &&
+	       (item = spsc_ring_peek(&worker->from_worker)) != NULL) {
+		connection = item->connection;
+
+		switch (item->type) {
+		case IO_WORKER_ITEM_DATA:
+		case IO_WORKER_ITEM_CLOSED:
+			if (connection->worker_io != NULL) {
+				io_worker_deliver(connection, item);
+			}
+
+			break;
+
+		case IO_WORKER_ITEM_WRITABLE:
+			if (connection->worker_io != NULL) {
+				connection->write(connection->opaque);
+			}
+
+			break;
+
+		case IO_WORKER_ITEM_BATCHING:
+			if (connection->worker_io != NULL && connection->batching != NULL) {
+				connection->batching(connection->batching_opaque);
+			}
+
+			break;
+
+		case IO_WORKER_ITEM_RELEASED:
+			--worker->connection_count;
+
+			free(connection);
+
+			break;
+
+		default:
+			break;
+		}
+
+		spsc_ring_pop(&worker->from_worker);
+
+		++count;
+	}
+
+	// the worker stops reading while the ring is full, tell it about the room.
+	// the fence pairs with the one in io_worker_wait_for_room
+	if (count > 0) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if (io_worker_exchange(&worker->room_wanted, 0) != 0) {
+			io_worker_signal(&worker->wakeup, &worker->wakeup_pending);
+		}
+	}
+
+	// continue in the next event loop iteration to not starve other sources
+	if (spsc_ring_peek(&worker->from_worker) != NULL) {
+		io_worker_signal(&worker->notification, &worker->notification_pending);
+	}
+}
+
+EVENT_PROFILE_HANDLER(io_worker_handle_events, "io-worker")
+
+static void io_worker_io_destroy(IO *io) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+
+	if (!connection->started) {
+		io_destroy(connection->io);
+		free(connection->io);
+		free(connection);
+
+		return;
+	}
+
+	// the worker writes what it already got and releases the connection
+	connection->worker_io = NULL;
+
+	io_worker_store(&connection->detached, 1);
+	io_worker_signal(&connection->worker->wakeup, &connection->worker->wakeup_pending);
+}
+
+static int io_worker_io_read(IO *io, void *buffer, int length) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+	IOWorkerItem *item = connection->current;
+
+	if (item == NULL) {
+		errno = EWOULDBLOCK;
+
+		return -1;
+	}
+
+	if (item->type == IO_WORKER_ITEM_CLOSED) {
+		connection->current = NULL;
+
+		if (item->length == 0) {
+			return 0;
+		}
+
+		errno = item->length;
+
+		return -1;
+	}
+
+	length = MIN(length, item->length - connection->current_offset);
+
+	memcpy(buffer, item->data + connection->current_offset, length);
+
+	connection->current_offset += length;
+
+	if (connection->current_offset >= item->length) {
+		connection->current = NULL;
+	}
+
+	return length;
+}
+
+static int io_worker_io_write(IO *io, const void *buffer, int length) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+	IOWorker *worker = connection->worker;
+	IOWorkerItem *item;
+	int written = 0;
+	int chunk;
+
+	if (!connection->started) {
+		errno = EWOULDBLOCK;
+
+		return -1;
+	}
+
+	while (written < length && !io_worker_is_write_blocked(connection)) {
+		item = spsc_ring_reserve(&worker->to_worker);
+		chunk = MIN(length - written, IO_WORKER_CHUNK_SIZE);
+
+		item->connection = connection;
+		item->type = IO_WORKER_ITEM_DATA;
+		item->length = chunk;
+
+		memcpy(item->data, (const uint8_t *)buffer + written, chunk);
+
+		// count the bytes before the worker can see and subtract them
+		__atomic_add_fetch(&connection->queued_bytes, chunk, __ATOMIC_SEQ_CST);
+
+		spsc_ring_commit(&worker->to_worker);
+
+		written += chunk;
+	}
+
+	// ask for a writable notification. the worker is woken up in any case, so
+	// it also sends one if it made room before it could see the request
+	if (written < length) {
+		io_worker_store(&connection->writable_wanted, 1);
+	}
+
+	io_worker_signal(&worker->wakeup, &worker->wakeup_pending);
+
+	if (written == 0) {
+		errno = EWOULDBLOCK;
+
+		return -1;
+	}
+
+	return written;
+}
+
+static void io_worker_handle_batching(void *opaque) {
+	IOWorkerConnection *connection = opaque;
+
+	// called by the WebSocket in the worker, the event thread is told after
+	// the current read returned
+	connection->batching_pending = true;
+}
+
+/*
+ * worker thread
+ */
+
+// asks the event thread for a wakeup after it made room. returns true if there
+// is room already, because the event thread might have missed the request
+static bool io_worker_wait_for_room(IOWorker *worker) {
+	io_worker_store(&worker->room_wanted, 1);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	return io_worker_has_room(worker);
+}
+
+static void io_worker_close(IOWorkerConnection *connection, int error) {
+	if (connection->closed) {
+		return;
+	}
+
+	connection->closed = true;
+	connection->closed_error = error;
+	connection->closed_pending = true;
+
+	__atomic_sub_fetch(&connection->queued_bytes, connection->output_used, __ATOMIC_SEQ_CST);
+
+	connection->output_used = 0;
+}
+
+static void io_worker_read(IOWorker *worker, IOWorkerConnection *connection) {
+	int length;
+	int reads = 0;
+
+	do {
+		if (!io_worker_has_room(worker)) {
+			return; // retried after the event thread made room
+		}
+
+		length = io_read(connection->io, worker->buffer, sizeof(worker->buffer));
+
+		if (connection->batching_pending) {
+			io_worker_push(worker, connection, IO_WORKER_ITEM_BATCHING, NULL, 0);
+
+			connection->batching_pending = false;
+		}
+
+		if (length == 0) {
+			io_worker_close(connection, 0);
+
+			return;
+		}
+
+		if (length < 0) {
+			if (length != IO_CONTINUE && !errno_interrupted() && !errno_would_block()) {
+				io_worker_close(connection, errno);
+			}
+
+			return;
+		}
+
+		io_worker_push(worker, connection, IO_WORKER_ITEM_DATA, worker->buffer, length);
+	} while (length == (int)sizeof(worker->buffer) && ++reads < IO_WORKER_MAX_READS_PER_EVENT);
+}
+
+static void io_worker_write(IOWorkerConnection *connection) {
+	int length;
+
+	if (connection->closed || connection->output_used == 0) {
+		return;
+	}
+
+	length = io_write(connection->io, connection->output, connection->output_used);
+
+	if (length < 0) {
+		if (!errno_interrupted() && !errno_would_block()) {
+			io_worker_close(connection, errno);
+		}
+
+		return;
+	}
+
+	memmove(connection->output, connection->output + length,
+	        connection->output_used - length);
+
+	connection->output_used -= length;
+
+	__atomic_sub_fetch(&connection->queued_bytes, length, __ATOMIC_SEQ_CST);
+}
+
+static void io_worker_append_output(IOWorkerConnection *connection, IOWorkerItem *item) {
+	int size;
+	uint8_t *output;
+
+	if (connection->closed) {
+		__atomic_sub_fetch(&connection->queued_bytes, item->length, __ATOMIC_SEQ_CST);
+
+		return;
+	}
+
+	if (connection->output_used + item->length > connection->output_size) {
+		size = MAX(connection->output_size * 2, 4096);
+		output = realloc(connection->output, size);
+
+		if (output == NULL) {
+			__atomic_sub_fetch(&connection->queued_bytes, item->length, __ATOMIC_SEQ_CST);
+
+			io_worker_close(connection, ENOMEM);
+
+			return;
+		}
+
+		connection->output = output;
+		connection->output_size = size;
+	}
+
+	memcpy(connection->output + connection->output_used, item->data, item->length);
+
+	connection->output_used += item->length;
+}
+
+// destroys the socket, the connection itself is released to the event thread
+// by io_worker_send_notifications
+static void io_worker_detach(IOWorkerConnection *connection) {
+	if (connection->output_used > 0) {
+		io_worker_write(connection);
+
+		if (connection->output_used > 0) {
+			log_warn("Closing client socket (handle: %d) while %d byte(s) are still unsent",
+			         connection->io->write_handle, connection->output_used);
+		}
+	}
+
+	io_destroy(connection->io);
+	free(connection->io);
+	free(connection->output);
+
+	connection->io = NULL;
+	connection->output = NULL;
+	connection->output_used = 0;
+	connection->closed = true;
+	connection->closed_pending = false;
+	connection->writable_pending = false;
+}
+
+// returns true if a connection got detached after the requests were handled.
+// it is detached in the next round, to also get the data that was sent for
+// it in the meantime
+static bool io_worker_handle_requests(IOWorker *worker) {
+	IOWorkerConnection *connection;
+	IOWorkerItem *item;
+	Node *node;
+	bool detached_later = false;
+
+	// look at the flags first, everything that was sent before a connection
+	// was detached is in the ring then
+	for (node = worker->connection_sentinel.next; node != &worker->connection_sentinel;
+	     node = node->next) {
+		connection = containerof(node, IOWorkerConnection, worker_node);
+
+		if (!connection->detaching && io_worker_load(&connection->detached)) {
+			connection->detaching = true;
+		}
+	}
+
+	while ((item = spsc_ring_peek(&worker->to_worker)) != NULL) {
+		connection = item->connection;
+
+		switch (item->type) {
+		case IO_WORKER_ITEM_ADD:
+			node_insert_before(&worker->connection_sentinel, &connection->worker_node);
+
+			break;
+
+		case IO_WORKER_ITEM_DATA:
+			io_worker_append_output(connection, item);
+
+			break;
+
+		default:
+			break;
+		}
+
+		spsc_ring_pop(&worker->to_worker);
+	}
+
+	for (node = worker->connection_sentinel.next; node != &worker->connection_sentinel;
+	     node = node->next) {
+		connection = containerof(node, IOWorkerConnection, worker_node);
+
+		if (connection->io == NULL) {
+			continue;
+		}
+
+		if (connection->detaching) {
+			io_worker_detach(connection);
+		} else if (io_worker_load(&connection->detached)) {
+			detached_later = true;
+		} else {
+			io_worker_write(connection);
+		}
+	}
+
+	return detached_later;
+}
+
+// returns true if some notifications could not be sent yet, but there is room
+// for them now
+static bool io_worker_send_notifications(IOWorker *worker) {
+	IOWorkerConnection *connection;
+	Node *node = worker->connection_sentinel.next;
+	bool deferred = false;
+
+	while (node != &worker->connection_sentinel) {
+		connection = containerof(node, IOWorkerConnection, worker_node);
+		node = node->next;
+
+		if (connection->io == NULL) {
+			if (spsc_ring_is_full(&worker->from_worker)) {
+				deferred = true;
+
+				continue;
+			}
+
+			// the event thread might free the connection as soon as it sees
+			// the item, unlink it first
+			node_remove(&connection->worker_node);
+			io_worker_push(worker, connection, IO_WORKER_ITEM_RELEASED, NULL, 0);
+
+			continue;
+		}
+
+		if (!connection->closed && !io_worker_is_write_blocked(connection) &&
+		    io_worker_load(&connection->writable_wanted) &&
+		    io_worker_exchange(&connection->writable_wanted, 0)) {
+			connection->writable_pending = true;
+		}
+
+		if (connection->writable_pending &&
+		    io_worker_push(worker, connection, IO_WORKER_ITEM_WRITABLE, NULL, 0)) {
+			connection->writable_pending = false;
+		}
+
+		if (connection->closed_pending &&
+		    io_worker_push(worker, connection, IO_WORKER_ITEM_CLOSED, NULL, connection->closed_error)) {
+			connection->closed_pending = false;
+		}
+
+		if (connection->writable_pending || connection->closed_pending) {
+			deferred = true;
+		}
+	}
+
+	if (worker->notify) {
+		worker->notify = false;
+
+		io_worker_signal(&worker->notification, &worker->notification_pending);
+	}
+
+	return deferred && io_worker_wait_for_room(worker);
+}
+
+// returns the number of pollfds. connections that can currently neither read
+// nor write are left out
+static int io_worker_prepare_pollfds(IOWorker *worker) {
+	IOWorkerConnection *connection;
+	Node *node;
+	struct pollfd *pollfds;
+	bool can_read = io_worker_has_room(worker) || io_worker_wait_for_room(worker);
+	int count = 1;
+	short events;
+
+	worker->pollfds[0].fd = worker->wakeup.base.read_handle;
+	worker->pollfds[0].events = POLLIN;
+
+	for (node = worker->connection_sentinel.next; node != &worker->connection_sentinel;
+	     node = node->next) {
+		connection = containerof(node, IOWorkerConnection, worker_node);
+		connection->pollfd_index = -1;
+
+		if (connection->io == NULL || connection->closed) {
+			continue;
+		}
+
+		events = 0;
+
+		if (can_read) {
+			events |= POLLIN;
+		}
+
+		if (connection->output_used > 0) {
+			events |= POLLOUT;
+		}
+
+		if (events == 0) {
+			continue;
+		}
+
+		if (count >= worker->pollfds_size) {
+			pollfds = realloc(worker->pollfds, worker->pollfds_size * 2 * sizeof(struct pollfd));
+
+			if (pollfds == NULL) {
+				log_error("Could not grow pollfd array of I/O worker %d, skipping remaining connections",
+				          worker->index);
+
+				break;
+			}
+
+			worker->pollfds = pollfds;
+			worker->pollfds_size *= 2;
+		}
+
+		worker->pollfds[count].fd = connection->io->read_handle;
+		worker->pollfds[count].events = events;
+		connection->pollfd_index = count++;
+	}
+
+	return count;
+}
+
+static void io_worker_loop(void *opaque) {
+	IOWorker *worker = opaque;
+	IOWorkerConnection *connection;
+	Node *node;
+	int count;
+	int timeout = -1;
+	short revents;
+
+	log_debug("Started I/O worker thread %d", worker->index);
+
+	while (!io_worker_load(&worker->stopping)) {
+		count = io_worker_prepare_pollfds(worker);
+
+		if (poll(worker->pollfds, count, timeout) < 0) {
+			if (errno_interrupted()) {
+				continue;
+			}
+
+			log_error("Could not poll in I/O worker %d, stopping it: %s (%d)",
+			          worker->index, get_errno_name(errno), errno);
+
+			break;
+		}
+
+		if ((worker->pollfds[0].revents & POLLIN) != 0) {
+			io_worker_drain(&worker->wakeup, &worker->wakeup_pending);
+		}
+
+		for (node = worker->connection_sentinel.next; node != &worker->connection_sentinel;
+		     node = node->next) {
+			connection = containerof(node, IOWorkerConnection, worker_node);
+
+			if (connection->pollfd_index < 0) {
+				continue;
+			}
+
+			revents = worker->pollfds[connection->pollfd_index].revents;
+
+			if ((revents & POLLOUT) != 0) {
+				io_worker_write(connection);
+			}
+
+			// errors and hang-ups are reported by the read
+			if ((revents & (POLLIN | POLLERR | POLLHUP)) != 0 && !connection->closed) {
+				io_worker_read(worker, connection);
+			}
+		}
+
+		timeout = -1;
+
+		if (io_worker_handle_requests(worker)) {
+			timeout = 0;
+		}
+
+		if (io_worker_send_notifications(worker)) {
+			timeout = 0;
+		}
+	}
+
+	log_debug("Stopped I/O worker thread %d", worker->index);
+}
+
+// sets errno on error
+static int io_worker_create(IOWorker *worker, int index) {
+	int phase = 0;
+	int saved_errno;
+
+	worker->index = index;
+	worker->stopping = 0;
+	worker->wakeup_pending = 0;
+	worker->notification_pending = 0;
+	worker->room_wanted = 0;
+	worker->connection_count = 0;
+	worker->notify = false;
+	worker->pollfds_size = 64;
+
+	node_reset(&worker->connection_sentinel);
+
+	worker->pollfds = calloc(worker->pollfds_size, sizeof(struct pollfd));
+
+	if (worker->pollfds == NULL) {
+		errno = ENOMEM;
+
+		goto cleanup;
+	}
+
+	phase = 1;
+
+	if (spsc_ring_create(&worker->to_worker, sizeof(IOWorkerItem), IO_WORKER_RING_CAPACITY) < 0) {
+		goto cleanup;
+	}
+
+	phase = 2;
+
+	if (spsc_ring_create(&worker->from_worker, sizeof(IOWorkerItem), IO_WORKER_RING_CAPACITY) < 0) {
+		goto cleanup;
+	}
+
+	phase = 3;
+
+	if (pipe_create(&worker->wakeup, PIPE_FLAG_NON_BLOCKING_READ | PIPE_FLAG_NON_BLOCKING_WRITE) < 0) {
+		goto cleanup;
+	}
+
+	phase = 4;
+
+	if (pipe_create(&worker->notification, PIPE_FLAG_NON_BLOCKING_READ | PIPE_FLAG_NON_BLOCKING_WRITE) < 0) {
+		goto cleanup;
+	}
+
+	phase = 5;
+
+	if (event_add_source(worker->notification.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, EVENT_PROFILED(io_worker_handle_events), worker) < 0) {
+		goto cleanup;
+	}
+
+	thread_create(&worker->thread, io_worker_loop, worker);
+
+	return 0;
+
+cleanup:
+	saved_errno = errno;
+
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 5:
+		pipe_destroy(&worker->notification);
+		// fall through
+
+	case 4:
+		pipe_destroy(&worker->wakeup);
+		// fall through
+
+	case 3:
+		spsc_ring_destroy(&worker->from_worker);
+		// fall through
+
+	case 2:
+		spsc_ring_destroy(&worker->to_worker);
+		// fall through
+
+	case 1:
+		free(worker->pollfds);
+		// fall through
+
+	default:
+		break;
+	}
+
+	errno = saved_errno;
+
+	return -1;
+}
+
+static void io_worker_destroy(IOWorker *worker) {
+	IOWorkerConnection *connection;
+	IOWorkerItem *item;
+
+	io_worker_store(&worker->stopping, 1);
+	io_worker_signal(&worker->wakeup, &worker->wakeup_pending);
+
+	thread_join(&worker->thread);
+	thread_destroy(&worker->thread);
+
+	event_remove_source(worker->notification.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+
+	// all clients are destroyed by now. connections that the worker did not
+	// get to see yet are still in the ring to the worker
+	while ((item = spsc_ring_peek(&worker->to_worker)) != NULL) {
+		if (item->type == IO_WORKER_ITEM_ADD) {
+			node_insert_before(&worker->connection_sentinel, &item->connection->worker_node);
+		}
+
+		spsc_ring_pop(&worker->to_worker);
+	}
+
+	// only released connections are referenced by the remaining items
+	while ((item = spsc_ring_peek(&worker->from_worker)) != NULL) {
+		if (item->type == IO_WORKER_ITEM_RELEASED) {
+			free(item->connection);
+		}
+
+		spsc_ring_pop(&worker->from_worker);
+	}
+
+	while (worker->connection_sentinel.next != &worker->connection_sentinel) {
+		connection = containerof(worker->connection_sentinel.next, IOWorkerConnection, worker_node);
+
+		node_remove(&connection->worker_node);
+
+		if (connection->io != NULL) {
+			io_destroy(connection->io);
+			free(connection->io);
+		}
+
+		free(connection->output);
+		free(connection);
+	}
+
+	pipe_destroy(&worker->notification);
+	pipe_destroy(&worker->wakeup);
+
+	spsc_ring_destroy(&worker->from_worker);
+	spsc_ring_destroy(&worker->to_worker);
+
+	free(worker->pollfds);
+}
+
+int io_worker_init(void) {
+	int count = config_get_option_value("listen.io_threads")->integer;
+	int i;
+
+	if (count == 0) {
+		log_debug("Network I/O worker threads are disabled");
+
+		return 0;
+	}
+
+	log_debug("Initializing I/O worker subsystem (threads: %d)", count);
+
+	_workers = calloc(count, sizeof(IOWorker));
+
+	if (_workers == NULL) {
+		log_error("Could not allocate %d I/O worker(s): %s (%d)",
+		          count, get_errno_name(ENOMEM), ENOMEM);
+
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (io_worker_create(&_workers[i], i) < 0) {
+			log_error("Could not create I/O worker %d: %s (%d)",
+			          i, get_errno_name(errno), errno);
+
+			while (--i >= 0) {
+				io_worker_destroy(&_workers[i]);
+			}
+
+			free(_workers);
+
+			_workers = NULL;
+
+			return -1;
+		}
+	}
+
+	_worker_count = count;
+
+	log_info("Handling client I/O in %d worker thread(s)", count);
+
+	return 0;
+}
+
+// has to be called after all clients are destroyed
+void io_worker_exit(void) {
+	int i;
+
+	if (_worker_count == 0) {
+		return;
+	}
+
+	log_debug("Shutting down I/O worker subsystem");
+
+	for (i = 0; i < _worker_count; ++i) {
+		io_worker_destroy(&_workers[i]);
+	}
+
+	free(_workers);
+
+	_workers = NULL;
+	_worker_count = 0;
+}
+
+bool io_worker_is_enabled(void) {
+	return _worker_count > 0;
+}
+
+// returns an I/O object that takes ownership of the given socket. the socket
+// is handed to a worker by io_worker_start. returns NULL on error
+IO *io_worker_wrap(IO *io) {
+	IOWorkerIO *worker_io = calloc(1, sizeof(IOWorkerIO));
+	IOWorkerConnection *connection = calloc(1, sizeof(IOWorkerConnection));
+
+	if (worker_io == NULL || connection == NULL) {
+		log_error("Could not allocate I/O worker connection: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		free(worker_io);
+		free(connection);
+
+		return NULL;
+	}
+
+	io_create(&worker_io->base, io->type, io_worker_io_destroy,
+	          io_worker_io_read, io_worker_io_write, NULL);
+
+	// the handles are only shown in log messages, the event thread never
+	// polls them
+	worker_io->base.read_handle = io->read_handle;
+	worker_io->base.write_handle = io->write_handle;
+	worker_io->connection = connection;
+
+	connection->io = io;
+	connection->worker_io = &worker_io->base;
+	connection->pollfd_index = -1;
+
+	node_reset(&connection->worker_node);
+
+	return &worker_io->base;
+}
+
+bool io_worker_is_wrapped(IO *io) {
+	return io->read == io_worker_io_read;
+}
+
+// the read function is called when data or the end of the stream was received
+// and the write function when there is room for more data. both are called
+// in the event thread
+void io_worker_set_functions(IO *io, EventFunction read, EventFunction write, void *opaque) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+
+	connection->read = read;
+	connection->write = write;
+	connection->opaque = opaque;
+}
+
+// has to be called before io_worker_start. the function is called in the
+// event thread
+void io_worker_set_batching_function(IO *io, WebsocketBatchingFunction function, void *opaque) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+
+	connection->batching = function;
+	connection->batching_opaque = opaque;
+
+	websocket_set_batching_function((Websocket *)connection->io,
+	                                io_worker_handle_batching, connection);
+}
+
+// hands the socket to the worker with the fewest connections. sets errno on
+// error
+int io_worker_start(IO *io) {
+	IOWorkerConnection *connection = ((IOWorkerIO *)io)->connection;
+	IOWorker *worker = &_workers[0];
+	IOWorkerItem *item;
+	int i;
+
+	for (i = 1; i < _worker_count; ++i) {
+		if (_workers[i].connection_count < worker->connection_count) {
+			worker = &_workers[i];
+		}
+	}
+
+	item = spsc_ring_reserve(&worker->to_worker);
+
+	if (item == NULL) {
+		errno = EAGAIN;
+
+		return -1;
+	}
+
+	connection->worker = worker;
+	connection->started = true;
+
+	item->connection = connection;
+	item->type = IO_WORKER_ITEM_ADD;
+	item->length = 0;
+
+	spsc_ring_commit(&worker->to_worker);
+
+	++worker->connection_count;
+
+	io_worker_signal(&worker->wakeup, &worker->wakeup_pending);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * io_worker.h: Client socket I/O on worker threads
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_IO_WORKER_H
+#define BRICKD_IO_WORKER_H
+
+#include <stdbool.h>
+
+#include <daemonlib/event.h>
+#include <daemonlib/io.h>
+
+#include "websocket.h"
+
+int io_worker_init(void);
+void io_worker_exit(void);
+
+bool io_worker_is_enabled(void);
+
+IO *io_worker_wrap(IO *io);
+bool io_worker_is_wrapped(IO *io);
+
+void io_worker_set_functions(IO *io, EventFunction read, EventFunction write, void *opaque);
+void io_worker_set_batching_function(IO *io, WebsocketBatchingFunction function, void *opaque);
+int io_worker_start(IO *io);
+
+#endif // BRICKD_IO_WORKER_H
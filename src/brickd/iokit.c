@@ -57,9 +57,11 @@ static void iokit_forward_notifications(void *opaque) {
 		return;
 	}
 
-	log_info("Reopening all USB devices to recover from system sleep");
+	// devices that survived the sleep keep their open handle and transfers,
+	// the others are reopened or picked up as new devices by the rescan
+	log_info("Reopening unresponsive USB devices to recover from system sleep");
 
-	usb_reopen(NULL);
+	usb_reopen_unresponsive();
 }
 
 static void iokit_handle_notifications(void *opaque, io_service_t service,
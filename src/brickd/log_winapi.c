@@ -31,6 +31,7 @@
 #include <daemonlib/utils.h>
 
 #include "log_messages.h"
+#include "spsc_ring.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
@@ -53,6 +54,7 @@ typedef struct {
 #include <daemonlib/packed_end.h>
 
 #define NAMED_PIPE_BUFFER_LENGTH (sizeof(LogPipeMessage) * 4)
+#define NAMED_PIPE_RING_CAPACITY 256 // messages
 #define FOREGROUND_ALL (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY)
 #define BACKGROUND_ALL (BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE | BACKGROUND_INTENSITY)
 #define FOREGROUND_YELLOW (FOREGROUND_RED | FOREGROUND_GREEN)
@@ -66,9 +68,16 @@ static bool _named_pipe_connected = false;
 static bool _named_pipe_running = false;
 static HANDLE _named_pipe = INVALID_HANDLE_VALUE;
 static Thread _named_pipe_thread;
-static HANDLE _named_pipe_write_event = NULL;
-static Mutex _named_pipe_write_event_mutex; // protects _named_pipe_write_event
+static HANDLE _named_pipe_write_event = NULL; // only used by the named pipe thread
 static HANDLE _named_pipe_stop_event = NULL;
+// log_write_platform queues messages for the named pipe thread, so no daemon
+// thread ever waits for the Log Viewer. log_write_platform is only called with
+// the log.c mutex locked, which makes it the single producer of the ring. if
+// the ring is full then the message is dropped and counted instead
+static SPSCRing _named_pipe_ring;
+static bool _named_pipe_ring_created = false;
+static HANDLE _named_pipe_ring_event = NULL; // auto-reset, set after queuing
+static volatile LONG _named_pipe_dropped = 0;
 
 void log_set_output_platform(IO *output);
 void log_apply_color_platform(LogLevel level, bool begin);
@@ -100,38 +109,117 @@ static WORD log_prepare_color_attributes(WORD color) {
 	return attributes;
 }
 
-static void log_send_pipe_message(LogPipeMessage *pipe_message) {
-	OVERLAPPED overlapped;
-	DWORD bytes_written;
+// NOTE: assumes that _mutex (in log.c) is locked
+static void log_queue_pipe_message(LogPipeMessage *pipe_message) {
+	LogPipeMessage *queued_message = spsc_ring_reserve(&_named_pipe_ring);
+
+	if (queued_message == NULL) {
+		InterlockedIncrement(&_named_pipe_dropped);
 
-	if (!_named_pipe_connected) {
 		return;
 	}
 
-	mutex_lock(&_named_pipe_write_event_mutex);
+	memcpy(queued_message, pipe_message, sizeof(*queued_message));
+	spsc_ring_commit(&_named_pipe_ring);
+
+	SetEvent(_named_pipe_ring_event);
+}
+
+static void log_discard_pipe_messages(void) {
+	while (spsc_ring_peek(&_named_pipe_ring) != NULL) {
+		spsc_ring_pop(&_named_pipe_ring);
+	}
+
+	InterlockedExchange(&_named_pipe_dropped, 0);
+}
+
+// only called by the named pipe thread. returns -1 if the message could not be
+// written. stopped is set if the stop event got signaled while waiting
+static int log_write_pipe_message(LogPipeMessage *pipe_message, bool *stopped) {
+	OVERLAPPED overlapped;
+	HANDLE events[2];
+	DWORD bytes_written;
+	DWORD rc;
 
 	memset(&overlapped, 0, sizeof(overlapped));
 	overlapped.hEvent = _named_pipe_write_event;
 
-	if (!WriteFile(_named_pipe, pipe_message, sizeof(*pipe_message),
-	               NULL, &overlapped) &&
-	    GetLastError() == ERROR_IO_PENDING) {
-		// wait for result of overlapped I/O to avoid a race condition with
-		// the next WriteFile call that will reuse the same event handle
+	if (WriteFile(_named_pipe, pipe_message, pipe_message->length, NULL, &overlapped)) {
+		return 0;
+	}
+
+	if (GetLastError() != ERROR_IO_PENDING) {
+		return -1;
+	}
+
+	events[0] = _named_pipe_stop_event;
+	events[1] = _named_pipe_write_event;
+
+	rc = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+	if (rc != WAIT_OBJECT_0 + 1) {
+		*stopped = rc == WAIT_OBJECT_0;
+
+		// the overlapped structure has to stay valid until the write is done
+		CancelIo(_named_pipe);
 		GetOverlappedResult(_named_pipe, &overlapped, &bytes_written, TRUE);
+
+		return -1;
 	}
 
-	mutex_unlock(&_named_pipe_write_event_mutex);
+	return GetOverlappedResult(_named_pipe, &overlapped, &bytes_written, FALSE) ? 0 : -1;
+}
+
+// only called by the named pipe thread. returns -1 if a message could not be
+// written, then the Log Viewer is treated as disconnected
+static int log_write_pipe_messages(bool *stopped) {
+	LogPipeMessage *pipe_message;
+	LogPipeMessage dropped_message;
+	LONG dropped;
+	struct timeval timestamp;
+	int rc;
+
+	while ((pipe_message = spsc_ring_peek(&_named_pipe_ring)) != NULL) {
+		rc = log_write_pipe_message(pipe_message, stopped);
+
+		spsc_ring_pop(&_named_pipe_ring);
+
+		if (rc < 0) {
+			return -1;
+		}
+	}
+
+	dropped = InterlockedExchange(&_named_pipe_dropped, 0);
+
+	if (dropped == 0) {
+		return 0;
+	}
+
+	gettimeofday(&timestamp, NULL);
+
+	dropped_message.flags = 0;
+	dropped_message.timestamp = (uint64_t)timestamp.tv_sec * 1000000 + timestamp.tv_usec;
+	dropped_message.level = LOG_LEVEL_WARN;
+	dropped_message.line = __LINE__;
+
+	string_copy(dropped_message.source, sizeof(dropped_message.source), "log_winapi.c", -1);
+	snprintf(dropped_message.message, sizeof(dropped_message.message),
+	         "Dropped %ld log message(s), Log Viewer is not reading fast enough", (long)dropped);
+
+	dropped_message.length = sizeof(dropped_message);
+
+	return log_write_pipe_message(&dropped_message, stopped);
 }
 
 static void log_connect_named_pipe(void *opaque) {
 	int phase = 0;
 	HANDLE overlapped_event;
-	HANDLE events[2];
+	HANDLE events[3];
 	int rc;
 	OVERLAPPED overlapped;
 	Semaphore *handshake = opaque;
 	uint8_t byte;
+	bool stopped;
 
 	// create connect/read event
 	overlapped_event = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -195,6 +283,9 @@ static void log_connect_named_pipe(void *opaque) {
 				// named pipe connect thread stopped
 				goto cleanup;
 			} else if (rc == WAIT_OBJECT_0 + 1) {
+				// messages queued during the last connection are dropped
+				log_discard_pipe_messages();
+
 				_named_pipe_connected = true;
 
 				log_info("Log Viewer connected");
@@ -224,7 +315,8 @@ static void log_connect_named_pipe(void *opaque) {
 			goto cleanup;
 		}
 
-		// read from named pipe to detect client disconnect
+		// read from named pipe to detect client disconnect, meanwhile write
+		// the queued messages to it
 		for (;;) {
 			ResetEvent(overlapped_event);
 
@@ -247,19 +339,36 @@ static void log_connect_named_pipe(void *opaque) {
 
 			events[0] = _named_pipe_stop_event;
 			events[1] = overlapped_event;
+			events[2] = _named_pipe_ring_event;
 
-			rc = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+			do {
+				rc = WaitForMultipleObjects(3, events, FALSE, INFINITE);
+
+				if (rc == WAIT_OBJECT_0 + 2) {
+					stopped = false;
+
+					if (log_write_pipe_messages(&stopped) < 0) {
+						if (stopped) {
+							goto cleanup;
+						}
+
+						// a failed write also cancels the pending read,
+						// so the read event reports the disconnect
+						CancelIo(_named_pipe);
+					}
+				}
+			} while (rc == WAIT_OBJECT_0 + 2);
 
 			if (rc == WAIT_OBJECT_0) {
 				// named pipe connect thread stopped
 				goto cleanup;
 			} else if (rc == WAIT_OBJECT_0 + 1) {
+				_named_pipe_connected = false;
+
 				DisconnectNamedPipe(_named_pipe);
 
 				log_info("Log Viewer disconnected");
 
-				_named_pipe_connected = false;
-
 				break;
 			} else {
 				rc = ERRNO_WINAPI_OFFSET + GetLastError();
@@ -295,14 +404,43 @@ cleanup:
 	_named_pipe_running = false;
 }
 
+static int log_create_named_pipe_ring(void) {
+	int rc;
+
+	_named_pipe_ring_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+
+	if (_named_pipe_ring_event == NULL) {
+		rc = ERRNO_WINAPI_OFFSET + GetLastError();
+
+		log_error("Could not create named pipe ring event: %s (%d)",
+		          get_errno_name(rc), rc);
+
+		return -1;
+	}
+
+	if (spsc_ring_create(&_named_pipe_ring, sizeof(LogPipeMessage),
+	                     NAMED_PIPE_RING_CAPACITY) < 0) {
+		log_error("Could not create named pipe ring: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		CloseHandle(_named_pipe_ring_event);
+
+		_named_pipe_ring_event = NULL;
+
+		return -1;
+	}
+
+	_named_pipe_ring_created = true;
+
+	return 0;
+}
+
 void log_init_platform(IO *output) {
 	int rc;
 	Semaphore handshake;
 
 	log_set_output_platform(output);
 
-	mutex_create(&_named_pipe_write_event_mutex);
-
 	// open event log
 	_event_log = RegisterEventSourceA(NULL, "Brick Daemon");
 
@@ -321,6 +459,8 @@ void log_init_platform(IO *output) {
 
 		log_error("Could not create named pipe overlapped write event: %s (%d)",
 		          get_errno_name(rc), rc);
+	} else if (log_create_named_pipe_ring() < 0) {
+		// error already logged
 	} else {
 		_named_pipe = CreateNamedPipeA("\\\\.\\pipe\\tinkerforge-brick-daemon-debug-log",
 		                               PIPE_ACCESS_DUPLEX |
@@ -385,11 +525,17 @@ void log_exit_platform(void) {
 		CloseHandle(_named_pipe_write_event);
 	}
 
+	if (_named_pipe_ring_created) {
+		spsc_ring_destroy(&_named_pipe_ring);
+	}
+
+	if (_named_pipe_ring_event != NULL) {
+		CloseHandle(_named_pipe_ring_event);
+	}
+
 	if (_event_log != NULL) {
 		DeregisterEventSource(_event_log);
 	}
-
-	mutex_destroy(&_named_pipe_write_event_mutex);
 }
 
 void log_set_output_platform(IO *output) {
@@ -525,6 +671,6 @@ void log_write_platform(struct timeval *timestamp, LogLevel level,
 		string_copy(message.source, sizeof(message.source),
 		            libusb ? function : source->name, -1);
 
-		log_send_pipe_message(&message);
+		log_queue_pipe_message(&message);
 	}
 }
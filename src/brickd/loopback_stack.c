@@ -0,0 +1,626 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * loopback_stack.c: Synthetic stack of emulated devices for benchmarking
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the loopback stack emulates devices without any hardware, to load-test and
+ * profile network, dispatch and pending request handling in isolation. every
+ * device answers enumerate and get-identity requests. any other request that
+ * expects a response is echoed back as its own response. responses can be
+ * delayed to emulate device latency and every device can send a callback
+ * periodically.
+ *
+ * the loopback stack can also replay a file written by the packet capture.
+ * captured requests from clients are dispatched through the routing code
+ * again and captured responses and callbacks are fed to
+ * network_dispatch_response, at the original or an accelerated rate. the
+ * devices seen in the capture are added as recipients that never answer by
+ * themselves, their answers come from the capture
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <daemonlib/base58.h>
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/queue.h>
+#include <daemonlib/timer.h>
+#include <daemonlib/utils.h>
+
+#include "loopback_stack.h"
+
+#include "hardware.h"
+#include "network.h"
+#include "packet_capture.h"
+#include "stack.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define LOOPBACK_STACK_UID_BASE 4000000000U
+#define LOOPBACK_STACK_DEVICE_IDENTIFIER 65535
+#define LOOPBACK_STACK_CALLBACK_FUNCTION_ID 250
+#define LOOPBACK_STACK_MAX_QUEUED_RESPONSES 65536
+#define LOOPBACK_STACK_REPLAY_RECIPIENT UINT64_MAX // recipient opaque of replayed devices
+#define LOOPBACK_STACK_REPLAY_BATCH 1024 // packets per timer event
+#define UID_BRICK_DAEMON 1
+
+typedef struct {
+	uint64_t due; // microseconds
+	Packet response;
+} LoopbackResponse;
+
+typedef struct {
+	PacketHeader header;
+	uint32_t counter;
+} ATTRIBUTE_PACKED LoopbackCallback;
+
+typedef struct {
+	Stack base;
+	int device_count;
+	uint64_t response_delay; // microseconds
+	Queue responses; // LoopbackResponse, ordered by due time because the delay is constant
+	Timer response_timer;
+	Timer callback_timer;
+	uint32_t callback_counter;
+	uint32_t dropped_responses;
+	bool active;
+	FILE *replay_fp; // NULL if not replaying
+	char replay_filename[1024];
+	uint32_t replay_speed; // percent of the original rate
+	uint64_t replay_start; // microseconds
+	uint64_t replay_first_timestamp; // microseconds, as captured
+	PacketCaptureRecord replay_record; // next packet to replay, in host byte order
+	Packet replay_packet;
+	Timer replay_timer;
+	uint32_t replayed_packets;
+} LoopbackStack;
+
+static LoopbackStack _loopback_stack;
+
+static uint32_t loopback_stack_get_uid(int index) { // always little endian
+	return uint32_to_le(LOOPBACK_STACK_UID_BASE + (uint32_t)index);
+}
+
+static void loopback_stack_send_response(Packet *response) {
+	LoopbackResponse *queued;
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	response->trace_id = packet_get_next_response_trace_id();
+#endif
+
+	if (_loopback_stack.response_delay == 0) {
+		network_dispatch_response(response);
+
+		return;
+	}
+
+	if (_loopback_stack.responses.count >= LOOPBACK_STACK_MAX_QUEUED_RESPONSES) {
+		++_loopback_stack.dropped_responses;
+
+		log_warn("Loopback stack response queue is full, dropping response (dropped: %u)",
+		         _loopback_stack.dropped_responses);
+
+		return;
+	}
+
+	queued = queue_push(&_loopback_stack.responses);
+
+	if (queued == NULL) {
+		log_error("Could not push to loopback stack response queue: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	queued->due = microseconds() + _loopback_stack.response_delay;
+
+	memcpy(&queued->response, response, sizeof(queued->response));
+
+	// the timer is already armed for an earlier response otherwise
+	if (_loopback_stack.responses.count == 1 &&
+	    timer_configure(&_loopback_stack.response_timer, _loopback_stack.response_delay, 0) < 0) {
+		log_error("Could not start loopback stack response timer: %s (%d)",
+		          get_errno_name(errno), errno);
+	}
+}
+
+static void loopback_stack_handle_response_timer(void *opaque) {
+	LoopbackResponse *queued;
+	uint64_t now = microseconds();
+
+	(void)opaque;
+
+	for (;;) {
+		queued = queue_peek(&_loopback_stack.responses);
+
+		if (queued == NULL) {
+			return;
+		}
+
+		if (queued->due > now) {
+			break;
+		}
+
+		network_dispatch_response(&queued->response);
+		queue_pop(&_loopback_stack.responses, NULL);
+	}
+
+	if (timer_configure(&_loopback_stack.response_timer, queued->due - now, 0) < 0) {
+		log_error("Could not restart loopback stack response timer: %s (%d)",
+		          get_errno_name(errno), errno);
+	}
+}
+
+static void loopback_stack_send_identity(int index, uint8_t function_id,
+                                         uint8_t sequence_number, bool enumerate) {
+	union {
+		EnumerateCallback enumerate_callback;
+		GetIdentityResponse get_identity_response;
+		Packet packet;
+	} u;
+	uint32_t uid = loopback_stack_get_uid(index); // always little endian
+
+	memset(&u, 0, sizeof(u));
+
+	// get-identity response and enumerate callback share their layout, the
+	// callback just has an additional enumeration type
+	u.packet.header.uid = uid;
+	u.packet.header.length = enumerate ? sizeof(EnumerateCallback) : sizeof(GetIdentityResponse);
+	u.packet.header.function_id = function_id;
+	packet_header_set_sequence_number(&u.packet.header, sequence_number);
+	packet_header_set_response_expected(&u.packet.header, true);
+
+	base58_encode(u.get_identity_response.uid, uint32_from_le(uid));
+	u.get_identity_response.connected_uid[0] = '0';
+	u.get_identity_response.position = '0';
+	u.get_identity_response.hardware_version[0] = 1;
+	u.get_identity_response.firmware_version[0] = 1;
+	u.get_identity_response.device_identifier = uint16_to_le(LOOPBACK_STACK_DEVICE_IDENTIFIER);
+
+	if (enumerate) {
+		u.enumerate_callback.enumeration_type = ENUMERATION_TYPE_AVAILABLE;
+	}
+
+	loopback_stack_send_response(&u.packet);
+}
+
+static int loopback_stack_dispatch_request(Stack *stack, Packet *request,
+                                           Recipient *recipient, Client *client) {
+	Packet response;
+	int i;
+
+	(void)client;
+
+	if (request->header.uid == 0) {
+		if (request->header.function_id == FUNCTION_ENUMERATE) {
+			for (i = 0; i < _loopback_stack.device_count; ++i) {
+				loopback_stack_send_identity(i, CALLBACK_ENUMERATE, 0, true);
+			}
+		}
+
+		return 0;
+	}
+
+	// forced dispatches come without recipient
+	if (recipient == NULL) {
+		recipient = stack_get_recipient(stack, request->header.uid);
+
+		if (recipient == NULL) {
+			return 0;
+		}
+	}
+
+	if (!packet_header_get_response_expected(&request->header) ||
+	    recipient->opaque == LOOPBACK_STACK_REPLAY_RECIPIENT) {
+		return 0;
+	}
+
+	if (request->header.function_id == FUNCTION_GET_IDENTITY) {
+		loopback_stack_send_identity((int)recipient->opaque, FUNCTION_GET_IDENTITY,
+		                             packet_header_get_sequence_number(&request->header), false);
+	} else {
+		memcpy(&response, request, request->header.length);
+
+		packet_header_set_error_code(&response.header, PACKET_E_SUCCESS);
+		loopback_stack_send_response(&response);
+	}
+
+	return 0;
+}
+
+static void loopback_stack_handle_callback_timer(void *opaque) {
+	union {
+		LoopbackCallback callback;
+		Packet packet;
+	} u;
+	int i;
+
+	(void)opaque;
+
+	memset(&u, 0, sizeof(u));
+
+	u.callback.header.length = sizeof(u.callback);
+	u.callback.header.function_id = LOOPBACK_STACK_CALLBACK_FUNCTION_ID;
+	packet_header_set_sequence_number(&u.callback.header, 0);
+	packet_header_set_response_expected(&u.callback.header, true);
+	u.callback.counter = uint32_to_le(_loopback_stack.callback_counter++);
+
+	for (i = 0; i < _loopback_stack.device_count; ++i) {
+		u.callback.header.uid = loopback_stack_get_uid(i);
+
+		loopback_stack_send_response(&u.packet);
+	}
+}
+
+static void loopback_stack_stop_replay(void) {
+	fclose(_loopback_stack.replay_fp);
+
+	_loopback_stack.replay_fp = NULL;
+}
+
+// reads the next record and its packet into replay_record and replay_packet.
+// returns 1 on success, 0 at the end of the capture and -1 on error
+static int loopback_stack_read_replay_record(void) {
+	uint8_t *bytes = (uint8_t *)&_loopback_stack.replay_packet;
+	PacketCaptureRecord *record = &_loopback_stack.replay_record;
+	int length;
+
+	if (fread(record, sizeof(*record), 1, _loopback_stack.replay_fp) != 1) {
+		return feof(_loopback_stack.replay_fp) ? 0 : -1;
+	}
+
+	if (fread(bytes, sizeof(PacketHeader), 1, _loopback_stack.replay_fp) != 1) {
+		return -1;
+	}
+
+	length = _loopback_stack.replay_packet.header.length;
+
+	if (length < (int)sizeof(PacketHeader) || length > (int)sizeof(Packet)) {
+		errno = EINVAL;
+
+		return -1;
+	}
+
+	if (length > (int)sizeof(PacketHeader) &&
+	    fread(bytes + sizeof(PacketHeader), length - sizeof(PacketHeader), 1,
+	          _loopback_stack.replay_fp) != 1) {
+		return -1;
+	}
+
+	record->timestamp = packet_log_uint64_to_le(record->timestamp); // swapping back is the same operation
+	record->stack_id = uint16_from_le(record->stack_id);
+
+	// devices are added while reading ahead, so their route exists before
+	// the first replayed request to them is dispatched
+	if (record->direction != PACKET_LOG_DIRECTION_REQUEST &&
+	    _loopback_stack.replay_packet.header.uid != 0 &&
+	    stack_get_recipient(&_loopback_stack.base, _loopback_stack.replay_packet.header.uid) == NULL &&
+	    stack_add_recipient(&_loopback_stack.base, _loopback_stack.replay_packet.header.uid,
+	                        LOOPBACK_STACK_REPLAY_RECIPIENT) < 0) {
+		return -1;
+	}
+
+	return 1;
+}
+
+static void loopback_stack_replay_packet(void) {
+	Packet *packet = &_loopback_stack.replay_packet;
+	uint16_t device_identifier;
+
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	packet->trace_id = packet_get_next_response_trace_id();
+#endif
+
+	switch (_loopback_stack.replay_record.direction) {
+	case PACKET_LOG_DIRECTION_REQUEST:
+		// only dispatch to the loopback stack, real devices must not see
+		// replayed requests
+		if (packet->header.uid == 0) {
+			stack_dispatch_request(&_loopback_stack.base, packet, NULL, true);
+		} else if (uint32_from_le(packet->header.uid) != UID_BRICK_DAEMON &&
+		           hardware_find_stack(packet->header.uid, &device_identifier) == &_loopback_stack.base) {
+			hardware_dispatch_request(packet, NULL);
+		}
+
+		break;
+
+	case PACKET_LOG_DIRECTION_RESPONSE:
+		network_dispatch_response(packet);
+		break;
+
+	default:
+		// requests to a stack are already replayed as requests from clients
+		return;
+	}
+
+	++_loopback_stack.replayed_packets;
+}
+
+static void loopback_stack_handle_replay_timer(void *opaque) {
+	uint64_t now = microseconds();
+	uint64_t due = 0;
+	int count = 0;
+	int rc;
+
+	(void)opaque;
+
+	for (;;) {
+		due = _loopback_stack.replay_start +
+		      (_loopback_stack.replay_record.timestamp - _loopback_stack.replay_first_timestamp) *
+		      100 / _loopback_stack.replay_speed;
+
+		if (due > now) {
+			break;
+		}
+
+		if (count >= LOOPBACK_STACK_REPLAY_BATCH) {
+			due = now + 1; // let other event sources run in between
+			break;
+		}
+
+		loopback_stack_replay_packet();
+
+		++count;
+		rc = loopback_stack_read_replay_record();
+
+		if (rc <= 0) {
+			if (rc < 0) {
+				log_error("Could not read from replay file '%s', stopping replay: %s (%d)",
+				          _loopback_stack.replay_filename, get_errno_name(errno), errno);
+			} else {
+				log_info("Finished replay of '%s', replayed %u packet(s) in %u msec",
+				         _loopback_stack.replay_filename, _loopback_stack.replayed_packets,
+				         (uint32_t)((microseconds() - _loopback_stack.replay_start) / 1000));
+			}
+
+			loopback_stack_stop_replay();
+
+			return;
+		}
+	}
+
+	if (timer_configure(&_loopback_stack.replay_timer, due - now, 0) < 0) {
+		log_error("Could not restart loopback stack replay timer, stopping replay: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		loopback_stack_stop_replay();
+	}
+}
+
+// the loopback stack keeps running without replay if the file cannot be read
+static void loopback_stack_start_replay(const char *filename) {
+	PacketCaptureHeader header;
+	int rc;
+
+	string_copy(_loopback_stack.replay_filename, sizeof(_loopback_stack.replay_filename),
+	            filename, -1);
+
+	_loopback_stack.replay_fp = fopen(filename, "rb");
+
+	if (_loopback_stack.replay_fp == NULL) {
+		log_error("Could not open replay file '%s': %s (%d)",
+		          filename, get_errno_name(errno), errno);
+
+		return;
+	}
+
+	if (fread(&header, sizeof(header), 1, _loopback_stack.replay_fp) != 1 ||
+	    memcmp(header.magic, PACKET_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+	    uint32_from_le(header.version) != PACKET_CAPTURE_VERSION) {
+		log_error("Replay file '%s' is not a packet capture file of version %d",
+		          filename, PACKET_CAPTURE_VERSION);
+
+		loopback_stack_stop_replay();
+
+		return;
+	}
+
+	rc = loopback_stack_read_replay_record();
+
+	if (rc <= 0) {
+		if (rc < 0) {
+			log_error("Could not read from replay file '%s': %s (%d)",
+			          filename, get_errno_name(errno), errno);
+		} else {
+			log_warn("Replay file '%s' contains no packets", filename);
+		}
+
+		loopback_stack_stop_replay();
+
+		return;
+	}
+
+	_loopback_stack.replay_start = microseconds();
+	_loopback_stack.replay_first_timestamp = _loopback_stack.replay_record.timestamp;
+	_loopback_stack.replayed_packets = 0;
+
+	if (timer_configure(&_loopback_stack.replay_timer, 1, 0) < 0) {
+		log_error("Could not start loopback stack replay timer: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		loopback_stack_stop_replay();
+
+		return;
+	}
+
+	log_info("Replaying '%s' at %u%% of the original rate",
+	         filename, _loopback_stack.replay_speed);
+}
+
+int loopback_stack_init(void) {
+	int phase = 0;
+	int callback_period = config_get_option_value("loopback_stack.callback_period")->integer;
+	const char *replay_filename = config_get_option_value("loopback_stack.replay_file")->string;
+	int i;
+
+	_loopback_stack.device_count = config_get_option_value("loopback_stack.devices")->integer;
+	_loopback_stack.response_delay = (uint64_t)config_get_option_value("loopback_stack.response_delay")->integer;
+	_loopback_stack.callback_counter = 0;
+	_loopback_stack.dropped_responses = 0;
+	_loopback_stack.active = false;
+	_loopback_stack.replay_fp = NULL;
+	_loopback_stack.replay_speed = (uint32_t)config_get_option_value("loopback_stack.replay_speed")->integer;
+
+	if (replay_filename != NULL && *replay_filename == '\0') {
+		replay_filename = NULL;
+	}
+
+	if (_loopback_stack.device_count == 0 && replay_filename == NULL) {
+		log_debug("Loopback stack is disabled");
+
+		return 0;
+	}
+
+	log_info("Initializing loopback stack subsystem (devices: %d, response-delay: %u usec, callback-period: %d msec)",
+	         _loopback_stack.device_count, (uint32_t)_loopback_stack.response_delay,
+	         callback_period);
+
+	if (stack_create(&_loopback_stack.base, "loopback", loopback_stack_dispatch_request) < 0) {
+		log_error("Could not create base stack for loopback stack: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 1;
+
+	if (queue_create(&_loopback_stack.responses, sizeof(LoopbackResponse)) < 0) {
+		log_error("Could not create loopback stack response queue: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 2;
+
+	if (timer_create_(&_loopback_stack.response_timer, loopback_stack_handle_response_timer, NULL) < 0) {
+		log_error("Could not create loopback stack response timer: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 3;
+
+	if (timer_create_(&_loopback_stack.callback_timer, loopback_stack_handle_callback_timer, NULL) < 0) {
+		log_error("Could not create loopback stack callback timer: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 4;
+
+	if (timer_create_(&_loopback_stack.replay_timer, loopback_stack_handle_replay_timer, NULL) < 0) {
+		log_error("Could not create loopback stack replay timer: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 5;
+
+	if (hardware_add_stack(&_loopback_stack.base) < 0) {
+		goto cleanup;
+	}
+
+	phase = 6;
+
+	for (i = 0; i < _loopback_stack.device_count; ++i) {
+		if (stack_add_recipient(&_loopback_stack.base, loopback_stack_get_uid(i), (uint64_t)i) < 0) {
+			goto cleanup;
+		}
+	}
+
+	if (callback_period > 0 &&
+	    timer_configure(&_loopback_stack.callback_timer,
+	                    (uint64_t)callback_period * 1000,
+	                    (uint64_t)callback_period * 1000) < 0) {
+		log_error("Could not start loopback stack callback timer: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	if (replay_filename != NULL) {
+		loopback_stack_start_replay(replay_filename);
+	}
+
+	_loopback_stack.active = true;
+
+	return 0;
+
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 6:
+		hardware_remove_stack(&_loopback_stack.base);
+		// fall through
+
+	case 5:
+		timer_destroy(&_loopback_stack.replay_timer);
+		// fall through
+
+	case 4:
+		timer_destroy(&_loopback_stack.callback_timer);
+		// fall through
+
+	case 3:
+		timer_destroy(&_loopback_stack.response_timer);
+		// fall through
+
+	case 2:
+		queue_destroy(&_loopback_stack.responses, NULL);
+		// fall through
+
+	case 1:
+		stack_destroy(&_loopback_stack.base);
+		// fall through
+
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+// safe to call if the loopback stack is disabled or failed to initialize
+void loopback_stack_exit(void) {
+	if (!_loopback_stack.active) {
+		return;
+	}
+
+	log_debug("Shutting down loopback stack subsystem");
+
+	stack_announce_disconnect(&_loopback_stack.base);
+	hardware_remove_stack(&_loopback_stack.base);
+
+	if (_loopback_stack.replay_fp != NULL) {
+		loopback_stack_stop_replay();
+	}
+
+	timer_destroy(&_loopback_stack.replay_timer);
+	timer_destroy(&_loopback_stack.callback_timer);
+	timer_destroy(&_loopback_stack.response_timer);
+
+	queue_destroy(&_loopback_stack.responses, NULL);
+	stack_destroy(&_loopback_stack.base);
+}
@@ -41,11 +41,16 @@
 	#include <daemonlib/red_led.h>
 #endif
 #include <daemonlib/signal.h>
+#include <daemonlib/timer.h>
 #include <daemonlib/utils.h>
 
+#include "config_options.h"
 #include "hardware.h"
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_log.h"
 #ifdef BRICKD_WITH_RED_BRICK
+	#include "realtime.h"
 	#include "redapid.h"
 	#include "red_stack.h"
 	#include "red_usb_gadget.h"
@@ -54,8 +59,14 @@
 #ifdef BRICKD_WITH_LIBUDEV
 	#include "udev.h"
 #endif
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	#include "socket_activation.h"
+#endif
 #include "usb.h"
 #include "mesh.h"
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	#include "loopback_stack.h"
+#endif
 #include "version.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
@@ -63,7 +74,15 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 static char _config_filename[1024] = SYSCONFDIR"/brickd.conf";
 static char _pid_filename[1024] = LOCALSTATEDIR"/run/brickd.pid";
 static char _log_filename[1024] = LOCALSTATEDIR"/log/brickd.log";
+static char _packet_log_filename[1024] = LOCALSTATEDIR"/log/brickd-packet-log.bin";
 static File _log_file;
+static const char *_debug_filter = NULL; // from the --debug argument
+static Timer _hardware_init_timer;
+static int _hardware_phase = 0;
+static bool _hardware_init_failed = false;
+#ifdef BRICKD_WITH_LIBUDEV
+static bool _initialized_udev = false;
+#endif
 
 static int prepare_paths(void) {
 	char *home;
@@ -122,6 +141,14 @@ static int prepare_paths(void) {
 		return -1;
 	}
 
+	if (robust_snprintf(_packet_log_filename, sizeof(_packet_log_filename),
+	                    "%s/.brickd/brickd-packet-log.bin", home) < 0) {
+		fprintf(stderr, "Could not format ~/.brickd/brickd-packet-log.bin file name: %s (%d)\n",
+		        get_errno_name(errno), errno);
+
+		return -1;
+	}
+
 	if (mkdir(brickd_dirname, 0755) < 0) {
 		if (errno != EEXIST) {
 			fprintf(stderr, "Could not create directory '%s': %s (%d)\n",
@@ -159,7 +186,30 @@ static void print_usage(void) {
 	       "  --debug [<filter>]  Set log level to debug and apply optional filter\n");
 }
 
+static void reload_config(void) {
+	bool log_changed;
+	IO *output;
+
+	if (config_options_reload(_config_filename, &log_changed) < 0 || !log_changed) {
+		return;
+	}
+
+	// log_init picks up the new level and debug filter, the output and the
+	// --debug override have to be restored afterwards
+	output = log_get_output();
+
+	log_exit();
+	log_init();
+	log_set_output(output);
+
+	if (_debug_filter != NULL) {
+		log_enable_debug_override(_debug_filter);
+	}
+}
+
 static void handle_sighup(void) {
+	reload_config();
+
 	if (log_get_output() != &_log_file.base) {
 		return;
 	}
@@ -182,6 +232,12 @@ static void handle_sighup(void) {
 }
 
 static void handle_sigusr1(void) {
+	if (_hardware_phase == 0) {
+		log_info("Ignoring SIGUSR1, USB subsystem is not initialized yet");
+
+		return;
+	}
+
 #ifdef BRICKD_WITH_USB_REOPEN_ON_SIGUSR1
 	log_info("Reopening all USB devices");
 
@@ -194,6 +250,149 @@ static void handle_sigusr1(void) {
 static void handle_event_cleanup(void) {
 	network_cleanup_clients_and_zombies();
 	mesh_cleanup_stacks();
+#ifdef BRICKD_WITH_RED_BRICK
+	redapid_flush_requests();
+#endif
+}
+
+// the hardware subsystems are initialized from the event loop after the
+// listeners are open, so clients can connect right away and get the enumerate
+// callbacks of the stacks as they come online
+static int hardware_subsystems_init(void) {
+	log_debug("Initializing hardware subsystems");
+
+	if (usb_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 1;
+
+#ifdef BRICKD_WITH_LIBUDEV
+	if (!usb_has_hotplug()) {
+		if (udev_init() < 0) {
+			return -1;
+		}
+
+		_initialized_udev = true;
+	}
+#endif
+
+	_hardware_phase = 2;
+
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	if (loopback_stack_init() < 0) {
+		return -1;
+	}
+#endif
+
+	_hardware_phase = 3;
+
+#ifdef BRICKD_WITH_RED_BRICK
+	// also applies to all later allocations and thread stacks
+	if (config_get_option_value("realtime.lock_memory")->boolean) {
+		realtime_lock_memory();
+	}
+
+	if (gpio_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 4;
+
+	if (redapid_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 5;
+
+	if (red_stack_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 6;
+
+	if (red_extension_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 7;
+
+	if (red_usb_gadget_init() < 0) {
+		return -1;
+	}
+
+	_hardware_phase = 8;
+
+	// clients that connected before the RED Brick UID was known didn't get
+	// its enumerate-connected callback yet
+	network_announce_red_brick_connect();
+
+	red_led_set_trigger(RED_LED_GREEN, config_get_option_value("led_trigger.green")->symbol);
+	red_led_set_trigger(RED_LED_RED, config_get_option_value("led_trigger.red")->symbol);
+#endif
+
+	return 0;
+}
+
+static void hardware_subsystems_exit(void) {
+	switch (_hardware_phase) { // no breaks, all cases fall through intentionally
+#ifdef BRICKD_WITH_RED_BRICK
+	case 8:
+		red_usb_gadget_exit();
+		// fall through
+
+	case 7:
+		red_extension_exit();
+		// fall through
+
+	case 6:
+		red_stack_exit();
+		// fall through
+
+	case 5:
+		redapid_exit();
+		// fall through
+
+	case 4:
+		//gpio_exit();
+		// fall through
+#endif
+
+	case 3:
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+		loopback_stack_exit();
+#endif
+		// fall through
+
+	case 2:
+#ifdef BRICKD_WITH_LIBUDEV
+		if (_initialized_udev) {
+			udev_exit();
+		}
+#endif
+		// fall through
+
+	case 1:
+		usb_exit();
+		// fall through
+
+	default:
+		break;
+	}
+
+	_hardware_phase = 0;
+}
+
+static void handle_hardware_init(void *opaque) {
+	(void)opaque;
+
+	if (hardware_subsystems_init() < 0) {
+		log_error("Could not initialize hardware subsystems, stopping");
+
+		_hardware_init_failed = true;
+
+		event_stop();
+	}
 }
 
 int main(int argc, char **argv) {
@@ -204,11 +403,7 @@ int main(int argc, char **argv) {
 	bool version = false;
 	bool check_config = false;
 	bool daemon = false;
-	const char *debug_filter = NULL;
 	int pid_fd = -1;
-#ifdef BRICKD_WITH_LIBUDEV
-	bool initialized_udev = false;
-#endif
 
 	for (i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "--help") == 0) {
@@ -221,9 +416,9 @@ int main(int argc, char **argv) {
 			daemon = true;
 		} else if (strcmp(argv[i], "--debug") == 0) {
 			if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
-				debug_filter = argv[++i];
+				_debug_filter = argv[++i];
 			} else {
-				debug_filter = "";
+				_debug_filter = "";
 			}
 		} else {
 			fprintf(stderr, "Unknown option '%s'\n\n", argv[i]);
@@ -287,8 +482,8 @@ int main(int argc, char **argv) {
 
 	phase = 3;
 
-	if (debug_filter != NULL) {
-		log_enable_debug_override(debug_filter);
+	if (_debug_filter != NULL) {
+		log_enable_debug_override(_debug_filter);
 	}
 
 	if (config_has_warning()) {
@@ -316,78 +511,56 @@ int main(int argc, char **argv) {
 
 	phase = 6;
 
+	packet_log_init(_packet_log_filename);
+	packet_capture_init();
+
 	if (hardware_init() < 0) {
 		goto cleanup;
 	}
 
 	phase = 7;
 
-	if (usb_init() < 0) {
-		goto cleanup;
-	}
-
-	phase = 8;
-
-#ifdef BRICKD_WITH_LIBUDEV
-	if (!usb_has_hotplug()) {
-		if (udev_init() < 0) {
-			goto cleanup;
-		}
-
-		initialized_udev = true;
-	}
-
-	phase = 9;
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	socket_activation_init();
 #endif
 
 	if (network_init() < 0) {
 		goto cleanup;
 	}
 
-	phase = 10;
+	phase = 8;
 
 	if (mesh_init() < 0) {
 		goto cleanup;
 	}
 
-	phase = 11;
+	phase = 9;
 
-#ifdef BRICKD_WITH_RED_BRICK
-	if (gpio_init() < 0) {
-		goto cleanup;
-	}
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	socket_activation_exit();
+#endif
 
-	phase = 12;
+	if (timer_create_(&_hardware_init_timer, handle_hardware_init, NULL) < 0) {
+		log_error("Could not create hardware initialization timer: %s (%d)",
+		          get_errno_name(errno), errno);
 
-	if (redapid_init() < 0) {
 		goto cleanup;
 	}
 
-	phase = 13;
-
-	if (red_stack_init() < 0) {
-		goto cleanup;
-	}
+	phase = 10;
 
-	phase = 14;
+	if (timer_configure(&_hardware_init_timer, 1, 0) < 0) {
+		log_error("Could not start hardware initialization timer: %s (%d)",
+		          get_errno_name(errno), errno);
 
-	if (red_extension_init() < 0) {
 		goto cleanup;
 	}
 
-	phase = 15;
-
-	if (red_usb_gadget_init() < 0) {
+	if (event_run(handle_event_cleanup) < 0) {
 		goto cleanup;
 	}
 
-	phase = 16;
-
-	red_led_set_trigger(RED_LED_GREEN, config_get_option_value("led_trigger.green")->symbol);
-	red_led_set_trigger(RED_LED_RED, config_get_option_value("led_trigger.red")->symbol);
-#endif
-
-	if (event_run(handle_event_cleanup) < 0) {
+	if (_hardware_init_failed) {
 		goto cleanup;
 	}
 
@@ -401,46 +574,17 @@ int main(int argc, char **argv) {
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
-#ifdef BRICKD_WITH_RED_BRICK
-	case 16:
-		red_usb_gadget_exit();
-		// fall through
-
-	case 15:
-		red_extension_exit();
-		// fall through
-
-	case 14:
-		red_stack_exit();
-		// fall through
-
-	case 13:
-		redapid_exit();
-		// fall through
-
-	case 12:
-		//gpio_exit();
-		// fall through
-#endif
-
-	case 11:
-		mesh_exit();
-		// fall through
-
 	case 10:
-		network_exit();
+		hardware_subsystems_exit();
+		timer_destroy(&_hardware_init_timer);
 		// fall through
 
-#ifdef BRICKD_WITH_LIBUDEV
 	case 9:
-		if (initialized_udev) {
-			udev_exit();
-		}
-#endif
+		mesh_exit();
 		// fall through
 
 	case 8:
-		usb_exit();
+		network_exit();
 		// fall through
 
 	case 7:
@@ -448,6 +592,8 @@ cleanup:
 		// fall through
 
 	case 6:
+		packet_capture_exit();
+		packet_log_exit();
 		signal_exit();
 		// fall through
 
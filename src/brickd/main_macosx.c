@@ -40,8 +40,13 @@
 #include "hardware.h"
 #include "iokit.h"
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_log.h"
 #include "usb.h"
 #include "mesh.h"
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	#include "loopback_stack.h"
+#endif
 #include "version.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
@@ -49,6 +54,7 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 #define CONFIG_FILENAME (SYSCONFDIR "/brickd.conf")
 #define PID_FILENAME (LOCALSTATEDIR "/run/brickd.pid")
 #define LOG_FILENAME (LOCALSTATEDIR "/log/brickd.log")
+#define PACKET_LOG_FILENAME (LOCALSTATEDIR "/log/brickd-packet-log.bin")
 static File _log_file;
 
 static void print_usage(void) {
@@ -188,6 +194,9 @@ int main(int argc, char **argv) {
 
 	phase = 5;
 
+	packet_log_init(PACKET_LOG_FILENAME);
+	packet_capture_init();
+
 	if (hardware_init() < 0) {
 		goto cleanup;
 	}
@@ -218,6 +227,12 @@ int main(int argc, char **argv) {
 
 	phase = 10;
 
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	if (loopback_stack_init() < 0) {
+		goto cleanup;
+	}
+#endif
+
 	if (event_run(handle_event_cleanup) < 0) {
 		goto cleanup;
 	}
@@ -227,6 +242,9 @@ int main(int argc, char **argv) {
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
 	case 10:
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+		loopback_stack_exit();
+#endif
 		mesh_exit();
 		// fall through
 
@@ -247,6 +265,8 @@ cleanup:
 		// fall through
 
 	case 5:
+		packet_capture_exit();
+		packet_log_exit();
 		signal_exit();
 		// fall through
 
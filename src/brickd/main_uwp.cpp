@@ -37,6 +37,8 @@ extern "C" {
 #include "app_service.h"
 #include "hardware.h"
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_log.h"
 #include "usb.h"
 #include "mesh.h"
 #include "version.h"
@@ -382,6 +384,10 @@ void brickd_uwp::MainTask::Run(IBackgroundTaskInstance ^taskInstance) {
 
 	phase = 5;
 
+	// there is no writable default location for the dump file
+	packet_log_init(NULL);
+	packet_capture_init();
+
 	if (hardware_init() < 0) {
 		goto cleanup;
 	}
@@ -489,6 +495,8 @@ cleanup:
 		// fall through
 
 	case 5:
+		packet_capture_exit();
+		packet_log_exit();
 		event_exit();
 		// fall through
 
@@ -61,14 +61,20 @@ BOOL WINAPI Process32Next(HANDLE hSnapshot, PROCESSENTRY32 *lppe);
 
 #include "hardware.h"
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_log.h"
 #include "service.h"
 #include "usb.h"
 #include "mesh.h"
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	#include "loopback_stack.h"
+#endif
 #include "version.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
 static char _config_filename[1024];
+static char _packet_log_filename[1024];
 static bool _run_as_service = true;
 static bool _pause_before_exit = false;
 
@@ -434,6 +440,9 @@ init:
 
 	phase = 1;
 
+	packet_log_init(_packet_log_filename);
+	packet_capture_init();
+
 	if (hardware_init() < 0) {
 		// FIXME: set service_exit_code
 		goto cleanup;
@@ -462,6 +471,13 @@ init:
 
 	phase = 5;
 
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+	if (loopback_stack_init() < 0) {
+		// FIXME: set service_exit_code
+		goto cleanup;
+	}
+#endif
+
 	// running
 	if (_run_as_service) {
 		service_set_status(SERVICE_RUNNING, NO_ERROR);
@@ -477,6 +493,9 @@ init:
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
 	case 5:
+#ifdef BRICKD_WITH_LOOPBACK_STACK
+		loopback_stack_exit();
+#endif
 		mesh_exit();
 		// fall through
 
@@ -493,6 +512,8 @@ cleanup:
 		// fall through
 
 	case 1:
+		packet_capture_exit();
+		packet_log_exit();
 		event_exit();
 		// fall through
 
@@ -707,6 +728,11 @@ int main(int argc, char **argv) {
 		return EXIT_FAILURE;
 	}
 
+	string_copy(_packet_log_filename, sizeof(_packet_log_filename), _config_filename, -1);
+
+	_packet_log_filename[i - 4] = '\0';
+	string_append(_packet_log_filename, sizeof(_packet_log_filename), "-packet-log.bin");
+
 	_config_filename[i - 3] = '\0';
 	string_append(_config_filename, sizeof(_config_filename), "ini");
 
@@ -38,6 +38,10 @@
 #include "mesh.h"
 
 #include "mesh_stack.h"
+#include "network.h"
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	#include "socket_activation.h"
+#endif
 
 Array mesh_stacks;
 
@@ -47,7 +51,7 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 int mesh_init(void) {
 	log_debug("Initializing mesh subsystem");
 
-	if (array_create(&mesh_stacks, MAX_MESH_STACKS, sizeof(MeshStack), false) < 0) {
+	if (array_create(&mesh_stacks, MESH_STACKS_INITIAL_CAPACITY, sizeof(MeshStack), false) < 0) {
 		log_error("Failed to create mesh stack array: %s (%d)",
 		          get_errno_name(errno), errno);
 
@@ -72,17 +76,17 @@ void mesh_exit(void) {
 	socket_destroy(&mesh_listen_socket);
 
 	array_destroy(&mesh_stacks, (ItemDestroyFunction)mesh_stack_destroy);
+
+	mesh_free_routes();
 }
 
 void mesh_handle_accept(void *opaque) {
-	char port[NI_MAXSERV];
 	char *name = "<unknown>";
-	char hostname[NI_MAXHOST];
 	Socket *mesh_client_socket;
 	// Socket that is created to the root node of a mesh network.
 	struct sockaddr_storage address;
 	socklen_t length = sizeof(address);
-	char buffer[NI_MAXHOST + NI_MAXSERV + 4];
+	char buffer[NETWORK_MAX_ADDRESS_LENGTH];
 
 	(void)opaque;
 
@@ -102,17 +106,11 @@ void mesh_handle_accept(void *opaque) {
 		return;
 	}
 
-	if (socket_address_to_hostname((struct sockaddr *)&address,
-	                               length,
-	                               hostname,
-	                               sizeof(hostname),
-	                               port,
-	                               sizeof(port)) < 0) {
-		log_warn("Could not get hostname and port of mesh client (socket: %d): %s (%d)",
-		         mesh_client_socket->handle, get_errno_name(errno), errno);
+	if (network_format_address((struct sockaddr *)&address, length,
+	                           buffer, sizeof(buffer)) < 0) {
+		log_warn("Could not format address of mesh client (socket: %d)",
+		         mesh_client_socket->handle);
 	} else {
-		snprintf(buffer, sizeof(buffer), "%s:%s", hostname, port);
-
 		name = buffer;
 	}
 
@@ -131,9 +129,18 @@ int mesh_start_listening(void) {
 	const char *address = config_get_option_value("listen.address")->string;
 	uint16_t port = (uint16_t)config_get_option_value("listen.mesh_gateway_port")->integer;
 	bool dual_stack = config_get_option_value("listen.dual_stack")->boolean;
+	int rc = 0;
+
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	rc = socket_activation_adopt_tcp(&mesh_listen_socket, port, socket_create_allocated);
+
+	if (rc < 0) {
+		return -1;
+	}
+#endif
 
-	if (socket_open_server(&mesh_listen_socket, address, port, dual_stack,
-	                       socket_create_allocated) < 0) {
+	if (rc == 0 && socket_open_server(&mesh_listen_socket, address, port, dual_stack,
+	                                  socket_create_allocated) < 0) {
 		return -1;
 	}
 
@@ -155,6 +162,12 @@ void mesh_cleanup_stacks(void) {
 	for (i = mesh_stacks.count - 1; i >= 0; --i) {
 		mesh_stack = array_get(&mesh_stacks, i);
 
+		// this is called at the end of each event loop iteration, write all
+		// packets that got collected during this iteration
+		if (!mesh_stack->write_pending) {
+			mesh_stack_flush(mesh_stack);
+		}
+
 		if (mesh_stack->cleanup) {
 			log_debug("Removing mesh stack, %s", mesh_stack->name);
 			array_remove(&mesh_stacks, i, (ItemDestroyFunction)mesh_stack_destroy);
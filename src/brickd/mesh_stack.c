@@ -29,10 +29,14 @@
 #include <daemonlib/utils.h>
 #include <daemonlib/event.h>
 #include <daemonlib/base58.h>
+#include <daemonlib/config.h>
 
 #include "mesh_stack.h"
 
+#include "client.h"
+#include "event_profile.h"
 #include "hardware.h"
+#include "hmac.h"
 #include "network.h"
 
 #define CHECK_BIT(val, pos) ((val) & (1 << (pos)))
@@ -40,121 +44,342 @@
 Array mesh_stacks;
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
-static void mesh_stack_recv_handler(void *opaque) {
-	int read_len = 0;
-	uint8_t mesh_pkt_type = 0;
-	esp_mesh_header_t *mesh_header = NULL;
-	MeshStack *mesh_stack = (MeshStack *)opaque;
+// the mesh router maps the address of each mesh node that sent a TFP packet
+// to the mesh stack of the root node it is currently connected through. it is
+// an open addressing hash table with linear probing, like the routing table in
+// hardware.c. an address of 0 marks an empty slot.
+//
+// with multiple root nodes a mesh node can reconnect through another root
+// node. then all devices behind the mesh node move to the other mesh stack at
+// once, instead of one by one as their responses arrive
+typedef struct {
+	uint64_t address;
+	MeshStack *mesh_stack;
+} MeshRoute;
+
+static uint32_t _heartbeat_jitter_state = 0; // xorshift32, seeded on first use
+
+static MeshRoute *_mesh_routes = NULL;
+static int _mesh_route_bits = 0; // capacity is 2^_mesh_route_bits
+static int _mesh_route_count = 0;
+
+static MeshRoute *mesh_get_route_slot(MeshRoute *routes, int bits, uint64_t address) {
+	uint32_t mask = ((uint32_t)1 << bits) - 1;
+	uint32_t i = (uint32_t)((address * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+
+	while (routes[i].address != 0 && routes[i].address != address) {
+		i = (i + 1) & mask;
+	}
 
-	if (mesh_stack->cleanup) {
-		log_warn("Mesh stack already scheduled for cleanup, ignoring receive...");
+	return &routes[i];
+}
 
-		return;
+// rebuilds the table with the given capacity and without the routes to the
+// excluded mesh stack. sets errno on error
+static int mesh_rebuild_routes(int bits, MeshStack *excluded_mesh_stack) {
+	MeshRoute *routes = calloc((size_t)1 << bits, sizeof(MeshRoute));
+	MeshRoute *route;
+	int count = 0;
+	int i;
+
+	if (routes == NULL) {
+		errno = ENOMEM;
+
+		return -1;
 	}
 
-	read_len = socket_receive(mesh_stack->sock,
-	                          (uint8_t *)&mesh_stack->incoming_buffer + mesh_stack->incoming_buffer_used,
-	                          sizeof(mesh_stack->incoming_buffer) - mesh_stack->incoming_buffer_used);
+	for (i = 0; _mesh_routes != NULL && i < 1 << _mesh_route_bits; ++i) {
+		if (_mesh_routes[i].address == 0 || _mesh_routes[i].mesh_stack == excluded_mesh_stack) {
+			continue;
+		}
 
-	if (read_len == 0) {
-		/*
-		 * Mark the stack for cleanup. Actual cleanup will be done after this
-		 * event handler callback has returned.
-		 */
-		mesh_stack->cleanup = true;
+		route = mesh_get_route_slot(routes, bits, _mesh_routes[i].address);
 
-		log_info("Mesh stack disconnected (N: %s)", mesh_stack->name);
+		*route = _mesh_routes[i];
+		++count;
+	}
 
-		return;
+	free(_mesh_routes);
+
+	_mesh_routes = routes;
+	_mesh_route_bits = bits;
+	_mesh_route_count = count;
+
+	return 0;
+}
+
+// returns the mesh stack the address was previously routed to, or NULL
+static MeshStack *mesh_set_route(uint64_t address, MeshStack *mesh_stack) {
+	MeshRoute *route;
+	MeshStack *previous_mesh_stack;
+
+	// keep the load factor at 50% or below
+	if ((_mesh_route_count + 1) * 2 > (_mesh_routes != NULL ? 1 << _mesh_route_bits : 0) &&
+	    mesh_rebuild_routes(_mesh_route_bits > 0 ? _mesh_route_bits + 1 : 5, NULL) < 0) {
+		log_error("Could not grow mesh routing table: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return NULL;
 	}
 
-	if (read_len < 0) {
-		if (read_len == IO_CONTINUE) {
-			log_debug("No actual data received");
-		} else if (errno_interrupted()) {
-			log_debug("Receiving interrupted, retrying");
-		} else if (errno_would_block()) {
-			log_debug("Receiving would block, retrying");
-		} else {
-			log_error("Could not receive from mesh client, disconnecting stack (N: %s, R: %d)",
-			          mesh_stack->name,
-			          read_len);
+	route = mesh_get_route_slot(_mesh_routes, _mesh_route_bits, address);
 
-			mesh_stack->cleanup = true;
-		}
+	if (route->address == 0) {
+		route->address = address;
+		route->mesh_stack = NULL;
+
+		++_mesh_route_count;
+	}
 
+	previous_mesh_stack = route->mesh_stack;
+	route->mesh_stack = mesh_stack;
+
+	return previous_mesh_stack;
+}
+
+static void mesh_remove_routes(MeshStack *mesh_stack) {
+	if (_mesh_routes == NULL) {
 		return;
 	}
 
-	mesh_stack->incoming_buffer_used += read_len;
+	// rebuilding the table in place can only fail if memory is exhausted, in
+	// which case the whole table is dropped
+	if (mesh_rebuild_routes(_mesh_route_bits, mesh_stack) < 0) {
+		log_error("Could not rebuild mesh routing table, clearing it: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		mesh_free_routes();
+	}
+}
+
+void mesh_free_routes(void) {
+	free(_mesh_routes);
 
-	while (!mesh_stack->cleanup && mesh_stack->incoming_buffer_used > 0) {
-		if (mesh_stack->incoming_buffer_used < (int)sizeof(esp_mesh_header_t)) {
-			// Wait for complete mesh header.
-			log_debug("Waiting for complete mesh header");
+	_mesh_routes = NULL;
+	_mesh_route_bits = 0;
+	_mesh_route_count = 0;
+}
 
-			break;
+static int mesh_stack_find_enumerate_callback(MeshStack *mesh_stack, uint32_t uid) {
+	int i;
+
+	for (i = 0; i < mesh_stack->enumerate_cache.count; ++i) {
+		if (((EnumerateCallback *)array_get(&mesh_stack->enumerate_cache, i))->header.uid == uid) {
+			return i;
 		}
+	}
 
-		// Now we have a complete mesh header.
-		mesh_header = (esp_mesh_header_t *)&mesh_stack->incoming_buffer;
+	return -1;
+}
 
-		if (!mesh_stack->mesh_header_checked) {
-			if (!is_mesh_header_valid(mesh_header)) {
-				log_error("Received invalid mesh header, disconnecting mesh stack (N: %s)",
-				          mesh_stack->name);
+// forget all devices behind the mesh node, because it is connected through
+// another root node now
+static void mesh_stack_forget_node(MeshStack *mesh_stack, uint64_t address) {
+	RecipientTable *recipients = &mesh_stack->base.recipients;
+	uint32_t uid;
+	int i;
+	int k;
 
-				mesh_stack->cleanup = true;
+	for (i = 0; recipients->slots != NULL && i < 1 << recipients->bits; ++i) {
+		// removing a recipient can shift a following entry into this slot,
+		// therefore, check this slot again until it holds no matching entry
+		while (recipients->slots[i].uid != 0 && recipients->slots[i].opaque == address) {
+			uid = recipients->slots[i].uid;
+			k = mesh_stack_find_enumerate_callback(mesh_stack, uid);
 
-				return;
+			if (k >= 0) {
+				array_remove(&mesh_stack->enumerate_cache, k, NULL);
 			}
 
-			mesh_stack->mesh_header_checked = true;
+			stack_remove_recipient(&mesh_stack->base, uid);
 		}
+	}
+}
 
-		read_len = mesh_header->len;
+static void mesh_stack_write_handler(void *opaque) {
+	mesh_stack_flush((MeshStack *)opaque);
+}
 
-		// FIXME: add mesh_header->len validation
+static void mesh_stack_set_write_pending(MeshStack *mesh_stack, bool write_pending) {
+	if (mesh_stack->write_pending == write_pending) {
+		return;
+	}
 
-		if (mesh_stack->incoming_buffer_used < read_len) {
-			// Wait for complete packet.
-			log_debug("Waiting for complete mesh packet");
+	if (write_pending) {
+		if (event_modify_source(mesh_stack->sock->handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        0, EVENT_WRITE, mesh_stack_write_handler, mesh_stack) < 0) {
+			log_error("Could not wait for mesh stack to become writable, disconnecting stack (N: %s)",
+			          mesh_stack->name);
 
-			break;
+			mesh_stack->cleanup = true;
+
+			return;
 		}
+	} else {
+		if (event_modify_source(mesh_stack->sock->handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        EVENT_WRITE, 0, NULL, NULL) < 0) {
+			log_error("Could not stop waiting for mesh stack to become writable, disconnecting stack (N: %s)",
+			          mesh_stack->name);
 
-		mesh_pkt_type = mesh_stack->incoming_buffer[sizeof(esp_mesh_header_t)];
+			mesh_stack->cleanup = true;
 
-		// Handle mesh hello packet.
-		if (mesh_pkt_type == MESH_PACKET_HELLO) {
-			hello_recv_handler(mesh_stack);
+			return;
 		}
-		// Handle heart beat ping packet.
-		else if (mesh_pkt_type == MESH_PACKET_HB_PING) {
-			hb_ping_recv_handler(mesh_stack);
+	}
+
+	mesh_stack->write_pending = write_pending;
+}
+
+// Handles one complete mesh packet at mesh_stack->incoming_packet.
+static void mesh_stack_handle_packet(MeshStack *mesh_stack) {
+	uint8_t mesh_pkt_type = mesh_stack->incoming_packet[sizeof(esp_mesh_header_t)];
+
+	// Handle mesh hello packet.
+	if (mesh_pkt_type == MESH_PACKET_HELLO) {
+		hello_recv_handler(mesh_stack);
+	}
+	// Handle heart beat ping packet.
+	else if (mesh_pkt_type == MESH_PACKET_HB_PING) {
+		hb_ping_recv_handler(mesh_stack);
+	}
+	// Handle heart beat pong packet.
+	else if (mesh_pkt_type == MESH_PACKET_HB_PONG) {
+		hb_pong_recv_handler(mesh_stack);
+	}
+	// Handle TFP packet.
+	else if (mesh_pkt_type == MESH_PACKET_TFP) {
+		tfp_recv_handler(mesh_stack);
+	}
+	// Packet type is unknown.
+	else {
+		log_error("Unknown mesh packet type received");
+	}
+}
+
+static void mesh_stack_recv_handler(void *opaque) {
+	int read_len = 0;
+	int reads = 0;
+	int free_len = 0;
+	int packet_len = 0;
+	int available = 0;
+	esp_mesh_header_t *mesh_header = NULL;
+	MeshStack *mesh_stack = (MeshStack *)opaque;
+
+	if (mesh_stack->cleanup) {
+		log_warn("Mesh stack already scheduled for cleanup, ignoring receive...");
+
+		return;
+	}
+
+	/*
+	 * Packets are parsed in place at incoming_buffer_start. The unparsed rest
+	 * is only moved to the front of the buffer if there is not enough room
+	 * left for a complete packet behind it. This happens at most once per read
+	 * instead of once per packet.
+	 */
+	while (!mesh_stack->cleanup && reads < MESH_STACK_MAX_READS_PER_EVENT) {
+		if (mesh_stack->incoming_buffer_start > 0 &&
+		    (int)sizeof(mesh_stack->incoming_buffer) - mesh_stack->incoming_buffer_used < (int)sizeof(pkt_mesh_tfp_t)) {
+			memmove(&mesh_stack->incoming_buffer,
+			        (uint8_t *)&mesh_stack->incoming_buffer + mesh_stack->incoming_buffer_start,
+			        mesh_stack->incoming_buffer_used - mesh_stack->incoming_buffer_start);
+
+			mesh_stack->incoming_buffer_used -= mesh_stack->incoming_buffer_start;
+			mesh_stack->incoming_buffer_start = 0;
 		}
-		// Handle heart beat pong packet.
-		else if (mesh_pkt_type == MESH_PACKET_HB_PONG) {
-			hb_pong_recv_handler(mesh_stack);
+
+		free_len = (int)sizeof(mesh_stack->incoming_buffer) - mesh_stack->incoming_buffer_used;
+		read_len = socket_receive(mesh_stack->sock,
+		                          (uint8_t *)&mesh_stack->incoming_buffer + mesh_stack->incoming_buffer_used,
+		                          free_len);
+
+		if (read_len == 0) {
+			/*
+			 * Mark the stack for cleanup. Actual cleanup will be done after this
+			 * event handler callback has returned.
+			 */
+			mesh_stack->cleanup = true;
+
+			log_info("Mesh stack disconnected (N: %s)", mesh_stack->name);
+
+			return;
 		}
-		// Handle TFP packet.
-		else if (mesh_pkt_type == MESH_PACKET_TFP) {
-			tfp_recv_handler(mesh_stack);
+
+		if (read_len < 0) {
+			if (read_len == IO_CONTINUE || errno_interrupted() || errno_would_block()) {
+				// Nothing more to read for now, this is expected after the first read.
+				if (reads == 0) {
+					log_debug("No data received from mesh stack (N: %s)", mesh_stack->name);
+				}
+			} else {
+				log_error("Could not receive from mesh client, disconnecting stack (N: %s, R: %d)",
+				          mesh_stack->name,
+				          read_len);
+
+				mesh_stack->cleanup = true;
+			}
+
+			return;
 		}
-		// Packet type is unknown.
-		else {
-			log_error("Unknown mesh packet type received");
+
+		++reads;
+		mesh_stack->incoming_buffer_used += read_len;
+		mesh_stack->last_received_at = microseconds();
+
+		while (!mesh_stack->cleanup) {
+			available = mesh_stack->incoming_buffer_used - mesh_stack->incoming_buffer_start;
+
+			if (available < (int)sizeof(esp_mesh_header_t)) {
+				// Wait for complete mesh header.
+				break;
+			}
+
+			// Now we have a complete mesh header.
+			mesh_header = (esp_mesh_header_t *)((uint8_t *)&mesh_stack->incoming_buffer +
+			                                    mesh_stack->incoming_buffer_start);
+
+			if (!mesh_stack->mesh_header_checked) {
+				if (!is_mesh_header_valid(mesh_header)) {
+					log_error("Received invalid mesh header, disconnecting mesh stack (N: %s)",
+					          mesh_stack->name);
+
+					mesh_stack->cleanup = true;
+
+					return;
+				}
+
+				mesh_stack->mesh_header_checked = true;
+			}
+
+			packet_len = mesh_header->len;
+
+			if (available < packet_len) {
+				// Wait for complete packet.
+				break;
+			}
+
+			mesh_stack->incoming_packet = (uint8_t *)mesh_header;
+
+			mesh_stack_handle_packet(mesh_stack);
+
+			mesh_stack->mesh_header_checked = false;
+			mesh_stack->incoming_buffer_start += packet_len;
 		}
 
-		memmove(&mesh_stack->incoming_buffer,
-		        (uint8_t *)&mesh_stack->incoming_buffer + read_len,
-		        mesh_stack->incoming_buffer_used - read_len);
+		if (mesh_stack->incoming_buffer_start == mesh_stack->incoming_buffer_used) {
+			mesh_stack->incoming_buffer_start = 0;
+			mesh_stack->incoming_buffer_used = 0;
+		}
 
-		mesh_stack->mesh_header_checked = false;
-		mesh_stack->incoming_buffer_used -= read_len;
+		// A short read means the socket is drained, don't waste another syscall.
+		if (read_len < free_len) {
+			break;
+		}
 	}
 }
 
+EVENT_PROFILE_HANDLER(mesh_stack_recv_handler, "mesh")
+
 static void timer_wait_hello_handler(void *opaque) {
 	MeshStack *mesh_stack = (MeshStack *)opaque;
 
@@ -223,41 +448,165 @@ void set_esp_mesh_header_flag_direction(uint8_t *flags, uint8_t val) {
 	}
 }
 
+/*
+ * Mesh packets are collected in the outgoing buffer of the mesh stack and are
+ * written to the root node in one go at the end of the event loop iteration,
+ * to send small TFP packets with fewer TCP writes. Whatever the root node does
+ * not accept without blocking stays in the buffer until the socket becomes
+ * writable again. If the buffer is full new packets are dropped, instead of
+ * disconnecting all devices behind a temporarily congested root node.
+ */
+int mesh_stack_send(MeshStack *mesh_stack, void *packet) {
+	int length = ((esp_mesh_header_t *)packet)->len;
+
+	if (mesh_stack->cleanup) {
+		return -1;
+	}
+
+	if (mesh_stack->outgoing_used + length > MESH_STACK_OUTGOING_BUFFER_SIZE) {
+		if (!mesh_stack->write_pending) {
+			mesh_stack_flush(mesh_stack);
+		}
+
+		if (mesh_stack->cleanup) {
+			return -1;
+		}
+
+		if (mesh_stack->outgoing_used + length > MESH_STACK_OUTGOING_BUFFER_SIZE) {
+			++mesh_stack->dropped_packets;
+
+			log_warn("Outgoing buffer of mesh stack is full, dropping packet (N: %s, L: %d, dropped: %u)",
+			         mesh_stack->name, length, mesh_stack->dropped_packets);
+
+			return -1;
+		}
+	}
+
+	memcpy(mesh_stack->outgoing_buffer + mesh_stack->outgoing_used, packet, length);
+
+	mesh_stack->outgoing_used += length;
+
+	return 0;
+}
+
+void mesh_stack_flush(MeshStack *mesh_stack) {
+	int length;
+
+	if (mesh_stack->cleanup || mesh_stack->outgoing_used == 0) {
+		return;
+	}
+
+	length = socket_send(mesh_stack->sock, mesh_stack->outgoing_buffer, mesh_stack->outgoing_used);
+
+	if (length < 0) {
+		if (!errno_interrupted() && !errno_would_block()) {
+			log_error("Could not send to mesh stack, disconnecting stack (N: %s): %s (%d)",
+			          mesh_stack->name, get_errno_name(errno), errno);
+
+			mesh_stack->cleanup = true;
+
+			return;
+		}
+
+		length = 0;
+	}
+
+	// keep the unsent rest and retry as soon as the socket is writable
+	memmove(mesh_stack->outgoing_buffer, mesh_stack->outgoing_buffer + length,
+	        mesh_stack->outgoing_used - length);
+
+	mesh_stack->outgoing_used -= length;
+
+	mesh_stack_set_write_pending(mesh_stack, mesh_stack->outgoing_used > 0);
+}
+
+// In microseconds.
+static uint64_t mesh_stack_get_heartbeat_interval(void) {
+	return (uint64_t)config_get_option_value("mesh.heartbeat_interval")->integer * 1000;
+}
+
+/*
+ * Returns the heartbeat interval randomized by the configured jitter. This
+ * keeps root nodes that connected at the same time, for example after a
+ * site-wide power cycle, from all being pinged at the same moment.
+ */
+static uint64_t mesh_stack_get_heartbeat_delay(void) {
+	uint64_t interval = mesh_stack_get_heartbeat_interval();
+	uint64_t jitter = interval * config_get_option_value("mesh.heartbeat_jitter")->integer / 100;
+
+	if (jitter == 0) {
+		return interval;
+	}
+
+	if (_heartbeat_jitter_state == 0) {
+		_heartbeat_jitter_state = get_random_uint32() | 1;
+	}
+
+	_heartbeat_jitter_state ^= _heartbeat_jitter_state << 13;
+	_heartbeat_jitter_state ^= _heartbeat_jitter_state >> 17;
+	_heartbeat_jitter_state ^= _heartbeat_jitter_state << 5;
+
+	return interval - jitter + _heartbeat_jitter_state % (2 * jitter + 1);
+}
+
 void timer_hb_do_ping_handler(void *opaque) {
 	MeshStack *mesh_stack = (MeshStack *)opaque;
 	pkt_mesh_hb_t pkt_mesh_hb;
-	esp_mesh_header_t *mesh_header = (esp_mesh_header_t *)
-	  esp_mesh_get_packet_header(// Direction.
-	                             ESP_MESH_PACKET_DOWNWARDS,
-	                             // P2P.
-	                             false,
-	                             // ESP mesh payload protocol.
-	                             ESP_MESH_PAYLOAD_BIN,
-	                             // Length of the payload of the mesh packet.
-	                             sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
-	                             // Destination address.
-	                             mesh_stack->root_node_addr,
-	                             // Source address.
-	                             mesh_stack->gw_addr);
+
+	/*
+	 * Any packet from the root node proves that the connection is alive. Only
+	 * ping if nothing was received for a whole heartbeat interval.
+	 */
+	if (microseconds() - mesh_stack->last_received_at < mesh_stack_get_heartbeat_interval()) {
+		log_debug("Skipping ping to mesh root node, traffic is flowing (N: %s)",
+		          mesh_stack->name);
+
+		arm_timer_hb_do_ping(mesh_stack);
+
+		return;
+	}
 
 	memset(&pkt_mesh_hb, 0, sizeof(pkt_mesh_hb_t));
-	memcpy(&pkt_mesh_hb.header, mesh_header, sizeof(esp_mesh_header_t));
-	free(mesh_header);
+	esp_mesh_init_packet_header(&pkt_mesh_hb.header,
+	                            // Direction.
+	                            ESP_MESH_PACKET_DOWNWARDS,
+	                            // P2P.
+	                            false,
+	                            // ESP mesh payload protocol.
+	                            ESP_MESH_PAYLOAD_BIN,
+	                            // Length of the payload of the mesh packet.
+	                            sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
+	                            // Destination address.
+	                            mesh_stack->root_node_addr,
+	                            // Source address.
+	                            mesh_stack->gw_addr);
 
 	pkt_mesh_hb.type = MESH_PACKET_HB_PING;
 
 	log_debug("Sending ping to mesh root node");
 
-	// TODO: Integrate buffered IO write.
-	if (socket_send(mesh_stack->sock, &pkt_mesh_hb, pkt_mesh_hb.header.len) < 0) {
-		log_error("Failed to send ping to mesh root node, cleaning up mesh stack");
+	if (mesh_stack_send(mesh_stack, &pkt_mesh_hb) < 0) {
+		/*
+		 * A full outgoing buffer is backpressure, not a dead connection. Skip
+		 * this ping and retry on the next tick. A real I/O error has already
+		 * marked the mesh stack for cleanup.
+		 */
+		if (mesh_stack->cleanup) {
+			log_error("Failed to send ping to mesh root node, cleaning up mesh stack (N: %s)",
+			          mesh_stack->name);
 
-		mesh_stack->cleanup = true;
+			return;
+		}
+
+		log_warn("Outgoing buffer of mesh stack is full, skipping ping to mesh root node (N: %s)",
+		         mesh_stack->name);
+
+		arm_timer_hb_do_ping(mesh_stack);
 	} else {
 		log_debug("Arming wait pong timer");
 
 		if (timer_configure(&mesh_stack->timer_hb_wait_pong,
-		                    TIME_HB_WAIT_PONG, 0) < 0) {
+		                    mesh_stack_get_heartbeat_interval() / 2, 0) < 0) {
 			log_error("Failed to arm wait pong timer (N: %s), cleaning up the mesh stack",
 			          mesh_stack->name);
 
@@ -265,6 +614,8 @@ void timer_hb_do_ping_handler(void *opaque) {
 
 			return;
 		}
+
+		arm_timer_hb_do_ping(mesh_stack);
 	}
 }
 
@@ -280,7 +631,7 @@ void hello_recv_handler(MeshStack *mesh_stack) {
 	char prefix_str[17];
 
 	pkt_mesh_hello_t *pkt_mesh_hello = \
-	        (pkt_mesh_hello_t *)&mesh_stack->incoming_buffer;
+	        (pkt_mesh_hello_t *)mesh_stack->incoming_packet;
 
 	log_debug("Received mesh packet (T: HELLO, L: %d)", pkt_mesh_hello->header.len);
 
@@ -326,9 +677,60 @@ void hello_recv_handler(MeshStack *mesh_stack) {
 	}
 }
 
+// Keeps the latest enumerate callback of every device to answer deduplicated
+// enumerate requests from the gateway.
+static void mesh_stack_cache_enumerate_callback(MeshStack *mesh_stack, Packet *response) {
+	EnumerateCallback *enumerate_callback = (EnumerateCallback *)response;
+	EnumerateCallback *cached;
+	int i;
+
+	if (response->header.length != sizeof(EnumerateCallback)) {
+		return;
+	}
+
+	i = mesh_stack_find_enumerate_callback(mesh_stack, response->header.uid);
+
+	if (enumerate_callback->enumeration_type == ENUMERATION_TYPE_DISCONNECTED) {
+		if (i >= 0) {
+			array_remove(&mesh_stack->enumerate_cache, i, NULL);
+		}
+
+		return;
+	}
+
+	if (i >= 0) {
+		cached = array_get(&mesh_stack->enumerate_cache, i);
+	} else {
+		cached = array_append(&mesh_stack->enumerate_cache);
+
+		if (cached == NULL) {
+			log_error("Could not append to enumerate cache: %s (%d)",
+			          get_errno_name(errno), errno);
+
+			return;
+		}
+	}
+
+	memcpy(cached, enumerate_callback, sizeof(*cached));
+
+	cached->enumeration_type = ENUMERATION_TYPE_AVAILABLE;
+}
+
+static void mesh_stack_send_cached_enumerate_callbacks(MeshStack *mesh_stack, Client *client) {
+	int i;
+
+	log_debug("Answering enumerate request from cache with %d device(s) (N: %s)",
+	          mesh_stack->enumerate_cache.count, mesh_stack->name);
+
+	for (i = 0; i < mesh_stack->enumerate_cache.count; ++i) {
+		client_broadcast_response(client, array_get(&mesh_stack->enumerate_cache, i));
+	}
+}
+
 bool tfp_recv_handler(MeshStack *mesh_stack) {
 	uint64_t mesh_src_addr = 0;
-	pkt_mesh_tfp_t *pkt_mesh_tfp = (pkt_mesh_tfp_t *)&mesh_stack->incoming_buffer;
+	MeshStack *previous_mesh_stack;
+	pkt_mesh_tfp_t *pkt_mesh_tfp = (pkt_mesh_tfp_t *)mesh_stack->incoming_packet;
 
 	log_debug("Received mesh packet (T: TFP, L: %d, A: %02X-%02X-%02X-%02X-%02X-%02X)",
 	          pkt_mesh_tfp->header.len,
@@ -339,16 +741,50 @@ bool tfp_recv_handler(MeshStack *mesh_stack) {
 	          pkt_mesh_tfp->header.src_addr[4],
 	          pkt_mesh_tfp->header.src_addr[5]);
 
+	if (pkt_mesh_tfp->header.len < sizeof(esp_mesh_header_t) + 1 + sizeof(PacketHeader) ||
+	    pkt_mesh_tfp->pkt_tfp.header.length != pkt_mesh_tfp->header.len - sizeof(esp_mesh_header_t) - 1) {
+		log_error("Received TFP packet with mismatching length (L: %d, T: %d), ignoring it",
+		          pkt_mesh_tfp->header.len, pkt_mesh_tfp->pkt_tfp.header.length);
+
+		return false;
+	}
+
 	memcpy(&mesh_src_addr,
 	       &pkt_mesh_tfp->header.src_addr,
 	       sizeof(pkt_mesh_tfp->header.src_addr));
 
+	if (mesh_stack->last_node_addr != mesh_src_addr) {
+		previous_mesh_stack = mesh_set_route(mesh_src_addr, mesh_stack);
+
+		if (previous_mesh_stack != NULL && previous_mesh_stack != mesh_stack) {
+			log_info("Mesh node %02X-%02X-%02X-%02X-%02X-%02X moved from mesh stack %s to %s",
+			         pkt_mesh_tfp->header.src_addr[0],
+			         pkt_mesh_tfp->header.src_addr[1],
+			         pkt_mesh_tfp->header.src_addr[2],
+			         pkt_mesh_tfp->header.src_addr[3],
+			         pkt_mesh_tfp->header.src_addr[4],
+			         pkt_mesh_tfp->header.src_addr[5],
+			         previous_mesh_stack->name,
+			         mesh_stack->name);
+
+			mesh_stack_forget_node(previous_mesh_stack, mesh_src_addr);
+			previous_mesh_stack->last_node_addr = 0;
+		}
+
+		mesh_stack->last_node_addr = mesh_src_addr;
+	}
+
 	if (stack_add_recipient(&mesh_stack->base, pkt_mesh_tfp->pkt_tfp.header.uid, mesh_src_addr) < 0) {
 		log_error("Failed to add recipient to mesh stack");
 
 		return false;
 	}
 
+	if (pkt_mesh_tfp->pkt_tfp.header.function_id == CALLBACK_ENUMERATE &&
+	    packet_header_get_sequence_number(&pkt_mesh_tfp->pkt_tfp.header) == 0) {
+		mesh_stack_cache_enumerate_callback(mesh_stack, &pkt_mesh_tfp->pkt_tfp);
+	}
+
 	network_dispatch_response(&pkt_mesh_tfp->pkt_tfp);
 
 	log_debug("TFP packet dispatched (L: %d)", pkt_mesh_tfp->pkt_tfp.header.length);
@@ -357,6 +793,8 @@ bool tfp_recv_handler(MeshStack *mesh_stack) {
 }
 
 void mesh_stack_destroy(MeshStack *mesh_stack) {
+	mesh_remove_routes(mesh_stack);
+
 	// Disable all running timers.
 	timer_configure(&mesh_stack->timer_wait_hello, 0, 0);
 	timer_configure(&mesh_stack->timer_hb_do_ping, 0, 0);
@@ -374,6 +812,15 @@ void mesh_stack_destroy(MeshStack *mesh_stack) {
 	socket_destroy(mesh_stack->sock);
 	free(mesh_stack->sock);
 
+	if (mesh_stack->outgoing_used > 0 || mesh_stack->dropped_packets > 0) {
+		log_debug("Mesh stack %s released with %d unsent byte(s), %u packet(s) were dropped",
+		          mesh_stack->name, mesh_stack->outgoing_used, mesh_stack->dropped_packets);
+	}
+
+	free(mesh_stack->outgoing_buffer);
+
+	array_destroy(&mesh_stack->enumerate_cache, NULL);
+
 	if (mesh_stack->state == MESH_STACK_STATE_OPERATIONAL) {
 		stack_announce_disconnect(&mesh_stack->base);
 		hardware_remove_stack(&mesh_stack->base);
@@ -409,11 +856,32 @@ int mesh_stack_create(char *name, Socket *sock) {
 	 * be reported with current stack state.
 	 */
 	mesh_stack->state = MESH_STACK_STATE_WAIT_HELLO;
+	mesh_stack->outgoing_buffer = NULL;
+	mesh_stack->outgoing_used = 0;
+	mesh_stack->last_node_addr = 0;
+	mesh_stack->write_pending = false;
+	mesh_stack->dropped_packets = 0;
+	mesh_stack->last_enumerate_at = 0;
+	mesh_stack->last_received_at = 0;
+
+	if (array_create(&mesh_stack->enumerate_cache, 32, sizeof(EnumerateCallback), true) < 0) {
+		log_error("Could not create enumerate cache: %s (%d)",
+		          get_errno_name(errno),
+		          errno);
+
+		socket_destroy(sock);
+		free(sock);
+
+		// Nothing else is initialised yet, don't call mesh_stack_destroy.
+		array_remove(&mesh_stacks, mesh_stacks.count - 1, NULL);
+
+		return -1;
+	}
 
 	if (event_add_source(sock->handle,
 	                     EVENT_SOURCE_TYPE_GENERIC,
 	                     EVENT_READ,
-	                     mesh_stack_recv_handler,
+	                     EVENT_PROFILED(mesh_stack_recv_handler),
 	                     mesh_stack) < 0) {
 		log_error("Failed to add stack receive event");
 
@@ -427,7 +895,32 @@ int mesh_stack_create(char *name, Socket *sock) {
 	// Initialise the mesh stack.
 	mesh_stack->sock = sock;
 	mesh_stack->cleanup = false;
+	mesh_stack->outgoing_buffer = malloc(MESH_STACK_OUTGOING_BUFFER_SIZE);
+
+	if (mesh_stack->outgoing_buffer == NULL) {
+		log_error("Could not allocate outgoing buffer for mesh stack: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		array_remove(&mesh_stacks,
+		             mesh_stacks.count - 1,
+		             (ItemDestroyFunction)mesh_stack_destroy);
+
+		return -1;
+	}
+
+	if (socket_set_non_blocking(sock, true) < 0) {
+		log_error("Could not enable non-blocking mode for mesh stack socket: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		array_remove(&mesh_stacks,
+		             mesh_stacks.count - 1,
+		             (ItemDestroyFunction)mesh_stack_destroy);
+
+		return -1;
+	}
 	mesh_stack->incoming_buffer_used = 0;
+	mesh_stack->incoming_buffer_start = 0;
+	mesh_stack->incoming_packet = NULL;
 	mesh_stack->mesh_header_checked = false;
 
 	snprintf(mesh_stack->name, sizeof(mesh_stack->name), "%s", name);
@@ -510,7 +1003,7 @@ void hb_ping_recv_handler(MeshStack *mesh_stack) {
 	pkt_mesh_hb_t pkt_mesh_hb_pong;
 	uint8_t dst[ESP_MESH_ADDRESS_LEN];
 	uint8_t src[ESP_MESH_ADDRESS_LEN];
-	pkt_mesh_hb_t *pkt_mesh_hb_ping = (pkt_mesh_hb_t *)&mesh_stack->incoming_buffer;
+	pkt_mesh_hb_t *pkt_mesh_hb_ping = (pkt_mesh_hb_t *)mesh_stack->incoming_packet;
 
 	log_debug("Received mesh ping packet (T: PING, L: %d, A: %02X-%02X-%02X-%02X-%02X-%02X)",
 	          pkt_mesh_hb_ping->header.len,
@@ -533,8 +1026,7 @@ void hb_ping_recv_handler(MeshStack *mesh_stack) {
 
 	pkt_mesh_hb_pong.type = MESH_PACKET_HB_PONG;
 
-	// TODO: Integrate buffered IO write.
-	if (socket_send(mesh_stack->sock, &pkt_mesh_hb_pong, pkt_mesh_hb_pong.header.len) < 0) {
+	if (mesh_stack_send(mesh_stack, &pkt_mesh_hb_pong) < 0) {
 		log_error("Failed to send mesh pong packet");
 	} else {
 		log_debug("Sent mesh pong packet (A: %02X-%02X-%02X-%02X-%02X-%02X)",
@@ -552,7 +1044,7 @@ void hb_pong_recv_handler(MeshStack *mesh_stack) {
 
 	timer_configure(&mesh_stack->timer_hb_wait_pong, 0, 0);
 
-	pkt_mesh_hb = (pkt_mesh_hb_t *)&mesh_stack->incoming_buffer;
+	pkt_mesh_hb = (pkt_mesh_hb_t *)mesh_stack->incoming_packet;
 
 	log_debug("Received mesh pong packet (T: PONG, L: %d, A: %02X-%02X-%02X-%02X-%02X-%02X)",
 	          pkt_mesh_hb->header.len,
@@ -565,7 +1057,7 @@ void hb_pong_recv_handler(MeshStack *mesh_stack) {
 }
 
 void arm_timer_hb_do_ping(MeshStack *mesh_stack) {
-	if (timer_configure(&mesh_stack->timer_hb_do_ping, 0, TIME_HB_DO_PING) < 0) {
+	if (timer_configure(&mesh_stack->timer_hb_do_ping, mesh_stack_get_heartbeat_delay(), 0) < 0) {
 		log_error("Failed to arm do ping timer (N: %s), cleaning up the mesh stack",
 		          mesh_stack->name);
 
@@ -580,33 +1072,27 @@ void arm_timer_hb_do_ping(MeshStack *mesh_stack) {
 void broadcast_reset_packet(MeshStack *mesh_stack) {
 	pkt_mesh_reset_t pkt_mesh_reset;
 	uint8_t addr[ESP_MESH_ADDRESS_LEN];
-	esp_mesh_header_t *mesh_header = NULL;
 
 	memset(&addr, 0, sizeof(addr));
 
-	mesh_header = (esp_mesh_header_t *)
-	  esp_mesh_get_packet_header(// Direction.
-	                             ESP_MESH_PACKET_DOWNWARDS,
-	                             // P2P.
-	                             false,
-	                             // ESP mesh payload protocol.
-	                             ESP_MESH_PAYLOAD_BIN,
-	                             // Length of the payload of the mesh packet.
-	                             sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
-	                             // Destination address.
-	                             addr,
-	                             // Source address.
-	                             addr);
-
 	memset(&pkt_mesh_reset, 0, sizeof(pkt_mesh_reset_t));
-	memcpy(&pkt_mesh_reset.header, mesh_header, sizeof(esp_mesh_header_t));
-
-	free(mesh_header);
+	esp_mesh_init_packet_header(&pkt_mesh_reset.header,
+	                            // Direction.
+	                            ESP_MESH_PACKET_DOWNWARDS,
+	                            // P2P.
+	                            false,
+	                            // ESP mesh payload protocol.
+	                            ESP_MESH_PAYLOAD_BIN,
+	                            // Length of the payload of the mesh packet.
+	                            sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
+	                            // Destination address.
+	                            addr,
+	                            // Source address.
+	                            addr);
 
 	pkt_mesh_reset.type = MESH_PACKET_RESET;
 
-	// TODO: Integrate buffered IO write.
-	if (socket_send(mesh_stack->sock, &pkt_mesh_reset, pkt_mesh_reset.header.len) < 0) {
+	if (mesh_stack_send(mesh_stack, &pkt_mesh_reset) < 0) {
 		log_error("Failed to send broadcast reset stack packet, LEN=%d", pkt_mesh_reset.header.len);
 	} else {
 		log_debug("Broadcast reset stack packet sent");
@@ -616,10 +1102,9 @@ void broadcast_reset_packet(MeshStack *mesh_stack) {
 bool hello_root_recv_handler(MeshStack *mesh_stack) {
 	char prefix_str[17];
 	pkt_mesh_olleh_t olleh_mesh_pkt;
-	esp_mesh_header_t *mesh_header = NULL;
 	MeshStack *mesh_stack_from_list = NULL;
 	pkt_mesh_hello_t *hello_mesh_pkt = \
-	        (pkt_mesh_hello_t *)&mesh_stack->incoming_buffer;
+	        (pkt_mesh_hello_t *)mesh_stack->incoming_packet;
 	int i;
 
 #ifdef BRICKD_WITH_MESH_SINGLE_ROOT_NODE
@@ -657,29 +1142,24 @@ bool hello_root_recv_handler(MeshStack *mesh_stack) {
 			         hello_mesh_pkt->group_id[5]);
 
 			// Reset the mesh stack that was found on the list.
-			mesh_header = (esp_mesh_header_t *)
-			  esp_mesh_get_packet_header(// Direction.
-			                             ESP_MESH_PACKET_DOWNWARDS,
-			                             // P2P.
-			                             false,
-			                             // ESP mesh payload protocol.
-			                             ESP_MESH_PAYLOAD_BIN,
-			                             // Length of the payload of the mesh packet.
-			                             sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
-			                             // Destination address.
-			                             mesh_stack_from_list->root_node_addr,
-			                             // Source address.
-			                             hello_mesh_pkt->header.dst_addr);
-
 			memset(&pkt_mesh_reset, 0, sizeof(pkt_mesh_reset_t));
-			memcpy(&pkt_mesh_reset.header, mesh_header, sizeof(pkt_mesh_reset_t));
-
-			free(mesh_header);
+			esp_mesh_init_packet_header(&pkt_mesh_reset.header,
+			                            // Direction.
+			                            ESP_MESH_PACKET_DOWNWARDS,
+			                            // P2P.
+			                            false,
+			                            // ESP mesh payload protocol.
+			                            ESP_MESH_PAYLOAD_BIN,
+			                            // Length of the payload of the mesh packet.
+			                            sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
+			                            // Destination address.
+			                            mesh_stack_from_list->root_node_addr,
+			                            // Source address.
+			                            hello_mesh_pkt->header.dst_addr);
 
 			pkt_mesh_reset.type = MESH_PACKET_RESET;
 
-			// TODO: Integrate buffered IO write.
-			if (socket_send(mesh_stack_from_list->sock, &pkt_mesh_reset, pkt_mesh_reset.header.len) < 0) {
+			if (mesh_stack_send(mesh_stack_from_list, &pkt_mesh_reset) < 0) {
 				log_error("Failed to send mesh stack reset packet (A: %02X-%02X-%02X-%02X-%02X-%02X)",
 				          mesh_stack_from_list->root_node_addr[0],
 				          mesh_stack_from_list->root_node_addr[1],
@@ -698,29 +1178,24 @@ bool hello_root_recv_handler(MeshStack *mesh_stack) {
 			}
 
 			// Reset the mesh stack from which we just received.
-			mesh_header = (esp_mesh_header_t *)
-			  esp_mesh_get_packet_header(// Direction.
-			                             ESP_MESH_PACKET_DOWNWARDS,
-			                             // P2P.
-			                             false,
-			                             // ESP mesh payload protocol.
-			                             ESP_MESH_PAYLOAD_BIN,
-			                             // Length of the payload of the mesh packet.
-			                             sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
-			                             // Destination address.
-			                             hello_mesh_pkt->header.src_addr,
-			                             // Source address.
-			                             hello_mesh_pkt->header.dst_addr);
-
 			memset(&pkt_mesh_reset, 0, sizeof(pkt_mesh_reset_t));
-			memcpy(&pkt_mesh_reset.header, mesh_header, sizeof(pkt_mesh_reset_t));
-
-			free(mesh_header);
+			esp_mesh_init_packet_header(&pkt_mesh_reset.header,
+			                            // Direction.
+			                            ESP_MESH_PACKET_DOWNWARDS,
+			                            // P2P.
+			                            false,
+			                            // ESP mesh payload protocol.
+			                            ESP_MESH_PAYLOAD_BIN,
+			                            // Length of the payload of the mesh packet.
+			                            sizeof(pkt_mesh_reset_t) - sizeof(esp_mesh_header_t),
+			                            // Destination address.
+			                            hello_mesh_pkt->header.src_addr,
+			                            // Source address.
+			                            hello_mesh_pkt->header.dst_addr);
 
 			pkt_mesh_reset.type = MESH_PACKET_RESET;
 
-			// TODO: Integrate buffered IO write.
-			if (socket_send(mesh_stack->sock, &pkt_mesh_reset, pkt_mesh_reset.header.len) < 0) {
+			if (mesh_stack_send(mesh_stack, &pkt_mesh_reset) < 0) {
 				log_error("Failed to send mesh stack reset packet (A: %02X-%02X-%02X-%02X-%02X-%02X)",
 				          hello_mesh_pkt->header.src_addr[0],
 				          hello_mesh_pkt->header.src_addr[1],
@@ -800,30 +1275,25 @@ bool hello_root_recv_handler(MeshStack *mesh_stack) {
 		return false;
 	}
 
-	mesh_header = (esp_mesh_header_t *)
-	  esp_mesh_get_packet_header(// Direction.
-	                             ESP_MESH_PACKET_DOWNWARDS,
-	                             // P2P.
-	                             false,
-	                             // ESP mesh payload protocol.
-	                             ESP_MESH_PAYLOAD_BIN,
-	                             // Length of the payload of the mesh packet.
-	                             sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
-	                             // Destination address.
-	                             hello_mesh_pkt->header.src_addr,
-	                             // Source address.
-	                             hello_mesh_pkt->header.dst_addr);
-
 	// Prepare the olleh packet.
 	memset(&olleh_mesh_pkt, 0, sizeof(pkt_mesh_olleh_t));
-	memcpy(&olleh_mesh_pkt.header, mesh_header, sizeof(esp_mesh_header_t));
-
-	free(mesh_header);
+	esp_mesh_init_packet_header(&olleh_mesh_pkt.header,
+	                            // Direction.
+	                            ESP_MESH_PACKET_DOWNWARDS,
+	                            // P2P.
+	                            false,
+	                            // ESP mesh payload protocol.
+	                            ESP_MESH_PAYLOAD_BIN,
+	                            // Length of the payload of the mesh packet.
+	                            sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
+	                            // Destination address.
+	                            hello_mesh_pkt->header.src_addr,
+	                            // Source address.
+	                            hello_mesh_pkt->header.dst_addr);
 
 	olleh_mesh_pkt.type = MESH_PACKET_OLLEH;
 
-	// TODO: Integrate buffered IO write.
-	if (socket_send(mesh_stack->sock, &olleh_mesh_pkt, olleh_mesh_pkt.header.len) < 0) {
+	if (mesh_stack_send(mesh_stack, &olleh_mesh_pkt) < 0) {
 		log_error("Failed to send mesh olleh packet (A: %02X-%02X-%02X-%02X-%02X-%02X)",
 		          hello_mesh_pkt->header.src_addr[0],
 		          hello_mesh_pkt->header.src_addr[1],
@@ -858,6 +1328,21 @@ bool hello_root_recv_handler(MeshStack *mesh_stack) {
 	       &hello_mesh_pkt->header.dst_addr,
 	       sizeof(hello_mesh_pkt->header.dst_addr));
 
+	// Prebuild the header for TFP requests to the mesh.
+	esp_mesh_init_packet_header(&mesh_stack->tfp_header,
+	                            // Direction.
+	                            ESP_MESH_PACKET_DOWNWARDS,
+	                            // P2P.
+	                            false,
+	                            // ESP mesh payload protocol.
+	                            ESP_MESH_PAYLOAD_BIN,
+	                            // Length of the payload of the mesh packet, set per request.
+	                            0,
+	                            // Destination address, set per request.
+	                            mesh_stack->root_node_addr,
+	                            // Source address.
+	                            mesh_stack->gw_addr);
+
 	mesh_stack->state = MESH_STACK_STATE_OPERATIONAL;
 
 	memset(&prefix_str, 0, sizeof(prefix_str));
@@ -882,8 +1367,10 @@ bool hello_root_recv_handler(MeshStack *mesh_stack) {
 }
 
 bool is_mesh_header_valid(esp_mesh_header_t *mesh_header) {
-	if (mesh_header->len <= 0) {
-		log_error("ESP mesh packet header length is zero");
+	// A mesh packet has at least a type byte and at most carries a TFP packet.
+	if (mesh_header->len < sizeof(esp_mesh_header_t) + 1 ||
+	    mesh_header->len > sizeof(pkt_mesh_tfp_t)) {
+		log_error("ESP mesh packet header has invalid length (L: %d)", mesh_header->len);
 
 		return false;
 	}
@@ -903,17 +1390,39 @@ bool is_mesh_header_valid(esp_mesh_header_t *mesh_header) {
 	return true;
 }
 
-int mesh_stack_dispatch_request(Stack *stack, Packet *request, Recipient *recipient) {
+int mesh_stack_dispatch_request(Stack *stack, Packet *request,
+                                Recipient *recipient, Client *client) {
 	int ret = 0;
 	bool is_broadcast = true;
 	pkt_mesh_tfp_t tfp_mesh_pkt;
 	char base58[BASE58_MAX_LENGTH];
-	esp_mesh_header_t *mesh_header = NULL;
 	uint8_t dst_addr[ESP_MESH_ADDRESS_LEN];
 	MeshStack *mesh_stack = (MeshStack *)stack;
+	uint64_t now;
 
 	memset(&dst_addr, 0, sizeof(dst_addr));
 
+	/*
+	 * Every ESP node rebroadcasts a flooded request. All enumerate responses
+	 * are broadcast to all clients anyway, so a client enumerating shortly
+	 * after another one gets the responses that already arrived from the
+	 * cache and the rest from the pending flood.
+	 */
+	if (recipient == NULL && request->header.function_id == FUNCTION_ENUMERATE) {
+		now = microseconds();
+
+		if (mesh_stack->last_enumerate_at != 0 &&
+		    now - mesh_stack->last_enumerate_at < TIME_ENUMERATE_DEDUP_WINDOW) {
+			if (client != NULL) {
+				mesh_stack_send_cached_enumerate_callbacks(mesh_stack, client);
+			}
+
+			return 0;
+		}
+
+		mesh_stack->last_enumerate_at = now;
+	}
+
 	// Unicast.
 	if (recipient != NULL) {
 		is_broadcast = false;
@@ -921,24 +1430,12 @@ int mesh_stack_dispatch_request(Stack *stack, Packet *request, Recipient *recipi
 		memcpy(&dst_addr, &recipient->opaque, sizeof(dst_addr));
 	}
 
-	mesh_header = (esp_mesh_header_t *)
-	  esp_mesh_get_packet_header(// Direction.
-	                             ESP_MESH_PACKET_DOWNWARDS,
-	                             // P2P.
-	                             false,
-	                             // ESP mesh payload protocol.
-	                             ESP_MESH_PAYLOAD_BIN,
-	                             // Length of the payload of the mesh packet.
-	                             request->header.length + 1,
-	                             // Destination address.
-	                             dst_addr,
-	                             // Source address.
-	                             mesh_stack->gw_addr);
+	// Only the length and the destination address differ between requests.
+	// The rest of the packet is completely overwritten, no need to clear it
+	tfp_mesh_pkt.header = mesh_stack->tfp_header;
+	tfp_mesh_pkt.header.len = sizeof(esp_mesh_header_t) + 1 + request->header.length;
 
-	memset(&tfp_mesh_pkt, 0, sizeof(pkt_mesh_tfp_t));
-	memcpy(&tfp_mesh_pkt.header, mesh_header, mesh_header->len);
-
-	free(mesh_header);
+	memcpy(&tfp_mesh_pkt.header.dst_addr, &dst_addr, sizeof(dst_addr));
 
 	tfp_mesh_pkt.type = MESH_PACKET_TFP;
 
@@ -949,8 +1446,7 @@ int mesh_stack_dispatch_request(Stack *stack, Packet *request, Recipient *recipi
 		base58_encode(base58, uint32_from_le(recipient->uid));
 	}
 
-	// TODO: Integrate buffered IO write.
-	ret = socket_send(mesh_stack->sock, &tfp_mesh_pkt, tfp_mesh_pkt.header.len);
+	ret = mesh_stack_send(mesh_stack, &tfp_mesh_pkt);
 
 	if (ret < 0) {
 		if (is_broadcast) {
@@ -972,9 +1468,6 @@ int mesh_stack_dispatch_request(Stack *stack, Packet *request, Recipient *recipi
 			          dst_addr[5]);
 		}
 
-		log_debug("Marking mesh stack for cleanup (N: %s)", mesh_stack->name);
-		mesh_stack->cleanup = true;
-
 		return -1;
 	} else {
 		if (is_broadcast) {
@@ -1014,34 +1507,28 @@ void arm_timer_cleanup_after_reset_sent(MeshStack *mesh_stack) {
 
 bool hello_non_root_recv_handler(MeshStack *mesh_stack) {
 	pkt_mesh_olleh_t olleh_mesh_pkt;
-	esp_mesh_header_t *mesh_header = NULL;
 	pkt_mesh_hello_t *hello_mesh_pkt = \
-	        (pkt_mesh_hello_t *)&mesh_stack->incoming_buffer;
-
-	mesh_header = (esp_mesh_header_t *)
-	  esp_mesh_get_packet_header(// Direction.
-	                             ESP_MESH_PACKET_DOWNWARDS,
-	                             // P2P.
-	                             false,
-	                             // ESP mesh payload protocol.
-	                             ESP_MESH_PAYLOAD_BIN,
-	                             // Length of the payload of the mesh packet.
-	                             sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
-	                             // Destination address.
-	                             hello_mesh_pkt->header.src_addr,
-	                             // Source address.
-	                             mesh_stack->gw_addr);
+	        (pkt_mesh_hello_t *)mesh_stack->incoming_packet;
 
 	// Prepare the olleh packet.
 	memset(&olleh_mesh_pkt, 0, sizeof(pkt_mesh_olleh_t));
-	memcpy(&olleh_mesh_pkt.header, mesh_header, sizeof(esp_mesh_header_t));
-
-	free(mesh_header);
+	esp_mesh_init_packet_header(&olleh_mesh_pkt.header,
+	                            // Direction.
+	                            ESP_MESH_PACKET_DOWNWARDS,
+	                            // P2P.
+	                            false,
+	                            // ESP mesh payload protocol.
+	                            ESP_MESH_PAYLOAD_BIN,
+	                            // Length of the payload of the mesh packet.
+	                            sizeof(pkt_mesh_olleh_t) - sizeof(esp_mesh_header_t),
+	                            // Destination address.
+	                            hello_mesh_pkt->header.src_addr,
+	                            // Source address.
+	                            mesh_stack->gw_addr);
 
 	olleh_mesh_pkt.type = MESH_PACKET_OLLEH;
 
-	// TODO: Integrate buffered IO write.
-	if (socket_send(mesh_stack->sock, &olleh_mesh_pkt, olleh_mesh_pkt.header.len) < 0) {
+	if (mesh_stack_send(mesh_stack, &olleh_mesh_pkt) < 0) {
 		log_error("Olleh packet send failed (A: %02X-%02X-%02X-%02X-%02X-%02X)",
 		          hello_mesh_pkt->header.src_addr[0],
 		          hello_mesh_pkt->header.src_addr[1],
@@ -1064,13 +1551,14 @@ bool hello_non_root_recv_handler(MeshStack *mesh_stack) {
 	return true;
 }
 
-void *esp_mesh_get_packet_header(uint8_t flag_direction,
+void esp_mesh_init_packet_header(esp_mesh_header_t *mesh_header,
+                                 uint8_t flag_direction,
                                  bool flag_p2p,
                                  uint8_t flag_protocol,
                                  uint16_t len,
                                  uint8_t *mesh_dst_addr,
                                  uint8_t *mesh_src_addr) {
-	esp_mesh_header_t *mesh_header = calloc(1, sizeof(esp_mesh_header_t)); // FIXME: calloc can return NULL
+	mesh_header->flags = 0;
 
 	set_esp_mesh_header_flag_direction((uint8_t *)&mesh_header->flags, flag_direction);
 	set_esp_mesh_header_flag_p2p((uint8_t *)&mesh_header->flags, flag_p2p);
@@ -1079,6 +1567,4 @@ void *esp_mesh_get_packet_header(uint8_t flag_direction,
 
 	memcpy(&mesh_header->dst_addr, mesh_dst_addr, sizeof(mesh_header->dst_addr));
 	memcpy(&mesh_header->src_addr, mesh_src_addr, sizeof(mesh_header->src_addr));
-
-	return (void *)mesh_header;
 }
@@ -28,16 +28,30 @@
 #include "stack.h"
 #include "daemonlib/packet.h"
 
-#define MAX_MESH_STACKS 64
+// the mesh stack array grows as needed, this is just its initial capacity
+#define MESH_STACKS_INITIAL_CAPACITY 64
+
+// room for 64 TFP packets with mesh header
+#define MESH_STACK_OUTGOING_BUFFER_SIZE (64 * (int)sizeof(pkt_mesh_tfp_t))
+
+// room for 16 TFP packets with mesh header
+#define MESH_STACK_INCOMING_BUFFER_SIZE (16 * sizeof(pkt_mesh_tfp_t))
+
+// read at most this many times per receive event to avoid starving other
+// event sources while a root node keeps sending
+#define MESH_STACK_MAX_READS_PER_EVENT 4
 
 #define MESH_STACK_STATE_WAIT_HELLO 1
 #define MESH_STACK_STATE_OPERATIONAL 2
 
 // In microseconds.
-#define TIME_HB_DO_PING 8000000
+// The heartbeat interval is configured by mesh.heartbeat_interval, the wait
+// pong timeout is half of it.
 #define TIME_WAIT_HELLO 8000000
-#define TIME_HB_WAIT_PONG (TIME_HB_DO_PING/2)
 #define TIME_CLEANUP_AFTER_RESET_SENT 4000000
+// Enumerate requests within this window after a flooded one are answered from
+// the enumerate cache instead of flooding the mesh again.
+#define TIME_ENUMERATE_DEDUP_WINDOW 1000000
 
 #define ESP_MESH_ADDRESS_LEN 6
 
@@ -139,7 +153,18 @@ typedef struct {
 	uint8_t root_node_firmware_version[3];
 	uint8_t gw_addr[ESP_MESH_ADDRESS_LEN];
 	uint8_t root_node_addr[ESP_MESH_ADDRESS_LEN];
-	uint8_t incoming_buffer[sizeof(esp_mesh_header_t) + sizeof(Packet) + 1];
+	esp_mesh_header_t tfp_header; // prebuilt, only len and dst_addr change per request
+	uint64_t last_node_addr; // mesh node of the last TFP packet, already routed to this stack
+	int incoming_buffer_start; // start of the first unparsed packet
+	uint8_t *incoming_packet; // packet currently handled, points into incoming_buffer
+	uint8_t incoming_buffer[MESH_STACK_INCOMING_BUFFER_SIZE];
+	uint8_t *outgoing_buffer; // MESH_STACK_OUTGOING_BUFFER_SIZE bytes
+	int outgoing_used;
+	bool write_pending;
+	uint32_t dropped_packets;
+	uint64_t last_enumerate_at; // when the last enumerate request was flooded
+	uint64_t last_received_at; // when data was last received from the root node
+	Array enumerate_cache; // EnumerateCallback of every device behind this root node
 } MeshStack;
 
 void timer_hb_do_ping_handler(void *opaque);
@@ -148,6 +173,9 @@ void timer_hb_wait_pong_handler(void *opaque);
 void hello_recv_handler(MeshStack *mesh_stack);
 void mesh_stack_destroy(MeshStack *mesh_stack);
 int mesh_stack_create(char *name, Socket *sock);
+int mesh_stack_send(MeshStack *mesh_stack, void *packet);
+void mesh_stack_flush(MeshStack *mesh_stack);
+void mesh_free_routes(void);
 void hb_ping_recv_handler(MeshStack *mesh_stack);
 void hb_pong_recv_handler(MeshStack *mesh_stack);
 void arm_timer_hb_do_ping(MeshStack *mesh_stack);
@@ -162,10 +190,12 @@ void set_esp_mesh_header_flag_p2p(uint8_t *flags, bool val);
 void arm_timer_cleanup_after_reset_sent(MeshStack *mesh_stack);
 void set_esp_mesh_header_flag_protocol(uint8_t *flags, uint8_t val);
 void set_esp_mesh_header_flag_direction(uint8_t *flags, uint8_t val);
-int mesh_stack_dispatch_request(Stack *stack, Packet *request, Recipient *recipient);
+int mesh_stack_dispatch_request(Stack *stack, Packet *request,
+                                Recipient *recipient, Client *client);
 
-// Generate a mesh packet header.
-void *esp_mesh_get_packet_header(uint8_t flag_direction,
+// Initialise a mesh packet header in place.
+void esp_mesh_init_packet_header(esp_mesh_header_t *mesh_header,
+                                 uint8_t flag_direction,
                                  bool flag_p2p,
                                  uint8_t flag_protocol,
                                  uint16_t len,
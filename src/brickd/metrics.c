@@ -0,0 +1,704 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * metrics.c: OpenMetrics endpoint for daemon health and throughput
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * a minimal HTTP/1.0 server that answers every GET request for /metrics with
+ * the current counters in OpenMetrics text format and then closes the
+ * connection. the text is generated on demand, so nothing is collected while
+ * nobody scrapes. connections are handled in the event loop, at most
+ * METRICS_MAX_CONNECTIONS at a time. if all are in use the oldest one is
+ * dropped, so stuck scrapers cannot lock out others
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/config.h>
+#include <daemonlib/event.h>
+#include <daemonlib/log.h>
+#include <daemonlib/node.h>
+#include <daemonlib/socket.h>
+#include <daemonlib/utils.h>
+
+#include "metrics.h"
+
+#ifdef BRICKD_WITH_EVENT_PROFILING
+	#include "event_profile.h"
+#endif
+#include "hardware.h"
+#include "multicast.h"
+#include "network.h"
+#ifdef BRICKD_WITH_RED_BRICK
+	#include "realtime.h"
+	#include "red_rs485_extension.h"
+	#include "red_stack.h"
+#endif
+#include "response_cache.h"
+#include "response_latency.h"
+#include "usb.h"
+#include "usb_stack.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define METRICS_MAX_CONNECTIONS 4
+#define METRICS_MAX_REQUEST_LENGTH 2048
+#define METRICS_INITIAL_RESPONSE_SIZE 8192
+
+typedef struct {
+	Node node;
+	Socket *socket;
+	char request[METRICS_MAX_REQUEST_LENGTH + 1];
+	int request_used;
+	char *response; // NULL until the request is complete
+	int response_used;
+	int response_offset; // bytes already sent
+} MetricsConnection;
+
+typedef struct {
+	char *buffer;
+	int size;
+	int used;
+	bool failed; // out of memory, the text is incomplete
+} MetricsText;
+
+static Socket _server_socket;
+static bool _server_socket_open = false;
+static Node _connection_sentinel;
+static int _connection_count = 0;
+
+static void metrics_text_append(MetricsText *text, const char *format, ...) {
+	va_list arguments;
+	char *buffer;
+	int length;
+
+	while (!text->failed) {
+		va_start(arguments, format);
+		length = vsnprintf(text->buffer + text->used, text->size - text->used, format, arguments);
+		va_end(arguments);
+
+		// MSVC reports truncation as -1 instead of the required length
+		if (length >= 0 && length < text->size - text->used) {
+			text->used += length;
+
+			return;
+		}
+
+		buffer = realloc(text->buffer, text->size * 2);
+
+		if (buffer == NULL) {
+			text->failed = true;
+
+			return;
+		}
+
+		text->buffer = buffer;
+		text->size *= 2;
+	}
+}
+
+// label values need backslash, double quote and newline escaped
+static void metrics_text_append_label(MetricsText *text, const char *value) {
+	char escaped[STACK_MAX_NAME_LENGTH * 2];
+	int used = 0;
+
+	for (; *value != '\0' && used < (int)sizeof(escaped) - 2; ++value) {
+		if (*value == '\\' || *value == '"') {
+			escaped[used++] = '\\';
+			escaped[used++] = *value;
+		} else if (*value == '\n') {
+			escaped[used++] = '\\';
+			escaped[used++] = 'n';
+		} else {
+			escaped[used++] = *value;
+		}
+	}
+
+	escaped[used] = '\0';
+
+	metrics_text_append(text, "\"%s\"", escaped);
+}
+
+static void metrics_text_append_family(MetricsText *text, const char *name,
+                                       const char *type, const char *help) {
+	metrics_text_append(text, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void metrics_format_network(MetricsText *text) {
+	NetworkStatistics statistics;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+	int cache_entry_count;
+	uint32_t multicast_published;
+	uint32_t multicast_dropped;
+	uint32_t usb_memory = 0;
+	int i;
+
+	network_get_statistics(&statistics);
+
+	metrics_text_append_family(text, "brickd_clients", "gauge", "Connected clients.");
+	metrics_text_append(text, "brickd_clients %d\n", statistics.client_count);
+
+	metrics_text_append_family(text, "brickd_zombies", "gauge", "Disconnected clients with pending requests.");
+	metrics_text_append(text, "brickd_zombies %d\n", statistics.zombie_count);
+
+	metrics_text_append_family(text, "brickd_pending_requests", "gauge", "Requests waiting for their response.");
+	metrics_text_append(text, "brickd_pending_requests %d\n", statistics.pending_request_count);
+
+	metrics_text_append_family(text, "brickd_client_queued_responses", "gauge", "Responses queued for slow clients.");
+	metrics_text_append(text, "brickd_client_queued_responses %u\n", statistics.queued_responses);
+
+	metrics_text_append_family(text, "brickd_client_queued_bytes", "gauge", "Bytes queued for slow clients.");
+	metrics_text_append(text, "brickd_client_queued_bytes %u\n", statistics.queued_bytes);
+
+	metrics_text_append_family(text, "brickd_client_dropped_callbacks", "counter", "Callbacks dropped for connected clients with full queues.");
+	metrics_text_append(text, "brickd_client_dropped_callbacks_total %u\n", statistics.dropped_callbacks);
+
+	metrics_text_append_family(text, "brickd_client_decimated_callbacks", "counter", "Callbacks replaced by newer ones due to client callback rate limits.");
+	metrics_text_append(text, "brickd_client_decimated_callbacks_total %u\n", statistics.decimated_callbacks);
+
+	metrics_text_append_family(text, "brickd_coalesced_requests", "counter", "Requests answered by the response to an identical pending request.");
+	metrics_text_append(text, "brickd_coalesced_requests_total %u\n", statistics.coalesced_requests);
+
+	response_cache_get_statistics(&cache_hits, &cache_misses, &cache_entry_count);
+
+	metrics_text_append_family(text, "brickd_response_cache_hits", "counter", "Requests answered from the response cache.");
+	metrics_text_append(text, "brickd_response_cache_hits_total %u\n", cache_hits);
+
+	metrics_text_append_family(text, "brickd_response_cache_misses", "counter", "Cacheable requests dispatched to the device.");
+	metrics_text_append(text, "brickd_response_cache_misses_total %u\n", cache_misses);
+
+	metrics_text_append_family(text, "brickd_response_cache_entries", "gauge", "Responses in the response cache, including ones still being filled.");
+	metrics_text_append(text, "brickd_response_cache_entries %d\n", cache_entry_count);
+
+	multicast_get_statistics(&multicast_published, &multicast_dropped);
+
+	metrics_text_append_family(text, "brickd_multicast_published_callbacks", "counter", "Callbacks sent to the multicast group.");
+	metrics_text_append(text, "brickd_multicast_published_callbacks_total %u\n", multicast_published);
+
+	metrics_text_append_family(text, "brickd_multicast_dropped_callbacks", "counter", "Callbacks that could not be sent to the multicast group.");
+	metrics_text_append(text, "brickd_multicast_dropped_callbacks_total %u\n", multicast_dropped);
+
+	metrics_text_append_family(text, "brickd_event_loop_iterations", "counter", "Event loop iterations.");
+	metrics_text_append(text, "brickd_event_loop_iterations_total %llu\n",
+	                    (unsigned long long)statistics.iterations);
+
+	metrics_text_append_family(text, "brickd_event_loop_cleanup_seconds", "counter", "Time spent flushing and cleaning up at the end of event loop iterations.");
+	metrics_text_append(text, "brickd_event_loop_cleanup_seconds_total %.6f\n",
+	                    (double)statistics.cleanup_time / 1000000.0);
+
+	for (i = 0; i < usb_get_stack_count(); ++i) {
+		usb_memory += usb_stack_get_memory_usage(usb_get_stack(i));
+	}
+
+	metrics_text_append_family(text, "brickd_memory_bytes", "gauge", "Memory currently allocated by the subsystem, approximately.");
+	metrics_text_append(text, "brickd_memory_bytes{subsystem=\"clients\"} %u\n", statistics.client_memory);
+	metrics_text_append(text, "brickd_memory_bytes{subsystem=\"zombies\"} %u\n", statistics.zombie_memory);
+	metrics_text_append(text, "brickd_memory_bytes{subsystem=\"pending_requests\"} %u\n", statistics.pending_request_memory);
+	metrics_text_append(text, "brickd_memory_bytes{subsystem=\"usb_stacks\"} %u\n", usb_memory);
+}
+
+static void metrics_format_stack_latency(MetricsText *text) {
+	int count = hardware_get_stack_count();
+	Stack *stack;
+	uint32_t cumulative;
+	int i;
+	int k;
+
+	metrics_text_append_family(text, "brickd_stack_response_latency_seconds", "histogram",
+	                          "Time from request arrival to response dispatch.");
+
+	for (i = 0; i < count; ++i) {
+		stack = hardware_get_stack(i);
+		cumulative = 0;
+
+		for (k = 0; k < RESPONSE_LATENCY_BUCKETS; ++k) {
+			cumulative += stack->latency_histogram[k];
+
+			metrics_text_append(text, "brickd_stack_response_latency_seconds_bucket{stack=");
+			metrics_text_append_label(text, stack->name);
+
+			if (k < RESPONSE_LATENCY_BUCKETS - 1) {
+				metrics_text_append(text, ",le=\"%g\"} %u\n", 0.0001 * (double)(1 << k), cumulative);
+			} else {
+				metrics_text_append(text, ",le=\"+Inf\"} %u\n", cumulative);
+			}
+		}
+
+		metrics_text_append(text, "brickd_stack_response_latency_seconds_count{stack=");
+		metrics_text_append_label(text, stack->name);
+		metrics_text_append(text, "} %u\n", cumulative);
+	}
+}
+
+static void metrics_format_usb_stacks(MetricsText *text) {
+	static const struct {
+		const char *name;
+		const char *type;
+		const char *help;
+		size_t offset;
+	} counters[] = {
+		{ "brickd_usb_stack_packets_in", "counter", "Valid responses received from the USB device.", offsetof(USBStackStatistics, packets_in) },
+		{ "brickd_usb_stack_packets_out", "counter", "Requests submitted to the USB device.", offsetof(USBStackStatistics, packets_out) },
+		{ "brickd_usb_stack_bytes_in", "counter", "Bytes received from the USB device, wraps around at 2^32.", offsetof(USBStackStatistics, bytes_in) },
+		{ "brickd_usb_stack_bytes_out", "counter", "Bytes submitted to the USB device, wraps around at 2^32.", offsetof(USBStackStatistics, bytes_out) },
+		{ "brickd_usb_stack_peak_queued_writes", "gauge", "Peak length of the USB write queues.", offsetof(USBStackStatistics, peak_queued_writes) },
+		{ "brickd_usb_stack_dropped_requests", "counter", "Requests dropped because the USB write queues were full.", offsetof(USBStackStatistics, dropped_requests) },
+		{ "brickd_usb_stack_submit_failures", "counter", "Failed USB transfer submissions.", offsetof(USBStackStatistics, submit_failures) },
+		{ "brickd_usb_stack_stall_recoveries", "counter", "Recoveries from stalled USB endpoints.", offsetof(USBStackStatistics, stall_recoveries) }
+	};
+	int count = usb_get_stack_count();
+	USBStack *usb_stack;
+	bool is_counter;
+	int i;
+	int k;
+
+	for (i = 0; i < (int)(sizeof(counters) / sizeof(counters[0])); ++i) {
+		is_counter = strcmp(counters[i].type, "counter") == 0;
+
+		metrics_text_append_family(text, counters[i].name, counters[i].type, counters[i].help);
+
+		for (k = 0; k < count; ++k) {
+			usb_stack = usb_get_stack(k);
+
+			metrics_text_append(text, "%s%s{stack=", counters[i].name, is_counter ? "_total" : "");
+			metrics_text_append_label(text, usb_stack->base.name);
+			metrics_text_append(text, "} %u\n",
+			                    *(uint32_t *)((uint8_t *)&usb_stack->statistics + counters[i].offset));
+		}
+	}
+
+	metrics_text_append_family(text, "brickd_usb_stack_memory_bytes", "gauge", "Memory allocated for the USB transfers and write queues.");
+
+	for (k = 0; k < count; ++k) {
+		usb_stack = usb_get_stack(k);
+
+		metrics_text_append(text, "brickd_usb_stack_memory_bytes{stack=");
+		metrics_text_append_label(text, usb_stack->base.name);
+		metrics_text_append(text, "} %u\n", usb_stack_get_memory_usage(usb_stack));
+	}
+}
+
+#ifdef BRICKD_WITH_RED_BRICK
+
+static void metrics_format_spi_stack(MetricsText *text) {
+	int count = red_stack_get_slave_count();
+	REDStackStatistics statistics;
+	int i;
+
+	metrics_text_append_family(text, "brickd_spi_stack_packets_in", "counter", "Valid responses received from the SPI stack slave.");
+
+	for (i = 0; i < count; ++i) {
+		if (red_stack_get_slave_statistics(i, &statistics) >= 0) {
+			metrics_text_append(text, "brickd_spi_stack_packets_in_total{slave=\"%d\"} %u\n", i, statistics.link.packets_in);
+		}
+	}
+
+	metrics_text_append_family(text, "brickd_spi_stack_packets_out", "counter", "Requests acknowledged by the SPI stack slave.");
+
+	for (i = 0; i < count; ++i) {
+		if (red_stack_get_slave_statistics(i, &statistics) >= 0) {
+			metrics_text_append(text, "brickd_spi_stack_packets_out_total{slave=\"%d\"} %u\n", i, statistics.link.packets_out);
+		}
+	}
+
+	metrics_text_append_family(text, "brickd_spi_stack_queued_requests", "gauge", "Requests queued for the SPI stack slave.");
+
+	for (i = 0; i < count; ++i) {
+		if (red_stack_get_slave_statistics(i, &statistics) >= 0) {
+			metrics_text_append(text, "brickd_spi_stack_queued_requests{slave=\"%d\"} %u\n", i, statistics.queued_requests);
+		}
+	}
+}
+
+static void metrics_format_jitter(MetricsText *text, const char *thread, RealtimeJitter *jitter) {
+	uint32_t cumulative = 0;
+	int k;
+
+	for (k = 0; k < REALTIME_JITTER_BUCKETS; ++k) {
+		cumulative += jitter->histogram[k];
+
+		if (k < REALTIME_JITTER_BUCKETS - 1) {
+			metrics_text_append(text, "brickd_wakeup_lateness_seconds_bucket{thread=\"%s\",le=\"%g\"} %u\n",
+			                    thread, 0.00001 * (double)(1 << k), cumulative);
+		} else {
+			metrics_text_append(text, "brickd_wakeup_lateness_seconds_bucket{thread=\"%s\",le=\"+Inf\"} %u\n",
+			                    thread, cumulative);
+		}
+	}
+
+	metrics_text_append(text, "brickd_wakeup_lateness_seconds_sum{thread=\"%s\"} %.6f\n",
+	                    thread, (double)jitter->total_lateness / 1000000.0);
+	metrics_text_append(text, "brickd_wakeup_lateness_seconds_count{thread=\"%s\"} %u\n",
+	                    thread, jitter->wakeups);
+}
+
+// scheduled versus actual wakeup of the SPI thread after its poll delay and
+// of the RS485 master timer, to judge the real-time options
+static void metrics_format_wakeup_lateness(MetricsText *text) {
+	RealtimeJitter spi;
+	RealtimeJitter rs485;
+	bool has_rs485;
+
+	red_stack_get_spi_jitter(&spi);
+
+	has_rs485 = red_rs485_extension_get_master_jitter(&rs485) >= 0;
+
+	metrics_text_append_family(text, "brickd_wakeup_lateness_seconds", "histogram",
+	                          "Time from the scheduled to the actual wakeup.");
+
+	metrics_format_jitter(text, "spi", &spi);
+
+	if (has_rs485) {
+		metrics_format_jitter(text, "rs485_master", &rs485);
+	}
+
+	metrics_text_append_family(text, "brickd_wakeup_max_lateness_seconds", "gauge",
+	                          "Latest wakeup after the scheduled time.");
+
+	metrics_text_append(text, "brickd_wakeup_max_lateness_seconds{thread=\"spi\"} %.6f\n",
+	                    (double)spi.max_lateness / 1000000.0);
+
+	if (has_rs485) {
+		metrics_text_append(text, "brickd_wakeup_max_lateness_seconds{thread=\"rs485_master\"} %.6f\n",
+		                    (double)rs485.max_lateness / 1000000.0);
+	}
+}
+
+#endif
+
+#ifdef BRICKD_WITH_EVENT_PROFILING
+
+static void metrics_format_event_profile(MetricsText *text) {
+	EventProfile *profile;
+
+	metrics_text_append_family(text, "brickd_event_source_calls", "counter", "Calls of the event handler.");
+
+	for (profile = event_profile_get_first(); profile != NULL; profile = profile->next) {
+		metrics_text_append(text, "brickd_event_source_calls_total{source=");
+		metrics_text_append_label(text, profile->name);
+		metrics_text_append(text, "} %u\n", profile->calls);
+	}
+
+	metrics_text_append_family(text, "brickd_event_source_seconds", "counter", "Time spent in the event handler.");
+
+	for (profile = event_profile_get_first(); profile != NULL; profile = profile->next) {
+		metrics_text_append(text, "brickd_event_source_seconds_total{source=");
+		metrics_text_append_label(text, profile->name);
+		metrics_text_append(text, "} %.6f\n", (double)profile->total_time / 1000000.0);
+	}
+
+	metrics_text_append_family(text, "brickd_event_source_max_seconds", "gauge", "Longest single call of the event handler.");
+
+	for (profile = event_profile_get_first(); profile != NULL; profile = profile->next) {
+		metrics_text_append(text, "brickd_event_source_max_seconds{source=");
+		metrics_text_append_label(text, profile->name);
+		metrics_text_append(text, "} %.6f\n", (double)profile->max_time / 1000000.0);
+	}
+}
+
+#endif
+
+// returns NULL if out of memory
+static char *metrics_format_response(bool found, int *length) {
+	MetricsText body;
+	MetricsText response;
+
+	body.buffer = malloc(METRICS_INITIAL_RESPONSE_SIZE);
+	body.size = METRICS_INITIAL_RESPONSE_SIZE;
+	body.used = 0;
+	body.failed = body.buffer == NULL;
+
+	if (found) {
+		metrics_format_network(&body);
+		metrics_format_stack_latency(&body);
+		metrics_format_usb_stacks(&body);
+#ifdef BRICKD_WITH_RED_BRICK
+		metrics_format_spi_stack(&body);
+		metrics_format_wakeup_lateness(&body);
+#endif
+#ifdef BRICKD_WITH_EVENT_PROFILING
+		metrics_format_event_profile(&body);
+#endif
+		metrics_text_append(&body, "# EOF\n");
+	} else {
+		metrics_text_append(&body, "Not Found\n");
+	}
+
+	if (body.failed) {
+		free(body.buffer);
+
+		return NULL;
+	}
+
+	response.buffer = malloc(body.used + 256);
+	response.size = body.used + 256;
+	response.used = 0;
+	response.failed = response.buffer == NULL;
+
+	metrics_text_append(&response,
+	                    "HTTP/1.0 %s\r\n"
+	                    "Content-Type: %s\r\n"
+	                    "Content-Length: %d\r\n"
+	                    "Connection: close\r\n"
+	                    "\r\n",
+	                    found ? "200 OK" : "404 Not Found",
+	                    found ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain",
+	                    body.used);
+
+	// the body can contain percent signs, append it without formatting
+	if (!response.failed && response.size - response.used < body.used) {
+		response.failed = true;
+	}
+
+	if (response.failed) {
+		free(body.buffer);
+		free(response.buffer);
+
+		return NULL;
+	}
+
+	memcpy(response.buffer + response.used, body.buffer, body.used);
+	response.used += body.used;
+
+	free(body.buffer);
+
+	*length = response.used;
+
+	return response.buffer;
+}
+
+static void metrics_destroy_connection(MetricsConnection *connection) {
+	event_remove_source(connection->socket->handle, EVENT_SOURCE_TYPE_GENERIC);
+	socket_destroy(connection->socket);
+	free(connection->socket);
+	free(connection->response);
+
+	node_remove(&connection->node);
+	--_connection_count;
+
+	free(connection);
+}
+
+static void metrics_handle_write(void *opaque) {
+	MetricsConnection *connection = opaque;
+	int length;
+
+	while (connection->response_offset < connection->response_used) {
+		length = socket_send(connection->socket, connection->response + connection->response_offset,
+		                     connection->response_used - connection->response_offset);
+
+		if (length < 0) {
+			if (errno_interrupted()) {
+				continue;
+			}
+
+			if (errno_would_block()) {
+				return;
+			}
+
+			log_debug("Could not send metrics response (socket: %d): %s (%d)",
+			          connection->socket->handle, get_errno_name(errno), errno);
+
+			break;
+		}
+
+		connection->response_offset += length;
+	}
+
+	metrics_destroy_connection(connection);
+}
+
+static void metrics_handle_read(void *opaque) {
+	MetricsConnection *connection = opaque;
+	int length;
+	bool found;
+
+	length = socket_receive(connection->socket, connection->request + connection->request_used,
+	                        METRICS_MAX_REQUEST_LENGTH - connection->request_used);
+
+	if (length < 0) {
+		if (errno_interrupted() || errno_would_block()) {
+			return;
+		}
+
+		log_debug("Could not receive metrics request (socket: %d): %s (%d)",
+		          connection->socket->handle, get_errno_name(errno), errno);
+
+		metrics_destroy_connection(connection);
+
+		return;
+	}
+
+	if (length == 0) {
+		metrics_destroy_connection(connection);
+
+		return;
+	}
+
+	connection->request_used += length;
+	connection->request[connection->request_used] = '\0';
+
+	if (strstr(connection->request, "\r\n\r\n") == NULL &&
+	    strstr(connection->request, "\n\n") == NULL) {
+		if (connection->request_used >= METRICS_MAX_REQUEST_LENGTH) {
+			log_debug("Metrics request (socket: %d) is too long, closing connection",
+			          connection->socket->handle);
+
+			metrics_destroy_connection(connection);
+		}
+
+		return;
+	}
+
+	found = strncmp(connection->request, "GET /metrics ", 13) == 0 ||
+	        strncmp(connection->request, "GET / ", 6) == 0;
+
+	connection->response = metrics_format_response(found, &connection->response_used);
+
+	if (connection->response == NULL) {
+		log_error("Could not format metrics response: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		metrics_destroy_connection(connection);
+
+		return;
+	}
+
+	if (event_modify_source(connection->socket->handle, EVENT_SOURCE_TYPE_GENERIC,
+	                        EVENT_READ, EVENT_WRITE, metrics_handle_write, connection) < 0) {
+		metrics_destroy_connection(connection);
+
+		return;
+	}
+}
+
+static void metrics_handle_accept(void *opaque) {
+	Socket *socket;
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	MetricsConnection *connection;
+
+	(void)opaque;
+
+	socket = socket_accept(&_server_socket, (struct sockaddr *)&address, &length);
+
+	if (socket == NULL) {
+		if (!errno_interrupted()) {
+			log_error("Could not accept new metrics connection: %s (%d)",
+			          get_errno_name(errno), errno);
+		}
+
+		return;
+	}
+
+	if (_connection_count >= METRICS_MAX_CONNECTIONS) {
+		log_debug("Too many metrics connections, dropping the oldest one");
+
+		metrics_destroy_connection(containerof(_connection_sentinel.next, MetricsConnection, node));
+	}
+
+	connection = calloc(1, sizeof(MetricsConnection));
+
+	if (connection == NULL) {
+		log_error("Could not allocate metrics connection: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		goto cleanup;
+	}
+
+	connection->socket = socket;
+
+	if (socket_set_non_blocking(socket, true) < 0) {
+		log_error("Could not enable non-blocking mode for metrics connection: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	if (event_add_source(socket->handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, metrics_handle_read, connection) < 0) {
+		goto cleanup;
+	}
+
+	node_insert_before(&_connection_sentinel, &connection->node);
+	++_connection_count;
+
+	return;
+
+cleanup:
+	free(connection);
+	socket_destroy(socket);
+	free(socket);
+}
+
+int metrics_init(void) {
+	uint16_t port = (uint16_t)config_get_option_value("listen.metrics_port")->integer;
+	const char *address = config_get_option_value("listen.address")->string;
+	bool dual_stack = config_get_option_value("listen.dual_stack")->boolean;
+
+	node_reset(&_connection_sentinel);
+
+	if (port == 0) {
+		log_debug("Metrics endpoint is disabled");
+
+		return 0;
+	}
+
+	log_debug("Initializing metrics subsystem");
+
+	if (socket_open_server(&_server_socket, address, port, dual_stack,
+	                       socket_create_allocated) < 0) {
+		return -1;
+	}
+
+	if (event_add_source(_server_socket.handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, metrics_handle_accept, NULL) < 0) {
+		socket_destroy(&_server_socket);
+
+		return -1;
+	}
+
+	_server_socket_open = true;
+
+	return 0;
+}
+
+void metrics_exit(void) {
+	if (!_server_socket_open) {
+		return;
+	}
+
+	log_debug("Shutting down metrics subsystem");
+
+	while (_connection_sentinel.next != &_connection_sentinel) {
+		metrics_destroy_connection(containerof(_connection_sentinel.next, MetricsConnection, node));
+	}
+
+	event_remove_source(_server_socket.handle, EVENT_SOURCE_TYPE_GENERIC);
+	socket_destroy(&_server_socket);
+
+	_server_socket_open = false;
+}
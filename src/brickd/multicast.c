@@ -0,0 +1,222 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * multicast.c: UDP multicast publisher for callbacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * publishes every callback (sequence number 0) as one UDP datagram to a
+ * multicast group, so any number of read-only listeners can receive them
+ * without a TCP connection each. every datagram starts with a little endian
+ * 32 bit sequence number that is incremented per callback, also for the ones
+ * that could not be sent, so listeners can detect loss. the TFP packet
+ * follows unchanged. nothing is received on the socket
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef _WIN32
+	#include <ws2tcpip.h>
+#else
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <sys/socket.h>
+#endif
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/socket.h>
+#include <daemonlib/utils.h>
+
+#include "multicast.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#include <daemonlib/packed_begin.h>
+
+typedef struct {
+	uint32_t sequence_number;
+	Packet packet;
+} ATTRIBUTE_PACKED MulticastDatagram;
+
+#include <daemonlib/packed_end.h>
+
+static bool _multicast_open = false;
+static Socket _socket;
+static uint32_t _sequence_number = 0;
+static uint32_t _published = 0;
+static uint32_t _dropped = 0;
+static bool _send_error_reported = false;
+
+static int multicast_set_socket_option(int level, int name, int value) {
+	if (setsockopt(_socket.handle, level, name, (const char *)&value, sizeof(value)) < 0) {
+#ifdef _WIN32
+		errno = ERRNO_WINAPI_OFFSET + WSAGetLastError();
+#endif
+
+		return -1;
+	}
+
+	return 0;
+}
+
+int multicast_init(void) {
+	const char *address = config_get_option_value("listen.multicast_address")->string;
+	uint16_t port = (uint16_t)config_get_option_value("listen.multicast_port")->integer;
+	int ttl = config_get_option_value("listen.multicast_ttl")->integer;
+	const char *secret = config_get_option_value("authentication.secret")->string;
+	struct addrinfo *resolved;
+	int rc;
+
+	if (address == NULL || *address == '\0') {
+		log_debug("Multicast publishing is disabled");
+
+		return 0;
+	}
+
+	// the datagrams bypass the authentication handshake of the clients
+	if (secret != NULL && *secret != '\0' &&
+	    !config_get_option_value("listen.multicast_without_authentication")->boolean) {
+		log_error("Refusing to enable callback multicast while authentication is enabled, set listen.multicast_without_authentication to override");
+
+		return 0;
+	}
+
+	log_debug("Initializing multicast subsystem (address: %s, port: %u, ttl: %d)",
+	          address, port, ttl);
+
+	resolved = socket_hostname_to_address(address, port);
+
+	if (resolved == NULL) {
+		log_error("Could not resolve multicast address '%s': %s (%d)",
+		          address, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	if (socket_create(&_socket) < 0) {
+		log_error("Could not create multicast socket: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		freeaddrinfo(resolved);
+
+		return -1;
+	}
+
+	if (socket_open(&_socket, resolved->ai_family, SOCK_DGRAM, IPPROTO_UDP) < 0) {
+		log_error("Could not open multicast socket: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto error;
+	}
+
+	if (resolved->ai_family == AF_INET6) {
+		rc = multicast_set_socket_option(IPPROTO_IPV6, IPV6_MULTICAST_HOPS, ttl);
+	} else {
+		rc = multicast_set_socket_option(IPPROTO_IP, IP_MULTICAST_TTL, ttl);
+	}
+
+	if (rc < 0) {
+		log_error("Could not set multicast TTL to %d: %s (%d)",
+		          ttl, get_errno_name(errno), errno);
+
+		goto error;
+	}
+
+	// a stalled network drops datagrams instead of blocking the event loop
+	if (socket_set_non_blocking(&_socket, true) < 0) {
+		log_error("Could not enable non-blocking mode for multicast socket: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto error;
+	}
+
+	// connecting a UDP socket only sets the destination for socket_send
+	if (socket_connect(&_socket, resolved->ai_addr, (int)resolved->ai_addrlen) < 0) {
+		log_error("Could not set multicast destination to '%s' port %u: %s (%d)",
+		          address, port, get_errno_name(errno), errno);
+
+		goto error;
+	}
+
+	freeaddrinfo(resolved);
+
+	_multicast_open = true;
+
+	return 0;
+
+error:
+	freeaddrinfo(resolved);
+	socket_destroy(&_socket);
+
+	return -1;
+}
+
+void multicast_exit(void) {
+	if (!_multicast_open) {
+		return;
+	}
+
+	log_debug("Shutting down multicast subsystem (published: %u, dropped: %u)",
+	          _published, _dropped);
+
+	socket_destroy(&_socket);
+
+	_multicast_open = false;
+}
+
+void multicast_publish(Packet *callback) {
+	MulticastDatagram datagram;
+	int length;
+
+	if (!_multicast_open) {
+		return;
+	}
+
+	length = (int)offsetof(MulticastDatagram, packet) + callback->header.length;
+
+	datagram.sequence_number = uint32_to_le(_sequence_number++);
+
+	memcpy(&datagram.packet, callback, callback->header.length);
+
+	if (socket_send(&_socket, &datagram, length) < 0) {
+		++_dropped;
+
+		// report the first of a series of errors only, callbacks can arrive
+		// at kHz rates
+		if (!_send_error_reported && !errno_would_block()) {
+			log_warn("Could not send callback to multicast group, dropping it: %s (%d)",
+			         get_errno_name(errno), errno);
+
+			_send_error_reported = true;
+		}
+
+		return;
+	}
+
+	++_published;
+	_send_error_reported = false;
+}
+
+void multicast_get_statistics(uint32_t *published, uint32_t *dropped) {
+	*published = _published;
+	*dropped = _dropped;
+}
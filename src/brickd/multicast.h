@@ -0,0 +1,37 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * multicast.h: UDP multicast publisher for callbacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_MULTICAST_H
+#define BRICKD_MULTICAST_H
+
+#include <stdint.h>
+
+#include <daemonlib/packet.h>
+
+int multicast_init(void);
+void multicast_exit(void);
+
+void multicast_publish(Packet *callback);
+
+void multicast_get_statistics(uint32_t *published, uint32_t *dropped);
+
+#endif // BRICKD_MULTICAST_H
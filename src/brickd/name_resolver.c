@@ -0,0 +1,302 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * name_resolver.c: Background reverse lookup of client addresses
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * a reverse lookup can block for seconds if DNS is slow, so it must not be
+ * done in the event thread. the resolver thread takes jobs from a fixed set
+ * of slots and signals finished jobs through a pipe. the event thread then
+ * reports the results. a job whose opaque is canceled while it's resolved is
+ * dropped once the lookup returns
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef _WIN32
+	#include <netdb.h>
+#endif
+
+#include <daemonlib/event.h>
+#include <daemonlib/log.h>
+#include <daemonlib/pipe.h>
+#include <daemonlib/threads.h>
+#include <daemonlib/utils.h>
+
+#include "name_resolver.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define MAX_NAME_RESOLVER_JOBS 32
+
+typedef enum {
+	NAME_RESOLVER_JOB_STATE_FREE = 0,
+	NAME_RESOLVER_JOB_STATE_QUEUED,
+	NAME_RESOLVER_JOB_STATE_RESOLVING,
+	NAME_RESOLVER_JOB_STATE_DONE
+} NameResolverJobState;
+
+typedef struct {
+	NameResolverJobState state;
+	uint32_t sequence_number; // to resolve jobs in the order they were queued
+	void *opaque; // NULL if canceled while resolving
+	struct sockaddr_storage address;
+	socklen_t length;
+	char hostname[NI_MAXHOST];
+} NameResolverJob;
+
+static NameResolverFunction _function = NULL;
+static NameResolverJob _jobs[MAX_NAME_RESOLVER_JOBS]; // protected by _mutex
+static uint32_t _next_sequence_number = 0; // protected by _mutex
+static bool _running = false; // protected by _mutex
+static Mutex _mutex;
+static Semaphore _queued; // released once per queued job
+static Pipe _done_pipe;
+static Thread _thread;
+
+// must be called with _mutex locked
+static NameResolverJob *name_resolver_find_job(NameResolverJobState state) {
+	NameResolverJob *oldest = NULL;
+	int i;
+
+	for (i = 0; i < MAX_NAME_RESOLVER_JOBS; ++i) {
+		if (_jobs[i].state == state &&
+		    (oldest == NULL ||
+		     (int32_t)(_jobs[i].sequence_number - oldest->sequence_number) < 0)) {
+			oldest = &_jobs[i];
+		}
+	}
+
+	return oldest;
+}
+
+static void name_resolver_thread(void *opaque) {
+	NameResolverJob *job;
+	struct sockaddr_storage address;
+	socklen_t length;
+	char hostname[NI_MAXHOST];
+	int rc;
+	uint8_t byte = 0;
+
+	(void)opaque;
+
+	for (;;) {
+		semaphore_acquire(&_queued);
+
+		mutex_lock(&_mutex);
+
+		if (!_running) {
+			mutex_unlock(&_mutex);
+
+			break;
+		}
+
+		job = name_resolver_find_job(NAME_RESOLVER_JOB_STATE_QUEUED);
+
+		if (job == NULL) { // canceled before it was picked up
+			mutex_unlock(&_mutex);
+
+			continue;
+		}
+
+		job->state = NAME_RESOLVER_JOB_STATE_RESOLVING;
+		memcpy(&address, &job->address, job->length);
+		length = job->length;
+
+		mutex_unlock(&_mutex);
+
+		rc = getnameinfo((struct sockaddr *)&address, length,
+		                 hostname, sizeof(hostname), NULL, 0, NI_NAMEREQD);
+
+		mutex_lock(&_mutex);
+
+		if (rc != 0 || job->opaque == NULL) {
+			job->state = NAME_RESOLVER_JOB_STATE_FREE;
+			job = NULL;
+		} else {
+			job->state = NAME_RESOLVER_JOB_STATE_DONE;
+
+			string_copy(job->hostname, sizeof(job->hostname), hostname, -1);
+		}
+
+		mutex_unlock(&_mutex);
+
+		if (job != NULL && pipe_write(&_done_pipe, &byte, sizeof(byte)) < 0) {
+			log_error("Could not write to name resolver pipe: %s (%d)",
+			          get_errno_name(errno), errno);
+		}
+	}
+}
+
+static void name_resolver_handle_done(void *opaque) {
+	NameResolverJob *job;
+	uint8_t byte;
+	void *job_opaque;
+	char hostname[NI_MAXHOST];
+
+	(void)opaque;
+
+	if (pipe_read(&_done_pipe, &byte, sizeof(byte)) < 0) {
+		log_error("Could not read from name resolver pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	// the function is called without the mutex being locked, because it
+	// might cancel other jobs
+	for (;;) {
+		mutex_lock(&_mutex);
+
+		job = name_resolver_find_job(NAME_RESOLVER_JOB_STATE_DONE);
+
+		if (job == NULL) {
+			mutex_unlock(&_mutex);
+
+			break;
+		}
+
+		job_opaque = job->opaque;
+		job->state = NAME_RESOLVER_JOB_STATE_FREE;
+
+		string_copy(hostname, sizeof(hostname), job->hostname, -1);
+
+		mutex_unlock(&_mutex);
+
+		_function(job_opaque, hostname);
+	}
+}
+
+int name_resolver_init(NameResolverFunction function) {
+	log_debug("Initializing name resolver subsystem");
+
+	_function = function;
+
+	memset(_jobs, 0, sizeof(_jobs));
+
+	if (pipe_create(&_done_pipe, 0) < 0) {
+		log_error("Could not create name resolver pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	if (event_add_source(_done_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, name_resolver_handle_done, NULL) < 0) {
+		pipe_destroy(&_done_pipe);
+
+		return -1;
+	}
+
+	if (semaphore_create(&_queued) < 0) {
+		log_error("Could not create name resolver semaphore: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		event_remove_source(_done_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+		pipe_destroy(&_done_pipe);
+
+		return -1;
+	}
+
+	mutex_create(&_mutex);
+
+	_running = true;
+
+	thread_create(&_thread, name_resolver_thread, NULL);
+
+	return 0;
+}
+
+// waits for a lookup that is still in progress
+void name_resolver_exit(void) {
+	log_debug("Shutting down name resolver subsystem");
+
+	mutex_lock(&_mutex);
+	_running = false;
+	mutex_unlock(&_mutex);
+
+	semaphore_release(&_queued);
+
+	thread_join(&_thread);
+	thread_destroy(&_thread);
+
+	mutex_destroy(&_mutex);
+	semaphore_destroy(&_queued);
+
+	event_remove_source(_done_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&_done_pipe);
+}
+
+// sets errno on error
+int name_resolver_resolve(struct sockaddr *address, socklen_t length, void *opaque) {
+	NameResolverJob *job;
+
+	if (length > (socklen_t)sizeof(job->address)) {
+		errno = EINVAL;
+
+		return -1;
+	}
+
+	mutex_lock(&_mutex);
+
+	job = name_resolver_find_job(NAME_RESOLVER_JOB_STATE_FREE);
+
+	if (job == NULL) {
+		mutex_unlock(&_mutex);
+
+		errno = ENOSPC;
+
+		return -1;
+	}
+
+	job->state = NAME_RESOLVER_JOB_STATE_QUEUED;
+	job->sequence_number = _next_sequence_number++;
+	job->opaque = opaque;
+	job->length = length;
+
+	memcpy(&job->address, address, length);
+
+	mutex_unlock(&_mutex);
+
+	semaphore_release(&_queued);
+
+	return 0;
+}
+
+// after this call the function will not be called for the opaque anymore
+void name_resolver_cancel(void *opaque) {
+	int i;
+
+	mutex_lock(&_mutex);
+
+	for (i = 0; i < MAX_NAME_RESOLVER_JOBS; ++i) {
+		if (_jobs[i].state == NAME_RESOLVER_JOB_STATE_FREE || _jobs[i].opaque != opaque) {
+			continue;
+		}
+
+		if (_jobs[i].state == NAME_RESOLVER_JOB_STATE_RESOLVING) {
+			_jobs[i].opaque = NULL;
+		} else {
+			_jobs[i].state = NAME_RESOLVER_JOB_STATE_FREE;
+		}
+	}
+
+	mutex_unlock(&_mutex);
+}
@@ -0,0 +1,36 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * name_resolver.h: Background reverse lookup of client addresses
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_NAME_RESOLVER_H
+#define BRICKD_NAME_RESOLVER_H
+
+#include <daemonlib/socket.h>
+
+// called in the event thread with the resolved hostname
+typedef void (*NameResolverFunction)(void *opaque, const char *hostname);
+
+int name_resolver_init(NameResolverFunction function);
+void name_resolver_exit(void);
+
+int name_resolver_resolve(struct sockaddr *address, socklen_t length, void *opaque);
+void name_resolver_cancel(void *opaque);
+
+#endif // BRICKD_NAME_RESOLVER_H
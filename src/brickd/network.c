@@ -27,6 +27,8 @@
 #include <string.h>
 #ifndef _WIN32
 	#include <netdb.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
 	#include <unistd.h>
 #endif
 
@@ -38,35 +40,479 @@
 #include <daemonlib/node.h>
 #include <daemonlib/packet.h>
 #include <daemonlib/socket.h>
+#include <daemonlib/timer.h>
 #include <daemonlib/utils.h>
 
 #include "network.h"
 
+#include "enumerate_cache.h"
+#include "event_profile.h"
+#include "hardware.h"
 #include "hmac.h"
+#ifdef BRICKD_WITH_IO_THREADS
+	#include "io_worker.h"
+#endif
+#include "metrics.h"
+#include "multicast.h"
+#include "name_resolver.h"
+#include "packet_capture.h"
+#include "packet_debug.h"
+#include "packet_log.h"
+#include "response_cache.h"
+#include "response_latency.h"
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	#include "socket_activation.h"
+#endif
 #include "websocket.h"
 #include "zombie.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
-static Array _clients;
-static Array _zombies;
+// the pending request index maps (uid, function ID, sequence number) to a
+// bucket list of pending requests. new pending requests are appended to the
+// end of their bucket list. therefore, the first matching pending request in
+// a bucket list is also the oldest matching one in the global list
+#define PENDING_REQUEST_INDEX_BITS 10
+#define PENDING_REQUEST_INDEX_SIZE (1 << PENDING_REQUEST_INDEX_BITS)
+
+// if request coalescing is enabled then every request to a getter listed in
+// response_cache.functions gets a coalesced request. the protocol does not
+// mark getters and coalescing a setter would execute it only once. an
+// identical request (same UID, function ID and payload) of any client that
+// arrives while the first one is still pending is not dispatched again. it
+// waits for the response to the first one instead and gets a copy of it with
+// its own sequence number. waiting pending requests are linked into the waiter
+// list of the coalesced request by their index_node, not into the pending
+// request index, because no device response carries their sequence number
+#define COALESCED_REQUEST_INDEX_BITS 10
+#define COALESCED_REQUEST_INDEX_SIZE (1 << COALESCED_REQUEST_INDEX_BITS)
+
+struct _CoalescedRequest {
+	Node index_node; // bucket list of the coalesced request index
+	Node waiter_sentinel;
+	Node redispatch_node; // in the redispatch list, if redispatch_scheduled
+	bool redispatch_scheduled;
+	PendingRequest *leader; // the pending request of the dispatched request
+	uint32_t hash;
+	Packet request; // only the header and the payload are valid
+};
+
+// clients and zombies are allocated individually and linked into lists. the
+// structs are not relocatable, because pointers to them are passed as opaque
+// parameters to the event and timer subsystems. clients and zombies that are
+// done get queued in removal lists. this way cleanup only costs O(removed)
+static Node _client_sentinel;
+static int _client_count = 0;
+static Node _client_removal_sentinel;
+static Node _client_flush_sentinel;
+static Node _zombie_sentinel;
+static int _zombie_count = 0;
+static Node _zombie_removal_sentinel;
+// all zombies share one timer. the zombie list is kept sorted by deadline, so
+// the timer only has to fire for the first zombie that is not finished yet.
+// most zombies get the same timeout and are simply appended, only resumable
+// zombies with their longer session timeout have to be sorted in
+static Timer _zombie_timer;
+static bool _zombie_timer_armed = false;
 static Socket _plain_server_socket;
 static bool _plain_server_socket_open = false;
 static Socket _websocket_server_socket;
 static bool _websocket_server_socket_open = false;
+#ifndef _WIN32
+static Socket _unix_server_socket;
+static bool _unix_server_socket_open = false;
+static bool _unix_server_socket_inherited = false; // the socket file belongs to systemd
+static Socket _unix_seqpacket_server_socket; // one TFP packet per message
+static bool _unix_seqpacket_server_socket_open = false;
+static bool _unix_seqpacket_server_socket_inherited = false;
+#endif
 static uint32_t _next_authentication_nonce = 0;
+static bool _authentication_enabled = false;
+static HMACSHA1Key _authentication_key;
 static Node _pending_request_sentinel;
+static Node _pending_request_index[PENDING_REQUEST_INDEX_SIZE];
+static bool _request_coalescing = false;
+static Node _coalesced_request_index[COALESCED_REQUEST_INDEX_SIZE];
+static uint32_t _coalesced_requests = 0;
+static Node _coalesced_request_redispatch_sentinel;
+// admission control is checked right after accept, before a client is created
+// for the new connection. accepts are rate limited by a token bucket, its
+// tokens are counted in millionths so that it can be refilled per microsecond
+static int _max_clients = 0; // 0 means unlimited
+static int _max_clients_per_address = 0; // 0 means unlimited
+static uint64_t _accept_rate = 0; // accepts per second, 0 means unlimited
+static uint64_t _accept_tokens_max = 0;
+static uint64_t _accept_tokens = 0;
+static uint64_t _accept_tokens_refilled_at = 0;
+static bool _accept_rejecting = false;
+static bool _resolve_client_names = false;
+static uint64_t _iterations = 0;
+static uint64_t _cleanup_time = 0; // microseconds
+
+static Node *network_get_pending_request_bucket(PacketHeader *header) {
+	uint32_t hash = header->uid ^
+	                ((uint32_t)header->function_id << 16) ^
+	                ((uint32_t)packet_header_get_sequence_number(header) << 24);
+
+	// multiplicative hashing, use the upper bits as they are mixed best
+	hash *= 2654435761u;
+
+	return &_pending_request_index[hash >> (32 - PENDING_REQUEST_INDEX_BITS)];
+}
+
+// FNV-1a over everything but the sequence number and the options
+static uint32_t network_get_coalesced_request_hash(Packet *request) {
+	uint8_t *payload = (uint8_t *)request + sizeof(PacketHeader);
+	int length = request->header.length - (int)sizeof(PacketHeader);
+	uint32_t hash = 2166136261u;
+	int i;
+
+	hash = (hash ^ request->header.uid) * 16777619u;
+	hash = (hash ^ request->header.function_id) * 16777619u;
+	hash = (hash ^ request->header.length) * 16777619u;
+
+	for (i = 0; i < length; ++i) {
+		hash = (hash ^ payload[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static bool network_is_coalesced_request_matching(CoalescedRequest *coalesced_request,
+                                                  Packet *request, uint32_t hash) {
+	return coalesced_request->hash == hash &&
+	       coalesced_request->request.header.uid == request->header.uid &&
+	       coalesced_request->request.header.function_id == request->header.function_id &&
+	       coalesced_request->request.header.length == request->header.length &&
+	       memcmp((uint8_t *)&coalesced_request->request + sizeof(PacketHeader),
+	              (uint8_t *)request + sizeof(PacketHeader),
+	              request->header.length - sizeof(PacketHeader)) == 0;
+}
+
+// returns true if the request does not have to be dispatched, because the
+// response to an identical pending request is delivered for it as well.
+// otherwise the pending request becomes the leader of a new coalesced request
+bool network_coalesce_request(PendingRequest *pending_request, Packet *request) {
+	uint32_t hash;
+	Node *bucket;
+	Node *node;
+	CoalescedRequest *coalesced_request;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+
+	// broadcasts are answered by every device
+	if (!_request_coalescing || request->header.uid == 0 ||
+	    !response_cache_is_getter(request)) {
+		return false;
+	}
+
+	hash = network_get_coalesced_request_hash(request);
+	bucket = &_coalesced_request_index[hash >> (32 - COALESCED_REQUEST_INDEX_BITS)];
+
+	for (node = bucket->next; node != bucket; node = node->next) {
+		coalesced_request = containerof(node, CoalescedRequest, index_node);
+
+		if (network_is_coalesced_request_matching(coalesced_request, request, hash)) {
+			node_remove(&pending_request->index_node);
+			node_insert_before(&coalesced_request->waiter_sentinel, &pending_request->index_node);
+
+			pending_request->coalesced_request = coalesced_request;
+
+			++_coalesced_requests;
+
+			log_packet_debug_checked("Coalesced request (%s) with identical pending request",
+			                         packet_get_request_signature(packet_signature, request));
+
+			return true;
+		}
+	}
+
+	coalesced_request = malloc(sizeof(CoalescedRequest));
+
+	if (coalesced_request == NULL) {
+		// not coalescing is always correct, just dispatch the request
+		return false;
+	}
+
+	node_reset(&coalesced_request->waiter_sentinel);
+
+	coalesced_request->redispatch_scheduled = false;
+	coalesced_request->leader = pending_request;
+	coalesced_request->hash = hash;
+
+	memcpy(&coalesced_request->request, request, request->header.length);
+
+	node_insert_before(bucket, &coalesced_request->index_node);
+
+	pending_request->coalesced_request = coalesced_request;
+
+	return false;
+}
+
+// called before a coalesced pending request is freed. if the leader is freed
+// without a response (for example because its client was evicted or its
+// request was canceled) then the waiters cannot get a response through it
+// anymore. the first waiter becomes the new leader and its request is
+// dispatched at the end of the event loop iteration. not now, because the
+// caller might be iterating the pending requests
+void network_release_coalesced_request(PendingRequest *pending_request) {
+	CoalescedRequest *coalesced_request = pending_request->coalesced_request;
+	PendingRequest *waiter;
+
+	pending_request->coalesced_request = NULL;
+
+	if (coalesced_request->leader != pending_request) {
+		return; // the caller removes the waiter from the waiter list
+	}
+
+	if (coalesced_request->waiter_sentinel.next == &coalesced_request->waiter_sentinel) {
+		if (coalesced_request->redispatch_scheduled) {
+			node_remove(&coalesced_request->redispatch_node);
+		}
+
+		node_remove(&coalesced_request->index_node);
+		free(coalesced_request);
+
+		return;
+	}
+
+	waiter = containerof(coalesced_request->waiter_sentinel.next, PendingRequest, index_node);
+
+	node_remove(&waiter->index_node);
+	node_insert_before(network_get_pending_request_bucket(&waiter->header),
+	                   &waiter->index_node);
+
+	coalesced_request->leader = waiter;
+
+	if (!coalesced_request->redispatch_scheduled) {
+		coalesced_request->redispatch_scheduled = true;
+
+		node_insert_before(&_coalesced_request_redispatch_sentinel,
+		                   &coalesced_request->redispatch_node);
+	}
+}
+
+// dispatches the requests of leaders that took over from a leader that was
+// freed without a response
+static void network_redispatch_coalesced_requests(void) {
+	CoalescedRequest *coalesced_request;
+	Packet request;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+
+	while (_coalesced_request_redispatch_sentinel.next != &_coalesced_request_redispatch_sentinel) {
+		coalesced_request = containerof(_coalesced_request_redispatch_sentinel.next,
+		                                CoalescedRequest, redispatch_node);
+
+		node_remove(&coalesced_request->redispatch_node);
+		coalesced_request->redispatch_scheduled = false;
+
+		memcpy(&request, &coalesced_request->request, coalesced_request->request.header.length);
+		memcpy(&request.header, &coalesced_request->leader->header, sizeof(PacketHeader));
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+		request.trace_id = packet_get_next_request_trace_id();
+#endif
+
+		log_packet_debug_checked("Redispatching coalesced request (%s), its first request got no response",
+		                         packet_get_request_signature(packet_signature, &request));
+
+		packet_add_trace(&request);
+		hardware_dispatch_request(&request, coalesced_request->leader->client);
+	}
+}
+
+// delivers a copy of the response to every waiter, with the sequence number
+// of the waiting request
+static void network_dispatch_coalesced_response(CoalescedRequest *coalesced_request,
+                                                Packet *response) {
+	PendingRequest *waiter;
+	Packet copy;
+
+	while (coalesced_request->waiter_sentinel.next != &coalesced_request->waiter_sentinel) {
+		waiter = containerof(coalesced_request->waiter_sentinel.next, PendingRequest, index_node);
+
+		memcpy(&copy, response, response->header.length);
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+		copy.trace_id = response->trace_id;
+#endif
+
+		packet_header_set_sequence_number(&copy.header,
+		                                  packet_header_get_sequence_number(&waiter->header));
+
+		// both remove the waiter from the waiter list
+		if (waiter->client != NULL) {
+			client_dispatch_response(waiter->client, waiter, &copy, false, false);
+		} else {
+			zombie_dispatch_response(waiter->zombie, waiter, &copy);
+		}
+	}
+}
+
+// find the oldest pending request matching the response. if a client is given
+// then only pending requests of this client are considered
+PendingRequest *network_find_pending_request(Packet *response, Client *client) {
+	Node *bucket = network_get_pending_request_bucket(&response->header);
+	Node *pending_request_index_node = bucket->next;
+	PendingRequest *pending_request;
+
+	while (pending_request_index_node != bucket) {
+		pending_request = containerof(pending_request_index_node,
+		                              PendingRequest, index_node);
+
+		if ((client == NULL || pending_request->client == client) &&
+		    packet_is_matching_response(response, &pending_request->header)) {
+			return pending_request;
+		}
+
+		pending_request_index_node = pending_request_index_node->next;
+	}
+
+	return NULL;
+}
+
+// batching WebSocket clients get all responses of an event loop iteration in
+// one frame. without a configured coalescing delay the coalescing buffer is
+// only flushed at the end of the iteration
+static void network_enable_websocket_batching(void *opaque) {
+	Client *client = opaque;
+	uint64_t delay = config_get_option_value("listen.response_coalescing_delay")->integer;
+
+	if (delay == 0) {
+		delay = UINT64_MAX;
+	}
+
+	if (client_enable_response_coalescing(client, delay) < 0) {
+		client_mark_as_disconnected(client);
+	}
+}
+
+// formats the address and port numerically. this never does a DNS lookup,
+// because the caller is in the event thread. returns -1 on error
+int network_format_address(struct sockaddr *address, socklen_t length,
+                           char *buffer, int buffer_length) {
+	char hostname[NI_MAXHOST];
+	char port[NI_MAXSERV];
+
+	if (getnameinfo(address, length, hostname, sizeof(hostname),
+	                port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+		return -1;
+	}
+
+	if (address->sa_family == AF_INET6) {
+		snprintf(buffer, buffer_length, "[%s]:%s", hostname, port);
+	} else {
+		snprintf(buffer, buffer_length, "%s:%s", hostname, port);
+	}
+
+	return 0;
+}
+
+// the hostname is only used for display purpose, the numeric address that
+// was used as name so far is kept next to it. a long hostname is cut short
+// to keep the numeric address complete
+static void network_handle_resolved_name(void *opaque, const char *hostname) {
+	Client *client = opaque;
+	char name[CLIENT_MAX_NAME_LENGTH - 4]; // room for " ()" and at least one character of the hostname
+	int hostname_length;
+
+	string_copy(name, sizeof(name), client->name, -1);
+
+	hostname_length = (int)sizeof(client->name) - 4 - (int)strlen(name);
+
+	snprintf(client->name, sizeof(client->name), "%.*s (%s)", hostname_length, hostname, name);
+
+	log_debug("Resolved name of client (N: %s) to %s", name, hostname);
+}
+
+// returns false if the address has an unexpected family
+static bool network_get_peer_address(struct sockaddr_storage *address,
+                                     uint8_t peer_address[16]) {
+	if (address->ss_family == AF_INET6) {
+		memcpy(peer_address, &((struct sockaddr_in6 *)address)->sin6_addr, 16);
+
+		return true;
+	}
+
+	if (address->ss_family == AF_INET) {
+		// map to ::ffff:a.b.c.d, so that dual-stack and IPv4-only connections
+		// from the same host are counted together
+		memset(peer_address, 0, 10);
+		memset(peer_address + 10, 0xFF, 2);
+		memcpy(peer_address + 12, &((struct sockaddr_in *)address)->sin_addr, 4);
+
+		return true;
+	}
+
+	return false;
+}
+
+static bool network_take_accept_token(void) {
+	uint64_t now;
+
+	if (_accept_rate == 0) {
+		return true;
+	}
+
+	now = microseconds();
+
+	_accept_tokens += (now - _accept_tokens_refilled_at) * _accept_rate;
+	_accept_tokens_refilled_at = now;
+
+	if (_accept_tokens > _accept_tokens_max) {
+		_accept_tokens = _accept_tokens_max;
+	}
+
+	if (_accept_tokens < 1000000) {
+		return false;
+	}
+
+	_accept_tokens -= 1000000;
+
+	return true;
+}
+
+// returns the reason if the connection has to be rejected, NULL otherwise
+static const char *network_check_admission(bool address_known,
+                                           uint8_t peer_address[16]) {
+	Node *client_node;
+	Client *client;
+	int count = 0;
+
+	if (_max_clients > 0 && _client_count >= _max_clients) {
+		return "too many clients";
+	}
+
+	if (_max_clients_per_address > 0 && address_known) {
+		for (client_node = _client_sentinel.next; client_node != &_client_sentinel;
+		     client_node = client_node->next) {
+			client = containerof(client_node, Client, network_node);
+
+			if (client->address_known &&
+			    memcmp(client->address, peer_address, sizeof(client->address)) == 0 &&
+			    ++count >= _max_clients_per_address) {
+				return "too many clients from this address";
+			}
+		}
+	}
+
+	if (!network_take_accept_token()) {
+		return "accept rate limit exceeded";
+	}
+
+	return NULL;
+}
 
 static void network_handle_accept(void *opaque) {
 	Socket *server_socket = opaque;
 	Socket *client_socket;
+	IO *io;
 	struct sockaddr_storage address;
 	socklen_t length = sizeof(address);
-	char hostname[NI_MAXHOST];
-	char port[NI_MAXSERV];
-	char buffer[NI_MAXHOST + NI_MAXSERV + 4]; // 4 == strlen("[]:") + 1
+	char buffer[NETWORK_MAX_ADDRESS_LENGTH];
 	char *name = "<unknown>";
 	Client *client;
+	uint64_t coalescing_delay = config_get_option_value("listen.response_coalescing_delay")->integer;
+	uint8_t peer_address[16];
+	bool address_known;
+	const char *rejection;
 
 	// accept new client socket
 	client_socket = socket_accept(server_socket, (struct sockaddr *)&address, &length);
@@ -80,61 +526,317 @@ static void network_handle_accept(void *opaque) {
 		return;
 	}
 
-	if (socket_address_to_hostname((struct sockaddr *)&address, length,
-	                               hostname, sizeof(hostname),
-	                               port, sizeof(port)) < 0) {
-		log_warn("Could not get hostname and port of client (socket: %d): %s (%d)",
-		         client_socket->handle, get_errno_name(errno), errno);
-	} else {
-		if (address.ss_family == AF_INET6) {
-			snprintf(buffer, sizeof(buffer), "[%s]:%s", hostname, port);
+	// check admission before spending anything on the new connection. only
+	// warn for the first rejection in a row, a reconnect loop would flood the
+	// log otherwise
+	address_known = network_get_peer_address(&address, peer_address);
+	rejection = network_check_admission(address_known, peer_address);
+
+	if (rejection != NULL) {
+		if (!_accept_rejecting) {
+			log_warn("Rejecting new client connection (socket: %d): %s",
+			         client_socket->handle, rejection);
+
+			_accept_rejecting = true;
 		} else {
-			snprintf(buffer, sizeof(buffer), "%s:%s", hostname, port);
+			log_debug("Rejecting new client connection (socket: %d): %s",
+			          client_socket->handle, rejection);
 		}
 
+		socket_destroy(client_socket);
+		free(client_socket);
+
+		return;
+	}
+
+	_accept_rejecting = false;
+
+#ifndef _WIN32
+	if (address.ss_family == AF_UNIX) {
+		// local peers are unnamed, tell them apart by their socket instead
+		snprintf(buffer, sizeof(buffer), "unix:%d", client_socket->handle);
+
+		name = buffer;
+	} else
+#endif
+	if (network_format_address((struct sockaddr *)&address, length,
+	                           buffer, sizeof(buffer)) < 0) {
+		log_warn("Could not format address of client (socket: %d)",
+		         client_socket->handle);
+	} else {
 		name = buffer;
 	}
 
+	io = &client_socket->base;
+
+#ifdef BRICKD_WITH_IO_THREADS
+	if (io_worker_is_enabled()) {
+		io = io_worker_wrap(io);
+
+		if (io == NULL) {
+			socket_destroy(client_socket);
+			free(client_socket);
+
+			return;
+		}
+	}
+#endif
+
 	// create new client
-	client = network_create_client(name, &client_socket->base);
+	client = network_create_client(name, io);
 
 	if (client == NULL) {
-		socket_destroy(client_socket);
-		free(client_socket);
+		io_destroy(io);
+		free(io);
+
+		return;
+	}
+
+	if (address_known) {
+		client->address_known = true;
+		memcpy(client->address, peer_address, sizeof(client->address));
+	}
+
+	if (_resolve_client_names &&
+	    name_resolver_resolve((struct sockaddr *)&address, length, client) < 0) {
+		log_debug("Could not queue name lookup for client ("CLIENT_SIGNATURE_FORMAT"): %s (%d)",
+		          client_expand_signature(client), get_errno_name(errno), errno);
+	}
+
+	// WebSocket clients expect one packet per frame, unless they negotiate
+	// batching during the initial handshake. the same applies to messages of
+	// seqpacket clients. therefore, only enable response coalescing for plain
+	// and UNIX domain stream clients here
+	client->byte_stream = server_socket == &_plain_server_socket;
+#ifndef _WIN32
+	client->byte_stream = client->byte_stream || server_socket == &_unix_server_socket;
+#endif
+
+	if (client->byte_stream && coalescing_delay > 0 &&
+	    client_enable_response_coalescing(client, coalescing_delay) < 0) {
+		client_mark_as_disconnected(client);
+
+		return;
+	}
+
+	if (server_socket == &_websocket_server_socket) {
+#ifdef BRICKD_WITH_IO_THREADS
+		if (io_worker_is_wrapped(io)) {
+			io_worker_set_batching_function(io, network_enable_websocket_batching, client);
+		} else {
+			websocket_set_batching_function((Websocket *)client_socket,
+			                                network_enable_websocket_batching, client);
+
+			client->websocket = (Websocket *)client_socket;
+		}
+#else
+		websocket_set_batching_function((Websocket *)client_socket,
+		                                network_enable_websocket_batching, client);
+
+		client->websocket = (Websocket *)client_socket;
+#endif
+	}
+
+#ifdef BRICKD_WITH_IO_THREADS
+	// the socket belongs to the worker from here on
+	if (io_worker_is_wrapped(io) && io_worker_start(io) < 0) {
+		log_error("Could not hand client ("CLIENT_SIGNATURE_FORMAT") to an I/O worker, disconnecting client: %s (%d)",
+		          client_expand_signature(client), get_errno_name(errno), errno);
+
+		client_mark_as_disconnected(client);
 
 		return;
 	}
+#endif
 
 #ifdef BRICKD_WITH_RED_BRICK
 	client_send_red_brick_enumerate(client, ENUMERATION_TYPE_CONNECTED);
 #endif
 }
 
+EVENT_PROFILE_HANDLER(network_handle_accept, "network-accept")
+
 static int network_open_server_socket(Socket *socket, uint16_t port,
                                       SocketCreateAllocatedFunction create_allocated) {
 	const char *address = config_get_option_value("listen.address")->string;
 	bool dual_stack = config_get_option_value("listen.dual_stack")->boolean;
+	int rc = 0;
+
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	rc = socket_activation_adopt_tcp(socket, port, create_allocated);
 
-	if (socket_open_server(socket, address, port, dual_stack, create_allocated) < 0) {
+	if (rc < 0) {
+		return -1;
+	}
+#endif
+
+	if (rc == 0 && socket_open_server(socket, address, port, dual_stack, create_allocated) < 0) {
 		return -1;
 	}
 
 	if (event_add_source(socket->handle, EVENT_SOURCE_TYPE_GENERIC,
-	                     EVENT_READ, network_handle_accept, socket) < 0) {
+	                     EVENT_READ, EVENT_PROFILED(network_handle_accept), socket) < 0) {
+		socket_destroy(socket);
+
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifndef _WIN32
+
+// local clients can skip the TCP loopback overhead by connecting to a socket
+// file instead. a stale socket file left behind by a previous brickd run is
+// replaced, other files are not touched. a socket passed in by systemd is
+// used as is, its socket file is left to systemd
+static int network_open_local_server_socket(Socket *socket, const char *path, int type,
+                                            bool *inherited) {
+	const char *type_name = type == SOCK_SEQPACKET ? "seqpacket" : "stream";
+	struct sockaddr_un address;
+	struct stat st;
+
+	*inherited = false;
+
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+	switch (socket_activation_adopt_unix(socket, path, socket_create_allocated)) {
+	case -1:
+		return -1;
+
+	case 1:
+		*inherited = true;
+
+		goto add_source;
+
+	default:
+		break;
+	}
+#endif
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		log_error("UNIX domain socket path '%s' is too long", path);
+
+		return -1;
+	}
+
+	if (socket_create(socket) < 0) {
+		log_error("Could not create UNIX domain %s socket: %s (%d)",
+		          type_name, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	if (socket_open(socket, AF_UNIX, type, 0) < 0) {
+		log_error("Could not open UNIX domain %s socket: %s (%d)",
+		          type_name, get_errno_name(errno), errno);
+
 		socket_destroy(socket);
 
 		return -1;
 	}
 
-	return 0;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) && unlink(path) < 0) {
+		log_warn("Could not remove stale UNIX domain socket file '%s': %s (%d)",
+		         path, get_errno_name(errno), errno);
+	}
+
+	memset(&address, 0, sizeof(address));
+
+	address.sun_family = AF_UNIX;
+	string_copy(address.sun_path, sizeof(address.sun_path), path, -1);
+
+	if (socket_bind(socket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		log_error("Could not bind UNIX domain %s socket to '%s': %s (%d)",
+		          type_name, path, get_errno_name(errno), errno);
+
+		socket_destroy(socket);
+
+		return -1;
+	}
+
+	if (socket_listen(socket, 10, socket_create_allocated) < 0) {
+		log_error("Could not listen to UNIX domain %s socket '%s': %s (%d)",
+		          type_name, path, get_errno_name(errno), errno);
+
+		goto error;
+	}
+
+#ifdef BRICKD_WITH_SOCKET_ACTIVATION
+add_source:
+#endif
+	if (event_add_source(socket->handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, EVENT_PROFILED(network_handle_accept), socket) < 0) {
+		goto error;
+	}
+
+	log_info("Listening on UNIX domain %s socket '%s'", type_name, path);
+
+	return 0;
+
+error:
+	socket_destroy(socket);
+
+	if (!*inherited) {
+		unlink(path);
+	}
+
+	return -1;
+}
+
+static void network_close_local_server_socket(Socket *socket, const char *path,
+                                              bool inherited) {
+	event_remove_source(socket->handle, EVENT_SOURCE_TYPE_GENERIC);
+	socket_destroy(socket);
+
+	if (!inherited && unlink(path) < 0 && errno != ENOENT) {
+		log_warn("Could not remove UNIX domain socket file '%s': %s (%d)",
+		         path, get_errno_name(errno), errno);
+	}
+}
+
+#endif
+
+// drop all pending requests for the given UID from the global list
+static void network_drop_pending_requests(uint32_t uid) {
+	Node *pending_request_global_node = _pending_request_sentinel.next;
+	Node *pending_request_global_node_next;
+	PendingRequest *pending_request;
+	char base58[BASE58_MAX_LENGTH];
+	int count = 0;
+
+	while (pending_request_global_node != &_pending_request_sentinel) {
+		pending_request = containerof(pending_request_global_node,
+		                              PendingRequest, global_node);
+		pending_request_global_node_next = pending_request_global_node->next;
+
+		if (pending_request->header.uid == uid) {
+			pending_request_remove_and_free(pending_request);
+
+			++count;
+		}
+
+		pending_request_global_node = pending_request_global_node_next;
+	}
+
+	if (count > 0) {
+		log_warn("Dropped %d pending request(s) (uid: %s)",
+		         count, base58_encode(base58, uint32_from_le(uid)));
+	}
+}
+
+static int network_compare_uids(const void *a, const void *b) {
+	uint32_t uid_a = *(const uint32_t *)a;
+	uint32_t uid_b = *(const uint32_t *)b;
+
+	return uid_a < uid_b ? -1 : (uid_a > uid_b ? 1 : 0);
 }
 
-// drop all pending requests for the given UID from the global list
-static void network_drop_pending_requests(uint32_t uid) {
+// drop all pending requests for the given sorted UIDs in one pass over the
+// global list, instead of one pass per UID
+static void network_drop_pending_requests_of_uids(uint32_t *uids, int uid_count) {
 	Node *pending_request_global_node = _pending_request_sentinel.next;
 	Node *pending_request_global_node_next;
 	PendingRequest *pending_request;
-	char base58[BASE58_MAX_LENGTH];
 	int count = 0;
 
 	while (pending_request_global_node != &_pending_request_sentinel) {
@@ -142,7 +844,8 @@ static void network_drop_pending_requests(uint32_t uid) {
 		                              PendingRequest, global_node);
 		pending_request_global_node_next = pending_request_global_node->next;
 
-		if (pending_request->header.uid == uid) {
+		if (bsearch(&pending_request->header.uid, uids, uid_count,
+		            sizeof(uint32_t), network_compare_uids) != NULL) {
 			pending_request_remove_and_free(pending_request);
 
 			++count;
@@ -152,44 +855,163 @@ static void network_drop_pending_requests(uint32_t uid) {
 	}
 
 	if (count > 0) {
-		log_warn("Dropped %d pending request(s) (uid: %s)",
-		         count, base58_encode(base58, uint32_from_le(uid)));
+		log_warn("Dropped %d pending request(s) for %d disconnected device(s)",
+		         count, uid_count);
+	}
+}
+
+static void network_destroy_client(Client *client) {
+	if (_resolve_client_names) {
+		name_resolver_cancel(client);
+	}
+
+	client_destroy(client);
+
+	node_remove(&client->network_node);
+	--_client_count;
+
+	if (client->disconnected) {
+		node_remove(&client->removal_node);
+	}
+
+	if (client->flush_scheduled) {
+		node_remove(&client->flush_node);
+	}
+
+	free(client);
+}
+
+static void network_destroy_zombie(Zombie *zombie) {
+	zombie_destroy(zombie);
+
+	node_remove(&zombie->network_node);
+	--_zombie_count;
+
+	if (zombie->finished) {
+		node_remove(&zombie->removal_node);
+	}
+
+	free(zombie);
+}
+
+static void network_arm_zombie_timer(void) {
+	uint64_t now = microseconds();
+	Node *zombie_node = _zombie_sentinel.next;
+	Zombie *zombie;
+
+	_zombie_timer_armed = false;
+
+	while (zombie_node != &_zombie_sentinel) {
+		zombie = containerof(zombie_node, Zombie, network_node);
+		zombie_node = zombie_node->next;
+
+		if (zombie->finished) {
+			continue;
+		}
+
+		if (zombie->deadline > now) {
+			if (timer_configure(&_zombie_timer, zombie->deadline - now, 0) < 0) {
+				log_error("Could not start zombie timer: %s (%d)",
+				          get_errno_name(errno), errno);
+
+				return;
+			}
+
+			_zombie_timer_armed = true;
+
+			return;
+		}
+
+		zombie_expire(zombie);
 	}
 }
 
+static void network_handle_zombie_timeout(void *opaque) {
+	(void)opaque;
+
+	network_arm_zombie_timer();
+}
+
 int network_init(void) {
 	uint16_t plain_port = (uint16_t)config_get_option_value("listen.plain_port")->integer;
 	uint16_t websocket_port = (uint16_t)config_get_option_value("listen.websocket_port")->integer;
+#ifndef _WIN32
+	const char *unix_socket = config_get_option_value("listen.unix_socket")->string;
+	const char *unix_seqpacket_socket = config_get_option_value("listen.unix_seqpacket_socket")->string;
+#endif
+	const char *secret;
+	int i;
 
 	log_debug("Initializing network subsystem");
 
+	_max_clients = config_get_option_value("listen.max_clients")->integer;
+	_max_clients_per_address = config_get_option_value("listen.max_clients_per_address")->integer;
+	_accept_rate = config_get_option_value("listen.accept_rate")->integer;
+	_accept_tokens_max = (uint64_t)config_get_option_value("listen.accept_burst")->integer * 1000000;
+	_accept_tokens = _accept_tokens_max;
+	_accept_tokens_refilled_at = microseconds();
+	_resolve_client_names = config_get_option_value("listen.resolve_client_names")->boolean;
+	_request_coalescing = config_get_option_value("listen.request_coalescing")->boolean;
+
 	node_reset(&_pending_request_sentinel);
 
-	if (config_get_option_value("authentication.secret")->string != NULL) {
+	for (i = 0; i < PENDING_REQUEST_INDEX_SIZE; ++i) {
+		node_reset(&_pending_request_index[i]);
+	}
+
+	for (i = 0; i < COALESCED_REQUEST_INDEX_SIZE; ++i) {
+		node_reset(&_coalesced_request_index[i]);
+	}
+
+	node_reset(&_coalesced_request_redispatch_sentinel);
+
+	response_cache_init();
+	enumerate_cache_init();
+
+	if (_request_coalescing) {
+		log_info("Request coalescing is enabled");
+	}
+
+	secret = config_get_option_value("authentication.secret")->string;
+
+	if (secret != NULL) {
 		log_info("Authentication is enabled");
 
 		_next_authentication_nonce = get_random_uint32();
+		_authentication_enabled = true;
+
+		// prepare the HMAC key once instead of redoing the ipad/opad work
+		// for each handshake. network_reload_config prepares it again if
+		// the secret changes
+		hmac_sha1_prepare_key(&_authentication_key, (uint8_t *)secret, strlen(secret));
 	}
 
-	// create client array. the Client struct is not relocatable, because a
-	// pointer to it is passed as opaque parameter to the event subsystem
-	if (array_create(&_clients, 32, sizeof(Client), false) < 0) {
-		log_error("Could not create client array: %s (%d)",
+	node_reset(&_client_sentinel);
+	node_reset(&_client_removal_sentinel);
+	node_reset(&_client_flush_sentinel);
+	node_reset(&_zombie_sentinel);
+	node_reset(&_zombie_removal_sentinel);
+
+	if (timer_create_(&_zombie_timer, network_handle_zombie_timeout, NULL) < 0) {
+		log_error("Could not create zombie timer: %s (%d)",
 		          get_errno_name(errno), errno);
 
 		return -1;
 	}
 
-	// create zombie array. the Zombie struct is not relocatable, because a
-	// pointer to it is passed as opaque parameter to its timer object
-	if (array_create(&_zombies, 32, sizeof(Zombie), false) < 0) {
-		log_error("Could not create zombie array: %s (%d)",
-		          get_errno_name(errno), errno);
+	// names are only for display purpose, continue with numeric names if the
+	// resolver cannot be started
+	if (_resolve_client_names && name_resolver_init(network_handle_resolved_name) < 0) {
+		log_warn("Could not start name resolver, using numeric client names");
 
-		array_destroy(&_clients, (ItemDestroyFunction)client_destroy);
+		_resolve_client_names = false;
+	}
 
-		return -1;
+#ifdef BRICKD_WITH_IO_THREADS
+	if (io_worker_init() < 0) {
+		log_warn("Could not start I/O worker threads, handling client I/O in the event thread");
 	}
+#endif
 
 	if (network_open_server_socket(&_plain_server_socket, plain_port,
 	                               socket_create_allocated) >= 0) {
@@ -197,33 +1019,129 @@ int network_init(void) {
 	}
 
 	if (websocket_port != 0) {
-		if (config_get_option_value("authentication.secret")->string == NULL) {
+		if (!_authentication_enabled) {
 			log_warn("WebSocket support is enabled without authentication");
 		}
 
+#ifndef BRICKD_WITH_ZLIB
+		if (config_get_option_value("listen.websocket_deflate")->boolean) {
+			log_warn("WebSocket compression is enabled, but not supported by this build");
+		}
+#endif
+
 		if (network_open_server_socket(&_websocket_server_socket, websocket_port,
 		                               websocket_create_allocated) >= 0) {
 			_websocket_server_socket_open = true;
 		}
 	}
 
+#ifndef _WIN32
+	if (unix_socket != NULL && *unix_socket != '\0' &&
+	    network_open_local_server_socket(&_unix_server_socket, unix_socket,
+	                                     SOCK_STREAM, &_unix_server_socket_inherited) >= 0) {
+		_unix_server_socket_open = true;
+	}
+
+	if (unix_seqpacket_socket != NULL && *unix_seqpacket_socket != '\0' &&
+	    network_open_local_server_socket(&_unix_seqpacket_server_socket,
+	                                     unix_seqpacket_socket, SOCK_SEQPACKET,
+	                                     &_unix_seqpacket_server_socket_inherited) >= 0) {
+		_unix_seqpacket_server_socket_open = true;
+	}
+
+	if (!_plain_server_socket_open && !_websocket_server_socket_open &&
+	    !_unix_server_socket_open && !_unix_seqpacket_server_socket_open) {
+#else
 	if (!_plain_server_socket_open && !_websocket_server_socket_open) {
+#endif
 		log_error("Could not open any socket to listen to");
 
-		array_destroy(&_zombies, (ItemDestroyFunction)zombie_destroy);
-		array_destroy(&_clients, (ItemDestroyFunction)client_destroy);
+#ifdef BRICKD_WITH_IO_THREADS
+		io_worker_exit();
+#endif
+
+		if (_resolve_client_names) {
+			name_resolver_exit();
+		}
+
+		timer_destroy(&_zombie_timer);
 
 		return -1;
 	}
 
+	// multicast is an addition to TCP, brickd keeps running without it
+	if (multicast_init() < 0) {
+		log_error("Could not open multicast socket, callback multicast is disabled");
+	}
+
+	// monitoring is optional, brickd keeps running without it
+	if (metrics_init() < 0) {
+		log_error("Could not open metrics socket, metrics endpoint is disabled");
+	}
+
+#ifdef BRICKD_WITH_EVENT_PROFILING
+	event_profile_init();
+#endif
+
 	return 0;
 }
 
+// called by config_options_reload after the config file was reread. listeners
+// are not reopened, only values that are looked up per connection or per
+// accept are updated here
+void network_reload_config(void) {
+	const char *secret = config_get_option_value("authentication.secret")->string;
+
+	_max_clients = config_get_option_value("listen.max_clients")->integer;
+	_max_clients_per_address = config_get_option_value("listen.max_clients_per_address")->integer;
+	_accept_rate = config_get_option_value("listen.accept_rate")->integer;
+	_accept_tokens_max = (uint64_t)config_get_option_value("listen.accept_burst")->integer * 1000000;
+
+	if (_accept_tokens > _accept_tokens_max) {
+		_accept_tokens = _accept_tokens_max;
+	}
+
+	_resolve_client_names = config_get_option_value("listen.resolve_client_names")->boolean;
+
+	// config_options_reload does not allow to enable or disable authentication
+	// at runtime, only the secret of an enabled authentication can change.
+	// already authenticated clients stay authenticated, clients in the middle
+	// of the handshake have to answer the nonce with the new secret
+	if (_authentication_enabled && secret != NULL) {
+		hmac_sha1_prepare_key(&_authentication_key, (uint8_t *)secret, strlen(secret));
+	}
+}
+
 void network_exit(void) {
+	uint32_t pool_hits;
+	uint32_t pool_misses;
+
 	log_debug("Shutting down network subsystem");
 
-	array_destroy(&_clients, (ItemDestroyFunction)client_destroy); // might call network_create_zombie
-	array_destroy(&_zombies, (ItemDestroyFunction)zombie_destroy);
+#ifdef BRICKD_WITH_EVENT_PROFILING
+	event_profile_exit();
+#endif
+
+	metrics_exit();
+	multicast_exit();
+
+	while (_client_sentinel.next != &_client_sentinel) {
+		network_destroy_client(containerof(_client_sentinel.next, Client, network_node)); // might call network_create_zombie
+	}
+
+	while (_zombie_sentinel.next != &_zombie_sentinel) {
+		network_destroy_zombie(containerof(_zombie_sentinel.next, Zombie, network_node));
+	}
+
+#ifdef BRICKD_WITH_IO_THREADS
+	io_worker_exit();
+#endif
+
+	if (_resolve_client_names) {
+		name_resolver_exit();
+	}
+
+	timer_destroy(&_zombie_timer);
 
 	if (_plain_server_socket_open) {
 		event_remove_source(_plain_server_socket.handle, EVENT_SOURCE_TYPE_GENERIC);
@@ -234,28 +1152,127 @@ void network_exit(void) {
 		event_remove_source(_websocket_server_socket.handle, EVENT_SOURCE_TYPE_GENERIC);
 		socket_destroy(&_websocket_server_socket);
 	}
+
+#ifndef _WIN32
+	if (_unix_server_socket_open) {
+		network_close_local_server_socket(&_unix_server_socket,
+		                                  config_get_option_value("listen.unix_socket")->string,
+		                                  _unix_server_socket_inherited);
+	}
+
+	if (_unix_seqpacket_server_socket_open) {
+		network_close_local_server_socket(&_unix_seqpacket_server_socket,
+		                                  config_get_option_value("listen.unix_seqpacket_socket")->string,
+		                                  _unix_seqpacket_server_socket_inherited);
+	}
+#endif
+
+	enumerate_cache_exit();
+	response_cache_exit();
+
+	pending_request_get_pool_counters(&pool_hits, &pool_misses);
+
+	log_debug("Pending request pool served %u allocation(s), %u allocation(s) fell back to the heap",
+	          pool_hits, pool_misses);
+}
+
+// walks all clients and pending requests, meant for occasional monitoring
+// requests and not for hot paths
+// approximation, the items of non-relocatable arrays are allocated separately
+static uint32_t network_get_array_memory(Array *array) {
+	if (array->relocatable) {
+		return (uint32_t)array->allocated * array->size;
+	}
+
+	return (uint32_t)array->allocated * sizeof(void *) + (uint32_t)array->count * array->size;
 }
 
-Client *network_create_client(const char *name, IO *io) {
+void network_get_statistics(NetworkStatistics *statistics) {
+	Node *node;
 	Client *client;
+	Zombie *zombie;
+
+	memset(statistics, 0, sizeof(*statistics));
+
+	statistics->client_count = _client_count;
+	statistics->zombie_count = _zombie_count;
+	statistics->iterations = _iterations;
+	statistics->cleanup_time = _cleanup_time;
+	statistics->coalesced_requests = _coalesced_requests;
+
+	for (node = _pending_request_sentinel.next; node != &_pending_request_sentinel;
+	     node = node->next) {
+		++statistics->pending_request_count;
+	}
+
+	for (node = _client_sentinel.next; node != &_client_sentinel; node = node->next) {
+		client = containerof(node, Client, network_node);
+
+		statistics->queued_responses += client->queued_responses;
+		statistics->queued_bytes += client->queued_bytes;
+		statistics->dropped_callbacks += client->dropped_callbacks;
+		statistics->decimated_callbacks += client->decimated_callbacks;
+
+		statistics->client_memory += sizeof(Client) +
+		                             client->queued_responses * CLIENT_QUEUED_RESPONSE_OVERHEAD +
+		                             client->queued_bytes +
+		                             network_get_array_memory(&client->callback_filters) +
+		                             network_get_array_memory(&client->callback_rate_limits);
+
+		if (client->buffer != NULL) {
+			statistics->client_memory += client->buffer_size;
+		}
+
+		if (client->coalescing_buffer != NULL) {
+			statistics->client_memory += client->coalescing_size;
+		}
+	}
+
+	for (node = _zombie_sentinel.next; node != &_zombie_sentinel; node = node->next) {
+		zombie = containerof(node, Zombie, network_node);
+
+		statistics->zombie_memory += sizeof(Zombie) +
+		                             zombie->held_responses.count * sizeof(Packet) +
+		                             network_get_array_memory(&zombie->callback_filters) +
+		                             network_get_array_memory(&zombie->callback_rate_limits);
+	}
+
+	// the pool is static and always fully accounted for. requests beyond its
+	// size are on the heap, if slots were freed in the meantime this slightly
+	// overestimates the heap part
+	statistics->pending_request_memory = PENDING_REQUEST_POOL_SIZE * sizeof(PendingRequest);
 
-	// append to client array
-	client = array_append(&_clients);
+	if (statistics->pending_request_count > PENDING_REQUEST_POOL_SIZE) {
+		statistics->pending_request_memory += (statistics->pending_request_count -
+		                                       PENDING_REQUEST_POOL_SIZE) * sizeof(PendingRequest);
+	}
+}
+
+// returns NULL if authentication is disabled
+HMACSHA1Key *network_get_authentication_key(void) {
+	return _authentication_enabled ? &_authentication_key : NULL;
+}
+
+Client *network_create_client(const char *name, IO *io) {
+	Client *client = calloc(1, sizeof(Client));
 
 	if (client == NULL) {
-		log_error("Could not append to client array: %s (%d)",
-		          get_errno_name(errno), errno);
+		log_error("Could not allocate client: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
 
 		return NULL;
 	}
 
 	// create new client that takes ownership of the I/O object
 	if (client_create(client, name, io, _next_authentication_nonce++, NULL) < 0) {
-		array_remove(&_clients, _clients.count - 1, NULL);
+		free(client);
 
 		return NULL;
 	}
 
+	node_insert_before(&_client_sentinel, &client->network_node);
+	++_client_count;
+
 	log_info("Added new client ("CLIENT_SIGNATURE_FORMAT")",
 	         client_expand_signature(client));
 
@@ -263,61 +1280,146 @@ Client *network_create_client(const char *name, IO *io) {
 }
 
 int network_create_zombie(Client *client) {
-	Zombie *zombie;
-
-	// append to zombie array
-	zombie = array_append(&_zombies);
+	Zombie *zombie = calloc(1, sizeof(Zombie));
+	Node *zombie_node;
+	uint64_t timeout;
 
 	if (zombie == NULL) {
-		log_error("Could not append to zombie array: %s (%d)",
-		          get_errno_name(errno), errno);
+		log_error("Could not allocate zombie: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
 
 		return -1;
 	}
 
 	// create new zombie that takes ownership of the pending requests
 	if (zombie_create(zombie, client) < 0) {
-		array_remove(&_zombies, _zombies.count - 1, NULL);
+		free(zombie);
 
 		return -1;
 	}
 
+	if (zombie->resumable) {
+		timeout = config_get_option_value("listen.session_timeout")->integer;
+	} else {
+		timeout = config_get_option_value("listen.zombie_timeout")->integer;
+	}
+
+	zombie->deadline = microseconds() + timeout * 1000;
+
+	zombie_node = _zombie_sentinel.prev;
+
+	while (zombie_node != &_zombie_sentinel &&
+	       containerof(zombie_node, Zombie, network_node)->deadline > zombie->deadline) {
+		zombie_node = zombie_node->prev;
+	}
+
+	node_insert_after(zombie_node, &zombie->network_node);
+	++_zombie_count;
+
 	log_debug("Added new zombie (id: %u)", zombie->id);
 
+	// the new zombie might be due before the one the timer is armed for
+	if (!_zombie_timer_armed || zombie->network_node.next != &_zombie_sentinel) {
+		network_arm_zombie_timer();
+	}
+
 	return 0;
 }
 
+// compares all bytes, so the time taken doesn't tell a guessing client how many
+// leading bytes of its session token are correct
+static bool network_is_session_token_matching(const uint8_t *session_token1,
+                                              const uint8_t *session_token2) {
+	uint8_t difference = 0;
+	int i;
+
+	for (i = 0; i < CLIENT_SESSION_TOKEN_LENGTH; ++i) {
+		difference |= session_token1[i] ^ session_token2[i];
+	}
+
+	return difference == 0;
+}
+
+// returns NULL if no zombie with this session token exists (anymore)
+Zombie *network_find_resumable_zombie(const uint8_t *session_token) {
+	Node *zombie_node;
+	Zombie *zombie;
+
+	for (zombie_node = _zombie_sentinel.next; zombie_node != &_zombie_sentinel;
+	     zombie_node = zombie_node->next) {
+		zombie = containerof(zombie_node, Zombie, network_node);
+
+		if (zombie->resumable && !zombie->finished &&
+		    network_is_session_token_matching(zombie->session_token, session_token)) {
+			return zombie;
+		}
+	}
+
+	return NULL;
+}
+
+void network_schedule_client_flush(Client *client) {
+	client->flush_scheduled = true;
+
+	node_insert_before(&_client_flush_sentinel, &client->flush_node);
+}
+
+void network_schedule_client_removal(Client *client) {
+	node_insert_before(&_client_removal_sentinel, &client->removal_node);
+}
+
+void network_schedule_zombie_removal(Zombie *zombie) {
+	node_insert_before(&_zombie_removal_sentinel, &zombie->removal_node);
+}
+
 // remove clients that got marked as disconnected and finished zombies
 void network_cleanup_clients_and_zombies(void) {
-	int i;
+	uint64_t start = microseconds();
 	Client *client;
 	Zombie *zombie;
 
-	// iterate backwards for simpler index handling
-	for (i = _clients.count - 1; i >= 0; --i) {
-		client = array_get(&_clients, i);
+	network_redispatch_coalesced_requests();
 
-		if (client->disconnected) {
-			log_debug("Removing disconnected client ("CLIENT_SIGNATURE_FORMAT")",
-			          client_expand_signature(client));
+	// this is called at the end of each event loop iteration, flush all
+	// responses that got coalesced during this iteration
+	while (_client_flush_sentinel.next != &_client_flush_sentinel) {
+		client = containerof(_client_flush_sentinel.next, Client, flush_node);
 
-			array_remove(&_clients, i, (ItemDestroyFunction)client_destroy);
-		}
+		node_remove(&client->flush_node);
+		client->flush_scheduled = false;
+
+		client_flush_responses(client);
 	}
 
-	// iterate backwards for simpler index handling
-	for (i = _zombies.count - 1; i >= 0; --i) {
-		zombie = array_get(&_zombies, i);
+	// destroying a client can add new clients and zombies, therefore, always
+	// take the head of the removal list until it is empty
+	while (_client_removal_sentinel.next != &_client_removal_sentinel) {
+		client = containerof(_client_removal_sentinel.next, Client, removal_node);
 
-		if (zombie->finished) {
-			log_debug("Removing finished zombie (id: %u)", zombie->id);
+		log_debug("Removing disconnected client ("CLIENT_SIGNATURE_FORMAT")",
+		          client_expand_signature(client));
 
-			array_remove(&_zombies, i, (ItemDestroyFunction)zombie_destroy);
-		}
+		network_destroy_client(client);
+	}
+
+	while (_zombie_removal_sentinel.next != &_zombie_removal_sentinel) {
+		zombie = containerof(_zombie_removal_sentinel.next, Zombie, removal_node);
+
+		log_debug("Removing finished zombie (id: %u)", zombie->id);
+
+		network_destroy_zombie(zombie);
 	}
+
+	++_iterations;
+	_cleanup_time += microseconds() - start;
+
+#ifdef BRICKD_WITH_EVENT_PROFILING
+	event_profile_end_iteration();
+#endif
 }
 
-void network_client_expects_response(Client *client, Packet *request) {
+// returns NULL if the pending request could not be allocated
+PendingRequest *network_client_expects_response(Client *client, Packet *request) {
 	PendingRequest *pending_request;
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 
@@ -326,6 +1428,9 @@ void network_client_expects_response(Client *client, Packet *request) {
 		         client_expand_signature(client),
 		         client->pending_request_count - CLIENT_MAX_PENDING_REQUESTS + 1);
 
+		// the client list is in insertion order, so the oldest pending
+		// request is always at its head and can be evicted without any
+		// matching work. removing it from all lists is constant time
 		while (client->pending_request_count >= CLIENT_MAX_PENDING_REQUESTS) {
 			pending_request = containerof(client->pending_request_sentinel.next,
 			                              PendingRequest, client_node);
@@ -334,13 +1439,13 @@ void network_client_expects_response(Client *client, Packet *request) {
 		}
 	}
 
-	pending_request = calloc(1, sizeof(PendingRequest));
+	pending_request = pending_request_allocate();
 
 	if (pending_request == NULL) {
 		log_error("Could not allocate pending request: %s (%d)",
-		          get_errno_name(ENOMEM), ENOMEM);
+		          get_errno_name(errno), errno);
 
-		return;
+		return NULL;
 	}
 
 	node_insert_before(&_pending_request_sentinel, &pending_request->global_node);
@@ -353,20 +1458,43 @@ void network_client_expects_response(Client *client, Packet *request) {
 
 	memcpy(&pending_request->header, &request->header, sizeof(PacketHeader));
 
-	log_packet_debug("Added pending request (%s) for client ("CLIENT_SIGNATURE_FORMAT")",
-	                 packet_get_request_signature(packet_signature, request),
-	                 client_expand_signature(client));
+	pending_request->arrival_time = microseconds();
+
+	node_insert_before(network_get_pending_request_bucket(&pending_request->header),
+	                   &pending_request->index_node);
+
+	log_packet_debug_checked("Added pending request (%s) for client ("CLIENT_SIGNATURE_FORMAT")",
+	                         packet_get_request_signature(packet_signature, request),
+	                         client_expand_signature(client));
+
+	return pending_request;
+}
+
+// the clients that have to queue the response share one copy of it, and the
+// WebSocket clients one prepared frame of it
+static void network_broadcast_response(Packet *response) {
+	Node *client_node = _client_sentinel.next;
+	ClientBroadcast broadcast;
+
+	client_broadcast_init(&broadcast, response);
+
+	while (client_node != &_client_sentinel) {
+		client_broadcast_shared_response(containerof(client_node, Client, network_node), &broadcast);
+
+		client_node = client_node->next;
+	}
+
+	client_broadcast_release(&broadcast);
 }
 
 void network_dispatch_response(Packet *response) {
 	EnumerateCallback *enumerate_callback;
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
-	int i;
-	Client *client;
-	Node *pending_request_global_node;
 	PendingRequest *pending_request;
 
 	packet_add_trace(response);
+	packet_log_add(response, PACKET_LOG_DIRECTION_RESPONSE, NULL);
+	packet_capture_add(response, PACKET_LOG_DIRECTION_RESPONSE, NULL);
 
 	if (packet_header_get_sequence_number(&response->header) == 0) {
 		if (response->header.function_id == CALLBACK_ENUMERATE) {
@@ -375,88 +1503,176 @@ void network_dispatch_response(Packet *response) {
 			if (enumerate_callback->enumeration_type == ENUMERATION_TYPE_CONNECTED ||
 			    enumerate_callback->enumeration_type == ENUMERATION_TYPE_DISCONNECTED) {
 				network_drop_pending_requests(response->header.uid);
+				response_cache_invalidate(response->header.uid);
 			}
+
+			if (enumerate_callback->enumeration_type != ENUMERATION_TYPE_DISCONNECTED) {
+				hardware_set_device_identifier(response->header.uid,
+				                               uint16_from_le(enumerate_callback->device_identifier));
+			}
+
+			enumerate_cache_update(enumerate_callback);
 		}
 
-		if (_clients.count == 0) {
-			log_packet_debug("No clients connected, dropping %s (%s)",
-			                 packet_get_response_type(response),
-			                 packet_get_response_signature(packet_signature, response));
+		// multicast listeners are not clients, publish before the client check
+		multicast_publish(response);
+
+		if (_client_count == 0) {
+			log_packet_debug_checked("No clients connected, dropping %s (%s)",
+			                         packet_get_response_type(response),
+			                         packet_get_response_signature(packet_signature, response));
 
 			return;
 		}
 
-		log_packet_debug("Broadcasting %s (%s) to %d client(s)",
-		                 packet_get_response_type(response),
-		                 packet_get_response_signature(packet_signature, response),
-		                 _clients.count);
+		log_packet_debug_checked("Broadcasting %s (%s) to %d client(s)",
+		                         packet_get_response_type(response),
+		                         packet_get_response_signature(packet_signature, response),
+		                         _client_count);
 
 		packet_add_trace(response);
+		network_broadcast_response(response);
+	} else if (_client_count + _zombie_count > 0) {
+		log_packet_debug_checked("Dispatching response (%s) to %d client(s) and %d zombies(s)",
+		                         packet_get_response_signature(packet_signature, response),
+		                         _client_count, _zombie_count);
+
+		if (response->header.function_id == FUNCTION_GET_IDENTITY &&
+		    response->header.length == sizeof(GetIdentityResponse) &&
+		    packet_header_get_error_code(&response->header) == PACKET_E_SUCCESS) {
+			hardware_set_device_identifier(response->header.uid,
+			                               uint16_from_le(((GetIdentityResponse *)response)->device_identifier));
+		}
 
-		for (i = 0; i < _clients.count; ++i) {
-			client = array_get(&_clients, i);
+		pending_request = network_find_pending_request(response, NULL);
 
-			client_dispatch_response(client, NULL, response, true, false);
-		}
-	} else if (_clients.count + _zombies.count > 0) {
-		log_packet_debug("Dispatching response (%s) to %d client(s) and %d zombies(s)",
-		                 packet_get_response_signature(packet_signature, response),
-		                 _clients.count, _zombies.count);
-
-		pending_request_global_node = _pending_request_sentinel.next;
-
-		while (pending_request_global_node != &_pending_request_sentinel) {
-			pending_request = containerof(pending_request_global_node,
-			                              PendingRequest, global_node);
-
-			if (packet_is_matching_response(response, &pending_request->header)) {
-				if (pending_request->client != NULL) {
-					packet_add_trace(response);
-					client_dispatch_response(pending_request->client, pending_request,
-					                         response, false, false);
-				} else {
-					packet_add_trace(response);
-					zombie_dispatch_response(pending_request->zombie, pending_request,
-					                         response);
-				}
+		if (pending_request != NULL) {
+			response_latency_add(response->header.uid, response->header.function_id,
+			                     microseconds() - pending_request->arrival_time);
 
-				return;
+			if (pending_request->response_cache_entry != NULL) {
+				response_cache_put(pending_request, response);
+			}
+
+			// only leaders are in the pending request index
+			if (pending_request->coalesced_request != NULL) {
+				network_dispatch_coalesced_response(pending_request->coalesced_request, response);
+			}
+
+			if (pending_request->client != NULL) {
+				packet_add_trace(response);
+				client_dispatch_response(pending_request->client, pending_request,
+				                         response, false, false);
+			} else {
+				packet_add_trace(response);
+				zombie_dispatch_response(pending_request->zombie, pending_request,
+				                         response);
 			}
 
-			pending_request_global_node = pending_request_global_node->next;
+			return;
 		}
 
 		log_warn("Broadcasting response (%s) because no client/zombie has a matching pending request",
 		         packet_get_response_signature(packet_signature, response));
 
 		packet_add_trace(response);
+		network_broadcast_response(response);
+	} else {
+		log_packet_debug_checked("No clients/zombies connected, dropping response (%s)",
+		                         packet_get_response_signature(packet_signature, response));
+
+		packet_add_trace(response);
+	}
+}
+
+// dispatches the enumerate-disconnected callbacks for all devices of a stack
+// at once. pending requests are dropped in one pass and each client gets all
+// callbacks in one write, instead of one dispatch per callback
+void network_dispatch_disconnect_callbacks(Packet *callbacks, int count) {
+	uint32_t *uids;
+	Node *client_node;
+	int i;
+
+	if (count == 1) {
+		network_dispatch_response(callbacks);
+
+		return;
+	}
+
+	uids = calloc(count, sizeof(uint32_t));
 
-		for (i = 0; i < _clients.count; ++i) {
-			client = array_get(&_clients, i);
+	if (uids == NULL) {
+		log_error("Could not allocate UID array for %d disconnect callback(s): %s (%d)",
+		          count, get_errno_name(ENOMEM), ENOMEM);
 
-			client_dispatch_response(client, NULL, response, true, false);
+		for (i = 0; i < count; ++i) {
+			network_dispatch_response(&callbacks[i]);
 		}
-	} else {
-		log_packet_debug("No clients/zombies connected, dropping response (%s)",
-		                 packet_get_response_signature(packet_signature, response));
 
-		packet_add_trace(response);
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		packet_add_trace(&callbacks[i]);
+		packet_log_add(&callbacks[i], PACKET_LOG_DIRECTION_RESPONSE, NULL);
+		packet_capture_add(&callbacks[i], PACKET_LOG_DIRECTION_RESPONSE, NULL);
+
+		uids[i] = callbacks[i].header.uid;
+	}
+
+	qsort(uids, count, sizeof(uint32_t), network_compare_uids);
+	network_drop_pending_requests_of_uids(uids, count);
+	free(uids);
+
+	for (i = 0; i < count; ++i) {
+		response_cache_invalidate(callbacks[i].header.uid);
+		enumerate_cache_update((EnumerateCallback *)&callbacks[i]);
+		multicast_publish(&callbacks[i]);
+	}
+
+	if (_client_count == 0) {
+		log_debug("No clients connected, dropping %d disconnect callback(s)", count);
+
+		return;
+	}
+
+	log_debug("Broadcasting %d disconnect callback(s) to %d client(s)",
+	          count, _client_count);
+
+	for (client_node = _client_sentinel.next; client_node != &_client_sentinel;
+	     client_node = client_node->next) {
+		client_broadcast_responses(containerof(client_node, Client, network_node),
+		                           callbacks, count);
 	}
 }
 
 #ifdef BRICKD_WITH_RED_BRICK
 
+void network_announce_red_brick_connect(void) {
+	Node *client_node = _client_sentinel.next;
+
+	log_debug("Broadcasting enumerate-connected callback for RED Brick to %d client(s)",
+	          _client_count);
+
+	while (client_node != &_client_sentinel) {
+		client_send_red_brick_enumerate(containerof(client_node, Client, network_node),
+		                                ENUMERATION_TYPE_CONNECTED);
+
+		client_node = client_node->next;
+	}
+}
+
 void network_announce_red_brick_disconnect(void) {
-	int i;
-	Client *client;
+	Node *client_node = _client_sentinel.next;
 
 	log_debug("Broadcasting enumerate-disconnected callback for RED Brick to %d client(s)",
-	          _clients.count);
+	          _client_count);
 
-	for (i = 0; i < _clients.count; ++i) {
-		client = array_get(&_clients, i);
+	while (client_node != &_client_sentinel) {
+		client_send_red_brick_enumerate(containerof(client_node, Client, network_node),
+		                                ENUMERATION_TYPE_DISCONNECTED);
 
-		client_send_red_brick_enumerate(client, ENUMERATION_TYPE_DISCONNECTED);
+		client_node = client_node->next;
 	}
 }
 
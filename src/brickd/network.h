@@ -24,22 +24,60 @@
 #define BRICKD_NETWORK_H
 
 #include <daemonlib/packet.h>
+#include <daemonlib/socket.h>
 
 #include "client.h"
+#include "hmac.h"
+
+typedef struct {
+	int client_count;
+	int zombie_count;
+	int pending_request_count; // of clients and zombies
+	uint32_t queued_responses; // summed over all clients
+	uint32_t queued_bytes; // summed over all clients
+	uint32_t dropped_callbacks; // summed over the connected clients
+	uint32_t decimated_callbacks; // replaced by newer ones, summed over the connected clients
+	uint64_t iterations; // event loop iterations
+	uint64_t cleanup_time; // microseconds, spent flushing and cleaning up at the end of iterations
+	uint32_t coalesced_requests; // answered by the response to an identical request
+	uint32_t client_memory; // bytes, clients with their buffers and queued responses
+	uint32_t zombie_memory; // bytes, zombies with their held responses
+	uint32_t pending_request_memory; // bytes, the pool plus heap allocated requests
+} NetworkStatistics;
 
 int network_init(void);
 void network_exit(void);
 
+void network_reload_config(void);
+
+void network_get_statistics(NetworkStatistics *statistics);
+
+HMACSHA1Key *network_get_authentication_key(void);
+
+#define NETWORK_MAX_ADDRESS_LENGTH (NI_MAXHOST + NI_MAXSERV + 4) // 4 == strlen("[]:") + 1
+
+int network_format_address(struct sockaddr *address, socklen_t length,
+                           char *buffer, int buffer_length);
+
 Client *network_create_client(const char *name, IO *io);
 int network_create_zombie(Client *client);
+Zombie *network_find_resumable_zombie(const uint8_t *session_token);
 
+void network_schedule_client_flush(Client *client);
+void network_schedule_client_removal(Client *client);
+void network_schedule_zombie_removal(Zombie *zombie);
 void network_cleanup_clients_and_zombies(void);
 
-void network_client_expects_response(Client *client, Packet *request);
+PendingRequest *network_client_expects_response(Client *client, Packet *request);
+bool network_coalesce_request(PendingRequest *pending_request, Packet *request);
+void network_release_coalesced_request(PendingRequest *pending_request);
+PendingRequest *network_find_pending_request(Packet *response, Client *client);
 void network_dispatch_response(Packet *response);
+void network_dispatch_disconnect_callbacks(Packet *callbacks, int count);
 
 #ifdef BRICKD_WITH_RED_BRICK
 
+void network_announce_red_brick_connect(void);
 void network_announce_red_brick_disconnect(void);
 
 #endif
@@ -0,0 +1,170 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_capture.c: Streaming capture of all packets for offline replay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * if packet_capture.file is set then every request received from a client,
+ * every request sent to a stack and every response and callback received from
+ * a stack is appended to that file, including the full packet. the capture is
+ * meant to be taken at a site with a performance problem and to be replayed
+ * by the loopback stack later. the file is written buffered and flushed once
+ * per second. all functions have to be called from the event thread
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/timer.h>
+#include <daemonlib/utils.h>
+
+#include "packet_capture.h"
+
+#include "hardware.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define PACKET_CAPTURE_FLUSH_INTERVAL 1000000 // microseconds
+
+static FILE *_fp = NULL; // NULL if not capturing
+static char _filename[1024];
+static uint64_t _start = 0; // microseconds
+static uint32_t _captured = 0;
+static Timer _flush_timer;
+
+static void packet_capture_stop(void) {
+	if (fclose(_fp) != 0) {
+		log_error("Could not close packet capture file '%s': %s (%d)",
+		          _filename, get_errno_name(errno), errno);
+	}
+
+	_fp = NULL;
+
+	timer_destroy(&_flush_timer);
+}
+
+static void packet_capture_handle_flush_timer(void *opaque) {
+	(void)opaque;
+
+	if (fflush(_fp) != 0) {
+		log_error("Could not write to packet capture file '%s', stopping capture: %s (%d)",
+		          _filename, get_errno_name(errno), errno);
+
+		packet_capture_stop();
+	}
+}
+
+// the capture is optional. if the file cannot be opened then brickd runs
+// without capturing
+void packet_capture_init(void) {
+	const char *filename = config_get_option_value("packet_capture.file")->string;
+	PacketCaptureHeader header;
+
+	if (filename == NULL || *filename == '\0') {
+		log_debug("Packet capture is disabled");
+
+		return;
+	}
+
+	string_copy(_filename, sizeof(_filename), filename, -1);
+
+	if (timer_create_(&_flush_timer, packet_capture_handle_flush_timer, NULL) < 0) {
+		log_error("Could not create packet capture flush timer, disabling packet capture: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	_fp = fopen(_filename, "wb");
+
+	if (_fp == NULL) {
+		log_error("Could not open packet capture file '%s', disabling packet capture: %s (%d)",
+		          _filename, get_errno_name(errno), errno);
+
+		timer_destroy(&_flush_timer);
+
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACKET_CAPTURE_MAGIC, sizeof(header.magic));
+
+	header.version = uint32_to_le(PACKET_CAPTURE_VERSION);
+
+	if (fwrite(&header, sizeof(header), 1, _fp) != 1 ||
+	    timer_configure(&_flush_timer, PACKET_CAPTURE_FLUSH_INTERVAL,
+	                    PACKET_CAPTURE_FLUSH_INTERVAL) < 0) {
+		log_error("Could not start packet capture to '%s', disabling packet capture: %s (%d)",
+		          _filename, get_errno_name(errno), errno);
+
+		packet_capture_stop();
+
+		return;
+	}
+
+	_start = microseconds();
+	_captured = 0;
+
+	log_info("Capturing all packets to '%s'", _filename);
+}
+
+// safe to call if not capturing
+void packet_capture_exit(void) {
+	if (_fp == NULL) {
+		return;
+	}
+
+	log_info("Captured %u packet(s) to '%s'", _captured, _filename);
+
+	packet_capture_stop();
+}
+
+void packet_capture_add(Packet *packet, PacketLogDirection direction, Stack *stack) {
+	PacketCaptureRecord record;
+	uint16_t device_identifier;
+
+	if (_fp == NULL) {
+		return;
+	}
+
+	if (stack == NULL && direction == PACKET_LOG_DIRECTION_RESPONSE) {
+		stack = hardware_find_stack(packet->header.uid, &device_identifier);
+	}
+
+	record.timestamp = packet_log_uint64_to_le(microseconds() - _start);
+	record.stack_id = uint16_to_le(stack != NULL ? stack->id : 0);
+	record.direction = (uint8_t)direction;
+	record.reserved = 0;
+
+	if (fwrite(&record, sizeof(record), 1, _fp) != 1 ||
+	    fwrite(packet, packet->header.length, 1, _fp) != 1) {
+		log_error("Could not write to packet capture file '%s', stopping capture: %s (%d)",
+		          _filename, get_errno_name(errno), errno);
+
+		packet_capture_stop();
+
+		return;
+	}
+
+	++_captured;
+}
@@ -0,0 +1,62 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_capture.h: Streaming capture of all packets for offline replay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_PACKET_CAPTURE_H
+#define BRICKD_PACKET_CAPTURE_H
+
+#include <stdint.h>
+
+#include <daemonlib/packet.h>
+
+#include "packet_log.h"
+#include "stack.h"
+
+#define PACKET_CAPTURE_MAGIC "BRICKDPC"
+#define PACKET_CAPTURE_VERSION 1
+
+#include <daemonlib/packed_begin.h>
+
+// all fields are little endian. the file starts with the header, followed by
+// any number of records. each record is directly followed by the packet as it
+// is on the wire, the length of the packet is taken from its header. the file
+// can be read while it is still being written
+typedef struct {
+	char magic[8]; // PACKET_CAPTURE_MAGIC, not NUL-terminated
+	uint32_t version;
+	uint32_t reserved;
+} ATTRIBUTE_PACKED PacketCaptureHeader;
+
+typedef struct {
+	uint64_t timestamp; // microseconds since the capture started
+	uint16_t stack_id; // 0 if unknown
+	uint8_t direction; // PacketLogDirection
+	uint8_t reserved;
+} ATTRIBUTE_PACKED PacketCaptureRecord;
+
+#include <daemonlib/packed_end.h>
+
+void packet_capture_init(void);
+void packet_capture_exit(void);
+
+void packet_capture_add(Packet *packet, PacketLogDirection direction, Stack *stack);
+
+#endif // BRICKD_PACKET_CAPTURE_H
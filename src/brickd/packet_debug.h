@@ -0,0 +1,50 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_debug.h: Level-checked packet debug logging
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_PACKET_DEBUG_H
+#define BRICKD_PACKET_DEBUG_H
+
+#include <stdbool.h>
+
+#include <daemonlib/log.h>
+
+// the effective log level is checked first, because it's cheap and packet
+// debug messages are not logged in the common case. without logging support
+// the check is constant false and the compiler drops the guarded code
+#ifdef DAEMONLIB_WITH_LOGGING
+	#define packet_debug_is_enabled() \
+		(log_get_effective_level() == LOG_LEVEL_DEBUG && \
+		 log_is_included(LOG_LEVEL_DEBUG, &_log_source, LOG_DEBUG_GROUP_PACKET))
+#else
+	#define packet_debug_is_enabled() false
+#endif
+
+// evaluates its arguments only if packet debug messages are logged. use this
+// instead of log_packet_debug for messages that are logged per packet and
+// have costly arguments such as packet signatures
+#define log_packet_debug_checked(...) \
+	do { \
+		if (packet_debug_is_enabled()) { \
+			log_packet_debug(__VA_ARGS__); \
+		} \
+	} while (0)
+
+#endif // BRICKD_PACKET_DEBUG_H
@@ -0,0 +1,357 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_log.c: Always-on binary ring of recently routed packets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the packet log records every request that arrives from a client, every
+ * request that is sent to a stack and every response and callback that comes
+ * from a stack into a fixed size ring. recording a packet costs a few stores
+ * into the ring, so the packet log can stay enabled in production. the ring is
+ * written to a file on SIGUSR2 and by the dump-packet-log function of the
+ * Brick Daemon UID. the packet_log_decoder tool turns such a file into text,
+ * so latency incidents can be looked at after the fact. all functions have to
+ * be called from the event thread
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+	#include <signal.h>
+	#include <unistd.h>
+#endif
+
+#include <daemonlib/config.h>
+#include <daemonlib/event.h>
+#include <daemonlib/log.h>
+#include <daemonlib/pipe.h>
+#include <daemonlib/utils.h>
+
+#include "packet_log.h"
+
+#include "hardware.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+static PacketLogRecord *_records = NULL; // NULL if the packet log is disabled
+static uint32_t _mask = 0; // capacity minus one, capacity is a power of two
+static uint64_t _added = 0; // records added since the start
+static char _dump_filename[1024] = "";
+#ifndef _WIN32
+static Pipe _signal_pipe; // readable after SIGUSR2 was received
+static bool _signal_handler_installed = false;
+#endif
+
+uint64_t packet_log_uint64_to_le(uint64_t native) {
+	uint8_t bytes[8];
+	uint64_t result;
+	int i;
+
+	for (i = 0; i < 8; ++i) {
+		bytes[i] = (uint8_t)(native >> (i * 8));
+	}
+
+	memcpy(&result, bytes, sizeof(result));
+
+	return result;
+}
+
+#ifndef _WIN32
+
+static void packet_log_handle_sigusr2(int signal_number) {
+	uint8_t byte = 0;
+	int saved_errno = errno;
+	ssize_t rc;
+
+	(void)signal_number;
+
+	// only write(2) is async-signal-safe here. if the pipe is full then a
+	// dump is already pending
+	rc = write(_signal_pipe.base.write_handle, &byte, sizeof(byte));
+
+	(void)rc;
+
+	errno = saved_errno;
+}
+
+static void packet_log_handle_signal(void *opaque) {
+	uint8_t bytes[16];
+	uint32_t record_count;
+
+	(void)opaque;
+
+	while (pipe_read(&_signal_pipe, bytes, sizeof(bytes)) > 0) {
+	}
+
+	log_info("Received SIGUSR2, dumping packet log");
+
+	packet_log_dump(&record_count);
+}
+
+static void packet_log_install_signal_handler(void) {
+	struct sigaction action;
+
+	if (pipe_create(&_signal_pipe, PIPE_FLAG_NON_BLOCKING_READ | PIPE_FLAG_NON_BLOCKING_WRITE) < 0) {
+		log_error("Could not create packet log signal pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	if (event_add_source(_signal_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, packet_log_handle_signal, NULL) < 0) {
+		pipe_destroy(&_signal_pipe);
+
+		return;
+	}
+
+	memset(&action, 0, sizeof(action));
+
+	action.sa_handler = packet_log_handle_sigusr2;
+	action.sa_flags = SA_RESTART;
+
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(SIGUSR2, &action, NULL) < 0) {
+		log_error("Could not install SIGUSR2 handler: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		event_remove_source(_signal_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+		pipe_destroy(&_signal_pipe);
+
+		return;
+	}
+
+	_signal_handler_installed = true;
+}
+
+static void packet_log_uninstall_signal_handler(void) {
+	if (!_signal_handler_installed) {
+		return;
+	}
+
+	signal(SIGUSR2, SIG_DFL);
+
+	event_remove_source(_signal_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&_signal_pipe);
+
+	_signal_handler_installed = false;
+}
+
+#endif
+
+// the packet log is optional. if it cannot be allocated then brickd runs
+// without it. the dump file name is platform specific and can be overridden
+// by the packet_log.dump_file option
+void packet_log_init(const char *dump_filename) {
+	int records = config_get_option_value("packet_log.records")->integer;
+	const char *configured_filename = config_get_option_value("packet_log.dump_file")->string;
+	uint32_t capacity = 1;
+
+	if (configured_filename != NULL && *configured_filename != '\0') {
+		dump_filename = configured_filename;
+	}
+
+	if (dump_filename != NULL) {
+		string_copy(_dump_filename, sizeof(_dump_filename), dump_filename, -1);
+	}
+
+	if (records == 0) {
+		log_debug("Packet log is disabled");
+
+		return;
+	}
+
+	while (capacity < (uint32_t)records) {
+		capacity <<= 1;
+	}
+
+	_records = calloc(capacity, sizeof(PacketLogRecord));
+
+	if (_records == NULL) {
+		log_error("Could not allocate packet log for %u record(s), disabling packet log",
+		          capacity);
+
+		return;
+	}
+
+	_mask = capacity - 1;
+	_added = 0;
+
+	log_debug("Initialized packet log (records: %u, dump-file: %s)",
+	          capacity, _dump_filename[0] != '\0' ? _dump_filename : "<none>");
+
+#ifndef _WIN32
+	packet_log_install_signal_handler();
+#endif
+}
+
+// safe to call if the packet log is disabled
+void packet_log_exit(void) {
+#ifndef _WIN32
+	packet_log_uninstall_signal_handler();
+#endif
+
+	free(_records);
+
+	_records = NULL;
+}
+
+// if no stack is given for a response then it is looked up by the route of
+// its UID, so the route lookup is skipped while the packet log is disabled
+void packet_log_add(Packet *packet, PacketLogDirection direction, Stack *stack) {
+	PacketLogRecord *record;
+	uint16_t device_identifier;
+
+	if (_records == NULL) {
+		return;
+	}
+
+	if (stack == NULL && direction == PACKET_LOG_DIRECTION_RESPONSE) {
+		stack = hardware_find_stack(packet->header.uid, &device_identifier);
+	}
+
+	record = &_records[(uint32_t)_added & _mask];
+
+	++_added;
+
+	record->timestamp = microseconds();
+#ifdef DAEMONLIB_WITH_PACKET_TRACE
+	record->trace_id = packet->trace_id;
+#else
+	record->trace_id = 0;
+#endif
+	record->uid = packet->header.uid;
+	record->stack_id = stack != NULL ? stack->id : 0;
+	record->function_id = packet->header.function_id;
+	record->sequence_number = packet_header_get_sequence_number(&packet->header);
+	record->direction = (uint8_t)direction;
+	record->error_code = (uint8_t)packet_header_get_error_code(&packet->header);
+	record->length = packet->header.length;
+}
+
+static int packet_log_write(FILE *fp, const void *buffer, size_t length) {
+	return fwrite(buffer, length, 1, fp) == 1 ? 0 : -1;
+}
+
+// writes the stacks that currently exist and the records in the ring to the
+// dump file, replacing its previous content
+int packet_log_dump(uint32_t *record_count) {
+	FILE *fp;
+	PacketLogHeader header;
+	PacketLogStack stack_entry;
+	PacketLogRecord record;
+	int stack_count = hardware_get_stack_count();
+	uint32_t count;
+	uint32_t i;
+	int k;
+	Stack *stack;
+
+	*record_count = 0;
+
+	if (_records == NULL) {
+		log_warn("Cannot dump packet log, it is disabled");
+
+		return -1;
+	}
+
+	if (_dump_filename[0] == '\0') {
+		log_warn("Cannot dump packet log, no dump file is configured");
+
+		return -1;
+	}
+
+	fp = fopen(_dump_filename, "wb");
+
+	if (fp == NULL) {
+		log_error("Could not open packet log dump file '%s': %s (%d)",
+		          _dump_filename, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	count = _added < (uint64_t)_mask + 1 ? (uint32_t)_added : _mask + 1;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACKET_LOG_MAGIC, sizeof(header.magic));
+
+	header.version = uint32_to_le(PACKET_LOG_VERSION);
+	header.record_size = uint32_to_le(sizeof(PacketLogRecord));
+	header.record_count = uint32_to_le(count);
+	header.stack_count = uint32_to_le((uint32_t)stack_count);
+	header.dropped_records = packet_log_uint64_to_le(_added - count);
+	header.dump_time = packet_log_uint64_to_le((uint64_t)time(NULL));
+	header.dump_timestamp = packet_log_uint64_to_le(microseconds());
+
+	if (packet_log_write(fp, &header, sizeof(header)) < 0) {
+		goto error;
+	}
+
+	for (k = 0; k < stack_count; ++k) {
+		stack = hardware_get_stack(k);
+
+		memset(&stack_entry, 0, sizeof(stack_entry));
+
+		stack_entry.id = uint16_to_le(stack->id);
+
+		memcpy(stack_entry.name, stack->name,
+		       MIN(strlen(stack->name), sizeof(stack_entry.name)));
+
+		if (packet_log_write(fp, &stack_entry, sizeof(stack_entry)) < 0) {
+			goto error;
+		}
+	}
+
+	// oldest first
+	for (i = 0; i < count; ++i) {
+		memcpy(&record, &_records[(uint32_t)(_added - count + i) & _mask], sizeof(record));
+
+		record.timestamp = packet_log_uint64_to_le(record.timestamp);
+		record.trace_id = packet_log_uint64_to_le(record.trace_id);
+		record.stack_id = uint16_to_le(record.stack_id);
+
+		if (packet_log_write(fp, &record, sizeof(record)) < 0) {
+			goto error;
+		}
+	}
+
+	if (fclose(fp) != 0) {
+		log_error("Could not write packet log dump file '%s': %s (%d)",
+		          _dump_filename, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	log_info("Dumped %u packet log record(s) to '%s'", count, _dump_filename);
+
+	*record_count = count;
+
+	return 0;
+
+error:
+	log_error("Could not write packet log dump file '%s': %s (%d)",
+	          _dump_filename, get_errno_name(errno), errno);
+
+	fclose(fp);
+
+	return -1;
+}
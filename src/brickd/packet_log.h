@@ -0,0 +1,85 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_log.h: Always-on binary ring of recently routed packets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_PACKET_LOG_H
+#define BRICKD_PACKET_LOG_H
+
+#include <stdint.h>
+
+#include <daemonlib/packet.h>
+
+#include "stack.h"
+
+#define PACKET_LOG_MAGIC "BRICKDPL"
+#define PACKET_LOG_VERSION 1
+#define PACKET_LOG_STACK_NAME_LENGTH 64
+
+typedef enum {
+	PACKET_LOG_DIRECTION_REQUEST = 0, // received from a client
+	PACKET_LOG_DIRECTION_REQUEST_TO_STACK, // sent to a stack
+	PACKET_LOG_DIRECTION_RESPONSE // response or callback received from a stack
+} PacketLogDirection;
+
+#include <daemonlib/packed_begin.h>
+
+// all fields are little endian in the dump file. the records follow the stack
+// table, oldest first
+typedef struct {
+	char magic[8]; // PACKET_LOG_MAGIC, not NUL-terminated
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t record_count;
+	uint32_t stack_count;
+	uint64_t dropped_records; // overwritten since the start
+	uint64_t dump_time; // seconds since the epoch
+	uint64_t dump_timestamp; // microseconds, same clock as the record timestamps
+} ATTRIBUTE_PACKED PacketLogHeader;
+
+typedef struct {
+	uint16_t id;
+	char name[PACKET_LOG_STACK_NAME_LENGTH]; // truncated, not NUL-terminated if full
+} ATTRIBUTE_PACKED PacketLogStack;
+
+typedef struct {
+	uint64_t timestamp; // microseconds
+	uint64_t trace_id; // 0 if built without packet tracing
+	uint32_t uid; // as on the wire
+	uint16_t stack_id; // 0 if unknown
+	uint8_t function_id;
+	uint8_t sequence_number;
+	uint8_t direction;
+	uint8_t error_code;
+	uint8_t length;
+	uint8_t reserved[5];
+} ATTRIBUTE_PACKED PacketLogRecord;
+
+#include <daemonlib/packed_end.h>
+
+void packet_log_init(const char *dump_filename);
+void packet_log_exit(void);
+
+void packet_log_add(Packet *packet, PacketLogDirection direction, Stack *stack);
+
+int packet_log_dump(uint32_t *record_count);
+
+uint64_t packet_log_uint64_to_le(uint64_t native);
+
+#endif // BRICKD_PACKET_LOG_H
@@ -0,0 +1,216 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_ring.c: Ring buffer for variable-length packets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * a packet ring is a FIFO queue for packets of variable length. compared to
+ * a Queue with sizeof(Packet) items it only uses as much memory as the queued
+ * packets actually need. the buffer grows on demand up to a maximum size.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "packet_ring.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define PACKET_RING_INITIAL_SIZE 1024 // bytes
+
+// a header with length 0 marks the skipped rest of the buffer
+static uint32_t packet_ring_get_slot_length(Packet *packet) {
+	return ((uint32_t)packet->header.length + 3) & ~(uint32_t)3;
+}
+
+// moves the read position to the next packet, skipping the end of the buffer
+// if no packet is stored there
+static void packet_ring_skip_end(PacketRing *ring) {
+	uint32_t rest = ring->size - ring->head;
+
+	if (ring->count > 0 &&
+	    (rest < sizeof(PacketHeader) ||
+	     ((Packet *)&ring->buffer[ring->head])->header.length == 0)) {
+		ring->used -= rest;
+		ring->head = 0;
+	}
+}
+
+// sets errno on error
+static int packet_ring_grow(PacketRing *ring, uint32_t size) {
+	uint8_t *buffer = malloc(size);
+	uint32_t offset = 0;
+	uint32_t length;
+	Packet *packet;
+	int i;
+
+	if (buffer == NULL) {
+		errno = ENOMEM;
+
+		return -1;
+	}
+
+	// copy all packets to the front of the new buffer
+	for (i = 0; i < ring->count; ++i) {
+		packet_ring_skip_end(ring);
+
+		packet = (Packet *)&ring->buffer[ring->head];
+		length = packet_ring_get_slot_length(packet);
+
+		memcpy(&buffer[offset], packet, length);
+
+		offset += length;
+		ring->head += length;
+	}
+
+	free(ring->buffer);
+
+	ring->buffer = buffer;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = offset;
+	ring->used = offset;
+
+	return 0;
+}
+
+int packet_ring_create(PacketRing *ring, uint32_t max_size) {
+	// the buffer is allocated on first use
+	ring->buffer = NULL;
+	ring->size = 0;
+	ring->max_size = max_size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->used = 0;
+	ring->peak_used = 0;
+	ring->count = 0;
+
+	return 0;
+}
+
+void packet_ring_destroy(PacketRing *ring) {
+	free(ring->buffer);
+}
+
+// returns -1 and sets errno to ENOSPC if the ring is full, or to ENOMEM
+// if the buffer could not be grown
+int packet_ring_push(PacketRing *ring, Packet *packet) {
+	uint32_t length = packet_ring_get_slot_length(packet);
+	uint32_t rest;
+	uint32_t size;
+
+	for (;;) {
+		if (ring->count == 0 || ring->tail > ring->head) {
+			// not wrapped, free space is behind the tail and in front of the head
+			rest = ring->size - ring->tail;
+
+			if (length <= rest) {
+				break;
+			}
+
+			if (ring->count > 0 && length <= ring->head) {
+				// skip the rest of the buffer and wrap around
+				if (rest >= sizeof(PacketHeader)) {
+					((Packet *)&ring->buffer[ring->tail])->header.length = 0;
+				}
+
+				ring->used += rest;
+				ring->tail = 0;
+
+				break;
+			}
+
+			if (ring->count == 0) {
+				ring->head = 0;
+				ring->tail = 0;
+				ring->used = 0;
+
+				if (length <= ring->size) {
+					break;
+				}
+			}
+		} else if (length <= ring->head - ring->tail) {
+			// wrapped, free space is between the tail and the head
+			break;
+		}
+
+		if (ring->size >= ring->max_size) {
+			errno = ENOSPC;
+
+			return -1;
+		}
+
+		size = MIN(MAX(ring->size * 2, PACKET_RING_INITIAL_SIZE), ring->max_size);
+
+		if (size < length || packet_ring_grow(ring, size) < 0) {
+			errno = size < length ? ENOSPC : ENOMEM;
+
+			return -1;
+		}
+
+		log_debug("Grew packet ring %p to %u byte(s) for %d packet(s)",
+		          ring, ring->size, ring->count);
+	}
+
+	memcpy(&ring->buffer[ring->tail], packet, packet->header.length);
+
+	ring->tail += length;
+	ring->used += length;
+	++ring->count;
+
+	if (ring->used > ring->peak_used) {
+		ring->peak_used = ring->used;
+	}
+
+	return 0;
+}
+
+Packet *packet_ring_peek(PacketRing *ring) {
+	if (ring->count == 0) {
+		return NULL;
+	}
+
+	return (Packet *)&ring->buffer[ring->head];
+}
+
+void packet_ring_pop(PacketRing *ring) {
+	uint32_t length;
+
+	if (ring->count == 0) {
+		return;
+	}
+
+	length = packet_ring_get_slot_length((Packet *)&ring->buffer[ring->head]);
+
+	ring->head += length;
+	ring->used -= length;
+	--ring->count;
+
+	if (ring->count == 0) {
+		ring->head = 0;
+		ring->tail = 0;
+		ring->used = 0;
+	} else {
+		packet_ring_skip_end(ring);
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_ring.h: Ring buffer for variable-length packets
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_PACKET_RING_H
+#define BRICKD_PACKET_RING_H
+
+#include <stdint.h>
+
+#include <daemonlib/packet.h>
+
+// packets are stored back to back with their actual length, rounded up to a
+// multiple of 4 bytes. a packet never wraps around the end of the buffer. if
+// it does not fit at the end then the rest of the buffer is skipped
+typedef struct {
+	uint8_t *buffer;
+	uint32_t size; // bytes
+	uint32_t max_size; // bytes
+	uint32_t head; // offset of the oldest packet
+	uint32_t tail; // offset behind the newest packet
+	uint32_t used; // bytes, including skipped bytes at the end
+	uint32_t peak_used; // bytes
+	int count; // packets
+} PacketRing;
+
+int packet_ring_create(PacketRing *ring, uint32_t max_size);
+void packet_ring_destroy(PacketRing *ring);
+
+int packet_ring_push(PacketRing *ring, Packet *packet);
+Packet *packet_ring_peek(PacketRing *ring);
+void packet_ring_pop(PacketRing *ring);
+
+#endif // BRICKD_PACKET_RING_H
@@ -0,0 +1,73 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * pearson_hash.c: Pearson hash used as SPI stack checksum
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * every step of the pearson hash depends on the result of the previous step,
+ * so it cannot be vectorized. the loop is unrolled by four instead and keeps
+ * the hash in a full register, to avoid the loop overhead and the truncation
+ * of a uint8_t loop counter and hash value for every single byte.
+ */
+
+#include "pearson_hash.h"
+
+// We use the Pearson Hash for fast hashing
+// See: http://en.wikipedia.org/wiki/Pearson_hashing
+// the permutation table is taken from the original paper:
+// "Fast Hashing of Variable-Length Text Strings" by Peter K. Pearson,
+// pp. 677-680, CACM 33(6), June 1990.
+const uint8_t pearson_permutation[PEARSON_PERMUTATION_SIZE] = {
+	1, 87, 49, 12, 176, 178, 102, 166, 121, 193, 6, 84, 249, 230, 44, 163,
+	14, 197, 213, 181, 161, 85, 218, 80, 64, 239, 24, 226, 236, 142, 38, 200,
+	110, 177, 104, 103, 141, 253, 255, 50, 77, 101, 81, 18, 45, 96, 31, 222,
+	25, 107, 190, 70, 86, 237, 240, 34, 72, 242, 20, 214, 244, 227, 149, 235,
+	97, 234, 57, 22, 60, 250, 82, 175, 208, 5, 127, 199, 111, 62, 135, 248,
+	174, 169, 211, 58, 66, 154, 106, 195, 245, 171, 17, 187, 182, 179, 0, 243,
+	132, 56, 148, 75, 128, 133, 158, 100, 130, 126, 91, 13, 153, 246, 216, 219,
+	119, 68, 223, 78, 83, 88, 201, 99, 122, 11, 92, 32, 136, 114, 52, 10,
+	138, 30, 48, 183, 156, 35, 61, 26, 143, 74, 251, 94, 129, 162, 63, 152,
+	170, 7, 115, 167, 241, 206, 3, 150, 55, 59, 151, 220, 90, 53, 23, 131,
+	125, 173, 15, 238, 79, 95, 89, 16, 105, 137, 225, 224, 217, 160, 37, 123,
+	118, 73, 2, 157, 46, 116, 9, 145, 134, 228, 207, 212, 202, 215, 69, 229,
+	27, 188, 67, 124, 168, 252, 42, 4, 29, 108, 21, 247, 19, 205, 39, 203,
+	233, 40, 186, 147, 198, 192, 155, 33, 164, 191, 98, 204, 165, 180, 117, 76,
+	140, 36, 210, 172, 41, 54, 159, 8, 185, 232, 113, 196, 231, 47, 146, 120,
+	51, 65, 28, 144, 254, 221, 93, 189, 194, 139, 112, 43, 71, 109, 184, 209
+};
+
+uint8_t pearson_hash(const uint8_t *data, int length) {
+	const uint8_t *table = pearson_permutation;
+	const uint8_t *end = data + length;
+	unsigned int hash = 0;
+
+	while (end - data >= 4) {
+		hash = table[hash ^ data[0]];
+		hash = table[hash ^ data[1]];
+		hash = table[hash ^ data[2]];
+		hash = table[hash ^ data[3]];
+		data += 4;
+	}
+
+	while (data < end) {
+		hash = table[hash ^ *data++];
+	}
+
+	return (uint8_t)hash;
+}
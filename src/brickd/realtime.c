@@ -0,0 +1,123 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * realtime.c: Real-time scheduling and wakeup jitter measurement
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "realtime.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define REALTIME_JITTER_STORE(field, value) \
+	__atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+// applies to the calling thread. priority 0 keeps the normal scheduling
+// policy and a negative cpu keeps the current CPU affinity
+int realtime_set_thread_profile(const char *name, int priority, int cpu) {
+	struct sched_param param;
+	cpu_set_t cpus;
+	int result = 0;
+	int rc;
+
+	if (priority > 0) {
+		memset(&param, 0, sizeof(param));
+
+		param.sched_priority = priority;
+
+		rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+		if (rc != 0) {
+			log_warn("Could not set real-time priority %d for %s thread: %s (%d)",
+			         priority, name, get_errno_name(rc), rc);
+
+			result = -1;
+		} else {
+			log_info("Running %s thread with real-time priority %d", name, priority);
+		}
+	}
+
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+
+		rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+		if (rc != 0) {
+			log_warn("Could not bind %s thread to CPU %d: %s (%d)",
+			         name, cpu, get_errno_name(rc), rc);
+
+			result = -1;
+		} else {
+			log_info("Bound %s thread to CPU %d", name, cpu);
+		}
+	}
+
+	return result;
+}
+
+// keeps all current and future pages of the process in RAM, so the real-time
+// threads don't stall on page faults
+int realtime_lock_memory(void) {
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		log_warn("Could not lock memory: %s (%d)", get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	log_info("Locked memory");
+
+	return 0;
+}
+
+void realtime_jitter_add(RealtimeJitter *jitter, uint64_t lateness) {
+	int bucket = 0;
+
+	while (bucket < REALTIME_JITTER_BUCKETS - 1 && lateness >= (uint64_t)10 << bucket) {
+		++bucket;
+	}
+
+	REALTIME_JITTER_STORE(jitter->wakeups, jitter->wakeups + 1);
+	REALTIME_JITTER_STORE(jitter->total_lateness, jitter->total_lateness + lateness);
+	REALTIME_JITTER_STORE(jitter->histogram[bucket], jitter->histogram[bucket] + 1);
+
+	if (lateness > jitter->max_lateness) {
+		REALTIME_JITTER_STORE(jitter->max_lateness, lateness > UINT32_MAX ? UINT32_MAX : (uint32_t)lateness);
+	}
+}
+
+void realtime_jitter_get(RealtimeJitter *jitter, RealtimeJitter *copy) {
+	int i;
+
+	copy->wakeups = __atomic_load_n(&jitter->wakeups, __ATOMIC_RELAXED);
+	copy->max_lateness = __atomic_load_n(&jitter->max_lateness, __ATOMIC_RELAXED);
+	copy->total_lateness = __atomic_load_n(&jitter->total_lateness, __ATOMIC_RELAXED);
+
+	for (i = 0; i < REALTIME_JITTER_BUCKETS; ++i) {
+		copy->histogram[i] = __atomic_load_n(&jitter->histogram[i], __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * realtime.h: Real-time scheduling and wakeup jitter measurement
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_REALTIME_H
+#define BRICKD_REALTIME_H
+
+#include <stdint.h>
+
+#define REALTIME_JITTER_BUCKETS 10
+
+// lateness of wakeups compared to their scheduled time. written by a single
+// thread, other threads read it with realtime_jitter_get. bucket 0 counts
+// wakeups less than 10 microseconds late, bucket i counts wakeups from
+// 10 * 2^(i-1) up to 10 * 2^i microseconds late and the last bucket counts
+// everything from 10 * 2^(REALTIME_JITTER_BUCKETS-2) microseconds upwards
+typedef struct {
+	uint32_t wakeups;
+	uint32_t max_lateness; // microseconds
+	uint64_t total_lateness; // microseconds
+	uint32_t histogram[REALTIME_JITTER_BUCKETS];
+} RealtimeJitter;
+
+int realtime_set_thread_profile(const char *name, int priority, int cpu);
+int realtime_lock_memory(void);
+
+void realtime_jitter_add(RealtimeJitter *jitter, uint64_t lateness /* microseconds */);
+void realtime_jitter_get(RealtimeJitter *jitter, RealtimeJitter *copy);
+
+#endif // BRICKD_REALTIME_H
@@ -47,6 +47,7 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 #define EXTENSION_EEPROM_RS485_BAUDRATE_LOCATION                 400
 #define EXTENSION_EEPROM_RS485_PARTIY_LOCATION                   404
 #define EXTENSION_EEPROM_RS485_STOPBITS_LOCATION                 405
+#define EXTENSION_EEPROM_RS485_SERIAL_SIZE                       6 // baudrate up to stopbits
 
 #define EXTENSION_EEPROM_ETHERNET_MAC_ADDRESS                    (32*4)
 
@@ -290,8 +291,13 @@ cleanup:
 	return ret;
 }
 
+// Every i2c_eeprom_read is a separate I2C transaction with EEPROM selection,
+// so the fields are read in as few blocks as possible: the address, the
+// adjacent baudrate, parity and stopbits, and the whole slave address list
 int red_extension_read_rs485_config(I2CEEPROM *i2c_eeprom, ExtensionRS485Config *config) {
-	uint8_t buf[4];
+	uint8_t buf[EXTENSION_EEPROM_RS485_SERIAL_SIZE];
+	uint8_t slave_buf[EXTENSION_RS485_SLAVES_MAX * 4];
+	uint8_t *p;
 
 	// address
 	if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_ADDRESS_LOCATION, buf, 4) < 4) {
@@ -302,9 +308,10 @@ int red_extension_read_rs485_config(I2CEEPROM *i2c_eeprom, ExtensionRS485Config
 
 	config->address = (buf[0] << 0) | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
 
-	// baudrate
-	if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_BAUDRATE_LOCATION, buf, 4) < 4) {
-		log_error("Could not read RS485 baudrate from EEPROM");
+	// baudrate, parity and stopbits
+	if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_BAUDRATE_LOCATION, buf,
+	                    EXTENSION_EEPROM_RS485_SERIAL_SIZE) < EXTENSION_EEPROM_RS485_SERIAL_SIZE) {
+		log_error("Could not read RS485 baudrate, parity and stopbits from EEPROM");
 
 		return -1;
 	}
@@ -317,45 +324,34 @@ int red_extension_read_rs485_config(I2CEEPROM *i2c_eeprom, ExtensionRS485Config
 		return -1;
 	}
 
-	// parity
-	if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_PARTIY_LOCATION, buf, 1) < 1) {
-		log_error("Could not read RS485 parity from EEPROM");
-
-		return -1;
-	}
+	p = &buf[EXTENSION_EEPROM_RS485_PARTIY_LOCATION - EXTENSION_EEPROM_RS485_BAUDRATE_LOCATION];
 
-	if (buf[0] == EXTENSION_RS485_PARITY_NONE) {
+	if (*p == EXTENSION_RS485_PARITY_NONE) {
 		config->parity = EXTENSION_RS485_PARITY_NONE;
-	} else if (buf[0] == EXTENSION_RS485_PARITY_EVEN) {
+	} else if (*p == EXTENSION_RS485_PARITY_EVEN) {
 		config->parity = EXTENSION_RS485_PARITY_EVEN;
 	} else {
 		config->parity = EXTENSION_RS485_PARITY_ODD;
 	}
 
-	// stopbits
-	if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_STOPBITS_LOCATION, buf, 1) < 1) {
-		log_error("Could not read RS485 stopbits from EEPROM");
-
-		return -1;
-	}
-
-	config->stopbits = buf[0];
+	config->stopbits = buf[EXTENSION_EEPROM_RS485_STOPBITS_LOCATION - EXTENSION_EEPROM_RS485_BAUDRATE_LOCATION];
 
-	// slave addresses
+	// slave addresses, terminated by 0 if less than EXTENSION_RS485_SLAVES_MAX
 	if (config->address == 0) {
-		config->slave_num = 0;
-		uint16_t current_eeprom_location = EXTENSION_EEPROM_RS485_SLAVE_ADDRESSES_START_LOCATION;
 		uint32_t current_slave_address;
 
+		if (i2c_eeprom_read(i2c_eeprom, EXTENSION_EEPROM_RS485_SLAVE_ADDRESSES_START_LOCATION,
+		                    slave_buf, sizeof(slave_buf)) < (int)sizeof(slave_buf)) {
+			log_error("Could not read RS485 slave addresses from EEPROM");
+			return -1;
+		}
+
+		config->slave_num = 0;
 		config->slave_address[0] = 0;
 
 		while (config->slave_num < EXTENSION_RS485_SLAVES_MAX) {
-			if (i2c_eeprom_read(i2c_eeprom, current_eeprom_location, buf, 4) < 4) {
-				log_error("Could not read RS485 slave addresses from EEPROM");
-				return -1;
-			}
-
-			current_slave_address = (buf[0] << 0) | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
+			p = &slave_buf[config->slave_num * 4];
+			current_slave_address = (p[0] << 0) | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
 
 			config->slave_address[config->slave_num] = current_slave_address;
 
@@ -364,7 +360,6 @@ int red_extension_read_rs485_config(I2CEEPROM *i2c_eeprom, ExtensionRS485Config
 			}
 
 			config->slave_num++;
-			current_eeprom_location += 4;
 		}
 	}
 
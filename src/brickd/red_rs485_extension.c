@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -51,8 +52,14 @@
 
 #include "red_rs485_extension.h"
 
+#include "client.h"
+#include "crc16.h"
+#include "event_profile.h"
+#include "fair_queue.h"
 #include "hardware.h"
 #include "network.h"
+#include "packet_debug.h"
+#include "realtime.h"
 #include "stack.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
@@ -81,8 +88,23 @@ static uint64_t TIMEOUT = 0;
 // delay between polls in nanoseconds. configurable with brickd.conf option poll_delay.rs485 in microseconds
 static uint64_t MASTER_POLL_SLAVE_INTERVAL = 40000000;
 static uint32_t TIMEOUT_BYTES = 86;
-static uint64_t last_timer_enable_at_uS = 0;
-static uint64_t time_passed_from_last_timer_enable = 0;
+// number of request/response exchanges with a slave that has queued requests
+// before the next slave is polled. configurable with brickd.conf option
+// rs485.frames_per_turn
+static int MASTER_FRAMES_PER_TURN = 1;
+// maximum number of poll turns an idle slave is skipped. configurable with
+// brickd.conf option poll_backoff.rs485
+static int MASTER_POLL_BACKOFF_MAX = 8;
+// learn a response timeout per slave from its measured turnaround instead of
+// using TIMEOUT for all of them. configurable with brickd.conf options
+// rs485.adaptive_timeout, rs485.timeout_min and rs485.timeout_max in
+// microseconds. bounds in nanoseconds, a maximum of 0 stands for TIMEOUT
+static bool MASTER_ADAPTIVE_TIMEOUT = true;
+static uint64_t MASTER_TIMEOUT_MIN = 2000000;
+static uint64_t MASTER_TIMEOUT_MAX = 0;
+// nanoseconds to transfer one byte with the configured baudrate, parity and
+// stop bits
+static uint64_t BYTE_TIME = 0;
 
 // Frame related constants
 #define RS485_FRAME_HEADER_LENGTH      3
@@ -92,65 +114,8 @@ static uint64_t time_passed_from_last_timer_enable = 0;
 #define RS485_FRAME_OVERHEAD           RS485_FRAME_HEADER_LENGTH + RS485_FRAME_FOOTER_LENGTH
 #define RS485_FRAME_MAX_CONTENT_DUMP_LENGTH (((int)sizeof(Packet) + RS485_FRAME_OVERHEAD) * 3 + 1)
 
-// Table of CRC values for high-order byte
-static const uint8_t table_crc_hi[] = {
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-	0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-	0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-	0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-	0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-	0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-	0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-	0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-	0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-	0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-	0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40,
-	0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1,
-	0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
-	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
-	0x80, 0x41, 0x00, 0xC1, 0x81, 0x40
-};
-
-// Table of CRC values for low-order byte
-static const uint8_t table_crc_lo[] = {
-	0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06,
-	0x07, 0xC7, 0x05, 0xC5, 0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD,
-	0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
-	0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A,
-	0x1E, 0xDE, 0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC, 0x14, 0xD4,
-	0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
-	0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3,
-	0xF2, 0x32, 0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4,
-	0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
-	0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29,
-	0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF, 0x2D, 0xED,
-	0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
-	0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60,
-	0x61, 0xA1, 0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67,
-	0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
-	0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68,
-	0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA, 0xBE, 0x7E,
-	0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
-	0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71,
-	0x70, 0xB0, 0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92,
-	0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
-	0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B,
-	0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89, 0x4B, 0x8B,
-	0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
-	0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42,
-	0x43, 0x83, 0x41, 0x81, 0x80, 0x40
-};
+// Scheduling related constants
+#define RS485_MASTER_MAX_PRIORITY_TURNS 4 // then do one regular round-robin turn
 
 // Data structure definitions
 typedef struct {
@@ -161,7 +126,13 @@ typedef struct {
 typedef struct {
 	uint8_t address;
 	uint8_t sequence;
-	Queue packet_queue;
+	FairQueue packet_queue; // scheduled fairly between clients
+	int poll_backoff; // number of turns to skip after the next idle poll
+	int polls_to_skip; // remaining turns to skip before polling an idle slave
+	bool has_turnaround;
+	uint64_t turnaround; // smoothed response time without transfer time, in nanoseconds
+	uint64_t turnaround_deviation; // smoothed mean deviation of the turnaround, in nanoseconds
+	uint64_t timeout; // of the last request, in nanoseconds
 } RS485Slave;
 
 typedef struct {
@@ -182,6 +153,11 @@ static int _red_rs485_serial_fd = -1; // Serial interface file descriptor
 // Variables tracking current states
 static char current_request_as_byte_array[sizeof(Packet) + RS485_FRAME_OVERHEAD] = {0};
 static int master_current_slave_to_process = -1; // Only used used by master
+static int master_frames_left_in_turn = 0; // Only used used by master
+static int master_next_regular_slave = 0; // Only used used by master
+static int master_priority_turns = 0; // Only used used by master
+static uint64_t master_request_sent_at = 0; // Only used used by master, in nanoseconds
+static int master_request_length = 0; // Only used used by master
 
 // Receive buffer
 #include <daemonlib/packed_begin.h>
@@ -201,12 +177,21 @@ static union {
 #include <daemonlib/packed_end.h>
 
 static int _receive_buffer_used = 0;
+static int _receive_frame_length = 0; // 0 until the length byte of the current frame is received
+static uint16_t _receive_crc16 = CRC16_INITIAL_VALUE; // CRC16 of the first _receive_crc16_length bytes
+static int _receive_crc16_length = 0;
 
 // Events
 static int _master_timer_event = 0;
 
-// Timers
+// Timers. The master timer is armed with absolute CLOCK_MONOTONIC deadlines,
+// so a re-arm after an early wakeup does not push the deadline back
 static struct itimerspec master_timer;
+static struct timespec master_timer_deadline;
+static bool master_timer_armed = false;
+
+// lateness of the master timer handler compared to the armed deadline
+static RealtimeJitter master_timer_jitter;
 
 // Used as boolean
 static bool _initialized = false;
@@ -218,37 +203,67 @@ static bool master_poll_interval = false;
 static GPIOPin _rx_pin; // Active low
 
 // Function prototypes
-uint16_t crc16(uint8_t*, uint16_t);
 int serial_interface_init(const char*);
-void verify_buffer(void);
+bool verify_buffer(void);
 void send_packet(void);
 void init_rxe_pin_state(int);
 void serial_data_available_handler(void*);
 void master_poll_slave(void);
 void master_timeout_handler(void*);
-int red_rs485_extension_dispatch_to_rs485(Stack*, Packet*, Recipient*);
+int red_rs485_extension_dispatch_to_rs485(Stack*, Packet*, Recipient*, Client*);
 void disable_master_timer(void);
+void arm_master_timer(uint64_t delay);
 void pop_packet_from_slave_queue(void);
 bool is_current_request_empty(void);
 void seq_pop_poll(void);
 void arm_master_poll_slave_interval_timer(void);
+void master_finish_exchange(void);
+void master_select_next_slave(void);
+void master_mark_slave_active(void);
+void master_mark_slave_idle(void);
 bool init_crc_error_count_to_fs(void);
 static void update_crc_error_count_to_fs(void *opaque);
+static void master_add_turnaround_sample(int response_length);
 
-// CRC16 function
-uint16_t crc16(uint8_t *buffer, uint16_t buffer_length) {
-	uint8_t crc_hi = 0xFF; // High CRC byte initialized
-	uint8_t crc_lo = 0xFF; // Low CRC byte initialized
-	int i;
+// Reset the CRC16 of the receive buffer, whenever its content is discarded
+static void receive_crc16_reset(void) {
+	_receive_crc16 = CRC16_INITIAL_VALUE;
+	_receive_crc16_length = 0;
+}
 
-	// Pass through message buffer
-	while (buffer_length--) {
-		i = crc_hi ^ *buffer++; // Calculate the CRC
-		crc_hi = crc_lo ^ table_crc_hi[i];
-		crc_lo = table_crc_lo[i];
+// Extend the CRC16 of the receive buffer up to the given length, so the CRC16
+// of a frame is already known when its last byte arrives
+static void receive_crc16_update(int length) {
+	if (length > _receive_buffer_used) {
+		length = _receive_buffer_used;
 	}
 
-	return (crc_hi << 8 | crc_lo);
+	if (length > _receive_crc16_length) {
+		_receive_crc16 = crc16_update(_receive_crc16, _receive.buffer + _receive_crc16_length,
+		                              length - _receive_crc16_length);
+		_receive_crc16_length = length;
+	}
+}
+
+// Discard the content of the receive buffer. Only the used part is cleared
+static void reset_receive_buffer(void) {
+	memset(_receive.buffer, 0, _receive_buffer_used);
+	_receive_buffer_used = 0;
+	_receive_frame_length = 0;
+	receive_crc16_reset();
+}
+
+// Get the CRC16 of the first length bytes of the receive buffer
+static uint16_t receive_crc16_get(int length) {
+	// A malformed length byte can make a short frame look longer while
+	// it is received, start over in that case
+	if (_receive_crc16_length > length) {
+		receive_crc16_reset();
+	}
+
+	receive_crc16_update(length);
+
+	return crc16_finalize(_receive_crc16);
 }
 
 // Function for initializing the serial interface
@@ -386,7 +401,7 @@ char *frame_get_content_dump(char *content_dump, uint8_t *frame, int length) {
 }
 
 // Verify packet
-void verify_buffer(void) {
+bool verify_buffer(void) {
 	int frame_length;
 	uint16_t crc16_calculated;
 	uint16_t crc16_on_packet;
@@ -395,31 +410,39 @@ void verify_buffer(void) {
 	char frame_content_dump[RS485_FRAME_MAX_CONTENT_DUMP_LENGTH];
 	char base58[BASE58_MAX_LENGTH];
 
-	// Check if length byte is available
-	if (_receive_buffer_used < 8) {
-		return;
+	// Calculate packet end index once the length byte is available
+	if (_receive_frame_length == 0) {
+		if (_receive_buffer_used < 8) {
+			return false;
+		}
+
+		_receive_frame_length = RS485_FRAME_HEADER_LENGTH + _receive.packet.header.length + RS485_FRAME_FOOTER_LENGTH;
 	}
 
-	// Calculate packet end index
-	frame_length = RS485_FRAME_HEADER_LENGTH + _receive.packet.header.length + RS485_FRAME_FOOTER_LENGTH;
+	frame_length = _receive_frame_length;
 
 	// Check if complete packet is available
 	if (_receive_buffer_used < frame_length) {
-		return;
+		return false;
 	}
 
 	// If send verify flag was set
 	if (send_verify_flag) {
-		for (i = 0; i < frame_length; i++) {
-			if (_receive.buffer[i] != current_request_as_byte_array[i]) {
-				// Move on to next slave
-				disable_master_timer();
-				log_error("Send verification failed (offset: %d, actual: %u != expected: %u)",
-				          i, _receive.buffer[i], current_request_as_byte_array[i]);
-				seq_pop_poll();
-
-				return;
+		if (frame_length > (int)sizeof(current_request_as_byte_array) ||
+		    memcmp(_receive.buffer, current_request_as_byte_array, frame_length) != 0) {
+			for (i = 0; i < frame_length - 1 && i < (int)sizeof(current_request_as_byte_array) - 1; i++) {
+				if (_receive.buffer[i] != (uint8_t)current_request_as_byte_array[i]) {
+					break;
+				}
 			}
+
+			// Move on to next slave
+			disable_master_timer();
+			log_error("Send verification failed (offset: %d, actual: %u != expected: %u)",
+			          i, _receive.buffer[i], (uint8_t)current_request_as_byte_array[i]);
+			seq_pop_poll();
+
+			return false;
 		}
 
 		// Send verify successful. Reset flag
@@ -433,47 +456,45 @@ void verify_buffer(void) {
 			if (sent_ack_of_data_packet == 1) {
 				log_packet_debug("Processed current request");
 				++_red_rs485_extension.slaves[master_current_slave_to_process].sequence;
-				queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
+				fair_queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
 			}
 
-			// Poll next slave after the configured timeout
-			arm_master_poll_slave_interval_timer();
+			// Continue with the current slave or poll the next one
+			master_finish_exchange();
 
-			return;
+			return false;
 		} else if (_receive_buffer_used == frame_length) {
 			// Everything OK. Wait for response now
 			log_packet_debug("No more Data. Waiting for response");
-			_receive_buffer_used = 0;
-			memset(_receive.buffer, 0, RECEIVE_BUFFER_SIZE);
+			reset_receive_buffer();
 
-			return;
+			return false;
 		} else if (_receive_buffer_used > frame_length) {
 			// More data in the receive buffer
 			log_packet_debug("Potential partial data in the buffer. Verifying");
 
 			memmove(_receive.buffer, _receive.buffer + frame_length,
 			        _receive_buffer_used - frame_length);
+			memset(_receive.buffer + _receive_buffer_used - frame_length, 0, frame_length);
 
 			_receive_buffer_used -= frame_length;
+			_receive_frame_length = 0;
+			receive_crc16_reset();
 
-			// A recursive call to handle the remaining bytes in the buffer
-			if (_receive_buffer_used >= 8) {
-				verify_buffer(); // FIXME: turn this into an external loop
-			}
-
-			return;
+			// Let the caller handle the remaining bytes in the buffer
+			return true;
 		} else {
 			// Undefined state
 			disable_master_timer();
 			log_error("Undefined receive buffer state");
 			seq_pop_poll();
 
-			return;
+			return false;
 		}
 	}
 
 	// Checking the CRC16 checksum
-	crc16_calculated = crc16(_receive.buffer, frame_length - RS485_FRAME_FOOTER_LENGTH);
+	crc16_calculated = receive_crc16_get(frame_length - RS485_FRAME_FOOTER_LENGTH);
 	crc16_on_packet = (_receive.buffer[frame_length - 2] << 8) | _receive.buffer[frame_length - 1];
 
 	if (crc16_calculated != crc16_on_packet) {
@@ -487,7 +508,7 @@ void verify_buffer(void) {
 		          crc16_calculated, crc16_on_packet);
 		seq_pop_poll();
 
-		return;
+		return false;
 	}
 
 	// Checking address
@@ -499,7 +520,7 @@ void verify_buffer(void) {
 		          _receive.frame.address, current_request_as_byte_array[0]);
 		seq_pop_poll();
 
-		return;
+		return false;
 	}
 
 	// Checking function code
@@ -511,7 +532,7 @@ void verify_buffer(void) {
 		          _receive.frame.function_code, current_request_as_byte_array[1]);
 		seq_pop_poll();
 
-		return;
+		return false;
 	}
 
 	// Received empty packet from the other side (UID=0, FID=0)
@@ -525,24 +546,34 @@ void verify_buffer(void) {
 			          _receive.frame.sequence_number, current_request_as_byte_array[2]);
 			seq_pop_poll();
 
-			return;
+			return false;
 		}
 
 		disable_master_timer();
+		master_add_turnaround_sample(frame_length);
 
 		log_packet_debug("Received empty response");
 
+		if (is_current_request_empty()) {
+			master_mark_slave_idle();
+		}
+
 		// Updating sequence number
 		++_red_rs485_extension.slaves[master_current_slave_to_process].sequence;
 
 		// Popping slave's packet queue
-		queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
+		fair_queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
 
-		// Poll next slave after the configured timeout
-		arm_master_poll_slave_interval_timer();
+		// Continue with the current slave or poll the next one
+		master_finish_exchange();
+
+		// The exchange is done, the next frame belongs to the next request
+		return false;
 	}
 	// Received data packet from the other side
 	else if (_receive.packet.header.uid != 0 && _receive.packet.header.function_id != 0) {
+		master_add_turnaround_sample(frame_length);
+
 		// Checking current sequence number
 		if (_receive.frame.sequence_number != current_request_as_byte_array[2]) {
 			log_warn("Received data response (frame: %s) with sequence number mismatch (actual: %u != expected: %u)",
@@ -551,25 +582,27 @@ void verify_buffer(void) {
 		} else {
 			log_packet_debug("Received data response");
 
+			master_mark_slave_active();
+
 			stack_add_recipient(&_red_rs485_extension.base, _receive.packet.header.uid, _receive.frame.address); // FIXME: check return value
 
 			// Send message into brickd dispatcher
 			network_dispatch_response(&_receive.packet);
 		}
 
-		queue_packet = queue_peek(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
+		queue_packet = fair_queue_peek(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
 
 		if (queue_packet == NULL) {
 			log_warn("Sending ACK for unexpected data response");
 
-			queue_packet = queue_push(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
+			queue_packet = fair_queue_push(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
 
 			if (queue_packet == NULL) {
 				log_error("Could not push empty request to packet queue for slave %d: %s (%d)",
 				          _red_rs485_extension.slaves[master_current_slave_to_process].address,
 				          get_errno_name(errno), errno);
 
-				return; // FIXME
+				return false; // FIXME
 			}
 
 			sent_ack_of_data_packet = 2;
@@ -582,12 +615,14 @@ void verify_buffer(void) {
 		queue_packet->tries_left = RS485_FRAME_TRIES_EMPTY;
 		queue_packet->packet.header.length = 8;
 
-		_receive_buffer_used = 0;
-		memset(_receive.buffer, 0, RECEIVE_BUFFER_SIZE);
+		reset_receive_buffer();
 
 		log_packet_debug("Sending ACK of the data response");
 
 		send_packet();
+
+		// The receive buffer was reset for the send verification of the ACK
+		return false;
 	} else {
 		// Undefined packet
 		disable_master_timer();
@@ -597,9 +632,61 @@ void verify_buffer(void) {
 		          _receive.packet.header.length,
 		          _receive.packet.header.function_id);
 		seq_pop_poll();
+
+		// The receive buffer is left as is, don't verify the same frame again
+		return false;
 	}
 }
 
+static uint64_t master_get_time(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// The request is sent and a response of maximum length is received within
+// the timeout, plus the time the slave needs to start its response. Only the
+// latter is learned per slave, the transfer times follow from the baudrate
+static uint64_t master_get_timeout(RS485Slave *slave, int request_length) {
+	uint64_t maximum = MASTER_TIMEOUT_MAX > 0 ? MASTER_TIMEOUT_MAX : TIMEOUT;
+	uint64_t minimum = MIN(MASTER_TIMEOUT_MIN, maximum);
+	uint64_t timeout;
+
+	if (!MASTER_ADAPTIVE_TIMEOUT || !slave->has_turnaround) {
+		return TIMEOUT;
+	}
+
+	timeout = (uint64_t)(request_length + (int)sizeof(Packet) + RS485_FRAME_OVERHEAD) * BYTE_TIME +
+	          slave->turnaround + 4 * slave->turnaround_deviation;
+
+	return MAX(minimum, MIN(timeout, maximum));
+}
+
+// The current slave responded to the last request. The smoothing follows the
+// retransmission timer of TCP (RFC 6298) with gains of 1/8 and 1/4
+static void master_add_turnaround_sample(int response_length) {
+	RS485Slave *slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
+	uint64_t round_trip = master_get_time() - master_request_sent_at;
+	uint64_t transfer = (uint64_t)(master_request_length + response_length) * BYTE_TIME;
+	uint64_t sample = round_trip > transfer ? round_trip - transfer : 0;
+	uint64_t deviation;
+
+	if (!slave->has_turnaround) {
+		slave->has_turnaround = true;
+		slave->turnaround = sample;
+		slave->turnaround_deviation = sample / 2;
+
+		return;
+	}
+
+	deviation = sample > slave->turnaround ? sample - slave->turnaround : slave->turnaround - sample;
+
+	slave->turnaround_deviation = (3 * slave->turnaround_deviation + deviation) / 4;
+	slave->turnaround = (7 * slave->turnaround + sample) / 8;
+}
+
 // Send packet
 void send_packet(void) {
 	uint16_t packet_crc16 = 0;
@@ -608,7 +695,7 @@ void send_packet(void) {
 	RS485ExtensionPacket* packet_to_send = NULL;
 
 	current_slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
-	packet_to_send = queue_peek(&current_slave->packet_queue);
+	packet_to_send = fair_queue_peek(&current_slave->packet_queue);
 
 	if (packet_to_send == NULL) {
 		// Slave's packet queue is empty. Move on to next slave
@@ -657,13 +744,12 @@ void send_packet(void) {
 
 	log_packet_debug("Sent packet");
 
+	master_request_sent_at = master_get_time();
+	master_request_length = (int)sizeof(rs485_packet);
+	current_slave->timeout = master_get_timeout(current_slave, master_request_length);
+
 	// Start the master timer
-	master_timer.it_interval.tv_sec = 0;
-	master_timer.it_interval.tv_nsec = 0;
-	master_timer.it_value.tv_sec = 0;
-	master_timer.it_value.tv_nsec = TIMEOUT;
-	timerfd_settime(_master_timer_event, 0, &master_timer, NULL);
-	last_timer_enable_at_uS = microseconds();
+	arm_master_timer(current_slave->timeout);
 }
 
 // Initialize RX state
@@ -689,6 +775,41 @@ void init_rxe_pin_state(int extension) {
 	log_info("Initialized RS485 RXE state");
 }
 
+// Arm the master timer to expire delay nanoseconds from now
+void arm_master_timer(uint64_t delay) {
+	clock_gettime(CLOCK_MONOTONIC, &master_timer_deadline);
+
+	delay += (uint64_t)master_timer_deadline.tv_nsec;
+
+	master_timer_deadline.tv_sec += (time_t)(delay / 1000000000);
+	master_timer_deadline.tv_nsec = (long)(delay % 1000000000);
+
+	master_timer.it_interval.tv_sec = 0;
+	master_timer.it_interval.tv_nsec = 0;
+	master_timer.it_value = master_timer_deadline;
+	timerfd_settime(_master_timer_event, TFD_TIMER_ABSTIME, &master_timer, NULL);
+	master_timer_armed = true;
+}
+
+static bool master_timer_deadline_passed(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec > master_timer_deadline.tv_sec ||
+	       (now.tv_sec == master_timer_deadline.tv_sec && now.tv_nsec >= master_timer_deadline.tv_nsec);
+}
+
+// Microseconds since the deadline of the master timer passed
+static uint64_t master_timer_get_lateness(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)(now.tv_sec - master_timer_deadline.tv_sec) * 1000000000 +
+	        (uint64_t)now.tv_nsec - (uint64_t)master_timer_deadline.tv_nsec) / 1000;
+}
+
 void disable_master_timer(void) {
 	uint64_t dummy_read_buffer = 0;
 	if (robust_read(_master_timer_event, &dummy_read_buffer, sizeof(uint64_t)) < 0) {}
@@ -697,6 +818,7 @@ void disable_master_timer(void) {
 	master_timer.it_value.tv_sec = 0;
 	master_timer.it_value.tv_nsec = 0;
 	timerfd_settime(_master_timer_event, 0, &master_timer, NULL);
+	master_timer_armed = false;
 	log_debug("Disabled master timer");
 }
 
@@ -725,26 +847,42 @@ void serial_data_available_handler(void* opaque) {
 	}
 
 	_receive_buffer_used += bytes_received;
-	verify_buffer();
+
+	// Only the frame header and the packet are covered by the CRC16. Before the
+	// length byte is available all received bytes belong to them
+	if (_receive_buffer_used < 8) {
+		receive_crc16_update(_receive_buffer_used);
+	} else {
+		receive_crc16_update(RS485_FRAME_HEADER_LENGTH + _receive.packet.header.length);
+	}
+
+	// Wait for the rest of a frame whose length is already known
+	if (_receive_frame_length > 0 && _receive_buffer_used < _receive_frame_length) {
+		return;
+	}
+
+	// Verify frames until the receive buffer holds no complete frame anymore
+	while (verify_buffer()) {}
 }
 
+EVENT_PROFILE_HANDLER(serial_data_available_handler, "rs485")
+
 // Master polling slave event handler
 void master_poll_slave(void) {
 	RS485ExtensionPacket* slave_queue_packet;
 	sent_ack_of_data_packet = 0;
-	_receive_buffer_used = 0;
-	memset(_receive.buffer, 0, RECEIVE_BUFFER_SIZE);
+	reset_receive_buffer();
 
 	// Updating current slave to process
-	if (++master_current_slave_to_process >= _red_rs485_extension.slave_num) {
-		master_current_slave_to_process = 0;
-	}
+	master_select_next_slave();
 
 	log_debug("Updated current RS485 slave's index");
 
+	master_frames_left_in_turn = MASTER_FRAMES_PER_TURN;
+
 	if (_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue.count == 0) {
 		// Nothing to send in the slave's queue. So send a poll packet
-		slave_queue_packet = queue_push(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
+		slave_queue_packet = fair_queue_push(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
 
 		if (slave_queue_packet == NULL) {
 			log_error("Could not push empty request to packet queue for slave %d: %s (%d)",
@@ -777,27 +915,25 @@ void master_poll_slave(void) {
 
 // Master timer event handler
 void master_timeout_handler(void* opaque) {
+	uint64_t expirations = 0;
+	RS485Slave *slave;
+
 	(void)opaque;
 
-	disable_master_timer();
+	// The event loop can still report an expiration of the timer after it was
+	// disabled or armed again in the same iteration. Just consume such a stale
+	// expiration, the absolute deadline of an armed timer stays in place
+	if (robust_read(_master_timer_event, &expirations, sizeof(uint64_t)) < 0) {}
 
-	if (master_poll_interval) {
-		// For some unknown reason the timer randomly times out or this timeout function is called
-		// much long before the actual timeout. This is a fix to this problem
-		// until we find the real problem
-		time_passed_from_last_timer_enable = (microseconds() - last_timer_enable_at_uS) * 1000;
-
-		if (time_passed_from_last_timer_enable < MASTER_POLL_SLAVE_INTERVAL) {
-			master_timer.it_interval.tv_sec = 0;
-			master_timer.it_interval.tv_nsec = 0;
-			master_timer.it_value.tv_sec = 0;
-			master_timer.it_value.tv_nsec = MASTER_POLL_SLAVE_INTERVAL;
-			timerfd_settime(_master_timer_event, 0, &master_timer, NULL);
-			last_timer_enable_at_uS = microseconds();
+	if (!master_timer_armed || !master_timer_deadline_passed()) {
+		return;
+	}
 
-			return;
-		}
+	realtime_jitter_add(&master_timer_jitter, master_timer_get_lateness());
+
+	disable_master_timer();
 
+	if (master_poll_interval) {
 		log_debug("Master poll slave interval timed out... time to poll next slave");
 		master_poll_interval = false;
 		master_poll_slave();
@@ -805,27 +941,22 @@ void master_timeout_handler(void* opaque) {
 		return;
 	}
 
-	// For some unknown reason the timer randomly times out or this timeout function is called
-	// much long before the actual timeout. This is a fix to this problem
-	// until we find the real problem
-	time_passed_from_last_timer_enable = (microseconds() - last_timer_enable_at_uS) * 1000;
+	log_debug("Current request timed out. Moving on");
 
-	if (time_passed_from_last_timer_enable < TIMEOUT) {
-		master_timer.it_interval.tv_sec = 0;
-		master_timer.it_interval.tv_nsec = 0;
-		master_timer.it_value.tv_sec = 0;
-		master_timer.it_value.tv_nsec = TIMEOUT;
-		timerfd_settime(_master_timer_event, 0, &master_timer, NULL);
-		last_timer_enable_at_uS = microseconds();
+	// Back off the learned timeout of the slave, fresh samples bring it down
+	// again if the slave responds in time with the next requests
+	slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
 
-		return;
+	if (slave->has_turnaround) {
+		slave->turnaround_deviation = MIN(MAX(2 * slave->turnaround_deviation, (uint64_t)1000000),
+		                                  MASTER_TIMEOUT_MAX > 0 ? MASTER_TIMEOUT_MAX : TIMEOUT);
 	}
 
-	log_debug("Current request timed out. Moving on");
-
 	// Current request timedout. Move on to next slave
 	if (is_current_request_empty()) {
 		++_red_rs485_extension.slaves[master_current_slave_to_process].sequence;
+
+		master_mark_slave_idle();
 	}
 
 	pop_packet_from_slave_queue();
@@ -836,10 +967,10 @@ void master_timeout_handler(void* opaque) {
 
 void pop_packet_from_slave_queue(void) {
 	RS485ExtensionPacket* current_slave_queue_packet;
-	current_slave_queue_packet = queue_peek(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
+	current_slave_queue_packet = fair_queue_peek(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue);
 
 	if (current_slave_queue_packet != NULL && --current_slave_queue_packet->tries_left == 0) {
-		queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
+		fair_queue_pop(&_red_rs485_extension.slaves[master_current_slave_to_process].packet_queue, NULL);
 	}
 }
 
@@ -872,16 +1003,127 @@ void arm_master_poll_slave_interval_timer(void) {
 	log_debug("Waiting before polling next slave");
 	master_poll_interval = true;
 
-	master_timer.it_interval.tv_sec = 0;
-	master_timer.it_interval.tv_nsec = 0;
-	master_timer.it_value.tv_sec = 0;
-	master_timer.it_value.tv_nsec = MASTER_POLL_SLAVE_INTERVAL;
-	timerfd_settime(_master_timer_event, 0, &master_timer, NULL);
-	last_timer_enable_at_uS = microseconds();
+	arm_master_timer(MASTER_POLL_SLAVE_INTERVAL);
+}
+
+// Select the slave for the next turn. Slaves with queued requests are served
+// first in round-robin order. To keep callbacks flowing from all other slaves
+// every RS485_MASTER_MAX_PRIORITY_TURNS + 1 turn is a regular round-robin turn
+// that skips idle slaves according to their backoff
+void master_select_next_slave(void) {
+	RS485Slave *slave;
+	int i;
+	int k;
+
+	if (master_priority_turns < RS485_MASTER_MAX_PRIORITY_TURNS) {
+		for (i = 1; i <= _red_rs485_extension.slave_num; i++) {
+			k = (master_current_slave_to_process + i) % _red_rs485_extension.slave_num;
+
+			if (_red_rs485_extension.slaves[k].packet_queue.count > 0) {
+				++master_priority_turns;
+				master_current_slave_to_process = k;
+
+				return;
+			}
+		}
+	}
+
+	master_priority_turns = 0;
+
+	// If all slaves are backed off the last one is polled anyway
+	for (i = 0; i < _red_rs485_extension.slave_num; i++) {
+		k = master_next_regular_slave;
+		slave = &_red_rs485_extension.slaves[k];
+
+		if (++master_next_regular_slave >= _red_rs485_extension.slave_num) {
+			master_next_regular_slave = 0;
+		}
+
+		master_current_slave_to_process = k;
+
+		if (slave->packet_queue.count > 0 || slave->polls_to_skip == 0) {
+			return;
+		}
+
+		--slave->polls_to_skip;
+	}
+}
+
+// The current slave responded with data, poll it at full rate again
+void master_mark_slave_active(void) {
+	RS485Slave *slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
+
+	slave->poll_backoff = 0;
+	slave->polls_to_skip = 0;
+}
+
+// The current slave had nothing to send when polled, double its backoff
+void master_mark_slave_idle(void) {
+	RS485Slave *slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
+
+	slave->polls_to_skip = slave->poll_backoff;
+
+	if (slave->poll_backoff == 0) {
+		slave->poll_backoff = 1;
+	} else {
+		slave->poll_backoff *= 2;
+	}
+
+	if (slave->poll_backoff > MASTER_POLL_BACKOFF_MAX) {
+		slave->poll_backoff = MASTER_POLL_BACKOFF_MAX;
+	}
+}
+
+// A request/response exchange with the current slave completed successfully.
+// The sequence number was already increased for it, so the next queued request
+// of the slave can be sent right away as long as the turn has frames left.
+// Polls and failed exchanges always end the turn
+void master_finish_exchange(void) {
+	RS485Slave *current_slave = &_red_rs485_extension.slaves[master_current_slave_to_process];
+
+	if (--master_frames_left_in_turn <= 0 || current_slave->packet_queue.count == 0) {
+		// Poll next slave after the configured timeout
+		arm_master_poll_slave_interval_timer();
+
+		return;
+	}
+
+	sent_ack_of_data_packet = 0;
+	reset_receive_buffer();
+
+	log_packet_debug("Sending next packet of the burst to slave ID = %d, Sequence number = %d",
+	                 current_slave->address, current_slave->sequence);
+
+	// The timer will be fired by the send function
+	send_packet();
 }
 
 // New packet from brickd event loop is queued to be sent via RS485 interface
-int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request, Recipient *recipient) {
+static void red_rs485_extension_cancel_request(void *item, void *opaque) {
+	client_cancel_pending_request(opaque, &((RS485ExtensionPacket *)item)->packet);
+}
+
+// The packet currently being exchanged with a slave stays queued until it is
+// acknowledged, fair_queue_cancel_owner keeps it
+static void red_rs485_extension_cancel_requests(Stack *stack, Client *client) {
+	int i;
+	int count;
+
+	(void)stack;
+
+	for (i = 0; i < _red_rs485_extension.slave_num; i++) {
+		count = fair_queue_cancel_owner(&_red_rs485_extension.slaves[i].packet_queue, client,
+		                                red_rs485_extension_cancel_request, client);
+
+		if (count > 0) {
+			log_packet_debug("Canceled %d queued request(s) for slave %d",
+			                 count, _red_rs485_extension.slaves[i].address);
+		}
+	}
+}
+
+int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request,
+                                          Recipient *recipient, Client *client) {
 	RS485ExtensionPacket* queued_request;
 	int i;
 
@@ -891,7 +1133,7 @@ int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request, Recipie
 		log_packet_debug("Broadcasting to all available slaves");
 
 		for (i = 0; i < _red_rs485_extension.slave_num; i++) {
-			queued_request = queue_push(&_red_rs485_extension.slaves[i].packet_queue);
+			queued_request = fair_queue_push(&_red_rs485_extension.slaves[i].packet_queue, client);
 
 			if (queued_request == NULL) {
 				log_error("Could not push request (%s) to packet queue for slave %d, dropping request: %s (%d)",
@@ -905,14 +1147,14 @@ int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request, Recipie
 			queued_request->tries_left = RS485_FRAME_TRIES_DATA;
 			memcpy(&queued_request->packet, request, request->header.length);
 
-			log_packet_debug("Broadcast... Packet is queued to be sent to slave %d. Function signature = (%s)",
-			                 _red_rs485_extension.slaves[i].address,
-			                 packet_get_request_signature(packet_signature, request));
+			log_packet_debug_checked("Broadcast... Packet is queued to be sent to slave %d. Function signature = (%s)",
+			                         _red_rs485_extension.slaves[i].address,
+			                         packet_get_request_signature(packet_signature, request));
 		}
 	} else if (recipient != NULL) {
 		for (i = 0; i < _red_rs485_extension.slave_num; i++) {
 			if (_red_rs485_extension.slaves[i].address == recipient->opaque) {
-				queued_request = queue_push(&_red_rs485_extension.slaves[i].packet_queue);
+				queued_request = fair_queue_push(&_red_rs485_extension.slaves[i].packet_queue, client);
 
 				if (queued_request == NULL) {
 					log_error("Could not push request (%s) to packet queue for slave %d, dropping request: %s (%d)",
@@ -926,9 +1168,9 @@ int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request, Recipie
 				queued_request->tries_left = RS485_FRAME_TRIES_DATA;
 				memcpy(&queued_request->packet, request, request->header.length);
 
-				log_packet_debug("Packet is queued to be sent to slave %d over. Function signature = (%s)",
-				                 _red_rs485_extension.slaves[i].address,
-				                 packet_get_request_signature(packet_signature, request));
+				log_packet_debug_checked("Packet is queued to be sent to slave %d over. Function signature = (%s)",
+				                         _red_rs485_extension.slaves[i].address,
+				                         packet_get_request_signature(packet_signature, request));
 
 				break;
 			}
@@ -938,6 +1180,15 @@ int red_rs485_extension_dispatch_to_rs485(Stack *stack, Packet *request, Recipie
 	return 0;
 }
 
+static void red_rs485_extension_read_poll_config(void) {
+	MASTER_POLL_SLAVE_INTERVAL = (uint64_t)config_get_option_value("poll_delay.rs485")->integer * 1000;
+	MASTER_FRAMES_PER_TURN = config_get_option_value("rs485.frames_per_turn")->integer;
+	MASTER_POLL_BACKOFF_MAX = config_get_option_value("poll_backoff.rs485")->integer;
+	MASTER_ADAPTIVE_TIMEOUT = config_get_option_value("rs485.adaptive_timeout")->boolean;
+	MASTER_TIMEOUT_MIN = (uint64_t)config_get_option_value("rs485.timeout_min")->integer * 1000;
+	MASTER_TIMEOUT_MAX = (uint64_t)config_get_option_value("rs485.timeout_max")->integer * 1000;
+}
+
 // Init function called from central brickd code
 int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 	int phase = 0;
@@ -947,7 +1198,7 @@ int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 
 	log_info("Initializing extension subsystem");
 
-	MASTER_POLL_SLAVE_INTERVAL = (uint64_t)config_get_option_value("poll_delay.rs485")->integer * 1000;
+	red_rs485_extension_read_poll_config();
 
 	// Create base stack
 	if (stack_create(&_red_rs485_extension.base, "red_rs485_extension",
@@ -958,6 +1209,8 @@ int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 		goto cleanup;
 	}
 
+	_red_rs485_extension.base.cancel_requests = red_rs485_extension_cancel_requests;
+
 	phase = 1;
 
 	// Add to stacks array
@@ -980,8 +1233,15 @@ int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 		for (i = 0; i < _red_rs485_extension.slave_num; i++) {
 			_red_rs485_extension.slaves[i].address = rs485_config->slave_address[i];
 			_red_rs485_extension.slaves[i].sequence = 0;
-
-			if (queue_create(&_red_rs485_extension.slaves[i].packet_queue, sizeof(RS485ExtensionPacket)) < 0) {
+			_red_rs485_extension.slaves[i].poll_backoff = 0;
+			_red_rs485_extension.slaves[i].polls_to_skip = 0;
+			_red_rs485_extension.slaves[i].has_turnaround = false;
+			_red_rs485_extension.slaves[i].turnaround = 0;
+			_red_rs485_extension.slaves[i].turnaround_deviation = 0;
+			_red_rs485_extension.slaves[i].timeout = 0;
+
+			if (fair_queue_create(&_red_rs485_extension.slaves[i].packet_queue, sizeof(RS485ExtensionPacket),
+			                      offsetof(RS485ExtensionPacket, packet)) < 0) {
 				log_error("Could not create slave queue, %s (%d)",
 				          get_errno_name(errno), errno);
 				goto cleanup;
@@ -997,6 +1257,10 @@ int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 	TIMEOUT = (((double)(TIMEOUT_BYTES / (double)(_red_rs485_extension.baudrate / 8)) *
 	            (double)1000000000) * (double)2) + (double)8000000;
 
+	// Start bit, 8 data bits, optional parity bit and stop bits
+	BYTE_TIME = (uint64_t)(9 + (_red_rs485_extension.parity != EXTENSION_RS485_PARITY_NONE ? 1 : 0) +
+	                       _red_rs485_extension.stopbits) * 1000000000 / _red_rs485_extension.baudrate;
+
 	// Configuring serial interface from the configs
 	if (serial_interface_init(RS485_EXTENSION_SERIAL_DEVICE) < 0) {
 		goto cleanup;
@@ -1009,7 +1273,7 @@ int red_rs485_extension_init(ExtensionRS485Config *rs485_config) {
 
 	// Adding serial data available event
 	if (event_add_source(_red_rs485_serial_fd, EVENT_SOURCE_TYPE_GENERIC,
-	                     EVENT_READ, serial_data_available_handler, NULL) < 0) {
+	                     EVENT_READ, EVENT_PROFILED(serial_data_available_handler), NULL) < 0) {
 		log_error("Could not add new serial data event");
 
 		goto cleanup;
@@ -1075,7 +1339,7 @@ cleanup:
 	case 3:
 		if (_red_rs485_extension.address == 0) {
 			for (i = 0; i < _red_rs485_extension.slave_num; i++) {
-				queue_destroy(&_red_rs485_extension.slaves[i].packet_queue, NULL);
+				fair_queue_destroy(&_red_rs485_extension.slaves[i].packet_queue, NULL);
 			}
 		}
 
@@ -1100,6 +1364,14 @@ cleanup:
 	return phase == 6 ? 0 : -1;
 }
 
+// Reload function called from config_options_reload. The master timer runs in
+// the event thread as well, the new interval applies from the next poll on
+// and the backoff of idle slaves is clamped to the new maximum on their next
+// idle poll
+void red_rs485_extension_reload_config(void) {
+	red_rs485_extension_read_poll_config();
+}
+
 // Exit function called from central brickd code
 void red_rs485_extension_exit(void) {
 	int i;
@@ -1122,7 +1394,7 @@ void red_rs485_extension_exit(void) {
 
 	if (_red_rs485_extension.address == 0) {
 		for (i = 0; i < _red_rs485_extension.slave_num; i++) {
-			queue_destroy(&_red_rs485_extension.slaves[i].packet_queue, NULL);
+			fair_queue_destroy(&_red_rs485_extension.slaves[i].packet_queue, NULL);
 		}
 	}
 
@@ -1198,7 +1470,10 @@ bool init_crc_error_count_to_fs(void) {
 
 static void update_crc_error_count_to_fs(void *opaque) {
 	char buffer[1024];
+	char name[64];
 	uint64_t _crc_error_count_value = *((uint64_t *)opaque);
+	RS485Slave *slave;
+	int i;
 
 	// Write options
 	snprintf(buffer, sizeof(buffer), "%d", (int)_crc_error_count_value);
@@ -1208,6 +1483,28 @@ static void update_crc_error_count_to_fs(void *opaque) {
 		          "type", get_errno_name(errno), errno);
 	}
 
+	// Learned turnaround and current timeout per slave in microseconds, 0
+	// until the slave responded for the first time
+	for (i = 0; i < _red_rs485_extension.slave_num; i++) {
+		slave = &_red_rs485_extension.slaves[i];
+
+		snprintf(name, sizeof(name), "slave_%u_turnaround", slave->address);
+		snprintf(buffer, sizeof(buffer), "%u", (uint32_t)(slave->turnaround / 1000));
+
+		if (conf_file_set_option_value(&crc_error_count_file, name, buffer) < 0) {
+			log_error("Could not set '%s' option for RS485 CRC error count file: %s (%d)",
+			          name, get_errno_name(errno), errno);
+		}
+
+		snprintf(name, sizeof(name), "slave_%u_timeout", slave->address);
+		snprintf(buffer, sizeof(buffer), "%u", (uint32_t)(slave->timeout / 1000));
+
+		if (conf_file_set_option_value(&crc_error_count_file, name, buffer) < 0) {
+			log_error("Could not set '%s' option for RS485 CRC error count file: %s (%d)",
+			          name, get_errno_name(errno), errno);
+		}
+	}
+
 	// Write config to filesystem
 	if (conf_file_write(&crc_error_count_file, RS485_EXTENSION_CRC_ERROR_COUNT_FILE_PATH) < 0) {
 		log_error("Could not write config to '%s': %s (%d)",
@@ -1216,3 +1513,13 @@ static void update_crc_error_count_to_fs(void *opaque) {
 
 	log_debug("CRC error count updated, current value: %d", (int)_crc_error_count_value);
 }
+
+int red_rs485_extension_get_master_jitter(RealtimeJitter *jitter) {
+	if (!_initialized) {
+		return -1;
+	}
+
+	realtime_jitter_get(&master_timer_jitter, jitter);
+
+	return 0;
+}
@@ -23,9 +23,14 @@
 #ifndef BRICKD_RED_RS485_EXTENSION_H
 #define BRICKD_RED_RS485_EXTENSION_H
 
+#include "realtime.h"
 #include "red_extension.h"
 
 int red_rs485_extension_init(ExtensionRS485Config *config);
 void red_rs485_extension_exit(void);
 
+void red_rs485_extension_reload_config(void);
+
+int red_rs485_extension_get_master_jitter(RealtimeJitter *jitter);
+
 #endif // BRICKD_RED_RS485_EXTENSION_H
@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -35,6 +36,7 @@
 #include <sys/eventfd.h>
 
 #include <daemonlib/base58.h>
+#include <daemonlib/conf_file.h>
 #include <daemonlib/config.h>
 #include <daemonlib/event.h>
 #include <daemonlib/io.h>
@@ -43,43 +45,24 @@
 #include <daemonlib/pipe.h>
 #include <daemonlib/red_gpio.h>
 #include <daemonlib/threads.h>
+#include <daemonlib/utils.h>
 
 #include "red_stack.h"
 
+#include "client.h"
+#include "event_profile.h"
+#include "fair_queue.h"
 #include "hardware.h"
 #include "network.h"
+#include "packet_debug.h"
+#include "pearson_hash.h"
+#include "realtime.h"
 #include "red_usb_gadget.h"
+#include "spsc_ring.h"
 #include "stack.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
-// We use the Pearson Hash for fast hashing
-// See: http://en.wikipedia.org/wiki/Pearson_hashing
-// the permutation table is taken from the original paper:
-// "Fast Hashing of Variable-Length Text Strings" by Peter K. Pearson,
-// pp. 677-680, CACM 33(6), June 1990.
-
-#define RED_STACK_SPI_PEARSON_PERMUTATION_SIZE 256
-static const uint8_t _red_stack_spi_pearson_permutation[RED_STACK_SPI_PEARSON_PERMUTATION_SIZE] = {
-	1, 87, 49, 12, 176, 178, 102, 166, 121, 193, 6, 84, 249, 230, 44, 163,
-	14, 197, 213, 181, 161, 85, 218, 80, 64, 239, 24, 226, 236, 142, 38, 200,
-	110, 177, 104, 103, 141, 253, 255, 50, 77, 101, 81, 18, 45, 96, 31, 222,
-	25, 107, 190, 70, 86, 237, 240, 34, 72, 242, 20, 214, 244, 227, 149, 235,
-	97, 234, 57, 22, 60, 250, 82, 175, 208, 5, 127, 199, 111, 62, 135, 248,
-	174, 169, 211, 58, 66, 154, 106, 195, 245, 171, 17, 187, 182, 179, 0, 243,
-	132, 56, 148, 75, 128, 133, 158, 100, 130, 126, 91, 13, 153, 246, 216, 219,
-	119, 68, 223, 78, 83, 88, 201, 99, 122, 11, 92, 32, 136, 114, 52, 10,
-	138, 30, 48, 183, 156, 35, 61, 26, 143, 74, 251, 94, 129, 162, 63, 152,
-	170, 7, 115, 167, 241, 206, 3, 150, 55, 59, 151, 220, 90, 53, 23, 131,
-	125, 173, 15, 238, 79, 95, 89, 16, 105, 137, 225, 224, 217, 160, 37, 123,
-	118, 73, 2, 157, 46, 116, 9, 145, 134, 228, 207, 212, 202, 215, 69, 229,
-	27, 188, 67, 124, 168, 252, 42, 4, 29, 108, 21, 247, 19, 205, 39, 203,
-	233, 40, 186, 147, 198, 192, 155, 33, 164, 191, 98, 204, 165, 180, 117, 76,
-	140, 36, 210, 172, 41, 54, 159, 8, 185, 232, 113, 196, 231, 47, 146, 120,
-	51, 65, 28, 144, 254, 221, 93, 189, 194, 139, 112, 43, 71, 109, 184, 209
-};
-#define PEARSON(cur, next) do { cur = _red_stack_spi_pearson_permutation[cur ^ next]; } while(0)
-
 #define RED_STACK_SPI_PACKET_SIZE       84
 #define RED_STACK_SPI_PACKET_EMPTY_SIZE 4
 #define RED_STACK_SPI_PREAMBLE_VALUE    0xAA
@@ -88,8 +71,15 @@ static const uint8_t _red_stack_spi_pearson_permutation[RED_STACK_SPI_PEARSON_PE
 #define RED_STACK_SPI_INFO(length)      ((length) -2)
 #define RED_STACK_SPI_CHECKSUM(length)  ((length) -1)
 #define RED_STACK_SPI_MAX_SLAVES        8
-#define RED_STACK_SPI_ROUTING_WAIT      (1000*1000*50) // Give slave 50ms between each routing table setup try
-#define RED_STACK_SPI_ROUTING_TRIES     10             // Try 10 times for each slave to setup routing table
+#define RED_STACK_SPI_ROUTING_FIRST_WAIT (1000*1000*1)  // Retry routing table setup after 1ms first, ...
+#define RED_STACK_SPI_ROUTING_WAIT      (1000*1000*50) // ... doubling the wait up to 50ms between tries
+#define RED_STACK_SPI_ROUTING_TIMEOUT   (1000*1000*500) // Give slave 500ms to answer the routing table setup
+#define RED_STACK_SPI_ROUTING_CACHED_TIMEOUT (1000*1000*100) // Only 100ms beyond the previously found slaves
+#define RED_STACK_SPI_ROUTING_CACHE_FILE_PATH "/tmp/red_stack_routing.conf"
+#define RED_STACK_SPI_ROUTING_CACHE_COMMENT   "# This file is written by brickd's SPI stack."
+#define RED_STACK_REQUEST_RING_SIZE     8              // Requests per slave handed over to the SPI thread at once
+#define RED_STACK_RESPONSE_RING_SIZE    256            // Responses waiting for the brickd event thread
+#define RED_STACK_SPI_MAX_PRIORITY_TRANSFERS 4         // Transfers for slaves with pending requests before the next poll
 
 #define RED_STACK_SPI_INFO_SEQUENCE_MASTER_MASK (0x07)
 #define RED_STACK_SPI_INFO_SEQUENCE_SLAVE_MASK  (0x38)
@@ -140,13 +130,52 @@ static pthread_cond_t _red_stack_wait_for_reset_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t _red_stack_wait_for_reset_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int _red_stack_wait_for_reset_helper = 0;
 
+// The SPI thread waits on this condition variable between transfers. The main
+// thread signals it whenever a request is queued, so the thread does not have
+// to sleep through its poll delay if there is something to send. The helper
+// variable protects against spurious and lost wakeups.
+static pthread_cond_t _red_stack_request_queued_cond;
+static pthread_mutex_t _red_stack_request_queued_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int _red_stack_request_queued_helper = 0;
+
 static int _red_stack_notification_event;
+static int _red_stack_request_refill_event;
+static bool _red_stack_discard_requests = false; // set by SPI thread, cleared by event thread
 static int _red_stack_reset_fd;
 static int _red_stack_reset_detected = 0;
 
 // delay between transfers in microseconds. configurable with brickd.conf option poll_delay.spi
 static int _red_stack_spi_poll_delay = 50;
 
+// the delay between transfers is doubled for each full cycle through the slaves
+// without any data being send or received, up to this maximum in microseconds.
+// configurable with brickd.conf option poll_delay.spi_max
+static int _red_stack_spi_max_poll_delay = 1000;
+
+// responses dispatched per event loop iteration. configurable with brickd.conf
+// option spi.responses_per_iteration
+static int _red_stack_responses_per_iteration = 64;
+static uint32_t _red_stack_response_high_water_mark = 0;
+
+// written by SPI thread, in microseconds
+static uint64_t _red_stack_spi_transceive_time = 0;
+static uint64_t _red_stack_spi_sleep_time = 0;
+
+// scheduling of the SPI thread. configurable with brickd.conf options
+// spi.realtime_priority and spi.cpu_affinity, read once before the SPI
+// thread is started
+static int _red_stack_spi_realtime_priority = 0;
+static int _red_stack_spi_cpu_affinity = -1;
+
+// lateness of the SPI thread waking up from the poll delay, written by the
+// SPI thread
+static RealtimeJitter _red_stack_spi_jitter;
+
+// statistics are only written by the SPI thread, the event thread reads them
+#define RED_STACK_STATISTICS_ADD(counter, value) \
+	__atomic_store_n(&(counter), (counter) + (value), __ATOMIC_RELAXED)
+#define RED_STACK_STATISTICS_INCREMENT(counter) RED_STACK_STATISTICS_ADD(counter, 1)
+
 typedef enum {
 	RED_STACK_SLAVE_STATUS_ABSENT = 0,
 	RED_STACK_SLAVE_STATUS_AVAILABLE,
@@ -163,9 +192,11 @@ typedef struct {
 	uint8_t sequence_number_slave;
 	REDStackSlaveStatus status;
 	GPIOPin slave_select_pin;
-	Queue request_queue;
-	Mutex request_queue_mutex;
+	FairQueue request_queue; // scheduled fairly between clients, owned by event thread
+	SPSCRing request_ring; // produced by event thread, consumed by SPI thread
 	bool next_packet_empty;
+	REDStackSlaveStatistics statistics; // written by SPI thread
+	uint32_t peak_queued_requests; // written by event thread
 } REDStackSlave;
 
 typedef struct {
@@ -173,19 +204,29 @@ typedef struct {
 	REDStackSlave slaves[RED_STACK_SPI_MAX_SLAVES];
 	uint8_t slave_num;
 
-	Queue response_queue;
-	Mutex response_queue_mutex;
+	SPSCRing response_ring; // produced by SPI thread, consumed by event thread
 } REDStack;
 
 typedef struct {
 	REDStackSlave *slave;
 	Packet packet;
 	REDStackRequestStatus status;
+	uint64_t queued; // microseconds
 } REDStackRequest;
 
+// The recipient table of the stack and the UID routes of the hardware belong to
+// the brickd event thread. The SPI thread sends its changes to them through the
+// response ring, in order with the responses
+typedef enum {
+	RED_STACK_RESPONSE_TYPE_PACKET = 0,
+	RED_STACK_RESPONSE_TYPE_ADD_RECIPIENT, // UID in packet header, no payload
+	RED_STACK_RESPONSE_TYPE_RESET // Announce disconnect and clear recipients
+} REDStackResponseType;
+
 typedef struct {
 	Packet packet;
 	uint8_t stack_address;
+	REDStackResponseType type;
 } REDStackResponse;
 
 static REDStack _red_stack;
@@ -247,10 +288,11 @@ static int red_stack_spi_request_dispatch_response_event(REDStackResponse *respo
 	REDStackResponse *queued_response;
 	eventfd_t ev = 1;
 
-	mutex_lock(&_red_stack.response_queue_mutex);
-	queued_response = queue_push(&_red_stack.response_queue);
+	// The SPI thread does not transceive while the ring is full, so there is
+	// always room for the response here
+	queued_response = spsc_ring_reserve(&_red_stack.response_ring);
 	memcpy(queued_response, response, sizeof(REDStackResponse));
-	mutex_unlock(&_red_stack.response_queue_mutex);
+	spsc_ring_commit(&_red_stack.response_ring);
 
 	if (eventfd_write(_red_stack_notification_event, ev) < 0) {
 		log_error("Could not write to red stack spi notification event: %s (%d)",
@@ -262,16 +304,35 @@ static int red_stack_spi_request_dispatch_response_event(REDStackResponse *respo
 	return 0;
 }
 
-// Calculates a Pearson Hash for the given data
-static uint8_t red_stack_spi_calculate_pearson_hash(const uint8_t *data, const uint8_t length) {
-	uint8_t i;
-	uint8_t checksum = 0;
+// Get the recipient table changed from main brickd event thread. Unlike a
+// response this can be queued while the SPI thread is not polling the slaves,
+// so wait for the brickd event thread to make room if necessary
+static void red_stack_spi_request_recipient_event(REDStackResponseType type,
+                                                  uint32_t uid, uint8_t stack_address) {
+	REDStackResponse response;
 
-	for (i = 0; i < length; i++) {
-		checksum = _red_stack_spi_pearson_permutation[checksum ^ data[i]];
+	while (spsc_ring_is_full(&_red_stack.response_ring)) {
+		SLEEP_NS(0, 1000*_red_stack_spi_poll_delay);
 	}
 
-	return checksum;
+	memset(&response.packet.header, 0, sizeof(PacketHeader));
+
+	response.packet.header.uid = uid;
+	response.packet.header.length = sizeof(PacketHeader);
+	response.stack_address = stack_address;
+	response.type = type;
+
+	red_stack_spi_request_dispatch_response_event(&response);
+}
+
+// Get "red_stack_refill_request_rings" called from main brickd event thread
+static void red_stack_spi_request_refill(void) {
+	eventfd_t ev = 1;
+
+	if (eventfd_write(_red_stack_request_refill_event, ev) < 0) {
+		log_error("Could not write to red stack spi request refill event: %s (%d)",
+		          get_errno_name(errno), errno);
+	}
 }
 
 static void red_stack_spi_select(REDStackSlave *slave) {
@@ -282,6 +343,23 @@ static void red_stack_spi_deselect(REDStackSlave *slave) {
 	gpio_output_set(slave->slave_select_pin);
 }
 
+static void red_stack_spi_add_latency(REDStackSlave *slave, REDStackRequest *request) {
+	uint64_t latency;
+	int bucket;
+
+	if (request->queued == 0) { // not queued by the event thread
+		return;
+	}
+
+	latency = (microseconds() - request->queued) / 100;
+
+	for (bucket = 0; latency > 0 && bucket < RED_STACK_LATENCY_BUCKETS - 1; ++bucket) {
+		latency >>= 1;
+	}
+
+	RED_STACK_STATISTICS_INCREMENT(slave->statistics.latency_histogram[bucket]);
+}
+
 // If data should just be polled, set packet_send to NULL.
 //
 // If no packet is received from slave the length in packet_recv will be set to 0,
@@ -341,8 +419,14 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 	tx[RED_STACK_SPI_INFO(length)] = slave->sequence_number_master | slave->sequence_number_slave;
 
 	// Calculate checksum
-	tx[RED_STACK_SPI_CHECKSUM(length)] = red_stack_spi_calculate_pearson_hash(tx, length-1);
-
+	tx[RED_STACK_SPI_CHECKSUM(length)] = pearson_hash(tx, length-1);
+
+	// This is deliberately a single transfer per ioctl. The slaves are
+	// selected by GPIOs toggled from here, not by the chip select of the SPI
+	// controller, so several slaves cannot be queued into one
+	// SPI_IOC_MESSAGE(n) call. Several packets for the same slave cannot be
+	// queued either, because the sequence number of the next packet depends
+	// on the acknowledgement in the response to the current one.
 	struct spi_ioc_transfer spi_transfer = {
 		.tx_buf = (unsigned long)&tx,
 		.rx_buf = (unsigned long)&rx,
@@ -353,11 +437,15 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 	rc = ioctl(_red_stack_spi_fd, SPI_IOC_MESSAGE(1), &spi_transfer);
 	red_stack_spi_deselect(slave);
 
+	RED_STACK_STATISTICS_INCREMENT(slave->statistics.transfers);
+
 	if (rc < 0) {
 		// Overwrite current return status with error,
 		// it seems ioctl itself didn't work.
 		retval = RED_STACK_TRANSCEIVE_RESULT_SEND_ERROR | RED_STACK_TRANSCEIVE_RESULT_READ_ERROR;
 
+		RED_STACK_STATISTICS_INCREMENT(slave->statistics.transfer_errors);
+
 		if(packet_send == NULL) {
 			slave->next_packet_empty = true;
 		}
@@ -374,6 +462,8 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 		// it seems ioctl itself didn't work.
 		retval = RED_STACK_TRANSCEIVE_RESULT_SEND_ERROR | RED_STACK_TRANSCEIVE_RESULT_READ_ERROR;
 
+		RED_STACK_STATISTICS_INCREMENT(slave->statistics.transfer_errors);
+
 		if(packet_send == NULL) {
 			slave->next_packet_empty = true;
 		}
@@ -391,6 +481,8 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 		//          rx[RED_STACK_SPI_PREAMBLE], RED_STACK_SPI_PREAMBLE_VALUE);
 		retval = (retval & (~RED_STACK_TRANSCEIVE_RESULT_MASK_READ)) | RED_STACK_TRANSCEIVE_RESULT_READ_ERROR;
 
+		RED_STACK_STATISTICS_INCREMENT(slave->statistics.preamble_errors);
+
 		if(packet_send == NULL) {
 			slave->next_packet_empty = true;
 		}
@@ -407,6 +499,8 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 		log_error("Received packet with malformed length: %d", length);
 		retval = (retval & (~RED_STACK_TRANSCEIVE_RESULT_MASK_READ)) | RED_STACK_TRANSCEIVE_RESULT_READ_ERROR;
 
+		RED_STACK_STATISTICS_INCREMENT(slave->statistics.length_errors);
+
 		if(packet_send == NULL) {
 			slave->next_packet_empty = true;
 		}
@@ -415,13 +509,15 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 	}
 
 	// Calculate and check checksum
-	checksum = red_stack_spi_calculate_pearson_hash(rx, length-1);
+	checksum = pearson_hash(rx, length-1);
 
 	if (checksum != rx[RED_STACK_SPI_CHECKSUM(length)]) {
 		log_error("Received packet with wrong checksum (actual: %x != expected: %x)",
 		          checksum, rx[RED_STACK_SPI_CHECKSUM(length)]);
 		retval = (retval & (~RED_STACK_TRANSCEIVE_RESULT_MASK_READ)) | RED_STACK_TRANSCEIVE_RESULT_READ_ERROR;
 
+		RED_STACK_STATISTICS_INCREMENT(slave->statistics.checksum_errors);
+
 		if(packet_send == NULL) {
 			slave->next_packet_empty = true;
 		}
@@ -439,6 +535,11 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 
 			// Increase sequence number for next packet
 			red_stack_increase_master_sequence_number(slave);
+
+			RED_STACK_STATISTICS_INCREMENT(slave->statistics.packets_out);
+			red_stack_spi_add_latency(slave, packet_send);
+		} else {
+			RED_STACK_STATISTICS_INCREMENT(slave->statistics.sequence_mismatches);
 		}
 	} else {
 		// If we didn't send anything we can increase the sequence number
@@ -481,11 +582,13 @@ static int red_stack_spi_transceive_message(REDStackRequest *packet_send, REDSta
 
 			packet_add_trace(&packet_recv->packet);
 
-			log_packet_debug("Received packet over SPI (%s)",
-			                 packet_get_response_signature(packet_signature, &packet_recv->packet));
+			log_packet_debug_checked("Received packet over SPI (%s)",
+			                         packet_get_response_signature(packet_signature, &packet_recv->packet));
 
 			retval = (retval & (~RED_STACK_TRANSCEIVE_RESULT_MASK_READ)) | RED_STACK_TRANSCEIVE_RESULT_READ_OK;
 			retval |= RED_STACK_TRANSCEIVE_DATA_RECEIVED;
+
+			RED_STACK_STATISTICS_INCREMENT(slave->statistics.packets_in);
 		}
 	}
 
@@ -493,84 +596,202 @@ ret:
 	return retval;
 }
 
+typedef enum {
+	RED_STACK_ROUTING_STATE_SEND = 0, // stack enumerate request not acknowledged yet
+	RED_STACK_ROUTING_STATE_RECEIVE, // waiting for stack enumerate response
+	RED_STACK_ROUTING_STATE_DONE
+} REDStackRoutingState;
+
+// Returns the number of slaves found by the previous discovery, or -1 if unknown
+static int red_stack_spi_read_routing_cache(void) {
+	ConfFile conf_file;
+	const char *value;
+	int slave_num = -1;
+
+	if (conf_file_create(&conf_file) < 0) {
+		return -1;
+	}
+
+	if (conf_file_read(&conf_file, RED_STACK_SPI_ROUTING_CACHE_FILE_PATH, NULL, NULL) >= 0) {
+		value = conf_file_get_option_value(&conf_file, "slave_num");
+
+		if (value != NULL) {
+			slave_num = atoi(value);
+
+			if (slave_num < 0 || slave_num > RED_STACK_SPI_MAX_SLAVES) {
+				slave_num = -1;
+			}
+		}
+	}
+
+	conf_file_destroy(&conf_file);
+
+	return slave_num;
+}
+
+static void red_stack_spi_write_routing_cache(int slave_num) {
+	ConfFile conf_file;
+	ConfFileLine *line;
+	char buffer[32];
+
+	if (conf_file_create(&conf_file) < 0) {
+		log_error("Could not create SPI stack routing cache: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	line = array_append(&conf_file.lines);
+
+	if (line == NULL) {
+		log_error("Could not add comment to SPI stack routing cache: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		conf_file_destroy(&conf_file);
+
+		return;
+	}
+
+	line->raw = strdup(RED_STACK_SPI_ROUTING_CACHE_COMMENT);
+	line->name = NULL;
+	line->value = NULL;
+
+	snprintf(buffer, sizeof(buffer), "%d", slave_num);
+
+	if (conf_file_set_option_value(&conf_file, "slave_num", buffer) < 0 ||
+	    conf_file_write(&conf_file, RED_STACK_SPI_ROUTING_CACHE_FILE_PATH) < 0) {
+		log_warn("Could not write SPI stack routing cache to '%s': %s (%d)",
+		         RED_STACK_SPI_ROUTING_CACHE_FILE_PATH, get_errno_name(errno), errno);
+	}
+
+	conf_file_destroy(&conf_file);
+}
+
 // Creates the "routing table", which is just the
 // array of REDStackSlave structures.
+//
+// All slave addresses are probed in parallel, starting with short waits
+// between the tries that are doubled up to RED_STACK_SPI_ROUTING_WAIT. The
+// stack ends with the first address that did not answer within
+// RED_STACK_SPI_ROUTING_TIMEOUT. The number of slaves found by the previous
+// discovery is cached. It is only used to give up faster on the addresses
+// beyond it, every slave is still verified by its stack enumerate response.
 static void red_stack_spi_create_routing_table(void) {
 	char base58[BASE58_MAX_LENGTH];
-	int tries, ret, i;
-	uint8_t stack_address = 0;
+	int ret, i;
+	uint8_t stack_address;
+	uint8_t slave_num;
 	uint8_t uid_counter = 0;
+	int cached_slave_num;
+	int timeout;
+	int wait = RED_STACK_SPI_ROUTING_FIRST_WAIT;
+	int waited = 0;
+	REDStackRoutingState states[RED_STACK_SPI_MAX_SLAVES];
+	REDStackResponse responses[RED_STACK_SPI_MAX_SLAVES];
+	StackEnumerateResponse *enumerate_response;
+
+	cached_slave_num = red_stack_spi_read_routing_cache();
+
+	if (cached_slave_num >= 0) {
+		log_debug("Starting to discover SPI stack slaves (%d slave(s) found last time)",
+		          cached_slave_num);
+	} else {
+		log_debug("Starting to discover SPI stack slaves");
+	}
 
-	log_debug("Starting to discover SPI stack slaves");
-
-	while (stack_address < RED_STACK_SPI_MAX_SLAVES) {
-		REDStackSlave *slave = &_red_stack.slaves[stack_address];
-		REDStackResponse response;
-		StackEnumerateResponse *enumerate_response;
-		REDStackRequest request = {
-			slave,
-			{{
-				0,   // UID 0
-				sizeof(StackEnumerateRequest),
-				FUNCTION_STACK_ENUMERATE,
-				0x08, // Return expected
-				0
-			}, {0}, {0}},
-			RED_STACK_REQUEST_STATUS_ADDED,
-		};
-
+	for (stack_address = 0; stack_address < RED_STACK_SPI_MAX_SLAVES; stack_address++) {
 		// We have to assume that the slave is available
-		slave->status = RED_STACK_SLAVE_STATUS_AVAILABLE;
-
-		// Send stack enumerate request
-		for (tries = 0; tries < RED_STACK_SPI_ROUTING_TRIES; tries++) {
-			ret = red_stack_spi_transceive_message(&request, &response, slave);
+		_red_stack.slaves[stack_address].status = RED_STACK_SLAVE_STATUS_AVAILABLE;
+		states[stack_address] = RED_STACK_ROUTING_STATE_SEND;
+	}
 
-			if ((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_SEND) == RED_STACK_TRANSCEIVE_RESULT_SEND_OK) {
-				break;
+	for (;;) {
+		for (stack_address = 0; stack_address < RED_STACK_SPI_MAX_SLAVES; stack_address++) {
+			REDStackSlave *slave = &_red_stack.slaves[stack_address];
+			REDStackResponse *response = &responses[stack_address];
+			REDStackRequest request = {
+				slave,
+				{{
+					0,   // UID 0
+					sizeof(StackEnumerateRequest),
+					FUNCTION_STACK_ENUMERATE,
+					0x08, // Return expected
+					0
+				}, {0}, {0}},
+				RED_STACK_REQUEST_STATUS_ADDED,
+				0 // not queued
+			};
+
+			if (states[stack_address] == RED_STACK_ROUTING_STATE_SEND) {
+				// Send stack enumerate request
+				ret = red_stack_spi_transceive_message(&request, response, slave);
+
+				if ((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_SEND) == RED_STACK_TRANSCEIVE_RESULT_SEND_OK) {
+					states[stack_address] = RED_STACK_ROUTING_STATE_RECEIVE;
+				}
+			} else if (states[stack_address] == RED_STACK_ROUTING_STATE_RECEIVE) {
+				// Receive stack enumerate response
+				ret = red_stack_spi_transceive_message(NULL, response, slave);
+			} else {
+				continue;
 			}
 
-			SLEEP_NS(0, RED_STACK_SPI_ROUTING_WAIT); // Give slave some more time
-		}
+			// We check if we already received an answer
+			if (states[stack_address] == RED_STACK_ROUTING_STATE_RECEIVE &&
+			    (ret & RED_STACK_TRANSCEIVE_RESULT_MASK_READ) == RED_STACK_TRANSCEIVE_RESULT_READ_OK) {
+				states[stack_address] = RED_STACK_ROUTING_STATE_DONE;
+			}
 
-		if (tries == RED_STACK_SPI_ROUTING_TRIES) {
-			// Slave does not seem to be available,
-			slave->status = RED_STACK_SLAVE_STATUS_ABSENT;
-			// This means that there can't be any more slaves above
-			// and we are actually done here already!
-			break;
+			SLEEP_NS(0, 1000*_red_stack_spi_poll_delay);
 		}
 
-		// Receive stack enumerate response
-		for (tries = 0; tries < RED_STACK_SPI_ROUTING_TRIES; tries++) {
-			// We first check if we already received an answer before we try again
-			if ((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_READ) == RED_STACK_TRANSCEIVE_RESULT_READ_OK) {
+		// The stack ends below the first slave that did not answer yet
+		for (slave_num = 0; slave_num < RED_STACK_SPI_MAX_SLAVES; slave_num++) {
+			if (states[slave_num] != RED_STACK_ROUTING_STATE_DONE) {
 				break;
 			}
+		}
 
-			// Here we sleep before transceive so that there is some time
-			// between the sending of stack enumerate and the receiving
-			// of the answer
-			SLEEP_NS(0, RED_STACK_SPI_ROUTING_WAIT); // Give slave some more time
+		if (slave_num == RED_STACK_SPI_MAX_SLAVES) {
+			break;
+		}
 
-			ret = red_stack_spi_transceive_message(NULL, &response, slave);
+		if (cached_slave_num >= 0 && slave_num >= cached_slave_num) {
+			timeout = RED_STACK_SPI_ROUTING_CACHED_TIMEOUT;
+		} else {
+			timeout = RED_STACK_SPI_ROUTING_TIMEOUT;
 		}
 
-		if (tries == RED_STACK_SPI_ROUTING_TRIES) {
+		if (waited >= timeout) {
 			// Slave does not seem to be available,
-			slave->status = RED_STACK_SLAVE_STATUS_ABSENT;
-			// This means that there can't be any more slaves above
+			// this means that there can't be any more slaves above
 			// and we are actually done here already!
 			break;
 		}
 
-		enumerate_response = (StackEnumerateResponse *)&response.packet;
+		SLEEP_NS(0, wait); // Give slaves some more time
+
+		waited += wait;
+		wait *= 2;
+
+		if (wait > RED_STACK_SPI_ROUTING_WAIT) {
+			wait = RED_STACK_SPI_ROUTING_WAIT;
+		}
+	}
+
+	for (stack_address = slave_num; stack_address < RED_STACK_SPI_MAX_SLAVES; stack_address++) {
+		_red_stack.slaves[stack_address].status = RED_STACK_SLAVE_STATUS_ABSENT;
+	}
+
+	for (stack_address = 0; stack_address < slave_num; stack_address++) {
+		enumerate_response = (StackEnumerateResponse *)&responses[stack_address].packet;
 
 		for (i = 0; i < PACKET_MAX_STACK_ENUMERATE_UIDS; i++) {
 			if (enumerate_response->uids[i] != 0) {
 				uid_counter++;
 
-				stack_add_recipient(&_red_stack.base, enumerate_response->uids[i], stack_address);
+				red_stack_spi_request_recipient_event(RED_STACK_RESPONSE_TYPE_ADD_RECIPIENT,
+				                                      enumerate_response->uids[i], stack_address);
 
 				log_debug("Found UID number %d of slave %d with UID %s",
 				          i, stack_address,
@@ -579,14 +800,21 @@ static void red_stack_spi_create_routing_table(void) {
 				break;
 			}
 		}
+	}
+
+	_red_stack.slave_num = slave_num;
 
-		stack_address++;
+	if (cached_slave_num >= 0 && cached_slave_num != slave_num) {
+		log_info("SPI stack changed since last discovery: %d slave(s) instead of %d",
+		         slave_num, cached_slave_num);
 	}
 
-	_red_stack.slave_num = stack_address;
+	if (cached_slave_num != slave_num) {
+		red_stack_spi_write_routing_cache(slave_num);
+	}
 
 	log_info("SPI stack slave discovery done. Found %d slave(s) with %d UID(s) in total",
-	         stack_address, uid_counter);
+	         slave_num, uid_counter);
 }
 
 static void red_stack_spi_insert_position(REDStackResponse *response) {
@@ -604,8 +832,7 @@ static void red_stack_spi_insert_position(REDStackResponse *response) {
 static void red_stack_spi_handle_reset(void) {
 	int slave;
 
-	stack_announce_disconnect(&_red_stack.base);
-	_red_stack.base.recipients.count = 0; // FIXME: properly clear the array
+	red_stack_spi_request_recipient_event(RED_STACK_RESPONSE_TYPE_RESET, 0, 0);
 
 	log_info("Starting reinitialization of SPI slaves");
 
@@ -627,25 +854,120 @@ static void red_stack_spi_handle_reset(void) {
 		_red_stack.slaves[slave].sequence_number_slave = 0;
 		_red_stack.slaves[slave].next_packet_empty = false;
 
-		// Unfortunately we have to discard all of the queued packets.
-		// we can't be sure that the packets are for the correct slave after a reset.
-		while (queue_peek(&_red_stack.slaves[slave].request_queue) != NULL) {
-			queue_pop(&_red_stack.slaves[slave].request_queue, NULL);
+	}
+
+	// Unfortunately we have to discard all of the queued packets.
+	// we can't be sure that the packets are for the correct slave after a reset.
+	// The fair queues belong to the brickd event thread, tell it to discard
+	// them before it hands over any further request, then empty the rings.
+	__atomic_store_n(&_red_stack_discard_requests, true, __ATOMIC_RELEASE);
+
+	for (slave = 0; slave < RED_STACK_SPI_MAX_SLAVES; slave++) {
+		while (spsc_ring_peek(&_red_stack.slaves[slave].request_ring) != NULL) {
+			spsc_ring_pop(&_red_stack.slaves[slave].request_ring);
+		}
+	}
+
+	red_stack_spi_request_refill();
+}
+
+static void red_stack_spi_add_delay(struct timespec *deadline, const struct timespec *now, int delay) {
+	deadline->tv_sec = now->tv_sec + delay / 1000000;
+	deadline->tv_nsec = now->tv_nsec + (delay % 1000000) * 1000;
+
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec += 1;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+// Wait for the given delay (in microseconds) or until the main thread queues
+// a new request, whatever happens first, but at least for the minimum delay.
+// Both deadlines are taken from the same clock reading, so that the common
+// case of no new request only needs the single timed wait instead of a sleep
+// for the minimum delay plus a timed wait for the rest. Returns true if a
+// request was queued.
+static bool red_stack_spi_wait_for_request(int minimum_delay, int delay) {
+	struct timespec now;
+	struct timespec minimum_deadline;
+	struct timespec deadline;
+	bool request_queued;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	red_stack_spi_add_delay(&minimum_deadline, &now, minimum_delay);
+	red_stack_spi_add_delay(&deadline, &now, delay);
+
+	pthread_mutex_lock(&_red_stack_request_queued_mutex);
+
+	while (_red_stack_request_queued_helper == 0 && _red_stack_spi_thread_running) {
+		if (pthread_cond_timedwait(&_red_stack_request_queued_cond,
+		                           &_red_stack_request_queued_mutex, &deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	request_queued = _red_stack_request_queued_helper != 0;
+	_red_stack_request_queued_helper = 0;
+
+	pthread_mutex_unlock(&_red_stack_request_queued_mutex);
+
+	// Woken up early, the slaves still need the minimum delay
+	if (request_queued) {
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &minimum_deadline, NULL);
+	}
+
+	return request_queued;
+}
+
+// Wake up the SPI thread if it is waiting between transfers
+static void red_stack_spi_wake_up(void) {
+	pthread_mutex_lock(&_red_stack_request_queued_mutex);
+	_red_stack_request_queued_helper = 1;
+	pthread_cond_signal(&_red_stack_request_queued_cond);
+	pthread_mutex_unlock(&_red_stack_request_queued_mutex);
+}
+
+// Bitmap of the slaves that have requests waiting in their ring
+static uint8_t red_stack_spi_get_pending_slaves(void) {
+	uint8_t pending = 0;
+	uint8_t slave;
+
+	for (slave = 0; slave < _red_stack.slave_num; slave++) {
+		if (spsc_ring_peek(&_red_stack.slaves[slave].request_ring) != NULL) {
+			pending |= 1 << slave;
 		}
 	}
+
+	return pending;
 }
 
 // Main SPI loop. This runs independently from the brickd event thread.
-// Data between RED Brick and SPI slave is exchanged every 500us.
-// If there is no data to be send, we cycle through the slaves and request
-// data. If there is data to be send the slave that ought to receive
-// the data gets priority. This can greatly reduce latency in a big stack.
+// Data between RED Brick and SPI slave is exchanged every poll_delay.spi us.
+// Slaves with pending requests get priority, they are served round-robin
+// among themselves. To still deliver callbacks in time, after at most
+// RED_STACK_SPI_MAX_PRIORITY_TRANSFERS priority transfers the next slave in
+// the plain round-robin poll order gets a turn. This can greatly reduce
+// latency in a big stack. While no slave has data to exchange the delay is
+// backed off up to poll_delay.spi_max us, a newly queued request cuts the
+// delay short.
 static void red_stack_spi_thread(void *opaque) {
 	uint8_t stack_address_cycle;
+	uint8_t priority_cycle;
+	uint8_t pending_slaves;
+	int priority_transfers;
 	int ret;
+	uint64_t transceive_start;
+	uint64_t sleep_start;
+	int poll_delay;
+	bool cycle_active;
+	uint64_t wakeup;
 
 	(void)opaque;
 
+	realtime_set_thread_profile("SPI", _red_stack_spi_realtime_priority,
+	                            _red_stack_spi_cpu_affinity);
+
 	do {
 		stack_address_cycle = 0;
 		_red_stack_reset_detected = 0;
@@ -661,37 +983,90 @@ static void red_stack_spi_thread(void *opaque) {
 		// Ignore resets that we received in the meantime to prevent race conditions.
 		_red_stack_reset_detected = 0;
 
+		poll_delay = _red_stack_spi_poll_delay;
+		cycle_active = false;
+		priority_cycle = 0;
+		priority_transfers = 0;
+
 		while (_red_stack_spi_thread_running) {
-			REDStackSlave *slave = &_red_stack.slaves[stack_address_cycle];
+			REDStackSlave *slave;
 			REDStackRequest *request = NULL;
 			REDStackResponse response;
 
-			// Get packet from queue. The queue contains request that are to
-			// be send over SPI. It is filled through from the main brickd
-			// event thread, so we have to make sure that there is not race
-			// condition.
+			// Every transceive can receive a response. If the brickd event
+			// thread is lagging behind and all response slots are in use, wait
+			// for it instead of dropping responses. The slaves keep their
+			// data until we poll them again.
+			if (spsc_ring_is_full(&_red_stack.response_ring)) {
+				SLEEP_NS(0, 1000*_red_stack_spi_poll_delay);
+				continue;
+			}
+
+			pending_slaves = red_stack_spi_get_pending_slaves();
+
+			if (pending_slaves != 0 && priority_transfers < RED_STACK_SPI_MAX_PRIORITY_TRANSFERS) {
+				// Serve the next slave with pending requests
+				do {
+					priority_cycle++;
+
+					if (priority_cycle >= _red_stack.slave_num) {
+						priority_cycle = 0;
+					}
+				} while ((pending_slaves & (1 << priority_cycle)) == 0);
+
+				slave = &_red_stack.slaves[priority_cycle];
+				priority_transfers++;
+			} else {
+				// Poll the next slave in round-robin order
+				slave = &_red_stack.slaves[stack_address_cycle];
+				priority_transfers = 0;
+
+				stack_address_cycle++;
+
+				if (stack_address_cycle >= _red_stack.slave_num) {
+					stack_address_cycle = 0;
+
+					// Back off if a full cycle through all slaves went by without
+					// any data being exchanged
+					if (!cycle_active && poll_delay < _red_stack_spi_max_poll_delay) {
+						poll_delay *= 2;
+
+						if (poll_delay > _red_stack_spi_max_poll_delay) {
+							poll_delay = _red_stack_spi_max_poll_delay;
+						}
+					}
+
+					cycle_active = false;
+				}
+			}
+
+			// Get packet from ring. The ring contains request that are to
+			// be send over SPI. It is filled from the main brickd event
+			// thread, the peeked request stays in place until we pop it.
 			if(slave->next_packet_empty) {
 				slave->next_packet_empty = false;
 				request = NULL;
 			} else {
-				mutex_lock(&slave->request_queue_mutex);
-				request = queue_peek(&slave->request_queue);
-				mutex_unlock(&slave->request_queue_mutex);
-			}
-
-			stack_address_cycle++;
-
-			if (stack_address_cycle >= _red_stack.slave_num) {
-				stack_address_cycle = 0;
+				request = spsc_ring_peek(&slave->request_ring);
 			}
 
 			// Set request if we have a packet to send
 			if (request != NULL) {
-				log_packet_debug("Packet will now be send over SPI (%s)",
-				                 packet_get_request_signature(packet_signature, &request->packet));
+				log_packet_debug_checked("Packet will now be send over SPI (%s)",
+				                         packet_get_request_signature(packet_signature, &request->packet));
 			}
 
+			transceive_start = microseconds();
 			ret = red_stack_spi_transceive_message(request, &response, slave);
+			sleep_start = microseconds();
+
+			RED_STACK_STATISTICS_ADD(_red_stack_spi_transceive_time, sleep_start - transceive_start);
+
+			if (request != NULL &&
+			    ((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_SEND) != RED_STACK_TRANSCEIVE_RESULT_SEND_OK ||
+			     (ret & RED_STACK_TRANSCEIVE_RESULT_MASK_READ) == RED_STACK_TRANSCEIVE_RESULT_READ_ERROR)) {
+				RED_STACK_STATISTICS_INCREMENT(slave->statistics.retransmits);
+			}
 
 			if ((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_SEND) == RED_STACK_TRANSCEIVE_RESULT_SEND_OK) {
 				if (!((ret & RED_STACK_TRANSCEIVE_RESULT_MASK_READ) == RED_STACK_TRANSCEIVE_RESULT_READ_ERROR)) {
@@ -699,9 +1074,15 @@ static void red_stack_spi_thread(void *opaque) {
 					// pop it from the queue now.
 					// If the sending didn't work (for whatever reason), we don't pop it
 					// and therefore we will automatically try to send it again in the next cycle.
-					mutex_lock(&slave->request_queue_mutex);
-					queue_pop(&slave->request_queue, NULL);
-					mutex_unlock(&slave->request_queue_mutex);
+					// If the ring was full the event thread might have more requests
+					// for this slave waiting in its fair queue.
+					bool was_full = spsc_ring_was_full(&slave->request_ring);
+
+					spsc_ring_pop(&slave->request_ring);
+
+					if (was_full) {
+						red_stack_spi_request_refill();
+					}
 				}
 			}
 
@@ -714,13 +1095,32 @@ static void red_stack_spi_thread(void *opaque) {
 				// Before the dispatching we insert the stack position into an enumerate message
 				red_stack_spi_insert_position(&response);
 
+				response.type = RED_STACK_RESPONSE_TYPE_PACKET;
+
 				red_stack_spi_request_dispatch_response_event(&response);
 				// Wait until message is dispatched, so we don't overwrite it
 				// accidentally.
 				//semaphore_acquire(&_red_stack_dispatch_packet_from_spi_semaphore);
 			}
 
-			SLEEP_NS(0, 1000*_red_stack_spi_poll_delay);
+			if ((ret & (RED_STACK_TRANSCEIVE_DATA_SEND | RED_STACK_TRANSCEIVE_DATA_RECEIVED)) != 0) {
+				cycle_active = true;
+				poll_delay = _red_stack_spi_poll_delay;
+			}
+
+			// The slaves need at least the configured poll delay between two
+			// transfers, only the back off on top of it can be cut short
+			if (poll_delay <= _red_stack_spi_poll_delay) {
+				wakeup = microseconds() + _red_stack_spi_poll_delay;
+
+				SLEEP_NS(0, 1000*_red_stack_spi_poll_delay);
+
+				realtime_jitter_add(&_red_stack_spi_jitter, microseconds() - wakeup);
+			} else if (red_stack_spi_wait_for_request(_red_stack_spi_poll_delay, poll_delay)) {
+				poll_delay = _red_stack_spi_poll_delay;
+			}
+
+			RED_STACK_STATISTICS_ADD(_red_stack_spi_sleep_time, microseconds() - sleep_start);
 		}
 
 		if (_red_stack.slave_num == 0) {
@@ -765,6 +1165,7 @@ static int red_stack_init_spi(void) {
 	const uint8_t lsb_first = RED_STACK_SPI_CONFIG_LSB_FIRST;
 	const uint8_t bits_per_word = RED_STACK_SPI_CONFIG_BITS_PER_WORD;
 	const uint32_t max_speed_hz = RED_STACK_SPI_CONFIG_MAX_SPEED_HZ;
+	pthread_condattr_t attr;
 
 	// Set Master High pin to low (so Master Bricks above RED Brick can
 	// configure themselves as slave)
@@ -814,6 +1215,26 @@ static int red_stack_init_spi(void) {
 		return -1;
 	}
 
+	// The SPI thread waits on this between transfers with an absolute timeout,
+	// use the monotonic clock so the timeout is not affected by clock changes
+	if (pthread_condattr_init(&attr) != 0) {
+		log_error("Could not create SPI request condition variable attributes");
+		return -1;
+	}
+
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	if (pthread_cond_init(&_red_stack_request_queued_cond, &attr) != 0) {
+		pthread_condattr_destroy(&attr);
+		log_error("Could not create SPI request condition variable");
+		return -1;
+	}
+
+	pthread_condattr_destroy(&attr);
+
+	_red_stack_spi_realtime_priority = config_get_option_value("spi.realtime_priority")->integer;
+	_red_stack_spi_cpu_affinity = config_get_option_value("spi.cpu_affinity")->integer;
+
 	// Create SPI packet transceive thread
 	// FIXME: maybe handshake thread start?
 	thread_create(&_red_stack_spi_thread, red_stack_spi_thread, NULL);
@@ -825,85 +1246,243 @@ static int red_stack_init_spi(void) {
 static void red_stack_dispatch_from_spi(void *opaque) {
 	int i;
 	eventfd_t ev;
+	uint32_t depth;
 	REDStackResponse *response;
 
 	(void)opaque;
 
-	// handle at most 5 queued responses at once to avoid blocking the event
-	// lopp for too long
-	for (i = 0; i < 5; ++i) {
-		if (eventfd_read(_red_stack_notification_event, &ev) < 0) {
-			if (errno_would_block()) {
-				return; // no queue responses left
+	// The notification event counts the queued responses. It is not a
+	// semaphore, so one read collects all notifications at once.
+	if (eventfd_read(_red_stack_notification_event, &ev) < 0) {
+		if (!errno_would_block()) {
+			log_error("Could not read from SPI notification event: %s (%d)",
+			          get_errno_name(errno), errno);
+		}
+
+		return;
+	}
+
+	depth = spsc_ring_count(&_red_stack.response_ring);
+
+	if (depth > _red_stack_response_high_water_mark) {
+		_red_stack_response_high_water_mark = depth;
+
+		if (depth > (uint32_t)_red_stack_responses_per_iteration) {
+			log_info("SPI response queue reached a new maximum depth of %u response(s) (spi.responses_per_iteration: %d)",
+			         depth, _red_stack_responses_per_iteration);
+		}
+	}
+
+	// Handle at most the configured number of responses at once to avoid
+	// blocking the event loop for too long
+	for (i = 0; i < _red_stack_responses_per_iteration; ++i) {
+		response = spsc_ring_peek(&_red_stack.response_ring);
+
+		if (response == NULL) {
+			return; // no queued responses left
+		}
+
+		switch (response->type) {
+		case RED_STACK_RESPONSE_TYPE_ADD_RECIPIENT:
+			stack_add_recipient(&_red_stack.base, response->packet.header.uid, response->stack_address);
+
+			break;
+
+		case RED_STACK_RESPONSE_TYPE_RESET:
+			stack_announce_disconnect(&_red_stack.base);
+			stack_clear_recipients(&_red_stack.base);
+
+			break;
+
+		default:
+			// Update routing table (this is necessary for Co MCU Bricklets)
+			if (response->packet.header.function_id == CALLBACK_ENUMERATE) {
+				stack_add_recipient(&_red_stack.base, response->packet.header.uid, response->stack_address);
 			}
 
-			log_error("Could not read from SPI notification event: %s (%d)",
+			// Send message into brickd dispatcher
+			network_dispatch_response(&response->packet);
+
+			break;
+		}
+
+		spsc_ring_pop(&_red_stack.response_ring);
+	}
+
+	// Keep the notification event readable to get called again in the next
+	// event loop iteration for the remaining responses
+	if (spsc_ring_peek(&_red_stack.response_ring) != NULL) {
+		log_debug("Deferring %u queued SPI response(s) to the next event loop iteration",
+		          spsc_ring_count(&_red_stack.response_ring));
+
+		ev = 1;
+
+		if (eventfd_write(_red_stack_notification_event, ev) < 0) {
+			log_error("Could not write to red stack spi notification event: %s (%d)",
 			          get_errno_name(errno), errno);
+		}
+	}
+}
 
-			return;
+EVENT_PROFILE_HANDLER(red_stack_dispatch_from_spi, "red-stack")
+
+static void red_stack_cancel_request(void *item, void *opaque) {
+	client_cancel_pending_request(opaque, &((REDStackRequest *)item)->packet);
+}
+
+// Requests already handed over to the SPI thread are sent anyway, only the
+// ones still waiting in the fair queues can be canceled
+static void red_stack_cancel_requests(Stack *stack, Client *client) {
+	int slave;
+	int count;
+
+	(void)stack;
+
+	for (slave = 0; slave < RED_STACK_SPI_MAX_SLAVES; slave++) {
+		count = fair_queue_cancel_owner(&_red_stack.slaves[slave].request_queue, client,
+		                                red_stack_cancel_request, client);
+
+		if (count > 0) {
+			log_debug("Canceled %d queued request(s) for slave %d", count, slave);
 		}
+	}
+}
 
-		mutex_lock(&_red_stack.response_queue_mutex);
-		response = queue_peek(&_red_stack.response_queue);
-		mutex_unlock(&_red_stack.response_queue_mutex);
+// Hand over as many requests from the fair queue of the slave to the SPI
+// thread as fit into its ring
+static void red_stack_refill_request_ring(REDStackSlave *slave) {
+	REDStackRequest *request;
+	REDStackRequest *ring_request;
 
-		if (response == NULL) { // eventfd indicates a reponsed but queue is empty
-			log_error("Response queue and notification event are out-of-sync");
+	while ((ring_request = spsc_ring_reserve(&slave->request_ring)) != NULL) {
+		request = fair_queue_peek(&slave->request_queue);
 
-			return;
+		if (request == NULL) {
+			break;
 		}
 
-		// Update routing table (this is necessary for Co MCU Bricklets)
-		if (response->packet.header.function_id == CALLBACK_ENUMERATE) {
-			stack_add_recipient(&_red_stack.base, response->packet.header.uid, response->stack_address);
+		memcpy(ring_request, request, sizeof(REDStackRequest));
+		spsc_ring_commit(&slave->request_ring);
+		fair_queue_pop(&slave->request_queue, NULL);
+	}
+}
+
+static uint32_t red_stack_get_queued_requests(REDStackSlave *slave) {
+	return slave->request_queue.count + spsc_ring_count(&slave->request_ring);
+}
+
+static void red_stack_update_peak_queued_requests(REDStackSlave *slave) {
+	uint32_t queued_requests = red_stack_get_queued_requests(slave);
+
+	if (queued_requests > slave->peak_queued_requests) {
+		slave->peak_queued_requests = queued_requests;
+	}
+}
+
+static void red_stack_discard_queued_requests(void) {
+	int slave;
+
+	if (!__atomic_exchange_n(&_red_stack_discard_requests, false, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	for (slave = 0; slave < RED_STACK_SPI_MAX_SLAVES; slave++) {
+		while (fair_queue_peek(&_red_stack.slaves[slave].request_queue) != NULL) {
+			fair_queue_pop(&_red_stack.slaves[slave].request_queue, NULL);
+		}
+	}
+}
+
+// The SPI thread made room in a full request ring
+static void red_stack_refill_request_rings(void *opaque) {
+	uint8_t slave;
+	eventfd_t ev;
+
+	(void)opaque;
+
+	if (eventfd_read(_red_stack_request_refill_event, &ev) < 0) {
+		if (errno_would_block()) {
+			return;
 		}
 
-		// Send message into brickd dispatcher
-		network_dispatch_response(&response->packet);
+		log_error("Could not read from SPI request refill event: %s (%d)",
+		          get_errno_name(errno), errno);
 
-		mutex_lock(&_red_stack.response_queue_mutex);
-		queue_pop(&_red_stack.response_queue, NULL);
-		mutex_unlock(&_red_stack.response_queue_mutex);
+		return;
+	}
+
+	red_stack_discard_queued_requests();
+
+	for (slave = 0; slave < _red_stack.slave_num; slave++) {
+		red_stack_refill_request_ring(&_red_stack.slaves[slave]);
 	}
 }
 
 // New packet from brickd event loop is queued to be written to stack via SPI
-static int red_stack_dispatch_to_spi(Stack *stack, Packet *request, Recipient *recipient) {
+static int red_stack_dispatch_to_spi(Stack *stack, Packet *request,
+                                     Recipient *recipient, Client *client) {
 	REDStackRequest *queued_request;
 
 	(void)stack;
 
+	red_stack_discard_queued_requests();
+
 	if (request->header.uid == 0) {
 		// UID = 0 -> Broadcast to all UIDs
 		uint8_t is;
 
 		for (is = 0; is < _red_stack.slave_num; is++) {
-			mutex_lock(&_red_stack.slaves[is].request_queue_mutex);
-			queued_request = queue_push(&_red_stack.slaves[is].request_queue);
+			queued_request = fair_queue_push(&_red_stack.slaves[is].request_queue, client);
+
+			if (queued_request == NULL) {
+				// The other slaves still get the broadcast
+				log_error("Could not push request (%s) to request queue for slave %d, dropping request: %s (%d)",
+				          packet_get_request_signature(packet_signature, request),
+				          is, get_errno_name(errno), errno);
+
+				continue;
+			}
+
 			queued_request->status = RED_STACK_REQUEST_STATUS_ADDED;
 			queued_request->slave = &_red_stack.slaves[is];
+			queued_request->queued = microseconds();
 			memcpy(&queued_request->packet, request, request->header.length);
-			mutex_unlock(&_red_stack.slaves[is].request_queue_mutex);
 
-			log_packet_debug("Request is queued to be broadcast to slave %d (%s)",
-			                 is, packet_get_request_signature(packet_signature, request));
+			red_stack_refill_request_ring(&_red_stack.slaves[is]);
+			red_stack_update_peak_queued_requests(&_red_stack.slaves[is]);
+
+			log_packet_debug_checked("Request is queued to be broadcast to slave %d (%s)",
+			                         is, packet_get_request_signature(packet_signature, request));
 		}
 	} else if (recipient != NULL) {
 		// Get slave for recipient opaque (== stack_address)
 		REDStackSlave *slave = &_red_stack.slaves[recipient->opaque];
 
-		mutex_lock(&slave->request_queue_mutex);
-		queued_request = queue_push(&slave->request_queue);
+		queued_request = fair_queue_push(&slave->request_queue, client);
+
+		if (queued_request == NULL) {
+			log_error("Could not push request (%s) to request queue for slave %d, dropping request: %s (%d)",
+			          packet_get_request_signature(packet_signature, request),
+			          slave->stack_address, get_errno_name(errno), errno);
+
+			return -1;
+		}
+
 		queued_request->status = RED_STACK_REQUEST_STATUS_ADDED;
 		queued_request->slave = slave;
+		queued_request->queued = microseconds();
 		memcpy(&queued_request->packet, request, request->header.length);
-		mutex_unlock(&slave->request_queue_mutex);
 
-		log_packet_debug("Packet is queued to be send to slave %d over SPI (%s)",
-		                 slave->stack_address,
-		                 packet_get_request_signature(packet_signature, request));
+		red_stack_refill_request_ring(slave);
+		red_stack_update_peak_queued_requests(slave);
+
+		log_packet_debug_checked("Packet is queued to be send to slave %d over SPI (%s)",
+		                         slave->stack_address,
+		                         packet_get_request_signature(packet_signature, request));
 	}
 
+	red_stack_spi_wake_up();
+
 	return 0;
 }
 
@@ -921,6 +1500,9 @@ static void red_stack_reset_handler(void *opaque) {
 
 	_red_stack_spi_thread_running = false;
 
+	// If the spi thread is backing off we have to cut that short
+	red_stack_spi_wake_up();
+
 	// If there is no slave we have to wake up the spi thread
 	if (_red_stack.slave_num == 0) {
 		pthread_mutex_lock(&_red_stack_wait_for_reset_mutex);
@@ -930,6 +1512,21 @@ static void red_stack_reset_handler(void *opaque) {
 	}
 }
 
+static void red_stack_read_poll_delays(void) {
+	int poll_delay = config_get_option_value("poll_delay.spi")->integer;
+	int max_poll_delay = config_get_option_value("poll_delay.spi_max")->integer;
+
+	if (max_poll_delay < poll_delay) {
+		max_poll_delay = poll_delay;
+	}
+
+	// the SPI thread reads both values without locking. an aligned int is
+	// written in one go, the thread only sees one mismatched pair of values
+	// for a single iteration at worst, which the backoff clamping tolerates
+	_red_stack_spi_poll_delay = poll_delay;
+	_red_stack_spi_max_poll_delay = max_poll_delay;
+}
+
 int red_stack_init(void) {
 	int phase = 0;
 	int i;
@@ -937,7 +1534,9 @@ int red_stack_init(void) {
 
 	log_debug("Initializing RED Brick SPI Stack subsystem");
 
-	_red_stack_spi_poll_delay = config_get_option_value("poll_delay.spi")->integer;
+	red_stack_read_poll_delays();
+
+	_red_stack_responses_per_iteration = config_get_option_value("spi.responses_per_iteration")->integer;
 
 	if (gpio_sysfs_export(RED_STACK_RESET_PIN_GPIO_NUM) < 0) {
 		// Just issue a warning, RED Brick will work without reset interrupt
@@ -963,6 +1562,8 @@ int red_stack_init(void) {
 		goto cleanup;
 	}
 
+	_red_stack.base.cancel_requests = red_stack_cancel_requests;
+
 	phase = 1;
 
 	// add to stacks array
@@ -972,7 +1573,7 @@ int red_stack_init(void) {
 
 	phase = 2;
 
-	if ((_red_stack_notification_event = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE)) < 0) {
+	if ((_red_stack_notification_event = eventfd(0, EFD_NONBLOCK)) < 0) {
 		log_error("Could not create red stack notification event: %s (%d)",
 		          get_errno_name(errno), errno);
 
@@ -984,7 +1585,7 @@ int red_stack_init(void) {
 	// Add notification pipe as event source.
 	// Event is used to dispatch packets.
 	if (event_add_source(_red_stack_notification_event, EVENT_SOURCE_TYPE_GENERIC,
-	                     EVENT_READ, red_stack_dispatch_from_spi, NULL) < 0) {
+	                     EVENT_READ, EVENT_PROFILED(red_stack_dispatch_from_spi), NULL) < 0) {
 		log_error("Could not add red stack notification pipe as event source");
 
 		goto cleanup;
@@ -994,7 +1595,8 @@ int red_stack_init(void) {
 
 	// Initialize SPI packet queues
 	for (k = 0; k < RED_STACK_SPI_MAX_SLAVES; k++) {
-		if (queue_create(&_red_stack.slaves[k].request_queue, sizeof(REDStackRequest)) < 0) {
+		if (fair_queue_create(&_red_stack.slaves[k].request_queue, sizeof(REDStackRequest),
+		                      offsetof(REDStackRequest, packet)) < 0) {
 			log_error("Could not create SPI request queue %d: %s (%d)",
 			          k, get_errno_name(errno), errno);
 
@@ -1004,14 +1606,20 @@ int red_stack_init(void) {
 
 	phase = 5;
 
+	// Initialize lock-free rings between brickd event thread and SPI thread
 	for (i = 0; i < RED_STACK_SPI_MAX_SLAVES; i++) {
-		mutex_create(&_red_stack.slaves[i].request_queue_mutex);
-	}
+		if (spsc_ring_create(&_red_stack.slaves[i].request_ring, sizeof(REDStackRequest),
+		                     RED_STACK_REQUEST_RING_SIZE) < 0) {
+			log_error("Could not create SPI request ring %d: %s (%d)",
+			          i, get_errno_name(errno), errno);
 
-	mutex_create(&_red_stack.response_queue_mutex);
+			goto cleanup;
+		}
+	}
 
-	if (queue_create(&_red_stack.response_queue, sizeof(REDStackResponse)) < 0) {
-		log_error("Could not create SPI response queue: %s (%d)",
+	if (spsc_ring_create(&_red_stack.response_ring, sizeof(REDStackResponse),
+	                     RED_STACK_RESPONSE_RING_SIZE) < 0) {
+		log_error("Could not create SPI response ring: %s (%d)",
 		          get_errno_name(errno), errno);
 
 		goto cleanup;
@@ -1019,6 +1627,26 @@ int red_stack_init(void) {
 
 	phase = 6;
 
+	if ((_red_stack_request_refill_event = eventfd(0, EFD_NONBLOCK)) < 0) {
+		log_error("Could not create red stack request refill event: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 7;
+
+	// Add refill event as event source.
+	// Event is used to hand over further requests to the SPI thread.
+	if (event_add_source(_red_stack_request_refill_event, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, red_stack_refill_request_rings, NULL) < 0) {
+		log_error("Could not add red stack request refill event as event source");
+
+		goto cleanup;
+	}
+
+	phase = 8;
+
 	if (red_stack_init_spi() < 0) {
 		goto cleanup;
 	}
@@ -1037,26 +1665,32 @@ int red_stack_init(void) {
 		}
 	}
 
-	phase = 7;
+	phase = 9;
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
+	case 8:
+		event_remove_source(_red_stack_request_refill_event, EVENT_SOURCE_TYPE_GENERIC);
+		// fall through
+
+	case 7:
+		close(_red_stack_request_refill_event);
+		// fall through
+
 	case 6:
-		queue_destroy(&_red_stack.response_queue, NULL);
+		spsc_ring_destroy(&_red_stack.response_ring);
 		// fall through
 
 	case 5:
-		mutex_destroy(&_red_stack.response_queue_mutex);
-
-		for (i = 0; i < RED_STACK_SPI_MAX_SLAVES; i++) {
-			mutex_destroy(&_red_stack.slaves[i].request_queue_mutex);
+		for (i--; i >= 0; i--) {
+			spsc_ring_destroy(&_red_stack.slaves[i].request_ring);
 		}
 
 		// fall through
 
 	case 4:
 		for (k--; k >= 0; k--) {
-			queue_destroy(&_red_stack.slaves[k].request_queue, NULL);
+			fair_queue_destroy(&_red_stack.slaves[k].request_queue, NULL);
 		}
 
 		event_remove_source(_red_stack_notification_event, EVENT_SOURCE_TYPE_GENERIC);
@@ -1078,7 +1712,13 @@ cleanup:
 		break;
 	}
 
-	return phase == 7 ? 0 : -1;
+	return phase == 9 ? 0 : -1;
+}
+
+// called by config_options_reload, the new poll delays are used by the SPI
+// thread from its next iteration on
+void red_stack_reload_config(void) {
+	red_stack_read_poll_delays();
 }
 
 void red_stack_exit(void) {
@@ -1090,8 +1730,9 @@ void red_stack_exit(void) {
 		event_remove_source(_red_stack_reset_fd, EVENT_SOURCE_TYPE_GENERIC);
 	}
 
-	// Remove event as possible poll source
+	// Remove events as possible poll source
 	event_remove_source(_red_stack_notification_event, EVENT_SOURCE_TYPE_GENERIC);
+	event_remove_source(_red_stack_request_refill_event, EVENT_SOURCE_TYPE_GENERIC);
 
 	// Make sure that Thread shuts down properly
 	if (_red_stack_spi_thread_running) {
@@ -1100,6 +1741,9 @@ void red_stack_exit(void) {
 		eventfd_t ev = 1;
 		eventfd_write(_red_stack_notification_event, ev);
 
+		// Also wake it up if it is waiting between transfers
+		red_stack_spi_wake_up();
+
 		thread_join(&_red_stack_spi_thread);
 		thread_destroy(&_red_stack_spi_thread);
 	}
@@ -1109,22 +1753,57 @@ void red_stack_exit(void) {
 		red_stack_spi_deselect(&_red_stack.slaves[slave]);
 	}
 
-	// We can also free the queue and stack now, nobody will use them anymore
+	// We can also free the queues, rings and stack now, nobody will use them anymore
 	for (i = 0; i < RED_STACK_SPI_MAX_SLAVES; i++) {
-		queue_destroy(&_red_stack.slaves[i].request_queue, NULL);
+		fair_queue_destroy(&_red_stack.slaves[i].request_queue, NULL);
+		spsc_ring_destroy(&_red_stack.slaves[i].request_ring);
 	}
 
 	hardware_remove_stack(&_red_stack.base);
 	stack_destroy(&_red_stack.base);
 
-	for (i = 0; i < RED_STACK_SPI_MAX_SLAVES; i++) {
-		mutex_destroy(&_red_stack.slaves[i].request_queue_mutex);
-	}
+	spsc_ring_destroy(&_red_stack.response_ring);
 
-	queue_destroy(&_red_stack.response_queue, NULL);
-	mutex_destroy(&_red_stack.response_queue_mutex);
+	pthread_cond_destroy(&_red_stack_request_queued_cond);
 
 	// Close file descriptors
 	close(_red_stack_notification_event);
+	close(_red_stack_request_refill_event);
 	close(_red_stack_spi_fd);
 }
+
+int red_stack_get_slave_count(void) {
+	return _red_stack.slave_num;
+}
+
+// the statistics of the SPI link are written by the SPI thread, the queue
+// statistics by the event thread
+int red_stack_get_slave_statistics(int index, REDStackStatistics *statistics) {
+	REDStackSlave *slave;
+	const uint32_t *link;
+	uint32_t *copy;
+	int i;
+
+	if (index < 0 || index >= _red_stack.slave_num) {
+		return -1;
+	}
+
+	slave = &_red_stack.slaves[index];
+	link = (const uint32_t *)&slave->statistics;
+	copy = (uint32_t *)&statistics->link;
+
+	for (i = 0; i < (int)(sizeof(REDStackSlaveStatistics) / sizeof(uint32_t)); ++i) {
+		copy[i] = __atomic_load_n(&link[i], __ATOMIC_RELAXED);
+	}
+
+	statistics->queued_requests = red_stack_get_queued_requests(slave);
+	statistics->peak_queued_requests = slave->peak_queued_requests;
+	statistics->transceive_time = __atomic_load_n(&_red_stack_spi_transceive_time, __ATOMIC_RELAXED);
+	statistics->sleep_time = __atomic_load_n(&_red_stack_spi_sleep_time, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void red_stack_get_spi_jitter(RealtimeJitter *jitter) {
+	realtime_jitter_get(&_red_stack_spi_jitter, jitter);
+}
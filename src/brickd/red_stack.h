@@ -22,7 +22,44 @@
 #ifndef BRICKD_RED_STACK_H
 #define BRICKD_RED_STACK_H
 
+#include <stdint.h>
+
+#include "realtime.h"
+
+#define RED_STACK_LATENCY_BUCKETS 8
+
+// written by the SPI thread only. bucket 0 counts latencies below 100
+// microseconds, bucket i counts latencies from 100 * 2^(i-1) up to 100 * 2^i
+// microseconds and the last bucket counts everything from
+// 100 * 2^(RED_STACK_LATENCY_BUCKETS-2) microseconds upwards
+typedef struct {
+	uint32_t transfers;
+	uint32_t packets_in; // valid responses
+	uint32_t packets_out; // acknowledged requests
+	uint32_t retransmits; // requests kept queued to be sent again
+	uint32_t sequence_mismatches; // requests not acknowledged by the slave
+	uint32_t checksum_errors;
+	uint32_t length_errors;
+	uint32_t preamble_errors; // slave too busy to fill its DMA buffers
+	uint32_t transfer_errors; // failed or short ioctl
+	uint32_t latency_histogram[RED_STACK_LATENCY_BUCKETS]; // from queuing to acknowledgement
+} REDStackSlaveStatistics;
+
+typedef struct {
+	REDStackSlaveStatistics link;
+	uint32_t queued_requests; // in fair queue and ring together
+	uint32_t peak_queued_requests;
+	uint64_t transceive_time; // microseconds, whole SPI thread
+	uint64_t sleep_time; // microseconds, whole SPI thread
+} REDStackStatistics;
+
 int red_stack_init(void);
 void red_stack_exit(void);
 
+void red_stack_reload_config(void);
+
+int red_stack_get_slave_count(void);
+int red_stack_get_slave_statistics(int index, REDStackStatistics *statistics);
+void red_stack_get_spi_jitter(RealtimeJitter *jitter);
+
 #endif // BRICKD_RED_STACK_H
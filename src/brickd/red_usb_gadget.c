@@ -48,6 +48,7 @@
 #include <daemonlib/event.h>
 #include <daemonlib/file.h>
 #include <daemonlib/log.h>
+#include <daemonlib/timer.h>
 #include <daemonlib/utils.h>
 
 #include "red_usb_gadget.h"
@@ -58,6 +59,7 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
 #define G_RED_BRICK_STATE_FILENAME "/proc/g_red_brick_state"
 #define G_RED_BRICK_DATA_FILENAME "/dev/g_red_brick_data"
+#define RECONNECT_INTERVAL 1000000 // 1 second in microseconds
 
 typedef enum {
 	RED_USB_GADGET_STATE_DISCONNECTED = 0,
@@ -67,15 +69,69 @@ typedef enum {
 static uint32_t _uid = 0; // always little endian
 static File _state_file;
 static Client *_client = NULL;
+static Timer _reconnect_timer;
+static bool _reconnect_timer_armed = false;
 
 static int red_usb_gadget_create_client(void);
 
+static void red_usb_gadget_stop_reconnect(void) {
+	if (!_reconnect_timer_armed) {
+		return;
+	}
+
+	if (timer_configure(&_reconnect_timer, 0, 0) < 0) {
+		log_error("Could not stop reconnect timer for RED Brick USB gadget: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	_reconnect_timer_armed = false;
+}
+
+// keep trying while the USB gadget is connected, the data file might not be
+// ready again right away after it got closed
+static void red_usb_gadget_start_reconnect(void) {
+	if (_reconnect_timer_armed) {
+		return;
+	}
+
+	if (timer_configure(&_reconnect_timer, RECONNECT_INTERVAL, RECONNECT_INTERVAL) < 0) {
+		log_error("Could not start reconnect timer for RED Brick USB gadget: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return;
+	}
+
+	_reconnect_timer_armed = true;
+
+	log_warn("Could not reconnect to RED Brick USB gadget, retrying with 1 second interval");
+}
+
+static void red_usb_gadget_handle_reconnect(void *opaque) {
+	(void)opaque;
+
+	if (_client != NULL) {
+		red_usb_gadget_stop_reconnect();
+
+		return;
+	}
+
+	log_debug("Retrying to reconnect to RED Brick USB gadget");
+
+	if (red_usb_gadget_create_client() >= 0) {
+		red_usb_gadget_stop_reconnect();
+	}
+}
+
 static void red_usb_gadget_client_destroy_done(void) {
 	log_debug("Trying to reconnect to RED Brick USB gadget");
 
 	_client = NULL;
 
-	red_usb_gadget_create_client();
+	if (red_usb_gadget_create_client() < 0) {
+		red_usb_gadget_start_reconnect();
+	}
 }
 
 static int red_usb_gadget_create_client(void) {
@@ -111,7 +167,7 @@ static int red_usb_gadget_create_client(void) {
 		return -1;
 	}
 
-	_client->destroy_done = red_usb_gadget_client_destroy_done; // FIXME: this will only do one reconnect try
+	_client->destroy_done = red_usb_gadget_client_destroy_done;
 	_client->authentication_state = CLIENT_AUTHENTICATION_STATE_DISABLED;
 
 	log_info("Connected to RED Brick USB gadget");
@@ -125,6 +181,8 @@ static int red_usb_gadget_connect(void) {
 		return -1;
 	}
 
+	red_usb_gadget_stop_reconnect();
+
 	// send enumerate-connected callback
 	log_debug("Sending enumerate-connected callback for RED Brick to '%s'",
 	          G_RED_BRICK_DATA_FILENAME);
@@ -135,8 +193,15 @@ static int red_usb_gadget_connect(void) {
 }
 
 static void red_usb_gadget_disconnect(void) {
+	red_usb_gadget_stop_reconnect();
+
+	if (_client == NULL) {
+		// a reconnect was still pending
+		return;
+	}
+
 	_client->destroy_done = NULL;
-	_client->disconnected = true;
+	client_mark_as_disconnected(_client);
 	_client = NULL;
 
 	log_info("Disconnected from RED Brick USB gadget");
@@ -176,7 +241,7 @@ static void red_usb_gadget_handle_state_change(void *opaque) {
 		break;
 
 	case RED_USB_GADGET_STATE_DISCONNECTED:
-		if (_client == NULL) {
+		if (_client == NULL && !_reconnect_timer_armed) {
 			log_warn("Already disconnected from RED Brick USB gadget");
 
 			return;
@@ -222,12 +287,21 @@ int red_usb_gadget_init(void) {
 
 	phase = 1;
 
+	if (timer_create_(&_reconnect_timer, red_usb_gadget_handle_reconnect, NULL) < 0) {
+		log_error("Could not create reconnect timer for RED Brick USB gadget: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 2;
+
 	if (event_add_source(_state_file.handle, EVENT_SOURCE_TYPE_GENERIC,
 	                     EVENT_READ, red_usb_gadget_handle_state_change, NULL) < 0) {
 		goto cleanup;
 	}
 
-	phase = 2;
+	phase = 3;
 
 	if (file_read(&_state_file, &state, sizeof(state)) != sizeof(state)) {
 		log_error("Could not read from '%s': %s (%d)",
@@ -240,14 +314,18 @@ int red_usb_gadget_init(void) {
 		goto cleanup;
 	}
 
-	phase = 3;
+	phase = 4;
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
-	case 2:
+	case 3:
 		event_remove_source(_state_file.handle, EVENT_SOURCE_TYPE_GENERIC);
 		// fall through
 
+	case 2:
+		timer_destroy(&_reconnect_timer);
+		// fall through
+
 	case 1:
 		file_destroy(&_state_file);
 		// fall through
@@ -256,7 +334,7 @@ cleanup:
 		break;
 	}
 
-	return phase == 3 ? 0 : -1;
+	return phase == 4 ? 0 : -1;
 }
 
 void red_usb_gadget_exit(void) {
@@ -266,6 +344,8 @@ void red_usb_gadget_exit(void) {
 		red_usb_gadget_disconnect();
 	}
 
+	timer_destroy(&_reconnect_timer);
+
 	event_remove_source(_state_file.handle, EVENT_SOURCE_TYPE_GENERIC);
 
 	file_destroy(&_state_file);
@@ -21,6 +21,8 @@
 
 #include <errno.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/un.h>
 
 #include <daemonlib/base58.h>
@@ -34,6 +36,7 @@
 
 #include "hardware.h"
 #include "network.h"
+#include "packet_debug.h"
 #include "red_usb_gadget.h"
 #include "stack.h"
 
@@ -42,14 +45,31 @@ static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 #define RECONNECT_INTERVAL 2000000 // 2 seconds in microseconds
 #define SOCKET_FILENAME "/var/run/redapid-brickd.socket"
 
+// responses are parsed in place from the receive buffer, requests are
+// collected in the request buffer and written in one go at the end of the
+// event loop iteration. file transfers and program output move a lot of
+// packets over this link
+#define RECEIVE_BUFFER_SIZE (32 * (int)sizeof(Packet))
+#define REQUEST_BUFFER_SIZE (256 * (int)sizeof(Packet))
+#define MAX_READS_PER_EVENT 4
+
+// both daemons run on the same single-core RED Brick. larger kernel socket
+// buffers let a whole burst of file transfer or program output packets pass
+// with one wakeup on each side, instead of the sender blocking early
+#define SOCKET_BUFFER_SIZE (256 * 1024)
+
 typedef struct {
 	Stack base;
 
 	Socket socket;
-	Packet response;
-	int response_used;
+	uint8_t response_buffer[RECEIVE_BUFFER_SIZE];
+	int response_buffer_start; // start of the first unparsed response
+	int response_buffer_used;
 	bool response_header_checked;
-	Writer request_writer;
+	uint8_t request_buffer[REQUEST_BUFFER_SIZE];
+	int request_buffer_used;
+	bool write_pending;
+	REDBrickAPIDaemonStatistics statistics;
 } REDBrickAPIDaemon;
 
 static REDBrickAPIDaemon _redapid;
@@ -59,7 +79,13 @@ static bool _connect_error_warning = false;
 uint8_t _redapid_version[3] = { 2, 0, 0 };
 
 static void redapid_disconnect(bool reconnect) {
-	writer_destroy(&_redapid.request_writer);
+	if (_redapid.request_buffer_used > 0) {
+		log_warn("Disconnecting from RED Brick API Daemon while %d byte(s) of requests are still unsent",
+		         _redapid.request_buffer_used);
+	}
+
+	_redapid.request_buffer_used = 0;
+	_redapid.write_pending = false;
 
 	event_remove_source(_redapid.socket.handle, EVENT_SOURCE_TYPE_GENERIC);
 	socket_destroy(&_redapid.socket);
@@ -78,96 +104,215 @@ static void redapid_disconnect(bool reconnect) {
 	}
 }
 
-static void redapid_handle_read(void *opaque) {
-	int length;
-	const char *message = NULL;
-	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+static void redapid_handle_write(void *opaque);
 
-	(void)opaque;
+static void redapid_set_write_pending(bool write_pending) {
+	if (_redapid.write_pending == write_pending) {
+		return;
+	}
+
+	if (write_pending) {
+		if (event_modify_source(_redapid.socket.handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        0, EVENT_WRITE, redapid_handle_write, NULL) < 0) {
+			log_error("Could not wait for RED Brick API Daemon to become writable, disconnecting redapid: %s (%d)",
+			          get_errno_name(errno), errno);
 
-	length = socket_receive(&_redapid.socket, (uint8_t *)&_redapid.response + _redapid.response_used,
-	                        sizeof(Packet) - _redapid.response_used);
+			redapid_disconnect(true);
 
-	if (length == 0) {
-		log_info("RED Brick API Daemon disconnected by peer");
+			return;
+		}
+	} else {
+		if (event_modify_source(_redapid.socket.handle, EVENT_SOURCE_TYPE_GENERIC,
+		                        EVENT_WRITE, 0, NULL, NULL) < 0) {
+			log_error("Could not stop waiting for RED Brick API Daemon to become writable, disconnecting redapid: %s (%d)",
+			          get_errno_name(errno), errno);
 
-		redapid_disconnect(true);
+			redapid_disconnect(true);
 
+			return;
+		}
+	}
+
+	_redapid.write_pending = write_pending;
+}
+
+// writes as much of the request buffer as the socket accepts without
+// blocking, the rest is written as soon as the socket becomes writable
+static void redapid_write_request_buffer(void) {
+	int length;
+
+	if (!_connected || _redapid.request_buffer_used == 0) {
 		return;
 	}
 
+	length = socket_send(&_redapid.socket, _redapid.request_buffer,
+	                     _redapid.request_buffer_used);
+
 	if (length < 0) {
-		if (length == IO_CONTINUE) {
-			// no actual data received
-		} else if (errno_interrupted()) {
-			log_debug("Receiving from RED Brick API Daemon was interrupted, retrying");
-		} else if (errno_would_block()) {
-			log_debug("Receiving from RED Brick API Daemon would block, retrying");
-		} else {
-			log_error("Could not receive from RED Brick API Daemon, disconnecting redapid: %s (%d)",
+		if (!errno_interrupted() && !errno_would_block()) {
+			log_error("Could not send to RED Brick API Daemon, disconnecting redapid: %s (%d)",
 			          get_errno_name(errno), errno);
 
 			redapid_disconnect(true);
+
+			return;
 		}
 
-		return;
+		length = 0;
+	} else {
+		++_redapid.statistics.writes;
+		_redapid.statistics.bytes_out += length;
 	}
 
-	_redapid.response_used += length;
+	memmove(_redapid.request_buffer, _redapid.request_buffer + length,
+	        _redapid.request_buffer_used - length);
 
-	while (_connected && _redapid.response_used > 0) {
-		if (_redapid.response_used < (int)sizeof(PacketHeader)) {
-			// wait for complete header
-			break;
+	_redapid.request_buffer_used -= length;
+
+	redapid_set_write_pending(_redapid.request_buffer_used > 0);
+}
+
+static void redapid_handle_write(void *opaque) {
+	(void)opaque;
+
+	redapid_write_request_buffer();
+}
+
+// called at the end of each event loop iteration
+void redapid_flush_requests(void) {
+	if (!_redapid.write_pending) {
+		redapid_write_request_buffer();
+	}
+}
+
+static void redapid_handle_read(void *opaque) {
+	int read_length;
+	int length;
+	int free_length;
+	int available;
+	int reads = 0;
+	Packet *response;
+	const char *message = NULL;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+
+	(void)opaque;
+
+	while (_connected && reads < MAX_READS_PER_EVENT) {
+		// only move the unparsed rest to the front if a complete packet would
+		// not fit behind it anymore
+		if (_redapid.response_buffer_start > 0 &&
+		    RECEIVE_BUFFER_SIZE - _redapid.response_buffer_used < (int)sizeof(Packet)) {
+			memmove(_redapid.response_buffer,
+			        _redapid.response_buffer + _redapid.response_buffer_start,
+			        _redapid.response_buffer_used - _redapid.response_buffer_start);
+
+			_redapid.response_buffer_used -= _redapid.response_buffer_start;
+			_redapid.response_buffer_start = 0;
 		}
 
-		if (!_redapid.response_header_checked) {
-			if (!packet_header_is_valid_response(&_redapid.response.header, &message)) {
-				// FIXME: include packet_get_content_dump output in the error message
-				log_error("Received invalid response (%s) from RED Brick API Daemon, disconnecting redapid: %s",
-				          packet_get_response_signature(packet_signature, &_redapid.response),
-				          message);
+		free_length = RECEIVE_BUFFER_SIZE - _redapid.response_buffer_used;
+		read_length = socket_receive(&_redapid.socket,
+		                        _redapid.response_buffer + _redapid.response_buffer_used,
+		                        free_length);
 
-				redapid_disconnect(true);
+		if (read_length == 0) {
+			log_info("RED Brick API Daemon disconnected by peer");
 
-				return;
-			}
+			redapid_disconnect(true);
 
-			_redapid.response_header_checked = true;
+			return;
 		}
 
-		length = _redapid.response.header.length;
+		if (read_length < 0) {
+			if (read_length == IO_CONTINUE) {
+				// no actual data received
+			} else if (errno_interrupted()) {
+				log_debug("Receiving from RED Brick API Daemon was interrupted, retrying");
+			} else if (errno_would_block()) {
+				// everything available was read
+			} else {
+				log_error("Could not receive from RED Brick API Daemon, disconnecting redapid: %s (%d)",
+				          get_errno_name(errno), errno);
 
-		if (_redapid.response_used < length) {
-			// wait for complete packet
-			break;
+				redapid_disconnect(true);
+			}
+
+			return;
 		}
 
-		log_packet_debug("Received %s (%s) from RED Brick API Daemon",
-		                 packet_get_response_type(&_redapid.response),
-		                 packet_get_response_signature(packet_signature, &_redapid.response));
+		++reads;
+		++_redapid.statistics.reads;
+		_redapid.statistics.bytes_in += read_length;
+		_redapid.response_buffer_used += read_length;
+
+		while (_connected) {
+			available = _redapid.response_buffer_used - _redapid.response_buffer_start;
+
+			if (available < (int)sizeof(PacketHeader)) {
+				// wait for complete header
+				break;
+			}
+
+			response = (Packet *)(_redapid.response_buffer + _redapid.response_buffer_start);
+
+			if (!_redapid.response_header_checked) {
+				if (!packet_header_is_valid_response(&response->header, &message)) {
+					// FIXME: include packet_get_content_dump output in the error message
+					log_error("Received invalid response (%s) from RED Brick API Daemon, disconnecting redapid: %s",
+					          packet_get_response_signature(packet_signature, response),
+					          message);
 
-		stack_add_recipient(&_redapid.base, _redapid.response.header.uid, 0);
+					redapid_disconnect(true);
 
-		network_dispatch_response(&_redapid.response);
+					return;
+				}
 
-		memmove(&_redapid.response, (uint8_t *)&_redapid.response + length,
-		        _redapid.response_used - length);
+				_redapid.response_header_checked = true;
+			}
+
+			length = response->header.length;
+
+			if (available < length) {
+				// wait for complete packet
+				break;
+			}
+
+			log_packet_debug_checked("Received %s (%s) from RED Brick API Daemon",
+			                         packet_get_response_type(response),
+			                         packet_get_response_signature(packet_signature, response));
+
+			++_redapid.statistics.packets_in;
+
+			stack_add_recipient(&_redapid.base, response->header.uid, 0);
 
-		_redapid.response_used -= length;
-		_redapid.response_header_checked = false;
+			network_dispatch_response(response);
+
+			_redapid.response_buffer_start += length;
+			_redapid.response_header_checked = false;
+		}
+
+		if (_redapid.response_buffer_start == _redapid.response_buffer_used) {
+			_redapid.response_buffer_start = 0;
+			_redapid.response_buffer_used = 0;
+		}
+
+		// a short read means the socket is drained
+		if (read_length < free_length) {
+			break;
+		}
 	}
 }
 
 static int redapid_dispatch_request(Stack *stack, Packet *request,
-                                    Recipient *recipient) {
+                                    Recipient *recipient, Client *client) {
 	char base58[BASE58_MAX_LENGTH];
 	uint32_t uid; // always little endian
 	EnumerateCallback enumerate_callback;
-	int enqueued = 0;
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 
 	(void)stack;
 	(void)recipient;
+	(void)client;
 
 	if (request->header.function_id == FUNCTION_ENUMERATE) {
 		uid = red_usb_gadget_get_uid();
@@ -198,15 +343,39 @@ static int redapid_dispatch_request(Stack *stack, Packet *request,
 
 		network_dispatch_response((Packet *)&enumerate_callback);
 	} else if (_connected) {
-		// forward to redapid
-		enqueued = writer_write(&_redapid.request_writer, request);
+		// forward to redapid, the request buffer is written at the end of the
+		// event loop iteration or earlier if it is full
+		if (_redapid.request_buffer_used + request->header.length > REQUEST_BUFFER_SIZE &&
+		    !_redapid.write_pending) {
+			redapid_write_request_buffer();
+		}
 
-		if (enqueued < 0) {
+		if (!_connected) {
 			return -1;
 		}
 
-		log_packet_debug("%s request to RED Brick API Daemon",
-		                 enqueued ? "Enqueued" : "Sent");
+		if (_redapid.request_buffer_used + request->header.length > REQUEST_BUFFER_SIZE) {
+			++_redapid.statistics.dropped_requests;
+
+			log_warn("Request buffer for RED Brick API Daemon is full, dropping request (%s, dropped: %u)",
+			         packet_get_request_signature(packet_signature, request),
+			         _redapid.statistics.dropped_requests);
+
+			return -1;
+		}
+
+		memcpy(_redapid.request_buffer + _redapid.request_buffer_used, request,
+		       request->header.length);
+
+		_redapid.request_buffer_used += request->header.length;
+		++_redapid.statistics.packets_out;
+
+		if ((uint32_t)_redapid.request_buffer_used > _redapid.statistics.peak_buffered_bytes) {
+			_redapid.statistics.peak_buffered_bytes = _redapid.request_buffer_used;
+		}
+
+		log_packet_debug("Buffered request to RED Brick API Daemon (buffered: %d byte(s))",
+		                 _redapid.request_buffer_used);
 	} else {
 		log_packet_debug("Not connected to RED Brick API Daemon, ignoring request");
 	}
@@ -214,20 +383,21 @@ static int redapid_dispatch_request(Stack *stack, Packet *request,
 	return 0;
 }
 
-static char *redapid_get_recipient_signature(char *signature, bool upper, void *opaque) {
-	(void)upper;
-	(void)opaque;
+// failing to enlarge the buffers is not fatal, the default sizes work too
+static void redapid_set_socket_buffer_sizes(void) {
+	int size = SOCKET_BUFFER_SIZE;
 
-	snprintf(signature, WRITER_MAX_RECIPIENT_SIGNATURE_LENGTH,
-	         "RED Brick API Daemon");
-
-	return signature;
-}
+	if (setsockopt(_redapid.socket.handle, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) < 0) {
+		log_warn("Could not set send buffer size for RED Brick API Daemon socket: %s (%d)",
+		         get_errno_name(errno), errno);
+	}
 
-static void redapid_recipient_disconnect(void *opaque) {
-	(void)opaque;
+	size = SOCKET_BUFFER_SIZE;
 
-	redapid_disconnect(true);
+	if (setsockopt(_redapid.socket.handle, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
+		log_warn("Could not set receive buffer size for RED Brick API Daemon socket: %s (%d)",
+		         get_errno_name(errno), errno);
+	}
 }
 
 static void redapid_handle_reconnect(void *opaque) {
@@ -236,8 +406,11 @@ static void redapid_handle_reconnect(void *opaque) {
 
 	(void)opaque;
 
-	_redapid.response_used = 0;
+	_redapid.response_buffer_start = 0;
+	_redapid.response_buffer_used = 0;
 	_redapid.response_header_checked = false;
+	_redapid.request_buffer_used = 0;
+	_redapid.write_pending = false;
 
 	log_debug("Connecting to RED Brick API Daemon");
 
@@ -281,12 +454,11 @@ static void redapid_handle_reconnect(void *opaque) {
 
 	phase = 2;
 
-	// create request writer
-	if (writer_create(&_redapid.request_writer, &_redapid.socket.base,
-	                  "request", packet_get_request_signature,
-	                  "redapid", redapid_get_recipient_signature,
-	                  redapid_recipient_disconnect, NULL) < 0) {
-		log_error("Could not create request writer: %s (%d)",
+	redapid_set_socket_buffer_sizes();
+
+	// requests are written from the request buffer without blocking
+	if (socket_set_non_blocking(&_redapid.socket, true) < 0) {
+		log_error("Could not enable non-blocking mode for RED Brick API Daemon socket: %s (%d)",
 		          get_errno_name(errno), errno);
 
 		goto cleanup;
@@ -305,15 +477,13 @@ static void redapid_handle_reconnect(void *opaque) {
 	phase = 4;
 
 	_connected = true;
+	++_redapid.statistics.connects;
 
 	log_info("Connected to RED Brick API Daemon");
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
 	case 3:
-		writer_destroy(&_redapid.request_writer);
-		// fall through
-
 	case 2:
 		event_remove_source(_redapid.socket.handle, EVENT_SOURCE_TYPE_GENERIC);
 		// fall through
@@ -457,3 +627,11 @@ void redapid_exit(void) {
 
 	stack_destroy(&_redapid.base);
 }
+
+bool redapid_is_connected(void) {
+	return _connected;
+}
+
+void redapid_get_statistics(REDBrickAPIDaemonStatistics *statistics) {
+	*statistics = _redapid.statistics;
+}
@@ -22,7 +22,28 @@
 #ifndef BRICKD_REDAPID_H
 #define BRICKD_REDAPID_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// cumulative over all connections to redapid
+typedef struct {
+	uint32_t connects;
+	uint32_t packets_in;
+	uint32_t packets_out;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint32_t reads; // socket reads that returned data
+	uint32_t writes; // socket writes that sent data
+	uint32_t dropped_requests; // because the request buffer was full
+	uint32_t peak_buffered_bytes;
+} REDBrickAPIDaemonStatistics;
+
 int redapid_init(void);
 void redapid_exit(void);
 
+void redapid_flush_requests(void);
+
+bool redapid_is_connected(void);
+void redapid_get_statistics(REDBrickAPIDaemonStatistics *statistics);
+
 #endif // BRICKD_REDAPID_H
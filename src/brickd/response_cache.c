@@ -0,0 +1,454 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * response_cache.c: TTL cache for responses of rarely changing getters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * responses to requests whose function is listed in response_cache.functions
+ * are kept for the configured TTL and answered directly from the cache, keyed
+ * by UID, function ID and request payload. the list has the form
+ *
+ *   [<device-identifier>:]<function-id>=<ttl>, ...
+ *
+ * with the TTL in milliseconds. a rule without device identifier applies to
+ * all devices. a TTL of 0 marks a getter that is not cached, but also does
+ * not invalidate the cache. any other request to a UID is treated as a setter
+ * and drops all cached responses of that UID. enumerate-connected and
+ * enumerate-disconnected callbacks do the same.
+ *
+ * on a miss the pending request gets a filling entry, which is completed by
+ * the response to that pending request. entries are found through two hash
+ * indexes, by key for lookups and by UID for invalidation, and are evicted in
+ * least recently filled order once RESPONSE_CACHE_MAX_ENTRIES is reached
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/node.h>
+#include <daemonlib/utils.h>
+
+#include "response_cache.h"
+
+#include "hardware.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define ENTRY_INDEX_BITS 12
+#define ENTRY_INDEX_SIZE (1 << ENTRY_INDEX_BITS)
+#define UID_INDEX_BITS 8
+#define UID_INDEX_SIZE (1 << UID_INDEX_BITS)
+
+typedef struct {
+	int device_identifier; // -1 matches all devices
+	uint8_t function_id;
+	uint32_t ttl; // milliseconds, 0 for getters that are not cached
+} ResponseCacheRule;
+
+struct _ResponseCacheEntry {
+	Node index_node; // bucket list of the entry index
+	Node uid_node; // bucket list of the UID index
+	Node lru_node;
+	uint32_t hash;
+	PendingRequest *filler; // NULL once the response was stored
+	uint64_t expires_at; // microseconds
+	Packet request; // only the header and the payload are valid
+	Packet response; // only valid once filled
+};
+
+static ResponseCacheRule _rules[RESPONSE_CACHE_MAX_RULES];
+static int _rule_count = 0;
+static Node _entry_index[ENTRY_INDEX_SIZE];
+static Node _uid_index[UID_INDEX_SIZE];
+static Node _lru_sentinel; // oldest first
+static int _entry_count = 0;
+static uint32_t _hits = 0;
+static uint32_t _misses = 0;
+
+// FNV-1a over everything but the sequence number and the options
+static uint32_t response_cache_get_hash(Packet *request) {
+	uint8_t *payload = (uint8_t *)request + sizeof(PacketHeader);
+	int length = request->header.length - (int)sizeof(PacketHeader);
+	uint32_t hash = 2166136261u;
+	int i;
+
+	hash = (hash ^ request->header.uid) * 16777619u;
+	hash = (hash ^ request->header.function_id) * 16777619u;
+	hash = (hash ^ request->header.length) * 16777619u;
+
+	for (i = 0; i < length; ++i) {
+		hash = (hash ^ payload[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static Node *response_cache_get_uid_bucket(uint32_t uid) {
+	return &_uid_index[(uint32_t)(uid * 2654435761u) >> (32 - UID_INDEX_BITS)];
+}
+
+// returns NULL if no rule matches. device specific rules take precedence
+static ResponseCacheRule *response_cache_find_rule(Packet *request) {
+	uint16_t device_identifier;
+	ResponseCacheRule *generic = NULL;
+	int i;
+
+	hardware_find_stack(request->header.uid, &device_identifier);
+
+	for (i = 0; i < _rule_count; ++i) {
+		if (_rules[i].function_id != request->header.function_id) {
+			continue;
+		}
+
+		if (_rules[i].device_identifier < 0) {
+			generic = &_rules[i];
+		} else if (_rules[i].device_identifier == device_identifier) {
+			return &_rules[i];
+		}
+	}
+
+	return generic;
+}
+
+static ResponseCacheEntry *response_cache_find_entry(Packet *request, uint32_t hash) {
+	Node *bucket = &_entry_index[hash >> (32 - ENTRY_INDEX_BITS)];
+	Node *node;
+	ResponseCacheEntry *entry;
+
+	for (node = bucket->next; node != bucket; node = node->next) {
+		entry = containerof(node, ResponseCacheEntry, index_node);
+
+		if (entry->hash == hash &&
+		    entry->request.header.uid == request->header.uid &&
+		    entry->request.header.function_id == request->header.function_id &&
+		    entry->request.header.length == request->header.length &&
+		    memcmp((uint8_t *)&entry->request + sizeof(PacketHeader),
+		           (uint8_t *)request + sizeof(PacketHeader),
+		           request->header.length - sizeof(PacketHeader)) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void response_cache_remove_entry(ResponseCacheEntry *entry) {
+	if (entry->filler != NULL) {
+		entry->filler->response_cache_entry = NULL;
+	}
+
+	node_remove(&entry->index_node);
+	node_remove(&entry->uid_node);
+	node_remove(&entry->lru_node);
+
+	--_entry_count;
+
+	free(entry);
+}
+
+// returns -1 if the rule is malformed
+static int response_cache_parse_rule(const char *string, ResponseCacheRule *rule) {
+	char *end;
+	long value;
+
+	rule->device_identifier = -1;
+
+	value = strtol(string, &end, 10);
+
+	if (end == string) {
+		return -1;
+	}
+
+	if (*end == ':') {
+		if (value < 0 || value > UINT16_MAX) {
+			return -1;
+		}
+
+		rule->device_identifier = (int)value;
+		string = end + 1;
+		value = strtol(string, &end, 10);
+
+		if (end == string) {
+			return -1;
+		}
+	}
+
+	if (*end != '=' || value < 0 || value > UINT8_MAX) {
+		return -1;
+	}
+
+	rule->function_id = (uint8_t)value;
+	string = end + 1;
+	value = strtol(string, &end, 10);
+
+	if (end == string || value < 0 || value > 86400000) {
+		return -1;
+	}
+
+	while (isspace((unsigned char)*end)) {
+		++end;
+	}
+
+	if (*end != '\0') {
+		return -1;
+	}
+
+	rule->ttl = (uint32_t)value;
+
+	return 0;
+}
+
+// malformed rules are skipped with a warning, the cache is disabled if no
+// rule is left
+void response_cache_init(void) {
+	const char *functions = config_get_option_value("response_cache.functions")->string;
+	char rule_string[64];
+	const char *p;
+	int length;
+	int i;
+
+	_rule_count = 0;
+	_entry_count = 0;
+	_hits = 0;
+	_misses = 0;
+
+	node_reset(&_lru_sentinel);
+
+	for (i = 0; i < ENTRY_INDEX_SIZE; ++i) {
+		node_reset(&_entry_index[i]);
+	}
+
+	for (i = 0; i < UID_INDEX_SIZE; ++i) {
+		node_reset(&_uid_index[i]);
+	}
+
+	if (functions == NULL) {
+		log_debug("Response cache is disabled");
+
+		return;
+	}
+
+	for (p = functions; *p != '\0'; p += length) {
+		while (*p == ',' || isspace((unsigned char)*p)) {
+			++p;
+		}
+
+		length = (int)strcspn(p, ",");
+
+		if (length == 0) {
+			break;
+		}
+
+		if (length >= (int)sizeof(rule_string)) {
+			log_warn("Ignoring too long response cache rule '%.*s'", length, p);
+
+			continue;
+		}
+
+		memcpy(rule_string, p, length);
+		rule_string[length] = '\0';
+
+		if (_rule_count >= RESPONSE_CACHE_MAX_RULES) {
+			log_warn("Ignoring response cache rule '%s', only %d rules are supported",
+			         rule_string, RESPONSE_CACHE_MAX_RULES);
+
+			continue;
+		}
+
+		if (response_cache_parse_rule(rule_string, &_rules[_rule_count]) < 0) {
+			log_warn("Ignoring malformed response cache rule '%s'", rule_string);
+
+			continue;
+		}
+
+		++_rule_count;
+	}
+
+	if (_rule_count == 0) {
+		log_debug("Response cache is disabled, no valid rule");
+
+		return;
+	}
+
+	log_info("Response cache is enabled for %d function(s)", _rule_count);
+}
+
+void response_cache_exit(void) {
+	while (_lru_sentinel.next != &_lru_sentinel) {
+		response_cache_remove_entry(containerof(_lru_sentinel.next, ResponseCacheEntry, lru_node));
+	}
+}
+
+// returns true and a copy of the cached response with the sequence number of
+// the request on a hit
+bool response_cache_get(Packet *request, Packet *response) {
+	ResponseCacheEntry *entry;
+
+	if (_rule_count == 0) {
+		return false;
+	}
+
+	entry = response_cache_find_entry(request, response_cache_get_hash(request));
+
+	if (entry == NULL || entry->filler != NULL) {
+		return false;
+	}
+
+	if (entry->expires_at <= microseconds()) {
+		response_cache_remove_entry(entry);
+
+		return false;
+	}
+
+	memcpy(response, &entry->response, entry->response.header.length);
+
+	response->header.sequence_number_and_options = request->header.sequence_number_and_options;
+
+	++_hits;
+
+	return true;
+}
+
+// the configured functions are known getters, only those are safe to coalesce.
+// a rule with TTL 0 marks a getter without caching its responses
+bool response_cache_is_getter(Packet *request) {
+	return _rule_count > 0 && response_cache_find_rule(request) != NULL;
+}
+
+// called for every request to a device that was not answered from the cache.
+// the pending request is NULL if the request expects no response
+void response_cache_handle_request(Packet *request, PendingRequest *pending_request) {
+	ResponseCacheRule *rule;
+	ResponseCacheEntry *entry;
+	uint32_t hash;
+
+	if (_rule_count == 0 || request->header.uid == 0) {
+		return;
+	}
+
+	rule = response_cache_find_rule(request);
+
+	if (rule == NULL) {
+		response_cache_invalidate(request->header.uid);
+
+		return;
+	}
+
+	if (rule->ttl == 0 || pending_request == NULL) {
+		return;
+	}
+
+	++_misses;
+
+	hash = response_cache_get_hash(request);
+	entry = response_cache_find_entry(request, hash);
+
+	if (entry != NULL) {
+		if (entry->filler != NULL) {
+			return; // an identical request is already filling the entry
+		}
+
+		response_cache_remove_entry(entry); // expired
+	}
+
+	if (_entry_count >= RESPONSE_CACHE_MAX_ENTRIES) {
+		response_cache_remove_entry(containerof(_lru_sentinel.next, ResponseCacheEntry, lru_node));
+	}
+
+	entry = malloc(sizeof(ResponseCacheEntry));
+
+	if (entry == NULL) {
+		return; // not caching is always correct
+	}
+
+	entry->hash = hash;
+	entry->filler = pending_request;
+	entry->expires_at = (uint64_t)rule->ttl * 1000; // relative until filled
+
+	memcpy(&entry->request, request, request->header.length);
+
+	node_insert_before(&_entry_index[hash >> (32 - ENTRY_INDEX_BITS)], &entry->index_node);
+	node_insert_before(response_cache_get_uid_bucket(request->header.uid), &entry->uid_node);
+	node_insert_before(&_lru_sentinel, &entry->lru_node);
+
+	++_entry_count;
+
+	pending_request->response_cache_entry = entry;
+}
+
+// stores the response to a pending request with a filling entry. error
+// responses are not cached
+void response_cache_put(PendingRequest *pending_request, Packet *response) {
+	ResponseCacheEntry *entry = pending_request->response_cache_entry;
+
+	pending_request->response_cache_entry = NULL;
+	entry->filler = NULL;
+
+	if (packet_header_get_error_code(&response->header) != PACKET_E_SUCCESS) {
+		response_cache_remove_entry(entry);
+
+		return;
+	}
+
+	memcpy(&entry->response, response, response->header.length);
+
+	entry->expires_at += microseconds();
+
+	node_remove(&entry->lru_node);
+	node_insert_before(&_lru_sentinel, &entry->lru_node);
+}
+
+// called before a pending request with a filling entry is freed without a
+// response. the entry is dropped, the next identical request fills it again
+void response_cache_release(PendingRequest *pending_request) {
+	response_cache_remove_entry(pending_request->response_cache_entry);
+}
+
+void response_cache_invalidate(uint32_t uid /* always little endian */) {
+	Node *bucket;
+	Node *node;
+	Node *next;
+	ResponseCacheEntry *entry;
+
+	if (_entry_count == 0) {
+		return;
+	}
+
+	bucket = response_cache_get_uid_bucket(uid);
+
+	for (node = bucket->next; node != bucket; node = next) {
+		next = node->next;
+		entry = containerof(node, ResponseCacheEntry, uid_node);
+
+		if (entry->request.header.uid == uid) {
+			response_cache_remove_entry(entry);
+		}
+	}
+}
+
+void response_cache_get_statistics(uint32_t *hits, uint32_t *misses, int *entry_count) {
+	*hits = _hits;
+	*misses = _misses;
+	*entry_count = _entry_count;
+}
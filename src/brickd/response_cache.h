@@ -0,0 +1,48 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * response_cache.h: TTL cache for responses of rarely changing getters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_RESPONSE_CACHE_H
+#define BRICKD_RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <daemonlib/packet.h>
+
+#include "client.h"
+
+#define RESPONSE_CACHE_MAX_RULES 64
+#define RESPONSE_CACHE_MAX_ENTRIES 4096
+
+void response_cache_init(void);
+void response_cache_exit(void);
+
+bool response_cache_get(Packet *request, Packet *response);
+bool response_cache_is_getter(Packet *request);
+void response_cache_handle_request(Packet *request, PendingRequest *pending_request);
+void response_cache_put(PendingRequest *pending_request, Packet *response);
+void response_cache_release(PendingRequest *pending_request);
+void response_cache_invalidate(uint32_t uid /* always little endian */);
+
+void response_cache_get_statistics(uint32_t *hits, uint32_t *misses, int *entry_count);
+
+#endif // BRICKD_RESPONSE_CACHE_H
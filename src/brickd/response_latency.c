@@ -0,0 +1,116 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * response_latency.c: Request to response latency histograms
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * the functions are kept in insertion order so that clients can page through
+ * them by index. a small open addressing hash table with linear probing maps
+ * device identifier and function ID to their index. it has twice as many
+ * slots as there are functions, so it never fills up
+ */
+
+#include <string.h>
+
+#include "response_latency.h"
+
+#include "hardware.h"
+
+#define FUNCTION_INDEX_BITS 9 // 2 * RESPONSE_LATENCY_MAX_FUNCTIONS slots
+
+static ResponseLatencyFunction _functions[RESPONSE_LATENCY_MAX_FUNCTIONS];
+static int _function_count = 0;
+static int16_t _function_index[1 << FUNCTION_INDEX_BITS]; // index + 1, 0 marks an empty slot
+
+static int response_latency_get_bucket(uint64_t latency) {
+	int bucket;
+
+	latency /= 100;
+
+	for (bucket = 0; latency > 0 && bucket < RESPONSE_LATENCY_BUCKETS - 1; ++bucket) {
+		latency >>= 1;
+	}
+
+	return bucket;
+}
+
+// returns NULL if all functions are in use
+static ResponseLatencyFunction *response_latency_find_function(uint16_t device_identifier,
+                                                               uint8_t function_id) {
+	uint32_t key = ((uint32_t)device_identifier << 8) | function_id;
+	uint32_t mask = (1 << FUNCTION_INDEX_BITS) - 1;
+	uint32_t i = (uint32_t)(key * 2654435761u) >> (32 - FUNCTION_INDEX_BITS);
+	ResponseLatencyFunction *function;
+
+	while (_function_index[i] != 0) {
+		function = &_functions[_function_index[i] - 1];
+
+		if (function->device_identifier == device_identifier &&
+		    function->function_id == function_id) {
+			return function;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	if (_function_count >= RESPONSE_LATENCY_MAX_FUNCTIONS) {
+		return NULL;
+	}
+
+	function = &_functions[_function_count++];
+
+	memset(function, 0, sizeof(*function));
+
+	function->device_identifier = device_identifier;
+	function->function_id = function_id;
+
+	_function_index[i] = (int16_t)_function_count;
+
+	return function;
+}
+
+void response_latency_add(uint32_t uid, uint8_t function_id, uint64_t latency) {
+	int bucket = response_latency_get_bucket(latency);
+	uint16_t device_identifier;
+	Stack *stack = hardware_find_stack(uid, &device_identifier);
+	ResponseLatencyFunction *function;
+
+	if (stack != NULL) {
+		++stack->latency_histogram[bucket];
+	}
+
+	function = response_latency_find_function(device_identifier, function_id);
+
+	if (function != NULL) {
+		++function->histogram[bucket];
+	}
+}
+
+int response_latency_get_function_count(void) {
+	return _function_count;
+}
+
+ResponseLatencyFunction *response_latency_get_function(int index) {
+	if (index < 0 || index >= _function_count) {
+		return NULL;
+	}
+
+	return &_functions[index];
+}
@@ -0,0 +1,52 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * response_latency.h: Request to response latency histograms
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_RESPONSE_LATENCY_H
+#define BRICKD_RESPONSE_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stack.h"
+
+// bucket 0 counts latencies below 100 microseconds, bucket i counts latencies
+// from 100 * 2^(i-1) up to 100 * 2^i microseconds and the last bucket counts
+// everything from 100 * 2^(RESPONSE_LATENCY_BUCKETS-2) microseconds upwards
+#define RESPONSE_LATENCY_BUCKETS STACK_LATENCY_BUCKETS
+
+// histograms per device identifier and function ID are kept for this many
+// combinations, further combinations are only counted per stack
+#define RESPONSE_LATENCY_MAX_FUNCTIONS 256
+
+typedef struct {
+	uint16_t device_identifier; // 0 if the device was not enumerated yet
+	uint8_t function_id;
+	uint32_t histogram[RESPONSE_LATENCY_BUCKETS];
+} ResponseLatencyFunction;
+
+void response_latency_add(uint32_t uid /* always little endian */,
+                          uint8_t function_id, uint64_t latency /* microseconds */);
+
+int response_latency_get_function_count(void);
+ResponseLatencyFunction *response_latency_get_function(int index);
+
+#endif // BRICKD_RESPONSE_LATENCY_H
@@ -11,6 +11,7 @@
  *   34AA973C D4C4DAA4 F61EEB2B DBAD2731 6534016F
  */
 
+#include <stdbool.h>
 #include <string.h>
 #ifdef _WIN32
 	#include <winsock2.h> // for htonl()
@@ -20,6 +21,23 @@
 
 #include "sha1.h"
 
+// the SHA extensions of x86 CPUs are used if the CPU supports them. the
+// accelerated transform is compiled with a target attribute, so it doesn't
+// require the whole build to enable -msha, and it's selected at runtime
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define SHA1_WITH_SHA_NI
+
+	#include <cpuid.h>
+	#include <immintrin.h>
+#endif
+
+typedef void (*SHA1TransformFunction)(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+static void sha1_select_transform(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+static SHA1TransformFunction _sha1_transform = sha1_select_transform;
+static const char *_sha1_backend = NULL;
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 // blk0() and blk() perform the initial expand. blk0() deals with host endianess
@@ -34,18 +52,18 @@
 #define R4(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0xCA62C1D6+rol(v,5); w=rol(w,30)
 
 // hash a single 512-bit block. this is the core of the algorithm
-static uint32_t sha1_transform(SHA1 *sha1, const uint8_t buffer[SHA1_BLOCK_LENGTH]) {
+static uint32_t sha1_transform_block(uint32_t state[5], const uint8_t buffer[SHA1_BLOCK_LENGTH]) {
 	uint32_t a, b, c, d, e;
 	uint32_t block[SHA1_BLOCK_LENGTH / 4];
 
 	memcpy(&block, buffer, SHA1_BLOCK_LENGTH);
 
-	// copy sha1->state[] to working variables
-	a = sha1->state[0];
-	b = sha1->state[1];
-	c = sha1->state[2];
-	d = sha1->state[3];
-	e = sha1->state[4];
+	// copy state[] to working variables
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
 
 	// 4 rounds of 20 operations each (loop unrolled)
 	R0(a,b,c,d,e, 0); R0(e,a,b,c,d, 1); R0(d,e,a,b,c, 2); R0(c,d,e,a,b, 3);
@@ -72,12 +90,12 @@ static uint32_t sha1_transform(SHA1 *sha1, const uint8_t buffer[SHA1_BLOCK_LENGT
 	R4(d,e,a,b,c,72); R4(c,d,e,a,b,73); R4(b,c,d,e,a,74); R4(a,b,c,d,e,75);
 	R4(e,a,b,c,d,76); R4(d,e,a,b,c,77); R4(c,d,e,a,b,78); R4(b,c,d,e,a,79);
 
-	// add the working variables back into sha1->state[]
-	sha1->state[0] += a;
-	sha1->state[1] += b;
-	sha1->state[2] += c;
-	sha1->state[3] += d;
-	sha1->state[4] += e;
+	// add the working variables back into state[]
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
 
 	// wipe variables
 	a = b = c = d = e = 0;
@@ -85,6 +103,133 @@ static uint32_t sha1_transform(SHA1 *sha1, const uint8_t buffer[SHA1_BLOCK_LENGT
 	return a; // return a to avoid dead-store warning from clang static analyzer
 }
 
+static void sha1_transform_portable(uint32_t state[5], const uint8_t *data, size_t blocks) {
+	for (; blocks > 0; --blocks, data += SHA1_BLOCK_LENGTH) {
+		sha1_transform_block(state, data);
+	}
+}
+
+#ifdef SHA1_WITH_SHA_NI
+
+// each group does 4 of the 80 rounds. the message schedule is kept in four
+// registers of 4 words each, msg[g % 4] holds the words for group g. while
+// group g is hashed the words for the following groups are prepared from it
+#define NI_GROUP(g, f) \
+	e = _mm_sha1nexte_epu32(e_base, msg[(g) % 4]); \
+	e_base = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f)
+
+#define NI_MSG1(g) msg[((g) + 3) % 4] = _mm_sha1msg1_epu32(msg[((g) + 3) % 4], msg[(g) % 4])
+#define NI_XOR(g) msg[((g) + 2) % 4] = _mm_xor_si128(msg[((g) + 2) % 4], msg[(g) % 4])
+#define NI_MSG2(g) msg[((g) + 1) % 4] = _mm_sha1msg2_epu32(msg[((g) + 1) % 4], msg[(g) % 4])
+
+#define NI_LOAD(g) msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + (g) * 16)), byte_swap)
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_transform_sha_ni(uint32_t state[5], const uint8_t *data, size_t blocks) {
+	const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+	__m128i abcd, abcd_saved;
+	__m128i e, e_base, e_saved;
+	__m128i msg[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	e_base = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for (; blocks > 0; --blocks, data += SHA1_BLOCK_LENGTH) {
+		abcd_saved = abcd;
+		e_saved = e_base;
+
+		// rounds 0-15, the message words are taken from the block as is
+		NI_LOAD(0);
+		e = _mm_add_epi32(e_base, msg[0]);
+		e_base = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+
+		NI_LOAD(1);  NI_GROUP( 1, 0); NI_MSG1( 1);
+		NI_LOAD(2);  NI_GROUP( 2, 0); NI_MSG1( 2); NI_XOR( 2);
+		NI_LOAD(3);  NI_GROUP( 3, 0); NI_MSG1( 3); NI_XOR( 3); NI_MSG2( 3);
+
+		// rounds 16-79, the message words are expanded on the fly
+		NI_GROUP( 4, 0); NI_MSG1( 4); NI_XOR( 4); NI_MSG2( 4);
+		NI_GROUP( 5, 1); NI_MSG1( 5); NI_XOR( 5); NI_MSG2( 5);
+		NI_GROUP( 6, 1); NI_MSG1( 6); NI_XOR( 6); NI_MSG2( 6);
+		NI_GROUP( 7, 1); NI_MSG1( 7); NI_XOR( 7); NI_MSG2( 7);
+		NI_GROUP( 8, 1); NI_MSG1( 8); NI_XOR( 8); NI_MSG2( 8);
+		NI_GROUP( 9, 1); NI_MSG1( 9); NI_XOR( 9); NI_MSG2( 9);
+		NI_GROUP(10, 2); NI_MSG1(10); NI_XOR(10); NI_MSG2(10);
+		NI_GROUP(11, 2); NI_MSG1(11); NI_XOR(11); NI_MSG2(11);
+		NI_GROUP(12, 2); NI_MSG1(12); NI_XOR(12); NI_MSG2(12);
+		NI_GROUP(13, 2); NI_MSG1(13); NI_XOR(13); NI_MSG2(13);
+		NI_GROUP(14, 2); NI_MSG1(14); NI_XOR(14); NI_MSG2(14);
+		NI_GROUP(15, 3); NI_MSG1(15); NI_XOR(15); NI_MSG2(15);
+		NI_GROUP(16, 3); NI_MSG1(16); NI_XOR(16); NI_MSG2(16);
+		NI_GROUP(17, 3);              NI_XOR(17); NI_MSG2(17);
+		NI_GROUP(18, 3);                          NI_MSG2(18);
+		NI_GROUP(19, 3);
+
+		// add the working variables back into the state
+		e_base = _mm_sha1nexte_epu32(e_base, e_saved);
+		abcd = _mm_add_epi32(abcd, abcd_saved);
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+
+	state[4] = (uint32_t)_mm_extract_epi32(e_base, 3);
+}
+
+static bool sha1_is_sha_ni_supported(void) {
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 || (ecx & (1u << 19)) == 0) { // SSE4.1
+		return false;
+	}
+
+	if (__get_cpuid_max(0, NULL) < 7) {
+		return false;
+	}
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return (ebx & (1u << 29)) != 0; // SHA
+}
+
+#endif
+
+static void sha1_select_backend(void) {
+#ifdef SHA1_WITH_SHA_NI
+	if (sha1_is_sha_ni_supported()) {
+		_sha1_transform = sha1_transform_sha_ni;
+		_sha1_backend = "sha-ni";
+
+		return;
+	}
+#endif
+
+	_sha1_transform = sha1_transform_portable;
+	_sha1_backend = "portable";
+}
+
+// detects the best transform on first use and replaces itself with it
+static void sha1_select_transform(uint32_t state[5], const uint8_t *data, size_t blocks) {
+	sha1_select_backend();
+
+	_sha1_transform(state, data, blocks);
+}
+
+const char *sha1_get_backend(void) {
+	if (_sha1_backend == NULL) {
+		sha1_select_backend();
+	}
+
+	return _sha1_backend;
+}
+
+// for tests and benchmarks
+void sha1_disable_acceleration(void) {
+	_sha1_transform = sha1_transform_portable;
+	_sha1_backend = "portable";
+}
+
 void sha1_init(SHA1 *sha1) {
 	sha1->state[0] = 0x67452301;
 	sha1->state[1] = 0xEFCDAB89;
@@ -104,12 +249,12 @@ void sha1_update(SHA1 *sha1, const uint8_t *data, size_t length) {
 		i = 64 - j;
 
 		memcpy(&sha1->buffer[j], data, i);
-		sha1_transform(sha1, sha1->buffer);
+		_sha1_transform(sha1->state, sha1->buffer, 1);
 
-		for (; i + 63 < length; i += 64) {
-			sha1_transform(sha1, &data[i]);
-		}
+		// hash all following complete blocks directly from the data
+		_sha1_transform(sha1->state, &data[i], (length - i) / 64);
 
+		i += (length - i) & ~(size_t)63;
 		j = 0;
 	} else {
 		i = 0;
@@ -119,19 +264,18 @@ void sha1_update(SHA1 *sha1, const uint8_t *data, size_t length) {
 }
 
 void sha1_final(SHA1 *sha1, uint8_t digest[SHA1_DIGEST_LENGTH]) {
+	static const uint8_t padding[SHA1_BLOCK_LENGTH] = { 0x80 };
 	uint32_t i;
 	uint8_t count[8];
+	size_t used = (size_t)((sha1->count >> 3) & 63);
 
 	for (i = 0; i < 8; i++) {
 		// this is endian independent
 		count[i] = (uint8_t)((sha1->count >> ((7 - (i & 7)) * 8)) & 255);
 	}
 
-	sha1_update(sha1, (uint8_t *)"\200", 1);
-
-	while ((sha1->count & 504) != 448) {
-		sha1_update(sha1, (uint8_t *)"\0", 1);
-	}
+	// pad with 0x80 and zeros to 56 bytes modulo 64 in a single update
+	sha1_update(sha1, padding, used < 56 ? 56 - used : 120 - used);
 
 	sha1_update(sha1, count, 8);
 
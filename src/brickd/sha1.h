@@ -22,4 +22,7 @@ void sha1_init(SHA1 *sha1);
 void sha1_update(SHA1 *sha1, const uint8_t *data, size_t length);
 void sha1_final(SHA1 *sha1, uint8_t digest[SHA1_DIGEST_LENGTH]);
 
+const char *sha1_get_backend(void);
+void sha1_disable_acceleration(void);
+
 #endif // SHA1_H
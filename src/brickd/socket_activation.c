@@ -0,0 +1,216 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * socket_activation.c: Adoption of listening sockets passed in by systemd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * implements the receiving side of the systemd socket activation protocol
+ * without depending on libsystemd. systemd passes the listening sockets as
+ * file descriptors starting at 3 and announces them in LISTEN_PID and
+ * LISTEN_FDS. the listeners of brickd pick their socket by the TCP port or
+ * the UNIX domain socket path it is bound to, so the .socket unit does not
+ * need FileDescriptorName= entries. sockets that no listener claims are
+ * closed once all listeners are open
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "socket_activation.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define SOCKET_ACTIVATION_FIRST_FD 3 // SD_LISTEN_FDS_START
+#define SOCKET_ACTIVATION_MAX_FDS 16
+
+static int _fds[SOCKET_ACTIVATION_MAX_FDS]; // -1 once claimed
+static int _fd_count = 0;
+
+void socket_activation_init(void) {
+	const char *listen_pid = getenv("LISTEN_PID");
+	const char *listen_fds = getenv("LISTEN_FDS");
+	int count;
+	int i;
+
+	_fd_count = 0;
+
+	if (listen_pid == NULL || listen_fds == NULL) {
+		return;
+	}
+
+	// the variables are meant for this process only, not for children or a
+	// process that inherited the environment
+	if (atoi(listen_pid) == (int)getpid()) {
+		count = atoi(listen_fds);
+
+		if (count > SOCKET_ACTIVATION_MAX_FDS) {
+			log_warn("Got %d sockets from systemd, using the first %d only",
+			         count, SOCKET_ACTIVATION_MAX_FDS);
+
+			count = SOCKET_ACTIVATION_MAX_FDS;
+		}
+
+		for (i = 0; i < count; ++i) {
+			_fds[_fd_count] = SOCKET_ACTIVATION_FIRST_FD + i;
+
+			if (fcntl(_fds[_fd_count], F_SETFD, FD_CLOEXEC) < 0) {
+				log_warn("Could not set close-on-exec flag for socket %d from systemd: %s (%d)",
+				         _fds[_fd_count], get_errno_name(errno), errno);
+			}
+
+			++_fd_count;
+		}
+
+		log_info("Got %d socket(s) from systemd", _fd_count);
+	}
+
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_FDNAMES");
+}
+
+void socket_activation_exit(void) {
+	int i;
+
+	for (i = 0; i < _fd_count; ++i) {
+		if (_fds[i] < 0) {
+			continue;
+		}
+
+		log_warn("Closing socket %d from systemd that matches no enabled listener",
+		         _fds[i]);
+
+		close(_fds[i]);
+
+		_fds[i] = -1;
+	}
+
+	_fd_count = 0;
+}
+
+static int socket_activation_adopt(Socket *socket, int index, int family,
+                                   SocketCreateAllocatedFunction create_allocated) {
+	int fd = _fds[index];
+
+	if (socket_create(socket) < 0) {
+		log_error("Could not create socket for socket %d from systemd: %s (%d)",
+		          fd, get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	socket->handle = fd;
+	socket->family = family;
+
+	_fds[index] = -1;
+
+	// the socket is already listening, this only sets the function for
+	// allocating accepted sockets
+	if (socket_listen(socket, 10, create_allocated) < 0) {
+		log_error("Could not listen to socket %d from systemd: %s (%d)",
+		          fd, get_errno_name(errno), errno);
+
+		socket_destroy(socket);
+
+		return -1;
+	}
+
+	return 1;
+}
+
+// returns 1 if an inherited socket was adopted, 0 if there is none for this
+// port and -1 on error
+int socket_activation_adopt_tcp(Socket *socket, uint16_t port,
+                                SocketCreateAllocatedFunction create_allocated) {
+	struct sockaddr_storage address;
+	socklen_t length;
+	uint16_t bound_port;
+	int i;
+
+	for (i = 0; i < _fd_count; ++i) {
+		if (_fds[i] < 0) {
+			continue;
+		}
+
+		length = sizeof(address);
+
+		if (getsockname(_fds[i], (struct sockaddr *)&address, &length) < 0) {
+			continue;
+		}
+
+		if (address.ss_family == AF_INET) {
+			bound_port = ntohs(((struct sockaddr_in *)&address)->sin_port);
+		} else if (address.ss_family == AF_INET6) {
+			bound_port = ntohs(((struct sockaddr_in6 *)&address)->sin6_port);
+		} else {
+			continue;
+		}
+
+		if (bound_port == port) {
+			log_info("Using socket %d from systemd for port %u", _fds[i], port);
+
+			return socket_activation_adopt(socket, i, address.ss_family, create_allocated);
+		}
+	}
+
+	return 0;
+}
+
+// returns 1 if an inherited socket was adopted, 0 if there is none for this
+// path and -1 on error
+int socket_activation_adopt_unix(Socket *socket, const char *path,
+                                 SocketCreateAllocatedFunction create_allocated) {
+	struct sockaddr_un address;
+	socklen_t length;
+	int i;
+
+	for (i = 0; i < _fd_count; ++i) {
+		if (_fds[i] < 0) {
+			continue;
+		}
+
+		length = sizeof(address);
+
+		memset(&address, 0, sizeof(address));
+
+		if (getsockname(_fds[i], (struct sockaddr *)&address, &length) < 0 ||
+		    address.sun_family != AF_UNIX) {
+			continue;
+		}
+
+		if (strncmp(address.sun_path, path, sizeof(address.sun_path)) == 0) {
+			log_info("Using socket %d from systemd for '%s'", _fds[i], path);
+
+			return socket_activation_adopt(socket, i, AF_UNIX, create_allocated);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * socket_activation.h: Adoption of listening sockets passed in by systemd
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_SOCKET_ACTIVATION_H
+#define BRICKD_SOCKET_ACTIVATION_H
+
+#include <stdint.h>
+
+#include <daemonlib/socket.h>
+
+void socket_activation_init(void);
+void socket_activation_exit(void);
+
+int socket_activation_adopt_tcp(Socket *socket, uint16_t port,
+                                SocketCreateAllocatedFunction create_allocated);
+int socket_activation_adopt_unix(Socket *socket, const char *path,
+                                 SocketCreateAllocatedFunction create_allocated);
+
+#endif // BRICKD_SOCKET_ACTIVATION_H
@@ -0,0 +1,146 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * spsc_ring.c: Lock-free single-producer/single-consumer ring buffer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the producer writes an item into the slot at tail and then publishes it by
+ * storing tail + 1 with release semantic. the consumer loads tail with acquire
+ * semantic before reading the slot, so it always sees the complete item. the
+ * same holds the other way round for head, so the producer can only reuse a
+ * slot after the consumer is completely done with it.
+ *
+ * head and tail are free running and wrap around at 2^32, because capacity is
+ * a power of two the difference between them is always the number of items.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#ifdef _MSC_VER
+	#include <windows.h>
+#endif
+
+#include "spsc_ring.h"
+
+#ifdef _MSC_VER
+
+// MSVC has no __atomic builtins. a full barrier after the load and before the
+// store gives at least the required acquire and release semantic
+static uint32_t spsc_ring_load(uint32_t *index) {
+	uint32_t value = *(volatile uint32_t *)index;
+
+	MemoryBarrier();
+
+	return value;
+}
+
+static void spsc_ring_store(uint32_t *index, uint32_t value) {
+	MemoryBarrier();
+
+	*(volatile uint32_t *)index = value;
+}
+
+#else
+
+static uint32_t spsc_ring_load(uint32_t *index) {
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void spsc_ring_store(uint32_t *index, uint32_t value) {
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+#endif
+
+// sets errno on error
+int spsc_ring_create(SPSCRing *ring, int item_size, uint32_t capacity) {
+	if (item_size <= 0 || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+		errno = EINVAL;
+
+		return -1;
+	}
+
+	ring->items = calloc(capacity, item_size);
+
+	if (ring->items == NULL) {
+		errno = ENOMEM;
+
+		return -1;
+	}
+
+	ring->item_size = item_size;
+	ring->capacity = capacity;
+	ring->head = 0;
+	ring->tail = 0;
+
+	return 0;
+}
+
+void spsc_ring_destroy(SPSCRing *ring) {
+	free(ring->items);
+
+	ring->items = NULL;
+}
+
+// returns the slot for the next item or NULL if the ring is full. the item
+// becomes visible to the consumer by calling spsc_ring_commit
+void *spsc_ring_reserve(SPSCRing *ring) {
+	uint32_t tail = ring->tail; // only written by this side
+
+	if (tail - spsc_ring_load(&ring->head) >= ring->capacity) {
+		return NULL;
+	}
+
+	return ring->items + (tail & (ring->capacity - 1)) * ring->item_size;
+}
+
+void spsc_ring_commit(SPSCRing *ring) {
+	spsc_ring_store(&ring->tail, ring->tail + 1);
+}
+
+bool spsc_ring_is_full(SPSCRing *ring) {
+	return ring->tail - spsc_ring_load(&ring->head) >= ring->capacity;
+}
+
+// returns the oldest item or NULL if the ring is empty. the item stays valid
+// and in place until it is removed by calling spsc_ring_pop
+void *spsc_ring_peek(SPSCRing *ring) {
+	uint32_t head = ring->head; // only written by this side
+
+	if (spsc_ring_load(&ring->tail) == head) {
+		return NULL;
+	}
+
+	return ring->items + (head & (ring->capacity - 1)) * ring->item_size;
+}
+
+void spsc_ring_pop(SPSCRing *ring) {
+	spsc_ring_store(&ring->head, ring->head + 1);
+}
+
+// true if the producer could not add another item before the next
+// spsc_ring_pop call. a producer that found the ring full can be told to retry
+// if this was true before popping
+bool spsc_ring_was_full(SPSCRing *ring) {
+	return spsc_ring_load(&ring->tail) - ring->head >= ring->capacity;
+}
+
+uint32_t spsc_ring_count(SPSCRing *ring) {
+	return spsc_ring_load(&ring->tail) - spsc_ring_load(&ring->head);
+}
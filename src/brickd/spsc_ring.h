@@ -0,0 +1,55 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * spsc_ring.h: Lock-free single-producer/single-consumer ring buffer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_SPSC_RING_H
+#define BRICKD_SPSC_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// bounded FIFO of fixed size items for exactly one producer thread and exactly
+// one consumer thread. the producer owns tail and the consumer owns head, both
+// are free running counters. neither side ever blocks or takes a lock
+typedef struct {
+	uint8_t *items;
+	int item_size;
+	uint32_t capacity; // items, power of two
+	uint32_t head; // written by the consumer only
+	uint32_t tail; // written by the producer only
+} SPSCRing;
+
+int spsc_ring_create(SPSCRing *ring, int item_size, uint32_t capacity);
+void spsc_ring_destroy(SPSCRing *ring);
+
+// producer side
+void *spsc_ring_reserve(SPSCRing *ring);
+void spsc_ring_commit(SPSCRing *ring);
+bool spsc_ring_is_full(SPSCRing *ring);
+
+// consumer side
+void *spsc_ring_peek(SPSCRing *ring);
+void spsc_ring_pop(SPSCRing *ring);
+bool spsc_ring_was_full(SPSCRing *ring);
+
+// either side, the result is only a snapshot
+uint32_t spsc_ring_count(SPSCRing *ring);
+
+#endif // BRICKD_SPSC_RING_H
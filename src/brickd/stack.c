@@ -35,84 +35,214 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <daemonlib/array.h>
 #include <daemonlib/base58.h>
 #include <daemonlib/log.h>
 #include <daemonlib/utils.h>
 
+#include "hardware.h"
 #include "network.h"
+#include "packet_capture.h"
+#include "packet_log.h"
 #include "stack.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
+static uint16_t _next_stack_id = 0;
+
+static Recipient *stack_get_recipient_slot(RecipientTable *recipients,
+                                           uint32_t uid) {
+	uint32_t mask = ((uint32_t)1 << recipients->bits) - 1;
+	uint32_t i = (uint32_t)(uid * 2654435761u) >> (32 - recipients->bits);
+
+	while (recipients->slots[i].uid != 0 && recipients->slots[i].uid != uid) {
+		i = (i + 1) & mask;
+	}
+
+	return &recipients->slots[i];
+}
+
+// sets errno on error
+static int stack_grow_recipients(RecipientTable *recipients) {
+	int bits = recipients->bits > 0 ? recipients->bits + 1 : 5;
+	Recipient *slots = calloc((size_t)1 << bits, sizeof(Recipient));
+	Recipient *old_slots = recipients->slots;
+	int old_capacity = old_slots != NULL ? 1 << recipients->bits : 0;
+	int i;
+
+	if (slots == NULL) {
+		errno = ENOMEM;
+
+		return -1;
+	}
+
+	recipients->slots = slots;
+	recipients->bits = bits;
+	recipients->last = NULL;
+
+	for (i = 0; i < old_capacity; ++i) {
+		if (old_slots[i].uid != 0) {
+			*stack_get_recipient_slot(recipients, old_slots[i].uid) = old_slots[i];
+		}
+	}
+
+	free(old_slots);
+
+	return 0;
+}
+
 int stack_create(Stack *stack, const char *name,
                  StackDispatchRequestFunction dispatch_request) {
 	string_copy(stack->name, sizeof(stack->name), name, -1);
 
-	stack->dispatch_request = dispatch_request;
+	// IDs are not reused before 65535 other stacks were created
+	if (++_next_stack_id == 0) {
+		++_next_stack_id;
+	}
 
-	if (array_create(&stack->recipients, 32, sizeof(Recipient), true) < 0) {
-		log_error("Could not create recipient array: %s (%d)",
-		          get_errno_name(errno), errno);
+	stack->id = _next_stack_id;
 
-		return -1;
-	}
+	stack->dispatch_request = dispatch_request;
+	stack->cancel_requests = NULL;
+
+	// the recipient table is allocated on first use
+	memset(&stack->recipients, 0, sizeof(stack->recipients));
+	memset(stack->latency_histogram, 0, sizeof(stack->latency_histogram));
 
 	return 0;
 }
 
 void stack_destroy(Stack *stack) {
-	array_destroy(&stack->recipients, NULL);
+	free(stack->recipients.slots);
 }
 
 int stack_add_recipient(Stack *stack, uint32_t uid /* always little endian */, uint64_t opaque) {
-	int i;
-	Recipient *recipient;
+	RecipientTable *recipients = &stack->recipients;
+	Recipient *recipient = recipients->last;
 	char base58[BASE58_MAX_LENGTH];
 
-	for (i = 0; i < stack->recipients.count; ++i) {
-		recipient = array_get(&stack->recipients, i);
+	// consecutive responses are likely to come from the same device
+	if (recipient == NULL || recipient->uid != uid) {
+		// keep the load factor at 50% or below
+		if ((recipients->count + 1) * 2 > (recipients->slots != NULL ? 1 << recipients->bits : 0) &&
+		    stack_grow_recipients(recipients) < 0) {
+			log_error("Could not grow recipient table to add %s: %s (%d)",
+			          base58_encode(base58, uint32_from_le(uid)),
+			          get_errno_name(errno), errno);
 
-		if (recipient->uid == uid) {
-			recipient->opaque = opaque;
-
-			return 0;
+			return -1;
 		}
-	}
 
-	recipient = array_append(&stack->recipients);
+		recipient = stack_get_recipient_slot(recipients, uid);
 
-	if (recipient == NULL) {
-		log_error("Could not append %s to recipient array: %s (%d)",
-		          base58_encode(base58, uint32_from_le(uid)),
-		          get_errno_name(errno), errno);
+		if (recipient->uid == 0) {
+			recipient->uid = uid;
+			++recipients->count;
+		}
 
-		return -1;
+		recipients->last = recipient;
 	}
 
-	recipient->uid = uid;
 	recipient->opaque = opaque;
 
+	hardware_update_route(stack, uid);
+
 	return 0;
 }
 
-Recipient *stack_get_recipient(Stack *stack, uint32_t uid /* always little endian */) {
-	int i;
+void stack_remove_recipient(Stack *stack, uint32_t uid /* always little endian */) {
+	RecipientTable *recipients = &stack->recipients;
 	Recipient *recipient;
+	uint32_t mask;
+	uint32_t i;
+	uint32_t k;
+	uint32_t home;
+
+	if (recipients->slots == NULL) {
+		return;
+	}
 
-	for (i = 0; i < stack->recipients.count; ++i) {
-		recipient = array_get(&stack->recipients, i);
+	recipient = stack_get_recipient_slot(recipients, uid);
 
-		if (recipient->uid == uid) {
-			return recipient;
+	if (recipient->uid == 0) {
+		return;
+	}
+
+	mask = ((uint32_t)1 << recipients->bits) - 1;
+	i = (uint32_t)(recipient - recipients->slots);
+	k = i;
+
+	recipients->last = NULL;
+	--recipients->count;
+
+	// shift following entries of the same probe sequence back to keep the
+	// table free of holes, instead of leaving tombstones behind
+	for (;;) {
+		recipients->slots[i].uid = 0;
+
+		for (;;) {
+			k = (k + 1) & mask;
+
+			if (recipients->slots[k].uid == 0) {
+				return;
+			}
+
+			home = (uint32_t)(recipients->slots[k].uid * 2654435761u) >> (32 - recipients->bits);
+
+			// move the entry at k to the hole at i, if its home slot is not
+			// cyclically between i (exclusive) and k (inclusive)
+			if ((i <= k) ? (i >= home || home > k) : (i >= home && home > k)) {
+				break;
+			}
 		}
+
+		recipients->slots[i] = recipients->slots[k];
+		i = k;
+	}
+}
+
+Recipient *stack_get_recipient(Stack *stack, uint32_t uid /* always little endian */) {
+	RecipientTable *recipients = &stack->recipients;
+	Recipient *recipient = recipients->last;
+
+	if (recipient != NULL && recipient->uid == uid) {
+		return recipient;
+	}
+
+	if (recipients->slots == NULL) {
+		return NULL;
+	}
+
+	recipient = stack_get_recipient_slot(recipients, uid);
+
+	if (recipient->uid == 0) {
+		return NULL;
+	}
+
+	recipients->last = recipient;
+
+	return recipient;
+}
+
+void stack_clear_recipients(Stack *stack) {
+	if (stack->recipients.slots != NULL) {
+		memset(stack->recipients.slots, 0,
+		       ((size_t)1 << stack->recipients.bits) * sizeof(Recipient));
 	}
 
-	return NULL;
+	stack->recipients.count = 0;
+	stack->recipients.last = NULL;
+}
+
+// used to keep the recipients while a stack is recreated
+void stack_swap_recipients(Stack *stack, RecipientTable *recipients) {
+	RecipientTable tmp = stack->recipients;
+
+	stack->recipients = *recipients;
+	*recipients = tmp;
 }
 
 // returns -1 on error, 0 if the request was not dispatched and 1 if it was dispatch
-int stack_dispatch_request(Stack *stack, Packet *request, bool force) {
+int stack_dispatch_request(Stack *stack, Packet *request, Client *client, bool force) {
 	Recipient *recipient = NULL;
 
 	packet_add_trace(request);
@@ -125,7 +255,11 @@ int stack_dispatch_request(Stack *stack, Packet *request, bool force) {
 		}
 	}
 
-	if (stack->dispatch_request(stack, request, recipient) < 0) {
+	// recorded before dispatching, because some stacks respond right away
+	packet_log_add(request, PACKET_LOG_DIRECTION_REQUEST_TO_STACK, stack);
+	packet_capture_add(request, PACKET_LOG_DIRECTION_REQUEST_TO_STACK, stack);
+
+	if (stack->dispatch_request(stack, request, recipient, client) < 0) {
 		return -1;
 	}
 
@@ -140,28 +274,51 @@ int stack_dispatch_request(Stack *stack, Packet *request, bool force) {
 
 void stack_announce_disconnect(Stack *stack) {
 	int i;
+	int count = 0;
 	Recipient *recipient;
-	EnumerateCallback enumerate_callback;
+	Packet *callbacks;
+	EnumerateCallback *enumerate_callback;
 
 	log_debug("Disconnecting %s stack", stack->name);
 
-	for (i = 0; i < stack->recipients.count; ++i) {
-		recipient = array_get(&stack->recipients, i);
+	if (stack->recipients.slots == NULL || stack->recipients.count == 0) {
+		return;
+	}
 
-		memset(&enumerate_callback, 0, sizeof(enumerate_callback));
+	callbacks = calloc(stack->recipients.count, sizeof(Packet));
 
-		enumerate_callback.header.uid = recipient->uid;
-		enumerate_callback.header.length = sizeof(enumerate_callback);
-		enumerate_callback.header.function_id = CALLBACK_ENUMERATE;
-		packet_header_set_sequence_number(&enumerate_callback.header, 0);
-		packet_header_set_response_expected(&enumerate_callback.header, true);
+	if (callbacks == NULL) {
+		log_error("Could not allocate enumerate-disconnected callbacks for %s stack: %s (%d)",
+		          stack->name, get_errno_name(ENOMEM), ENOMEM);
 
-		base58_encode(enumerate_callback.uid, uint32_from_le(recipient->uid));
-		enumerate_callback.enumeration_type = ENUMERATION_TYPE_DISCONNECTED;
+		return;
+	}
 
-		log_debug("Sending enumerate-disconnected callback (uid: %s)",
-		          enumerate_callback.uid);
+	for (i = 0; i < 1 << stack->recipients.bits && count < stack->recipients.count; ++i) {
+		recipient = &stack->recipients.slots[i];
+
+		if (recipient->uid == 0) {
+			continue;
+		}
+
+		enumerate_callback = (EnumerateCallback *)&callbacks[count++];
+
+		enumerate_callback->header.uid = recipient->uid;
+		enumerate_callback->header.length = sizeof(*enumerate_callback);
+		enumerate_callback->header.function_id = CALLBACK_ENUMERATE;
+		packet_header_set_sequence_number(&enumerate_callback->header, 0);
+		packet_header_set_response_expected(&enumerate_callback->header, true);
 
-		network_dispatch_response((Packet *)&enumerate_callback);
+		base58_encode(enumerate_callback->uid, uint32_from_le(recipient->uid));
+		enumerate_callback->enumeration_type = ENUMERATION_TYPE_DISCONNECTED;
+
+		log_debug("Sending enumerate-disconnected callback (uid: %s)",
+		          enumerate_callback->uid);
 	}
+
+	// all callbacks at once, so pending requests are dropped in one pass and
+	// clients get one write instead of one per device
+	network_dispatch_disconnect_callbacks(callbacks, count);
+
+	free(callbacks);
 }
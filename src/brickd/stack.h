@@ -24,24 +24,48 @@
 
 #include <stdbool.h>
 
-#include <daemonlib/array.h>
 #include <daemonlib/packet.h>
 
 typedef struct _Stack Stack;
+typedef struct _Client Client; // see client.h
 
 typedef struct {
 	uint32_t uid; // always little endian
 	uint64_t opaque;
 } Recipient;
 
-typedef int (*StackDispatchRequestFunction)(Stack *stack, Packet *request, Recipient *recipient);
+// open addressing hash table with linear probing, keyed on the UID. a UID of 0
+// marks an empty slot, because 0 is the broadcast UID
+typedef struct {
+	Recipient *slots;
+	int bits; // capacity is 2^bits
+	int count;
+	Recipient *last; // the most recently used recipient, or NULL
+} RecipientTable;
+
+// the client is the origin of the request, or NULL if it has no client origin.
+// it is only used to schedule requests fairly between clients and must not be
+// dereferenced, it might be gone by the time a queued request is sent
+typedef int (*StackDispatchRequestFunction)(Stack *stack, Packet *request,
+                                            Recipient *recipient, Client *client);
+
+// removes the requests of a disconnected client that are still queued for
+// sending and cancels their pending requests. the client is still valid here
+typedef void (*StackCancelRequestsFunction)(Stack *stack, Client *client);
 
 #define STACK_MAX_NAME_LENGTH 128
 
+// response latencies from the arrival of the request to the dispatch of its
+// response, see response_latency.h for the bucket layout
+#define STACK_LATENCY_BUCKETS 12
+
 struct _Stack {
 	char name[STACK_MAX_NAME_LENGTH]; // for display purpose
+	uint16_t id; // identifies the stack in the packet log, never 0
 	StackDispatchRequestFunction dispatch_request;
-	Array recipients;
+	StackCancelRequestsFunction cancel_requests; // optional, NULL if requests are not queued per client
+	RecipientTable recipients;
+	uint32_t latency_histogram[STACK_LATENCY_BUCKETS];
 };
 
 int stack_create(Stack *stack, const char *name,
@@ -49,9 +73,12 @@ int stack_create(Stack *stack, const char *name,
 void stack_destroy(Stack *stack);
 
 int stack_add_recipient(Stack *stack, uint32_t uid /* always little endian */, uint64_t opaque);
+void stack_remove_recipient(Stack *stack, uint32_t uid /* always little endian */);
 Recipient *stack_get_recipient(Stack *stack, uint32_t uid /* always little endian */);
+void stack_clear_recipients(Stack *stack);
+void stack_swap_recipients(Stack *stack, RecipientTable *recipients);
 
-int stack_dispatch_request(Stack *stack, Packet *request, bool force);
+int stack_dispatch_request(Stack *stack, Packet *request, Client *client, bool force);
 
 void stack_announce_disconnect(Stack *stack);
 
@@ -60,6 +60,7 @@
 	#include <libudev.h>
 #endif
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <daemonlib/event.h>
@@ -225,6 +226,8 @@ static void udev_handle_event(void *opaque) {
 	const char *action;
 	const char *dev_node;
 	const char *sys_name;
+	unsigned int bus_number;
+	unsigned int device_address;
 
 	(void)opaque;
 
@@ -258,7 +261,17 @@ static void udev_handle_event(void *opaque) {
 		log_debug("Received udev event (action: %s, dev node: %s, sys name: %s)",
 		          action, dev_node, sys_name);
 
-		usb_rescan();
+		// the dev node of a USB device is /dev/bus/usb/<bus>/<device>. only
+		// handle this USB device, but fall back to a full rescan if the dev
+		// node has an unexpected format
+		if (sscanf(dev_node, "/dev/bus/usb/%u/%u", &bus_number, &device_address) != 2 ||
+		    bus_number > 255 || device_address > 255) {
+			usb_rescan();
+		} else if (action[0] == 'a') {
+			usb_add_device(bus_number, device_address);
+		} else {
+			usb_remove_device(bus_number, device_address);
+		}
 	} else {
 		log_debug("Ignoring udev event (action: %s, dev node: %s, sys name: %s)",
 		          action, dev_node, sys_name);
@@ -25,12 +25,17 @@
 #include <string.h>
 
 #include <daemonlib/array.h>
+#include <daemonlib/config.h>
 #include <daemonlib/event.h>
 #include <daemonlib/log.h>
+#include <daemonlib/pipe.h>
+#include <daemonlib/queue.h>
+#include <daemonlib/threads.h>
 #include <daemonlib/utils.h>
 
 #include "usb.h"
 
+#include "event_profile.h"
 #include "stack.h"
 #include "network.h"
 #include "usb_transfer.h"
@@ -38,9 +43,41 @@
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 static LogSource _libusb_log_source = LOG_SOURCE_INITIALIZER;
 
+#define USB_MAX_BUS_NUMBERS 256
+#define USB_MAX_DEVICE_ADDRESSES 256
+#define USB_MAX_PARALLEL_OPENS 16
+#define USB_MAX_PENDING_RESPONSES 16384
+#define USB_MAX_FREE_RESPONSE_BUFFERS 256
+#define USB_STATUS_REQUEST_TIMEOUT 500 // milliseconds
+
+typedef enum {
+	USB_OPENER_STATE_RUNNING = 0,
+	USB_OPENER_STATE_OPENED,
+	USB_OPENER_STATE_DONE,
+	USB_OPENER_STATE_FAILED
+} USBOpenerState;
+
+typedef struct {
+	uint8_t bus_number;
+	uint8_t device_address;
+	USBStack *usb_stack;
+	Thread thread;
+	USBOpenerState state; // protected by _opener_mutex while running
+	int rc;
+} USBOpener;
+
 static libusb_context *_context = NULL;
 static Array _usb_stacks;
+static USBStack **_usb_stack_index[USB_MAX_BUS_NUMBERS]; // by bus number and device address
 static bool _initialized_hotplug = false;
+static Mutex _opener_mutex;
+static Semaphore _opener_semaphore;
+static Queue _pending_responses; // of USBResponseBuffer pointers
+static Array _free_response_buffers; // of USBResponseBuffer pointers
+static int _responses_per_iteration;
+static Pipe _pending_responses_pipe; // readable while responses are pending
+static bool _pending_responses_signaled = false;
+static bool _handling_events = false;
 
 extern int usb_init_platform(void);
 extern void usb_exit_platform(void);
@@ -84,18 +121,279 @@ static void LIBUSB_CALL usb_forward_message(libusb_context *ctx,
 
 #endif
 
+// the USB stacks are indexed by bus number and device address, so hotplug
+// events and rescans can find a known USB stack without a linear search. the
+// per-bus tables are allocated on first use
+static USBStack *usb_find_stack(uint8_t bus_number, uint8_t device_address) {
+	if (_usb_stack_index[bus_number] == NULL) {
+		return NULL;
+	}
+
+	return _usb_stack_index[bus_number][device_address];
+}
+
+// sets errno on error
+static int usb_index_stack(USBStack *usb_stack) {
+	USBStack ***table = &_usb_stack_index[usb_stack->bus_number];
+
+	if (*table == NULL) {
+		*table = calloc(USB_MAX_DEVICE_ADDRESSES, sizeof(USBStack *));
+
+		if (*table == NULL) {
+			errno = ENOMEM;
+
+			return -1;
+		}
+	}
+
+	(*table)[usb_stack->device_address] = usb_stack;
+
+	return 0;
+}
+
+static void usb_unindex_stack(USBStack *usb_stack) {
+	if (_usb_stack_index[usb_stack->bus_number] != NULL) {
+		_usb_stack_index[usb_stack->bus_number][usb_stack->device_address] = NULL;
+	}
+}
+
+static void usb_free_index(void) {
+	int i;
+
+	for (i = 0; i < USB_MAX_BUS_NUMBERS; ++i) {
+		free(_usb_stack_index[i]);
+
+		_usb_stack_index[i] = NULL;
+	}
+}
+
+static void usb_remove_stack(int i) {
+	USBStack *usb_stack = array_get(&_usb_stacks, i);
+
+	log_info("Removing USB device (bus: %u, device: %u) at index %d: %s",
+	         usb_stack->bus_number, usb_stack->device_address, i,
+	         usb_stack->base.name);
+
+	stack_announce_disconnect(&usb_stack->base);
+
+	usb_unindex_stack(usb_stack);
+
+	array_remove(&_usb_stacks, i, (ItemDestroyFunction)usb_stack_destroy);
+}
+
+static bool usb_is_brick_device(libusb_device *device, uint8_t bus_number,
+                                uint8_t device_address) {
+	int rc;
+	struct libusb_device_descriptor descriptor;
+
+	rc = libusb_get_device_descriptor(device, &descriptor);
+
+	if (rc < 0) {
+		log_warn("Could not get device descriptor for USB device (bus: %u, device: %u), ignoring USB device: %s (%d)",
+		         bus_number, device_address, usb_get_error_name(rc), rc);
+
+		return false;
+	}
+
+	if (descriptor.idVendor == USB_BRICK_VENDOR_ID &&
+	    descriptor.idProduct == USB_BRICK_PRODUCT_ID) {
+		if (descriptor.bcdDevice < USB_BRICK_DEVICE_RELEASE) {
+			log_warn("USB device (bus: %u, device: %u) has unsupported protocol 1.0 firmware, please update firmware, ignoring USB device",
+			         bus_number, device_address);
+
+			return false;
+		}
+	} else if (descriptor.idVendor == USB_RED_BRICK_VENDOR_ID &&
+	           descriptor.idProduct == USB_RED_BRICK_PRODUCT_ID) {
+		if (descriptor.bcdDevice < USB_RED_BRICK_DEVICE_RELEASE) {
+			log_warn("USB device (bus: %u, device: %u) has unexpected release version, ignoring USB device",
+			         bus_number, device_address);
+
+			return false;
+		}
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+static void usb_publish_stack(USBStack *usb_stack, int index) {
+	// mark new stack as connected
+	usb_stack->connected = true;
+
+	log_info("Added USB device (bus: %u, device: %u) at index %d: %s",
+	         usb_stack->bus_number, usb_stack->device_address,
+	         index, usb_stack->base.name);
+}
+
+// returns -1 on error, 0 if the USB device could not be opened and 1 if a new
+// USBStack was added
+static int usb_add_stack(uint8_t bus_number, uint8_t device_address) {
+	USBStack *usb_stack;
+
+	log_debug("Found new USB device (bus: %u, device: %u)",
+	          bus_number, device_address);
+
+	usb_stack = array_append(&_usb_stacks);
+
+	if (usb_stack == NULL) {
+		log_error("Could not append to USB stacks array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		return -1;
+	}
+
+	if (usb_stack_create(usb_stack, bus_number, device_address) < 0) {
+		array_remove(&_usb_stacks, _usb_stacks.count - 1, NULL);
+
+		log_warn("Ignoring USB device (bus: %u, device: %u) due to an error",
+		         bus_number, device_address);
+
+		return 0;
+	}
+
+	if (usb_index_stack(usb_stack) < 0) {
+		log_error("Could not index USB device (bus: %u, device: %u): %s (%d)",
+		          bus_number, device_address, get_errno_name(errno), errno);
+
+		array_remove(&_usb_stacks, _usb_stacks.count - 1,
+		             (ItemDestroyFunction)usb_stack_destroy);
+
+		return -1;
+	}
+
+	usb_publish_stack(usb_stack, _usb_stacks.count - 1);
+
+	return 1;
+}
+
+static void usb_run_opener(void *opaque) {
+	USBOpener *opener = opaque;
+	int rc = usb_stack_open(opener->usb_stack, &_opener_mutex);
+
+	mutex_lock(&_opener_mutex);
+
+	opener->rc = rc;
+	opener->state = USB_OPENER_STATE_OPENED;
+
+	mutex_unlock(&_opener_mutex);
+
+	semaphore_release(&_opener_semaphore);
+}
+
+// opens newly found USB devices in parallel, one worker thread per USB device.
+// the blocking USB I/O runs on the workers and the USB stacks are completed
+// and added in the order their workers finish. the event loop is blocked
+// meanwhile, but the total time is bound by the slowest USB device instead of
+// being the sum of all of them. returns -1 on error
+static int usb_open_stacks(USBOpener *openers, int count) {
+	int result = 0;
+	int base = _usb_stacks.count;
+	int i;
+	int running = 0;
+	USBOpener *opener;
+
+	for (i = 0; i < count; ++i) {
+		opener = &openers[i];
+		opener->usb_stack = array_append(&_usb_stacks);
+
+		if (opener->usb_stack == NULL) {
+			log_error("Could not append to USB stacks array: %s (%d)",
+			          get_errno_name(errno), errno);
+
+			count = i;
+			result = -1;
+
+			break;
+		}
+
+		log_debug("Found new USB device (bus: %u, device: %u)",
+		          opener->bus_number, opener->device_address);
+
+		if (usb_stack_prepare(opener->usb_stack, opener->bus_number,
+		                      opener->device_address) < 0) {
+			opener->state = USB_OPENER_STATE_FAILED;
+
+			continue;
+		}
+
+		opener->state = USB_OPENER_STATE_RUNNING;
+
+		thread_create(&opener->thread, usb_run_opener, opener);
+
+		++running;
+	}
+
+	while (running > 0) {
+		semaphore_acquire(&_opener_semaphore);
+
+		mutex_lock(&_opener_mutex);
+
+		for (i = 0; i < count; ++i) {
+			if (openers[i].state == USB_OPENER_STATE_OPENED) {
+				break;
+			}
+		}
+
+		mutex_unlock(&_opener_mutex);
+
+		opener = &openers[i];
+
+		thread_join(&opener->thread);
+		thread_destroy(&opener->thread);
+
+		--running;
+
+		if (opener->rc < 0) {
+			usb_stack_abort(opener->usb_stack);
+
+			opener->state = USB_OPENER_STATE_FAILED;
+		} else if (usb_stack_complete(opener->usb_stack) < 0) {
+			opener->state = USB_OPENER_STATE_FAILED;
+		} else if (usb_index_stack(opener->usb_stack) < 0) {
+			log_error("Could not index USB device (bus: %u, device: %u): %s (%d)",
+			          opener->bus_number, opener->device_address,
+			          get_errno_name(errno), errno);
+
+			usb_stack_destroy(opener->usb_stack);
+
+			opener->state = USB_OPENER_STATE_FAILED;
+			result = -1;
+		} else {
+			usb_publish_stack(opener->usb_stack, base + i);
+
+			opener->state = USB_OPENER_STATE_DONE;
+		}
+	}
+
+	// remove the USB stacks that could not be opened. iterate backwards so
+	// array_remove can be used without invalidating the other indices
+	for (i = count - 1; i >= 0; --i) {
+		if (openers[i].state != USB_OPENER_STATE_FAILED) {
+			continue;
+		}
+
+		log_warn("Ignoring USB device (bus: %u, device: %u) due to an error",
+		         openers[i].bus_number, openers[i].device_address);
+
+		array_remove(&_usb_stacks, base + i, NULL);
+	}
+
+	return result;
+}
+
 static int usb_enumerate(void) {
 	int result = -1;
 	libusb_device **devices;
 	libusb_device *device;
 	int rc;
 	int i = 0;
-	struct libusb_device_descriptor descriptor;
 	uint8_t bus_number;
 	uint8_t device_address;
-	bool known;
-	int k;
 	USBStack *usb_stack;
+	USBOpener openers[USB_MAX_PARALLEL_OPENS];
+	int opener_count = 0;
 
 	// get all devices
 	rc = libusb_get_device_list(_context, &devices);
@@ -112,91 +410,187 @@ static int usb_enumerate(void) {
 		bus_number = libusb_get_bus_number(device);
 		device_address = libusb_get_device_address(device);
 
-		rc = libusb_get_device_descriptor(device, &descriptor);
+		// mark known USBStack as connected
+		usb_stack = usb_find_stack(bus_number, device_address);
 
-		if (rc < 0) {
-			log_warn("Could not get device descriptor for USB device (bus: %u, device: %u), ignoring USB device: %s (%d)",
-			         bus_number, device_address, usb_get_error_name(rc), rc);
+		if (usb_stack != NULL) {
+			usb_stack->connected = true;
 
 			continue;
 		}
 
-		if (descriptor.idVendor == USB_BRICK_VENDOR_ID &&
-		    descriptor.idProduct == USB_BRICK_PRODUCT_ID) {
-			if (descriptor.bcdDevice < USB_BRICK_DEVICE_RELEASE) {
-				log_warn("USB device (bus: %u, device: %u) has unsupported protocol 1.0 firmware, please update firmware, ignoring USB device",
-				         bus_number, device_address);
+		if (!usb_is_brick_device(device, bus_number, device_address)) {
+			continue;
+		}
 
-				continue;
-			}
-		} else if (descriptor.idVendor == USB_RED_BRICK_VENDOR_ID &&
-		           descriptor.idProduct == USB_RED_BRICK_PRODUCT_ID) {
-			if (descriptor.bcdDevice < USB_RED_BRICK_DEVICE_RELEASE) {
-				log_warn("USB device (bus: %u, device: %u) has unexpected release version, ignoring USB device",
-				         bus_number, device_address);
+		openers[opener_count].bus_number = bus_number;
+		openers[opener_count].device_address = device_address;
 
-				continue;
+		if (++opener_count == USB_MAX_PARALLEL_OPENS) {
+			if (usb_open_stacks(openers, opener_count) < 0) {
+				goto cleanup;
 			}
-		} else {
-			continue;
+
+			opener_count = 0;
 		}
+	}
+
+	if (opener_count > 0 && usb_open_stacks(openers, opener_count) < 0) {
+		goto cleanup;
+	}
 
-		// check all known stacks
-		known = false;
+	result = 0;
 
-		for (k = 0; k < _usb_stacks.count; ++k) {
-			usb_stack = array_get(&_usb_stacks, k);
+cleanup:
+	libusb_free_device_list(devices, 1);
 
-			if (usb_stack->bus_number == bus_number &&
-			    usb_stack->device_address == device_address) {
-				// mark known USBStack as connected
-				usb_stack->connected = true;
-				known = true;
+	return result;
+}
 
-				break;
-			}
+// responses from USB devices are not dispatched from inside the libusb
+// callbacks, but collected and dispatched after libusb returned. only a limited
+// number of responses is dispatched per event loop iteration, so a storm of
+// callbacks cannot starve the clients. if responses are left over then the
+// pending responses pipe is kept readable, so the event loop comes back to them
+// after handling the other event sources
+static void usb_signal_pending_responses(bool signal) {
+	uint8_t byte = 0;
+
+	if (signal == _pending_responses_signaled) {
+		return;
+	}
+
+	if (signal) {
+		if (pipe_write(&_pending_responses_pipe, &byte, sizeof(byte)) < 0) {
+			log_error("Could not write to pending responses pipe: %s (%d)",
+			          get_errno_name(errno), errno);
+
+			return;
 		}
+	} else {
+		if (pipe_read(&_pending_responses_pipe, &byte, sizeof(byte)) < 0) {
+			log_error("Could not read from pending responses pipe: %s (%d)",
+			          get_errno_name(errno), errno);
 
-		if (known) {
-			continue;
+			return;
 		}
+	}
 
-		// create new USBStack object
-		log_debug("Found new USB device (bus: %u, device: %u)",
-		          bus_number, device_address);
+	_pending_responses_signaled = signal;
+}
 
-		usb_stack = array_append(&_usb_stacks);
+static void usb_dispatch_pending_response(void) {
+	USBResponseBuffer *buffer = *(USBResponseBuffer **)queue_peek(&_pending_responses);
 
-		if (usb_stack == NULL) {
-			log_error("Could not append to USB stacks array: %s (%d)",
-			          get_errno_name(errno), errno);
+	queue_pop(&_pending_responses, NULL);
 
-			goto cleanup;
+	network_dispatch_response(&buffer->packet);
+	usb_unref_response_buffer(buffer);
+}
+
+static void usb_dispatch_pending_responses(void) {
+	int i;
+
+	for (i = 0; i < _responses_per_iteration && _pending_responses.count > 0; ++i) {
+		usb_dispatch_pending_response();
+	}
+
+	usb_signal_pending_responses(_pending_responses.count > 0);
+}
+
+static void usb_handle_pending_responses(void *opaque) {
+	(void)opaque;
+
+	usb_dispatch_pending_responses();
+}
+
+static void usb_free_response_buffer(USBResponseBuffer **buffer) {
+	free(*buffer);
+}
+
+// sets errno on error
+USBResponseBuffer *usb_acquire_response_buffer(void) {
+	USBResponseBuffer *buffer;
+
+	if (_free_response_buffers.count > 0) {
+		buffer = *(USBResponseBuffer **)array_get(&_free_response_buffers,
+		                                          _free_response_buffers.count - 1);
+
+		array_remove(&_free_response_buffers, _free_response_buffers.count - 1, NULL);
+	} else {
+		buffer = malloc(sizeof(USBResponseBuffer));
+
+		if (buffer == NULL) {
+			errno = ENOMEM;
+
+			return NULL;
 		}
+	}
 
-		if (usb_stack_create(usb_stack, bus_number, device_address) < 0) {
-			array_remove(&_usb_stacks, _usb_stacks.count - 1, NULL);
+	buffer->ref_count = 1;
 
-			log_warn("Ignoring USB device (bus: %u, device: %u) due to an error",
-			         bus_number, device_address);
+	return buffer;
+}
 
-			continue;
+void usb_ref_response_buffer(USBResponseBuffer *buffer) {
+	++buffer->ref_count;
+}
+
+void usb_unref_response_buffer(USBResponseBuffer *buffer) {
+	USBResponseBuffer **free_buffer;
+
+	if (--buffer->ref_count > 0) {
+		return;
+	}
+
+	// keep a limited number of unused buffers around for reuse
+	if (_free_response_buffers.count < USB_MAX_FREE_RESPONSE_BUFFERS) {
+		free_buffer = array_append(&_free_response_buffers);
+
+		if (free_buffer != NULL) {
+			*free_buffer = buffer;
+
+			return;
 		}
+	}
+
+	free(buffer);
+}
 
-		// mark new stack as connected
-		usb_stack->connected = true;
+void usb_queue_response(USBResponseBuffer *buffer) {
+	USBResponseBuffer **pending_buffer;
 
-		log_info("Added USB device (bus: %u, device: %u) at index %d: %s",
-		         usb_stack->bus_number, usb_stack->device_address,
-		         _usb_stacks.count - 1, usb_stack->base.name);
+	// make room by dispatching the oldest pending response, instead of
+	// dispatching this response out of order
+	if (_pending_responses.count >= USB_MAX_PENDING_RESPONSES) {
+		usb_dispatch_pending_response();
 	}
 
-	result = 0;
+	pending_buffer = queue_push(&_pending_responses);
 
-cleanup:
-	libusb_free_device_list(devices, 1);
+	if (pending_buffer == NULL) {
+		log_error("Could not queue response, dispatching it directly: %s (%d)",
+		          get_errno_name(errno), errno);
 
-	return result;
+		while (_pending_responses.count > 0) {
+			usb_dispatch_pending_response();
+		}
+
+		network_dispatch_response(&buffer->packet);
+
+		return;
+	}
+
+	usb_ref_response_buffer(buffer);
+
+	*pending_buffer = buffer;
+
+	// usb_handle_events dispatches the pending responses after libusb returned.
+	// libusb callbacks can also be called from elsewhere, for example while a
+	// USB stack is destroyed, then the pipe takes care of them
+	if (!_handling_events) {
+		usb_signal_pending_responses(true);
+	}
 }
 
 static void usb_handle_events(void *opaque) {
@@ -207,21 +601,46 @@ static void usb_handle_events(void *opaque) {
 	tv.tv_sec = 0;
 	tv.tv_usec = 0;
 
+	_handling_events = true;
+
 	rc = libusb_handle_events_timeout(context, &tv);
 
+	_handling_events = false;
+
 	if (rc < 0) {
 		log_error("Could not handle USB events: %s (%d)",
 		          usb_get_error_name(rc), rc);
 	}
+
+	usb_dispatch_pending_responses();
+}
+
+EVENT_PROFILE_HANDLER(usb_handle_events, "usb")
+
+#ifdef BRICKD_WITH_USB_THREAD
+
+// transfers that completed on a USB thread are completed by the event thread
+// later. this runs the function that does this like a libusb event handler, so
+// the responses queued by it are dispatched afterwards in the same way
+void usb_handle_forwarded_completions(void (*function)(void *opaque), void *opaque) {
+	_handling_events = true;
+
+	function(opaque);
+
+	_handling_events = false;
+
+	usb_dispatch_pending_responses();
 }
 
+#endif
+
 static void LIBUSB_CALL usb_add_pollfd(int fd, short events, void *opaque) {
 	libusb_context *context = opaque;
 
 	log_event_debug("Got told to add libusb pollfd (handle: %d, events: %d)", fd, events);
 
 	// FIXME: need to handle libusb timeouts
-	event_add_source(fd, EVENT_SOURCE_TYPE_USB, events, usb_handle_events, context); // FIXME: handle error?
+	event_add_source(fd, EVENT_SOURCE_TYPE_USB, events, EVENT_PROFILED(usb_handle_events), context); // FIXME: handle error?
 }
 
 static void LIBUSB_CALL usb_remove_pollfd(int fd, void *opaque) {
@@ -290,6 +709,46 @@ int usb_init(void) {
 		log_debug("libusb can handle timeouts on its own");
 	}
 
+	// create response buffer pool, pending responses queue and pipe
+	_responses_per_iteration = config_get_option_value("usb.responses_per_iteration")->integer;
+
+	if (array_create(&_free_response_buffers, 32, sizeof(USBResponseBuffer *), true) < 0) {
+		log_error("Could not create response buffer array: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	if (queue_create(&_pending_responses, sizeof(USBResponseBuffer *)) < 0) {
+		log_error("Could not create pending responses queue: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		array_destroy(&_free_response_buffers, NULL);
+
+		goto cleanup;
+	}
+
+	if (pipe_create(&_pending_responses_pipe, 0) < 0) {
+		log_error("Could not create pending responses pipe: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		queue_destroy(&_pending_responses, NULL);
+		array_destroy(&_free_response_buffers, NULL);
+
+		goto cleanup;
+	}
+
+	if (event_add_source(_pending_responses_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC,
+	                     EVENT_READ, usb_handle_pending_responses, NULL) < 0) {
+		pipe_destroy(&_pending_responses_pipe);
+		queue_destroy(&_pending_responses, NULL);
+		array_destroy(&_free_response_buffers, NULL);
+
+		goto cleanup;
+	}
+
+	phase = 3;
+
 	// create USB stack array. the USBStack struct is not relocatable, because
 	// its USB transfers keep a pointer to it
 	if (array_create(&_usb_stacks, 32, sizeof(USBStack), false) < 0) {
@@ -299,7 +758,19 @@ int usb_init(void) {
 		goto cleanup;
 	}
 
-	phase = 3;
+	phase = 4;
+
+	// used to open new USB devices in parallel
+	if (semaphore_create(&_opener_semaphore) < 0) {
+		log_error("Could not create USB opener semaphore: %s (%d)",
+		          get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	mutex_create(&_opener_mutex);
+
+	phase = 5;
 
 	if (usb_has_hotplug()) {
 		log_debug("libusb supports hotplug");
@@ -317,12 +788,29 @@ int usb_init(void) {
 		goto cleanup;
 	}
 
-	phase = 4;
+	phase = 6;
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
-	case 3:
+	case 5:
+		mutex_destroy(&_opener_mutex);
+		semaphore_destroy(&_opener_semaphore);
+		// fall through
+
+	case 4:
 		array_destroy(&_usb_stacks, (ItemDestroyFunction)usb_stack_destroy);
+		usb_free_index();
+		// fall through
+
+	case 3:
+		while (_pending_responses.count > 0) {
+			usb_dispatch_pending_response();
+		}
+
+		event_remove_source(_pending_responses_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+		pipe_destroy(&_pending_responses_pipe);
+		queue_destroy(&_pending_responses, NULL);
+		array_destroy(&_free_response_buffers, (ItemDestroyFunction)usb_free_response_buffer);
 		// fall through
 
 	case 2:
@@ -337,7 +825,7 @@ cleanup:
 		break;
 	}
 
-	return phase == 4 ? 0 : -1;
+	return phase == 6 ? 0 : -1;
 }
 
 void usb_exit(void) {
@@ -349,6 +837,22 @@ void usb_exit(void) {
 
 	array_destroy(&_usb_stacks, (ItemDestroyFunction)usb_stack_destroy);
 
+	usb_free_index();
+
+	mutex_destroy(&_opener_mutex);
+	semaphore_destroy(&_opener_semaphore);
+
+	// responses that are still pending have no USB stack to come from anymore,
+	// but they are dispatched anyway to not lose them
+	while (_pending_responses.count > 0) {
+		usb_dispatch_pending_response();
+	}
+
+	event_remove_source(_pending_responses_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&_pending_responses_pipe);
+	queue_destroy(&_pending_responses, NULL);
+	array_destroy(&_free_response_buffers, (ItemDestroyFunction)usb_free_response_buffer);
+
 	usb_destroy_context(_context);
 
 	usb_exit_platform();
@@ -386,31 +890,123 @@ int usb_rescan(void) {
 			continue;
 		}
 
-		log_info("Removing USB device (bus: %u, device: %u) at index %d: %s",
-		         usb_stack->bus_number, usb_stack->device_address, i,
-		         usb_stack->base.name);
+		usb_remove_stack(i);
+	}
 
-		stack_announce_disconnect(&usb_stack->base);
+	return 0;
+}
 
-		array_remove(&_usb_stacks, i, (ItemDestroyFunction)usb_stack_destroy);
+// handles a hotplug event for a single USB device without rescanning all
+// USB devices. if the USB device is unknown then it is looked up in the
+// libusb device list by bus number and device address only
+int usb_add_device(uint8_t bus_number, uint8_t device_address) {
+	int result = -1;
+	libusb_device **devices;
+	libusb_device *device;
+	int rc;
+	int i = 0;
+
+	if (usb_find_stack(bus_number, device_address) != NULL) {
+		log_debug("USB device (bus: %u, device: %u) is already known",
+		          bus_number, device_address);
+
+		return 0;
 	}
 
-	return 0;
+	rc = libusb_get_device_list(_context, &devices);
+
+	if (rc < 0) {
+		log_error("Could not get USB device list: %s (%d)",
+		          usb_get_error_name(rc), rc);
+
+		return -1;
+	}
+
+	for (device = devices[0]; device != NULL; device = devices[++i]) {
+		if (libusb_get_bus_number(device) != bus_number ||
+		    libusb_get_device_address(device) != device_address) {
+			continue;
+		}
+
+		if (usb_is_brick_device(device, bus_number, device_address) &&
+		    usb_add_stack(bus_number, device_address) < 0) {
+			goto cleanup;
+		}
+
+		break;
+	}
+
+	result = 0;
+
+cleanup:
+	libusb_free_device_list(devices, 1);
+
+	return result;
 }
 
-int usb_reopen(USBStack *usb_stack) {
-	Array recipients;
+void usb_remove_device(uint8_t bus_number, uint8_t device_address) {
+	USBStack *usb_stack = usb_find_stack(bus_number, device_address);
 	int i;
-	USBStack *candidate;
-	uint8_t bus_number;
-	uint8_t device_address;
 
-	if (array_create(&recipients, 1, sizeof(Recipient), true) < 0) {
-		log_error("Could not create temporary recipient array: %s (%d)",
-		          get_errno_name(errno), errno);
+	if (usb_stack == NULL) {
+		return;
+	}
 
-		return -1;
+	for (i = 0; i < _usb_stacks.count; ++i) {
+		if (array_get(&_usb_stacks, i) == usb_stack) {
+			usb_remove_stack(i);
+
+			break;
+		}
 	}
+}
+
+int usb_get_stack_count(void) {
+	return _usb_stacks.count;
+}
+
+USBStack *usb_get_stack(int index) {
+	if (index < 0 || index >= _usb_stacks.count) {
+		return NULL;
+	}
+
+	return array_get(&_usb_stacks, index);
+}
+
+// keeps the recipients of the USB stack, so responses for requests that were
+// sent before the reopen are still routed to the right clients. if the USB
+// stack cannot be reopened then it is removed
+static void usb_reopen_stack(int i, RecipientTable *recipients) {
+	USBStack *usb_stack = array_get(&_usb_stacks, i);
+	uint8_t bus_number = usb_stack->bus_number;
+	uint8_t device_address = usb_stack->device_address;
+
+	log_debug("Reopening USB device (bus: %u, device: %u) at index %d: %s",
+	          bus_number, device_address, i, usb_stack->base.name);
+
+	stack_swap_recipients(&usb_stack->base, recipients);
+
+	usb_stack_destroy(usb_stack);
+
+	if (usb_stack_create(usb_stack, bus_number, device_address) < 0) {
+		usb_unindex_stack(usb_stack);
+		array_remove(&_usb_stacks, i, NULL);
+
+		log_warn("Could not reopen USB device (bus: %u, device: %u) due to an error",
+		         bus_number, device_address);
+
+		return;
+	}
+
+	stack_swap_recipients(&usb_stack->base, recipients);
+}
+
+int usb_reopen(USBStack *usb_stack) {
+	RecipientTable recipients;
+	int i;
+	USBStack *candidate;
+
+	memset(&recipients, 0, sizeof(recipients));
 
 	// iterate backwards for simpler index handling and to avoid memmove in
 	// array_remove call
@@ -421,42 +1017,74 @@ int usb_reopen(USBStack *usb_stack) {
 			continue;
 		}
 
-		log_debug("Reopening USB device (bus: %u, device: %u) at index %d: %s",
-		          candidate->bus_number, candidate->device_address, i,
-		          candidate->base.name);
+		usb_reopen_stack(i, &recipients);
 
-		bus_number = candidate->bus_number;
-		device_address = candidate->device_address;
+		if (usb_stack != NULL) {
+			break;
+		}
+	}
 
-		array_swap(&candidate->base.recipients, &recipients);
+	free(recipients.slots);
 
-		usb_stack_destroy(candidate);
+	return usb_rescan();
+}
 
-		if (usb_stack_create(candidate, bus_number, device_address) < 0) {
-			array_remove(&_usb_stacks, i, NULL);
+#ifdef __APPLE__
 
-			log_warn("Could not reopen USB device (bus: %u, device: %u) due to an error",
-			         bus_number, device_address);
-		} else {
-			array_swap(&recipients, &candidate->base.recipients);
-		}
+// a synchronous GET_STATUS request to the device. this goes over the bus, so
+// it also fails if the device handle became stale while the system was asleep
+static bool usb_is_stack_responsive(USBStack *usb_stack) {
+	uint8_t status[2];
+	int rc;
 
-		if (usb_stack != NULL && candidate == usb_stack) {
-			break;
+	rc = libusb_control_transfer(usb_stack->device_handle,
+	                             LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD |
+	                             LIBUSB_RECIPIENT_DEVICE,
+	                             LIBUSB_REQUEST_GET_STATUS, 0, 0, status,
+	                             sizeof(status), USB_STATUS_REQUEST_TIMEOUT);
+
+	if (rc < 0) {
+		log_debug("%s did not respond to status request: %s (%d)",
+		          usb_stack->base.name, usb_get_error_name(rc), rc);
+
+		return false;
+	}
+
+	return true;
+}
+
+// reopens only the USB stacks that stopped responding, instead of all of
+// them, then looks for added/removed USB devices
+int usb_reopen_unresponsive(void) {
+	RecipientTable recipients;
+	int i;
+	int count = 0;
+
+	memset(&recipients, 0, sizeof(recipients));
+
+	// iterate backwards, usb_reopen_stack might remove the USB stack
+	for (i = _usb_stacks.count - 1; i >= 0; --i) {
+		if (usb_is_stack_responsive(array_get(&_usb_stacks, i))) {
+			continue;
 		}
+
+		usb_reopen_stack(i, &recipients);
+
+		++count;
 	}
 
-	array_destroy(&recipients, NULL);
+	free(recipients.slots);
+
+	log_debug("Reopened %d unresponsive USB device(s)", count);
 
 	return usb_rescan();
 }
 
+#endif
+
 int usb_create_context(libusb_context **context) {
 	int phase = 0;
 	int rc;
-	const struct libusb_pollfd **pollfds = NULL;
-	const struct libusb_pollfd **pollfd;
-	const struct libusb_pollfd **last_added_pollfd = NULL;
 
 	rc = libusb_init(context);
 
@@ -496,8 +1124,41 @@ int usb_create_context(libusb_context **context) {
 
 	phase = 1;
 
-	// get pollfds from main libusb context
-	pollfds = libusb_get_pollfds(*context);
+	if (usb_attach_context(*context) < 0) {
+		goto cleanup;
+	}
+
+	phase = 2;
+
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 1:
+		libusb_exit(*context);
+		// fall through
+
+	default:
+		break;
+	}
+
+	return phase == 2 ? 0 : -1;
+}
+
+void usb_destroy_context(libusb_context *context) {
+	usb_detach_context(context);
+
+	libusb_exit(context);
+}
+
+// adds the pollfds of a libusb context to the event loop, so its events are
+// handled by the event thread
+int usb_attach_context(libusb_context *context) {
+	int phase = 0;
+	const struct libusb_pollfd **pollfds = NULL;
+	const struct libusb_pollfd **pollfd;
+	const struct libusb_pollfd **last_added_pollfd = NULL;
+
+	// get pollfds from libusb context
+	pollfds = libusb_get_pollfds(context);
 
 	if (pollfds == NULL) {
 		log_error("Could not get pollfds from libusb context");
@@ -507,8 +1168,8 @@ int usb_create_context(libusb_context **context) {
 
 	for (pollfd = pollfds; *pollfd != NULL; ++pollfd) {
 		if (event_add_source((*pollfd)->fd, EVENT_SOURCE_TYPE_USB,
-		                     (*pollfd)->events, usb_handle_events,
-		                     *context) < 0) {
+		                     (*pollfd)->events, EVENT_PROFILED(usb_handle_events),
+		                     context) < 0) {
 			goto cleanup;
 		}
 
@@ -519,22 +1180,18 @@ int usb_create_context(libusb_context **context) {
 	phase = 3;
 
 	// register pollfd notifiers
-	libusb_set_pollfd_notifiers(*context, usb_add_pollfd, usb_remove_pollfd,
-	                            *context);
+	libusb_set_pollfd_notifiers(context, usb_add_pollfd, usb_remove_pollfd,
+	                            context);
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
 	case 2:
-		for (pollfd = pollfds; pollfd != last_added_pollfd; ++pollfd) {
+		for (pollfd = pollfds; pollfd != last_added_pollfd + 1; ++pollfd) {
 			event_remove_source((*pollfd)->fd, EVENT_SOURCE_TYPE_USB);
 		}
 
 		// fall through
 
-	case 1:
-		libusb_exit(*context);
-		// fall through
-
 	default:
 		break;
 	}
@@ -548,7 +1205,7 @@ cleanup:
 	return phase == 3 ? 0 : -1;
 }
 
-void usb_destroy_context(libusb_context *context) {
+void usb_detach_context(libusb_context *context) {
 	const struct libusb_pollfd **pollfds = NULL;
 	const struct libusb_pollfd **pollfd;
 
@@ -557,7 +1214,7 @@ void usb_destroy_context(libusb_context *context) {
 	pollfds = libusb_get_pollfds(context);
 
 	if (pollfds == NULL) {
-		log_error("Could not get pollfds from main libusb context");
+		log_error("Could not get pollfds from libusb context");
 	} else {
 		for (pollfd = pollfds; *pollfd != NULL; ++pollfd) {
 			event_remove_source((*pollfd)->fd, EVENT_SOURCE_TYPE_USB);
@@ -569,8 +1226,6 @@ void usb_destroy_context(libusb_context *context) {
 		free(pollfds);
 #endif
 	}
-
-	libusb_exit(context);
 }
 
 int usb_get_interface_endpoints(libusb_device_handle *device_handle, int interface_number,
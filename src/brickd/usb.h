@@ -25,6 +25,8 @@
 #include <stdbool.h>
 #include <libusb.h>
 
+#include <daemonlib/packet.h>
+
 #include "usb_stack.h"
 
 // newer libusb defines LIBUSB_CALL but older libusb doesn't
@@ -48,11 +50,40 @@ void usb_exit(void);
 bool usb_has_hotplug(void);
 
 int usb_rescan(void);
+int usb_add_device(uint8_t bus_number, uint8_t device_address);
+void usb_remove_device(uint8_t bus_number, uint8_t device_address);
 int usb_reopen(USBStack *usb_stack);
+#ifdef __APPLE__
+int usb_reopen_unresponsive(void);
+#endif
+
+int usb_get_stack_count(void);
+USBStack *usb_get_stack(int index);
+
+// read transfers receive into reference-counted buffers from a pool, so a
+// filled buffer can move down the dispatch pipeline while the read transfer is
+// resubmitted with a fresh buffer
+typedef struct {
+	Packet packet;
+	int ref_count;
+} USBResponseBuffer;
+
+USBResponseBuffer *usb_acquire_response_buffer(void);
+void usb_ref_response_buffer(USBResponseBuffer *buffer);
+void usb_unref_response_buffer(USBResponseBuffer *buffer);
+
+void usb_queue_response(USBResponseBuffer *buffer);
+
+#ifdef BRICKD_WITH_USB_THREAD
+void usb_handle_forwarded_completions(void (*function)(void *opaque), void *opaque);
+#endif
 
 int usb_create_context(libusb_context **context);
 void usb_destroy_context(libusb_context *context);
 
+int usb_attach_context(libusb_context *context);
+void usb_detach_context(libusb_context *context);
+
 int usb_get_interface_endpoints(libusb_device_handle *device_handle, int interface_number,
                                 uint8_t *endpoint_in, uint8_t *endpoint_out);
 
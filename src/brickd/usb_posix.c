@@ -208,7 +208,7 @@ static int LIBUSB_CALL usb_handle_hotplug(libusb_context *context, libusb_device
 		log_debug("Received libusb hotplug event (event: arrived, bus: %u, device: %u)",
 		          bus_number, device_address);
 
-		usb_rescan();
+		usb_add_device(bus_number, device_address);
 
 		break;
 
@@ -216,7 +216,7 @@ static int LIBUSB_CALL usb_handle_hotplug(libusb_context *context, libusb_device
 		log_debug("Received libusb hotplug event (event: left, bus: %u, device: %u)",
 		          bus_number, device_address);
 
-		usb_rescan();
+		usb_remove_device(bus_number, device_address);
 
 		break;
 
@@ -29,38 +29,267 @@
 #include <string.h>
 
 #include <daemonlib/array.h>
+#include <daemonlib/config.h>
+#ifdef BRICKD_WITH_USB_THREAD
+	#include <daemonlib/event.h>
+#endif
 #include <daemonlib/log.h>
 #include <daemonlib/utils.h>
 
 #include "usb_stack.h"
 
+#include "client.h"
+#include "event_profile.h"
 #include "hardware.h"
-#include "network.h"
+#include "packet_debug.h"
 #include "usb.h"
 #include "usb_transfer.h"
+#ifdef BRICKD_WITH_USBFS
+	#include "usb_usbfs.h"
+#endif
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
-#define MAX_READ_TRANSFERS 10
-#define MAX_WRITE_TRANSFERS 10
-#define MAX_QUEUED_WRITES 32768
-#define STALL_TIMER_DELAY 1000000 // 1 second in microseconds
-
+#define MIN_ADAPTIVE_READ_TRANSFERS 2
+#define ADAPTION_INTERVAL 100000 // 100 milliseconds in microseconds
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	#define MAX_QUEUED_WRITES 1024 // for both write queues together
+#else
+	#define MAX_QUEUED_WRITES 32768 // for both write queues together
+#endif
+#define MAX_HIGH_PRIORITY_REQUEST_LENGTH 16 // header plus up to 8 bytes of payload
+#define HIGH_PRIORITY_WRITE_WEIGHT 4 // high priority writes per low priority write
+#define STALL_TIMER_DELAY 100000 // 100 milliseconds in microseconds
+#define MAX_STALL_RECOVERY_ATTEMPTS 3
+
+// recovers from stalled transfers by clearing the halt condition of the
+// affected endpoints and resubmitting only the stalled transfers. this keeps
+// the write queue and the recipients. if this fails or the transfers keep
+// stalling without any transfer completing successfully in between then the
+// USB device is reopened
 static void usb_stack_handle_stall(void *opaque) {
 	USBStack *usb_stack = opaque;
+	Array *transfers[2] = { &usb_stack->read_transfers, &usb_stack->write_transfers };
+	bool cleared[2] = { false, false };
+	uint8_t endpoints[2] = { usb_stack->endpoint_in, usb_stack->endpoint_out };
+	int k;
+	int i;
+	USBTransfer *usb_transfer;
+	int rc;
+
+	if (usb_stack->expecting_disconnect) {
+		return;
+	}
+
+	++usb_stack->statistics.stall_recoveries;
+
+	if (usb_stack->stall_recovery_attempts >= MAX_STALL_RECOVERY_ATTEMPTS) {
+		log_warn("Reopening %s to recover from stalled transfer, clearing the halt condition did not help",
+		         usb_stack->base.name);
+
+		usb_reopen(usb_stack);
+
+		return;
+	}
+
+	++usb_stack->stall_recovery_attempts;
+
+	log_warn("Clearing halt condition for %s to recover from stalled transfer (attempt: %d of %d)",
+	         usb_stack->base.name, usb_stack->stall_recovery_attempts,
+	         MAX_STALL_RECOVERY_ATTEMPTS);
+
+	for (k = 0; k < 2; ++k) {
+		for (i = 0; i < transfers[k]->count; ++i) {
+			usb_transfer = array_get(transfers[k], i);
+
+			if (!usb_transfer->stalled) {
+				continue;
+			}
+
+			if (!cleared[k]) {
+				rc = libusb_clear_halt(usb_stack->device_handle, endpoints[k]);
+
+				if (rc < 0) {
+					log_warn("Could not clear halt condition of endpoint 0x%02X for %s, reopening device: %s (%d)",
+					         endpoints[k], usb_stack->base.name,
+					         usb_get_error_name(rc), rc);
+
+					usb_reopen(usb_stack);
+
+					return;
+				}
+
+				cleared[k] = true;
+			}
+
+			usb_transfer->stalled = false;
+
+			// the number of read transfers to keep submitted might have shrunk
+			// in the meantime
+			if (usb_transfer->type == USB_TRANSFER_TYPE_READ &&
+			    usb_stack->read_transfers_to_idle > 0) {
+				--usb_stack->read_transfers_to_idle;
+
+				continue;
+			}
 
-	log_warn("Reopening %s to recover from stalled transfer", usb_stack->base.name);
+			// a stalled write transfer still contains its request
+			if (usb_transfer_submit(usb_transfer) < 0) {
+				log_warn("Could not resubmit stalled %s transfer %p for %s, reopening device",
+				         usb_transfer->type == USB_TRANSFER_TYPE_READ ? "read" : "write",
+				         usb_transfer, usb_stack->base.name);
 
-	usb_reopen(usb_stack);
+				usb_reopen(usb_stack);
+
+				return;
+			}
+		}
+	}
 }
 
-static void usb_stack_read_callback(USBTransfer *usb_transfer) {
+// grows the number of submitted read transfers if they complete quickly or if
+// requests are waiting in the write queue, because then more responses are
+// about to arrive. shrinks it if there is less than one completion per
+// submitted read transfer in an adaption interval
+static void usb_stack_adapt_read_transfers(USBStack *usb_stack,
+                                           USBTransfer *completed_transfer) {
+	uint64_t now = microseconds();
+	int old_target = usb_stack->read_transfer_target;
+	int new_target = old_target;
+	int i;
+	int to_submit;
+	USBTransfer *usb_transfer;
+
+	++usb_stack->read_completions;
+
+	if (now - usb_stack->adaption_start < ADAPTION_INTERVAL) {
+		return;
+	}
+
+	if (usb_stack->read_completions > (uint32_t)old_target * 2 ||
+	    usb_stack->high_priority_write_queue.count + usb_stack->write_queue.count > 0) {
+		new_target = MIN(old_target * 2, usb_stack->read_transfers.count);
+	} else if (usb_stack->read_completions < (uint32_t)old_target) {
+		new_target = MAX(old_target - 1, MIN_ADAPTIVE_READ_TRANSFERS);
+	}
+
+	usb_stack->read_completions = 0;
+	usb_stack->adaption_start = now;
+
+	if (new_target == old_target) {
+		return;
+	}
+
+	log_debug("Changing number of read transfers for %s from %d to %d",
+	          usb_stack->base.name, old_target, new_target);
+
+	usb_stack->read_transfer_target = new_target;
+
+	if (new_target < old_target) {
+		usb_stack->read_transfers_to_idle += old_target - new_target;
+
+		return;
+	}
+
+	to_submit = new_target - old_target;
+
+	// read transfers that are still submitted but about to become idle can
+	// just stay submitted
+	while (to_submit > 0 && usb_stack->read_transfers_to_idle > 0) {
+		--usb_stack->read_transfers_to_idle;
+		--to_submit;
+	}
+
+	// the completed transfer is resubmitted by the caller anyway
+	for (i = 0; to_submit > 0 && i < usb_stack->read_transfers.count; ++i) {
+		usb_transfer = array_get(&usb_stack->read_transfers, i);
+
+		// stalled transfers are resubmitted by usb_stack_handle_stall
+		if (usb_transfer->submitted || usb_transfer->stalled ||
+		    usb_transfer == completed_transfer) {
+			continue;
+		}
+
+		if (usb_transfer_submit(usb_transfer) < 0) {
+			break;
+		}
+
+		--to_submit;
+	}
+}
+
+// remembers when a request that expects a response was submitted, so the
+// latency can be recorded when the response arrives. if all slots are in use
+// then the oldest slot is reused
+static void usb_stack_record_request(USBStack *usb_stack, Packet *request) {
+	USBStackTimedRequest *timed_request;
+
+	++usb_stack->statistics.packets_out;
+	usb_stack->statistics.bytes_out += request->header.length;
+
+	if (!packet_header_get_response_expected(&request->header)) {
+		return;
+	}
+
+	timed_request = &usb_stack->timed_requests[usb_stack->next_timed_request];
+	usb_stack->next_timed_request = (usb_stack->next_timed_request + 1) % USB_STACK_MAX_TIMED_REQUESTS;
+
+	timed_request->uid = request->header.uid;
+	timed_request->function_id = request->header.function_id;
+	timed_request->sequence_number = packet_header_get_sequence_number(&request->header);
+	timed_request->submitted = microseconds();
+}
+
+static void usb_stack_record_response(USBStack *usb_stack, Packet *response) {
+	uint8_t sequence_number = packet_header_get_sequence_number(&response->header);
+	int i;
+	USBStackTimedRequest *timed_request;
+	uint64_t latency;
+	int bucket;
+
+	++usb_stack->statistics.packets_in;
+	usb_stack->statistics.bytes_in += response->header.length;
+
+	// callbacks have no request to measure the latency against
+	if (sequence_number == 0) {
+		return;
+	}
+
+	for (i = 0; i < USB_STACK_MAX_TIMED_REQUESTS; ++i) {
+		timed_request = &usb_stack->timed_requests[i];
+
+		if (timed_request->submitted == 0 ||
+		    timed_request->uid != response->header.uid ||
+		    timed_request->function_id != response->header.function_id ||
+		    timed_request->sequence_number != sequence_number) {
+			continue;
+		}
+
+		latency = (microseconds() - timed_request->submitted) / 1000; // milliseconds
+		timed_request->submitted = 0;
+
+		for (bucket = 0; latency > 0 && bucket < USB_STACK_LATENCY_BUCKETS - 1; ++bucket) {
+			latency >>= 1;
+		}
+
+		++usb_stack->statistics.latency_histogram[bucket];
+
+		return;
+	}
+}
+
+// the read transfer is only used for log messages and adapting the number of
+// read transfers. if the response is handed over to the dispatch pipeline then
+// the response buffer reference is taken
+static void usb_stack_handle_response(USBStack *usb_stack, USBTransfer *usb_transfer,
+                                      USBResponseBuffer **response_buffer, int length) {
+	Packet *response = &(*response_buffer)->packet;
 	const char *message = NULL;
 	char packet_content_dump[PACKET_MAX_CONTENT_DUMP_LENGTH];
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 
 	// check if packet is too short
-	if (usb_transfer->handle->actual_length < (int)sizeof(PacketHeader)) {
+	if (length < (int)sizeof(PacketHeader)) {
 		// there is a problem with the first USB transfer send by the RED
 		// Brick. if the first USB transfer was queued to the A10s USB hardware
 		// before the USB OTG connection got established then the payload of
@@ -69,118 +298,239 @@ static void usb_stack_read_callback(USBTransfer *usb_transfer) {
 		// the RED Brick sends a USB transfer with one byte payload before
 		// sending anything else. this short response with 0xA1/0xAA as payload
 		// is detected here and dropped
-		if (usb_transfer->usb_stack->expecting_short_Ax_response &&
-		    usb_transfer->handle->actual_length == 1 &&
-		    (*(uint8_t *)&usb_transfer->packet == 0xA1 ||
-		     *(uint8_t *)&usb_transfer->packet == 0xAA)) {
-			usb_transfer->usb_stack->expecting_short_Ax_response = false;
+		if (usb_stack->expecting_short_Ax_response &&
+		    length == 1 &&
+		    (*(uint8_t *)response == 0xA1 ||
+		     *(uint8_t *)response == 0xAA)) {
+			usb_stack->expecting_short_Ax_response = false;
 
 			log_debug("Read transfer %p returned expected short 0x%02X response from %s, dropping response",
-			          usb_transfer, *(uint8_t *)&usb_transfer->packet,
-			          usb_transfer->usb_stack->base.name);
+			          usb_transfer, *(uint8_t *)response,
+			          usb_stack->base.name);
 		} else {
 			log_error("Read transfer %p returned response%s%s%s with incomplete header (actual: %u < minimum: %d) from %s",
 			          usb_transfer,
-			          usb_transfer->handle->actual_length > 0 ? " (packet: " : "",
-			          packet_get_content_dump(packet_content_dump, &usb_transfer->packet,
-			                                  usb_transfer->handle->actual_length),
-			          usb_transfer->handle->actual_length > 0 ? ")" : "",
-			          usb_transfer->handle->actual_length,
+			          length > 0 ? " (packet: " : "",
+			          packet_get_content_dump(packet_content_dump, response,
+			                                  length),
+			          length > 0 ? ")" : "",
+			          length,
 			          (int)sizeof(PacketHeader),
-			          usb_transfer->usb_stack->base.name);
+			          usb_stack->base.name);
 		}
 
 		return;
 	}
 
+	if (usb_stack->adaptive_read_transfers) {
+		usb_stack_adapt_read_transfers(usb_stack, usb_transfer);
+	}
+
 	// only the first response from the RED Brick is expected to be a short
 	// 0xA1/0xAA response. after the first non-short response arrived stop
 	// expecting a short response
-	usb_transfer->usb_stack->expecting_short_Ax_response = false;
+	usb_stack->expecting_short_Ax_response = false;
 
 	// check if USB transfer length and packet length in header mismatches
-	if (usb_transfer->handle->actual_length != usb_transfer->packet.header.length) {
+	if (length != response->header.length) {
 		log_error("Read transfer %p returned response%s%s%s with length mismatch (actual: %u != expected: %u) from %s",
 		          usb_transfer,
-		          usb_transfer->handle->actual_length > 0 ? " (packet: " : "",
-		          packet_get_content_dump(packet_content_dump, &usb_transfer->packet,
-		                                  usb_transfer->handle->actual_length),
-		          usb_transfer->handle->actual_length > 0 ? ")" : "",
-		          usb_transfer->handle->actual_length,
-		          usb_transfer->packet.header.length,
-		          usb_transfer->usb_stack->base.name);
+		          length > 0 ? " (packet: " : "",
+		          packet_get_content_dump(packet_content_dump, response,
+		                                  length),
+		          length > 0 ? ")" : "",
+		          length,
+		          response->header.length,
+		          usb_stack->base.name);
 
 		return;
 	}
 
 	// check if packet is a valid response
-	if (!packet_header_is_valid_response(&usb_transfer->packet.header, &message)) {
+	if (!packet_header_is_valid_response(&response->header, &message)) {
 		log_debug("Received invalid response%s%s%s from %s: %s",
-		          usb_transfer->handle->actual_length > 0 ? " (packet: " : "",
-		          packet_get_content_dump(packet_content_dump, &usb_transfer->packet,
-		                                  usb_transfer->handle->actual_length),
-		          usb_transfer->handle->actual_length > 0 ? ")" : "",
-		          usb_transfer->usb_stack->base.name,
+		          length > 0 ? " (packet: " : "",
+		          packet_get_content_dump(packet_content_dump, response,
+		                                  length),
+		          length > 0 ? ")" : "",
+		          usb_stack->base.name,
 		          message);
 
 		return;
 	}
 
-	log_packet_debug("Received %s (%s) from %s",
-	                 packet_get_response_type(&usb_transfer->packet),
-	                 packet_get_response_signature(packet_signature, &usb_transfer->packet),
-	                 usb_transfer->usb_stack->base.name);
+	log_packet_debug_checked("Received %s (%s) from %s",
+	                         packet_get_response_type(response),
+	                         packet_get_response_signature(packet_signature, response),
+	                         usb_stack->base.name);
 
 #ifdef DAEMONLIB_WITH_PACKET_TRACE
-	usb_transfer->packet.trace_id = packet_get_next_response_trace_id();
+	response->trace_id = packet_get_next_response_trace_id();
 #endif
 
-	packet_add_trace(&usb_transfer->packet);
+	packet_add_trace(response);
 
-	if (stack_add_recipient(&usb_transfer->usb_stack->base,
-	                        usb_transfer->packet.header.uid, 0) < 0) {
+	if (stack_add_recipient(&usb_stack->base,
+	                        response->header.uid, 0) < 0) {
 		return;
 	}
 
-	network_dispatch_response(&usb_transfer->packet);
+	usb_stack_record_response(usb_stack, response);
+
+	// hand the filled buffer over to the dispatch pipeline. the read transfer
+	// gets a fresh buffer from the pool when it is resubmitted
+	usb_queue_response(*response_buffer);
+	usb_unref_response_buffer(*response_buffer);
+
+	*response_buffer = NULL;
+}
+
+static void usb_stack_read_callback(USBTransfer *usb_transfer) {
+	usb_stack_handle_response(usb_transfer->usb_stack, usb_transfer,
+	                          &usb_transfer->response_buffer,
+	                          usb_transfer->handle->actual_length);
+}
+
+// the write queue is split into two lanes. small requests that expect a
+// response (typically getters) go to the high priority lane, so they don't have
+// to wait behind bulk writes such as firmware flashing. to keep the order of
+// requests to the same device, a request only goes to the high priority lane
+// if no request for its UID is queued in the low priority lane. this is tracked
+// by counting the queued low priority requests per UID hash bucket
+static int usb_stack_get_uid_bucket(uint32_t uid) {
+	return (int)((uint32_t)(uid * 2654435761u) >> (32 - USB_STACK_LOW_PRIORITY_UID_BUCKETS_BITS));
+}
+
+static bool usb_stack_is_high_priority_request(USBStack *usb_stack, Packet *request) {
+	return packet_header_get_response_expected(&request->header) &&
+	       request->header.length <= MAX_HIGH_PRIORITY_REQUEST_LENGTH &&
+	       usb_stack->low_priority_uid_counts[usb_stack_get_uid_bucket(request->header.uid)] == 0;
+}
+
+// the high priority lane is preferred, but after HIGH_PRIORITY_WRITE_WEIGHT
+// high priority writes in a row a waiting low priority write gets its turn.
+// the low priority lane is a fair queue, so clients get the same share of
+// bandwidth for bulk writes, instead of being served in arrival order
+static Packet *usb_stack_peek_queued_write(USBStack *usb_stack, bool *high_priority) {
+	if (usb_stack->high_priority_write_queue.count > 0 &&
+	    (usb_stack->write_queue.count == 0 ||
+	     usb_stack->high_priority_writes_in_a_row < HIGH_PRIORITY_WRITE_WEIGHT)) {
+		*high_priority = true;
+
+		return packet_ring_peek(&usb_stack->high_priority_write_queue);
+	}
+
+	*high_priority = false;
+
+	return fair_queue_peek(&usb_stack->write_queue);
+}
+
+static void usb_stack_pop_queued_write(USBStack *usb_stack, bool high_priority) {
+	if (high_priority) {
+		packet_ring_pop(&usb_stack->high_priority_write_queue);
+	} else {
+		--usb_stack->low_priority_uid_counts[usb_stack_get_uid_bucket(((Packet *)fair_queue_peek(&usb_stack->write_queue))->header.uid)];
+
+		fair_queue_pop(&usb_stack->write_queue, NULL);
+	}
+}
+
+// drops the oldest low priority request of the client with the most queued
+// low priority requests, or the oldest high priority request if there is no
+// low priority request
+static void usb_stack_drop_queued_write(USBStack *usb_stack) {
+	if (usb_stack->write_queue.count > 0) {
+		--usb_stack->low_priority_uid_counts[usb_stack_get_uid_bucket(((Packet *)fair_queue_peek_longest(&usb_stack->write_queue))->header.uid)];
+
+		fair_queue_pop_longest(&usb_stack->write_queue, NULL);
+	} else {
+		packet_ring_pop(&usb_stack->high_priority_write_queue);
+	}
+}
+
+typedef struct {
+	USBStack *usb_stack;
+	Client *client;
+} USBStackCancelContext;
+
+static void usb_stack_cancel_queued_write(void *item, void *opaque) {
+	USBStackCancelContext *context = opaque;
+	Packet *request = item;
+
+	--context->usb_stack->low_priority_uid_counts[usb_stack_get_uid_bucket(request->header.uid)];
+
+	client_cancel_pending_request(context->client, request);
+}
+
+// only the low priority lane knows the client of a request. the high priority
+// lane only holds short requests anyway
+static void usb_stack_cancel_requests(Stack *stack, Client *client) {
+	USBStack *usb_stack = (USBStack *)stack;
+	USBStackCancelContext context;
+	int count;
+
+	context.usb_stack = usb_stack;
+	context.client = client;
+
+	count = fair_queue_cancel_owner(&usb_stack->write_queue, client,
+	                                usb_stack_cancel_queued_write, &context);
+
+	if (count > 0) {
+		log_debug("Canceled %d queued request(s) for %s", count, usb_stack->base.name);
+	}
 }
 
 static void usb_stack_write_callback(USBTransfer *usb_transfer) {
+	USBStack *usb_stack = usb_transfer->usb_stack;
+	bool high_priority;
 	Packet *request;
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 
-	if (!usb_transfer->usb_stack->expecting_disconnect &&
-	    usb_transfer->usb_stack->write_queue.count > 0) {
-		request = queue_peek(&usb_transfer->usb_stack->write_queue);
+	if (usb_stack->expecting_disconnect) {
+		return;
+	}
 
-		memcpy(&usb_transfer->packet, request, request->header.length);
+	request = usb_stack_peek_queued_write(usb_stack, &high_priority);
 
-		if (usb_transfer_submit(usb_transfer) < 0) {
-			log_error("Could not send queued request (%s) to %s: %s (%d)",
-			          packet_get_request_signature(packet_signature, &usb_transfer->packet),
-			          usb_transfer->usb_stack->base.name,
-			          get_errno_name(errno), errno);
+	if (request == NULL) {
+		return;
+	}
 
-			return;
-		}
+	memcpy(&usb_transfer->packet, request, request->header.length);
 
-		queue_pop(&usb_transfer->usb_stack->write_queue, NULL);
+	if (usb_transfer_submit(usb_transfer) < 0) {
+		log_error("Could not send queued request (%s) to %s: %s (%d)",
+		          packet_get_request_signature(packet_signature, &usb_transfer->packet),
+		          usb_stack->base.name, get_errno_name(errno), errno);
 
-		log_packet_debug("Sent queued request (%s) to %s, %d request(s) left in write queue",
-		                 packet_get_request_signature(packet_signature, &usb_transfer->packet),
-		                 usb_transfer->usb_stack->base.name,
-		                 usb_transfer->usb_stack->write_queue.count);
+		return;
 	}
+
+	usb_stack_record_request(usb_stack, &usb_transfer->packet);
+	usb_stack_pop_queued_write(usb_stack, high_priority);
+
+	if (high_priority) {
+		++usb_stack->high_priority_writes_in_a_row;
+	} else {
+		usb_stack->high_priority_writes_in_a_row = 0;
+	}
+
+	log_packet_debug_checked("Sent queued %s priority request (%s) to %s, %d + %d request(s) left in write queue",
+	                         high_priority ? "high" : "low",
+	                         packet_get_request_signature(packet_signature, &usb_transfer->packet),
+	                         usb_stack->base.name, usb_stack->high_priority_write_queue.count,
+	                         usb_stack->write_queue.count);
 }
 
 static int usb_stack_dispatch_request(Stack *stack, Packet *request,
-                                      Recipient *recipient) {
+                                      Recipient *recipient, Client *client) {
 	USBStack *usb_stack = (USBStack *)stack;
 	int i;
 	USBTransfer *usb_transfer;
-	Packet *queued_request;
 	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
 	uint32_t requests_to_drop;
+	bool high_priority;
+	Packet *queued_request;
 
 	(void)recipient;
 
@@ -196,7 +546,9 @@ static int usb_stack_dispatch_request(Stack *stack, Packet *request,
 	for (i = 0; i < usb_stack->write_transfers.count; ++i) {
 		usb_transfer = array_get(&usb_stack->write_transfers, i);
 
-		if (usb_transfer->submitted) {
+		// a stalled write transfer still holds its request until
+		// usb_stack_handle_stall resubmits it
+		if (usb_transfer->submitted || usb_transfer->stalled) {
 			continue;
 		}
 
@@ -208,53 +560,419 @@ static int usb_stack_dispatch_request(Stack *stack, Packet *request,
 			continue;
 		}
 
+		usb_stack_record_request(usb_stack, &usb_transfer->packet);
+
 		return 0;
 	}
 
 	// no free write transfer available, push request to write queue
-	log_packet_debug("Could not find a free write transfer for %s, pushing request to write queue (count: %d +1)",
-	                 usb_stack->base.name, usb_stack->write_queue.count);
+	high_priority = usb_stack_is_high_priority_request(usb_stack, request);
+
+	log_packet_debug("Could not find a free write transfer for %s, pushing request to %s priority write queue (count: %d + %d +1, used: %u byte(s) + %d flow(s))",
+	                 usb_stack->base.name, high_priority ? "high" : "low",
+	                 usb_stack->high_priority_write_queue.count, usb_stack->write_queue.count,
+	                 usb_stack->high_priority_write_queue.used, usb_stack->write_queue.flow_count);
+
+	// drop queued requests if the queue is full, low priority requests of the
+	// client with the most queued requests first
+	requests_to_drop = 0;
 
-	if (usb_stack->write_queue.count >= MAX_QUEUED_WRITES) {
-		requests_to_drop = usb_stack->write_queue.count - MAX_QUEUED_WRITES + 1;
+	for (;;) {
+		if (usb_stack->high_priority_write_queue.count + usb_stack->write_queue.count < MAX_QUEUED_WRITES) {
+			if (!high_priority) {
+				queued_request = fair_queue_push(&usb_stack->write_queue, client);
+
+				if (queued_request == NULL) {
+					log_error("Could not push request (%s) to write queue for %s, dropping request: %s (%d)",
+					          packet_get_request_signature(packet_signature, request),
+					          usb_stack->base.name,
+					          get_errno_name(errno), errno);
+
+					return -1;
+				}
+
+				memcpy(queued_request, request, request->header.length);
+
+				++usb_stack->low_priority_uid_counts[usb_stack_get_uid_bucket(request->header.uid)];
+
+				break;
+			}
+
+			if (packet_ring_push(&usb_stack->high_priority_write_queue, request) >= 0) {
+				break;
+			}
+
+			if (errno != ENOSPC || usb_stack->high_priority_write_queue.count == 0) {
+				log_error("Could not push request (%s) to write queue for %s, dropping request: %s (%d)",
+				          packet_get_request_signature(packet_signature, request),
+				          usb_stack->base.name,
+				          get_errno_name(errno), errno);
+
+				return -1;
+			}
+
+			packet_ring_pop(&usb_stack->high_priority_write_queue);
+		} else {
+			usb_stack_drop_queued_write(usb_stack);
+		}
 
-		log_warn("Write queue for %s is full, dropping %u queued request(s), %u + %u dropped in total",
+		++requests_to_drop;
+	}
+
+	if ((uint32_t)(usb_stack->high_priority_write_queue.count + usb_stack->write_queue.count) >
+	    usb_stack->statistics.peak_queued_writes) {
+		usb_stack->statistics.peak_queued_writes =
+			usb_stack->high_priority_write_queue.count + usb_stack->write_queue.count;
+	}
+
+	if (requests_to_drop > 0) {
+		log_warn("Write queue for %s is full, dropped %u queued request(s), %u + %u dropped in total",
 		         usb_stack->base.name, requests_to_drop,
-		         usb_stack->dropped_requests, requests_to_drop);
+		         usb_stack->statistics.dropped_requests, requests_to_drop);
+
+		usb_stack->statistics.dropped_requests += requests_to_drop;
+	}
+
+	return 0;
+}
+
+#ifdef BRICKD_WITH_USB_THREAD
+
+#define MAX_FORWARDED_RESPONSES 1024
+#define MAX_COMPLETIONS_PER_EVENT 256
+#define USB_THREAD_EVENT_TIMEOUT 100000 // 100 milliseconds in microseconds
+
+typedef struct {
+	USBTransfer *usb_transfer;
+	bool resubmitted; // the response was copied and the transfer submitted again
+	int length;
+	Packet response;
+} USBStackCompletion;
+
+static uint32_t usb_stack_load(uint32_t *value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static void usb_stack_store(uint32_t *value, uint32_t new_value) {
+	__atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+static uint32_t usb_stack_exchange(uint32_t *value, uint32_t new_value) {
+	return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+// called from both threads, the pipe holds at most one byte
+static void usb_stack_signal_completions(USBStack *usb_stack) {
+	uint8_t byte = 0;
+
+	if (usb_stack_exchange(&usb_stack->completion_pending, 1) != 0) {
+		return;
+	}
+
+	if (pipe_write(&usb_stack->completion_pipe, &byte, sizeof(byte)) < 0) {
+		log_error("Could not write to completion pipe for %s: %s (%d)",
+		          usb_stack->base.name, get_errno_name(errno), errno);
+	}
+}
+
+// called on the USB thread. a read transfer that completed successfully gets
+// its response copied and is resubmitted right away, so the device can send the
+// next response while the event thread is still busy. all other transfers are
+// forwarded as they are and completed by the event thread. such a transfer is
+// not submitted again before the event thread handled it. therefore, the ring
+// always has room for it above the limit for forwarded responses
+void usb_stack_forward_completion(USBTransfer *usb_transfer) {
+	USBStack *usb_stack = usb_transfer->usb_stack;
+	struct libusb_transfer *handle = usb_transfer->handle;
+	bool copy = usb_transfer->type == USB_TRANSFER_TYPE_READ &&
+	            handle->status == LIBUSB_TRANSFER_COMPLETED;
+	USBStackCompletion *completion;
+	int rc;
 
-		usb_stack->dropped_requests += requests_to_drop;
+	// wait for the event thread to catch up instead of dropping responses.
+	// meanwhile the device cannot send more responses, this is the same
+	// backpressure as without the USB thread
+	while (copy && spsc_ring_count(&usb_stack->completions) >= usb_stack->max_forwarded_responses) {
+		if (usb_stack_load(&usb_stack->usb_thread_stopping) != 0) {
+			copy = false;
 
-		while (usb_stack->write_queue.count >= MAX_QUEUED_WRITES) {
-			queue_pop(&usb_stack->write_queue, NULL);
+			break;
 		}
+
+		usb_stack_signal_completions(usb_stack);
+		millisleep(1);
 	}
 
-	queued_request = queue_push(&usb_stack->write_queue);
+	completion = spsc_ring_reserve(&usb_stack->completions);
 
-	if (queued_request == NULL) {
-		log_error("Could not push request (%s) to write queue for %s, dropping request: %s (%d)",
-		          packet_get_request_signature(packet_signature, request),
+	if (completion == NULL) { // cannot happen, see above
+		log_error("Completion ring for %s is full, dropping completed %s transfer %p",
 		          usb_stack->base.name,
+		          usb_transfer->type == USB_TRANSFER_TYPE_READ ? "read" : "write",
+		          usb_transfer);
+
+		return;
+	}
+
+	completion->usb_transfer = usb_transfer;
+	completion->resubmitted = false;
+
+	if (copy) {
+		completion->length = handle->actual_length;
+
+		memcpy(&completion->response, handle->buffer, handle->actual_length);
+
+		rc = libusb_submit_transfer(handle);
+
+		if (rc < 0) {
+			// the event thread resubmits the transfer after completing it
+			log_warn("Could not resubmit read transfer %p (%p) to %s on USB thread: %s (%d)",
+			         usb_transfer, handle, usb_stack->base.name,
+			         usb_get_error_name(rc), rc);
+		} else {
+			completion->resubmitted = true;
+		}
+	}
+
+	spsc_ring_commit(&usb_stack->completions);
+
+	usb_stack_signal_completions(usb_stack);
+}
+
+static void usb_stack_complete_forwarded(USBStack *usb_stack, USBStackCompletion *completion) {
+	USBTransfer *usb_transfer = completion->usb_transfer;
+	USBResponseBuffer *response_buffer;
+
+	if (!completion->resubmitted) {
+		usb_transfer_complete(usb_transfer);
+
+		return;
+	}
+
+	log_packet_debug("Read transfer %p (%p) returned successfully from %s on USB thread%s",
+	                 usb_transfer, usb_transfer->handle, usb_stack->base.name,
+	                 usb_transfer->cancelled
+	                 ? ", but it was cancelled in the meantime"
+	                 : (usb_stack->expecting_disconnect
+	                    ? ", but the corresponding USB device is about to be removed"
+	                    : ""));
+
+	if (usb_transfer->cancelled || usb_stack->expecting_disconnect) {
+		return;
+	}
+
+	usb_stack->stall_recovery_attempts = 0;
+
+	response_buffer = usb_acquire_response_buffer();
+
+	if (response_buffer == NULL) {
+		log_error("Could not acquire response buffer for read transfer %p (%p) from %s, dropping response: %s (%d)",
+		          usb_transfer, usb_transfer->handle, usb_stack->base.name,
 		          get_errno_name(errno), errno);
 
-		return -1;
+		return;
 	}
 
-	memcpy(queued_request, request, request->header.length);
+	memcpy(&response_buffer->packet, &completion->response, completion->length);
 
-	return 0;
+	usb_stack_handle_response(usb_stack, usb_transfer, &response_buffer, completion->length);
+
+	if (response_buffer != NULL) {
+		usb_unref_response_buffer(response_buffer);
+	}
 }
 
-int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_address) {
-	int phase = 0;
+static void usb_stack_complete_forwarded_batch(void *opaque) {
+	USBStack *usb_stack = opaque;
+	uint8_t bytes[16];
+	USBStackCompletion *completion;
+	int count = 0;
+
+	// drain the pipe before looking at the ring, so that completions added
+	// afterwards cause a new wakeup
+	while (pipe_read(&usb_stack->completion_pipe, bytes, sizeof(bytes)) > 0) {
+	}
+
+	usb_stack_store(&usb_stack->completion_pending, 0);
+
+	while (count < MAX_COMPLETIONS_PER_EVENT &&
+	       (completion = spsc_ring_peek(&usb_stack->completions)) != NULL) {
+		usb_stack_complete_forwarded(usb_stack, completion);
+		spsc_ring_pop(&usb_stack->completions);
+
+		++count;
+	}
+
+	// continue in the next event loop iteration to not starve other sources
+	if (spsc_ring_peek(&usb_stack->completions) != NULL) {
+		usb_stack_signal_completions(usb_stack);
+	}
+}
+
+static void usb_stack_handle_completions(void *opaque) {
+	usb_handle_forwarded_completions(usb_stack_complete_forwarded_batch, opaque);
+}
+
+EVENT_PROFILE_HANDLER(usb_stack_handle_completions, "usb-thread")
+
+static void usb_stack_run_usb_thread(void *opaque) {
+	USBStack *usb_stack = opaque;
+	struct timeval tv;
 	int rc;
-	libusb_device **devices;
-	libusb_device *device;
-	struct libusb_device_descriptor descriptor;
-	int i = 0;
+
+	log_debug("Started USB thread for %s", usb_stack->base.name);
+
+	while (usb_stack_load(&usb_stack->usb_thread_stopping) == 0) {
+		tv.tv_sec = 0;
+		tv.tv_usec = USB_THREAD_EVENT_TIMEOUT;
+
+		rc = libusb_handle_events_timeout(usb_stack->context, &tv);
+
+		if (rc < 0 && rc != LIBUSB_ERROR_INTERRUPTED) {
+			log_error("Could not handle USB events for %s on USB thread: %s (%d)",
+			          usb_stack->base.name, usb_get_error_name(rc), rc);
+
+			millisleep(10); // don't spin if the error persists
+		}
+	}
+
+	log_debug("Stopped USB thread for %s", usb_stack->base.name);
+}
+
+// the USB thread is optional. if it cannot be started then the event thread
+// keeps handling the libusb events of the USB stack
+static void usb_stack_start_usb_thread(USBStack *usb_stack) {
+	int phase = 0;
+	uint32_t capacity = 1;
+
+	// room for the forwarded responses and one completion per transfer
+	usb_stack->max_forwarded_responses = MAX_FORWARDED_RESPONSES;
+
+	while (capacity < MAX_FORWARDED_RESPONSES + (uint32_t)usb_stack->read_transfers.count +
+	                  (uint32_t)usb_stack->write_transfers.count) {
+		capacity <<= 1;
+	}
+
+	if (spsc_ring_create(&usb_stack->completions, sizeof(USBStackCompletion), capacity) < 0) {
+		log_error("Could not create completion ring for %s: %s (%d)",
+		          usb_stack->base.name, get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 1;
+
+	if (pipe_create(&usb_stack->completion_pipe,
+	                PIPE_FLAG_NON_BLOCKING_READ | PIPE_FLAG_NON_BLOCKING_WRITE) < 0) {
+		log_error("Could not create completion pipe for %s: %s (%d)",
+		          usb_stack->base.name, get_errno_name(errno), errno);
+
+		goto cleanup;
+	}
+
+	phase = 2;
+
+	if (event_add_source(usb_stack->completion_pipe.base.read_handle,
+	                     EVENT_SOURCE_TYPE_GENERIC, EVENT_READ,
+	                     EVENT_PROFILED(usb_stack_handle_completions), usb_stack) < 0) {
+		goto cleanup;
+	}
+
+	phase = 3;
+
+	usb_stack->usb_thread_stopping = 0;
+	usb_stack->completion_pending = 0;
+
+	// from now on only the USB thread handles the libusb events
+	usb_detach_context(usb_stack->context);
+
+	usb_stack->usb_thread_active = true;
+
+	thread_create(&usb_stack->usb_thread, usb_stack_run_usb_thread, usb_stack);
+
+	phase = 4;
+
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 2:
+		pipe_destroy(&usb_stack->completion_pipe);
+		// fall through
+
+	case 1:
+		spsc_ring_destroy(&usb_stack->completions);
+		// fall through
+
+	default:
+		break;
+	}
+
+	if (phase != 4) {
+		log_warn("Could not start USB thread for %s, handling its USB events in the event thread",
+		         usb_stack->base.name);
+	}
+}
+
+static void usb_stack_stop_usb_thread(USBStack *usb_stack) {
+	if (!usb_stack->usb_thread_active) {
+		return;
+	}
+
+	usb_stack_store(&usb_stack->usb_thread_stopping, 1);
+
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000105 // libusb 1.0.21
+	libusb_interrupt_event_handler(usb_stack->context);
+#endif
+
+	thread_join(&usb_stack->usb_thread);
+	thread_destroy(&usb_stack->usb_thread);
+
+	usb_stack->usb_thread_active = false;
+
+	// complete everything that was forwarded, afterwards the submitted flags
+	// of all transfers are accurate again
+	while (spsc_ring_peek(&usb_stack->completions) != NULL) {
+		usb_stack_handle_completions(usb_stack);
+	}
+
+	event_remove_source(usb_stack->completion_pipe.base.read_handle, EVENT_SOURCE_TYPE_GENERIC);
+	pipe_destroy(&usb_stack->completion_pipe);
+	spsc_ring_destroy(&usb_stack->completions);
+
+	// the event thread handles the libusb events again while the remaining
+	// transfers are cancelled and the device is closed
+	if (usb_attach_context(usb_stack->context) < 0) {
+		log_warn("Could not hand libusb events of %s back to the event thread",
+		         usb_stack->base.name);
+	}
+}
+
+#endif
+
+// the event mutex serializes libusb_open and libusb_close calls from worker
+// threads, because they can add and remove event sources through the pollfd
+// notifiers of the libusb context
+static void usb_stack_lock_events(Mutex *event_mutex) {
+	if (event_mutex != NULL) {
+		mutex_lock(event_mutex);
+	}
+}
+
+static void usb_stack_unlock_events(Mutex *event_mutex) {
+	if (event_mutex != NULL) {
+		mutex_unlock(event_mutex);
+	}
+}
+
+// creating a USBStack is split into three steps. usb_stack_prepare and
+// usb_stack_complete have to be called from the event thread, because they
+// add event sources. usb_stack_open does the blocking USB I/O to open the USB
+// device and can be called from a worker thread, so several USB devices can be
+// opened in parallel. if usb_stack_open fails then usb_stack_abort has to be
+// called to undo usb_stack_prepare
+int usb_stack_prepare(USBStack *usb_stack, uint8_t bus_number, uint8_t device_address) {
+	int phase = 0;
 	char preliminary_name[STACK_MAX_NAME_LENGTH];
-	int retries = 0;
-	USBTransfer *usb_transfer;
+	int max_read_transfers;
 
 	log_debug("Acquiring USB device (bus: %u, device: %u)",
 	          bus_number, device_address);
@@ -264,11 +982,42 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 
 	usb_stack->context = NULL;
 	usb_stack->device_handle = NULL;
-	usb_stack->dropped_requests = 0;
+	usb_stack->stall_recovery_attempts = 0;
+	usb_stack->next_timed_request = 0;
 	usb_stack->connected = true;
 	usb_stack->expecting_short_Ax_response = false;
 	usb_stack->expecting_read_stall_before_removal = false;
 	usb_stack->expecting_disconnect = false;
+#ifdef BRICKD_WITH_USBFS
+	usb_stack->usbfs_fd = -1;
+	usb_stack->usbfs_polling = false;
+#endif
+
+	memset(&usb_stack->statistics, 0, sizeof(usb_stack->statistics));
+	memset(usb_stack->timed_requests, 0, sizeof(usb_stack->timed_requests));
+
+	max_read_transfers = config_get_option_value("usb.read_transfers")->integer;
+
+	// in adaptive mode the configured number of read transfers is allocated,
+	// but only some of them are submitted at first
+	usb_stack->adaptive_read_transfers = config_get_option_value("usb.adaptive_read_transfers")->boolean;
+
+#ifdef BRICKD_WITH_USB_THREAD
+	usb_stack->usb_thread_active = false;
+
+	// the USB thread resubmits completed read transfers on its own, this
+	// doesn't work together with idling some of them
+	if (config_get_option_value("usb.dedicated_thread")->boolean) {
+		usb_stack->adaptive_read_transfers = false;
+	}
+#endif
+
+	usb_stack->read_transfer_target = usb_stack->adaptive_read_transfers
+	                                  ? MIN(MIN_ADAPTIVE_READ_TRANSFERS, max_read_transfers)
+	                                  : max_read_transfers;
+	usb_stack->read_transfers_to_idle = 0;
+	usb_stack->read_completions = 0;
+	usb_stack->adaption_start = microseconds();
 
 	// create stack base
 	snprintf(preliminary_name, sizeof(preliminary_name),
@@ -282,6 +1031,8 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		goto cleanup;
 	}
 
+	usb_stack->base.cancel_requests = usb_stack_cancel_requests;
+
 	phase = 1;
 
 	// initialize per-device libusb context
@@ -291,6 +1042,34 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 
 	phase = 2;
 
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 1:
+		stack_destroy(&usb_stack->base);
+		// fall through
+
+	default:
+		break;
+	}
+
+	return phase == 2 ? 0 : -1;
+}
+
+void usb_stack_abort(USBStack *usb_stack) {
+	usb_destroy_context(usb_stack->context);
+	stack_destroy(&usb_stack->base);
+}
+
+int usb_stack_open(USBStack *usb_stack, Mutex *event_mutex) {
+	int phase = 0;
+	int rc;
+	libusb_device **devices;
+	libusb_device *device;
+	struct libusb_device_descriptor descriptor;
+	int i = 0;
+	char preliminary_name[STACK_MAX_NAME_LENGTH];
+	int retries = 0;
+
 	// find device
 	rc = libusb_get_device_list(usb_stack->context, &devices);
 
@@ -317,7 +1096,7 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		}
 
 		log_debug("Looking at USB device (bus: %u, device: %u, vendor-id: 0x%04X, product-id: 0x%04X, release: 0x%04X)",
-		          bus_number, device_address, descriptor.idVendor, descriptor.idProduct, descriptor.bcdDevice);
+		          usb_stack->bus_number, usb_stack->device_address, descriptor.idVendor, descriptor.idProduct, descriptor.bcdDevice);
 
 		if (descriptor.idVendor == USB_BRICK_VENDOR_ID &&
 		    descriptor.idProduct == USB_BRICK_PRODUCT_ID) {
@@ -356,7 +1135,9 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		}
 
 		// open device
+		usb_stack_lock_events(event_mutex);
 		rc = libusb_open(device, &usb_stack->device_handle);
+		usb_stack_unlock_events(event_mutex);
 
 		if (rc < 0) {
 			log_warn("Could not open %s, ignoring USB device: %s (%d)",
@@ -378,7 +1159,7 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 
 	log_debug("Found %s", usb_stack->base.name);
 
-	phase = 3;
+	phase = 1;
 
 	// get interface endpoints
 	rc = usb_get_interface_endpoints(usb_stack->device_handle, usb_stack->interface_number,
@@ -418,13 +1199,17 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 #ifdef __APPLE__
 			device = libusb_get_device(usb_stack->device_handle);
 
+			usb_stack_lock_events(event_mutex);
 			libusb_close(usb_stack->device_handle);
+			usb_stack_unlock_events(event_mutex);
 #endif
 
 			millisleep(50);
 
 #ifdef __APPLE__
+			usb_stack_lock_events(event_mutex);
 			rc = libusb_open(device, &usb_stack->device_handle);
+			usb_stack_unlock_events(event_mutex);
 
 			if (rc < 0) {
 				log_error("Could not reopen %s: %s (%d)",
@@ -453,9 +1238,11 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		          usb_stack->interface_number, usb_stack->base.name);
 	}
 
-	phase = 4;
+	phase = 2;
 
 	// update stack name
+	string_copy(preliminary_name, sizeof(preliminary_name), usb_stack->base.name, -1);
+
 	if (usb_get_device_name(usb_stack->device_handle, usb_stack->base.name,
 	                        sizeof(usb_stack->base.name)) < 0) {
 		goto cleanup;
@@ -464,6 +1251,36 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 	log_debug("Got display name for %s: %s",
 	          preliminary_name, usb_stack->base.name);
 
+	phase = 3;
+
+cleanup:
+	switch (phase) { // no breaks, all cases fall through intentionally
+	case 2:
+		libusb_release_interface(usb_stack->device_handle, usb_stack->interface_number);
+		// fall through
+
+	case 1:
+		usb_stack_lock_events(event_mutex);
+		libusb_close(usb_stack->device_handle);
+		usb_stack_unlock_events(event_mutex);
+
+		usb_stack->device_handle = NULL;
+		// fall through
+
+	default:
+		break;
+	}
+
+	return phase == 3 ? 0 : -1;
+}
+
+int usb_stack_complete(USBStack *usb_stack) {
+	int phase = 0;
+	int i;
+	USBTransfer *usb_transfer;
+	int max_read_transfers = config_get_option_value("usb.read_transfers")->integer;
+	int max_write_transfers = config_get_option_value("usb.write_transfers")->integer;
+
 	// create stall timer
 	if (timer_create_(&usb_stack->stall_timer, usb_stack_handle_stall, usb_stack) < 0) {
 		log_error("Could not create stall timer for %s: %s (%d)",
@@ -472,10 +1289,17 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		goto cleanup;
 	}
 
-	phase = 5;
+	phase = 1;
+
+#ifdef BRICKD_WITH_USBFS
+	// falls back to libusb if the usbfs file descriptor cannot be used
+	if (config_get_option_value("usb.usbfs")->boolean) {
+		usb_usbfs_attach(usb_stack);
+	}
+#endif
 
 	// allocate and submit read transfers
-	if (array_create(&usb_stack->read_transfers, MAX_READ_TRANSFERS,
+	if (array_create(&usb_stack->read_transfers, max_read_transfers,
 	                 sizeof(USBTransfer), true) < 0) {
 		log_error("Could not create read transfer array for %s: %s (%d)",
 		          usb_stack->base.name, get_errno_name(errno), errno);
@@ -483,11 +1307,11 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		goto cleanup;
 	}
 
-	phase = 6;
+	phase = 2;
 
 	log_debug("Submitting read transfers to %s", usb_stack->base.name);
 
-	for (i = 0; i < MAX_READ_TRANSFERS; ++i) {
+	for (i = 0; i < max_read_transfers; ++i) {
 		usb_transfer = array_append(&usb_stack->read_transfers);
 
 		if (usb_transfer == NULL) {
@@ -505,23 +1329,34 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 			goto cleanup;
 		}
 
-		if (usb_transfer_submit(usb_transfer) < 0) {
+		if (i < usb_stack->read_transfer_target &&
+		    usb_transfer_submit(usb_transfer) < 0) {
 			goto cleanup;
 		}
 	}
 
-	// allocate write queue
-	if (queue_create(&usb_stack->write_queue, sizeof(Packet)) < 0) {
+	// allocate write queues. the buffers are allocated on first use, the
+	// maximum size is large enough to hold MAX_QUEUED_WRITES in each lane
+	packet_ring_create(&usb_stack->high_priority_write_queue,
+	                   MAX_QUEUED_WRITES * MAX_HIGH_PRIORITY_REQUEST_LENGTH);
+
+	if (fair_queue_create(&usb_stack->write_queue, sizeof(Packet), 0) < 0) {
 		log_error("Could not create write queue for %s: %s (%d)",
 		          usb_stack->base.name, get_errno_name(errno), errno);
 
+		packet_ring_destroy(&usb_stack->high_priority_write_queue);
+
 		goto cleanup;
 	}
 
-	phase = 7;
+	usb_stack->high_priority_writes_in_a_row = 0;
+
+	memset(usb_stack->low_priority_uid_counts, 0, sizeof(usb_stack->low_priority_uid_counts));
+
+	phase = 3;
 
 	// allocate write transfers
-	if (array_create(&usb_stack->write_transfers, MAX_WRITE_TRANSFERS,
+	if (array_create(&usb_stack->write_transfers, max_write_transfers,
 	                 sizeof(USBTransfer), true) < 0) {
 		log_error("Could not create write transfer array for %s: %s (%d)",
 		          usb_stack->base.name, get_errno_name(errno), errno);
@@ -529,9 +1364,9 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		goto cleanup;
 	}
 
-	phase = 8;
+	phase = 4;
 
-	for (i = 0; i < MAX_WRITE_TRANSFERS; ++i) {
+	for (i = 0; i < max_write_transfers; ++i) {
 		usb_transfer = array_append(&usb_stack->write_transfers);
 
 		if (usb_transfer == NULL) {
@@ -555,47 +1390,71 @@ int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_add
 		goto cleanup;
 	}
 
-	phase = 9;
+	phase = 5;
+
+#ifdef BRICKD_WITH_USB_THREAD
+	// the USB thread handles libusb events, it has nothing to do if the
+	// transfers bypass libusb
+	if (config_get_option_value("usb.dedicated_thread")->boolean
+#ifdef BRICKD_WITH_USBFS
+	    && usb_stack->usbfs_fd < 0
+#endif
+	    ) {
+		usb_stack_start_usb_thread(usb_stack);
+	}
+#endif
 
 cleanup:
 	switch (phase) { // no breaks, all cases fall through intentionally
-	case 8:
+	case 4:
 		array_destroy(&usb_stack->write_transfers, (ItemDestroyFunction)usb_transfer_destroy);
 		// fall through
 
-	case 7:
-		queue_destroy(&usb_stack->write_queue, NULL);
+	case 3:
+		fair_queue_destroy(&usb_stack->write_queue, NULL);
+		packet_ring_destroy(&usb_stack->high_priority_write_queue);
 		// fall through
 
-	case 6:
+	case 2:
 		array_destroy(&usb_stack->read_transfers, (ItemDestroyFunction)usb_transfer_destroy);
 		// fall through
 
-	case 5:
+	case 1:
 		timer_destroy(&usb_stack->stall_timer);
 		// fall through
 
-	case 4:
-		libusb_release_interface(usb_stack->device_handle, usb_stack->interface_number);
-		// fall through
+	default:
+		break;
+	}
 
-	case 3:
-		libusb_close(usb_stack->device_handle);
-		// fall through
+	if (phase == 5) {
+		return 0;
+	}
 
-	case 2:
-		usb_destroy_context(usb_stack->context);
-		// fall through
+#ifdef BRICKD_WITH_USBFS
+	usb_usbfs_detach(usb_stack);
+#endif
 
-	case 1:
-		stack_destroy(&usb_stack->base);
-		// fall through
+	libusb_release_interface(usb_stack->device_handle, usb_stack->interface_number);
+	libusb_close(usb_stack->device_handle);
 
-	default:
-		break;
+	usb_stack_abort(usb_stack);
+
+	return -1;
+}
+
+int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_address) {
+	if (usb_stack_prepare(usb_stack, bus_number, device_address) < 0) {
+		return -1;
 	}
 
-	return phase == 9 ? 0 : -1;
+	if (usb_stack_open(usb_stack, NULL) < 0) {
+		usb_stack_abort(usb_stack);
+
+		return -1;
+	}
+
+	return usb_stack_complete(usb_stack);
 }
 
 void usb_stack_destroy(USBStack *usb_stack) {
@@ -603,6 +1462,10 @@ void usb_stack_destroy(USBStack *usb_stack) {
 
 	usb_stack->expecting_disconnect = true;
 
+#ifdef BRICKD_WITH_USB_THREAD
+	usb_stack_stop_usb_thread(usb_stack);
+#endif
+
 	hardware_remove_stack(&usb_stack->base);
 
 	array_destroy(&usb_stack->read_transfers, (ItemDestroyFunction)usb_transfer_destroy);
@@ -610,7 +1473,18 @@ void usb_stack_destroy(USBStack *usb_stack) {
 
 	timer_destroy(&usb_stack->stall_timer);
 
-	queue_destroy(&usb_stack->write_queue, NULL);
+	if (usb_stack->high_priority_write_queue.peak_used > 0) {
+		log_debug("High priority write queue for %s used up to %u of %u byte(s)",
+		          usb_stack->base.name, usb_stack->high_priority_write_queue.peak_used,
+		          usb_stack->high_priority_write_queue.size);
+	}
+
+	packet_ring_destroy(&usb_stack->high_priority_write_queue);
+	fair_queue_destroy(&usb_stack->write_queue, NULL);
+
+#ifdef BRICKD_WITH_USBFS
+	usb_usbfs_detach(usb_stack);
+#endif
 
 	libusb_release_interface(usb_stack->device_handle, usb_stack->interface_number);
 
@@ -634,3 +1508,12 @@ void usb_stack_start_stall_timer(USBStack *usb_stack) {
 		return;
 	}
 }
+
+// bytes currently allocated for the transfers and the write queues. the write
+// queue counts full Packet slots, the high priority ring its whole buffer
+uint32_t usb_stack_get_memory_usage(USBStack *usb_stack) {
+	return sizeof(USBStack) +
+	       (uint32_t)(usb_stack->read_transfers.count + usb_stack->write_transfers.count) * sizeof(USBTransfer) +
+	       (uint32_t)usb_stack->write_queue.count * sizeof(Packet) +
+	       usb_stack->high_priority_write_queue.size;
+}
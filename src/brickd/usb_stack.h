@@ -26,11 +26,45 @@
 #include <stdbool.h>
 
 #include <daemonlib/array.h>
-#include <daemonlib/queue.h>
+#include <daemonlib/threads.h>
 #include <daemonlib/timer.h>
 
+#include "fair_queue.h"
+#include "packet_ring.h"
+#ifdef BRICKD_WITH_USB_THREAD
+	#include <daemonlib/pipe.h>
+
+	#include "spsc_ring.h"
+#endif
 #include "stack.h"
 
+#define USB_STACK_LOW_PRIORITY_UID_BUCKETS_BITS 6
+#define USB_STACK_LOW_PRIORITY_UID_BUCKETS (1 << USB_STACK_LOW_PRIORITY_UID_BUCKETS_BITS)
+#define USB_STACK_LATENCY_BUCKETS 8
+#define USB_STACK_MAX_TIMED_REQUESTS 32
+
+// bucket 0 counts latencies below 1 millisecond, bucket i counts latencies
+// from 2^(i-1) up to 2^i milliseconds and the last bucket counts everything
+// from 2^(USB_STACK_LATENCY_BUCKETS-2) milliseconds upwards
+typedef struct {
+	uint32_t packets_in; // valid responses
+	uint32_t packets_out; // submitted requests
+	uint32_t bytes_in; // wraps around
+	uint32_t bytes_out; // wraps around
+	uint32_t peak_queued_writes; // for both write queues together
+	uint32_t dropped_requests;
+	uint32_t submit_failures;
+	uint32_t stall_recoveries;
+	uint32_t latency_histogram[USB_STACK_LATENCY_BUCKETS];
+} USBStackStatistics;
+
+typedef struct {
+	uint32_t uid;
+	uint8_t function_id;
+	uint8_t sequence_number;
+	uint64_t submitted; // microseconds, 0 if the slot is unused
+} USBStackTimedRequest;
+
 typedef struct {
 	Stack base;
 
@@ -42,19 +76,57 @@ typedef struct {
 	uint8_t endpoint_in;
 	uint8_t endpoint_out;
 	Timer stall_timer;
+	int stall_recovery_attempts; // since the last successfully completed transfer
 	Array read_transfers;
+	int read_transfer_target; // number of read transfers to keep submitted
+	int read_transfers_to_idle; // read transfers not to resubmit on completion
+	bool adaptive_read_transfers;
+	uint32_t read_completions; // in the current adaption interval
+	uint64_t adaption_start; // microseconds
 	Array write_transfers;
-	Queue write_queue;
-	uint32_t dropped_requests;
+	PacketRing high_priority_write_queue; // small requests that expect a response
+	FairQueue write_queue; // all other requests, scheduled fairly between clients
+	int high_priority_writes_in_a_row;
+	uint16_t low_priority_uid_counts[USB_STACK_LOW_PRIORITY_UID_BUCKETS];
+	USBStackStatistics statistics;
+	USBStackTimedRequest timed_requests[USB_STACK_MAX_TIMED_REQUESTS];
+	int next_timed_request;
 	bool connected;
 	bool expecting_short_Ax_response;
 	bool expecting_read_stall_before_removal;
 	bool expecting_disconnect;
+#ifdef BRICKD_WITH_USB_THREAD
+	// if the USB thread is active then it handles the libusb events of the
+	// per-device context and forwards completed transfers to the event thread
+	bool usb_thread_active; // only changed while the USB thread is not running
+	uint32_t usb_thread_stopping; // accessed atomically
+	Thread usb_thread;
+	SPSCRing completions; // from the USB thread to the event thread
+	uint32_t max_forwarded_responses;
+	Pipe completion_pipe;
+	uint32_t completion_pending; // accessed atomically
+#endif
+#ifdef BRICKD_WITH_USBFS
+	int usbfs_fd; // -1 if the transfers go through libusb
+	bool usbfs_polling;
+#endif
 } USBStack;
 
 int usb_stack_create(USBStack *usb_stack, uint8_t bus_number, uint8_t device_address);
+int usb_stack_prepare(USBStack *usb_stack, uint8_t bus_number, uint8_t device_address);
+int usb_stack_open(USBStack *usb_stack, Mutex *event_mutex);
+int usb_stack_complete(USBStack *usb_stack);
+void usb_stack_abort(USBStack *usb_stack);
 void usb_stack_destroy(USBStack *usb_stack);
 
 void usb_stack_start_stall_timer(USBStack *usb_stack);
 
+uint32_t usb_stack_get_memory_usage(USBStack *usb_stack);
+
+#ifdef BRICKD_WITH_USB_THREAD
+struct _USBTransfer;
+
+void usb_stack_forward_completion(struct _USBTransfer *usb_transfer);
+#endif
+
 #endif // BRICKD_USB_STACK_H
@@ -19,15 +19,20 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <errno.h>
 #include <libusb.h>
 #include <time.h>
 
 #include <daemonlib/log.h>
+#include <daemonlib/utils.h>
 
 #include "usb_transfer.h"
 
 #include "stack.h"
 #include "usb.h"
+#ifdef BRICKD_WITH_USBFS
+	#include "usb_usbfs.h"
+#endif
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
@@ -56,8 +61,8 @@ static const char *usb_transfer_get_status_name(int usb_transfer_status) {
 	}
 }
 
-static void LIBUSB_CALL usb_transfer_wrapper(struct libusb_transfer *handle) {
-	USBTransfer *usb_transfer = handle->user_data;
+void usb_transfer_complete(USBTransfer *usb_transfer) {
+	struct libusb_transfer *handle = usb_transfer->handle;
 
 	if (!usb_transfer->submitted) {
 		log_error("%s transfer %p (%p) returned from %s, but was not submitted before",
@@ -108,6 +113,8 @@ static void LIBUSB_CALL usb_transfer_wrapper(struct libusb_transfer *handle) {
 			          usb_transfer_get_type_name(usb_transfer->type, true),
 			          usb_transfer, handle, usb_transfer->usb_stack->base.name);
 
+			usb_transfer->stalled = true;
+
 			usb_stack_start_stall_timer(usb_transfer->usb_stack);
 		}
 
@@ -132,6 +139,8 @@ static void LIBUSB_CALL usb_transfer_wrapper(struct libusb_transfer *handle) {
 			return;
 		}
 
+		usb_transfer->usb_stack->stall_recovery_attempts = 0;
+
 		if (usb_transfer->function != NULL) {
 			usb_transfer->function(usb_transfer);
 		}
@@ -140,17 +149,39 @@ static void LIBUSB_CALL usb_transfer_wrapper(struct libusb_transfer *handle) {
 	if (usb_transfer->type == USB_TRANSFER_TYPE_READ &&
 	    !usb_transfer->cancelled &&
 	    !usb_transfer->usb_stack->expecting_disconnect) {
-		usb_transfer_submit(usb_transfer);
+		if (usb_transfer->usb_stack->read_transfers_to_idle > 0) {
+			// the number of read transfers to keep submitted shrank
+			--usb_transfer->usb_stack->read_transfers_to_idle;
+		} else {
+			usb_transfer_submit(usb_transfer);
+		}
 	}
 }
 
+static void LIBUSB_CALL usb_transfer_wrapper(struct libusb_transfer *handle) {
+	USBTransfer *usb_transfer = handle->user_data;
+
+#ifdef BRICKD_WITH_USB_THREAD
+	// called on the USB thread, the event thread completes the transfer later
+	if (usb_transfer->usb_stack->usb_thread_active) {
+		usb_stack_forward_completion(usb_transfer);
+
+		return;
+	}
+#endif
+
+	usb_transfer_complete(usb_transfer);
+}
+
 int usb_transfer_create(USBTransfer *usb_transfer, USBStack *usb_stack,
                         USBTransferType type, USBTransferFunction function) {
 	usb_transfer->usb_stack = usb_stack;
 	usb_transfer->type = type;
 	usb_transfer->submitted = false;
 	usb_transfer->cancelled = false;
+	usb_transfer->stalled = false;
 	usb_transfer->function = function;
+	usb_transfer->response_buffer = NULL;
 	usb_transfer->handle = libusb_alloc_transfer(0);
 
 	if (usb_transfer->handle == NULL) {
@@ -174,7 +205,23 @@ void usb_transfer_destroy(USBTransfer *usb_transfer) {
 	          usb_transfer_get_type_name(usb_transfer->type, false), usb_transfer,
 	          usb_transfer->handle, usb_transfer->usb_stack->base.name);
 
-	if (usb_transfer->submitted) {
+#ifdef BRICKD_WITH_USBFS
+	if (usb_transfer->submitted && usb_transfer->usb_stack->usbfs_fd >= 0) {
+		usb_transfer->cancelled = true;
+
+		usb_usbfs_cancel_transfer(usb_transfer);
+
+		if (usb_transfer->submitted) {
+			log_warn("Attempt to cancel pending %s transfer %p (%p) for %s timed out",
+			         usb_transfer_get_type_name(usb_transfer->type, false), usb_transfer,
+			         usb_transfer->handle, usb_transfer->usb_stack->base.name);
+		}
+	}
+#endif
+
+	// the cancelled flag is only set in this function, if it's still unset
+	// then the transfer was submitted through libusb
+	if (usb_transfer->submitted && !usb_transfer->cancelled) {
 		usb_transfer->cancelled = true;
 
 		rc = libusb_cancel_transfer(usb_transfer->handle);
@@ -226,6 +273,10 @@ void usb_transfer_destroy(USBTransfer *usb_transfer) {
 
 	if (!usb_transfer->submitted) {
 		libusb_free_transfer(usb_transfer->handle);
+
+		if (usb_transfer->response_buffer != NULL) {
+			usb_unref_response_buffer(usb_transfer->response_buffer);
+		}
 	} else {
 		log_warn("Leaking pending %s transfer %p (%p) for %s",
 		         usb_transfer_get_type_name(usb_transfer->type, false), usb_transfer,
@@ -235,6 +286,7 @@ void usb_transfer_destroy(USBTransfer *usb_transfer) {
 
 int usb_transfer_submit(USBTransfer *usb_transfer) {
 	uint8_t endpoint;
+	unsigned char *buffer;
 	int length;
 	int rc;
 
@@ -248,12 +300,29 @@ int usb_transfer_submit(USBTransfer *usb_transfer) {
 
 	switch (usb_transfer->type) {
 	case USB_TRANSFER_TYPE_READ:
+		// the previous buffer might still be referenced by the dispatch
+		// pipeline, then the read transfer uses a fresh one
+		if (usb_transfer->response_buffer == NULL) {
+			usb_transfer->response_buffer = usb_acquire_response_buffer();
+
+			if (usb_transfer->response_buffer == NULL) {
+				log_error("Could not acquire response buffer for read transfer %p (%p) to %s: %s (%d)",
+				          usb_transfer, usb_transfer->handle,
+				          usb_transfer->usb_stack->base.name,
+				          get_errno_name(errno), errno);
+
+				return -1;
+			}
+		}
+
 		endpoint = usb_transfer->usb_stack->endpoint_in;
+		buffer = (unsigned char *)&usb_transfer->response_buffer->packet;
 		length = sizeof(Packet);
 		break;
 
 	case USB_TRANSFER_TYPE_WRITE:
 		endpoint = usb_transfer->usb_stack->endpoint_out;
+		buffer = (unsigned char *)&usb_transfer->packet;
 		length = usb_transfer->packet.header.length;
 		break;
 
@@ -266,10 +335,34 @@ int usb_transfer_submit(USBTransfer *usb_transfer) {
 
 	usb_transfer->submitted = true;
 
+#ifdef BRICKD_WITH_USBFS
+	if (usb_transfer->usb_stack->usbfs_fd >= 0) {
+		if (usb_usbfs_submit_transfer(usb_transfer, endpoint, buffer, length) < 0) {
+			log_error("Could not submit %s transfer %p (%p) to %s: %s (%d)",
+			          usb_transfer_get_type_name(usb_transfer->type, false), usb_transfer,
+			          usb_transfer->handle, usb_transfer->usb_stack->base.name,
+			          get_errno_name(errno), errno);
+
+			usb_transfer->submitted = false;
+
+			++usb_transfer->usb_stack->statistics.submit_failures;
+
+			return -1;
+		}
+
+		log_packet_debug("Submitted %s transfer %p (%p) for %u bytes to %s as URB",
+		                 usb_transfer_get_type_name(usb_transfer->type, false),
+		                 usb_transfer, usb_transfer->handle, length,
+		                 usb_transfer->usb_stack->base.name);
+
+		return 0;
+	}
+#endif
+
 	libusb_fill_bulk_transfer(usb_transfer->handle,
 	                          usb_transfer->usb_stack->device_handle,
 	                          endpoint,
-	                          (unsigned char *)&usb_transfer->packet,
+	                          buffer,
 	                          length,
 	                          usb_transfer_wrapper,
 	                          usb_transfer,
@@ -285,6 +378,8 @@ int usb_transfer_submit(USBTransfer *usb_transfer) {
 
 		usb_transfer->submitted = false;
 
+		++usb_transfer->usb_stack->statistics.submit_failures;
+
 		return -1;
 	}
 
@@ -24,9 +24,13 @@
 
 #include <libusb.h>
 #include <stdbool.h>
+#ifdef BRICKD_WITH_USBFS
+	#include <linux/usbdevice_fs.h>
+#endif
 
 #include <daemonlib/packet.h>
 
+#include "usb.h"
 #include "usb_stack.h"
 
 typedef enum {
@@ -43,9 +47,14 @@ struct _USBTransfer {
 	USBTransferType type;
 	bool submitted;
 	bool cancelled;
+	bool stalled; // waiting for the halt condition to be cleared
 	USBTransferFunction function;
 	struct libusb_transfer *handle;
-	Packet packet;
+	Packet packet; // write transfers only
+	USBResponseBuffer *response_buffer; // read transfers only
+#ifdef BRICKD_WITH_USBFS
+	struct usbdevfs_urb urb; // if the USB stack uses usbfs directly
+#endif
 };
 
 int usb_transfer_create(USBTransfer *usb_transfer, USBStack *usb_stack,
@@ -53,5 +62,6 @@ int usb_transfer_create(USBTransfer *usb_transfer, USBStack *usb_stack,
 void usb_transfer_destroy(USBTransfer *usb_transfer);
 
 int usb_transfer_submit(USBTransfer *usb_transfer);
+void usb_transfer_complete(USBTransfer *usb_transfer);
 
 #endif // BRICKD_USB_TRANSFER_H
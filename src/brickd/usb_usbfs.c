@@ -0,0 +1,303 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * usb_usbfs.c: Direct usbfs transport for the transfers of USB stacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * submits the bulk transfers of a USB stack directly to the kernel as usbfs
+ * URBs, instead of going through libusb. libusb still opens the device, claims
+ * the interface and does the synchronous control requests, the URBs are
+ * submitted on the same file descriptor. while attached, the libusb context
+ * of the USB stack is detached from the event loop, so libusb never reaps the
+ * URBs submitted here. the event loop watches the file descriptor for writability
+ * instead, which usbfs signals while completed URBs are waiting, and all of
+ * them are reaped in one go with USBDEVFS_REAPURBNDELAY.
+ */
+
+#include <errno.h>
+#include <libusb.h>
+#include <linux/usbdevice_fs.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <daemonlib/event.h>
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "usb_usbfs.h"
+
+#include "event_profile.h"
+#include "usb.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+// upper bound for the URBs reaped per event, so a busy device doesn't starve
+// the other event sources. remaining URBs keep the descriptor writable
+#define MAX_REAPED_URBS_PER_EVENT 64
+
+#define CANCEL_TIMEOUT 1000 // milliseconds
+
+// character device major of the usbfs device nodes, their minor is derived
+// from the bus number and the device address
+#define USBFS_DEVICE_MAJOR 189
+
+static int usb_usbfs_get_transfer_status(int urb_status) {
+	switch (urb_status) {
+	case 0:           return LIBUSB_TRANSFER_COMPLETED;
+	case -ENOENT:
+	case -ECONNRESET: return LIBUSB_TRANSFER_CANCELLED;
+	case -EPIPE:      return LIBUSB_TRANSFER_STALL;
+	case -ENODEV:
+	case -ESHUTDOWN:  return LIBUSB_TRANSFER_NO_DEVICE;
+	case -EOVERFLOW:  return LIBUSB_TRANSFER_OVERFLOW;
+	case -ETIMEDOUT:  return LIBUSB_TRANSFER_TIMED_OUT;
+
+	default:          return LIBUSB_TRANSFER_ERROR;
+	}
+}
+
+// libusb adds the file descriptor of an open usbfs device to the pollfds of
+// its context with POLLOUT, all other pollfds are internal pipes and timers
+// that are polled for POLLIN. libusb has no public API to get the file
+// descriptor of a device handle. therefore, a POLLOUT pollfd is only taken if
+// it is the device node of the device of the handle. anything else than
+// exactly one such pollfd makes the caller fall back to libusb
+static int usb_usbfs_find_device_fd(libusb_context *context,
+                                    libusb_device_handle *device_handle) {
+	libusb_device *device = libusb_get_device(device_handle);
+	dev_t rdev = makedev(USBFS_DEVICE_MAJOR,
+	                     (libusb_get_bus_number(device) - 1) * 128 +
+	                     libusb_get_device_address(device) - 1);
+	const struct libusb_pollfd **pollfds;
+	const struct libusb_pollfd **pollfd;
+	struct stat st;
+	int fd = -1;
+	int count = 0;
+
+	pollfds = libusb_get_pollfds(context);
+
+	if (pollfds == NULL) {
+		log_error("Could not get pollfds from libusb context");
+
+		return -1;
+	}
+
+	for (pollfd = pollfds; *pollfd != NULL; ++pollfd) {
+		if (((*pollfd)->events & POLLOUT) == 0) {
+			continue;
+		}
+
+		if (fstat((*pollfd)->fd, &st) < 0 || !S_ISCHR(st.st_mode) || st.st_rdev != rdev) {
+			log_debug("Ignoring pollfd %d of libusb context, it is not the usbfs device node",
+			          (*pollfd)->fd);
+
+			continue;
+		}
+
+		fd = (*pollfd)->fd;
+		++count;
+	}
+
+#if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000104 // libusb 1.0.20
+	libusb_free_pollfds(pollfds);
+#else
+	free(pollfds);
+#endif
+
+	if (count > 1) {
+		log_debug("Found %d pollfds for the same usbfs device node", count);
+	}
+
+	return count == 1 ? fd : -1;
+}
+
+static void usb_usbfs_stop_polling(USBStack *usb_stack) {
+	if (usb_stack->usbfs_polling) {
+		event_remove_source(usb_stack->usbfs_fd, EVENT_SOURCE_TYPE_GENERIC);
+
+		usb_stack->usbfs_polling = false;
+	}
+}
+
+// returns the number of reaped URBs, or -1 if the device is gone
+static int usb_usbfs_reap(USBStack *usb_stack, int max_urbs) {
+	struct usbdevfs_urb *urb;
+	USBTransfer *usb_transfer;
+	int count = 0;
+
+	while (count < max_urbs) {
+		if (ioctl(usb_stack->usbfs_fd, USBDEVFS_REAPURBNDELAY, &urb) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno == EAGAIN) {
+				break;
+			}
+
+			if (errno == ENODEV) {
+				// all completed URBs are reaped before this is reported
+				log_debug("%s got disconnected, stopping to reap URBs",
+				          usb_stack->base.name);
+
+				usb_stack->expecting_disconnect = true;
+
+				usb_usbfs_stop_polling(usb_stack);
+
+				return -1;
+			}
+
+			log_error("Could not reap URB from %s: %s (%d)",
+			          usb_stack->base.name, get_errno_name(errno), errno);
+
+			break;
+		}
+
+		usb_transfer = urb->usercontext;
+
+		// fill in the libusb transfer, so the completion is handled the same
+		// way for both transports
+		usb_transfer->handle->status = usb_usbfs_get_transfer_status(urb->status);
+		usb_transfer->handle->actual_length = urb->actual_length;
+
+		++count;
+
+		usb_transfer_complete(usb_transfer);
+	}
+
+	return count;
+}
+
+static void usb_usbfs_handle_urbs(void *opaque) {
+	usb_usbfs_reap(opaque, MAX_REAPED_URBS_PER_EVENT);
+}
+
+EVENT_PROFILE_HANDLER(usb_usbfs_handle_urbs, "usbfs")
+
+// has to be called before the first transfer is submitted. returns -1 if the
+// USB stack has to keep using libusb for its transfers
+int usb_usbfs_attach(USBStack *usb_stack) {
+	int fd = usb_usbfs_find_device_fd(usb_stack->context, usb_stack->device_handle);
+
+	if (fd < 0) {
+		log_warn("Could not find usbfs file descriptor of %s, using libusb for its transfers",
+		         usb_stack->base.name);
+
+		return -1;
+	}
+
+	usb_detach_context(usb_stack->context);
+
+	// usbfs reports POLLERR and POLLHUP after a disconnect, the handler has
+	// to see them to remove the event source
+	if (event_add_source(fd, EVENT_SOURCE_TYPE_GENERIC, EVENT_WRITE | EVENT_ERROR,
+	                     EVENT_PROFILED(usb_usbfs_handle_urbs), usb_stack) < 0) {
+		if (usb_attach_context(usb_stack->context) < 0) {
+			log_error("Could not reattach libusb context of %s to the event loop",
+			          usb_stack->base.name);
+		}
+
+		return -1;
+	}
+
+	usb_stack->usbfs_fd = fd;
+	usb_stack->usbfs_polling = true;
+
+	log_debug("Using usbfs file descriptor %d for transfers of %s",
+	          fd, usb_stack->base.name);
+
+	return 0;
+}
+
+// has to be called after all transfers are destroyed, so libusb can handle
+// the events of the device again while it gets closed
+void usb_usbfs_detach(USBStack *usb_stack) {
+	if (usb_stack->usbfs_fd < 0) {
+		return;
+	}
+
+	usb_usbfs_stop_polling(usb_stack);
+
+	usb_stack->usbfs_fd = -1;
+
+	if (usb_attach_context(usb_stack->context) < 0) {
+		log_error("Could not reattach libusb context of %s to the event loop",
+		          usb_stack->base.name);
+	}
+}
+
+// sets errno on error
+int usb_usbfs_submit_transfer(USBTransfer *usb_transfer, uint8_t endpoint,
+                              unsigned char *buffer, int length) {
+	struct usbdevfs_urb *urb = &usb_transfer->urb;
+
+	memset(urb, 0, sizeof(*urb));
+
+	urb->type = USBDEVFS_URB_TYPE_BULK;
+	urb->endpoint = endpoint;
+	urb->buffer = buffer;
+	urb->buffer_length = length;
+	urb->usercontext = usb_transfer;
+
+	return ioctl(usb_transfer->usb_stack->usbfs_fd, USBDEVFS_SUBMITURB, urb);
+}
+
+// discards the URB and reaps URBs until it is given back by the kernel. this
+// completes other transfers of the USB stack as well, they see the cancelled
+// flag of the transfer or the expecting_disconnect flag of the USB stack
+void usb_usbfs_cancel_transfer(USBTransfer *usb_transfer) {
+	USBStack *usb_stack = usb_transfer->usb_stack;
+	uint64_t deadline = microseconds() + CANCEL_TIMEOUT * 1000;
+	struct pollfd pollfd;
+	uint64_t now;
+
+	// fails with EINVAL if the URB already completed but is not reaped yet
+	if (ioctl(usb_stack->usbfs_fd, USBDEVFS_DISCARDURB, &usb_transfer->urb) < 0 &&
+	    errno != EINVAL && errno != ENODEV) {
+		log_warn("Could not discard URB of %s: %s (%d)",
+		         usb_stack->base.name, get_errno_name(errno), errno);
+	}
+
+	pollfd.fd = usb_stack->usbfs_fd;
+	pollfd.events = POLLOUT;
+
+	while (usb_transfer->submitted) {
+		if (usb_usbfs_reap(usb_stack, INT32_MAX) < 0 || !usb_transfer->submitted) {
+			break;
+		}
+
+		now = microseconds();
+
+		if (now >= deadline) {
+			break;
+		}
+
+		if (poll(&pollfd, 1, (int)((deadline - now + 999) / 1000)) < 0 && errno != EINTR) {
+			log_error("Could not poll usbfs file descriptor of %s: %s (%d)",
+			          usb_stack->base.name, get_errno_name(errno), errno);
+
+			break;
+		}
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * usb_usbfs.h: Direct usbfs transport for the transfers of USB stacks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef BRICKD_USB_USBFS_H
+#define BRICKD_USB_USBFS_H
+
+#include <stdint.h>
+
+#include "usb_stack.h"
+#include "usb_transfer.h"
+
+int usb_usbfs_attach(USBStack *usb_stack);
+void usb_usbfs_detach(USBStack *usb_stack);
+
+int usb_usbfs_submit_transfer(USBTransfer *usb_transfer, uint8_t endpoint,
+                              unsigned char *buffer, int length);
+void usb_usbfs_cancel_transfer(USBTransfer *usb_transfer);
+
+#endif // BRICKD_USB_USBFS_H
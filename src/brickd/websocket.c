@@ -32,6 +32,9 @@
 
 #include "base64.h"
 #include "sha1.h"
+#ifdef BRICKD_WITH_ZLIB
+	#include "websocket_deflate.h"
+#endif
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
@@ -39,52 +42,6 @@ extern void socket_destroy_platform(Socket *socket);
 extern int socket_receive_platform(Socket *socket, void *buffer, int length);
 extern int socket_send_platform(Socket *socket, const void *buffer, int length);
 
-typedef struct {
-	void *buffer;
-	int length;
-} WebsocketQueuedData;
-
-static void websocket_free_queued_data(void *item) {
-	WebsocketQueuedData *queued_data = item;
-
-	free(queued_data->buffer);
-}
-
-static int websocket_send_frame(Websocket *websocket, const void *buffer, int length) {
-	WebsocketFrameWithPayload frame;
-
-	if (length > WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH) {
-		// currently length should never exceed 80 (the current maximum packet
-		// size). so this is just a safeguard for possible later changes to the
-		// maximum packet size that might require adjustments here.
-		errno = E2BIG;
-
-		return -1;
-	}
-
-	frame.header.opcode_rsv_fin = 0;
-	frame.header.payload_length_mask = 0;
-	websocket_frame_set_fin(&frame.header, 1);
-	websocket_frame_set_opcode(&frame.header, 2);
-	websocket_frame_set_mask(&frame.header, 0);
-	websocket_frame_set_payload_length(&frame.header, length);
-	memcpy(frame.payload_data, buffer, length);
-
-	return socket_send_platform((Socket *)websocket, &frame, sizeof(WebsocketFrameHeader) + length);
-}
-
-static void websocket_send_queued_data(Websocket *websocket) {
-	WebsocketQueuedData *queued_data;
-
-	while (websocket->send_queue.count > 0) {
-		queued_data = queue_peek(&websocket->send_queue);
-
-		websocket_send_frame(websocket, queued_data->buffer, queued_data->length);
-
-		queue_pop(&websocket->send_queue, websocket_free_queued_data);
-	}
-}
-
 int websocket_frame_get_opcode(WebsocketFrameHeader *header) {
 	return header->opcode_rsv_fin & 0xF;
 }
@@ -94,6 +51,15 @@ void websocket_frame_set_opcode(WebsocketFrameHeader *header, int opcode) {
 	header->opcode_rsv_fin |= opcode & 0xF;
 }
 
+int websocket_frame_get_rsv1(WebsocketFrameHeader *header) {
+	return (header->opcode_rsv_fin >> 6) & 0x1;
+}
+
+void websocket_frame_set_rsv1(WebsocketFrameHeader *header, int rsv1) {
+	header->opcode_rsv_fin &= ~(0x1 << 6);
+	header->opcode_rsv_fin |= (rsv1 << 6) & (0x1 << 6);
+}
+
 int websocket_frame_get_fin(WebsocketFrameHeader *header) {
 	return (header->opcode_rsv_fin >> 7) & 0x1;
 }
@@ -121,6 +87,334 @@ void websocket_frame_set_mask(WebsocketFrameHeader *header, int mask) {
 	header->payload_length_mask |= ((mask << 7) & (0x1 << 7));
 }
 
+// fills in an unmasked frame header and returns its length
+static int websocket_fill_header(uint8_t *header, int opcode, int payload_length) {
+	WebsocketFrameHeader *frame_header = (WebsocketFrameHeader *)header;
+	int i;
+
+	frame_header->opcode_rsv_fin = 0;
+	frame_header->payload_length_mask = 0;
+	websocket_frame_set_fin(frame_header, 1);
+	websocket_frame_set_opcode(frame_header, opcode);
+	websocket_frame_set_mask(frame_header, 0);
+
+	if (payload_length <= WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH) {
+		websocket_frame_set_payload_length(frame_header, payload_length);
+
+		return sizeof(WebsocketFrameHeader);
+	}
+
+	// extended payload lengths are in network byte order
+	if (payload_length <= WEBSOCKET_MAX_EXTENDED_PAYLOAD_DATA_LENGTH) {
+		websocket_frame_set_payload_length(frame_header, 126);
+
+		header[2] = (uint8_t)(payload_length >> 8);
+		header[3] = (uint8_t)payload_length;
+
+		return sizeof(WebsocketFrameHeader) + 2;
+	}
+
+	websocket_frame_set_payload_length(frame_header, 127);
+
+	for (i = 0; i < 8; ++i) {
+		header[2 + i] = (uint8_t)((uint64_t)payload_length >> (56 - i * 8));
+	}
+
+	return sizeof(WebsocketFrameHeader) + 8;
+}
+
+// sends the rest of a partially sent frame header or control frame
+static int websocket_send_unsent(Websocket *websocket) {
+	int rc;
+
+	while (websocket->unsent_offset < websocket->unsent_length) {
+		rc = socket_send_platform(&websocket->base, websocket->unsent + websocket->unsent_offset,
+		                          websocket->unsent_length - websocket->unsent_offset);
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		websocket->unsent_offset += rc;
+	}
+
+	websocket->unsent_length = 0;
+	websocket->unsent_offset = 0;
+
+	return 0;
+}
+
+// control frames cannot be sent while a data frame is only partially sent.
+// a pong is sent after the data frame then, a close frame is just skipped
+static int websocket_send_control_frame(Websocket *websocket, int opcode,
+                                        const uint8_t *payload, int length) {
+	int header_length;
+
+	if (websocket->unsent_length > 0 || websocket->unsent_payload_length > 0 ||
+	    websocket->compressed_unsent_length > 0) {
+		if (opcode == WEBSOCKET_OPCODE_PONG_FRAME) {
+			memcpy(websocket->pong_payload, payload, length);
+
+			websocket->pong_length = length;
+			websocket->pong_pending = true;
+		}
+
+		return 0;
+	}
+
+	header_length = websocket_fill_header(websocket->unsent, opcode, length);
+
+	memcpy(websocket->unsent + header_length, payload, length);
+
+	websocket->unsent_length = header_length + length;
+	websocket->unsent_offset = 0;
+
+	if (websocket_send_unsent(websocket) < 0 &&
+	    !errno_interrupted() && !errno_would_block()) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void websocket_finish_sent_frame(Websocket *websocket) {
+	if (!websocket->pong_pending) {
+		return;
+	}
+
+	websocket->pong_pending = false;
+
+	if (websocket_send_control_frame(websocket, WEBSOCKET_OPCODE_PONG_FRAME,
+	                                 websocket->pong_payload, websocket->pong_length) < 0) {
+		log_error("Could not send WebSocket pong: %s (%d)",
+		          get_errno_name(errno), errno);
+	}
+}
+
+#ifdef BRICKD_WITH_ZLIB
+
+// a compressed frame cannot be sent partially like an uncompressed one,
+// because its payload doesn't correspond to the data of the caller anymore.
+// if the socket accepts only a part of the frame then the rest is kept and at
+// least one byte of the data is not reported as sent, so the caller retries.
+// the retry sends the rest of the frame and reports the held back bytes as
+// sent then
+static int websocket_send_compressed_frame(Websocket *websocket, const void *buffer, int length) {
+	uint8_t header[WEBSOCKET_MAX_SERVER_HEADER_LENGTH];
+	int header_length;
+	uint8_t *payload;
+	int payload_length;
+	int reported;
+	int rc;
+
+	if (websocket_send_unsent(websocket) < 0) {
+		return -1;
+	}
+
+	if (websocket->compressed_unsent_length == 0 && websocket->held_back_length == 0) {
+		if (length <= 0) {
+			return 0;
+		}
+
+		payload = websocket_deflate_compress(websocket->compression, buffer, length,
+		                                     WEBSOCKET_MAX_SERVER_HEADER_LENGTH, &payload_length);
+
+		if (payload == NULL) {
+			return -1;
+		}
+
+		// the RSV1 bit marks the first frame of a compressed message
+		header_length = websocket_fill_header(header, WEBSOCKET_OPCODE_BINARY_FRAME, payload_length);
+		websocket_frame_set_rsv1((WebsocketFrameHeader *)header, 1);
+
+		memcpy(payload - header_length, header, header_length);
+
+		websocket->compressed_unsent = payload - header_length;
+		websocket->compressed_unsent_length = header_length + payload_length;
+		websocket->held_back_length = length;
+	}
+
+	if (websocket->compressed_unsent_length > 0) {
+		rc = socket_send_platform(&websocket->base, websocket->compressed_unsent,
+		                          websocket->compressed_unsent_length);
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		websocket->compressed_unsent += rc;
+		websocket->compressed_unsent_length -= rc;
+
+		if (websocket->compressed_unsent_length == 0) {
+			websocket_finish_sent_frame(websocket);
+		}
+	}
+
+	if (websocket->compressed_unsent_length > 0) {
+		reported = MIN(length, websocket->held_back_length - 1);
+	} else {
+		reported = MIN(length, websocket->held_back_length);
+	}
+
+	websocket->held_back_length -= reported;
+
+	return reported;
+}
+
+#endif
+
+// sends the data as one binary frame, so several packets can be batched into
+// one frame. a frame cannot be split by the caller, therefore if the socket
+// accepts only a part of the frame then the number of sent payload bytes is
+// returned and the rest of the payload is sent from the next call(s) without a
+// new header. a partially sent header is kept and completed first
+static int websocket_send_frame(Websocket *websocket, const void *buffer, int length) {
+	int header_length;
+	uint8_t *send_buffer;
+	int rc;
+
+#ifdef BRICKD_WITH_ZLIB
+	if (websocket->compression != NULL) {
+		return websocket_send_compressed_frame(websocket, buffer, length);
+	}
+#endif
+
+	if (websocket_send_unsent(websocket) < 0) {
+		return -1;
+	}
+
+	if (websocket->unsent_payload_length > 0) {
+		rc = socket_send_platform(&websocket->base, buffer, MIN(length, websocket->unsent_payload_length));
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		websocket->unsent_payload_length -= rc;
+
+		if (websocket->unsent_payload_length == 0) {
+			websocket_finish_sent_frame(websocket);
+		}
+
+		return rc;
+	}
+
+	if (websocket->send_buffer_size < WEBSOCKET_MAX_SERVER_HEADER_LENGTH + length) {
+		send_buffer = realloc(websocket->send_buffer, WEBSOCKET_MAX_SERVER_HEADER_LENGTH + length);
+
+		if (send_buffer == NULL) {
+			errno = ENOMEM;
+
+			return -1;
+		}
+
+		websocket->send_buffer = send_buffer;
+		websocket->send_buffer_size = WEBSOCKET_MAX_SERVER_HEADER_LENGTH + length;
+	}
+
+	header_length = websocket_fill_header(websocket->send_buffer, WEBSOCKET_OPCODE_BINARY_FRAME, length);
+
+	memcpy(websocket->send_buffer + header_length, buffer, length);
+
+	rc = socket_send_platform(&websocket->base, websocket->send_buffer, header_length + length);
+
+	if (rc < 0) {
+		return -1;
+	}
+
+	if (rc < header_length) {
+		memcpy(websocket->unsent, websocket->send_buffer + rc, header_length - rc);
+
+		websocket->unsent_length = header_length - rc;
+		websocket->unsent_offset = 0;
+		websocket->unsent_payload_length = length;
+
+		return 0;
+	}
+
+	websocket->unsent_payload_length = length - (rc - header_length);
+
+	if (websocket->unsent_payload_length == 0) {
+		websocket_finish_sent_frame(websocket);
+	}
+
+	return rc - header_length;
+}
+
+static void websocket_send_frame_completely(Websocket *websocket, const uint8_t *buffer, int length) {
+	int offset;
+	int rc;
+
+	for (offset = 0; offset < length; offset += rc) {
+		rc = websocket_send_frame(websocket, buffer + offset, length - offset);
+
+		if (rc < 0) {
+			break;
+		}
+	}
+}
+
+// with batching all queued data is sent as one frame, the length prefixes are
+// squeezed out for this. otherwise each piece of data gets its own frame
+static void websocket_send_queued_data(Websocket *websocket) {
+	int offset = 0;
+	int batched_length = 0;
+	int length;
+
+	while (offset < websocket->queued_data_used) {
+		memcpy(&length, websocket->queued_data + offset, sizeof(length));
+
+		offset += sizeof(length);
+
+		if (websocket->batching) {
+			memmove(websocket->queued_data + batched_length, websocket->queued_data + offset, length);
+
+			batched_length += length;
+		} else {
+			websocket_send_frame_completely(websocket, websocket->queued_data + offset, length);
+		}
+
+		offset += length;
+	}
+
+	if (batched_length > 0) {
+		websocket_send_frame_completely(websocket, websocket->queued_data, batched_length);
+	}
+
+	free(websocket->queued_data);
+
+	websocket->queued_data = NULL;
+	websocket->queued_data_used = 0;
+	websocket->queued_data_size = 0;
+}
+
+// checks if the comma separated list of subprotocols contains the protocol
+static bool websocket_has_protocol(const char *list, const char *protocol) {
+	int protocol_length = strlen(protocol);
+	const char *start;
+
+	while (*list != '\0') {
+		if (*list == ' ' || *list == '\t' || *list == ',' || *list == '\r' || *list == '\n') {
+			++list;
+
+			continue;
+		}
+
+		start = list;
+
+		while (*list != '\0' && *list != ' ' && *list != '\t' && *list != ',' &&
+		       *list != '\r' && *list != '\n') {
+			++list;
+		}
+
+		if (list - start == protocol_length && strncmp(start, protocol, protocol_length) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 int websocket_answer_handshake_error(Websocket *websocket) {
 	(void)socket_send_platform(&websocket->base, WEBSOCKET_ERROR_STRING, strlen(WEBSOCKET_ERROR_STRING));
 
@@ -142,7 +436,44 @@ int websocket_answer_handshake_ok(Websocket *websocket, char *key, int length) {
 		return ret;
 	}
 
-	ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_2, strlen(WEBSOCKET_ANSWER_STRING_2));
+	if (websocket->batching) {
+		ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_2_BATCHING,
+		                           strlen(WEBSOCKET_ANSWER_STRING_2_BATCHING));
+	} else {
+		ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_2,
+		                           strlen(WEBSOCKET_ANSWER_STRING_2));
+	}
+
+	if (ret < 0) {
+		return ret;
+	}
+
+#ifdef BRICKD_WITH_ZLIB
+	if (websocket->compression != NULL) {
+		ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_EXTENSIONS,
+		                           strlen(WEBSOCKET_ANSWER_STRING_EXTENSIONS));
+
+		if (ret < 0) {
+			return ret;
+		}
+
+		ret = socket_send_platform(&websocket->base, websocket->compression->response,
+		                           strlen(websocket->compression->response));
+
+		if (ret < 0) {
+			return ret;
+		}
+
+		ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_3,
+		                           strlen(WEBSOCKET_ANSWER_STRING_3));
+
+		if (ret < 0) {
+			return ret;
+		}
+	}
+#endif
+
+	ret = socket_send_platform(&websocket->base, WEBSOCKET_ANSWER_STRING_3, strlen(WEBSOCKET_ANSWER_STRING_3));
 
 	if (ret < 0) {
 		return ret;
@@ -191,10 +522,18 @@ int websocket_parse_handshake_line(Websocket *websocket, char *line, int length)
 
 			rc = websocket_answer_handshake_ok(websocket, base64, base64_length);
 
-			if (rc < 0) {
+			if (rc == -1) {
 				return rc;
 			}
 
+			if (websocket->batching) {
+				log_debug("WebSocket client negotiated batching");
+
+				if (websocket->batching_enabled != NULL) {
+					websocket->batching_enabled(websocket->batching_opaque);
+				}
+			}
+
 			websocket_send_queued_data(websocket);
 
 			return IO_CONTINUE;
@@ -203,6 +542,28 @@ int websocket_parse_handshake_line(Websocket *websocket, char *line, int length)
 		}
 	}
 
+	// Find "Sec-WebSocket-Protocol", the client can opt in to batching
+	if (strcasestr(line, WEBSOCKET_CLIENT_PROTOCOL_STRING) != NULL) {
+		if (websocket_has_protocol(line + strlen(WEBSOCKET_CLIENT_PROTOCOL_STRING),
+		                           WEBSOCKET_BATCHING_PROTOCOL)) {
+			websocket->batching = true;
+		}
+
+		return IO_CONTINUE;
+	}
+
+#ifdef BRICKD_WITH_ZLIB
+	// Find "Sec-WebSocket-Extensions", the client can offer permessage-deflate.
+	// a line that was cut at WEBSOCKET_MAX_LINE_LENGTH is not parsed
+	if (strcasestr(line, WEBSOCKET_CLIENT_EXTENSIONS_STRING) != NULL) {
+		if (websocket->compression == NULL && line[length - 1] == '\n') {
+			websocket->compression = websocket_deflate_negotiate(line + strlen(WEBSOCKET_CLIENT_EXTENSIONS_STRING));
+		}
+
+		return IO_CONTINUE;
+	}
+#endif
+
 	// Find "Sec-WebSocket-Key"
 	if (strcasestr(line, WEBSOCKET_CLIENT_KEY_STRING) != NULL) {
 		memset(websocket->client_key, 0, WEBSOCKET_CLIENT_KEY_LENGTH);
@@ -251,146 +612,451 @@ int websocket_parse_handshake(Websocket *websocket, char *handshake_part, int le
 	return IO_CONTINUE;
 }
 
+static int websocket_get_header_length(Websocket *websocket) {
+	if (websocket->frame_index < (int)sizeof(WebsocketFrameHeader)) {
+		return sizeof(WebsocketFrameHeader);
+	}
+
+	switch (websocket_frame_get_payload_length(&websocket->frame.header)) {
+	case 126: return sizeof(WebsocketFrameExtended);
+	case 127: return sizeof(WebsocketFrameExtended2);
+	default:  return sizeof(WebsocketFrame);
+	}
+}
+
+static int websocket_finish_received_frame(Websocket *websocket) {
+	websocket->state = WEBSOCKET_STATE_HANDSHAKE_DONE;
+	websocket->mask_index = 0;
+
+	switch (websocket->opcode) {
+	case WEBSOCKET_OPCODE_CLOSE_FRAME:
+		log_debug("WebSocket opcode 'close frame'");
+
+		// answer with the status code of the client, the connection is
+		// closed anyway, so errors don't matter here
+		(void)websocket_send_control_frame(websocket, WEBSOCKET_OPCODE_CLOSE_FRAME,
+		                                   websocket->control_payload,
+		                                   MIN(websocket->control_length, 2));
+
+		websocket->state = WEBSOCKET_STATE_CLOSED;
+
+		return 0;
+
+	case WEBSOCKET_OPCODE_PING_FRAME:
+		log_packet_debug("WebSocket opcode 'ping', sending pong");
+
+		return websocket_send_control_frame(websocket, WEBSOCKET_OPCODE_PONG_FRAME,
+		                                    websocket->control_payload,
+		                                    websocket->control_length);
+
+	case WEBSOCKET_OPCODE_PONG_FRAME:
+		log_packet_debug("WebSocket opcode 'pong'");
+
+		return 0;
+
+	default:
+		// the client strips the trailer of the deflate stream from a
+		// compressed message, it has to be inflated after the last frame
+		if (websocket->compressed && !websocket->fragmented) {
+			websocket->compressed = false;
+			websocket->trailer_pending = true;
+			websocket->trailer_offset = 0;
+		}
+
+		return 0;
+	}
+}
+
+// returns the number of consumed bytes
 int websocket_parse_header(Websocket *websocket, uint8_t *buffer, int length) {
-	int websocket_frame_length = sizeof(WebsocketFrame);
-	int to_copy = MIN(length, websocket_frame_length - websocket->frame_index);
+	int consumed = 0;
+	int header_length;
+	int to_copy;
+	int fin;
+	int rsv1;
+	int payload_length;
+	int mask;
+	uint8_t *bytes = (uint8_t *)&websocket->frame;
+	uint8_t *masking_key;
+	int i;
+
+	// the header length is only known after its first two bytes arrived
+	for (;;) {
+		header_length = websocket_get_header_length(websocket);
+
+		if (websocket->frame_index >= header_length) {
+			break;
+		}
+
+		to_copy = MIN(length - consumed, header_length - websocket->frame_index);
+
+		if (to_copy <= 0) {
+			return consumed;
+		}
+
+		memcpy(bytes + websocket->frame_index, buffer + consumed, to_copy);
+
+		websocket->frame_index += to_copy;
+		consumed += to_copy;
+	}
+
+	fin = websocket_frame_get_fin(&websocket->frame.header);
+	rsv1 = websocket_frame_get_rsv1(&websocket->frame.header);
+	websocket->opcode = websocket_frame_get_opcode(&websocket->frame.header);
+	payload_length = websocket_frame_get_payload_length(&websocket->frame.header);
+	mask = websocket_frame_get_mask(&websocket->frame.header);
+
+	if (mask != 1) {
+		log_error("WebSocket frame has invalid mask (%d)", mask);
 
-	if (to_copy <= 0) {
-		log_error("WebSocket frame index has invalid value (%d)", websocket->frame_index);
 		return -1;
 	}
 
-	memcpy(((char*)&websocket->frame) + websocket->frame_index, buffer, to_copy);
-	if (to_copy + websocket->frame_index < websocket_frame_length) {
-		websocket->frame_index += to_copy;
-		return IO_CONTINUE;
-	} else {
-		int fin = websocket_frame_get_fin(&websocket->frame.header);
-		int opcode = websocket_frame_get_opcode(&websocket->frame.header);
-		int payload_length = websocket_frame_get_payload_length(&websocket->frame.header);
-		int mask = websocket_frame_get_mask(&websocket->frame.header);
+	// extended payload lengths are in network byte order
+	switch (payload_length) {
+	case 126:
+		websocket->to_read = ((uint64_t)bytes[2] << 8) | bytes[3];
+		masking_key = websocket->frame.extended.masking_key;
 
-		log_packet_debug("WebSocket header received (fin: %d, opc: %d, len: %d, key: [%d %d %d %d])",
-		                 fin, opcode, payload_length,
-		                 websocket->frame.masking_key[0],
-		                 websocket->frame.masking_key[1],
-		                 websocket->frame.masking_key[2],
-		                 websocket->frame.masking_key[3]);
+		break;
 
-		if (mask != 1) {
-			log_error("WebSocket frame has invalid mask (%d)", mask);
+	case 127:
+		websocket->to_read = 0;
 
-			return -1;
+		for (i = 0; i < 8; ++i) {
+			websocket->to_read = (websocket->to_read << 8) | bytes[2 + i];
 		}
 
-		if (payload_length == 126 || payload_length == 127) {
-			log_error("WebSocket frame with extended payload length not supported (%d)", payload_length);
+		if ((websocket->to_read >> 63) != 0) {
+			log_error("WebSocket frame has invalid payload length");
 
 			return -1;
 		}
 
-		switch (opcode) {
-		case WEBSOCKET_OPCODE_CONTINUATION_FRAME:
-		case WEBSOCKET_OPCODE_TEXT_FRAME:
-			log_error("WebSocket opcodes 'continuation' and 'text' not supported");
+		masking_key = websocket->frame.extended2.masking_key;
 
-			return -1;
+		break;
+
+	default:
+		websocket->to_read = payload_length;
+		masking_key = websocket->frame.normal.masking_key;
 
-		case WEBSOCKET_OPCODE_BINARY_FRAME:
-			websocket->mask_index = 0;
-			websocket->frame_index = 0;
-			websocket->to_read = payload_length;
-			websocket->state = WEBSOCKET_STATE_HEADER_DONE;
+		break;
+	}
 
-			if (length - to_copy > 0) {
-				memmove(buffer, buffer + to_copy, length - to_copy);
+	memcpy(websocket->masking_key, masking_key, WEBSOCKET_MASK_LENGTH);
 
-				return websocket_parse_data(websocket, buffer, length - to_copy);
-			}
+	log_packet_debug("WebSocket header received (fin: %d, opc: %d, len: %llu, key: [%d %d %d %d])",
+	                 fin, websocket->opcode, (unsigned long long)websocket->to_read,
+	                 websocket->masking_key[0], websocket->masking_key[1],
+	                 websocket->masking_key[2], websocket->masking_key[3]);
 
-			return IO_CONTINUE;
+	// only the first frame of a message can be marked as compressed
+	if (rsv1 != 0 && (websocket->compression == NULL ||
+	                  websocket->opcode != WEBSOCKET_OPCODE_BINARY_FRAME)) {
+		log_error("WebSocket frame has unexpected RSV1 bit (opc: %d)", websocket->opcode);
 
-		case WEBSOCKET_OPCODE_CLOSE_FRAME:
-			log_debug("WebSocket opcode 'close frame'");
+		return -1;
+	}
 
-			return 0;
+	switch (websocket->opcode) {
+	case WEBSOCKET_OPCODE_CONTINUATION_FRAME:
+		if (!websocket->fragmented) {
+			log_error("WebSocket opcode 'continuation' without preceding fragmented binary frame");
 
-		case WEBSOCKET_OPCODE_PING_FRAME:
-			log_error("WebSocket opcode 'ping' not supported");
+			return -1;
+		}
+
+		websocket->fragmented = !fin;
+
+		break;
+
+	case WEBSOCKET_OPCODE_TEXT_FRAME:
+		log_error("WebSocket opcode 'text' not supported");
+
+		return -1;
+
+	case WEBSOCKET_OPCODE_BINARY_FRAME:
+		if (websocket->fragmented) {
+			log_error("WebSocket opcode 'binary' inside fragmented binary message");
 
 			return -1;
+		}
+
+		websocket->fragmented = !fin;
+		websocket->compressed = rsv1 != 0;
 
-		case WEBSOCKET_OPCODE_PONG_FRAME:
-			log_error("WebSocket opcode 'pong' not supported");
+		break;
+
+	case WEBSOCKET_OPCODE_CLOSE_FRAME:
+	case WEBSOCKET_OPCODE_PING_FRAME:
+	case WEBSOCKET_OPCODE_PONG_FRAME:
+		if (!fin || websocket->to_read > WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH) {
+			log_error("WebSocket control frame is fragmented or too long (opc: %d)", websocket->opcode);
 
 			return -1;
 		}
+
+		websocket->control_length = 0;
+
+		break;
+
+	default:
+		log_error("Unknown WebSocket opcode (%d)", websocket->opcode);
+
+		return -1;
 	}
 
-	log_error("Unknown WebSocket opcode (%d)", websocket_frame_get_opcode(&websocket->frame.header));
+	websocket->frame_index = 0;
+	websocket->mask_index = 0;
+	websocket->state = WEBSOCKET_STATE_HEADER_DONE;
 
-	return -1;
+	if (websocket->to_read == 0 && websocket_finish_received_frame(websocket) < 0) {
+		return -1;
+	}
+
+	return consumed;
 }
 
+// unmasks the payload in place and returns the number of consumed bytes. the
+// payload of control frames is collected separately
 int websocket_parse_data(Websocket *websocket, uint8_t *buffer, int length) {
-	int i;
-	int length_recursive_add = 0;
-	int to_read = MIN(length, websocket->to_read);
+	int to_read = (int)MIN((uint64_t)length, websocket->to_read);
 
-	for (i = 0; i < to_read; i++) {
-		buffer[i] ^= websocket->frame.masking_key[websocket->mask_index];
-		websocket->mask_index++;
+	websocket->mask_index = websocket_mask(buffer, to_read, websocket->masking_key,
+	                                       websocket->mask_index);
 
-		if (websocket->mask_index >= WEBSOCKET_MASK_LENGTH) {
-			websocket->mask_index = 0;
-		}
+	if (websocket->opcode >= WEBSOCKET_OPCODE_CLOSE_FRAME) {
+		memcpy(websocket->control_payload + websocket->control_length, buffer, to_read);
+
+		websocket->control_length += to_read;
 	}
 
 	websocket->to_read -= to_read;
 
-	if (websocket->to_read < 0) {
-		log_error("WebSocket length mismatch (%d)", websocket->to_read);
-
+	if (websocket->to_read == 0 && websocket_finish_received_frame(websocket) < 0) {
 		return -1;
-	} else if (websocket->to_read == 0) {
-		websocket->state = WEBSOCKET_STATE_HANDSHAKE_DONE;
-		websocket->mask_index = 0;
-		websocket->frame_index = 0;
 	}
 
-	if (length > to_read) {
-		length_recursive_add = websocket_parse(websocket, buffer + to_read, length - to_read);
-
-		if (length_recursive_add < 0) {
-			if (length_recursive_add == IO_CONTINUE) {
-				length_recursive_add = 0;
-			} else {
-				return length_recursive_add;
-			}
-		}
-	}
-
-	return to_read + length_recursive_add;
+	return to_read;
 }
 
+// a single receive can contain several frames and partial frames. the
+// unmasked payload of all binary frames is moved to the start of the buffer
+// and its length is returned
 int websocket_parse(Websocket *websocket, void *buffer, int length) {
+	uint8_t *bytes = buffer;
+	int offset = 0;
+	int data_length = 0;
+	int opcode;
+	int rc;
+
 	switch (websocket->state) {
 	case WEBSOCKET_STATE_WAIT_FOR_HANDSHAKE:
 	case WEBSOCKET_STATE_FOUND_HANDSHAKE_KEY:
 		return websocket_parse_handshake(websocket, buffer, length);
 
 	case WEBSOCKET_STATE_HANDSHAKE_DONE:
-		return websocket_parse_header(websocket, buffer, length);
-
 	case WEBSOCKET_STATE_HEADER_DONE:
-		return websocket_parse_data(websocket, buffer, length);
+	case WEBSOCKET_STATE_CLOSED:
+		break;
+
+	default:
+		log_error("In invalid WebSocket state (%d)", websocket->state);
+
+		return -1;
 	}
 
-	log_error("In invalid WebSocket state (%d)", websocket->state);
+	while (offset < length && websocket->state != WEBSOCKET_STATE_CLOSED) {
+		if (websocket->state == WEBSOCKET_STATE_HANDSHAKE_DONE) {
+			rc = websocket_parse_header(websocket, bytes + offset, length - offset);
+		} else {
+			opcode = websocket->opcode;
+			rc = websocket_parse_data(websocket, bytes + offset, length - offset);
 
-	return -1;
+			if (rc > 0 && opcode < WEBSOCKET_OPCODE_CLOSE_FRAME) {
+				memmove(bytes + data_length, bytes + offset, rc);
+
+				data_length += rc;
+			}
+		}
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		offset += rc;
+	}
+
+	if (data_length > 0) {
+		return data_length;
+	}
+
+	return websocket->state == WEBSOCKET_STATE_CLOSED ? 0 : IO_CONTINUE;
+}
+
+#ifdef BRICKD_WITH_ZLIB
+
+// produces output that the inflater held back and inflates the trailer of a
+// finished compressed message. returns the number of produced bytes
+static int websocket_flush_inflater(Websocket *websocket, uint8_t *buffer, int length) {
+	int trailer_length = 0;
+	int consumed;
+	int produced;
+
+	if (websocket->trailer_pending) {
+		trailer_length = WEBSOCKET_DEFLATE_TRAILER_LENGTH - websocket->trailer_offset;
+	}
+
+	produced = websocket_deflate_decompress(websocket->compression,
+	                                        websocket_deflate_trailer + websocket->trailer_offset,
+	                                        trailer_length, &consumed, buffer, length);
+
+	if (produced < 0) {
+		return -1;
+	}
+
+	websocket->trailer_offset += consumed;
+
+	if (websocket->trailer_offset >= WEBSOCKET_DEFLATE_TRAILER_LENGTH) {
+		websocket->trailer_pending = false;
+	}
+
+	websocket->inflate_pending = produced == length;
+
+	return produced;
+}
+
+// unmasks the payload in the receive buffer and inflates or copies it into
+// the buffer. returns the number of produced bytes
+static int websocket_parse_compressed_data(Websocket *websocket, uint8_t *buffer, int length) {
+	uint8_t *input = websocket->receive_buffer + websocket->receive_offset;
+	int available = (int)MIN((uint64_t)(websocket->receive_length - websocket->receive_offset),
+	                         websocket->to_read);
+	int consumed;
+	int produced;
+
+	// uncompressed payload is only unmasked as far as it fits into the buffer
+	if (!websocket->compressed && websocket->opcode < WEBSOCKET_OPCODE_CLOSE_FRAME) {
+		available = MIN(available, length);
+	}
+
+	// if the buffer filled up while inflating then the rest of the input is
+	// already unmasked
+	if (available > websocket->unmasked_length) {
+		websocket->mask_index = websocket_mask(input + websocket->unmasked_length,
+		                                       available - websocket->unmasked_length,
+		                                       websocket->masking_key, websocket->mask_index);
+		websocket->unmasked_length = available;
+	}
+
+	if (websocket->opcode >= WEBSOCKET_OPCODE_CLOSE_FRAME) {
+		memcpy(websocket->control_payload + websocket->control_length, input, available);
+
+		websocket->control_length += available;
+		consumed = available;
+		produced = 0;
+	} else if (websocket->compressed) {
+		produced = websocket_deflate_decompress(websocket->compression, input, available,
+		                                        &consumed, buffer, length);
+
+		if (produced < 0) {
+			return -1;
+		}
+
+		websocket->inflate_pending = produced == length;
+	} else {
+		memcpy(buffer, input, available);
+
+		consumed = available;
+		produced = available;
+	}
+
+	websocket->unmasked_length -= consumed;
+	websocket->receive_offset += consumed;
+	websocket->to_read -= consumed;
+
+	if (websocket->to_read == 0 && websocket_finish_received_frame(websocket) < 0) {
+		return -1;
+	}
+
+	return produced;
+}
+
+// parses frames from the receive buffer until it is empty or the buffer is
+// full. inflated output has to be delivered in order, therefore output that
+// the inflater held back comes before anything else
+static int websocket_parse_compressed(Websocket *websocket, uint8_t *buffer, int length) {
+	int used = 0;
+	int rc;
+
+	while (used < length && websocket->state != WEBSOCKET_STATE_CLOSED) {
+		if (websocket->inflate_pending || websocket->trailer_pending) {
+			rc = websocket_flush_inflater(websocket, buffer + used, length - used);
+		} else if (websocket->receive_offset >= websocket->receive_length) {
+			break;
+		} else if (websocket->state == WEBSOCKET_STATE_HANDSHAKE_DONE) {
+			rc = websocket_parse_header(websocket, websocket->receive_buffer + websocket->receive_offset,
+			                            websocket->receive_length - websocket->receive_offset);
+
+			if (rc >= 0) {
+				websocket->receive_offset += rc;
+				rc = 0;
+			}
+		} else {
+			rc = websocket_parse_compressed_data(websocket, buffer + used, length - used);
+		}
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		used += rc;
+	}
+
+	if (used > 0) {
+		return used;
+	}
+
+	return websocket->state == WEBSOCKET_STATE_CLOSED ? 0 : IO_CONTINUE;
+}
+
+// data left in the receive buffer or held back by the inflater is parsed
+// first, the socket is only read if there is nothing left
+static int websocket_receive_compressed(Websocket *websocket, uint8_t *buffer, int length) {
+	uint8_t *receive_buffer;
+	int rc;
+
+	if (websocket->receive_offset >= websocket->receive_length &&
+	    !websocket->inflate_pending && !websocket->trailer_pending) {
+		if (websocket->receive_buffer_size < length) {
+			receive_buffer = realloc(websocket->receive_buffer, length);
+
+			if (receive_buffer == NULL) {
+				errno = ENOMEM;
+
+				return -1;
+			}
+
+			websocket->receive_buffer = receive_buffer;
+			websocket->receive_buffer_size = length;
+		}
+
+		rc = socket_receive_platform(&websocket->base, websocket->receive_buffer, length);
+
+		if (rc <= 0) {
+			return rc;
+		}
+
+		websocket->receive_length = rc;
+		websocket->receive_offset = 0;
+	}
+
+	return websocket_parse_compressed(websocket, buffer, length);
 }
 
+#endif
+
 // sets errno on error
 int websocket_create(Websocket *websocket) {
 	if (socket_create(&websocket->base) < 0) {
@@ -403,20 +1069,55 @@ int websocket_create(Websocket *websocket) {
 	websocket->base.send = websocket_send;
 
 	websocket->frame_index = 0;
+	websocket->opcode = WEBSOCKET_OPCODE_BINARY_FRAME;
+	websocket->fragmented = false;
+	websocket->mask_index = 0;
+	websocket->to_read = 0;
+	websocket->control_length = 0;
+	websocket->unsent_length = 0;
+	websocket->unsent_offset = 0;
+	websocket->unsent_payload_length = 0;
+	websocket->pong_pending = false;
+	websocket->pong_length = 0;
+	websocket->send_buffer = NULL;
+	websocket->send_buffer_size = 0;
 	websocket->line_index = 0;
 	websocket->state = WEBSOCKET_STATE_WAIT_FOR_HANDSHAKE;
-
-	memset(&websocket->frame, 0, sizeof(WebsocketFrame));
+	websocket->batching = false;
+	websocket->batching_enabled = NULL;
+	websocket->batching_opaque = NULL;
+	websocket->compression = NULL;
+	websocket->compressed = false;
+	websocket->receive_buffer = NULL;
+	websocket->receive_buffer_size = 0;
+	websocket->receive_length = 0;
+	websocket->receive_offset = 0;
+	websocket->unmasked_length = 0;
+	websocket->inflate_pending = false;
+	websocket->trailer_pending = false;
+	websocket->trailer_offset = 0;
+	websocket->compressed_unsent = NULL;
+	websocket->compressed_unsent_length = 0;
+	websocket->held_back_length = 0;
+	websocket->queued_data = NULL;
+	websocket->queued_data_used = 0;
+	websocket->queued_data_size = 0;
+
+	memset(&websocket->frame, 0, sizeof(websocket->frame));
 	memset(websocket->line, 0, WEBSOCKET_MAX_LINE_LENGTH);
 	memset(websocket->client_key, 0, WEBSOCKET_CLIENT_KEY_LENGTH);
 
-	if (queue_create(&websocket->send_queue, sizeof(WebsocketQueuedData)) < 0) {
-		return -1;
-	}
-
 	return 0;
 }
 
+// the function is called when the client negotiated batching during the
+// initial handshake, before data queued in the meantime is sent
+void websocket_set_batching_function(Websocket *websocket,
+                                     WebsocketBatchingFunction function, void *opaque) {
+	websocket->batching_enabled = function;
+	websocket->batching_opaque = opaque;
+}
+
 // sets errno on error
 Socket *websocket_create_allocated(void) {
 	Websocket *websocket = calloc(1, sizeof(Websocket));
@@ -439,7 +1140,15 @@ Socket *websocket_create_allocated(void) {
 void websocket_destroy(Socket *socket) {
 	Websocket *websocket = (Websocket *)socket;
 
-	queue_destroy(&websocket->send_queue, websocket_free_queued_data);
+#ifdef BRICKD_WITH_ZLIB
+	if (websocket->compression != NULL) {
+		websocket_deflate_destroy(websocket->compression);
+	}
+#endif
+
+	free(websocket->receive_buffer);
+	free(websocket->queued_data);
+	free(websocket->send_buffer);
 
 	socket_destroy_platform(socket);
 }
@@ -448,6 +1157,12 @@ void websocket_destroy(Socket *socket) {
 int websocket_receive(Socket *socket, void *buffer, int length) {
 	Websocket *websocket = (Websocket *)socket;
 
+#ifdef BRICKD_WITH_ZLIB
+	if (websocket->compression != NULL && websocket->state >= WEBSOCKET_STATE_HANDSHAKE_DONE) {
+		return websocket_receive_compressed(websocket, buffer, length);
+	}
+#endif
+
 	length = socket_receive_platform(socket, buffer, length);
 
 	if (length <= 0) {
@@ -460,32 +1175,88 @@ int websocket_receive(Socket *socket, void *buffer, int length) {
 // sets errno on error
 int websocket_send(Socket *socket, const void *buffer, int length) {
 	Websocket *websocket = (Websocket *)socket;
-	WebsocketQueuedData *queued_data;
+	int size;
+	uint8_t *queued_data;
 
 	if (websocket->state == WEBSOCKET_STATE_HANDSHAKE_DONE ||
-	    websocket->state == WEBSOCKET_STATE_HEADER_DONE) {
+	    websocket->state == WEBSOCKET_STATE_HEADER_DONE ||
+	    websocket->state == WEBSOCKET_STATE_CLOSED) {
 		return websocket_send_frame(websocket, buffer, length);
 	}
 
 	// initial handshake not finished yet
 	if (length > 0) {
-		queued_data = queue_push(&websocket->send_queue);
+		size = MAX(websocket->queued_data_size, 256);
 
-		if (queued_data == NULL) {
-			return -1;
+		while (websocket->queued_data_used + (int)sizeof(length) + length > size) {
+			size *= 2;
 		}
 
-		queued_data->buffer = malloc(length);
-		queued_data->length = length;
+		if (size > websocket->queued_data_size) {
+			queued_data = realloc(websocket->queued_data, size);
 
-		if (queued_data->buffer == NULL) {
-			errno = ENOMEM;
+			if (queued_data == NULL) {
+				errno = ENOMEM;
 
-			return -1;
+				return -1;
+			}
+
+			websocket->queued_data = queued_data;
+			websocket->queued_data_size = size;
 		}
 
-		memcpy(queued_data->buffer, buffer, length);
+		memcpy(websocket->queued_data + websocket->queued_data_used, &length, sizeof(length));
+		memcpy(websocket->queued_data + websocket->queued_data_used + sizeof(length), buffer, length);
+
+		websocket->queued_data_used += sizeof(length) + length;
 	}
 
 	return length;
 }
+
+// builds a complete binary frame for the payload, to send the same data to
+// several clients without framing it once per client. the frame buffer needs
+// room for WEBSOCKET_MAX_SERVER_HEADER_LENGTH plus the payload length. returns
+// the frame length
+int websocket_prepare_frame(uint8_t *frame, const void *payload, int length) {
+	int header_length = websocket_fill_header(frame, WEBSOCKET_OPCODE_BINARY_FRAME, length);
+
+	memcpy(frame + header_length, payload, length);
+
+	return header_length + length;
+}
+
+// a prepared frame can be sent as is once the initial handshake is finished
+// and as long as no compression was negotiated. it cannot be sent while a
+// batched frame is partially sent, but the caller keeps the order of its sends
+bool websocket_can_send_prepared_frame(Websocket *websocket) {
+	return (websocket->state == WEBSOCKET_STATE_HANDSHAKE_DONE ||
+	        websocket->state == WEBSOCKET_STATE_HEADER_DONE) &&
+	       websocket->compression == NULL && websocket->unsent_payload_length == 0;
+}
+
+// sends a frame built by websocket_prepare_frame and returns the number of
+// sent bytes of the frame. if the socket accepts only a part of the frame then
+// the rest has to be sent by websocket_send, it continues the frame without a
+// new header the same way as a frame it built itself. sets errno on error
+int websocket_send_prepared_frame(Websocket *websocket, const uint8_t *frame, int length) {
+	int rc;
+
+	if (websocket_send_unsent(websocket) < 0) {
+		return -1;
+	}
+
+	rc = socket_send_platform(&websocket->base, frame, length);
+
+	if (rc < 0) {
+		return -1;
+	}
+
+	websocket->unsent_payload_length = length - rc;
+
+	if (websocket->unsent_payload_length == 0) {
+		websocket_finish_sent_frame(websocket);
+	}
+
+	return rc;
+}
@@ -23,20 +23,28 @@
 #ifndef BRICKD_WEBSOCKET_H
 #define BRICKD_WEBSOCKET_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
-#include <daemonlib/queue.h>
 #include <daemonlib/socket.h>
 
-#define WEBSOCKET_MAX_LINE_LENGTH 100 // Line length > 100 are not interesting for us
+#include "websocket_mask.h"
+
+#define WEBSOCKET_MAX_LINE_LENGTH 256 // Line length > 256 are not interesting for us
 #define WEBSOCKET_CLIENT_KEY_LENGTH 37 // Can be max 36
 #define WEBSOCKET_BASE64_DIGEST_LENGTH 30 // Can be max 30 for a 20 byte digest
 
 #define WEBSOCKET_CLIENT_KEY_STRING "Sec-WebSocket-Key:"
+#define WEBSOCKET_CLIENT_PROTOCOL_STRING "Sec-WebSocket-Protocol:"
+#define WEBSOCKET_CLIENT_EXTENSIONS_STRING "Sec-WebSocket-Extensions:"
+#define WEBSOCKET_BATCHING_PROTOCOL "tfp-batch" // several packets per frame
 #define WEBSOCKET_SERVER_KEY "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
 #define WEBSOCKET_ANSWER_STRING_1 "HTTP/1.1 101 Switching Protocols\r\nAccess-Control-Allow-Origin: *\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
-#define WEBSOCKET_ANSWER_STRING_2 "\r\nSec-WebSocket-Protocol: tfp\r\n\r\n"
+#define WEBSOCKET_ANSWER_STRING_2 "\r\nSec-WebSocket-Protocol: tfp\r\n"
+#define WEBSOCKET_ANSWER_STRING_2_BATCHING "\r\nSec-WebSocket-Protocol: " WEBSOCKET_BATCHING_PROTOCOL "\r\n"
+#define WEBSOCKET_ANSWER_STRING_EXTENSIONS "Sec-WebSocket-Extensions: "
+#define WEBSOCKET_ANSWER_STRING_3 "\r\n"
 
 #define WEBSOCKET_ERROR_STRING "HTTP/1.1 200 OK\r\nContent-Length: 270\r\nContent-Type: text/html\r\n\r\n<html><head><title>This is a Websocket</title></head><body>Dear Sir or Madam,<br/><br/>I regret to inform you that there is no webserver here.<br/>This port is exclusively used for Websockets.<br/><br/>Yours faithfully,<blockquote>Brick Daemon</blockquote></body></html>"
 
@@ -47,22 +55,17 @@
 #define WEBSOCKET_OPCODE_PING_FRAME          9
 #define WEBSOCKET_OPCODE_PONG_FRAME         10
 
-#define WEBSOCKET_MASK_LENGTH 4
-
-#define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 125
+#define WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH 125 // also the maximum for control frames
+#define WEBSOCKET_MAX_EXTENDED_PAYLOAD_DATA_LENGTH 65535
+#define WEBSOCKET_MAX_SERVER_HEADER_LENGTH 10 // unmasked with 64 bit payload length
 
 #include <daemonlib/packed_begin.h>
 
 typedef struct {
-	uint8_t opcode_rsv_fin; // opcode: 4, rsv1: 1, rsv2: 1, rsv3: 1, fin: 1
+	uint8_t opcode_rsv_fin; // opcode: 4, rsv3: 1, rsv2: 1, rsv1: 1, fin: 1
 	uint8_t payload_length_mask; // payload_length: 7, mask: 1
 } ATTRIBUTE_PACKED WebsocketFrameHeader;
 
-typedef struct {
-	WebsocketFrameHeader header;
-	uint8_t payload_data[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
-} ATTRIBUTE_PACKED WebsocketFrameWithPayload;
-
 typedef struct {
 	WebsocketFrameHeader header;
 	uint8_t masking_key[WEBSOCKET_MASK_LENGTH]; // only used if mask = 1
@@ -84,34 +87,95 @@ typedef struct {
 
 #include <daemonlib/packed_end.h>
 
+// the header of a received frame is collected here, its actual length depends
+// on the payload length in the first two bytes
+typedef union {
+	WebsocketFrameHeader header;
+	WebsocketFrame normal;
+	WebsocketFrameExtended extended;
+	WebsocketFrameExtended2 extended2;
+} WebsocketAnyFrame;
+
 typedef enum {
 	WEBSOCKET_STATE_WAIT_FOR_HANDSHAKE = 0,
 	WEBSOCKET_STATE_FOUND_HANDSHAKE_KEY,
 	WEBSOCKET_STATE_HANDSHAKE_DONE,
-	WEBSOCKET_STATE_HEADER_DONE
+	WEBSOCKET_STATE_HEADER_DONE,
+	WEBSOCKET_STATE_CLOSED
 } WebsocketState;
 
+typedef void (*WebsocketBatchingFunction)(void *opaque);
+
+struct _WebsocketDeflate; // see websocket_deflate.h
+
 typedef struct {
 	Socket base;
 
 	// WebSocket specific data
 	WebsocketState state;
 	char client_key[WEBSOCKET_CLIENT_KEY_LENGTH];
+	bool batching; // negotiated by the client through the subprotocol
+	WebsocketBatchingFunction batching_enabled;
+	void *batching_opaque;
+	struct _WebsocketDeflate *compression; // NULL if permessage-deflate is not negotiated
 
 	char line[WEBSOCKET_MAX_LINE_LENGTH];
 	int line_index;
 
-	WebsocketFrame frame;
+	WebsocketAnyFrame frame;
 	int frame_index;
+	int opcode; // of the current frame
+	bool fragmented; // a fragmented binary message is in progress
+	uint8_t masking_key[WEBSOCKET_MASK_LENGTH];
 	int mask_index;
 
-	int to_read;
-
-	Queue send_queue;
+	uint64_t to_read;
+	bool compressed; // the current binary message is compressed
+
+	// with compression the data is received into the receive buffer first,
+	// because the inflated payload can be longer than the received data
+	uint8_t *receive_buffer;
+	int receive_buffer_size;
+	int receive_length;
+	int receive_offset;
+	int unmasked_length; // of the payload at the receive offset
+	bool inflate_pending; // the inflater might hold back output
+	bool trailer_pending; // the last frame of a compressed message was received
+	int trailer_offset;
+
+	uint8_t control_payload[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
+	int control_length;
+
+	// a frame header or a control frame that was only partially sent
+	uint8_t unsent[sizeof(WebsocketFrameHeader) + WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
+	int unsent_length;
+	int unsent_offset;
+	int unsent_payload_length; // of the current data frame
+
+	bool pong_pending; // waiting for the current data frame to be sent
+	uint8_t pong_payload[WEBSOCKET_MAX_UNEXTENDED_PAYLOAD_DATA_LENGTH];
+	int pong_length;
+
+	uint8_t *send_buffer; // header plus payload, to send a frame at once
+	int send_buffer_size;
+
+	// a compressed frame that was only partially sent, and the number of
+	// bytes of the uncompressed data that are not reported as sent yet
+	uint8_t *compressed_unsent;
+	int compressed_unsent_length;
+	int held_back_length;
+
+	// data sent before the initial handshake is finished. each piece of
+	// data is prefixed with its length, to send it as its own frame later
+	uint8_t *queued_data;
+	int queued_data_used;
+	int queued_data_size;
 } Websocket;
 
 int websocket_frame_get_opcode(WebsocketFrameHeader *header);
 void websocket_frame_set_opcode(WebsocketFrameHeader *header, int opcode);
+int websocket_frame_get_rsv1(WebsocketFrameHeader *header);
+void websocket_frame_set_rsv1(WebsocketFrameHeader *header, int rsv1);
 int websocket_frame_get_fin(WebsocketFrameHeader *header);
 void websocket_frame_set_fin(WebsocketFrameHeader *header, int fin);
 int websocket_frame_get_payload_length(WebsocketFrameHeader *header);
@@ -128,9 +192,15 @@ int websocket_parse_data(Websocket *websocket, uint8_t *buffer, int length);
 int websocket_parse(Websocket *websocket, void *buffer, int length);
 
 int websocket_create(Websocket *websocket);
+void websocket_set_batching_function(Websocket *websocket,
+                                     WebsocketBatchingFunction function, void *opaque);
 Socket *websocket_create_allocated(void);
 void websocket_destroy(Socket *socket);
 int websocket_receive(Socket *socket, void *buffer, int length);
 int websocket_send(Socket *socket, const void *buffer, int length);
 
+int websocket_prepare_frame(uint8_t *frame, const void *payload, int length);
+bool websocket_can_send_prepared_frame(Websocket *websocket);
+int websocket_send_prepared_frame(Websocket *websocket, const uint8_t *frame, int length);
+
 #endif // BRICKD_WEBSOCKET_H
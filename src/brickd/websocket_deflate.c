@@ -0,0 +1,512 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * websocket_deflate.c: WebSocket permessage-deflate extension (RFC 7692)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the permessage-deflate extension compresses the payload of whole messages
+ * with raw deflate. the negotiation picks the window sizes and the hash table
+ * size so that the estimated zlib memory usage of a connection fits into the
+ * configured limit. all zlib allocations go through a counting allocator that
+ * enforces this limit, so a connection cannot use more memory than allowed,
+ * even if the estimate is off.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/config.h>
+#include <daemonlib/log.h>
+#include <daemonlib/utils.h>
+
+#include "websocket_deflate.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+#define MIN_SERVER_WINDOW_BITS 9 // zlib doesn't support 8 for raw deflate
+#define MIN_CLIENT_WINDOW_BITS 8
+#define MAX_WINDOW_BITS 15
+#define MAX_MEMORY_LEVEL 8
+#define STREAM_STATE_OVERHEAD 8192 // per stream, rounded up
+
+typedef struct {
+	bool server_no_context_takeover;
+	bool client_no_context_takeover;
+	int server_max_window_bits; // -1 if not offered
+	int client_max_window_bits; // -1 if not offered, 0 if offered without value
+} WebsocketDeflateOffer;
+
+typedef union {
+	size_t length;
+	uint64_t alignment;
+} WebsocketDeflateAllocation;
+
+const uint8_t websocket_deflate_trailer[WEBSOCKET_DEFLATE_TRAILER_LENGTH] = {
+	0x00, 0x00, 0xFF, 0xFF
+};
+
+static voidpf websocket_deflate_alloc(voidpf opaque, uInt items, uInt size) {
+	WebsocketDeflate *compression = opaque;
+	size_t length = (size_t)items * size;
+	WebsocketDeflateAllocation *allocation;
+
+	if (length > (size_t)(compression->memory_limit - compression->memory_used)) {
+		log_warn("WebSocket compression memory limit of %d bytes reached",
+		         compression->memory_limit);
+
+		return Z_NULL;
+	}
+
+	allocation = malloc(sizeof(WebsocketDeflateAllocation) + length);
+
+	if (allocation == NULL) {
+		return Z_NULL;
+	}
+
+	allocation->length = length;
+	compression->memory_used += (int)length;
+
+	return allocation + 1;
+}
+
+static void websocket_deflate_free(voidpf opaque, voidpf address) {
+	WebsocketDeflate *compression = opaque;
+	WebsocketDeflateAllocation *allocation = (WebsocketDeflateAllocation *)address - 1;
+
+	compression->memory_used -= (int)allocation->length;
+
+	free(allocation);
+}
+
+static void websocket_deflate_trim(const char **start, const char **end) {
+	while (*start < *end && (**start == ' ' || **start == '\t' ||
+	                         **start == '\r' || **start == '\n')) {
+		++*start;
+	}
+
+	while (*end > *start && ((*end)[-1] == ' ' || (*end)[-1] == '\t' ||
+	                         (*end)[-1] == '\r' || (*end)[-1] == '\n')) {
+		--*end;
+	}
+}
+
+static bool websocket_deflate_equal(const char *start, const char *end, const char *string) {
+	return end - start == (int)strlen(string) && strncmp(start, string, end - start) == 0;
+}
+
+// window bits are a decimal number in the range [8..15], optionally quoted
+static bool websocket_deflate_parse_window_bits(const char *start, const char *end, int *bits) {
+	websocket_deflate_trim(&start, &end);
+
+	if (end - start >= 2 && *start == '"' && end[-1] == '"') {
+		++start;
+		--end;
+	}
+
+	if (start == end || end - start > 2) {
+		return false;
+	}
+
+	*bits = 0;
+
+	for (; start < end; ++start) {
+		if (*start < '0' || *start > '9') {
+			return false;
+		}
+
+		*bits = *bits * 10 + (*start - '0');
+	}
+
+	return *bits >= MIN_CLIENT_WINDOW_BITS && *bits <= MAX_WINDOW_BITS;
+}
+
+// parses one offer of the form "permessage-deflate; param[=value]; ...".
+// returns false if the offer is for another extension, is malformed or has
+// unknown or duplicate parameters
+static bool websocket_deflate_parse_offer(const char *start, const char *end,
+                                          WebsocketDeflateOffer *offer) {
+	const char *parameter_end;
+	const char *name_end;
+	const char *value;
+	bool first = true;
+
+	offer->server_no_context_takeover = false;
+	offer->client_no_context_takeover = false;
+	offer->server_max_window_bits = -1;
+	offer->client_max_window_bits = -1;
+
+	while (start < end) {
+		parameter_end = memchr(start, ';', end - start);
+
+		if (parameter_end == NULL) {
+			parameter_end = end;
+		}
+
+		name_end = memchr(start, '=', parameter_end - start);
+
+		if (name_end == NULL) {
+			name_end = parameter_end;
+			value = NULL;
+		} else {
+			value = name_end + 1;
+		}
+
+		websocket_deflate_trim(&start, &name_end);
+
+		if (first) {
+			if (value != NULL || !websocket_deflate_equal(start, name_end, WEBSOCKET_DEFLATE_EXTENSION)) {
+				return false;
+			}
+
+			first = false;
+		} else if (websocket_deflate_equal(start, name_end, "server_no_context_takeover")) {
+			if (value != NULL || offer->server_no_context_takeover) {
+				return false;
+			}
+
+			offer->server_no_context_takeover = true;
+		} else if (websocket_deflate_equal(start, name_end, "client_no_context_takeover")) {
+			if (value != NULL || offer->client_no_context_takeover) {
+				return false;
+			}
+
+			offer->client_no_context_takeover = true;
+		} else if (websocket_deflate_equal(start, name_end, "server_max_window_bits")) {
+			if (value == NULL || offer->server_max_window_bits >= 0 ||
+			    !websocket_deflate_parse_window_bits(value, parameter_end, &offer->server_max_window_bits)) {
+				return false;
+			}
+		} else if (websocket_deflate_equal(start, name_end, "client_max_window_bits")) {
+			if (offer->client_max_window_bits >= 0) {
+				return false;
+			}
+
+			if (value == NULL) {
+				offer->client_max_window_bits = 0;
+			} else if (!websocket_deflate_parse_window_bits(value, parameter_end, &offer->client_max_window_bits)) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+
+		start = parameter_end + 1;
+	}
+
+	return !first;
+}
+
+static int websocket_deflate_estimate_memory(int server_window_bits, int memory_level,
+                                             int client_window_bits) {
+	// zlib documents the deflate memory usage as (1 << (windowBits + 2)) +
+	// (1 << (memLevel + 9)) and the inflate memory usage as 1 << windowBits,
+	// plus the stream states
+	return 2 * STREAM_STATE_OVERHEAD + (1 << (server_window_bits + 2)) +
+	       (1 << (memory_level + 9)) + (1 << client_window_bits);
+}
+
+// accepts the offer if its parameters are supported and the compression
+// state fits into the memory limit, fills in the extension response then
+static WebsocketDeflate *websocket_deflate_accept(WebsocketDeflateOffer *offer,
+                                                  bool context_takeover,
+                                                  int memory_limit) {
+	int server_window_bits = offer->server_max_window_bits > 0 ? offer->server_max_window_bits : MAX_WINDOW_BITS;
+	int client_window_bits = offer->client_max_window_bits > 0 ? offer->client_max_window_bits : MAX_WINDOW_BITS;
+	int memory_level = MAX_MEMORY_LEVEL;
+	bool can_shrink_server;
+	bool can_shrink_memory;
+	bool can_shrink_client;
+	int server_window;
+	int hash_table;
+	int client_window;
+	WebsocketDeflate *compression;
+	char *response;
+	int rc;
+
+	if (server_window_bits < MIN_SERVER_WINDOW_BITS) {
+		log_debug("Declining WebSocket permessage-deflate offer with unsupported server_max_window_bits=%d",
+		          server_window_bits);
+
+		return NULL;
+	}
+
+	// shrink the largest part of the compression state until it fits. the
+	// client window can only be shrunk if the client offered to limit it
+	while (websocket_deflate_estimate_memory(server_window_bits, memory_level,
+	                                         client_window_bits) > memory_limit) {
+		can_shrink_server = server_window_bits > MIN_SERVER_WINDOW_BITS;
+		can_shrink_memory = memory_level > 1;
+		can_shrink_client = offer->client_max_window_bits >= 0 &&
+		                    client_window_bits > MIN_CLIENT_WINDOW_BITS;
+		server_window = 1 << (server_window_bits + 2);
+		hash_table = 1 << (memory_level + 9);
+		client_window = 1 << client_window_bits;
+
+		if (can_shrink_client && client_window >= server_window && client_window >= hash_table) {
+			--client_window_bits;
+		} else if (can_shrink_server && (server_window >= hash_table || !can_shrink_memory)) {
+			--server_window_bits;
+		} else if (can_shrink_memory) {
+			--memory_level;
+		} else if (can_shrink_client) {
+			--client_window_bits;
+		} else {
+			log_info("Declining WebSocket permessage-deflate offer, compression state doesn't fit into memory limit of %d bytes",
+			         memory_limit);
+
+			return NULL;
+		}
+	}
+
+	compression = calloc(1, sizeof(WebsocketDeflate));
+
+	if (compression == NULL) {
+		log_error("Could not allocate WebSocket compression state: %s (%d)",
+		          get_errno_name(ENOMEM), ENOMEM);
+
+		return NULL;
+	}
+
+	compression->server_no_context_takeover = offer->server_no_context_takeover || !context_takeover;
+	compression->memory_limit = memory_limit;
+
+	compression->deflater.zalloc = websocket_deflate_alloc;
+	compression->deflater.zfree = websocket_deflate_free;
+	compression->deflater.opaque = compression;
+
+	compression->inflater.zalloc = websocket_deflate_alloc;
+	compression->inflater.zfree = websocket_deflate_free;
+	compression->inflater.opaque = compression;
+
+	// negative window bits select raw deflate without zlib header
+	rc = deflateInit2(&compression->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	                  -server_window_bits, memory_level, Z_DEFAULT_STRATEGY);
+
+	if (rc != Z_OK) {
+		log_error("Could not initialize WebSocket compression: %s (%d)",
+		          zError(rc), rc);
+
+		websocket_deflate_destroy(compression);
+
+		return NULL;
+	}
+
+	compression->deflater_initialized = true;
+
+	rc = inflateInit2(&compression->inflater, -client_window_bits);
+
+	if (rc != Z_OK) {
+		log_error("Could not initialize WebSocket decompression: %s (%d)",
+		          zError(rc), rc);
+
+		websocket_deflate_destroy(compression);
+
+		return NULL;
+	}
+
+	compression->inflater_initialized = true;
+
+	response = compression->response;
+
+	snprintf(response, WEBSOCKET_DEFLATE_MAX_RESPONSE_LENGTH, "%s", WEBSOCKET_DEFLATE_EXTENSION);
+
+	if (compression->server_no_context_takeover) {
+		strcat(response, "; server_no_context_takeover");
+	}
+
+	if (offer->client_no_context_takeover || !context_takeover) {
+		strcat(response, "; client_no_context_takeover");
+	}
+
+	// a smaller server window doesn't need to be announced, the client can
+	// inflate with the default window anyway
+	if (offer->server_max_window_bits > 0) {
+		snprintf(response + strlen(response), WEBSOCKET_DEFLATE_MAX_RESPONSE_LENGTH - strlen(response),
+		         "; server_max_window_bits=%d", server_window_bits);
+	}
+
+	// the response must not contain client_max_window_bits if the client
+	// didn't offer it
+	if (offer->client_max_window_bits >= 0) {
+		snprintf(response + strlen(response), WEBSOCKET_DEFLATE_MAX_RESPONSE_LENGTH - strlen(response),
+		         "; client_max_window_bits=%d", client_window_bits);
+	}
+
+	log_debug("Accepted WebSocket extension offer (%s, memory-level: %d)",
+	          response, memory_level);
+
+	return compression;
+}
+
+// the offers are the value of a Sec-WebSocket-Extensions header. the first
+// acceptable permessage-deflate offer is accepted and the value for the
+// Sec-WebSocket-Extensions header of the handshake answer is stored in the
+// response member. returns NULL if compression is disabled or no offer is
+// acceptable
+WebsocketDeflate *websocket_deflate_negotiate(const char *offers) {
+	bool context_takeover = config_get_option_value("listen.websocket_deflate_context_takeover")->boolean;
+	int memory_limit = config_get_option_value("listen.websocket_deflate_memory_limit")->integer;
+	const char *end;
+	WebsocketDeflateOffer offer;
+	WebsocketDeflate *compression;
+
+	if (!config_get_option_value("listen.websocket_deflate")->boolean) {
+		return NULL;
+	}
+
+	for (;;) {
+		end = strchr(offers, ',');
+
+		if (end == NULL) {
+			end = offers + strlen(offers);
+		}
+
+		if (websocket_deflate_parse_offer(offers, end, &offer)) {
+			compression = websocket_deflate_accept(&offer, context_takeover, memory_limit);
+
+			if (compression != NULL) {
+				return compression;
+			}
+		}
+
+		if (*end == '\0') {
+			return NULL;
+		}
+
+		offers = end + 1;
+	}
+}
+
+void websocket_deflate_destroy(WebsocketDeflate *compression) {
+	if (compression->deflater_initialized) {
+		deflateEnd(&compression->deflater);
+	}
+
+	if (compression->inflater_initialized) {
+		inflateEnd(&compression->inflater);
+	}
+
+	free(compression->output);
+	free(compression);
+}
+
+// compresses the buffer as one message. the compressed payload is returned
+// with header_room bytes in front of it for the frame header and stays valid
+// until the next call. sets errno on error
+uint8_t *websocket_deflate_compress(WebsocketDeflate *compression, const void *buffer,
+                                    int length, int header_room, int *compressed_length) {
+	int used = header_room;
+	int size;
+	uint8_t *output;
+	int rc;
+
+	compression->deflater.next_in = (Bytef *)buffer;
+	compression->deflater.avail_in = length;
+
+	for (;;) {
+		// compressed data can be slightly longer than the uncompressed data
+		size = MAX(compression->output_size, header_room + length + 64);
+
+		if (compression->output_size - used < 64) {
+			size = MAX(size, compression->output_size * 2);
+		}
+
+		if (size > compression->output_size) {
+			output = realloc(compression->output, size);
+
+			if (output == NULL) {
+				errno = ENOMEM;
+
+				return NULL;
+			}
+
+			compression->output = output;
+			compression->output_size = size;
+		}
+
+		compression->deflater.next_out = compression->output + used;
+		compression->deflater.avail_out = compression->output_size - used;
+
+		rc = deflate(&compression->deflater, Z_SYNC_FLUSH);
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR) {
+			log_error("Could not compress WebSocket message: %s (%d)", zError(rc), rc);
+
+			errno = EINVAL;
+
+			return NULL;
+		}
+
+		used = compression->output_size - compression->deflater.avail_out;
+
+		// the flush is complete if there is output space left
+		if (compression->deflater.avail_out > 0) {
+			break;
+		}
+	}
+
+	// the sync flush ends with an empty stored block, that is not sent
+	if (used - header_room >= WEBSOCKET_DEFLATE_TRAILER_LENGTH) {
+		used -= WEBSOCKET_DEFLATE_TRAILER_LENGTH;
+	}
+
+	if (compression->server_no_context_takeover) {
+		deflateReset(&compression->deflater);
+	}
+
+	*compressed_length = used - header_room;
+
+	return compression->output + header_room;
+}
+
+// inflates as much of the input as fits into the output. returns the number
+// of produced bytes or -1 on error, the number of consumed input bytes is
+// stored in consumed. if the output is full then zlib might hold back more
+// output that is produced by the next call, even without more input
+int websocket_deflate_decompress(WebsocketDeflate *compression, const uint8_t *input,
+                                 int input_length, int *consumed,
+                                 uint8_t *output, int output_length) {
+	int rc;
+
+	compression->inflater.next_in = (Bytef *)input;
+	compression->inflater.avail_in = input_length;
+	compression->inflater.next_out = output;
+	compression->inflater.avail_out = output_length;
+
+	rc = inflate(&compression->inflater, Z_SYNC_FLUSH);
+
+	if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END) {
+		log_error("Could not decompress WebSocket message: %s (%d)",
+		          compression->inflater.msg != NULL ? compression->inflater.msg : zError(rc), rc);
+
+		return -1;
+	}
+
+	// the client ended the deflate stream with a final block, the next
+	// message starts a new stream
+	if (rc == Z_STREAM_END) {
+		inflateReset(&compression->inflater);
+	}
+
+	*consumed = input_length - (int)compression->inflater.avail_in;
+
+	return output_length - (int)compression->inflater.avail_out;
+}
@@ -0,0 +1,60 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * websocket_deflate.h: WebSocket permessage-deflate extension (RFC 7692)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_WEBSOCKET_DEFLATE_H
+#define BRICKD_WEBSOCKET_DEFLATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zlib.h>
+
+#define WEBSOCKET_DEFLATE_EXTENSION "permessage-deflate"
+#define WEBSOCKET_DEFLATE_MAX_RESPONSE_LENGTH 160
+#define WEBSOCKET_DEFLATE_TRAILER_LENGTH 4
+
+typedef struct _WebsocketDeflate WebsocketDeflate;
+
+struct _WebsocketDeflate {
+	z_stream deflater;
+	z_stream inflater;
+	bool deflater_initialized;
+	bool inflater_initialized;
+	bool server_no_context_takeover;
+	int memory_used; // by zlib, bytes
+	int memory_limit; // bytes
+	uint8_t *output; // compressed payload, with room for a frame header in front
+	int output_size;
+	char response[WEBSOCKET_DEFLATE_MAX_RESPONSE_LENGTH]; // for the handshake answer
+};
+
+extern const uint8_t websocket_deflate_trailer[WEBSOCKET_DEFLATE_TRAILER_LENGTH];
+
+WebsocketDeflate *websocket_deflate_negotiate(const char *offers);
+void websocket_deflate_destroy(WebsocketDeflate *compression);
+
+uint8_t *websocket_deflate_compress(WebsocketDeflate *compression, const void *buffer,
+                                    int length, int header_room, int *compressed_length);
+int websocket_deflate_decompress(WebsocketDeflate *compression, const uint8_t *input,
+                                 int input_length, int *consumed,
+                                 uint8_t *output, int output_length);
+
+#endif // BRICKD_WEBSOCKET_DEFLATE_H
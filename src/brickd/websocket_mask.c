@@ -0,0 +1,86 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * websocket_mask.c: WebSocket payload unmasking
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the payload of frames sent by a WebSocket client is XORed with a 4 byte
+ * masking key. instead of going through the payload byte by byte the key is
+ * repeated to a 16 byte (SSE2) or 8 byte pattern, starting at the current
+ * position in the key, and applied to the payload a whole chunk at a time.
+ * loads and stores go through memcpy, so the payload doesn't need to be
+ * aligned.
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#include "websocket_mask.h"
+
+// XORs the data in place with the masking key, starting at the given position
+// in the key. returns the position in the key after the data
+int websocket_mask(uint8_t *data, int length,
+                   const uint8_t masking_key[WEBSOCKET_MASK_LENGTH], int mask_index) {
+	uint8_t pattern[16];
+	uint64_t pattern64;
+	uint64_t word;
+	int i = 0;
+	int k;
+#ifdef __SSE2__
+	__m128i pattern128;
+	__m128i chunk;
+#endif
+
+	if (length >= 8) {
+		for (k = 0; k < (int)sizeof(pattern); ++k) {
+			pattern[k] = masking_key[(mask_index + k) % WEBSOCKET_MASK_LENGTH];
+		}
+
+#ifdef __SSE2__
+		pattern128 = _mm_loadu_si128((const __m128i *)pattern);
+
+		for (; i + 16 <= length; i += 16) {
+			chunk = _mm_loadu_si128((const __m128i *)(data + i));
+			chunk = _mm_xor_si128(chunk, pattern128);
+
+			_mm_storeu_si128((__m128i *)(data + i), chunk);
+		}
+#endif
+
+		memcpy(&pattern64, pattern, sizeof(pattern64));
+
+		for (; i + 8 <= length; i += 8) {
+			memcpy(&word, data + i, sizeof(word));
+
+			word ^= pattern64;
+
+			memcpy(data + i, &word, sizeof(word));
+		}
+	}
+
+	// 16 and 8 are multiples of the key length, so the position in the key is
+	// the same as before the chunks
+	for (; i < length; ++i) {
+		data[i] ^= masking_key[(mask_index + i) % WEBSOCKET_MASK_LENGTH];
+	}
+
+	return (mask_index + length) % WEBSOCKET_MASK_LENGTH;
+}
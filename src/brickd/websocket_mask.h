@@ -0,0 +1,32 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * websocket_mask.h: WebSocket payload unmasking
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_WEBSOCKET_MASK_H
+#define BRICKD_WEBSOCKET_MASK_H
+
+#include <stdint.h>
+
+#define WEBSOCKET_MASK_LENGTH 4
+
+int websocket_mask(uint8_t *data, int length,
+                   const uint8_t masking_key[WEBSOCKET_MASK_LENGTH], int mask_index);
+
+#endif // BRICKD_WEBSOCKET_MASK_H
@@ -21,51 +21,95 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <daemonlib/log.h>
 
 #include "zombie.h"
 
 #include "client.h"
+#include "network.h"
 
 static LogSource _log_source = LOG_SOURCE_INITIALIZER;
 
 static uint32_t _next_id = 0;
 
-static void zombie_handle_timeout(void *opaque) {
-	Zombie *zombie = opaque;
+// the zombie is removed at the end of the current event loop iteration
+static void zombie_finish(Zombie *zombie) {
+	if (zombie->finished) {
+		return;
+	}
 
 	zombie->finished = true;
+
+	network_schedule_zombie_removal(zombie);
 }
 
-int zombie_create(Zombie *zombie, Client *client) {
-	Node *pending_request_client_node;
-	PendingRequest *pending_request;
+static void zombie_swap_arrays(Array *a, Array *b) {
+	Array swap = *a;
 
-	zombie->id = _next_id++;
-	zombie->finished = false;
-	zombie->pending_request_count = client->pending_request_count;
+	*a = *b;
+	*b = swap;
+}
 
-	log_debug("Creating zombie (id: %u) from client ("CLIENT_SIGNATURE_FORMAT") for %d pending request(s)",
-	          zombie->id, client_expand_signature(client), zombie->pending_request_count);
+// the session state is swapped with empty arrays instead of copied, so the
+// client and the zombie can both destroy what they hold afterwards
+static int zombie_create_session(Zombie *zombie, Client *client) {
+	if (array_create(&zombie->callback_filters, 1, sizeof(ClientCallbackFilter), true) < 0) {
+		log_error("Could not create callback filter array for zombie (id: %u): %s (%d)",
+		          zombie->id, get_errno_name(errno), errno);
 
-	// create single shot timer with a delay of 1sec
-	if (timer_create_(&zombie->timer, zombie_handle_timeout, zombie) < 0) {
-		log_error("Could not create zombie timer: %s (%d)",
-		          get_errno_name(errno), errno);
+		return -1;
+	}
+
+	if (array_create(&zombie->callback_rate_limits, 1, sizeof(ClientCallbackRateLimit), true) < 0) {
+		log_error("Could not create callback rate limit array for zombie (id: %u): %s (%d)",
+		          zombie->id, get_errno_name(errno), errno);
+
+		array_destroy(&zombie->callback_filters, NULL);
 
 		return -1;
 	}
 
-	if (timer_configure(&zombie->timer, 1000000, 0) < 0) {
-		log_error("Could not start zombie timer: %s (%d)",
-		          get_errno_name(errno), errno);
+	if (queue_create(&zombie->held_responses, sizeof(Packet)) < 0) {
+		log_error("Could not create held response queue for zombie (id: %u): %s (%d)",
+		          zombie->id, get_errno_name(errno), errno);
 
-		timer_destroy(&zombie->timer);
+		array_destroy(&zombie->callback_rate_limits, NULL);
+		array_destroy(&zombie->callback_filters, NULL);
 
 		return -1;
 	}
 
+	zombie_swap_arrays(&zombie->callback_filters, &client->callback_filters);
+	zombie_swap_arrays(&zombie->callback_rate_limits, &client->callback_rate_limits);
+
+	memcpy(zombie->session_token, client->session_token, sizeof(zombie->session_token));
+
+	zombie->authentication_state = client->authentication_state;
+	zombie->resumable = true;
+
+	return 0;
+}
+
+int zombie_create(Zombie *zombie, Client *client) {
+	Node *pending_request_client_node;
+	PendingRequest *pending_request;
+
+	zombie->id = _next_id++;
+	zombie->finished = false;
+	zombie->resumable = false;
+
+	if (client->session_resumable && zombie_create_session(zombie, client) < 0) {
+		return -1;
+	}
+
+	zombie->pending_request_count = client->pending_request_count;
+
+	log_debug("Creating %szombie (id: %u) from client ("CLIENT_SIGNATURE_FORMAT") for %d pending request(s)",
+	          zombie->resumable ? "resumable " : "", zombie->id,
+	          client_expand_signature(client), zombie->pending_request_count);
+
 	// insert new sentinal and remove old one to take over the list
 	node_insert_after(&client->pending_request_sentinel, &zombie->pending_request_sentinel);
 	node_remove(&client->pending_request_sentinel);
@@ -101,25 +145,109 @@ void zombie_destroy(Zombie *zombie) {
 		}
 	}
 
-	timer_destroy(&zombie->timer);
+	if (zombie->resumable) {
+		array_destroy(&zombie->callback_filters, NULL);
+		array_destroy(&zombie->callback_rate_limits, NULL);
+		queue_destroy(&zombie->held_responses, NULL);
+	}
+}
+
+// called by network.c if the deadline of the zombie passed
+void zombie_expire(Zombie *zombie) {
+	if (zombie->finished) {
+		return;
+	}
+
+	log_debug("Zombie (id: %u) timed out with %d request(s) still pending",
+	          zombie->id, zombie->pending_request_count);
+
+	zombie_finish(zombie);
+}
+
+// hands the pending requests, the held responses and the session state over
+// to the reconnected client. the state the client set up before resuming is
+// replaced by the state of the session
+void zombie_resume(Zombie *zombie, Client *client) {
+	PendingRequest *pending_request;
+	ClientCallbackRateLimit *rate_limit;
+	Packet *response;
+	int pending_request_count = zombie->pending_request_count;
+	int held_response_count = zombie->held_responses.count;
+	int i;
+
+	while (zombie->pending_request_sentinel.next != &zombie->pending_request_sentinel) {
+		pending_request = containerof(zombie->pending_request_sentinel.next, PendingRequest, client_node);
+
+		node_remove(&pending_request->client_node);
+		node_insert_before(&client->pending_request_sentinel, &pending_request->client_node);
+
+		pending_request->client = client;
+		pending_request->zombie = NULL;
+	}
+
+	client->pending_request_count += zombie->pending_request_count;
+	zombie->pending_request_count = 0;
+
+	zombie_swap_arrays(&zombie->callback_filters, &client->callback_filters);
+	zombie_swap_arrays(&zombie->callback_rate_limits, &client->callback_rate_limits);
+
+	// the held back callbacks were lost together with the old connection
+	for (i = 0; i < client->callback_rate_limits.count; ++i) {
+		rate_limit = array_get(&client->callback_rate_limits, i);
+		rate_limit->held = false;
+	}
+
+	client->authentication_state = zombie->authentication_state;
+	client->session_resumable = true;
+
+	memcpy(client->session_token, zombie->session_token, sizeof(client->session_token));
+
+	log_info("Client ("CLIENT_SIGNATURE_FORMAT") resumed session of zombie (id: %u) with %d pending request(s) and %d held response(s)",
+	         client_expand_signature(client), zombie->id, pending_request_count,
+	         held_response_count);
+
+	while ((response = queue_peek(&zombie->held_responses)) != NULL) {
+		client_dispatch_response(client, NULL, response, true, false);
+		queue_pop(&zombie->held_responses, NULL);
+	}
+
+	zombie_finish(zombie);
 }
 
 void zombie_dispatch_response(Zombie *zombie, PendingRequest *pending_request,
                               Packet *response) {
+	Packet *held_response;
+
 	packet_add_trace(response);
 
 	pending_request_remove_and_free(pending_request);
 
-	if (zombie->pending_request_count == 0) {
-		zombie->finished = true;
+	// keep the response for the client to pick up after reconnecting. a
+	// resumable zombie lives until its session times out, even without
+	// pending requests
+	if (zombie->resumable) {
+		if (zombie->held_responses.count >= ZOMBIE_MAX_HELD_RESPONSES) {
+			log_debug("Held response queue of zombie (id: %u) is full, dropping oldest held response",
+			          zombie->id);
 
-		log_debug("Zombie (id: %u) finished", zombie->id);
+			queue_pop(&zombie->held_responses, NULL);
+		}
 
-		if (timer_configure(&zombie->timer, 0, 0) < 0) {
-			log_error("Could not stop zombie timer: %s (%d)",
-			          get_errno_name(errno), errno);
+		held_response = queue_push(&zombie->held_responses);
 
-			return;
+		if (held_response == NULL) {
+			log_error("Could not append to held response queue of zombie (id: %u), dropping response: %s (%d)",
+			          zombie->id, get_errno_name(errno), errno);
+		} else {
+			memcpy(held_response, response, response->header.length);
 		}
+
+		return;
+	}
+
+	if (zombie->pending_request_count == 0) {
+		zombie_finish(zombie);
+
+		log_debug("Zombie (id: %u) finished", zombie->id);
 	}
 }
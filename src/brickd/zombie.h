@@ -25,24 +25,46 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <daemonlib/array.h>
 #include <daemonlib/node.h>
 #include <daemonlib/packet.h>
-#include <daemonlib/timer.h>
+#include <daemonlib/queue.h>
 #include <daemonlib/utils.h>
 
 #include "client.h"
 
+// the oldest held responses are dropped beyond this, a client that does not
+// resume for long has little use for them anyway
+#ifdef BRICKD_WITH_COMPACT_MEMORY
+	#define ZOMBIE_MAX_HELD_RESPONSES 64
+#else
+	#define ZOMBIE_MAX_HELD_RESPONSES 1024
+#endif
+
 struct _Zombie {
+	Node network_node; // in the zombie list of network.c
+	Node removal_node; // in the removal list of network.c, if finished
 	uint32_t id;
 	bool finished;
-	Timer timer;
+	uint64_t deadline; // in microseconds, see network_create_zombie
 	Node pending_request_sentinel;
 	int pending_request_count;
+	// only used if the client had a session token, for a reconnecting client
+	// to take over the pending requests and the state of the session
+	bool resumable;
+	uint8_t session_token[CLIENT_SESSION_TOKEN_LENGTH];
+	ClientAuthenticationState authentication_state;
+	Array callback_filters;
+	Array callback_rate_limits;
+	Queue held_responses; // responses that arrived before the resumption
 };
 
 int zombie_create(Zombie *zombie, Client *client);
 void zombie_destroy(Zombie *zombie);
 
+void zombie_expire(Zombie *zombie);
+void zombie_resume(Zombie *zombie, Client *client);
+
 void zombie_dispatch_response(Zombie *zombie, PendingRequest *pending_request,
                               Packet *response);
 
@@ -55,6 +55,7 @@ libusb_get_device_t libusb_get_device;
 
 libusb_claim_interface_t libusb_claim_interface;
 libusb_release_interface_t libusb_release_interface;
+libusb_clear_halt_t libusb_clear_halt;
 
 libusb_alloc_transfer_t libusb_alloc_transfer;
 libusb_submit_transfer_t libusb_submit_transfer;
@@ -126,6 +127,7 @@ int libusb_init_dlopen(void) {
 
 	LIBUSB_DLSYM(libusb_claim_interface);
 	LIBUSB_DLSYM(libusb_release_interface);
+	LIBUSB_DLSYM(libusb_clear_halt);
 
 	LIBUSB_DLSYM(libusb_alloc_transfer);
 	LIBUSB_DLSYM(libusb_submit_transfer);
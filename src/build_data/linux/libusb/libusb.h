@@ -206,6 +206,7 @@ typedef libusb_device *(*libusb_get_device_t)(libusb_device_handle *dev_handle);
 
 typedef int (*libusb_claim_interface_t)(libusb_device_handle *dev, int interface_number);
 typedef int (*libusb_release_interface_t)(libusb_device_handle *dev, int interface_number);
+typedef int (*libusb_clear_halt_t)(libusb_device_handle *dev_handle, unsigned char endpoint);
 
 typedef struct libusb_transfer *(*libusb_alloc_transfer_t)(int iso_packets);
 typedef int (*libusb_submit_transfer_t)(struct libusb_transfer *transfer);
@@ -243,6 +244,7 @@ extern libusb_get_device_t libusb_get_device;
 
 extern libusb_claim_interface_t libusb_claim_interface;
 extern libusb_release_interface_t libusb_release_interface;
+extern libusb_clear_halt_t libusb_clear_halt;
 
 extern libusb_alloc_transfer_t libusb_alloc_transfer;
 extern libusb_submit_transfer_t libusb_submit_transfer;
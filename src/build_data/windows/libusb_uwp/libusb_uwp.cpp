@@ -85,9 +85,12 @@ typedef struct {
 	struct libusb_transfer transfer;
 	Node node;
 	bool submitted;
-	bool triggered;
 	bool completed;
 	uint32_t sequence_number;
+	// a reader or writer can only have one pending operation, so each transfer
+	// has its own. they are kept across submissions to the same pipe
+	uint32_t dev_handle_id; // of the device handle the reader or writer belongs to
+	unsigned char pipe_endpoint;
 	DataReader ^reader;
 	DataReaderLoadOperation ^load_operation;
 	DataWriter ^writer;
@@ -107,12 +110,14 @@ struct _libusb_device {
 
 struct _libusb_context {
 	int event_pipe[2];
+	volatile LONG event_triggered; // 1 while a notification is in the event pipe
 	struct libusb_pollfd event_pollfd;
 	Node dev_handle_sentinel;
 };
 
 struct _libusb_device_handle {
 	Node node;
+	uint32_t id; // unique, unlike the pointer
 	libusb_device *dev;
 	UsbDevice ^device;
 	Node read_itransfer_sentinel;
@@ -126,6 +131,7 @@ static std::unordered_map<std::wstring, uint16_t> _fake_device_addresses;
 static std::unordered_map<std::wstring, usbi_descriptor *> _cached_descriptors;
 static uint32_t _next_read_itransfer_sequence_number;
 static uint32_t _next_write_itransfer_sequence_number;
+static uint32_t _next_dev_handle_id = 1;
 
 // NOTE: assumes _log_callback is not nullptr
 static void usbi_log_message(libusb_context *ctx, enum libusb_log_level level,
@@ -757,6 +763,16 @@ static int usbi_get_string_descriptor(libusb_device_handle *dev_handle,
 	return rc;
 }
 
+// all transfers that complete before libusb_handle_events_timeout picked up
+// the pending notification share it, instead of writing one byte per transfer
+static void usbi_trigger_event(libusb_context *ctx) {
+	if (InterlockedExchange(&ctx->event_triggered, 1) == 0) {
+		if (usbi_write(ctx->event_pipe[1], nullptr, 1) != 1) {
+			usbi_log_error(ctx, "usbi_write failed: %d", errno); // FIXME
+		}
+	}
+}
+
 static void usbi_set_transfer_status(struct libusb_transfer *transfer,
                                      IAsyncOperation<size_t> ^operation,
                                      AsyncStatus status) {
@@ -898,6 +914,14 @@ int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
 
 	usbi_log_debug(ctx, "Handling events");
 
+	// reset the flag before looking at the transfers. a transfer that
+	// completes afterwards triggers a new notification
+	if (InterlockedExchange(&ctx->event_triggered, 0) != 0) {
+		if (usbi_read(ctx->event_pipe[0], nullptr, 1) != 1) {
+			usbi_log_error(ctx, "usbi_read failed: %d", errno); // FIXME
+		}
+	}
+
 	dev_handle_node = ctx->dev_handle_sentinel.next;
 
 	while (dev_handle_node != &ctx->dev_handle_sentinel) {
@@ -913,17 +937,6 @@ int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
 			if (!itransfer->completed) {
 				sparse = true;
 			} else {
-				if (itransfer->triggered) {
-					usbi_log_debug(ctx, "Reading from event pipe for read transfer %p [%u]",
-					               transfer, itransfer->sequence_number);
-
-					if (usbi_read(ctx->event_pipe[0], nullptr, 1) != 1) {
-						usbi_log_error(ctx, "usbi_read failed: %d", errno); // FIXME
-					} else {
-						itransfer->triggered = false;
-					}
-				}
-
 				if (!sparse || transfer->status != LIBUSB_TRANSFER_COMPLETED) {
 					usbi_log_debug(ctx, "Read transfer %p [%u] completed (length: %d, status: %d)",
 					               transfer, itransfer->sequence_number,
@@ -935,9 +948,12 @@ int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
 
 					itransfer->submitted = false;
 					itransfer->completed = false;
-					itransfer->reader = nullptr;
 					itransfer->load_operation = nullptr;
 
+					if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+						itransfer->reader = nullptr; // might be in an undefined state now
+					}
+
 					usbi_log_debug(ctx, "Triggering callback for read transfer %p [%u]",
 					               transfer, itransfer->sequence_number);
 
@@ -960,26 +976,18 @@ int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
 			transfer = &itransfer->transfer;
 
 			if (itransfer->completed) {
-				if (itransfer->triggered) {
-					usbi_log_debug(ctx, "Reading from event pipe for write transfer %p [%u]",
-					               transfer, itransfer->sequence_number);
-
-					if (usbi_read(ctx->event_pipe[0], nullptr, 1) != 1) {
-						usbi_log_error(ctx, "usbi_read failed: %d", errno); // FIXME
-					} else {
-						itransfer->triggered = false;
-					}
-				}
-
 				node_remove(&itransfer->node);
 
 				itransfer->store_operation->Close();
 
 				itransfer->submitted = false;
 				itransfer->completed = false;
-				itransfer->writer = nullptr;
 				itransfer->store_operation = nullptr;
 
+				if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+					itransfer->writer = nullptr; // might be in an undefined state now
+				}
+
 				usbi_log_debug(ctx, "Triggering callback for write transfer %p [%u]",
 				               transfer, itransfer->sequence_number);
 
@@ -1168,6 +1176,7 @@ int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle_ptr) {
 		return LIBUSB_ERROR_NO_DEVICE;
 	}
 
+	dev_handle->id = _next_dev_handle_id++;
 	dev_handle->dev = libusb_ref_device(dev);
 
 	node_reset(&dev_handle->read_itransfer_sentinel);
@@ -1279,6 +1288,55 @@ int libusb_release_interface(libusb_device_handle *dev_handle, int interface_num
 	return LIBUSB_SUCCESS;
 }
 
+int libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint) {
+	unsigned int i;
+	UsbInterface ^interface = dev_handle->device->DefaultInterface;
+	UsbBulkInPipe ^pipe_in;
+	UsbBulkOutPipe ^pipe_out;
+	IAsyncAction ^action = nullptr;
+	int rc = LIBUSB_ERROR_OTHER; // FIXME: use better error code
+	int *rc_ptr = &rc;
+
+	if ((endpoint & LIBUSB_ENDPOINT_IN) != 0) {
+		for (i = 0; i < interface->BulkInPipes->Size; ++i) {
+			pipe_in = interface->BulkInPipes->GetAt(i);
+
+			if ((LIBUSB_ENDPOINT_IN | pipe_in->EndpointDescriptor->EndpointNumber) == endpoint) {
+				action = pipe_in->ClearStallAsync();
+
+				break;
+			}
+		}
+	} else {
+		for (i = 0; i < interface->BulkOutPipes->Size; ++i) {
+			pipe_out = interface->BulkOutPipes->GetAt(i);
+
+			if (pipe_out->EndpointDescriptor->EndpointNumber == endpoint) {
+				action = pipe_out->ClearStallAsync();
+
+				break;
+			}
+		}
+	}
+
+	if (action == nullptr) {
+		return LIBUSB_ERROR_NOT_FOUND;
+	}
+
+	create_task(action)
+	.then([rc_ptr](task<void> previous) {
+		try {
+			previous.get();
+
+			*rc_ptr = LIBUSB_SUCCESS;
+		} catch (...) {
+			*rc_ptr = LIBUSB_ERROR_IO;
+		}
+	}).wait();
+
+	return rc;
+}
+
 struct libusb_transfer *libusb_alloc_transfer(int iso_packets) {
 	usbi_transfer *itransfer;
 
@@ -1302,140 +1360,189 @@ struct libusb_transfer *libusb_alloc_transfer(int iso_packets) {
 	return &itransfer->transfer;
 }
 
-int libusb_submit_transfer(struct libusb_transfer *transfer) {
-	usbi_transfer *itransfer = (usbi_transfer *)transfer;
-	libusb_device_handle *dev_handle = transfer->dev_handle;
-	libusb_context *ctx = dev_handle->dev->ctx;
-	unsigned int i;
+static UsbBulkInPipe ^usbi_find_bulk_in_pipe(libusb_device_handle *dev_handle,
+                                             unsigned char endpoint) {
 	UsbInterface ^interface = dev_handle->device->DefaultInterface;
 	UsbBulkInPipe ^pipe_in;
+	unsigned int i;
+
+	for (i = 0; i < interface->BulkInPipes->Size; ++i) {
+		pipe_in = interface->BulkInPipes->GetAt(i);
+
+		if ((LIBUSB_ENDPOINT_IN | pipe_in->EndpointDescriptor->EndpointNumber) == endpoint) {
+			return pipe_in;
+		}
+	}
+
+	return nullptr;
+}
+
+static UsbBulkOutPipe ^usbi_find_bulk_out_pipe(libusb_device_handle *dev_handle,
+                                               unsigned char endpoint) {
+	UsbInterface ^interface = dev_handle->device->DefaultInterface;
 	UsbBulkOutPipe ^pipe_out;
-	Array<unsigned char> ^data;
+	unsigned int i;
 
-	if (transfer->timeout != 0 || transfer->callback == nullptr) {
-		return LIBUSB_ERROR_INVALID_PARAM;
+	for (i = 0; i < interface->BulkOutPipes->Size; ++i) {
+		pipe_out = interface->BulkOutPipes->GetAt(i);
+
+		if (pipe_out->EndpointDescriptor->EndpointNumber == endpoint) {
+			return pipe_out;
+		}
 	}
 
-	if (itransfer->submitted) {
-		return LIBUSB_ERROR_BUSY;
+	return nullptr;
+}
+
+static bool usbi_is_same_pipe(usbi_transfer *itransfer) {
+	struct libusb_transfer *transfer = &itransfer->transfer;
+
+	return itransfer->dev_handle_id == transfer->dev_handle->id &&
+	       itransfer->pipe_endpoint == transfer->endpoint;
+}
+
+static int usbi_submit_read_transfer(usbi_transfer *itransfer) {
+	struct libusb_transfer *transfer = &itransfer->transfer;
+	libusb_device_handle *dev_handle = transfer->dev_handle;
+	libusb_context *ctx = dev_handle->dev->ctx;
+	UsbBulkInPipe ^pipe_in;
+
+	if (itransfer->reader == nullptr || !usbi_is_same_pipe(itransfer)) {
+		pipe_in = usbi_find_bulk_in_pipe(dev_handle, transfer->endpoint);
+
+		if (pipe_in == nullptr) {
+			return LIBUSB_ERROR_NOT_FOUND;
+		}
+
+		itransfer->dev_handle_id = dev_handle->id;
+		itransfer->pipe_endpoint = transfer->endpoint;
+		itransfer->reader = ref new DataReader(pipe_in->InputStream);
+		itransfer->writer = nullptr;
 	}
 
-	if ((transfer->endpoint & LIBUSB_ENDPOINT_IN) != 0) {
-		for (i = 0; i < interface->BulkInPipes->Size; ++i) {
-			pipe_in = interface->BulkInPipes->GetAt(i);
+	libusb_ref_device(dev_handle->dev);
 
-			if ((LIBUSB_ENDPOINT_IN | pipe_in->EndpointDescriptor->EndpointNumber) == transfer->endpoint) {
-				libusb_ref_device(dev_handle->dev);
+	itransfer->submitted = true;
+	itransfer->sequence_number = _next_read_itransfer_sequence_number++;
 
-				itransfer->submitted = true;
-				itransfer->sequence_number = _next_read_itransfer_sequence_number++;
-				itransfer->reader = ref new DataReader(pipe_in->InputStream);
+	try {
+		itransfer->load_operation = itransfer->reader->LoadAsync(transfer->length);
+	} catch (...) { // FIXME: too generic
+		usbi_log_error(ctx, "Could not submit read transfer %p [%u] (length: %d): <exception>", // FIXME
+		               transfer, itransfer->sequence_number, transfer->length);
 
-				try {
-					itransfer->load_operation = itransfer->reader->LoadAsync(transfer->length);
-				} catch (...) { // FIXME: too generic
-					usbi_log_error(ctx, "Could not submit read transfer %p [%u] (length: %d): <exception>", // FIXME
-					               transfer, itransfer->sequence_number, transfer->length);
+		itransfer->submitted = false;
+		itransfer->reader = nullptr;
 
-					itransfer->submitted = false;
-					itransfer->reader = nullptr;
+		libusb_unref_device(dev_handle->dev);
 
-					libusb_unref_device(dev_handle->dev);
+		return LIBUSB_ERROR_NO_DEVICE; // FIXME: assumes that this happend because of device hotunplug
+	}
 
-					return LIBUSB_ERROR_NO_DEVICE; // FIXME: assumes that this happend because of device hotunplug
-				}
+	itransfer->load_operation->Completed = ref new AsyncOperationCompletedHandler<size_t>(
+	[ctx, itransfer](IAsyncOperation<size_t> ^operation, AsyncStatus status) {
+		struct libusb_transfer *transfer = &itransfer->transfer;
 
-				itransfer->load_operation->Completed = ref new AsyncOperationCompletedHandler<size_t>(
-				[ctx, itransfer](IAsyncOperation<size_t> ^operation, AsyncStatus status) {
-					struct libusb_transfer *transfer = &itransfer->transfer;
-					Array<unsigned char> ^data;
+		usbi_set_transfer_status(transfer, operation, status);
 
-					usbi_set_transfer_status(transfer, operation, status);
+		if (transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length > 0) {
+			// read straight into the transfer buffer
+			itransfer->reader->ReadBytes(ArrayReference<unsigned char>(transfer->buffer,
+			                                                            transfer->actual_length));
+		}
 
-					if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-						data = ref new Array<unsigned char>(transfer->actual_length);
+		itransfer->completed = true;
 
-						itransfer->reader->ReadBytes(data);
+		usbi_log_debug(ctx, "Read transfer %p [%u] completed (length: %d, status: %d)",
+		               transfer, itransfer->sequence_number,
+		               transfer->actual_length, transfer->status);
 
-						memcpy(transfer->buffer, data->Data, transfer->actual_length);
-					}
+		usbi_trigger_event(ctx);
+	});
 
-					itransfer->triggered = true;
-					itransfer->completed = true;
+	node_insert_before(&dev_handle->read_itransfer_sentinel, &itransfer->node);
 
-					usbi_log_debug(ctx, "Read transfer %p [%u] completed (length: %d, status: %d)",
-					               transfer, itransfer->sequence_number,
-					               transfer->actual_length, transfer->status);
+	return LIBUSB_SUCCESS;
+}
 
-					if (usbi_write(ctx->event_pipe[1], nullptr, 1) != 1) {
-						usbi_log_error(ctx, "usbi_write failed: %d", errno); // FIXME
-					}
-				});
+static int usbi_submit_write_transfer(usbi_transfer *itransfer) {
+	struct libusb_transfer *transfer = &itransfer->transfer;
+	libusb_device_handle *dev_handle = transfer->dev_handle;
+	libusb_context *ctx = dev_handle->dev->ctx;
+	UsbBulkOutPipe ^pipe_out;
 
-				node_insert_before(&dev_handle->read_itransfer_sentinel,
-				                   &itransfer->node);
+	if (itransfer->writer == nullptr || !usbi_is_same_pipe(itransfer)) {
+		pipe_out = usbi_find_bulk_out_pipe(dev_handle, transfer->endpoint);
 
-				return LIBUSB_SUCCESS;
-			}
+		if (pipe_out == nullptr) {
+			return LIBUSB_ERROR_NOT_FOUND;
 		}
-	} else {
-		for (i = 0; i < interface->BulkOutPipes->Size; ++i) {
-			pipe_out = interface->BulkOutPipes->GetAt(i);
 
-			if (pipe_out->EndpointDescriptor->EndpointNumber == transfer->endpoint) {
-				libusb_ref_device(dev_handle->dev);
+		itransfer->dev_handle_id = dev_handle->id;
+		itransfer->pipe_endpoint = transfer->endpoint;
+		itransfer->reader = nullptr;
+		itransfer->writer = ref new DataWriter(pipe_out->OutputStream);
+	}
 
-				itransfer->submitted = true;
-				itransfer->sequence_number = _next_write_itransfer_sequence_number++;
-				itransfer->writer = ref new DataWriter(pipe_out->OutputStream);
+	libusb_ref_device(dev_handle->dev);
 
-				data = ref new Array<unsigned char>(transfer->length);
+	itransfer->submitted = true;
+	itransfer->sequence_number = _next_write_itransfer_sequence_number++;
 
-				memcpy(data->Data, transfer->buffer, transfer->length);
+	// write straight from the transfer buffer
+	itransfer->writer->WriteBytes(ArrayReference<unsigned char>(transfer->buffer,
+	                                                            transfer->length));
 
-				itransfer->writer->WriteBytes(data);
+	try {
+		itransfer->store_operation = itransfer->writer->StoreAsync();
+	} catch (...) { // FIXME: too generic
+		usbi_log_error(ctx, "Could not submit write transfer %p [%u] (length: %d): <exception>", // FIXME
+		               transfer, itransfer->sequence_number, transfer->length);
 
-				try {
-					itransfer->store_operation = itransfer->writer->StoreAsync();
-				} catch (...) { // FIXME: too generic
-					usbi_log_error(ctx, "Could not submit write transfer %p [%u] (length: %d): <exception>", // FIXME
-					               transfer, itransfer->sequence_number, transfer->length);
+		itransfer->submitted = false;
+		itransfer->writer = nullptr;
 
-					itransfer->submitted = false;
-					itransfer->writer = nullptr;
+		libusb_unref_device(dev_handle->dev);
 
-					libusb_unref_device(dev_handle->dev);
+		return LIBUSB_ERROR_NO_DEVICE; // FIXME: assumes that this happend because of device hotunplug
+	}
 
-					return LIBUSB_ERROR_NO_DEVICE; // FIXME: assumes that this happend because of device hotunplug
-				}
+	itransfer->store_operation->Completed = ref new AsyncOperationCompletedHandler<size_t>(
+	[ctx, itransfer](IAsyncOperation<size_t> ^operation, AsyncStatus status) {
+		struct libusb_transfer *transfer = &itransfer->transfer;
 
-				itransfer->store_operation->Completed = ref new AsyncOperationCompletedHandler<size_t>(
-				[ctx, itransfer](IAsyncOperation<size_t> ^operation, AsyncStatus status) {
-					struct libusb_transfer *transfer = &itransfer->transfer;
+		usbi_set_transfer_status(transfer, operation, status);
 
-					usbi_set_transfer_status(transfer, operation, status);
+		itransfer->completed = true;
 
-					itransfer->triggered = true;
-					itransfer->completed = true;
+		usbi_log_debug(ctx, "Write transfer %p [%u] completed (length: %d, status: %d)",
+		               transfer, itransfer->sequence_number,
+		               transfer->actual_length, transfer->status);
 
-					usbi_log_debug(ctx, "Write transfer %p [%u] completed (length: %d, status: %d)",
-					               transfer, itransfer->sequence_number,
-					               transfer->actual_length, transfer->status);
+		usbi_trigger_event(ctx);
+	});
 
-					if (usbi_write(ctx->event_pipe[1], nullptr, 1) != 1) {
-						usbi_log_error(ctx, "usbi_write failed: %d", errno); // FIXME
-					}
-				});
+	node_insert_before(&dev_handle->write_itransfer_sentinel, &itransfer->node);
+
+	return LIBUSB_SUCCESS;
+}
 
-				node_insert_before(&dev_handle->write_itransfer_sentinel,
-				                   &itransfer->node);
+int libusb_submit_transfer(struct libusb_transfer *transfer) {
+	usbi_transfer *itransfer = (usbi_transfer *)transfer;
 
-				return LIBUSB_SUCCESS;
-			}
-		}
+	if (transfer->timeout != 0 || transfer->callback == nullptr) {
+		return LIBUSB_ERROR_INVALID_PARAM;
 	}
 
-	return LIBUSB_ERROR_NOT_FOUND;
+	if (itransfer->submitted) {
+		return LIBUSB_ERROR_BUSY;
+	}
+
+	if ((transfer->endpoint & LIBUSB_ENDPOINT_IN) != 0) {
+		return usbi_submit_read_transfer(itransfer);
+	} else {
+		return usbi_submit_write_transfer(itransfer);
+	}
 }
 
 int libusb_cancel_transfer(struct libusb_transfer *transfer) {
@@ -1455,6 +1562,10 @@ int libusb_cancel_transfer(struct libusb_transfer *transfer) {
 void libusb_free_transfer(struct libusb_transfer *transfer) {
 	usbi_transfer *itransfer = (usbi_transfer *)transfer;
 
+	// release the references, free doesn't do this
+	itransfer->reader = nullptr;
+	itransfer->writer = nullptr;
+
 	free(itransfer);
 }
 
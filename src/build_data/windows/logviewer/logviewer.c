@@ -20,6 +20,7 @@
  */
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -36,7 +37,9 @@ static HINSTANCE _hinstance = NULL;
 static HANDLE _event_log = NULL;
 static HWND _hwnd = NULL;
 static HMENU _view_menu = NULL;
+static HMENU _filter_menu = NULL;
 static HWND _status_bar = NULL;
+static HWND _source_filter_edit = NULL;
 static HWND _event_list_view = NULL;
 static HWND _debug_list_view = NULL;
 static HWND _current_list_view = NULL;
@@ -45,6 +48,49 @@ static int _debug_connected = 0;
 
 #define MAX_TIMESTAMP_LENGTH (26 + 1) // yyyy-mm-dd hh:mm:ss.uuuuuu
 #define MAX_RECORD_BUFFER_SIZE 0x10000 // 64k
+#define MAX_SOURCE_LENGTH 192
+#define MAX_DEBUG_ITEMS 0x20000 // 128k, must be a power of two
+#define MAX_PENDING_DEBUG_ITEMS 0x4000 // 16k
+#define DEBUG_FRAME_INTERVAL 50 // milliseconds
+#define SOURCE_FILTER_HEIGHT 24
+
+typedef enum {
+	LOG_LEVEL_ERROR = 0,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+} LogLevel;
+
+#define DEBUG_LEVEL_META -1
+
+typedef struct {
+	int level;
+	char timestamp[MAX_TIMESTAMP_LENGTH];
+	char source[MAX_SOURCE_LENGTH];
+	char message[1]; // allocated to fit the actual message
+} DebugItem;
+
+// the live debug log can receive thousands of messages per second. the named
+// pipe thread only queues them. the UI thread takes the queued items once per
+// frame and stores them in a bounded ring, the oldest items are discarded
+// first. the debug list view is an owner-data list view that only shows the
+// items of the ring that match the filter, it asks for the text of the items
+// it actually draws
+static CRITICAL_SECTION _debug_pending_lock;
+static DebugItem *_debug_pending_buffers[2][MAX_PENDING_DEBUG_ITEMS];
+static DebugItem **_debug_pending = _debug_pending_buffers[0]; // protected by _debug_pending_lock
+static int _debug_pending_count = 0; // protected by _debug_pending_lock
+static int _debug_dropped = 0; // protected by _debug_pending_lock
+static DebugItem *_debug_items[MAX_DEBUG_ITEMS]; // indexed by sequence number
+static uint32_t _debug_items_first = 0; // sequence number of the oldest item
+static uint32_t _debug_items_end = 0; // sequence number of the next item
+static uint32_t _debug_visible[MAX_DEBUG_ITEMS]; // sequence numbers of items matching the filter
+static uint32_t _debug_visible_start = 0;
+static int _debug_visible_count = 0;
+static int _debug_level_filter = LOG_LEVEL_DEBUG; // show items up to this level
+static char _debug_source_filter[MAX_SOURCE_LENGTH] = "";
+
+#define DEBUG_ITEM(sequence_number) _debug_items[(sequence_number) % MAX_DEBUG_ITEMS]
 
 static void report_error(const char *format, ...) {
 	char message[1024 + 1];
@@ -79,7 +125,12 @@ enum {
 	ID_FILE_SAVE,
 	ID_FILE_EXIT,
 	ID_VIEW_EVENT,
-	ID_VIEW_DEBUG
+	ID_VIEW_DEBUG,
+	ID_FILTER_LEVEL_ERROR, // has to be in LogLevel order
+	ID_FILTER_LEVEL_WARN,
+	ID_FILTER_LEVEL_INFO,
+	ID_FILTER_LEVEL_DEBUG,
+	ID_FILTER_SOURCE
 };
 
 static void create_menu(void) {
@@ -88,6 +139,7 @@ static void create_menu(void) {
 	MENUITEMINFO menu_item_info;
 
 	_view_menu = CreatePopupMenu();
+	_filter_menu = CreatePopupMenu();
 
 	AppendMenu(menu, MF_STRING | MF_POPUP, (UINT)file_menu, "&File");
 	AppendMenu(file_menu, MF_STRING, ID_FILE_SAVE, "&Save...");
@@ -113,6 +165,17 @@ static void create_menu(void) {
 
 	SetMenuItemInfo(_view_menu, ID_VIEW_DEBUG, FALSE, &menu_item_info);
 
+	AppendMenu(menu, MF_STRING | MF_POPUP, (UINT)_filter_menu, "F&ilter");
+	AppendMenu(_filter_menu, MF_STRING, ID_FILTER_LEVEL_DEBUG, "&All Levels");
+	AppendMenu(_filter_menu, MF_STRING, ID_FILTER_LEVEL_INFO, "&Info and Above");
+	AppendMenu(_filter_menu, MF_STRING, ID_FILTER_LEVEL_WARN, "&Warn and Above");
+	AppendMenu(_filter_menu, MF_STRING, ID_FILTER_LEVEL_ERROR, "&Error Only");
+	AppendMenu(_filter_menu, MF_SEPARATOR, 0, NULL);
+	AppendMenu(_filter_menu, MF_STRING, ID_FILTER_SOURCE, "&Source...");
+
+	CheckMenuRadioItem(_filter_menu, ID_FILTER_LEVEL_ERROR, ID_FILTER_LEVEL_DEBUG,
+	                   ID_FILTER_LEVEL_DEBUG, MF_BYCOMMAND);
+
 	SetMenu(_hwnd, menu);
 }
 
@@ -130,9 +193,14 @@ static void set_view_menu_item_state(UINT item, UINT state) {
 
 static void update_status_bar_message_count() {
 	int count = ListView_GetItemCount(_current_list_view);
+	int total = (int)(_debug_items_end - _debug_items_first);
 	char buffer[128];
 
-	_snprintf(buffer, sizeof(buffer), "%d Message%s", count, count == 1 ? "" : "s");
+	if (_current_list_view == _debug_list_view && count != total) {
+		_snprintf(buffer, sizeof(buffer), "%d of %d Message%s", count, total, total == 1 ? "" : "s");
+	} else {
+		_snprintf(buffer, sizeof(buffer), "%d Message%s", count, count == 1 ? "" : "s");
+	}
 
 	SendMessage(_status_bar, SB_SETTEXT, 2, (LPARAM)buffer);
 }
@@ -149,6 +217,40 @@ static void update_status_bar() {
 	update_status_bar_message_count();
 }
 
+static void layout_windows(void) {
+	RECT client_rect;
+	RECT status_bar_rect;
+	int width;
+	int height;
+	int top = 0;
+
+	GetClientRect(_hwnd, &client_rect);
+
+	if (_status_bar != NULL) {
+		SendMessage(_status_bar, WM_SIZE, 0, 0);
+		GetWindowRect(_status_bar, &status_bar_rect);
+		client_rect.bottom -= status_bar_rect.bottom - status_bar_rect.top;
+	}
+
+	width = client_rect.right - client_rect.left;
+	height = client_rect.bottom - client_rect.top;
+
+	if (_source_filter_edit != NULL) {
+		SetWindowPos(_source_filter_edit, NULL, 0, 0, width,
+		             SOURCE_FILTER_HEIGHT, SWP_NOZORDER);
+
+		top = SOURCE_FILTER_HEIGHT;
+	}
+
+	if (_event_list_view != NULL) {
+		SetWindowPos(_event_list_view, NULL, 0, 0, width, height, SWP_NOZORDER);
+	}
+
+	if (_debug_list_view != NULL) {
+		SetWindowPos(_debug_list_view, NULL, 0, top, width, height - top, SWP_NOZORDER);
+	}
+}
+
 static void set_current_list_view(HWND list_view) {
 	if (_current_list_view != NULL) {
 		ShowWindow(_current_list_view, SW_HIDE);
@@ -156,6 +258,8 @@ static void set_current_list_view(HWND list_view) {
 
 	_current_list_view = list_view;
 
+	ShowWindow(_source_filter_edit, list_view == _debug_list_view ? SW_SHOW : SW_HIDE);
+
 	set_view_menu_item_state(ID_VIEW_EVENT, list_view == _event_list_view ? MFS_CHECKED : MFS_UNCHECKED);
 	set_view_menu_item_state(ID_VIEW_DEBUG, list_view == _debug_list_view ? MFS_CHECKED : MFS_UNCHECKED);
 
@@ -202,7 +306,8 @@ static int insert_list_view_column(HWND list_view, int sub_item, int width,
 }
 
 enum {
-	IDC_STATUSBAR = 1
+	IDC_STATUSBAR = 1,
+	IDC_SOURCE_FILTER = 1000 // sends WM_COMMAND, must not overlap with the menu IDs
 };
 
 static int create_status_bar(void) {
@@ -234,6 +339,40 @@ static int create_status_bar(void) {
 	return 0;
 }
 
+static int create_source_filter_edit(void) {
+	int rc;
+
+	_source_filter_edit = CreateWindowEx(WS_EX_CLIENTEDGE,
+	                                     "EDIT",
+	                                     "",
+	                                     WS_CHILD | ES_AUTOHSCROLL,
+	                                     0, 0, 0, 0,
+	                                     _hwnd,
+	                                     (HMENU)IDC_SOURCE_FILTER,
+	                                     _hinstance,
+	                                     NULL);
+
+	if (_source_filter_edit == NULL) {
+		rc = GetLastError();
+
+		report_error("Could not create source filter: %s (%d)",
+		             get_error_name(rc), rc);
+
+		return -1;
+	}
+
+	SendMessage(_source_filter_edit, WM_SETFONT,
+	            (WPARAM)GetStockObject(DEFAULT_GUI_FONT), FALSE);
+	SendMessage(_source_filter_edit, EM_LIMITTEXT, sizeof(_debug_source_filter) - 1, 0);
+
+#ifdef EM_SETCUEBANNER
+	SendMessage(_source_filter_edit, EM_SETCUEBANNER, FALSE,
+	            (LPARAM)L"Filter by source, for example usb or client.c");
+#endif
+
+	return 0;
+}
+
 static int create_event_list_view(void) {
 	RECT client_rect;
 	int rc;
@@ -282,7 +421,7 @@ static int create_debug_list_view(void) {
 
 	_debug_list_view = CreateWindow(WC_LISTVIEW,
 	                                "",
-	                                WS_CHILD | LVS_REPORT |
+	                                WS_CHILD | LVS_REPORT | LVS_OWNERDATA |
 	                                LVS_SHOWSELALWAYS | LVS_NOSORTHEADER,
 	                                0, 0,
 	                                client_rect.right - client_rect.left,
@@ -302,8 +441,8 @@ static int create_debug_list_view(void) {
 	}
 
 	ListView_SetExtendedListViewStyleEx(_debug_list_view,
-	                                    LVS_EX_FULLROWSELECT,
-	                                    LVS_EX_FULLROWSELECT);
+	                                    LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER,
+	                                    LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
 
 	if (insert_list_view_column(_debug_list_view, 0, 160, "Timestamp") < 0 ||
 	    insert_list_view_column(_debug_list_view, 1,  60, "Level") < 0 ||
@@ -347,42 +486,6 @@ static void append_event_item(const char *timestamp, const char *level,
 	update_status_bar_message_count();
 }
 
-static void append_debug_item(const char *timestamp, const char *level,
-                              const char *source, const char *message) {
-	SCROLLINFO si;
-	LVITEM lvi;
-
-	si.cbSize = sizeof(si);
-	si.fMask = SIF_RANGE | SIF_POS | SIF_PAGE;
-
-	GetScrollInfo(_debug_list_view, SB_VERT, &si);
-
-	lvi.mask = LVIF_TEXT;
-
-	lvi.iItem = ListView_GetItemCount(_debug_list_view);
-	lvi.iSubItem = 0;
-	lvi.pszText = (char *)timestamp;
-	ListView_InsertItem(_debug_list_view, &lvi);
-
-	lvi.iSubItem = 1;
-	lvi.pszText = (char *)level;
-	ListView_SetItem(_debug_list_view, &lvi);
-
-	lvi.iSubItem = 2;
-	lvi.pszText = (char *)source;
-	ListView_SetItem(_debug_list_view, &lvi);
-
-	lvi.iSubItem = 3;
-	lvi.pszText = (char *)message;
-	ListView_SetItem(_debug_list_view, &lvi);
-
-	if (si.nPos >= si.nMax - (int)si.nPage) {
-		ListView_EnsureVisible(_debug_list_view, lvi.iItem, FALSE);
-	}
-
-	update_status_bar_message_count();
-}
-
 static void format_timestamp(uint64_t seconds, int microseconds,
                              char *buffer, int length, char *date_separator,
                              char *date_time_separator, char *time_separator) {
@@ -411,13 +514,6 @@ static void format_timestamp(uint64_t seconds, int microseconds,
 	}
 }
 
-typedef enum {
-	LOG_LEVEL_ERROR = 0,
-	LOG_LEVEL_WARN,
-	LOG_LEVEL_INFO,
-	LOG_LEVEL_DEBUG
-} LogLevel;
-
 typedef enum { // bitmask
 	LOG_PIPE_MESSAGE_FLAG_LIBUSB = 0x0001
 } LogPipeMessageFlag;
@@ -437,31 +533,260 @@ typedef struct {
 
 #pragma pack(pop)
 
+static const char *get_level_name(int level) {
+	switch (level) {
+	case DEBUG_LEVEL_META: return "Meta";
+	case LOG_LEVEL_ERROR:  return "Error";
+	case LOG_LEVEL_WARN:   return "Warn";
+	case LOG_LEVEL_INFO:   return "Info";
+	case LOG_LEVEL_DEBUG:  return "Debug";
+	default:               return "<unknown>";
+	}
+}
+
+static DebugItem *create_debug_item(const char *timestamp, int level,
+                                    const char *source, const char *message) {
+	size_t length = strlen(message);
+	DebugItem *item = (DebugItem *)malloc(offsetof(DebugItem, message) + length + 1);
+
+	if (item == NULL) {
+		return NULL;
+	}
+
+	item->level = level;
+
+	lstrcpyn(item->timestamp, timestamp, sizeof(item->timestamp));
+	lstrcpyn(item->source, source, sizeof(item->source));
+	memcpy(item->message, message, length + 1);
+
+	return item;
+}
+
+// called by the named pipe thread, takes ownership of the item
+static void queue_debug_item(DebugItem *item) {
+	EnterCriticalSection(&_debug_pending_lock);
+
+	if (item != NULL && _debug_pending_count < MAX_PENDING_DEBUG_ITEMS) {
+		_debug_pending[_debug_pending_count++] = item;
+		item = NULL;
+	} else {
+		++_debug_dropped;
+	}
+
+	LeaveCriticalSection(&_debug_pending_lock);
+
+	free(item);
+}
+
+static int contains_ignore_case(const char *haystack, const char *needle) {
+	size_t length = strlen(needle);
+
+	if (length == 0) {
+		return 1;
+	}
+
+	for (; *haystack != '\0'; ++haystack) {
+		if (_strnicmp(haystack, needle, length) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int debug_item_matches_filter(DebugItem *item) {
+	// meta messages report the connection state, never hide them
+	if (item->level == DEBUG_LEVEL_META) {
+		return 1;
+	}
+
+	return item->level <= _debug_level_filter &&
+	       contains_ignore_case(item->source, _debug_source_filter);
+}
+
+static DebugItem *get_visible_debug_item(int index) {
+	if (index < 0 || index >= _debug_visible_count) {
+		return NULL;
+	}
+
+	return DEBUG_ITEM(_debug_visible[(_debug_visible_start + index) % MAX_DEBUG_ITEMS]);
+}
+
+// called by the UI thread, takes ownership of the item. returns 1 if a
+// visible item got discarded to make room for the new item
+static int store_debug_item(DebugItem *item) {
+	int discarded = 0;
+
+	if (_debug_items_end - _debug_items_first == MAX_DEBUG_ITEMS) {
+		// the visible items are in the same order as the stored items, so
+		// if the oldest item is visible then it's the first visible item
+		if (_debug_visible_count > 0 &&
+		    _debug_visible[_debug_visible_start] == _debug_items_first) {
+			_debug_visible_start = (_debug_visible_start + 1) % MAX_DEBUG_ITEMS;
+			--_debug_visible_count;
+			discarded = 1;
+		}
+
+		free(DEBUG_ITEM(_debug_items_first));
+
+		++_debug_items_first;
+	}
+
+	DEBUG_ITEM(_debug_items_end) = item;
+
+	if (debug_item_matches_filter(item)) {
+		_debug_visible[(_debug_visible_start + _debug_visible_count) % MAX_DEBUG_ITEMS] = _debug_items_end;
+		++_debug_visible_count;
+	}
+
+	++_debug_items_end;
+
+	return discarded;
+}
+
+// called once per frame by the UI thread
+static void update_debug_list_view(void) {
+	DebugItem **pending;
+	int pending_count;
+	int dropped;
+	int previous_count = _debug_visible_count;
+	int top_index;
+	int following;
+	int discarded = 0;
+	int i;
+	char timestamp[MAX_TIMESTAMP_LENGTH];
+	char message[128];
+	DebugItem *item;
+	RECT item_rect;
+
+	EnterCriticalSection(&_debug_pending_lock);
+
+	pending = _debug_pending;
+	pending_count = _debug_pending_count;
+	dropped = _debug_dropped;
+
+	if (_debug_pending == _debug_pending_buffers[0]) {
+		_debug_pending = _debug_pending_buffers[1];
+	} else {
+		_debug_pending = _debug_pending_buffers[0];
+	}
+
+	_debug_pending_count = 0;
+	_debug_dropped = 0;
+
+	LeaveCriticalSection(&_debug_pending_lock);
+
+	if (pending_count == 0 && dropped == 0) {
+		return;
+	}
+
+	// keep following new items, if the last item is visible
+	top_index = ListView_GetTopIndex(_debug_list_view);
+	following = top_index + ListView_GetCountPerPage(_debug_list_view) >= previous_count;
+
+	for (i = 0; i < pending_count; ++i) {
+		discarded += store_debug_item(pending[i]);
+	}
+
+	if (dropped > 0) {
+		format_timestamp(time(NULL), 0, timestamp, sizeof(timestamp), "-", " ", ":");
+		_snprintf(message, sizeof(message), "Dropped %d message%s, Log Viewer could not keep up",
+		          dropped, dropped == 1 ? "" : "s");
+
+		item = create_debug_item(timestamp, DEBUG_LEVEL_META, "", message);
+
+		if (item != NULL) {
+			discarded += store_debug_item(item);
+		}
+	}
+
+	ListView_SetItemCountEx(_debug_list_view, _debug_visible_count,
+	                        LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL);
+
+	if (discarded > 0) {
+		// all visible items moved up by the number of discarded items
+		InvalidateRect(_debug_list_view, NULL, FALSE);
+	}
+
+	if (following) {
+		if (_debug_visible_count > 0) {
+			ListView_EnsureVisible(_debug_list_view, _debug_visible_count - 1, FALSE);
+		}
+	} else if (discarded > 0 &&
+	           ListView_GetItemRect(_debug_list_view, 0, &item_rect, LVIR_BOUNDS)) {
+		// keep the same items in view
+		ListView_Scroll(_debug_list_view, 0, -discarded * (item_rect.bottom - item_rect.top));
+	}
+
+	update_status_bar_message_count();
+}
+
+// called by the UI thread after the filter changed
+static void apply_debug_filter(void) {
+	uint32_t sequence_number;
+
+	_debug_visible_start = 0;
+	_debug_visible_count = 0;
+
+	for (sequence_number = _debug_items_first; sequence_number != _debug_items_end; ++sequence_number) {
+		if (debug_item_matches_filter(DEBUG_ITEM(sequence_number))) {
+			_debug_visible[_debug_visible_count++] = sequence_number;
+		}
+	}
+
+	ListView_SetItemCountEx(_debug_list_view, _debug_visible_count, 0);
+
+	if (_debug_visible_count > 0) {
+		ListView_EnsureVisible(_debug_list_view, _debug_visible_count - 1, FALSE);
+	}
+
+	update_status_bar_message_count();
+}
+
+static void set_debug_level_filter(int level) {
+	_debug_level_filter = level;
+
+	CheckMenuRadioItem(_filter_menu, ID_FILTER_LEVEL_ERROR, ID_FILTER_LEVEL_DEBUG,
+	                   ID_FILTER_LEVEL_ERROR + level, MF_BYCOMMAND);
+
+	apply_debug_filter();
+}
+
+static void get_debug_item_text(LVITEM *lvi) {
+	DebugItem *item = get_visible_debug_item(lvi->iItem);
+	const char *text;
+
+	if ((lvi->mask & LVIF_TEXT) == 0 || item == NULL) {
+		return;
+	}
+
+	switch (lvi->iSubItem) {
+	case 0:  text = item->timestamp;              break;
+	case 1:  text = get_level_name(item->level);  break;
+	case 2:  text = item->source;                 break;
+	default: text = item->message;                break;
+	}
+
+	lstrcpyn(lvi->pszText, text, lvi->cchTextMax);
+}
+
 static void append_debug_meta_message(const char *message) {
 	char timestamp[MAX_TIMESTAMP_LENGTH];
 
 	format_timestamp(time(NULL), 0, timestamp, sizeof(timestamp), "-", " ", ":");
 
-	append_debug_item(timestamp, "Meta", "", message);
+	queue_debug_item(create_debug_item(timestamp, DEBUG_LEVEL_META, "", message));
 }
 
 static void append_debug_pipe_message(LogPipeMessage *pipe_message) {
 	char timestamp[MAX_TIMESTAMP_LENGTH];
 	uint64_t seconds = pipe_message->timestamp / 1000000;
 	int microseconds = pipe_message->timestamp % 1000000;
-	const char *level = "<unknown>";
-	char source[192];
+	char source[MAX_SOURCE_LENGTH];
 
 	format_timestamp(seconds, microseconds, timestamp, sizeof(timestamp),
 	                 "-", " ", ":");
 
-	switch (pipe_message->level) {
-	case LOG_LEVEL_ERROR: level = "Error"; break;
-	case LOG_LEVEL_WARN:  level = "Warn";  break;
-	case LOG_LEVEL_INFO:  level = "Info";  break;
-	case LOG_LEVEL_DEBUG: level = "Debug"; break;
-	}
-
 	if ((pipe_message->flags & LOG_PIPE_MESSAGE_FLAG_LIBUSB) != 0) {
 		_snprintf(source, sizeof(source), "libusb:%s", pipe_message->source);
 	} else {
@@ -469,7 +794,8 @@ static void append_debug_pipe_message(LogPipeMessage *pipe_message) {
 		          pipe_message->line);
 	}
 
-	append_debug_item(timestamp, level, source, pipe_message->message);
+	queue_debug_item(create_debug_item(timestamp, pipe_message->level, source,
+	                                   pipe_message->message));
 }
 
 // this thread works in a fire-and-forget fashion, it's started and then just runs
@@ -728,15 +1054,7 @@ static void save_debug_log(void) {
 	char *filters = "Log Files (*.log, *.txt)\0*.log;*.txt\0\0";
 	OPENFILENAME ofn;
 	FILE *fp;
-	int count;
-	LVITEM lvi_timestamp;
-	char timestamp[128];
-	LVITEM lvi_level;
-	char level[64];
-	LVITEM lvi_source;
-	char source[192];
-	LVITEM lvi_message;
-	char message[1024];
+	DebugItem *item;
 	int i;
 
 	format_timestamp(time(NULL), -1, save_timestamp, sizeof(save_timestamp), "", "_", "");
@@ -762,63 +1080,30 @@ static void save_debug_log(void) {
 
 	if (fp == NULL) {
 		report_error("Could not write to '%s'", save_filename);
-	}
-
-	count = ListView_GetItemCount(_debug_list_view);
-
-	lvi_timestamp.iSubItem = 0;
-	lvi_timestamp.mask = LVIF_TEXT;
-	lvi_timestamp.pszText = timestamp;
-	lvi_timestamp.cchTextMax = sizeof(timestamp) - 1;
-
-	lvi_level.iSubItem = 1;
-	lvi_level.mask = LVIF_TEXT;
-	lvi_level.pszText = level;
-	lvi_level.cchTextMax = sizeof(level) - 1;
-
-	lvi_source.iSubItem = 2;
-	lvi_source.mask = LVIF_TEXT;
-	lvi_source.pszText = source;
-	lvi_source.cchTextMax = sizeof(source) - 1;
-
-	lvi_message.iSubItem = 3;
-	lvi_message.mask = LVIF_TEXT;
-	lvi_message.pszText = message;
-	lvi_message.cchTextMax = sizeof(message) - 1;
-
-	for (i = 0; i < count; ++i) {
-		lvi_timestamp.iItem = i;
-		lvi_level.iItem = i;
-		lvi_source.iItem = i;
-		lvi_message.iItem = i;
-
-		if (!ListView_GetItem(_debug_list_view, &lvi_timestamp)) {
-			strcpy(timestamp, "<unknown>");
-		}
 
-		if (!ListView_GetItem(_debug_list_view, &lvi_level)) {
-			strcpy(level, "unknown");
-		}
+		return;
+	}
 
-		if (!ListView_GetItem(_debug_list_view, &lvi_source)) {
-			strcpy(source, "unknown");
-		}
+	// saves the items matching the current filter
+	for (i = 0; i < _debug_visible_count; ++i) {
+		item = get_visible_debug_item(i);
 
-		if (!ListView_GetItem(_debug_list_view, &lvi_message)) {
-			strcpy(message, "<unknown>");
-		}
-
-		fprintf(fp, "%s <%s> <%s> %s\r\n", timestamp, level, source, message);
+		fprintf(fp, "%s <%s> <%s> %s\r\n", item->timestamp,
+		        get_level_name(item->level), item->source, item->message);
 	}
 
 	fclose(fp);
 }
 
+enum {
+	ID_TIMER_EVENT_LOG = 1,
+	ID_TIMER_DEBUG_FRAME
+};
+
 static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg,
                                     WPARAM wparam, LPARAM lparam) {
-	RECT client_rect;
-	RECT status_bar_rect;
 	MINMAXINFO *info;
+	NMHDR *nmhdr;
 
 	switch(msg) {
 	case WM_CLOSE:
@@ -830,25 +1115,7 @@ static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg,
 		break;
 
 	case WM_SIZE:
-		GetClientRect(hwnd, &client_rect);
-		SendMessage(_status_bar, WM_SIZE, 0, 0);
-		GetWindowRect(_status_bar, &status_bar_rect);
-		client_rect.bottom -= status_bar_rect.bottom - status_bar_rect.top;
-
-		if (_event_list_view != NULL) {
-			SetWindowPos(_event_list_view, NULL, 0, 0,
-			             client_rect.right - client_rect.left,
-			             client_rect.bottom - client_rect.top,
-			             SWP_NOMOVE);
-		}
-
-		if (_debug_list_view != NULL) {
-			SetWindowPos(_debug_list_view, NULL, 0, 0,
-			             client_rect.right - client_rect.left,
-			             client_rect.bottom - client_rect.top,
-			             SWP_NOMOVE);
-		}
-
+		layout_windows();
 		break;
 
 	case WM_GETMINMAXINFO:
@@ -858,7 +1125,21 @@ static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg,
 		break;
 
 	case WM_TIMER:
-		read_event_log();
+		if (wparam == ID_TIMER_EVENT_LOG) {
+			read_event_log();
+		} else if (wparam == ID_TIMER_DEBUG_FRAME) {
+			update_debug_list_view();
+		}
+
+		break;
+
+	case WM_NOTIFY:
+		nmhdr = (NMHDR *)lparam;
+
+		if (nmhdr->hwndFrom == _debug_list_view && nmhdr->code == LVN_GETDISPINFO) {
+			get_debug_item_text(&((NMLVDISPINFO *)lparam)->item);
+		}
+
 		break;
 
 	case WM_COMMAND:
@@ -883,6 +1164,27 @@ static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg,
 		case ID_VIEW_DEBUG:
 			set_current_list_view(_debug_list_view);
 			break;
+
+		case ID_FILTER_LEVEL_ERROR:
+		case ID_FILTER_LEVEL_WARN:
+		case ID_FILTER_LEVEL_INFO:
+		case ID_FILTER_LEVEL_DEBUG:
+			set_debug_level_filter(LOWORD(wparam) - ID_FILTER_LEVEL_ERROR);
+			break;
+
+		case ID_FILTER_SOURCE:
+			set_current_list_view(_debug_list_view);
+			SetFocus(_source_filter_edit);
+			break;
+
+		case IDC_SOURCE_FILTER:
+			if (HIWORD(wparam) == EN_CHANGE) {
+				GetWindowText(_source_filter_edit, _debug_source_filter,
+				              sizeof(_debug_source_filter));
+				apply_debug_filter();
+			}
+
+			break;
 		}
 
 		break;
@@ -906,6 +1208,8 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
 	_hinstance = hInstance;
 
+	InitializeCriticalSection(&_debug_pending_lock);
+
 	_event_log = OpenEventLog(NULL, "Brick Daemon");
 
 	if (_event_log == NULL) {
@@ -970,6 +1274,7 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
 	if (init_common_controls() < 0 ||
 	    create_status_bar() < 0 ||
+	    create_source_filter_edit() < 0 ||
 	    create_event_list_view() < 0 ||
 	    create_debug_list_view() < 0) {
 		CloseEventLog(_event_log);
@@ -977,6 +1282,7 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 		return 0;
 	}
 
+	layout_windows();
 	set_current_list_view(_event_list_view);
 
 	ShowWindow(_hwnd, nCmdShow);
@@ -991,7 +1297,8 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
 	read_event_log();
 
-	SetTimer(_hwnd, 1, 200, (TIMERPROC)NULL);
+	SetTimer(_hwnd, ID_TIMER_EVENT_LOG, 200, (TIMERPROC)NULL);
+	SetTimer(_hwnd, ID_TIMER_DEBUG_FRAME, DEBUG_FRAME_INTERVAL, (TIMERPROC)NULL);
 
 	while ((rc = GetMessage(&msg, NULL, 0, 0)) != 0) {
 		if (rc < 0) {
@@ -0,0 +1,502 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * benchmark.c: Latency, throughput and callback fan-out benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * the benchmark talks TFP to a running brickd over plain TCP and WebSocket
+ * and reports the results as JSON to compare brickd releases:
+ *
+ * - sequential: one request at a time, latency percentiles
+ * - pipelined: a fixed number of outstanding requests, requests per second
+ * - fanout: one client enumerates, all clients receive the callbacks
+ *
+ * without --uid the requests go to brickd itself (get-authentication-nonce),
+ * this measures network and dispatch without any device. with --uid the
+ * get-identity request of that device is used instead
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/base58.h>
+#include <daemonlib/utils.h>
+
+#include "tfp_client.h"
+
+#define MAX_CLIENTS 128
+#define POLL_TIMEOUT 100 // msec
+#define CALIBRATION_TIMEOUT 500 // msec
+
+typedef struct {
+	const char *host;
+	uint16_t port;
+	uint16_t websocket_port;
+	uint32_t uid;
+	const char *uid_string;
+	int requests;
+	int outstanding;
+	int clients;
+	int rounds;
+	const char *output;
+} Options;
+
+typedef struct {
+	uint64_t *samples; // latency per completed request
+	int completed;
+} Run;
+
+static Options _options;
+static FILE *_output;
+static bool _first_result = true;
+
+static void fail(const char *message) {
+	fprintf(stderr, "error: %s\n", message);
+
+	exit(EXIT_FAILURE);
+}
+
+static int compare_uint64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// expects sorted samples
+static uint64_t percentile(uint64_t *samples, int count, int percent) {
+	int index = (count * percent + 99) / 100 - 1;
+
+	if (index < 0) {
+		index = 0;
+	}
+
+	return samples[index];
+}
+
+static double mean(uint64_t *samples, int count) {
+	double sum = 0;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		sum += (double)samples[i];
+	}
+
+	return count > 0 ? sum / count : 0;
+}
+
+static void poll_clients(TFPClient **clients, int count) {
+	if (tfp_client_poll(clients, count, POLL_TIMEOUT) < 0) {
+		fail("could not receive from brickd");
+	}
+}
+
+static void handle_response(TFPClient *client, const uint8_t *response,
+                            uint64_t latency, void *opaque) {
+	Run *run = opaque;
+
+	(void)client;
+
+	if (response == NULL) {
+		fail("timeout while waiting for response");
+	}
+
+	if ((response[7] >> 6) != 0) {
+		fail("request failed with an error code");
+	}
+
+	run->samples[run->completed++] = latency;
+}
+
+static void send_request(TFPClient *client, Run *run) {
+	uint8_t function_id = _options.uid == TFP_UID_BRICK_DAEMON
+	                      ? TFP_FUNCTION_GET_AUTHENTICATION_NONCE
+	                      : TFP_FUNCTION_GET_IDENTITY;
+
+	if (tfp_client_send_request(client, _options.uid, function_id, NULL, 0,
+	                            handle_response, run) < 0) {
+		fail("could not send request");
+	}
+}
+
+static void open_client(TFPClient *client, uint16_t port, bool websocket) {
+	if (tfp_client_open(client, _options.host, port, websocket) < 0) {
+		fail("could not connect to brickd");
+	}
+}
+
+static void begin_result(const char *name, bool websocket) {
+	fprintf(_output, "%s\n    {\"name\": \"%s\", \"transport\": \"%s\"",
+	        _first_result ? "" : ",", name, websocket ? "websocket" : "plain");
+
+	_first_result = false;
+}
+
+static void write_latencies(uint64_t *samples, int count) {
+	qsort(samples, count, sizeof(uint64_t), compare_uint64);
+
+	fprintf(_output, ", \"mean_us\": %.1f, \"min_us\": %llu, \"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu",
+	        mean(samples, count),
+	        (unsigned long long)samples[0],
+	        (unsigned long long)percentile(samples, count, 50),
+	        (unsigned long long)percentile(samples, count, 99),
+	        (unsigned long long)samples[count - 1]);
+}
+
+static void benchmark_sequential(uint16_t port, bool websocket) {
+	TFPClient client;
+	TFPClient *clients[1] = { &client };
+	Run run;
+	int i;
+
+	run.samples = calloc(_options.requests, sizeof(uint64_t));
+	run.completed = 0;
+
+	if (run.samples == NULL) {
+		fail("could not allocate samples");
+	}
+
+	fprintf(stderr, "sequential (%s): %d requests\n",
+	        websocket ? "websocket" : "plain", _options.requests);
+
+	open_client(&client, port, websocket);
+
+	for (i = 0; i < _options.requests; ++i) {
+		send_request(&client, &run);
+
+		while (run.completed <= i) {
+			poll_clients(clients, 1);
+		}
+	}
+
+	tfp_client_close(&client);
+
+	begin_result("sequential", websocket);
+	fprintf(_output, ", \"requests\": %d", _options.requests);
+	write_latencies(run.samples, _options.requests);
+	fprintf(_output, "}");
+
+	free(run.samples);
+}
+
+static void benchmark_pipelined(uint16_t port, bool websocket) {
+	TFPClient client;
+	TFPClient *clients[1] = { &client };
+	Run run;
+	int sent = 0;
+	uint64_t start;
+	uint64_t duration;
+
+	run.samples = calloc(_options.requests, sizeof(uint64_t));
+	run.completed = 0;
+
+	if (run.samples == NULL) {
+		fail("could not allocate samples");
+	}
+
+	fprintf(stderr, "pipelined (%s): %d requests, %d outstanding\n",
+	        websocket ? "websocket" : "plain", _options.requests, _options.outstanding);
+
+	open_client(&client, port, websocket);
+
+	start = microseconds();
+
+	while (run.completed < _options.requests) {
+		while (client.in_flight < _options.outstanding && sent < _options.requests) {
+			send_request(&client, &run);
+
+			++sent;
+		}
+
+		poll_clients(clients, 1);
+	}
+
+	duration = microseconds() - start;
+
+	tfp_client_close(&client);
+
+	begin_result("pipelined", websocket);
+	fprintf(_output, ", \"requests\": %d, \"outstanding\": %d, \"seconds\": %.6f, \"requests_per_second\": %.1f",
+	        _options.requests, _options.outstanding, duration / 1000000.0,
+	        duration > 0 ? _options.requests * 1000000.0 / duration : 0);
+	write_latencies(run.samples, _options.requests);
+	fprintf(_output, "}");
+
+	free(run.samples);
+}
+
+static void handle_callback(TFPClient *client, const uint8_t *packet, void *opaque) {
+	(void)client;
+
+	if (packet[5] == TFP_CALLBACK_ENUMERATE) {
+		++*(int *)opaque;
+	}
+}
+
+// polls until every client received the expected number of callbacks, or
+// until nothing was received for the timeout with expected < 0
+static bool wait_for_callbacks(TFPClient **clients, int *received, int expected,
+                               uint32_t timeout) {
+	uint64_t deadline = microseconds() + (uint64_t)timeout * 1000;
+	bool done;
+	int i;
+
+	for (;;) {
+		done = expected >= 0;
+
+		for (i = 0; done && i < _options.clients; ++i) {
+			done = received[i] >= expected;
+		}
+
+		if (done) {
+			return true;
+		}
+
+		if (microseconds() >= deadline) {
+			return expected < 0;
+		}
+
+		if (tfp_client_poll(clients, _options.clients, POLL_TIMEOUT) < 0) {
+			fail("could not receive from brickd");
+		}
+	}
+}
+
+static void benchmark_fanout(uint16_t port, bool websocket) {
+	TFPClient *clients[MAX_CLIENTS];
+	int received[MAX_CLIENTS];
+	uint64_t *samples = calloc(_options.rounds, sizeof(uint64_t));
+	uint64_t start;
+	uint64_t total = 0;
+	int devices;
+	int round;
+	int i;
+
+	if (samples == NULL) {
+		fail("could not allocate samples");
+	}
+
+	fprintf(stderr, "fanout (%s): %d clients, %d rounds\n",
+	        websocket ? "websocket" : "plain", _options.clients, _options.rounds);
+
+	for (i = 0; i < _options.clients; ++i) {
+		clients[i] = malloc(sizeof(TFPClient));
+
+		if (clients[i] == NULL) {
+			fail("could not allocate client");
+		}
+
+		open_client(clients[i], port, websocket);
+		tfp_client_set_callback(clients[i], handle_callback, &received[i]);
+
+		received[i] = 0;
+	}
+
+	// the number of devices is not known upfront
+	if (tfp_client_send_oneway(clients[0], 0, TFP_FUNCTION_ENUMERATE, NULL, 0) < 0) {
+		fail("could not send enumerate request");
+	}
+
+	wait_for_callbacks(clients, received, -1, CALIBRATION_TIMEOUT);
+
+	devices = received[0];
+
+	begin_result("fanout", websocket);
+	fprintf(_output, ", \"clients\": %d, \"devices\": %d", _options.clients, devices);
+
+	if (devices == 0) {
+		fprintf(stderr, "fanout (%s): skipped, no devices found\n",
+		        websocket ? "websocket" : "plain");
+
+		fprintf(_output, ", \"skipped\": true}");
+	} else {
+		for (round = 0; round < _options.rounds; ++round) {
+			memset(received, 0, sizeof(received));
+
+			start = microseconds();
+
+			if (tfp_client_send_oneway(clients[0], 0, TFP_FUNCTION_ENUMERATE, NULL, 0) < 0) {
+				fail("could not send enumerate request");
+			}
+
+			// the slowest client determines the round time
+			if (!wait_for_callbacks(clients, received, devices, 2500)) {
+				fail("timeout while waiting for enumerate callbacks");
+			}
+
+			samples[round] = microseconds() - start;
+			total += samples[round];
+		}
+
+		fprintf(_output, ", \"rounds\": %d", _options.rounds);
+		write_latencies(samples, _options.rounds);
+		fprintf(_output, ", \"callbacks_per_second\": %.1f}",
+		        total > 0 ? (double)_options.rounds * devices * _options.clients * 1000000.0 / total : 0);
+	}
+
+	for (i = 0; i < _options.clients; ++i) {
+		tfp_client_close(clients[i]);
+		free(clients[i]);
+	}
+
+	free(samples);
+}
+
+static void print_usage(const char *binary) {
+	fprintf(stderr,
+	        "Usage:\n"
+	        "  %s [--host <host>] [--port <port>] [--websocket-port <port>]\n"
+	        "     [--uid <uid>] [--requests <count>] [--outstanding <count>]\n"
+	        "     [--clients <count>] [--rounds <count>] [--output <file>]\n"
+	        "\n"
+	        "Options:\n"
+	        "  --host <host>            Host running brickd (default: localhost)\n"
+	        "  --port <port>            Plain TCP port, 0 to skip (default: 4223)\n"
+	        "  --websocket-port <port>  WebSocket port, 0 to skip (default: 4280)\n"
+	        "  --uid <uid>              Device to send get-identity requests to\n"
+	        "                           (default: brickd itself)\n"
+	        "  --requests <count>       Requests per latency/throughput run (default: 10000)\n"
+	        "  --outstanding <count>    Outstanding pipelined requests, 1-15 (default: 8)\n"
+	        "  --clients <count>        Clients for the callback fan-out (default: 8)\n"
+	        "  --rounds <count>         Enumerate rounds for the fan-out (default: 100)\n"
+	        "  --output <file>          Write JSON to a file instead of stdout\n",
+	        binary);
+}
+
+static int parse_count(const char *value, int min, int max) {
+	char *end = NULL;
+	long count = strtol(value, &end, 10);
+
+	if (end == value || *end != '\0' || count < min || count > max) {
+		fprintf(stderr, "error: invalid count '%s', expecting %d-%d\n", value, min, max);
+
+		exit(EXIT_FAILURE);
+	}
+
+	return (int)count;
+}
+
+static void run_transport(uint16_t port, bool websocket) {
+	if (port == 0) {
+		return;
+	}
+
+	benchmark_sequential(port, websocket);
+	benchmark_pipelined(port, websocket);
+	benchmark_fanout(port, websocket);
+}
+
+int main(int argc, char **argv) {
+	int i;
+	const char *value;
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (tfp_client_init() < 0) {
+		fail("could not initialize sockets");
+	}
+
+	_options.host = "localhost";
+	_options.port = 4223;
+	_options.websocket_port = 4280;
+	_options.uid = TFP_UID_BRICK_DAEMON;
+	_options.uid_string = NULL;
+	_options.requests = 10000;
+	_options.outstanding = 8;
+	_options.clients = 8;
+	_options.rounds = 100;
+	_options.output = NULL;
+
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			print_usage(argv[0]);
+
+			return EXIT_SUCCESS;
+		}
+
+		if (i + 1 >= argc) {
+			print_usage(argv[0]);
+
+			return EXIT_FAILURE;
+		}
+
+		value = argv[++i];
+
+		if (strcmp(argv[i - 1], "--host") == 0) {
+			_options.host = value;
+		} else if (strcmp(argv[i - 1], "--port") == 0) {
+			_options.port = (uint16_t)parse_count(value, 0, 65535);
+		} else if (strcmp(argv[i - 1], "--websocket-port") == 0) {
+			_options.websocket_port = (uint16_t)parse_count(value, 0, 65535);
+		} else if (strcmp(argv[i - 1], "--uid") == 0) {
+			if (base58_decode(&_options.uid, value) < 0) {
+				fail("invalid UID");
+			}
+
+			_options.uid_string = value;
+		} else if (strcmp(argv[i - 1], "--requests") == 0) {
+			_options.requests = parse_count(value, 1, 100000000);
+		} else if (strcmp(argv[i - 1], "--outstanding") == 0) {
+			_options.outstanding = parse_count(value, 1, TFP_MAX_IN_FLIGHT);
+		} else if (strcmp(argv[i - 1], "--clients") == 0) {
+			_options.clients = parse_count(value, 1, MAX_CLIENTS);
+		} else if (strcmp(argv[i - 1], "--rounds") == 0) {
+			_options.rounds = parse_count(value, 1, 1000000);
+		} else if (strcmp(argv[i - 1], "--output") == 0) {
+			_options.output = value;
+		} else {
+			print_usage(argv[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (_options.output != NULL) {
+		_output = fopen(_options.output, "w");
+
+		if (_output == NULL) {
+			fail("could not open output file");
+		}
+	} else {
+		_output = stdout;
+	}
+
+	fprintf(_output, "{\n  \"host\": \"%s\",\n  \"uid\": %s%s%s,\n  \"results\": [",
+	        _options.host,
+	        _options.uid_string != NULL ? "\"" : "",
+	        _options.uid_string != NULL ? _options.uid_string : "null",
+	        _options.uid_string != NULL ? "\"" : "");
+
+	run_transport(_options.port, false);
+	run_transport(_options.websocket_port, true);
+
+	fprintf(_output, "\n  ]\n}\n");
+
+	if (_output != stdout) {
+		fclose(_output);
+	}
+
+	tfp_client_exit();
+
+	return EXIT_SUCCESS;
+}
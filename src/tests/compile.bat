@@ -59,17 +59,47 @@ rem @set LD=link /nologo /debug
 @del *.obj *.res *.bin *.exp *.manifest
 
 
-%CC% throughput_test.c^
- ip_connection.c^
- brick_master.c^
+%CC% benchmark.c^
+ tfp_client.c^
  ..\brickd\fixes_msvc.c^
  ..\daemonlib\base58.c^
  ..\daemonlib\utils.c
 
-%LD% /out:throughput_test.exe *.obj *.res ws2_32.lib
+%LD% /out:benchmark.exe *.obj ws2_32.lib
 
-@if exist throughput_test.exe.manifest^
- %MT% /manifest throughput_test.exe.manifest -outputresource:throughput_test.exe
+@if exist benchmark.exe.manifest^
+ %MT% /manifest benchmark.exe.manifest -outputresource:benchmark.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% load_generator.c^
+ tfp_client.c^
+ ..\brickd\fixes_msvc.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:load_generator.exe *.obj ws2_32.lib
+
+@if exist load_generator.exe.manifest^
+ %MT% /manifest load_generator.exe.manifest -outputresource:load_generator.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% container_benchmark.c^
+ ..\brickd\fixes_msvc.c^
+ ..\daemonlib\array.c^
+ ..\daemonlib\queue.c^
+ ..\daemonlib\node.c^
+ ..\daemonlib\packet.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:container_benchmark.exe *.obj ws2_32.lib
+
+@if exist container_benchmark.exe.manifest^
+ %MT% /manifest container_benchmark.exe.manifest -outputresource:container_benchmark.exe
 
 @del *.obj *.res *.bin *.exp *.manifest
 
@@ -150,5 +180,110 @@ rem @set LD=link /nologo /debug
 @del *.obj *.res *.bin *.exp *.manifest
 
 
+%CC% websocket_mask_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\websocket_mask.c
+
+%LD% /out:websocket_mask_test.exe *.obj
+
+@if exist websocket_mask_test.exe.manifest^
+ %MT% /manifest websocket_mask_test.exe.manifest -outputresource:websocket_mask_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% spsc_ring_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\spsc_ring.c
+
+%LD% /out:spsc_ring_test.exe *.obj
+
+@if exist spsc_ring_test.exe.manifest^
+ %MT% /manifest spsc_ring_test.exe.manifest -outputresource:spsc_ring_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% pearson_hash_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\pearson_hash.c
+
+%LD% /out:pearson_hash_test.exe *.obj
+
+@if exist pearson_hash_test.exe.manifest^
+ %MT% /manifest pearson_hash_test.exe.manifest -outputresource:pearson_hash_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% fair_queue_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\fair_queue.c^
+ ..\daemonlib\queue.c^
+ ..\daemonlib\node.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:fair_queue_test.exe *.obj
+
+@if exist fair_queue_test.exe.manifest^
+ %MT% /manifest fair_queue_test.exe.manifest -outputresource:fair_queue_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% packet_ring_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\packet_ring.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:packet_ring_test.exe *.obj
+
+@if exist packet_ring_test.exe.manifest^
+ %MT% /manifest packet_ring_test.exe.manifest -outputresource:packet_ring_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% crc16_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\brickd\crc16.c
+
+%LD% /out:crc16_test.exe *.obj
+
+@if exist crc16_test.exe.manifest^
+ %MT% /manifest crc16_test.exe.manifest -outputresource:crc16_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% packet_debug_test.c^
+ ..\brickd\fixes_msvc.c^
+ ..\daemonlib\packet.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:packet_debug_test.exe *.obj
+
+@if exist packet_debug_test.exe.manifest^
+ %MT% /manifest packet_debug_test.exe.manifest -outputresource:packet_debug_test.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
+%CC% packet_log_decoder.c^
+ ..\brickd\fixes_msvc.c^
+ ..\daemonlib\base58.c^
+ ..\daemonlib\utils.c
+
+%LD% /out:packet_log_decoder.exe *.obj
+
+@if exist packet_log_decoder.exe.manifest^
+ %MT% /manifest packet_log_decoder.exe.manifest -outputresource:packet_log_decoder.exe
+
+@del *.obj *.res *.bin *.exp *.manifest
+
+
 :done
 @endlocal
@@ -0,0 +1,383 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * container_benchmark.c: Micro-benchmarks for the Array, Queue and Node types
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * measures the access patterns of the brickd hot paths and prints the average
+ * time per operation, as a baseline for judging data structure changes:
+ *
+ * - array: append and remove-at-index, as done for stacks and callback filters
+ *   and formerly for clients and zombies
+ * - queue: push, peek and pop of Packet sized items, as done for write queues
+ * - node: scans of 32k pending requests, over the global list and over the
+ *   bucketed index of network.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <daemonlib/array.h>
+#include <daemonlib/macros.h>
+#include <daemonlib/node.h>
+#include <daemonlib/packet.h>
+#include <daemonlib/queue.h>
+#include <daemonlib/utils.h>
+
+#define ARRAY_LENGTH 256
+#define ARRAY_ROUNDS 2000
+#define QUEUE_ROUNDS 1000000
+#define QUEUE_BATCH 64
+#define PENDING_REQUESTS 32768 // CLIENT_MAX_PENDING_REQUESTS
+#define PENDING_REQUEST_LOOKUPS 2000
+
+// same as in network.c
+#define PENDING_REQUEST_INDEX_BITS 10
+#define PENDING_REQUEST_INDEX_SIZE (1 << PENDING_REQUEST_INDEX_BITS)
+
+typedef enum {
+	ARRAY_FRONT = 0,
+	ARRAY_MIDDLE,
+	ARRAY_BACK,
+	ARRAY_RANDOM
+} ArrayPosition;
+
+// large enough that moving items dominates removal from relocatable arrays.
+// non-relocatable arrays allocate each item separately and move pointers only
+typedef struct {
+	uint8_t bytes[512];
+} LargeItem;
+
+// same layout as PendingRequest
+typedef struct {
+	Node global_node;
+	Node client_node;
+	Node index_node;
+	void *client;
+	void *zombie;
+	PacketHeader header;
+} Request;
+
+static uint32_t _random_state = 1;
+static volatile uint32_t _sink; // keeps the compiler from removing the work
+
+// xorshift, the same sequence on all platforms
+static uint32_t next_random(void) {
+	_random_state ^= _random_state << 13;
+	_random_state ^= _random_state >> 17;
+	_random_state ^= _random_state << 5;
+
+	return _random_state;
+}
+
+static void report(const char *name, uint64_t elapsed, uint64_t operations) {
+	printf("%-60s %10.1f nsec/op\n", name, (double)elapsed * 1000.0 / (double)operations);
+}
+
+static int benchmark_array(const char *name, int size, bool relocatable, ArrayPosition where) {
+	Array array;
+	uint64_t start;
+	uint64_t elapsed_append = 0;
+	uint64_t elapsed_remove = 0;
+	char buffer[128];
+	int round;
+	int i;
+	int k;
+	void *item;
+
+	if (array_create(&array, ARRAY_LENGTH, size, relocatable) < 0) {
+		printf("%s: array_create failed\n", name);
+
+		return -1;
+	}
+
+	for (round = 0; round < ARRAY_ROUNDS; ++round) {
+		start = microseconds();
+
+		for (i = 0; i < ARRAY_LENGTH; ++i) {
+			item = array_append(&array);
+
+			if (item == NULL) {
+				printf("%s: array_append failed\n", name);
+
+				return -1;
+			}
+
+			*(int *)item = i;
+		}
+
+		elapsed_append += microseconds() - start;
+		start = microseconds();
+
+		for (i = ARRAY_LENGTH; i > 0; --i) {
+			if (where == ARRAY_FRONT) {
+				k = 0;
+			} else if (where == ARRAY_MIDDLE) {
+				k = i / 2;
+			} else if (where == ARRAY_BACK) {
+				k = i - 1;
+			} else {
+				k = next_random() % i;
+			}
+
+			_sink += *(int *)array_get(&array, k);
+
+			array_remove(&array, k, NULL);
+		}
+
+		elapsed_remove += microseconds() - start;
+	}
+
+	array_destroy(&array, NULL);
+
+	snprintf(buffer, sizeof(buffer), "array append (%s)", name);
+	report(buffer, elapsed_append, (uint64_t)ARRAY_ROUNDS * ARRAY_LENGTH);
+
+	snprintf(buffer, sizeof(buffer), "array remove-at-index (%s)", name);
+	report(buffer, elapsed_remove, (uint64_t)ARRAY_ROUNDS * ARRAY_LENGTH);
+
+	return 0;
+}
+
+static int benchmark_queue(int batch) {
+	Queue queue;
+	uint64_t start;
+	uint64_t elapsed;
+	char buffer[128];
+	Packet *packet;
+	int round;
+	int i;
+
+	if (queue_create(&queue, sizeof(Packet)) < 0) {
+		printf("queue: queue_create failed\n");
+
+		return -1;
+	}
+
+	start = microseconds();
+
+	for (round = 0; round < QUEUE_ROUNDS / batch; ++round) {
+		for (i = 0; i < batch; ++i) {
+			packet = queue_push(&queue);
+
+			if (packet == NULL) {
+				printf("queue: queue_push failed\n");
+
+				return -1;
+			}
+
+			packet->header.uid = (uint32_t)i;
+			packet->header.length = sizeof(PacketHeader);
+		}
+
+		for (i = 0; i < batch; ++i) {
+			packet = queue_peek(&queue);
+
+			_sink += packet->header.uid;
+
+			queue_pop(&queue, NULL);
+		}
+	}
+
+	elapsed = microseconds() - start;
+
+	queue_destroy(&queue, NULL);
+
+	snprintf(buffer, sizeof(buffer), "queue push+peek+pop (Packet, depth %d)", batch);
+	report(buffer, elapsed, (uint64_t)(QUEUE_ROUNDS / batch) * batch);
+
+	return 0;
+}
+
+static Node *get_bucket(Node *index, PacketHeader *header) {
+	uint32_t hash = header->uid ^
+	                ((uint32_t)header->function_id << 16) ^
+	                ((uint32_t)packet_header_get_sequence_number(header) << 24);
+
+	hash *= 2654435761u;
+
+	return &index[hash >> (32 - PENDING_REQUEST_INDEX_BITS)];
+}
+
+static bool is_matching(PacketHeader *a, PacketHeader *b) {
+	return a->uid == b->uid &&
+	       a->function_id == b->function_id &&
+	       a->sequence_number_and_options == b->sequence_number_and_options;
+}
+
+static int benchmark_pending_requests(void) {
+	Request *requests = calloc(PENDING_REQUESTS, sizeof(Request));
+	Node *index = malloc(PENDING_REQUEST_INDEX_SIZE * sizeof(Node));
+	int *order = malloc(PENDING_REQUESTS * sizeof(int));
+	Node sentinel;
+	Node *node;
+	Node *bucket;
+	Request *request;
+	PacketHeader *target;
+	uint64_t start;
+	uint64_t elapsed;
+	uint64_t visited = 0;
+	char buffer[128];
+	int i;
+	int k;
+	int swap;
+
+	if (requests == NULL || index == NULL || order == NULL) {
+		printf("node: allocation failed\n");
+
+		free(requests);
+		free(index);
+		free(order);
+
+		return -1;
+	}
+
+	node_reset(&sentinel);
+
+	for (i = 0; i < PENDING_REQUEST_INDEX_SIZE; ++i) {
+		node_reset(&index[i]);
+	}
+
+	// 32k requests to 64 devices with sequence numbers 1 to 15 and a few
+	// function IDs, so headers repeat like they do in a busy daemon
+	start = microseconds();
+
+	for (i = 0; i < PENDING_REQUESTS; ++i) {
+		request = &requests[i];
+
+		request->header.uid = 1000 + (uint32_t)(i % 64);
+		request->header.function_id = (uint8_t)(1 + (i / 64) % 8);
+		packet_header_set_sequence_number(&request->header, (uint8_t)(1 + i % 15));
+		packet_header_set_response_expected(&request->header, true);
+
+		node_insert_before(&sentinel, &request->global_node);
+		node_insert_before(get_bucket(index, &request->header), &request->index_node);
+	}
+
+	elapsed = microseconds() - start;
+
+	report("node insert (global list + index bucket)", elapsed, PENDING_REQUESTS);
+
+	// linear scan of the global list, finds the oldest match
+	start = microseconds();
+
+	for (i = 0; i < PENDING_REQUEST_LOOKUPS; ++i) {
+		target = &requests[next_random() % PENDING_REQUESTS].header;
+
+		for (node = sentinel.next; node != &sentinel; node = node->next) {
+			++visited;
+			request = containerof(node, Request, global_node);
+
+			if (is_matching(&request->header, target)) {
+				_sink += request->header.uid;
+
+				break;
+			}
+		}
+	}
+
+	elapsed = microseconds() - start;
+
+	snprintf(buffer, sizeof(buffer), "node list scan (%d pending, %.0f visited)",
+	         PENDING_REQUESTS, (double)visited / PENDING_REQUEST_LOOKUPS);
+	report(buffer, elapsed, PENDING_REQUEST_LOOKUPS);
+
+	// bucketed scan, as done by network_find_pending_request
+	visited = 0;
+	start = microseconds();
+
+	for (i = 0; i < PENDING_REQUEST_LOOKUPS * 100; ++i) {
+		target = &requests[next_random() % PENDING_REQUESTS].header;
+		bucket = get_bucket(index, target);
+
+		for (node = bucket->next; node != bucket; node = node->next) {
+			++visited;
+			request = containerof(node, Request, index_node);
+
+			if (is_matching(&request->header, target)) {
+				_sink += request->header.uid;
+
+				break;
+			}
+		}
+	}
+
+	elapsed = microseconds() - start;
+
+	snprintf(buffer, sizeof(buffer), "node index scan (%d pending, %.1f visited)",
+	         PENDING_REQUESTS, (double)visited / (PENDING_REQUEST_LOOKUPS * 100));
+	report(buffer, elapsed, PENDING_REQUEST_LOOKUPS * 100);
+
+	// remove in random order, as responses arrive
+	for (i = 0; i < PENDING_REQUESTS; ++i) {
+		order[i] = i;
+	}
+
+	for (i = PENDING_REQUESTS - 1; i > 0; --i) {
+		k = next_random() % (i + 1);
+		swap = order[i];
+		order[i] = order[k];
+		order[k] = swap;
+	}
+
+	start = microseconds();
+
+	for (i = 0; i < PENDING_REQUESTS; ++i) {
+		node_remove(&requests[order[i]].global_node);
+		node_remove(&requests[order[i]].index_node);
+	}
+
+	elapsed = microseconds() - start;
+
+	report("node remove (global list + index bucket)", elapsed, PENDING_REQUESTS);
+
+	free(requests);
+	free(index);
+	free(order);
+
+	return 0;
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (benchmark_array("relocatable, pointer, front", sizeof(void *), true, ARRAY_FRONT) < 0 ||
+	    benchmark_array("relocatable, pointer, back", sizeof(void *), true, ARRAY_BACK) < 0 ||
+	    benchmark_array("relocatable, pointer, random", sizeof(void *), true, ARRAY_RANDOM) < 0 ||
+	    benchmark_array("relocatable, 512 bytes, front", sizeof(LargeItem), true, ARRAY_FRONT) < 0 ||
+	    benchmark_array("relocatable, 512 bytes, middle", sizeof(LargeItem), true, ARRAY_MIDDLE) < 0 ||
+	    benchmark_array("non-relocatable, 512 bytes, front", sizeof(LargeItem), false, ARRAY_FRONT) < 0 ||
+	    benchmark_array("non-relocatable, 512 bytes, random", sizeof(LargeItem), false, ARRAY_RANDOM) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (benchmark_queue(1) < 0 || benchmark_queue(QUEUE_BATCH) < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (benchmark_pending_requests() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
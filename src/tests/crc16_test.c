@@ -0,0 +1,222 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * crc16_test.c: Tests and micro-benchmark for the Modbus CRC-16
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../brickd/crc16.h"
+
+static uint8_t table_crc_hi[256];
+static uint8_t table_crc_lo[256];
+
+// bit-at-a-time Modbus CRC-16, returned with its two bytes swapped as done by
+// the RS485 extension
+static uint16_t reference_crc16(const uint8_t *data, int length) {
+	uint16_t crc = 0xFFFF;
+	int i;
+
+	while (length-- > 0) {
+		crc ^= *data++;
+
+		for (i = 0; i < 8; ++i) {
+			crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+	}
+
+	return (uint16_t)((crc << 8) | (crc >> 8));
+}
+
+// byte-at-a-time tables as used by the RS485 extension before
+static void init_tables(void) {
+	uint16_t crc;
+	int i;
+	int k;
+
+	for (i = 0; i < 256; ++i) {
+		crc = (uint16_t)i;
+
+		for (k = 0; k < 8; ++k) {
+			crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+
+		table_crc_hi[i] = (uint8_t)(crc & 0xFF);
+		table_crc_lo[i] = (uint8_t)(crc >> 8);
+	}
+}
+
+static uint16_t table_crc16(const uint8_t *buffer, int length) {
+	uint8_t crc_hi = 0xFF;
+	uint8_t crc_lo = 0xFF;
+	int i;
+
+	while (length--) {
+		i = crc_hi ^ *buffer++;
+		crc_hi = crc_lo ^ table_crc_hi[i];
+		crc_lo = table_crc_lo[i];
+	}
+
+	return (uint16_t)(crc_hi << 8 | crc_lo);
+}
+
+// known values, to detect changes to the polynomial or the byte order
+int test1(void) {
+	uint8_t empty_frame[11] = { 0x01, 100, 0x00, 0, 0, 0, 0, 8, 0, 0, 0 };
+
+	if (crc16((const uint8_t *)"", 0) != 0xFFFF ||
+	    crc16((const uint8_t *)"123456789", 9) != 0x374B ||
+	    crc16(empty_frame, sizeof(empty_frame)) != table_crc16(empty_frame, sizeof(empty_frame))) {
+		printf("test1: CRC mismatch\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+// all lengths of an RS485 frame at all offsets within 4 bytes, to cover the
+// slice-by-4 and the tail loop
+int test2(void) {
+	uint8_t data[96];
+	int length;
+	int offset;
+	int round;
+	int i;
+
+	for (round = 0; round < 100; ++round) {
+		for (i = 0; i < (int)sizeof(data); ++i) {
+			data[i] = (uint8_t)rand();
+		}
+
+		for (length = 0; length <= 83; ++length) {
+			for (offset = 0; offset < 4; ++offset) {
+				if (crc16(data + offset, length) != reference_crc16(data + offset, length) ||
+				    crc16(data + offset, length) != table_crc16(data + offset, length)) {
+					printf("test2: CRC mismatch (length: %d, offset: %d)\n", length, offset);
+
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// incremental updates in random chunks, as done while receiving
+int test3(void) {
+	uint8_t data[83];
+	uint16_t crc;
+	int used;
+	int chunk;
+	int round;
+	int i;
+
+	for (round = 0; round < 1000; ++round) {
+		for (i = 0; i < (int)sizeof(data); ++i) {
+			data[i] = (uint8_t)rand();
+		}
+
+		crc = CRC16_INITIAL_VALUE;
+		used = 0;
+
+		while (used < (int)sizeof(data)) {
+			chunk = 1 + rand() % 9;
+
+			if (chunk > (int)sizeof(data) - used) {
+				chunk = (int)sizeof(data) - used;
+			}
+
+			crc = crc16_update(crc, data + used, chunk);
+			used += chunk;
+		}
+
+		if (crc16_finalize(crc) != reference_crc16(data, sizeof(data))) {
+			printf("test3: CRC mismatch (round: %d)\n", round);
+
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// compare the speed on full RS485 frames, informational only
+void benchmark(void) {
+	uint8_t data[83];
+	int count = 2000000;
+	int i;
+	unsigned int sink = 0;
+	clock_t start;
+	double reference_duration;
+	double duration;
+
+	for (i = 0; i < (int)sizeof(data); ++i) {
+		data[i] = (uint8_t)rand();
+	}
+
+	start = clock();
+
+	for (i = 0; i < count; ++i) {
+		data[0] = (uint8_t)i;
+		sink += table_crc16(data, sizeof(data));
+	}
+
+	reference_duration = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+
+	for (i = 0; i < count; ++i) {
+		data[0] = (uint8_t)i;
+		sink -= crc16(data, sizeof(data));
+	}
+
+	duration = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("benchmark: %d frames, byte-at-a-time %.3f s, crc16 %.3f s (%u)\n",
+	       count, reference_duration, duration, sink);
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	init_tables();
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test3() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	benchmark();
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,382 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * fair_queue_test.c: Tests for the deficit round-robin fair queue
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/packet.h>
+
+#include "../brickd/fair_queue.h"
+
+// owners are only used as keys
+static int _heavy;
+static int _light;
+static int _other;
+
+static int push(FairQueue *queue, void *owner, uint32_t uid, int length) {
+	Packet *packet = fair_queue_push(queue, owner);
+
+	if (packet == NULL) {
+		return -1;
+	}
+
+	memset(packet, 0, sizeof(Packet));
+
+	packet->header.uid = uid;
+	packet->header.length = (uint8_t)length;
+
+	return 0;
+}
+
+// a heavy owner does not starve a light owner that queues after it. both get
+// one full packet per turn, so their items alternate until the light owner
+// has nothing left. an owner with smaller packets gets more of them per turn
+int test1(void) {
+	FairQueue queue;
+	Packet *packet;
+	int i;
+
+	if (fair_queue_create(&queue, sizeof(Packet), 0) < 0) {
+		printf("test1: fair_queue_create failed\n");
+
+		return -1;
+	}
+
+	for (i = 0; i < 20; ++i) {
+		if (push(&queue, &_heavy, 1000 + i, sizeof(Packet)) < 0) {
+			printf("test1: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 5; ++i) {
+		if (push(&queue, &_light, 2000 + i, sizeof(Packet)) < 0) {
+			printf("test1: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 25; ++i) {
+		packet = fair_queue_peek(&queue);
+
+		if (packet == NULL) {
+			printf("test1: queue empty too early (i: %d)\n", i);
+
+			return -1;
+		}
+
+		if (i < 10 && packet->header.uid != (uint32_t)(i % 2 == 0 ? 1000 + i / 2 : 2000 + i / 2)) {
+			printf("test1: owners do not alternate (i: %d, uid: %u)\n", i, packet->header.uid);
+
+			return -1;
+		}
+
+		if (i >= 10 && packet->header.uid != (uint32_t)(1000 + i - 5)) {
+			printf("test1: unexpected item of heavy owner (i: %d, uid: %u)\n", i, packet->header.uid);
+
+			return -1;
+		}
+
+		fair_queue_pop(&queue, NULL);
+	}
+
+	if (fair_queue_peek(&queue) != NULL || queue.count != 0 || queue.flow_count != 0) {
+		printf("test1: queue not empty\n");
+
+		return -1;
+	}
+
+	// one full size packet of credit per turn covers 10 header-only packets
+	for (i = 0; i < 4; ++i) {
+		if (push(&queue, &_heavy, 1000 + i, sizeof(Packet)) < 0) {
+			printf("test1: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 20; ++i) {
+		if (push(&queue, &_light, 2000 + i, sizeof(PacketHeader)) < 0) {
+			printf("test1: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 12; ++i) {
+		packet = fair_queue_peek(&queue);
+
+		if (packet == NULL ||
+		    packet->header.uid != (uint32_t)(i == 0 ? 1000 : (i == 11 ? 1001 : 2000 + i - 1))) {
+			printf("test1: unexpected byte share (i: %d)\n", i);
+
+			return -1;
+		}
+
+		fair_queue_pop(&queue, NULL);
+	}
+
+	fair_queue_destroy(&queue, NULL);
+
+	return 0;
+}
+
+// the peeked item stays the same until it is popped, even if other items are
+// pushed meanwhile, so it can be modified in place
+int test2(void) {
+	FairQueue queue;
+	Packet *packet;
+	Packet *current;
+	int i;
+
+	if (fair_queue_create(&queue, sizeof(Packet), 0) < 0) {
+		printf("test2: fair_queue_create failed\n");
+
+		return -1;
+	}
+
+	if (push(&queue, &_heavy, 1, sizeof(Packet)) < 0) {
+		printf("test2: fair_queue_push failed\n");
+
+		return -1;
+	}
+
+	current = fair_queue_peek(&queue);
+
+	for (i = 0; i < 10; ++i) {
+		if (push(&queue, i % 2 == 0 ? (void *)&_heavy : (void *)&_light, 10 + i, sizeof(Packet)) < 0) {
+			printf("test2: fair_queue_push failed\n");
+
+			return -1;
+		}
+
+		packet = fair_queue_peek(&queue);
+
+		if (packet != current || packet->header.uid != 1) {
+			printf("test2: peeked item changed (i: %d)\n", i);
+
+			return -1;
+		}
+	}
+
+	current->header.uid = 99;
+
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid != 99) {
+		printf("test2: modification of peeked item got lost\n");
+
+		return -1;
+	}
+
+	fair_queue_pop(&queue, NULL);
+
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid == 99 || queue.count != 10) {
+		printf("test2: peeked item was not popped\n");
+
+		return -1;
+	}
+
+	fair_queue_destroy(&queue, NULL);
+
+	return 0;
+}
+
+static void test3_cancel(void *item, void *opaque) {
+	uint32_t *cancelled = opaque;
+
+	*cancelled += ((Packet *)item)->header.uid;
+}
+
+// cancelling the owner of the peeked item keeps that item, because it might
+// be sent right now. all other items of that owner are removed
+int test3(void) {
+	FairQueue queue;
+	Packet *packet;
+	uint32_t cancelled = 0;
+	int i;
+
+	if (fair_queue_create(&queue, sizeof(Packet), 0) < 0) {
+		printf("test3: fair_queue_create failed\n");
+
+		return -1;
+	}
+
+	for (i = 1; i <= 3; ++i) {
+		if (push(&queue, &_heavy, i, sizeof(Packet)) < 0) {
+			printf("test3: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	if (push(&queue, &_light, 10, sizeof(Packet)) < 0) {
+		printf("test3: fair_queue_push failed\n");
+
+		return -1;
+	}
+
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid != 1) {
+		printf("test3: unexpected first item\n");
+
+		return -1;
+	}
+
+	if (fair_queue_cancel_owner(&queue, &_heavy, test3_cancel, &cancelled) != 2 ||
+	    cancelled != 2 + 3) {
+		printf("test3: unexpected items cancelled\n");
+
+		return -1;
+	}
+
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid != 1 || queue.count != 2) {
+		printf("test3: current item got cancelled\n");
+
+		return -1;
+	}
+
+	// nothing but the current item is left, cancelling again removes nothing
+	if (fair_queue_cancel_owner(&queue, &_heavy, NULL, NULL) != 0 || queue.count != 2) {
+		printf("test3: current item got cancelled on second cancel\n");
+
+		return -1;
+	}
+
+	fair_queue_pop(&queue, NULL);
+
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid != 10) {
+		printf("test3: item of other owner is missing\n");
+
+		return -1;
+	}
+
+	// an owner without the current item loses everything
+	if (push(&queue, &_other, 20, sizeof(Packet)) < 0 ||
+	    fair_queue_cancel_owner(&queue, &_other, NULL, NULL) != 1 ||
+	    queue.count != 1 || queue.flow_count != 1) {
+		printf("test3: cancel of other owner failed\n");
+
+		return -1;
+	}
+
+	fair_queue_destroy(&queue, NULL);
+
+	return 0;
+}
+
+// on overflow the oldest item of the owner with the most queued items is
+// evicted, not the oldest item overall
+int test4(void) {
+	FairQueue queue;
+	Packet *packet;
+	int i;
+
+	if (fair_queue_create(&queue, sizeof(Packet), 0) < 0) {
+		printf("test4: fair_queue_create failed\n");
+
+		return -1;
+	}
+
+	if (push(&queue, &_light, 1, sizeof(Packet)) < 0 ||
+	    push(&queue, &_light, 2, sizeof(Packet)) < 0 ||
+	    push(&queue, &_other, 3, sizeof(Packet)) < 0) {
+		printf("test4: fair_queue_push failed\n");
+
+		return -1;
+	}
+
+	for (i = 0; i < 5; ++i) {
+		if (push(&queue, &_heavy, 10 + i, sizeof(Packet)) < 0) {
+			printf("test4: fair_queue_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 3; ++i) {
+		packet = fair_queue_peek_longest(&queue);
+
+		if (packet == NULL || packet->header.uid != (uint32_t)(10 + i)) {
+			printf("test4: unexpected longest item (i: %d)\n", i);
+
+			return -1;
+		}
+
+		fair_queue_pop_longest(&queue, NULL);
+	}
+
+	if (queue.count != 5) {
+		printf("test4: unexpected item count %d\n", queue.count);
+
+		return -1;
+	}
+
+	// the items of the other owners are untouched and come out in order
+	packet = fair_queue_peek(&queue);
+
+	if (packet == NULL || packet->header.uid != 1) {
+		printf("test4: oldest item of other owner got evicted\n");
+
+		return -1;
+	}
+
+	fair_queue_destroy(&queue, NULL);
+
+	return 0;
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test3() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test4() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
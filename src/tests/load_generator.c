@@ -0,0 +1,655 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * load_generator.c: Multi-client load scenarios with daemon metrics
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * runs scripted load scenarios against a running brickd and reports them as
+ * JSON. a probe client measures the request latency while the scenario runs.
+ * with --pid the RSS and CPU usage of brickd are sampled as well (Linux only):
+ *
+ * - churn: clients connect, send a request and disconnect without waiting
+ *   for the response. with delayed responses this leaves zombies behind
+ * - callback-storm: many clients receive the callbacks of all devices, for
+ *   example from the loopback stack with loopback_stack.callback_period = 1
+ * - slow-client: one client triggers enumerates but never reads, so the
+ *   enumerate callbacks pile up in brickd
+ *
+ * requests go to --uid, for example a loopback stack device, or to brickd
+ * itself by default
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+	#include <unistd.h>
+#endif
+
+#include <daemonlib/base58.h>
+#include <daemonlib/utils.h>
+
+#include "tfp_client.h"
+
+#define MAX_CLIENTS 1024
+#define POLL_TIMEOUT 10 // msec
+#define PROBE_INTERVAL 10000 // usec
+#define METRICS_INTERVAL 100000 // usec
+#define MAX_PROBE_SAMPLES 65536
+
+typedef struct {
+	const char *host;
+	uint16_t port;
+	uint32_t uid;
+	const char *uid_string;
+	int duration; // seconds
+	int churn_clients;
+	int storm_clients;
+	int slow_enumerates; // per probe interval
+	int pid;
+	const char *scenarios;
+	const char *output;
+} Options;
+
+typedef struct {
+	uint64_t samples[MAX_PROBE_SAMPLES];
+	int count;
+	int timeouts;
+	bool in_flight;
+	uint64_t last_sent_at;
+} Probe;
+
+typedef struct {
+	bool available;
+	uint64_t cpu_ticks; // user plus system
+	long rss; // KiB
+	long peak_rss; // KiB
+	long start_rss; // KiB
+	uint64_t start_ticks;
+	uint64_t start_time; // usec
+} Metrics;
+
+static Options _options;
+static FILE *_output;
+static bool _first_result = true;
+static Probe _probe;
+
+static void fail(const char *message) {
+	fprintf(stderr, "error: %s\n", message);
+
+	exit(EXIT_FAILURE);
+}
+
+static int compare_uint64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// expects sorted samples
+static uint64_t percentile(uint64_t *samples, int count, int percent) {
+	int index = (count * percent + 99) / 100 - 1;
+
+	if (index < 0) {
+		index = 0;
+	}
+
+	return samples[index];
+}
+
+static uint8_t get_request_function_id(void) {
+	return _options.uid == TFP_UID_BRICK_DAEMON
+	       ? TFP_FUNCTION_GET_AUTHENTICATION_NONCE
+	       : TFP_FUNCTION_GET_IDENTITY;
+}
+
+static void open_client(TFPClient *client) {
+	if (tfp_client_open(client, _options.host, _options.port, false) < 0) {
+		fail("could not connect to brickd");
+	}
+}
+
+static TFPClient *create_client(void) {
+	TFPClient *client = malloc(sizeof(TFPClient));
+
+	if (client == NULL) {
+		fail("could not allocate client");
+	}
+
+	open_client(client);
+
+	return client;
+}
+
+static void destroy_client(TFPClient *client) {
+	tfp_client_close(client);
+	free(client);
+}
+
+#ifdef __linux__
+
+// reads utime, stime and RSS from /proc
+static bool metrics_read(int pid, uint64_t *cpu_ticks, long *rss) {
+	char filename[64];
+	char buffer[1024];
+	FILE *fp;
+	char *p;
+	unsigned long utime;
+	unsigned long stime;
+	long pages;
+	size_t length;
+
+	snprintf(filename, sizeof(filename), "/proc/%d/stat", pid);
+
+	fp = fopen(filename, "r");
+
+	if (fp == NULL) {
+		return false;
+	}
+
+	length = fread(buffer, 1, sizeof(buffer) - 1, fp);
+
+	fclose(fp);
+
+	buffer[length] = '\0';
+
+	// the command name can contain spaces, the fields start after its ')'
+	p = strrchr(buffer, ')');
+
+	if (p == NULL ||
+	    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+	           &utime, &stime) != 2) {
+		return false;
+	}
+
+	snprintf(filename, sizeof(filename), "/proc/%d/statm", pid);
+
+	fp = fopen(filename, "r");
+
+	if (fp == NULL) {
+		return false;
+	}
+
+	if (fscanf(fp, "%*d %ld", &pages) != 1) {
+		fclose(fp);
+
+		return false;
+	}
+
+	fclose(fp);
+
+	*cpu_ticks = utime + stime;
+	*rss = pages * (sysconf(_SC_PAGESIZE) / 1024);
+
+	return true;
+}
+
+#else
+
+static bool metrics_read(int pid, uint64_t *cpu_ticks, long *rss) {
+	(void)pid;
+	(void)cpu_ticks;
+	(void)rss;
+
+	return false;
+}
+
+#endif
+
+static void metrics_start(Metrics *metrics) {
+	memset(metrics, 0, sizeof(*metrics));
+
+	if (_options.pid <= 0) {
+		return;
+	}
+
+	metrics->available = metrics_read(_options.pid, &metrics->start_ticks, &metrics->start_rss);
+	metrics->cpu_ticks = metrics->start_ticks;
+	metrics->rss = metrics->start_rss;
+	metrics->peak_rss = metrics->start_rss;
+	metrics->start_time = microseconds();
+}
+
+static void metrics_sample(Metrics *metrics) {
+	if (!metrics->available) {
+		return;
+	}
+
+	if (!metrics_read(_options.pid, &metrics->cpu_ticks, &metrics->rss)) {
+		metrics->available = false;
+
+		return;
+	}
+
+	if (metrics->rss > metrics->peak_rss) {
+		metrics->peak_rss = metrics->rss;
+	}
+}
+
+static void handle_probe_response(TFPClient *client, const uint8_t *response,
+                                  uint64_t latency, void *opaque) {
+	(void)client;
+	(void)opaque;
+
+	_probe.in_flight = false;
+
+	if (response == NULL) {
+		++_probe.timeouts;
+
+		return;
+	}
+
+	if (_probe.count < MAX_PROBE_SAMPLES) {
+		_probe.samples[_probe.count++] = latency;
+	}
+}
+
+static void probe_update(TFPClient *probe, uint64_t now) {
+	if (_probe.in_flight || now - _probe.last_sent_at < PROBE_INTERVAL) {
+		return;
+	}
+
+	if (tfp_client_send_request(probe, _options.uid, get_request_function_id(),
+	                            NULL, 0, handle_probe_response, NULL) < 0) {
+		fail("could not send probe request");
+	}
+
+	_probe.in_flight = true;
+	_probe.last_sent_at = now;
+}
+
+static void begin_result(const char *name) {
+	fprintf(_output, "%s\n    {\"name\": \"%s\", \"duration\": %d",
+	        _first_result ? "" : ",", name, _options.duration);
+
+	_first_result = false;
+}
+
+static void end_result(Metrics *metrics) {
+	double seconds;
+	long ticks_per_second;
+
+	qsort(_probe.samples, _probe.count, sizeof(uint64_t), compare_uint64);
+
+	fprintf(_output, ", \"probe\": {\"requests\": %d, \"timeouts\": %d",
+	        _probe.count, _probe.timeouts);
+
+	if (_probe.count > 0) {
+		fprintf(_output, ", \"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu",
+		        (unsigned long long)percentile(_probe.samples, _probe.count, 50),
+		        (unsigned long long)percentile(_probe.samples, _probe.count, 99),
+		        (unsigned long long)_probe.samples[_probe.count - 1]);
+	}
+
+	fprintf(_output, "}");
+
+	if (!metrics->available) {
+		fprintf(_output, ", \"daemon\": null}");
+
+		return;
+	}
+
+#ifdef __linux__
+	ticks_per_second = sysconf(_SC_CLK_TCK);
+#else
+	ticks_per_second = 100;
+#endif
+	seconds = (microseconds() - metrics->start_time) / 1000000.0;
+
+	fprintf(_output, ", \"daemon\": {\"cpu_percent\": %.1f, \"start_rss_kib\": %ld, \"end_rss_kib\": %ld, \"peak_rss_kib\": %ld}}",
+	        seconds > 0 ? (metrics->cpu_ticks - metrics->start_ticks) * 100.0 / ticks_per_second / seconds : 0,
+	        metrics->start_rss, metrics->rss, metrics->peak_rss);
+}
+
+// polls the given clients and the probe until the scenario is over. the
+// function is called once per iteration to add scenario specific load
+static void run_scenario(TFPClient **clients, int count, Metrics *metrics,
+                         void (*function)(uint64_t now, void *opaque), void *opaque) {
+	TFPClient *polled[MAX_CLIENTS + 1];
+	uint64_t start = microseconds();
+	uint64_t end = start + (uint64_t)_options.duration * 1000000;
+	uint64_t last_sampled_at = start;
+	uint64_t now;
+
+	memset(&_probe, 0, sizeof(_probe));
+
+	polled[0] = create_client();
+
+	if (count > 0) {
+		memcpy(polled + 1, clients, count * sizeof(TFPClient *));
+	}
+
+	metrics_start(metrics);
+
+	for (now = start; now < end; now = microseconds()) {
+		probe_update(polled[0], now);
+
+		if (function != NULL) {
+			function(now, opaque);
+		}
+
+		if (tfp_client_poll(polled, count + 1, POLL_TIMEOUT) < 0) {
+			fail("could not receive from brickd");
+		}
+
+		if (now - last_sampled_at >= METRICS_INTERVAL) {
+			metrics_sample(metrics);
+
+			last_sampled_at = now;
+		}
+	}
+
+	metrics_sample(metrics);
+	destroy_client(polled[0]);
+}
+
+static void churn_iteration(uint64_t now, void *opaque) {
+	uint32_t *connections = opaque;
+	TFPClient *clients[MAX_CLIENTS];
+	int i;
+
+	(void)now;
+
+	for (i = 0; i < _options.churn_clients; ++i) {
+		clients[i] = create_client();
+
+		if (tfp_client_send_request(clients[i], _options.uid, get_request_function_id(),
+		                            NULL, 0, NULL, NULL) < 0) {
+			fail("could not send request");
+		}
+	}
+
+	// disconnect with the requests still pending
+	for (i = 0; i < _options.churn_clients; ++i) {
+		destroy_client(clients[i]);
+	}
+
+	*connections += _options.churn_clients;
+}
+
+static void scenario_churn(void) {
+	Metrics metrics;
+	uint32_t connections = 0;
+
+	fprintf(stderr, "churn: %d clients per round for %d seconds\n",
+	        _options.churn_clients, _options.duration);
+
+	run_scenario(NULL, 0, &metrics, churn_iteration, &connections);
+
+	begin_result("churn");
+	fprintf(_output, ", \"clients\": %d, \"connections\": %u, \"connections_per_second\": %.1f",
+	        _options.churn_clients, connections,
+	        (double)connections / _options.duration);
+	end_result(&metrics);
+}
+
+static void handle_storm_callback(TFPClient *client, const uint8_t *packet, void *opaque) {
+	(void)client;
+	(void)packet;
+
+	++*(uint32_t *)opaque;
+}
+
+static void scenario_callback_storm(void) {
+	TFPClient *clients[MAX_CLIENTS];
+	uint32_t callbacks[MAX_CLIENTS];
+	uint32_t total = 0;
+	uint32_t minimum = UINT32_MAX;
+	Metrics metrics;
+	int i;
+
+	fprintf(stderr, "callback-storm: %d clients for %d seconds\n",
+	        _options.storm_clients, _options.duration);
+
+	for (i = 0; i < _options.storm_clients; ++i) {
+		callbacks[i] = 0;
+		clients[i] = create_client();
+
+		tfp_client_set_callback(clients[i], handle_storm_callback, &callbacks[i]);
+	}
+
+	run_scenario(clients, _options.storm_clients, &metrics, NULL, NULL);
+
+	for (i = 0; i < _options.storm_clients; ++i) {
+		total += callbacks[i];
+
+		if (callbacks[i] < minimum) {
+			minimum = callbacks[i];
+		}
+
+		destroy_client(clients[i]);
+	}
+
+	begin_result("callback-storm");
+	fprintf(_output, ", \"clients\": %d, \"callbacks\": %u, \"callbacks_per_second\": %.1f, \"min_callbacks_per_client_per_second\": %.1f",
+	        _options.storm_clients, total, (double)total / _options.duration,
+	        (double)minimum / _options.duration);
+	end_result(&metrics);
+}
+
+typedef struct {
+	TFPClient *client;
+	uint64_t last_sent_at;
+	uint32_t enumerates;
+} Slow;
+
+static void slow_iteration(uint64_t now, void *opaque) {
+	Slow *slow = opaque;
+	int i;
+
+	if (now - slow->last_sent_at < PROBE_INTERVAL) {
+		return;
+	}
+
+	// every enumerate makes brickd send callbacks to all clients, including
+	// the slow client itself
+	for (i = 0; i < _options.slow_enumerates; ++i) {
+		if (tfp_client_send_oneway(slow->client, 0, TFP_FUNCTION_ENUMERATE, NULL, 0) < 0) {
+			fail("could not send enumerate request");
+		}
+	}
+
+	slow->enumerates += _options.slow_enumerates;
+	slow->last_sent_at = now;
+}
+
+static void scenario_slow_client(void) {
+	Slow slow;
+	Metrics metrics;
+
+	fprintf(stderr, "slow-client: %d enumerates per %d msec for %d seconds\n",
+	        _options.slow_enumerates, PROBE_INTERVAL / 1000, _options.duration);
+
+	// the slow client is not polled, so it never reads
+	slow.client = create_client();
+	slow.last_sent_at = 0;
+	slow.enumerates = 0;
+
+	run_scenario(NULL, 0, &metrics, slow_iteration, &slow);
+
+	destroy_client(slow.client);
+
+	begin_result("slow-client");
+	fprintf(_output, ", \"enumerates\": %u", slow.enumerates);
+	end_result(&metrics);
+}
+
+static void print_usage(const char *binary) {
+	fprintf(stderr,
+	        "Usage:\n"
+	        "  %s [--host <host>] [--port <port>] [--uid <uid>] [--pid <pid>]\n"
+	        "     [--scenarios <list>] [--duration <seconds>] [--churn-clients <count>]\n"
+	        "     [--storm-clients <count>] [--slow-enumerates <count>] [--output <file>]\n"
+	        "\n"
+	        "Options:\n"
+	        "  --host <host>              Host running brickd (default: localhost)\n"
+	        "  --port <port>              Plain TCP port (default: 4223)\n"
+	        "  --uid <uid>                Device to send get-identity requests to\n"
+	        "                             (default: brickd itself)\n"
+	        "  --pid <pid>                Sample RSS and CPU of this brickd process\n"
+	        "  --scenarios <list>         Comma separated list of churn, callback-storm\n"
+	        "                             and slow-client (default: all)\n"
+	        "  --duration <seconds>       Duration of each scenario (default: 10)\n"
+	        "  --churn-clients <count>    Clients connecting per churn round (default: 200)\n"
+	        "  --storm-clients <count>    Clients receiving callbacks (default: 50)\n"
+	        "  --slow-enumerates <count>  Enumerates per 10 msec by the slow client (default: 1)\n"
+	        "  --output <file>            Write JSON to a file instead of stdout\n",
+	        binary);
+}
+
+static int parse_count(const char *value, int min, int max) {
+	char *end = NULL;
+	long count = strtol(value, &end, 10);
+
+	if (end == value || *end != '\0' || count < min || count > max) {
+		fprintf(stderr, "error: invalid count '%s', expecting %d-%d\n", value, min, max);
+
+		exit(EXIT_FAILURE);
+	}
+
+	return (int)count;
+}
+
+static bool has_scenario(const char *name) {
+	const char *p = _options.scenarios;
+	size_t length = strlen(name);
+
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == _options.scenarios || p[-1] == ',') &&
+		    (p[length] == '\0' || p[length] == ',')) {
+			return true;
+		}
+
+		p += length;
+	}
+
+	return false;
+}
+
+int main(int argc, char **argv) {
+	int i;
+	const char *value;
+
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (tfp_client_init() < 0) {
+		fail("could not initialize sockets");
+	}
+
+	_options.host = "localhost";
+	_options.port = 4223;
+	_options.uid = TFP_UID_BRICK_DAEMON;
+	_options.uid_string = NULL;
+	_options.duration = 10;
+	_options.churn_clients = 200;
+	_options.storm_clients = 50;
+	_options.slow_enumerates = 1;
+	_options.pid = 0;
+	_options.scenarios = "churn,callback-storm,slow-client";
+	_options.output = NULL;
+
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--help") == 0) {
+			print_usage(argv[0]);
+
+			return EXIT_SUCCESS;
+		}
+
+		if (i + 1 >= argc) {
+			print_usage(argv[0]);
+
+			return EXIT_FAILURE;
+		}
+
+		value = argv[++i];
+
+		if (strcmp(argv[i - 1], "--host") == 0) {
+			_options.host = value;
+		} else if (strcmp(argv[i - 1], "--port") == 0) {
+			_options.port = (uint16_t)parse_count(value, 1, 65535);
+		} else if (strcmp(argv[i - 1], "--uid") == 0) {
+			if (base58_decode(&_options.uid, value) < 0) {
+				fail("invalid UID");
+			}
+
+			_options.uid_string = value;
+		} else if (strcmp(argv[i - 1], "--pid") == 0) {
+			_options.pid = parse_count(value, 1, INT32_MAX);
+		} else if (strcmp(argv[i - 1], "--scenarios") == 0) {
+			_options.scenarios = value;
+		} else if (strcmp(argv[i - 1], "--duration") == 0) {
+			_options.duration = parse_count(value, 1, 86400);
+		} else if (strcmp(argv[i - 1], "--churn-clients") == 0) {
+			_options.churn_clients = parse_count(value, 1, MAX_CLIENTS);
+		} else if (strcmp(argv[i - 1], "--storm-clients") == 0) {
+			_options.storm_clients = parse_count(value, 1, MAX_CLIENTS);
+		} else if (strcmp(argv[i - 1], "--slow-enumerates") == 0) {
+			_options.slow_enumerates = parse_count(value, 1, 1000);
+		} else if (strcmp(argv[i - 1], "--output") == 0) {
+			_options.output = value;
+		} else {
+			print_usage(argv[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (_options.output != NULL) {
+		_output = fopen(_options.output, "w");
+
+		if (_output == NULL) {
+			fail("could not open output file");
+		}
+	} else {
+		_output = stdout;
+	}
+
+	fprintf(_output, "{\n  \"host\": \"%s\",\n  \"uid\": %s%s%s,\n  \"results\": [",
+	        _options.host,
+	        _options.uid_string != NULL ? "\"" : "",
+	        _options.uid_string != NULL ? _options.uid_string : "null",
+	        _options.uid_string != NULL ? "\"" : "");
+
+	if (has_scenario("churn")) {
+		scenario_churn();
+	}
+
+	if (has_scenario("callback-storm")) {
+		scenario_callback_storm();
+	}
+
+	if (has_scenario("slow-client")) {
+		scenario_slow_client();
+	}
+
+	fprintf(_output, "\n  ]\n}\n");
+
+	if (_output != stdout) {
+		fclose(_output);
+	}
+
+	tfp_client_exit();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_debug_test.c: Tests and benchmark for level-checked packet debug logging
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// the check is only done at runtime with logging support
+#ifndef DAEMONLIB_WITH_LOGGING
+	#define DAEMONLIB_WITH_LOGGING
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <daemonlib/packet.h>
+
+#include "../brickd/packet_debug.h"
+
+static LogSource _log_source = LOG_SOURCE_INITIALIZER;
+
+// replace the log subsystem to control what the check sees
+static LogLevel _effective_level = LOG_LEVEL_INFO;
+static int _included_groups = LOG_DEBUG_GROUP_NONE;
+static int _included_calls = 0;
+
+LogLevel log_get_effective_level(void) {
+	return _effective_level;
+}
+
+bool log_is_included(LogLevel level, LogSource *source, int debug_group) {
+	(void)source;
+
+	++_included_calls;
+
+	return level <= _effective_level && (debug_group & _included_groups) != 0;
+}
+
+static volatile int _sink;
+
+static void create_request(Packet *request, int i) {
+	memset(request, 0, sizeof(*request));
+
+	packet_header_create(&request->header, sizeof(PacketHeader) + 8,
+	                     (uint8_t)(1 + i % 200), (uint8_t)(1 + i % 15), true);
+
+	request->header.uid = 0x12345678 + i;
+}
+
+int test1(void) {
+	_effective_level = LOG_LEVEL_INFO;
+	_included_groups = LOG_DEBUG_GROUP_ALL;
+	_included_calls = 0;
+
+	if (packet_debug_is_enabled()) {
+		printf("test1: enabled below debug level\n");
+
+		return -1;
+	}
+
+	// the per-source check must be skipped below debug level
+	if (_included_calls != 0) {
+		printf("test1: log_is_included called below debug level\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+int test2(void) {
+	_effective_level = LOG_LEVEL_DEBUG;
+	_included_groups = LOG_DEBUG_GROUP_EVENT;
+
+	if (packet_debug_is_enabled()) {
+		printf("test2: enabled without packet debug group\n");
+
+		return -1;
+	}
+
+	_included_groups = LOG_DEBUG_GROUP_PACKET;
+
+	if (!packet_debug_is_enabled()) {
+		printf("test2: not enabled with packet debug group\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+// formats the signature for every packet, as the arguments of an unchecked
+// log_packet_debug call would be evaluated
+static double benchmark_unchecked(Packet *requests, int count, int rounds) {
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+	clock_t start = clock();
+	int k;
+	int i;
+
+	for (k = 0; k < rounds; ++k) {
+		for (i = 0; i < count; ++i) {
+			_sink += packet_get_request_signature(packet_signature, &requests[i])[0];
+		}
+	}
+
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double benchmark_checked(Packet *requests, int count, int rounds) {
+	char packet_signature[PACKET_MAX_SIGNATURE_LENGTH];
+	clock_t start = clock();
+	int k;
+	int i;
+
+	for (k = 0; k < rounds; ++k) {
+		for (i = 0; i < count; ++i) {
+			if (packet_debug_is_enabled()) {
+				_sink += packet_get_request_signature(packet_signature, &requests[i])[0];
+			}
+		}
+	}
+
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void benchmark(void) {
+	static Packet requests[1024];
+	int count = sizeof(requests) / sizeof(requests[0]);
+	int rounds = 2000;
+	double packets = (double)count * rounds;
+	double elapsed;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		create_request(&requests[i], i);
+	}
+
+	_effective_level = LOG_LEVEL_INFO;
+	_included_groups = LOG_DEBUG_GROUP_NONE;
+
+	elapsed = benchmark_unchecked(requests, count, rounds);
+
+	printf("unchecked:         %8.1f ns/packet\n", elapsed * 1000000000.0 / packets);
+
+	elapsed = benchmark_checked(requests, count, rounds);
+
+	printf("checked, disabled: %8.1f ns/packet\n", elapsed * 1000000000.0 / packets);
+}
+
+int main(int argc, char **argv) {
+	// pass "benchmark" to measure the per-packet cost of packet debug logging
+	// with and without the check, instead of running the tests
+	if (argc > 1 && strcmp(argv[1], "benchmark") == 0) {
+		benchmark();
+
+		return EXIT_SUCCESS;
+	}
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
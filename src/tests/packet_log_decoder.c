@@ -0,0 +1,222 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_log_decoder.c: Prints the records of a brickd packet log dump file
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * reads a file written by the packet log of brickd on SIGUSR2 or by the
+ * dump-packet-log function and prints one line per record, oldest first. the
+ * file layout is described in brickd/packet_log.h. the fields are read byte by
+ * byte, so the decoder works on hosts of any byte order
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <daemonlib/base58.h>
+
+// same layout as in packet_log.h
+#define MAGIC "BRICKDPL"
+#define VERSION 1
+#define HEADER_SIZE 48
+#define STACK_NAME_LENGTH 64
+#define STACK_SIZE (2 + STACK_NAME_LENGTH)
+#define RECORD_SIZE 32
+
+typedef struct {
+	uint16_t id;
+	char name[STACK_NAME_LENGTH + 1];
+} Stack;
+
+static const char *_direction_names[] = {
+	"request",
+	"request-to-stack",
+	"response"
+};
+
+static void fail(const char *message) {
+	fprintf(stderr, "error: %s\n", message);
+
+	exit(EXIT_FAILURE);
+}
+
+static uint16_t get_uint16(const uint8_t *bytes) {
+	return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static uint32_t get_uint32(const uint8_t *bytes) {
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+	       ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t get_uint64(const uint8_t *bytes) {
+	return (uint64_t)get_uint32(bytes) | ((uint64_t)get_uint32(bytes + 4) << 32);
+}
+
+static const char *get_stack_name(Stack *stacks, uint32_t stack_count, uint16_t id) {
+	uint32_t i;
+
+	if (id == 0) {
+		return "-";
+	}
+
+	for (i = 0; i < stack_count; ++i) {
+		if (stacks[i].id == id) {
+			return stacks[i].name;
+		}
+	}
+
+	return "<removed>"; // the stack was removed before the dump
+}
+
+int main(int argc, char **argv) {
+	FILE *fp;
+	uint8_t header[HEADER_SIZE];
+	uint8_t buffer[STACK_SIZE];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t record_count;
+	uint32_t stack_count;
+	uint64_t dropped_records;
+	uint64_t dump_time;
+	uint64_t dump_timestamp;
+	uint64_t first_timestamp = 0;
+	uint64_t timestamp;
+	uint64_t age;
+	Stack *stacks;
+	uint32_t i;
+	uint64_t trace_id;
+	uint8_t direction;
+	char uid[BASE58_MAX_LENGTH];
+	time_t seconds;
+	struct tm *local;
+	char time_string[32];
+
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (argc != 2 || strcmp(argv[1], "--help") == 0) {
+		fprintf(stderr, "Usage:\n  %s <dump-file>\n", argv[0]);
+
+		return argc == 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	fp = fopen(argv[1], "rb");
+
+	if (fp == NULL) {
+		fail("could not open dump file");
+	}
+
+	if (fread(header, sizeof(header), 1, fp) != 1) {
+		fail("could not read header");
+	}
+
+	if (memcmp(header, MAGIC, 8) != 0) {
+		fail("not a packet log dump file");
+	}
+
+	version = get_uint32(header + 8);
+	record_size = get_uint32(header + 12);
+	record_count = get_uint32(header + 16);
+	stack_count = get_uint32(header + 20);
+	dropped_records = get_uint64(header + 24);
+	dump_time = get_uint64(header + 32);
+	dump_timestamp = get_uint64(header + 40);
+
+	if (version != VERSION) {
+		fail("unsupported packet log version");
+	}
+
+	if (record_size < RECORD_SIZE || record_size > sizeof(buffer)) {
+		fail("unsupported packet log record size");
+	}
+
+	stacks = calloc(stack_count + 1, sizeof(Stack));
+
+	if (stacks == NULL) {
+		fail("could not allocate stack table");
+	}
+
+	for (i = 0; i < stack_count; ++i) {
+		if (fread(buffer, STACK_SIZE, 1, fp) != 1) {
+			fail("could not read stack table");
+		}
+
+		stacks[i].id = get_uint16(buffer);
+
+		memcpy(stacks[i].name, buffer + 2, STACK_NAME_LENGTH);
+	}
+
+	printf("# %u record(s), %.0f dropped, %u stack(s)\n",
+	       record_count, (double)dropped_records, stack_count);
+
+	for (i = 0; i < stack_count; ++i) {
+		printf("# stack %u: %s\n", stacks[i].id, stacks[i].name);
+	}
+
+	printf("# %-26s %12s %-16s %-24s %-8s %4s %3s %3s %3s %s\n",
+	       "time", "relative", "direction", "stack", "uid", "fid",
+	       "seq", "err", "len", "trace-id");
+
+	for (i = 0; i < record_count; ++i) {
+		if (fread(buffer, record_size, 1, fp) != 1) {
+			fail("could not read record, dump file is truncated");
+		}
+
+		timestamp = get_uint64(buffer);
+
+		if (i == 0) {
+			first_timestamp = timestamp;
+		}
+
+		// the record timestamps come from a monotonic clock, the dump header
+		// ties that clock to the wall clock with a resolution of one second
+		age = dump_timestamp > timestamp ? dump_timestamp - timestamp : 0;
+		seconds = (time_t)(dump_time - age / 1000000);
+		local = localtime(&seconds);
+
+		if (local == NULL ||
+		    strftime(time_string, sizeof(time_string), "%Y-%m-%d %H:%M:%S", local) == 0) {
+			strcpy(time_string, "?");
+		}
+
+		direction = buffer[24];
+		trace_id = get_uint64(buffer + 8);
+
+		base58_encode(uid, get_uint32(buffer + 16));
+
+		printf("%-28s %12.6f %-16s %-24s %-8s %4u %3u %3u %3u %08x%08x\n",
+		       time_string, (double)(timestamp - first_timestamp) / 1000000.0,
+		       direction < sizeof(_direction_names) / sizeof(_direction_names[0]) ?
+		       _direction_names[direction] : "?",
+		       get_stack_name(stacks, stack_count, get_uint16(buffer + 20)),
+		       uid, buffer[22], buffer[23], buffer[25], buffer[26],
+		       (uint32_t)(trace_id >> 32), (uint32_t)trace_id);
+	}
+
+	free(stacks);
+	fclose(fp);
+
+	return EXIT_SUCCESS;
+}
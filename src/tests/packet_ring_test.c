@@ -0,0 +1,255 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * packet_ring_test.c: Tests for the variable length packet ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <daemonlib/packet.h>
+
+#include "../brickd/packet_ring.h"
+
+#define MAX_EXPECTED 1024
+
+// the packets that should be in the ring, oldest first
+static uint32_t _expected_uids[MAX_EXPECTED];
+static int _expected_lengths[MAX_EXPECTED];
+static int _expected_head = 0;
+static int _expected_tail = 0;
+static uint32_t _next_uid = 1;
+
+static int push(PacketRing *ring, int length) {
+	Packet packet;
+	int i;
+
+	memset(&packet, 0, sizeof(packet));
+
+	packet.header.uid = _next_uid;
+	packet.header.length = (uint8_t)length;
+
+	for (i = 0; i < length - (int)sizeof(PacketHeader); ++i) {
+		((uint8_t *)&packet)[sizeof(PacketHeader) + i] = (uint8_t)(_next_uid + i);
+	}
+
+	if (packet_ring_push(ring, &packet) < 0) {
+		return -1;
+	}
+
+	_expected_uids[_expected_tail % MAX_EXPECTED] = _next_uid++;
+	_expected_lengths[_expected_tail % MAX_EXPECTED] = length;
+	++_expected_tail;
+
+	return 0;
+}
+
+static int pop(PacketRing *ring, const char *test) {
+	Packet *packet = packet_ring_peek(ring);
+	uint32_t uid;
+	int length;
+	int i;
+
+	if (_expected_head == _expected_tail) {
+		if (packet != NULL) {
+			printf("%s: ring not empty\n", test);
+
+			return -1;
+		}
+
+		return 0;
+	}
+
+	uid = _expected_uids[_expected_head % MAX_EXPECTED];
+	length = _expected_lengths[_expected_head % MAX_EXPECTED];
+
+	if (packet == NULL) {
+		printf("%s: ring empty too early (expected uid: %u)\n", test, uid);
+
+		return -1;
+	}
+
+	if (packet->header.uid != uid || packet->header.length != length) {
+		printf("%s: unexpected packet (uid: %u, length: %d), expected (uid: %u, length: %d)\n",
+		       test, packet->header.uid, packet->header.length, uid, length);
+
+		return -1;
+	}
+
+	for (i = 0; i < length - (int)sizeof(PacketHeader); ++i) {
+		if (((uint8_t *)packet)[sizeof(PacketHeader) + i] != (uint8_t)(uid + i)) {
+			printf("%s: corrupted payload (uid: %u, i: %d)\n", test, uid, i);
+
+			return -1;
+		}
+	}
+
+	packet_ring_pop(ring);
+	++_expected_head;
+
+	return 0;
+}
+
+// fill the initial buffer, make room at the front, wrap around and keep
+// pushing until the ring has to grow while it is wrapped. all packets come out
+// in order with their length and payload intact
+int test1(void) {
+	PacketRing ring;
+	uint32_t initial_size;
+	bool wrapped = false;
+	int i;
+
+	if (packet_ring_create(&ring, 8192) < 0) {
+		printf("test1: packet_ring_create failed\n");
+
+		return -1;
+	}
+
+	if (push(&ring, sizeof(Packet)) < 0) {
+		printf("test1: packet_ring_push failed\n");
+
+		return -1;
+	}
+
+	initial_size = ring.size;
+
+	while (ring.size - ring.tail >= sizeof(Packet)) {
+		if (push(&ring, sizeof(Packet)) < 0) {
+			printf("test1: packet_ring_push failed\n");
+
+			return -1;
+		}
+	}
+
+	for (i = 0; i < 6; ++i) {
+		if (pop(&ring, "test1") < 0) {
+			return -1;
+		}
+	}
+
+	// odd lengths, so the slots are rounded up and the end of the buffer gets
+	// skipped on wrap around
+	while (ring.size == initial_size) {
+		if (push(&ring, 13 + (_next_uid % 5) * 11) < 0) {
+			printf("test1: packet_ring_push failed\n");
+
+			return -1;
+		}
+
+		if (ring.size == initial_size && ring.tail < ring.head) {
+			wrapped = true;
+		}
+	}
+
+	if (!wrapped) {
+		printf("test1: ring did not wrap around before growing\n");
+
+		return -1;
+	}
+
+	if (ring.head != 0 || ring.count != _expected_tail - _expected_head) {
+		printf("test1: unexpected ring state after growing\n");
+
+		return -1;
+	}
+
+	// mix pushes and pops in the grown ring, then drain it
+	for (i = 0; i < 200; ++i) {
+		if (push(&ring, 8 + i % 73) < 0) {
+			printf("test1: packet_ring_push failed\n");
+
+			return -1;
+		}
+
+		if (i % 3 != 0 && pop(&ring, "test1") < 0) {
+			return -1;
+		}
+	}
+
+	while (_expected_head != _expected_tail) {
+		if (pop(&ring, "test1") < 0) {
+			return -1;
+		}
+	}
+
+	if (pop(&ring, "test1") < 0 || ring.count != 0 || ring.used != 0) {
+		printf("test1: ring not empty after draining\n");
+
+		return -1;
+	}
+
+	packet_ring_destroy(&ring);
+
+	return 0;
+}
+
+// a full ring at its maximum size rejects packets without losing any
+int test2(void) {
+	PacketRing ring;
+	int count = 0;
+
+	_expected_head = _expected_tail;
+
+	if (packet_ring_create(&ring, 1024) < 0) {
+		printf("test2: packet_ring_create failed\n");
+
+		return -1;
+	}
+
+	while (push(&ring, sizeof(Packet)) == 0) {
+		++count;
+	}
+
+	if (errno != ENOSPC || count != 1024 / (int)sizeof(Packet)) {
+		printf("test2: unexpected capacity %d\n", count);
+
+		return -1;
+	}
+
+	while (_expected_head != _expected_tail) {
+		if (pop(&ring, "test2") < 0) {
+			return -1;
+		}
+	}
+
+	packet_ring_destroy(&ring);
+
+	return 0;
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/*
+ * brickd
+ * Copyright (C) 2014 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * pearson_hash_test.c: Tests and micro-benchmark for the Pearson hash
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../brickd/pearson_hash.h"
+
+// byte-at-a-time hashing as done by red_stack_spi_calculate_pearson_hash before
+static uint8_t reference_hash(const uint8_t *data, const uint8_t length) {
+	uint8_t i;
+	uint8_t checksum = 0;
+
+	for (i = 0; i < length; i++) {
+		checksum = pearson_permutation[checksum ^ data[i]];
+	}
+
+	return checksum;
+}
+
+// known values, to detect changes to the permutation table
+int test1(void) {
+	uint8_t empty_packet[3] = { 0xAA, 0x04, 0x09 };
+	uint8_t counting[83];
+	int i;
+
+	for (i = 0; i < (int)sizeof(counting); ++i) {
+		counting[i] = (uint8_t)i;
+	}
+
+	if (pearson_hash((const uint8_t *)"", 0) != 0 ||
+	    pearson_hash((const uint8_t *)"abc", 3) != 223 ||
+	    pearson_hash(empty_packet, sizeof(empty_packet)) != 235 ||
+	    pearson_hash(counting, sizeof(counting)) != 233) {
+		printf("test1: hash mismatch\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+// all lengths of an SPI packet at all offsets within 4 bytes, to cover the
+// unrolled and the tail loop
+int test2(void) {
+	uint8_t data[96];
+	int length;
+	int offset;
+	int round;
+	int i;
+
+	for (round = 0; round < 100; ++round) {
+		for (i = 0; i < (int)sizeof(data); ++i) {
+			data[i] = (uint8_t)rand();
+		}
+
+		for (length = 0; length <= 84; ++length) {
+			for (offset = 0; offset < 4; ++offset) {
+				if (pearson_hash(data + offset, length) != reference_hash(data + offset, length)) {
+					printf("test2: hash mismatch (length: %d, offset: %d)\n", length, offset);
+
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// compare the speed on full SPI packets, informational only
+void benchmark(void) {
+	uint8_t data[83];
+	int count = 2000000;
+	int i;
+	unsigned int sink = 0;
+	clock_t start;
+	double reference_duration;
+	double duration;
+
+	for (i = 0; i < (int)sizeof(data); ++i) {
+		data[i] = (uint8_t)rand();
+	}
+
+	start = clock();
+
+	for (i = 0; i < count; ++i) {
+		data[0] = (uint8_t)i;
+		sink += reference_hash(data, sizeof(data));
+	}
+
+	reference_duration = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+
+	for (i = 0; i < count; ++i) {
+		data[0] = (uint8_t)i;
+		sink -= pearson_hash(data, sizeof(data));
+	}
+
+	duration = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("benchmark: %d packets, reference %.3f s, pearson_hash %.3f s (%u)\n",
+	       count, reference_duration, duration, sink);
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	benchmark();
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "../brickd/sha1.h"
 
@@ -157,33 +158,87 @@ int test6(void) {
 	return 0;
 }
 
-int main(void) {
-#ifdef _WIN32
-	fixes_init();
-#endif
+// hashes a 64 KiB buffer repeatedly in chunks of the given size
+void benchmark(int chunk_size) {
+	static uint8_t data[65536];
+	SHA1 sha1;
+	uint8_t digest[SHA1_DIGEST_LENGTH];
+	int total = 256 * 1024 * 1024;
+	int k;
+	int i;
+	clock_t start;
+	double elapsed;
 
-	if (test1() < 0) {
-		return EXIT_FAILURE;
+	for (i = 0; i < (int)sizeof(data); ++i) {
+		data[i] = (uint8_t)i;
 	}
 
-	if (test2() < 0) {
-		return EXIT_FAILURE;
+	start = clock();
+
+	sha1_init(&sha1);
+
+	for (k = 0; k < total; k += sizeof(data)) {
+		for (i = 0; i < (int)sizeof(data); i += chunk_size) {
+			sha1_update(&sha1, &data[i], chunk_size);
+		}
 	}
 
-	if (test3() < 0) {
-		return EXIT_FAILURE;
+	sha1_final(&sha1, digest);
+
+	elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%-8s chunk %5d: %8.1f MiB/s\n", sha1_get_backend(), chunk_size,
+	       elapsed > 0 ? total / elapsed / (1024 * 1024) : 0.0);
+}
+
+int run_tests(void) {
+	if (test1() < 0 || test2() < 0 || test3() < 0 ||
+	    test4() < 0 || test5() < 0 || test6() < 0) {
+		printf("%s backend failed\n", sha1_get_backend());
+
+		return -1;
 	}
 
-	if (test4() < 0) {
-		return EXIT_FAILURE;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int chunk_sizes[] = { 64, 1024, 65536 };
+	int i;
+
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	// pass "benchmark" to measure the throughput of the selected and the
+	// portable backend instead of running the tests
+	if (argc > 1 && strcmp(argv[1], "benchmark") == 0) {
+		for (i = 0; i < (int)(sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); ++i) {
+			benchmark(chunk_sizes[i]);
+		}
+
+		if (strcmp(sha1_get_backend(), "portable") != 0) {
+			sha1_disable_acceleration();
+
+			for (i = 0; i < (int)(sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); ++i) {
+				benchmark(chunk_sizes[i]);
+			}
+		}
+
+		return EXIT_SUCCESS;
 	}
 
-	if (test5() < 0) {
+	// test the selected backend first, then the portable one
+	if (run_tests() < 0) {
 		return EXIT_FAILURE;
 	}
 
-	if (test6() < 0) {
-		return EXIT_FAILURE;
+	if (strcmp(sha1_get_backend(), "portable") != 0) {
+		sha1_disable_acceleration();
+
+		if (run_tests() < 0) {
+			return EXIT_FAILURE;
+		}
 	}
 
 	printf("success\n");
@@ -0,0 +1,215 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * spsc_ring_test.c: Tests for the single-producer/single-consumer ring buffer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+#include "../brickd/spsc_ring.h"
+
+// fill and empty the ring, starting close to the 2^32 wrap around of the
+// free running head and tail counters
+int test1(void) {
+	SPSCRing ring;
+	uint32_t *item;
+	uint32_t value = 0;
+	uint32_t expected = 0;
+	int round;
+	int i;
+
+	if (spsc_ring_create(&ring, sizeof(uint32_t), 8) < 0) {
+		printf("test1: spsc_ring_create failed\n");
+
+		return -1;
+	}
+
+	ring.head = UINT32_MAX - 20;
+	ring.tail = UINT32_MAX - 20;
+
+	for (round = 0; round < 10; ++round) {
+		if (spsc_ring_peek(&ring) != NULL || spsc_ring_count(&ring) != 0) {
+			printf("test1: ring not empty (round: %d)\n", round);
+
+			return -1;
+		}
+
+		for (i = 0; i < 8; ++i) {
+			item = spsc_ring_reserve(&ring);
+
+			if (item == NULL) {
+				printf("test1: ring full too early (round: %d, i: %d)\n", round, i);
+
+				return -1;
+			}
+
+			*item = value++;
+
+			spsc_ring_commit(&ring);
+		}
+
+		if (spsc_ring_reserve(&ring) != NULL || !spsc_ring_is_full(&ring) ||
+		    !spsc_ring_was_full(&ring) || spsc_ring_count(&ring) != 8) {
+			printf("test1: ring not full (round: %d)\n", round);
+
+			return -1;
+		}
+
+		for (i = 0; i < 8; ++i) {
+			item = spsc_ring_peek(&ring);
+
+			if (item == NULL || *item != expected) {
+				printf("test1: unexpected item (round: %d, i: %d)\n", round, i);
+
+				return -1;
+			}
+
+			++expected;
+
+			spsc_ring_pop(&ring);
+
+			if (spsc_ring_is_full(&ring)) {
+				printf("test1: ring still full (round: %d, i: %d)\n", round, i);
+
+				return -1;
+			}
+		}
+	}
+
+	spsc_ring_destroy(&ring);
+
+	return 0;
+}
+
+// invalid capacities are rejected
+int test2(void) {
+	SPSCRing ring;
+
+	if (spsc_ring_create(&ring, sizeof(uint32_t), 0) == 0 ||
+	    spsc_ring_create(&ring, sizeof(uint32_t), 12) == 0 ||
+	    spsc_ring_create(&ring, 0, 8) == 0) {
+		printf("test2: invalid ring was created\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifndef _WIN32
+
+#define TEST3_COUNT 1000000
+
+static void *test3_producer(void *opaque) {
+	SPSCRing *ring = opaque;
+	uint32_t *item;
+	uint32_t value = 0;
+
+	while (value < TEST3_COUNT) {
+		item = spsc_ring_reserve(ring);
+
+		if (item == NULL) {
+			sched_yield();
+			continue;
+		}
+
+		*item = value++;
+
+		spsc_ring_commit(ring);
+	}
+
+	return NULL;
+}
+
+// one producer and one consumer thread, every item arrives once and in order
+int test3(void) {
+	SPSCRing ring;
+	pthread_t producer;
+	uint32_t *item;
+	uint32_t expected = 0;
+
+	if (spsc_ring_create(&ring, sizeof(uint32_t), 16) < 0) {
+		printf("test3: spsc_ring_create failed\n");
+
+		return -1;
+	}
+
+	if (pthread_create(&producer, NULL, test3_producer, &ring) != 0) {
+		printf("test3: pthread_create failed\n");
+
+		return -1;
+	}
+
+	while (expected < TEST3_COUNT) {
+		item = spsc_ring_peek(&ring);
+
+		if (item == NULL) {
+			sched_yield();
+			continue;
+		}
+
+		if (*item != expected) {
+			printf("test3: unexpected item %u, expected %u\n", *item, expected);
+
+			return -1;
+		}
+
+		++expected;
+
+		spsc_ring_pop(&ring);
+	}
+
+	pthread_join(producer, NULL);
+
+	spsc_ring_destroy(&ring);
+
+	return 0;
+}
+
+#endif
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+#ifndef _WIN32
+	if (test3() < 0) {
+		return EXIT_FAILURE;
+	}
+#endif
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}
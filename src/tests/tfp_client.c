@@ -0,0 +1,512 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * tfp_client.c: Non-blocking TFP client with pipelined requests for tests
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * unlike the C/C++ bindings this client never waits for a response. requests
+ * are sent with a completion function that is called from tfp_client_poll,
+ * so a single thread can keep many requests in flight on many connections.
+ * it speaks plain TFP or TFP over WebSocket
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+	#include <ws2tcpip.h>
+#else
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/select.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
+#include <daemonlib/utils.h>
+
+#include "tfp_client.h"
+
+#ifdef _WIN32
+	#define close_socket closesocket
+#else
+	#define INVALID_SOCKET -1
+	#define close_socket close
+#endif
+
+#define DEFAULT_TIMEOUT 2500 // milliseconds
+
+uint32_t tfp_get_uid(const uint8_t *packet) {
+	return (uint32_t)packet[0] | ((uint32_t)packet[1] << 8) |
+	       ((uint32_t)packet[2] << 16) | ((uint32_t)packet[3] << 24);
+}
+
+int tfp_client_init(void) {
+#ifdef _WIN32
+	WSADATA wsa_data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+		errno = EIO;
+
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+void tfp_client_exit(void) {
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+static int tfp_client_send_all(TFPClient *client, const void *buffer, int length) {
+	const char *p = buffer;
+	int rc;
+
+	while (length > 0) {
+		rc = send(client->fd, p, length, 0);
+
+		if (rc <= 0) {
+			errno = rc == 0 ? ECONNRESET : errno;
+
+			return -1;
+		}
+
+		p += rc;
+		length -= rc;
+	}
+
+	return 0;
+}
+
+// sets errno on error
+int tfp_client_open(TFPClient *client, const char *host, uint16_t port, bool websocket) {
+	struct addrinfo hints;
+	struct addrinfo *result;
+	char service[16];
+	const char *handshake =
+		"GET / HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"Sec-WebSocket-Protocol: tfp\r\n"
+		"\r\n";
+	char c;
+	int matched = 0;
+	int one = 1;
+
+	memset(client, 0, sizeof(*client));
+	memset(&hints, 0, sizeof(hints));
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	snprintf(service, sizeof(service), "%u", port);
+
+	if (getaddrinfo(host, service, &hints, &result) != 0) {
+		errno = EHOSTUNREACH;
+
+		return -1;
+	}
+
+	client->fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+	if (client->fd == INVALID_SOCKET) {
+		freeaddrinfo(result);
+
+		return -1;
+	}
+
+	if (connect(client->fd, result->ai_addr, (int)result->ai_addrlen) < 0) {
+		close_socket(client->fd);
+		freeaddrinfo(result);
+
+		return -1;
+	}
+
+	freeaddrinfo(result);
+
+	// latency would otherwise include Nagle's delay
+	setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+
+	client->websocket = websocket;
+	client->next_sequence_number = 1;
+	client->timeout = DEFAULT_TIMEOUT * 1000;
+
+	if (!websocket) {
+		return 0;
+	}
+
+	if (tfp_client_send_all(client, handshake, (int)strlen(handshake)) < 0) {
+		close_socket(client->fd);
+
+		return -1;
+	}
+
+	// skip the handshake response up to the empty line, byte by byte to not
+	// consume the first frame
+	while (matched < 4) {
+		if (recv(client->fd, &c, 1, 0) != 1) {
+			close_socket(client->fd);
+
+			errno = ECONNRESET;
+
+			return -1;
+		}
+
+		if (c == "\r\n\r\n"[matched]) {
+			++matched;
+		} else {
+			matched = c == '\r' ? 1 : 0;
+		}
+	}
+
+	return 0;
+}
+
+// requests still in flight are dropped without calling their function
+void tfp_client_close(TFPClient *client) {
+	close_socket(client->fd);
+}
+
+void tfp_client_set_callback(TFPClient *client, TFPCallbackFunction function, void *opaque) {
+	client->callback = function;
+	client->callback_opaque = opaque;
+}
+
+void tfp_client_set_timeout(TFPClient *client, uint32_t timeout) {
+	client->timeout = (uint64_t)timeout * 1000;
+}
+
+static int tfp_client_send_packet(TFPClient *client, uint32_t uid, uint8_t function_id,
+                                  uint8_t sequence_number, bool response_expected,
+                                  const void *payload, int payload_length) {
+	uint8_t frame[6 + TFP_MAX_PACKET_LENGTH];
+	uint8_t *packet = client->websocket ? frame + 6 : frame;
+	int length = TFP_HEADER_LENGTH + payload_length;
+
+	if (payload_length < 0 || length > TFP_MAX_PACKET_LENGTH) {
+		errno = EINVAL;
+
+		return -1;
+	}
+
+	packet[0] = uid & 0xFF;
+	packet[1] = (uid >> 8) & 0xFF;
+	packet[2] = (uid >> 16) & 0xFF;
+	packet[3] = (uid >> 24) & 0xFF;
+	packet[4] = (uint8_t)length;
+	packet[5] = function_id;
+	packet[6] = (uint8_t)(sequence_number << 4) | (response_expected ? 0x08 : 0x00);
+	packet[7] = 0;
+
+	if (payload_length > 0) {
+		memcpy(packet + TFP_HEADER_LENGTH, payload, payload_length);
+	}
+
+	if (!client->websocket) {
+		return tfp_client_send_all(client, packet, length);
+	}
+
+	// binary frame, fin set, masked with an all-zero key
+	frame[0] = 0x82;
+	frame[1] = 0x80 | (uint8_t)length;
+
+	memset(frame + 2, 0, 4);
+
+	return tfp_client_send_all(client, frame, 6 + length);
+}
+
+// sets errno on error, EAGAIN if TFP_MAX_IN_FLIGHT requests are in flight
+int tfp_client_send_request(TFPClient *client, uint32_t uid, uint8_t function_id,
+                            const void *payload, int payload_length,
+                            TFPResponseFunction function, void *opaque) {
+	TFPRequest *request;
+	uint8_t sequence_number;
+	uint64_t sent_at = microseconds();
+
+	if (client->in_flight >= TFP_MAX_IN_FLIGHT) {
+		errno = EAGAIN;
+
+		return -1;
+	}
+
+	while (client->requests[client->next_sequence_number].used) {
+		client->next_sequence_number = client->next_sequence_number % TFP_MAX_IN_FLIGHT + 1;
+	}
+
+	sequence_number = client->next_sequence_number;
+	client->next_sequence_number = sequence_number % TFP_MAX_IN_FLIGHT + 1;
+
+	if (tfp_client_send_packet(client, uid, function_id, sequence_number, true,
+	                           payload, payload_length) < 0) {
+		return -1;
+	}
+
+	request = &client->requests[sequence_number];
+
+	request->used = true;
+	request->uid = uid;
+	request->function_id = function_id;
+	request->sent_at = sent_at;
+	request->function = function;
+	request->opaque = opaque;
+
+	++client->in_flight;
+
+	return 0;
+}
+
+// sets errno on error
+int tfp_client_send_oneway(TFPClient *client, uint32_t uid, uint8_t function_id,
+                           const void *payload, int payload_length) {
+	uint8_t sequence_number = client->next_sequence_number;
+
+	// brickd expects a non-zero sequence number also without response
+	client->next_sequence_number = sequence_number % TFP_MAX_IN_FLIGHT + 1;
+
+	return tfp_client_send_packet(client, uid, function_id, sequence_number, false,
+	                              payload, payload_length);
+}
+
+// moves websocket payload from raw to stream
+static void tfp_client_unframe(TFPClient *client) {
+	int offset = 0;
+	int header_length;
+	int length;
+	int i;
+
+	while (offset < client->raw_used) {
+		if (client->frame_remaining == 0) {
+			if (client->raw_used - offset < 2) {
+				break;
+			}
+
+			length = client->raw[offset + 1] & 0x7F;
+			header_length = 2 + (length == 126 ? 2 : (length == 127 ? 8 : 0));
+
+			if (client->raw_used - offset < header_length) {
+				break;
+			}
+
+			if (length == 126) {
+				client->frame_remaining = ((uint64_t)client->raw[offset + 2] << 8) | client->raw[offset + 3];
+			} else if (length == 127) {
+				client->frame_remaining = 0;
+
+				for (i = 0; i < 8; ++i) {
+					client->frame_remaining = (client->frame_remaining << 8) | client->raw[offset + 2 + i];
+				}
+			} else {
+				client->frame_remaining = length;
+			}
+
+			// continuation or binary frame
+			client->frame_is_data = (client->raw[offset] & 0x0F) == 0x00 ||
+			                        (client->raw[offset] & 0x0F) == 0x02;
+			offset += header_length;
+
+			continue;
+		}
+
+		length = client->raw_used - offset;
+
+		if ((uint64_t)length > client->frame_remaining) {
+			length = (int)client->frame_remaining;
+		}
+
+		if (client->frame_is_data) {
+			if (length > (int)sizeof(client->stream) - client->stream_used) {
+				length = (int)sizeof(client->stream) - client->stream_used;
+			}
+
+			if (length == 0) {
+				break;
+			}
+
+			memcpy(client->stream + client->stream_used, client->raw + offset, length);
+
+			client->stream_used += length;
+		}
+
+		client->frame_remaining -= length;
+		offset += length;
+	}
+
+	memmove(client->raw, client->raw + offset, client->raw_used - offset);
+
+	client->raw_used -= offset;
+}
+
+static void tfp_client_handle_packet(TFPClient *client, const uint8_t *packet) {
+	uint8_t sequence_number = packet[6] >> 4;
+	TFPRequest *request = &client->requests[sequence_number];
+	TFPResponseFunction function;
+
+	++client->received_packets;
+
+	if (sequence_number != 0 && request->used &&
+	    request->uid == tfp_get_uid(packet) && request->function_id == packet[5]) {
+		function = request->function;
+		request->used = false;
+
+		--client->in_flight;
+
+		if (function != NULL) {
+			function(client, packet, microseconds() - request->sent_at, request->opaque);
+		}
+	} else if (client->callback != NULL) {
+		client->callback(client, packet, client->callback_opaque);
+	}
+}
+
+// sets errno on error
+static int tfp_client_read(TFPClient *client) {
+	uint8_t *buffer;
+	int available;
+	int length;
+	int rc;
+	int handled = 0;
+
+	if (client->websocket) {
+		buffer = client->raw + client->raw_used;
+		available = (int)sizeof(client->raw) - client->raw_used;
+	} else {
+		buffer = client->stream + client->stream_used;
+		available = (int)sizeof(client->stream) - client->stream_used;
+	}
+
+	rc = recv(client->fd, (char *)buffer, available, 0);
+
+	if (rc <= 0) {
+		errno = rc == 0 ? ECONNRESET : errno;
+
+		return -1;
+	}
+
+	if (client->websocket) {
+		client->raw_used += rc;
+
+		tfp_client_unframe(client);
+	} else {
+		client->stream_used += rc;
+	}
+
+	while (client->stream_used >= TFP_HEADER_LENGTH) {
+		length = client->stream[4];
+
+		if (length < TFP_HEADER_LENGTH || length > TFP_MAX_PACKET_LENGTH) {
+			errno = EPROTO;
+
+			return -1;
+		}
+
+		if (client->stream_used < length) {
+			break;
+		}
+
+		tfp_client_handle_packet(client, client->stream);
+
+		memmove(client->stream, client->stream + length, client->stream_used - length);
+
+		client->stream_used -= length;
+		++handled;
+	}
+
+	return handled;
+}
+
+static void tfp_client_expire_requests(TFPClient *client, uint64_t now) {
+	TFPRequest *request;
+	int i;
+
+	for (i = 1; client->in_flight > 0 && i <= TFP_MAX_IN_FLIGHT; ++i) {
+		request = &client->requests[i];
+
+		if (!request->used || now - request->sent_at < client->timeout) {
+			continue;
+		}
+
+		request->used = false;
+
+		--client->in_flight;
+
+		if (request->function != NULL) {
+			request->function(client, NULL, now - request->sent_at, request->opaque);
+		}
+	}
+}
+
+// waits up to timeout for data on any of the clients and calls the functions
+// of received responses, callbacks and expired requests. returns the number
+// of received packets, sets errno on error
+int tfp_client_poll(TFPClient **clients, int count, uint32_t timeout) {
+	fd_set fds;
+	struct timeval tv;
+	tfp_socket_t max_fd = 0;
+	uint64_t now;
+	int handled = 0;
+	int rc;
+	int i;
+
+	FD_ZERO(&fds);
+
+	for (i = 0; i < count; ++i) {
+		FD_SET(clients[i]->fd, &fds);
+
+		if (clients[i]->fd > max_fd) {
+			max_fd = clients[i]->fd;
+		}
+	}
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	rc = select((int)max_fd + 1, &fds, NULL, NULL, &tv);
+
+	if (rc < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (!FD_ISSET(clients[i]->fd, &fds)) {
+			continue;
+		}
+
+		rc = tfp_client_read(clients[i]);
+
+		if (rc < 0) {
+			return -1;
+		}
+
+		handled += rc;
+	}
+
+	now = microseconds();
+
+	for (i = 0; i < count; ++i) {
+		tfp_client_expire_requests(clients[i], now);
+	}
+
+	return handled;
+}
@@ -0,0 +1,105 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * tfp_client.h: Non-blocking TFP client with pipelined requests for tests
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BRICKD_TFP_CLIENT_H
+#define BRICKD_TFP_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#ifdef _WIN32
+	#include <winsock2.h>
+#endif
+
+#ifdef _WIN32
+	typedef SOCKET tfp_socket_t;
+#else
+	typedef int tfp_socket_t;
+#endif
+
+#define TFP_UID_BRICK_DAEMON 1
+#define TFP_FUNCTION_GET_AUTHENTICATION_NONCE 1
+#define TFP_CALLBACK_ENUMERATE 253
+#define TFP_FUNCTION_ENUMERATE 254
+#define TFP_FUNCTION_GET_IDENTITY 255
+
+#define TFP_HEADER_LENGTH 8
+#define TFP_MAX_PACKET_LENGTH 80
+
+// sequence numbers 1 to 15 are used for requests expecting a response, this
+// limits a connection to 15 requests in flight
+#define TFP_MAX_IN_FLIGHT 15
+
+typedef struct _TFPClient TFPClient;
+
+// the response is NULL if the request timed out
+typedef void (*TFPResponseFunction)(TFPClient *client, const uint8_t *response,
+                                    uint64_t latency /* microseconds */, void *opaque);
+
+// called for callbacks and for responses that match no request in flight
+typedef void (*TFPCallbackFunction)(TFPClient *client, const uint8_t *packet, void *opaque);
+
+typedef struct {
+	bool used;
+	uint32_t uid;
+	uint8_t function_id;
+	uint64_t sent_at; // microseconds
+	TFPResponseFunction function;
+	void *opaque;
+} TFPRequest;
+
+struct _TFPClient {
+	tfp_socket_t fd;
+	bool websocket;
+	uint8_t raw[8192]; // received bytes, still websocket framed
+	int raw_used;
+	uint64_t frame_remaining; // websocket payload left in the current frame
+	bool frame_is_data;
+	uint8_t stream[8192]; // received TFP bytes
+	int stream_used;
+	uint8_t next_sequence_number;
+	TFPRequest requests[TFP_MAX_IN_FLIGHT + 1]; // indexed by sequence number
+	int in_flight;
+	uint64_t timeout; // microseconds
+	TFPCallbackFunction callback;
+	void *callback_opaque;
+	uint32_t received_packets;
+};
+
+int tfp_client_init(void);
+void tfp_client_exit(void);
+
+int tfp_client_open(TFPClient *client, const char *host, uint16_t port, bool websocket);
+void tfp_client_close(TFPClient *client);
+
+void tfp_client_set_callback(TFPClient *client, TFPCallbackFunction function, void *opaque);
+void tfp_client_set_timeout(TFPClient *client, uint32_t timeout /* milliseconds */);
+
+int tfp_client_send_request(TFPClient *client, uint32_t uid, uint8_t function_id,
+                            const void *payload, int payload_length,
+                            TFPResponseFunction function, void *opaque);
+int tfp_client_send_oneway(TFPClient *client, uint32_t uid, uint8_t function_id,
+                           const void *payload, int payload_length);
+
+int tfp_client_poll(TFPClient **clients, int count, uint32_t timeout /* milliseconds */);
+
+uint32_t tfp_get_uid(const uint8_t *packet);
+
+#endif // BRICKD_TFP_CLIENT_H
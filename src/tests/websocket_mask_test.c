@@ -0,0 +1,147 @@
+/*
+ * brickd
+ * Copyright (C) 2026 Matthias Bolte <matthias@tinkerforge.com>
+ *
+ * websocket_mask_test.c: Tests for the WebSocket payload unmasking
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../brickd/websocket_mask.h"
+
+// byte-at-a-time unmasking as done by websocket_parse_data before
+static int reference_mask(uint8_t *data, int length,
+                          const uint8_t masking_key[WEBSOCKET_MASK_LENGTH], int mask_index) {
+	int i;
+
+	for (i = 0; i < length; i++) {
+		data[i] ^= masking_key[mask_index];
+		mask_index++;
+
+		if (mask_index >= WEBSOCKET_MASK_LENGTH) {
+			mask_index = 0;
+		}
+	}
+
+	return mask_index;
+}
+
+// all lengths up to 100 bytes at all offsets within 16 bytes and with all
+// starting positions in the key, to cover the SSE2, word and byte paths
+int test1(void) {
+	uint8_t masking_key[WEBSOCKET_MASK_LENGTH] = { 0x37, 0xFA, 0x21, 0x3D };
+	uint8_t input[128];
+	uint8_t expected[128];
+	uint8_t actual[128];
+	int length;
+	int offset;
+	int mask_index;
+	int expected_index;
+	int actual_index;
+	int i;
+
+	for (i = 0; i < (int)sizeof(input); ++i) {
+		input[i] = (uint8_t)rand();
+	}
+
+	for (length = 0; length <= 100; ++length) {
+		for (offset = 0; offset < 16; ++offset) {
+			for (mask_index = 0; mask_index < WEBSOCKET_MASK_LENGTH; ++mask_index) {
+				memcpy(expected, input, sizeof(input));
+				memcpy(actual, input, sizeof(input));
+
+				expected_index = reference_mask(expected + offset, length, masking_key, mask_index);
+				actual_index = websocket_mask(actual + offset, length, masking_key, mask_index);
+
+				if (memcmp(expected, actual, sizeof(input)) != 0) {
+					printf("test1: data mismatch (length: %d, offset: %d, mask-index: %d)\n",
+					       length, offset, mask_index);
+
+					return -1;
+				}
+
+				if (expected_index != actual_index) {
+					printf("test1: mask index mismatch (length: %d, offset: %d, mask-index: %d)\n",
+					       length, offset, mask_index);
+
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// unmasking a payload in several pieces, as it arrives over several receives,
+// gives the same result as unmasking it at once
+int test2(void) {
+	uint8_t masking_key[WEBSOCKET_MASK_LENGTH] = { 0x01, 0x80, 0xFF, 0x5A };
+	uint8_t expected[4096];
+	uint8_t actual[4096];
+	int mask_index = 0;
+	int offset = 0;
+	int length;
+	int i;
+
+	for (i = 0; i < (int)sizeof(expected); ++i) {
+		expected[i] = (uint8_t)rand();
+	}
+
+	memcpy(actual, expected, sizeof(expected));
+
+	reference_mask(expected, sizeof(expected), masking_key, 0);
+
+	while (offset < (int)sizeof(actual)) {
+		length = 1 + rand() % 200;
+
+		if (length > (int)sizeof(actual) - offset) {
+			length = (int)sizeof(actual) - offset;
+		}
+
+		mask_index = websocket_mask(actual + offset, length, masking_key, mask_index);
+		offset += length;
+	}
+
+	if (memcmp(expected, actual, sizeof(expected)) != 0) {
+		printf("test2: data mismatch\n");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(void) {
+#ifdef _WIN32
+	fixes_init();
+#endif
+
+	if (test1() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (test2() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	printf("success\n");
+
+	return EXIT_SUCCESS;
+}